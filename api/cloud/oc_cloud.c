@@ -21,6 +21,7 @@
 
 #ifdef OC_CLOUD
 
+#include "api/oc_ri_internal.h"
 #include "api/oc_server_api_internal.h"
 #include "oc_api.h"
 #include "oc_cloud_context_internal.h"
@@ -124,6 +125,43 @@ cloud_close_endpoint(const oc_endpoint_t *cloud_ep)
   }
 }
 
+/* Requests of a device carry either its context or the parameters of a cloud
+ * API call as user data. */
+static bool
+cloud_client_cb_of_context(const oc_client_cb_t *cb, const void *filter_data)
+{
+  const oc_cloud_context_t *ctx = (const oc_cloud_context_t *)filter_data;
+  if (oc_endpoint_compare(&cb->endpoint, ctx->cloud_ep) != 0) {
+    return false;
+  }
+  if (cb->user_data == ctx) {
+    return true;
+  }
+  const cloud_api_param_t *p = cloud_api_param_find(cb->user_data);
+  return p != NULL && p->ctx == ctx;
+}
+
+void
+cloud_interrupt_requests(const oc_cloud_context_t *ctx)
+{
+  oc_ri_free_client_cbs_by_filter(cloud_client_cb_of_context, ctx,
+                                  OC_CONNECTION_CLOSED);
+}
+
+void
+cloud_release_endpoint(oc_cloud_context_t *ctx)
+{
+  size_t refs = cloud_context_session_refs(ctx->cloud_ep);
+  if (refs > 1) {
+    OC_DBG("cloud_release_endpoint: session shared by %zu devices", refs);
+    cloud_interrupt_requests(ctx);
+  } else if (refs == 1) {
+    cloud_close_endpoint(ctx->cloud_ep);
+  }
+  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
+  ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+}
+
 int
 cloud_reset(size_t device, bool sync, uint16_t timeout)
 {
@@ -179,9 +217,7 @@ oc_cloud_provision_conf_resource(oc_cloud_context_t *ctx, const char *server,
     return -1;
   }
 
-  cloud_close_endpoint(ctx->cloud_ep);
-  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
-  ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+  cloud_release_endpoint(ctx);
   cloud_store_initialize(&ctx->store);
   cloud_manager_stop(ctx);
   cloud_deregister_stop(ctx);
@@ -226,9 +262,7 @@ cloud_update_by_resource(oc_cloud_context_t *ctx,
   // if deregistering or other cloud API was active then closing of the endpoint
   // triggers the handler with timeout error, which ensures that/ the operation
   // is interrupted
-  cloud_close_endpoint(ctx->cloud_ep);
-  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
-  ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+  cloud_release_endpoint(ctx);
   cloud_store_initialize(&ctx->store);
   cloud_manager_stop(ctx);
   cloud_deregister_stop(ctx);
@@ -250,14 +284,9 @@ cloud_update_by_resource(oc_cloud_context_t *ctx,
 
 #ifdef OC_SESSION_EVENTS
 static void
-cloud_ep_session_event_handler(const oc_endpoint_t *endpoint,
-                               oc_session_state_t state, void *user_data)
+cloud_ep_session_state_changed(oc_cloud_context_t *ctx, void *user_data)
 {
-  oc_cloud_context_t *ctx = (oc_cloud_context_t *)user_data;
-  if (oc_endpoint_compare(endpoint, ctx->cloud_ep) != 0) {
-    OC_DBG("session handler skipped: endpoint does not match");
-    return;
-  }
+  oc_session_state_t state = *(oc_session_state_t *)user_data;
   OC_DBG("[CM] cloud_ep_session_event_handler ep_state: %d (current: %d)",
          (int)state, (int)ctx->cloud_ep_state);
   bool state_changed = ctx->cloud_ep_state != state;
@@ -271,6 +300,36 @@ cloud_ep_session_event_handler(const oc_endpoint_t *endpoint,
     cloud_manager_restart(ctx);
   }
 }
+
+/* A single handler serves all devices, the event of a session is dispatched
+ * to each device connected through it. */
+static void
+cloud_ep_session_event_handler(const oc_endpoint_t *endpoint,
+                               oc_session_state_t state, void *user_data)
+{
+  (void)user_data;
+  cloud_context_iterate_session(endpoint, NULL, cloud_ep_session_state_changed,
+                                &state);
+}
+
+static void
+cloud_has_manager(oc_cloud_context_t *ctx, void *user_data)
+{
+  if (ctx->cloud_manager) {
+    *(bool *)user_data = true;
+  }
+}
+
+static void
+cloud_remove_session_event_callback(void)
+{
+  bool has_manager = false;
+  cloud_context_iterate(cloud_has_manager, &has_manager);
+  if (!has_manager) {
+    oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, NULL,
+                                        false);
+  }
+}
 #endif /* OC_SESSION_EVENTS */
 
 static void
@@ -330,7 +389,9 @@ oc_cloud_manager_restart(oc_cloud_context_t *ctx)
 {
   OC_DBG("[CM] oc_cloud_manager_restart");
 #ifdef OC_SESSION_EVENTS
-  if (ctx->cloud_ep_state == OC_SESSION_CONNECTED) {
+  // the manager is restarted by the disconnection of an unshared session
+  if (ctx->cloud_ep_state == OC_SESSION_CONNECTED &&
+      cloud_context_session_refs(ctx->cloud_ep) == 1) {
     bool is_tcp = (ctx->cloud_ep->flags & TCP) != 0;
     cloud_close_endpoint(ctx->cloud_ep);
     if (is_tcp) {
@@ -338,6 +399,7 @@ oc_cloud_manager_restart(oc_cloud_context_t *ctx)
     }
   }
 #endif /* OC_SESSION_EVENTS */
+  cloud_interrupt_requests(ctx);
   oc_remove_delayed_callback(ctx, restart_manager);
   oc_set_delayed_callback(ctx, restart_manager, 0);
 }
@@ -355,10 +417,10 @@ oc_cloud_manager_start(oc_cloud_context_t *ctx, oc_cloud_cb_t cb, void *data)
   cloud_manager_start(ctx);
   ctx->cloud_manager = true;
 #ifdef OC_SESSION_EVENTS
-  oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, ctx,
+  oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, NULL,
                                       false);
   oc_remove_network_interface_event_callback(cloud_interface_event_handler);
-  oc_add_session_event_callback_v1(cloud_ep_session_event_handler, ctx);
+  oc_add_session_event_callback_v1(cloud_ep_session_event_handler, NULL);
   oc_add_network_interface_event_callback(cloud_interface_event_handler);
 #endif /* OC_SESSION_EVENTS */
 
@@ -372,8 +434,6 @@ oc_cloud_manager_stop(oc_cloud_context_t *ctx)
     return -1;
   }
 #ifdef OC_SESSION_EVENTS
-  oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, ctx,
-                                      false);
   if (cloud_context_size() == 0) {
     oc_remove_network_interface_event_callback(cloud_interface_event_handler);
   }
@@ -383,10 +443,11 @@ oc_cloud_manager_stop(oc_cloud_context_t *ctx)
   cloud_rd_reset_context(ctx);
   cloud_manager_stop(ctx);
   cloud_store_initialize(&ctx->store);
-  cloud_close_endpoint(ctx->cloud_ep);
-  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
-  ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+  cloud_release_endpoint(ctx);
   ctx->cloud_manager = false;
+#ifdef OC_SESSION_EVENTS
+  cloud_remove_session_event_callback();
+#endif /* OC_SESSION_EVENTS */
   return 0;
 }
 
@@ -414,12 +475,12 @@ oc_cloud_shutdown(void)
       continue;
     }
     cloud_manager_stop(ctx);
-#ifdef OC_SESSION_EVENTS
-    oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, ctx,
-                                        false);
-#endif /* OC_SESSION_EVENTS */
     cloud_context_deinit(ctx);
     OC_DBG("cloud_shutdown for %d", (int)device);
   }
+#ifdef OC_SESSION_EVENTS
+  oc_remove_session_event_callback_v1(cloud_ep_session_event_handler, NULL,
+                                      false);
+#endif /* OC_SESSION_EVENTS */
 }
 #endif /* OC_CLOUD */
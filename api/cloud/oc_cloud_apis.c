@@ -43,24 +43,52 @@
 // cloud_deregister might invoke cloud_refresh_token or cloud_login so we might
 // have 2 concurrent allocations per device
 OC_MEMB(g_api_params, cloud_api_param_t, OC_MAX_NUM_DEVICES * 2);
+// allocated parameters, the user data of pending requests is looked up in it
+OC_LIST(g_api_params_list);
 
 cloud_api_param_t *
 alloc_api_param(void)
 {
-  return (cloud_api_param_t *)oc_memb_alloc(&g_api_params);
+  cloud_api_param_t *p = (cloud_api_param_t *)oc_memb_alloc(&g_api_params);
+  if (p != NULL) {
+    oc_list_add(g_api_params_list, p);
+  }
+  return p;
 }
 
 void
 free_api_param(cloud_api_param_t *p)
 {
+  if (p == NULL) {
+    return;
+  }
+  oc_list_remove(g_api_params_list, p);
   oc_memb_free(&g_api_params, p);
 }
 
+const cloud_api_param_t *
+cloud_api_param_find(const void *user_data)
+{
+  const cloud_api_param_t *p = oc_list_head(g_api_params_list);
+  while (p != NULL && p != user_data) {
+    p = p->next;
+  }
+  return p;
+}
+
 int
 conv_cloud_endpoint(oc_cloud_context_t *ctx)
 {
   int ret = 0;
   if (ctx->cloud_ep != NULL && oc_endpoint_is_empty(ctx->cloud_ep)) {
+    // devices logged in to the same cloud server share the resolved endpoint
+    // and the session
+    const oc_cloud_context_t *other =
+      cloud_context_find_logged_in_to_server(ctx);
+    if (other != NULL) {
+      oc_endpoint_copy(ctx->cloud_ep, other->cloud_ep);
+      return 0;
+    }
     ret = oc_string_to_endpoint(&ctx->store.ci_server, ctx->cloud_ep, NULL);
 #ifdef OC_DNS_CACHE
     oc_dns_clear_cache();
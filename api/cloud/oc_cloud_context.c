@@ -34,6 +34,7 @@
 #endif /* OC_SECURITY */
 
 #include <assert.h>
+#include <string.h>
 
 OC_LIST(g_cloud_context_list);
 OC_MEMB(g_cloud_context_pool, oc_cloud_context_t, OC_MAX_NUM_DEVICES);
@@ -101,7 +102,7 @@ cloud_context_deinit(oc_cloud_context_t *ctx)
   // when the device is shut down during de-registration.
   reinitialize_cloud_storage(ctx);
   cloud_store_deinitialize(&ctx->store);
-  cloud_close_endpoint(ctx->cloud_ep);
+  cloud_release_endpoint(ctx);
   oc_free_endpoint(ctx->cloud_ep);
   oc_list_remove(g_cloud_context_list, ctx);
   oc_memb_free(&g_cloud_context_pool, ctx);
@@ -126,6 +127,54 @@ cloud_context_iterate(cloud_context_iterator_cb_t cb, void *user_data)
   }
 }
 
+void
+cloud_context_iterate_session(const oc_endpoint_t *endpoint,
+                              const oc_cloud_context_t *exclude,
+                              cloud_context_iterator_cb_t cb, void *user_data)
+{
+  assert(endpoint != NULL);
+  for (oc_cloud_context_t *ctx = oc_list_head(g_cloud_context_list);
+       ctx != NULL; ctx = ctx->next) {
+    if (ctx != exclude && ctx->cloud_manager &&
+        oc_endpoint_compare(endpoint, ctx->cloud_ep) == 0) {
+      cb(ctx, user_data);
+    }
+  }
+}
+
+size_t
+cloud_context_session_refs(const oc_endpoint_t *endpoint)
+{
+  assert(endpoint != NULL);
+  size_t refs = 0;
+  for (const oc_cloud_context_t *ctx = oc_list_head(g_cloud_context_list);
+       ctx != NULL; ctx = ctx->next) {
+    if (oc_endpoint_compare(endpoint, ctx->cloud_ep) == 0) {
+      ++refs;
+    }
+  }
+  return refs;
+}
+
+const oc_cloud_context_t *
+cloud_context_find_logged_in_to_server(const oc_cloud_context_t *ctx)
+{
+  const char *ci_server = oc_string(ctx->store.ci_server);
+  if (ci_server == NULL) {
+    return NULL;
+  }
+  for (const oc_cloud_context_t *other = oc_list_head(g_cloud_context_list);
+       other != NULL; other = other->next) {
+    if (other != ctx && (other->store.status & OC_CLOUD_LOGGED_IN) != 0 &&
+        oc_string(other->store.ci_server) != NULL &&
+        strcmp(oc_string(other->store.ci_server), ci_server) == 0 &&
+        !oc_endpoint_is_empty(other->cloud_ep)) {
+      return other;
+    }
+  }
+  return NULL;
+}
+
 void
 cloud_context_clear(oc_cloud_context_t *ctx)
 {
@@ -138,9 +187,7 @@ oc_cloud_context_clear(oc_cloud_context_t *ctx, bool dump_async)
   assert(ctx != NULL);
 
   cloud_rd_reset_context(ctx);
-  cloud_close_endpoint(ctx->cloud_ep);
-  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
-  ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+  cloud_release_endpoint(ctx);
   cloud_manager_stop(ctx);
   cloud_deregister_stop(ctx);
   cloud_store_initialize(&ctx->store);
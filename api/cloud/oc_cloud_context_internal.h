@@ -57,6 +57,42 @@ typedef void (*cloud_context_iterator_cb_t)(oc_cloud_context_t *ctx,
 /// Iterate over allocated cloud contexts;
 void cloud_context_iterate(cloud_context_iterator_cb_t cb, void *user_data);
 
+/**
+ * @brief Iterate over contexts with a running cloud manager connected through
+ * the session of the endpoint.
+ *
+ * Cloud endpoints of all devices are resolved with the same device index, so
+ * devices connected to the same cloud server share a single TCP/TLS session.
+ *
+ * @param endpoint endpoint of the session (cannot be NULL)
+ * @param exclude context to skip (can be NULL)
+ * @param cb callback invoked for each context (cannot be NULL)
+ * @param user_data user data passed to the callback
+ */
+void cloud_context_iterate_session(const oc_endpoint_t *endpoint,
+                                   const oc_cloud_context_t *exclude,
+                                   cloud_context_iterator_cb_t cb,
+                                   void *user_data);
+
+/**
+ * @brief Get the number of contexts using the session of the endpoint.
+ *
+ * @param endpoint endpoint of the session (cannot be NULL)
+ * @return number of contexts with the endpoint, 0 for an empty endpoint
+ */
+size_t cloud_context_session_refs(const oc_endpoint_t *endpoint);
+
+/**
+ * @brief Find a context of another device logged in to the cloud server of the
+ * context.
+ *
+ * @param ctx cloud context (cannot be NULL)
+ * @return context logged in to the same cloud server
+ * @return NULL if no such context exists
+ */
+const oc_cloud_context_t *cloud_context_find_logged_in_to_server(
+  const oc_cloud_context_t *ctx);
+
 /// @brief Clear cloud context values
 void cloud_context_clear(oc_cloud_context_t *ctx);
 
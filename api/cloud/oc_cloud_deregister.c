@@ -29,6 +29,8 @@
 #include "oc_cloud_manager_internal.h"
 #include "oc_cloud_store_internal.h"
 
+#include <string.h>
+
 #ifdef OC_SECURITY
 
 static void
@@ -126,6 +128,8 @@ cloud_deregistered_internal(oc_client_response_t *data)
   if (data->code < OC_STATUS_BAD_REQUEST ||
       cloud_is_connection_error_code(data->code)) {
     ctx->store.status = OC_CLOUD_DEREGISTERED;
+    // links of a deregistered device are removed from the resource directory
+    memset(ctx->store.rd_digests, 0, sizeof(ctx->store.rd_digests));
   } else if (data->code >= OC_STATUS_BAD_REQUEST) {
     cloud_set_last_error(ctx, CLOUD_ERROR_RESPONSE);
     ctx->store.status |= OC_CLOUD_FAILURE;
@@ -39,6 +39,35 @@ extern "C" {
  */
 #define RD_PUBLISH_TTL_UNLIMITED 0
 
+/**
+ * Delay in milliseconds before changed resource links are published, all
+ * changes made during the delay are published together.
+ */
+#ifndef OC_CLOUD_RD_PUBLISH_DELAY_MS
+#define OC_CLOUD_RD_PUBLISH_DELAY_MS (100)
+#endif /* OC_CLOUD_RD_PUBLISH_DELAY_MS */
+
+/**
+ * Upper bound of the estimated encoded size of resource links published by a
+ * single request. A link larger than the bound is published alone.
+ */
+#ifndef OC_CLOUD_RD_PUBLISH_BATCH_SIZE
+#define OC_CLOUD_RD_PUBLISH_BATCH_SIZE (1024)
+#endif /* OC_CLOUD_RD_PUBLISH_BATCH_SIZE */
+
+/**
+ * Delay in milliseconds before a failed resource directory request is retried,
+ * the delay doubles with each failure in a row up to
+ * OC_CLOUD_RD_RETRY_MAX_DELAY_MS.
+ */
+#ifndef OC_CLOUD_RD_RETRY_DELAY_MS
+#define OC_CLOUD_RD_RETRY_DELAY_MS (2000)
+#endif /* OC_CLOUD_RD_RETRY_DELAY_MS */
+
+#ifndef OC_CLOUD_RD_RETRY_MAX_DELAY_MS
+#define OC_CLOUD_RD_RETRY_MAX_DELAY_MS (120000)
+#endif /* OC_CLOUD_RD_RETRY_MAX_DELAY_MS */
+
 typedef struct cloud_conf_update_t
 {
   const char *access_token; /**< Access Token resolved with an auth code. */
@@ -54,6 +83,7 @@ typedef struct cloud_conf_update_t
 
 typedef struct cloud_api_param_t
 {
+  struct cloud_api_param_t *next;
   oc_cloud_context_t *ctx;
   oc_cloud_cb_t cb;
   void *data;
@@ -62,6 +92,15 @@ typedef struct cloud_api_param_t
 
 cloud_api_param_t *alloc_api_param(void);
 void free_api_param(cloud_api_param_t *p);
+
+/**
+ * @brief Find allocated parameters of a cloud API call.
+ *
+ * @param user_data user data of a request
+ * @return the parameters if the user data are parameters of a pending call,
+ * NULL otherwise
+ */
+const cloud_api_param_t *cloud_api_param_find(const void *user_data);
 int conv_cloud_endpoint(oc_cloud_context_t *ctx);
 
 int oc_cloud_init(void);
@@ -76,6 +115,25 @@ void oc_cloud_refresh_token_handler(oc_client_response_t *data);
 
 void cloud_close_endpoint(const oc_endpoint_t *cloud_ep);
 
+/**
+ * @brief Release the session of the device with the cloud.
+ *
+ * The session is shared by all devices connected to the same cloud server. It
+ * is closed when no other device uses it, otherwise only the pending requests
+ * of the device are interrupted. The endpoint of the device is cleared.
+ *
+ * @param ctx Cloud context, must not be NULL
+ */
+void cloud_release_endpoint(oc_cloud_context_t *ctx);
+
+/**
+ * @brief Interrupt the pending requests of the device with the cloud, their
+ * handlers are invoked with OC_CONNECTION_CLOSED.
+ *
+ * @param ctx Cloud context, must not be NULL
+ */
+void cloud_interrupt_requests(const oc_cloud_context_t *ctx);
+
 /// Remove callback (if it exists) and schedule it again
 void cloud_reset_delayed_callback(void *cb_data, oc_trigger_t callback,
                                   uint16_t seconds);
@@ -120,8 +178,12 @@ void cloud_update_by_resource(oc_cloud_context_t *ctx,
  * @brief Update resource links after manager status change.
  *
  * If cloud is in logged in state the function executes several resource links
- * updates: deletes links scheduled to be deleted, publishes links scheduled
- * to be published and republishes links that were already published.
+ * updates: deletes links scheduled to be deleted and publishes links scheduled
+ * to be published in batches of OC_CLOUD_RD_PUBLISH_BATCH_SIZE. Links are not
+ * published again if the digest of their bucket matches the digest of the
+ * bucket last acknowledged by the resource directory and their Time to Live is
+ * unlimited. The stored digests are invalidated until all changes are
+ * acknowledged. Failed requests are retried with an exponential backoff.
  * Additionally, if Time to Live property is not equal to
  * RD_PUBLISH_TTL_UNLIMITED then published links are scheduled to be republished
  * each hour. (If cloud_rd_manager_status_changed function is triggered again
@@ -146,13 +208,47 @@ void cloud_rd_deinit(oc_cloud_context_t *ctx);
 /**
  * @brief Reset resource directory context member variables.
  *
- * Items in the list of published resources are moved to the list of to be
- * published resources. The list of to be deleted resources is cleared.
+ * Items in the lists of published resources and of resources being published
+ * are moved to the list of to be published resources. The lists of to be
+ * deleted resources and of resources being deleted are cleared.
  *
  * @param ctx Cloud context, must not be NULL
  */
 void cloud_rd_reset_context(oc_cloud_context_t *ctx);
 
+/**
+ * @brief Get the number of resource links from the head of the list that are
+ * published by a single request.
+ *
+ * @param head the list of links
+ * @param max_size upper bound of the estimated encoded size of the links
+ * @return number of links, at least 1 for a non-empty list
+ */
+size_t cloud_rd_links_batch_size(const oc_link_t *head, size_t max_size);
+
+/**
+ * @brief Get the bucket of the digest of a resource link.
+ *
+ * @param link the link, must not be NULL
+ * @return index of the bucket, less than OC_CLOUD_RD_DIGESTS
+ */
+size_t cloud_rd_link_bucket(const oc_link_t *link);
+
+/**
+ * @brief Add the digests of resource links to the digests of their buckets.
+ *
+ * The digest of a bucket doesn't depend on the order of the links and it
+ * changes when the server id, the published properties or the instance id of a
+ * link in the bucket changes.
+ *
+ * @param ctx Cloud context, must not be NULL
+ * @param head the list of links
+ * @param digests digests of the buckets to update, must not be NULL
+ */
+void cloud_rd_links_digests(const oc_cloud_context_t *ctx,
+                            const oc_link_t *head,
+                            uint64_t digests[OC_CLOUD_RD_DIGESTS]);
+
 int cloud_register(oc_cloud_context_t *ctx, oc_cloud_cb_t cb, void *data,
                    uint16_t timeout);
 int cloud_login(oc_cloud_context_t *ctx, oc_cloud_cb_t cb, void *data,
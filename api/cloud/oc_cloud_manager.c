@@ -30,6 +30,7 @@
 #include "oc_cloud_store_internal.h"
 #include "oc_endpoint.h"
 #include "port/oc_log_internal.h"
+#include "port/oc_random.h"
 #include "rd_client.h"
 #include "util/oc_list.h"
 #include "util/oc_memb.h"
@@ -48,8 +49,11 @@ static oc_event_callback_retval_t cloud_manager_register_async(void *data);
 static oc_event_callback_retval_t cloud_manager_login_async(void *data);
 static oc_event_callback_retval_t cloud_manager_refresh_token_async(void *data);
 static oc_event_callback_retval_t cloud_manager_send_ping_async(void *data);
+static void cloud_manager_wake_deferred(void);
 
 static uint8_t g_retry_timeout[MAX_RETRY_COUNT] = { 2, 4, 8, 16, 32, 64 };
+static uint8_t g_max_concurrent_attempts = OC_CLOUD_MAX_CONCURRENT_ATTEMPTS;
+static uint32_t g_deferred_order = 0;
 
 bool
 cloud_manager_set_retry(const uint8_t retry_timeout[],
@@ -95,6 +99,137 @@ cloud_manager_get_retry(uint8_t *buffer, size_t buffer_size)
   return cfg_size;
 }
 
+void
+oc_cloud_manager_set_max_concurrent_attempts(uint8_t max_attempts)
+{
+  g_max_concurrent_attempts = max_attempts;
+  cloud_manager_wake_deferred();
+}
+
+void
+oc_cloud_get_reconnect_stats(const oc_cloud_context_t *ctx,
+                             oc_cloud_reconnect_stats_t *stats)
+{
+  assert(ctx != NULL);
+  assert(stats != NULL);
+  *stats = ctx->reconnect_stats;
+}
+
+static uint64_t
+cloud_random_ms(uint64_t min_ms, uint64_t max_ms)
+{
+  if (max_ms <= min_ms) {
+    return min_ms;
+  }
+  return min_ms + (oc_random_value() % (max_ms - min_ms + 1));
+}
+
+uint64_t
+cloud_manager_retry_delay_ms(oc_cloud_context_t *ctx, uint16_t interval)
+{
+  uint64_t base = (uint64_t)g_retry_timeout[0] * 1000;
+  uint64_t cap = (uint64_t)interval * 1000;
+  uint64_t prev = ctx->retry_delay_ms > base ? ctx->retry_delay_ms : base;
+  uint64_t max = 3 * prev < cap ? 3 * prev : cap;
+  // the first retry is capped by the first retry timeout as well
+  uint64_t min = base < max ? base : max / 2;
+  uint64_t delay = cloud_random_ms(min, max);
+  ctx->retry_delay_ms = (uint32_t)delay;
+  return delay;
+}
+
+static void
+cloud_manager_schedule_ms(oc_cloud_context_t *ctx, oc_trigger_t callback,
+                          uint64_t delay_ms)
+{
+  ctx->reconnect_stats.last_delay_ms = (uint32_t)delay_ms;
+  cloud_reset_delayed_callback_ms(ctx, callback, delay_ms);
+}
+
+typedef struct
+{
+  size_t in_flight;
+  oc_cloud_context_t *deferred; ///< context deferred for the longest time
+} cloud_attempts_t;
+
+static void
+count_attempts(oc_cloud_context_t *ctx, void *user_data)
+{
+  cloud_attempts_t *attempts = (cloud_attempts_t *)user_data;
+  if (ctx->attempt_in_flight) {
+    ++attempts->in_flight;
+  }
+  if (ctx->deferred_attempt != NULL &&
+      (attempts->deferred == NULL ||
+       ctx->deferred_order < attempts->deferred->deferred_order)) {
+    attempts->deferred = ctx;
+  }
+}
+
+/* Wake the attempts deferred for the longest time, one for each free slot. A
+ * woken attempt that loses its slot keeps its position in the queue. */
+static void
+cloud_manager_wake_deferred(void)
+{
+  cloud_attempts_t attempts = { 0, NULL };
+  cloud_context_iterate(count_attempts, &attempts);
+  size_t free_slots = SIZE_MAX;
+  if (g_max_concurrent_attempts > 0) {
+    free_slots = attempts.in_flight < g_max_concurrent_attempts
+                   ? g_max_concurrent_attempts - attempts.in_flight
+                   : 0;
+  }
+  while (free_slots > 0 && attempts.deferred != NULL) {
+    oc_cloud_context_t *ctx = attempts.deferred;
+    OC_DBG("[CM] wake deferred attempt of device=%zu", ctx->device);
+    cloud_reset_delayed_callback_ms(ctx, ctx->deferred_attempt, 0);
+    ctx->deferred_attempt = NULL;
+    --free_slots;
+    attempts.deferred = NULL;
+    cloud_context_iterate(count_attempts, &attempts);
+  }
+}
+
+/* Limit the number of connection attempts waiting for a response, so that
+ * devices reconnecting after an outage don't overload the cloud. A deferred
+ * attempt is queued until a slot frees and it doesn't count as a retry. */
+static bool
+cloud_manager_begin_attempt(oc_cloud_context_t *ctx, oc_trigger_t callback)
+{
+  if (g_max_concurrent_attempts > 0) {
+    cloud_attempts_t attempts = { 0, NULL };
+    cloud_context_iterate(count_attempts, &attempts);
+    if (attempts.in_flight >= g_max_concurrent_attempts) {
+      OC_DBG("[CM] attempt deferred, %zu attempts in flight",
+             attempts.in_flight);
+      ++ctx->reconnect_stats.deferred;
+      if (ctx->deferred_order == 0) {
+        if (++g_deferred_order == 0) {
+          g_deferred_order = 1;
+        }
+        ctx->deferred_order = g_deferred_order;
+      }
+      ctx->deferred_attempt = callback;
+      return false;
+    }
+  }
+  ctx->deferred_attempt = NULL;
+  ctx->deferred_order = 0;
+  ctx->attempt_in_flight = true;
+  ++ctx->reconnect_stats.attempts;
+  return true;
+}
+
+static void
+cloud_manager_end_attempt(oc_cloud_context_t *ctx, bool success)
+{
+  ctx->attempt_in_flight = false;
+  if (!success) {
+    ++ctx->reconnect_stats.failures;
+  }
+  cloud_manager_wake_deferred();
+}
+
 static oc_event_callback_retval_t
 cloud_manager_callback_handler_async(void *data)
 {
@@ -124,12 +259,20 @@ cloud_manager_stop(oc_cloud_context_t *ctx)
   oc_remove_delayed_callback(ctx, cloud_manager_send_ping_async);
   oc_remove_delayed_callback(ctx, cloud_manager_refresh_token_async);
   oc_remove_delayed_callback(ctx, cloud_manager_callback_handler_async);
+  bool in_flight = ctx->attempt_in_flight;
+  ctx->attempt_in_flight = false;
+  ctx->deferred_attempt = NULL;
+  ctx->deferred_order = 0;
+  if (in_flight) {
+    cloud_manager_wake_deferred();
+  }
 }
 
 static oc_event_callback_retval_t
 cloud_manager_reconnect_async(void *data)
 {
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)data;
+  ++ctx->reconnect_stats.reconnects;
   cloud_reset_delayed_callback(ctx, cloud_manager_callback_handler_async, 0);
   oc_cloud_manager_restart(ctx);
   return OC_EVENT_DONE;
@@ -154,6 +297,10 @@ cloud_start_process(oc_cloud_context_t *ctx)
 {
   ctx->retry_count = 0;
   ctx->retry_refresh_token_count = 0;
+  ctx->retry_delay_ms = 0;
+  // stagger the first attempts of devices started at the same time
+  uint64_t base = (uint64_t)g_retry_timeout[0] * 1000;
+  uint64_t delay = cloud_random_ms(base / 2, base + base / 2);
 
 #ifdef OC_SECURITY
   const oc_sec_pstat_t *pstat = oc_sec_get_pstat(ctx->device);
@@ -164,19 +311,16 @@ cloud_start_process(oc_cloud_context_t *ctx)
 
   if (ctx->store.status == OC_CLOUD_INITIALIZED &&
       ctx->store.cps == OC_CPS_READYTOREGISTER) {
-    cloud_reset_delayed_callback(ctx, cloud_manager_register_async,
-                                 g_retry_timeout[0]);
+    cloud_manager_schedule_ms(ctx, cloud_manager_register_async, delay);
     goto finish;
   }
   if ((ctx->store.status & OC_CLOUD_REGISTERED) != 0) {
     if (cloud_context_has_permanent_access_token(ctx)) {
-      cloud_reset_delayed_callback(ctx, cloud_manager_login_async,
-                                   g_retry_timeout[0]);
+      cloud_manager_schedule_ms(ctx, cloud_manager_login_async, delay);
       goto finish;
     }
     if (cloud_context_has_refresh_token(ctx)) {
-      cloud_reset_delayed_callback(ctx, cloud_manager_refresh_token_async,
-                                   g_retry_timeout[0]);
+      cloud_manager_schedule_ms(ctx, cloud_manager_refresh_token_async, delay);
       goto finish;
     }
   }
@@ -185,23 +329,21 @@ finish:
   _oc_signal_event_loop();
 }
 
-static uint16_t
-check_expires_in(int64_t expires_in)
+uint64_t
+cloud_manager_refresh_token_delay_ms(int64_t expires_in)
 {
   if (expires_in <= 0) {
     return 0;
   }
-  if (expires_in > 60 * 60) {
-    // if time is more than 1h then set expires to (expires_in - 10min).
-    expires_in = expires_in - 10 * 60;
-  } else if (expires_in > 4 * 60) {
-    // if time is more than 240sec then set expires to (expires_in - 2min).
-    expires_in = expires_in - 2 * 60;
-  } else if (expires_in > 20) {
-    // if time is more than 20sec then set expires to (expires_in - 10sec).
-    expires_in = expires_in - 10;
+  if (expires_in > UINT32_MAX) {
+    expires_in = UINT32_MAX;
   }
-  return expires_in > UINT16_MAX ? UINT16_MAX : (uint16_t)expires_in;
+  uint64_t lifetime_ms = (uint64_t)expires_in * 1000;
+  if (expires_in <= 20) {
+    return lifetime_ms;
+  }
+  // refresh between 3/4 and 9/10 of the lifetime of the token
+  return cloud_random_ms(lifetime_ms / 4 * 3, lifetime_ms / 10 * 9);
 }
 
 static bool
@@ -282,9 +424,7 @@ cloud_manager_handle_redirect_response(oc_cloud_context_t *ctx,
     if ((ctx->cloud_ep != NULL) &&
         (ci_server == NULL || oc_string_len(ctx->store.ci_server) != size ||
          strcmp(ci_server, value) != 0)) {
-      cloud_close_endpoint(ctx->cloud_ep);
-      memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
-      ctx->cloud_ep_state = OC_SESSION_DISCONNECTED;
+      cloud_release_endpoint(ctx);
     }
     oc_set_string(&ctx->store.ci_server, value, size);
     return true;
@@ -363,7 +503,11 @@ cloud_schedule_retry(oc_cloud_context_t *ctx, oc_trigger_t callback,
     interval = g_retry_timeout[ctx->retry_count];
     ++ctx->retry_count;
   }
-  oc_set_delayed_callback(ctx, callback, is_timeout ? 0 : interval);
+  // a timed out attempt already waited, it is retried after a short jitter
+  uint64_t delay =
+    is_timeout ? cloud_random_ms(0, (uint64_t)g_retry_timeout[0] * 1000)
+               : cloud_manager_retry_delay_ms(ctx, interval);
+  cloud_manager_schedule_ms(ctx, callback, delay);
 }
 
 static void
@@ -373,10 +517,12 @@ cloud_manager_register_handler(oc_client_response_t *data)
   oc_remove_delayed_callback(ctx, cloud_manager_register_async);
   bool retry = false;
   if (_register_handler(ctx, data, /*retryIsActive*/ true) == 0) {
+    cloud_manager_end_attempt(ctx, true);
     cloud_reset_delayed_callback(ctx, cloud_manager_login_async,
                                  g_retry_timeout[ctx->retry_count]);
     goto finish;
   }
+  cloud_manager_end_attempt(ctx, false);
 
   if (((ctx->store.status & ~OC_CLOUD_FAILURE) == OC_CLOUD_INITIALIZED) &&
       cloud_is_connection_error_or_timeout(data->code) && !is_retry_over(ctx)) {
@@ -410,6 +556,10 @@ cloud_manager_register_async(void *data)
     return OC_EVENT_DONE;
   }
 
+  if (!cloud_manager_begin_attempt(ctx, cloud_manager_register_async)) {
+    return OC_EVENT_DONE;
+  }
+
   oc_cloud_access_conf_t conf = {
     .device = ctx->device,
     .selected_identity_cred_id = ctx->selected_identity_cred_id,
@@ -436,9 +586,8 @@ cloud_manager_register_async(void *data)
 retry:
   // While retrying, keep last error (clec) to CLOUD_OK
   cloud_set_last_error(ctx, CLOUD_OK);
-  oc_set_delayed_callback(data, cloud_manager_register_async,
-                          g_retry_timeout[ctx->retry_count]);
-  ++ctx->retry_count;
+  cloud_manager_end_attempt(ctx, false);
+  cloud_schedule_retry(ctx, cloud_manager_register_async, false, false);
   return OC_EVENT_DONE;
 }
 
@@ -577,14 +726,16 @@ cloud_manager_login_handler(oc_client_response_t *data)
   bool retry = false;
   oc_cloud_error_t ret = _login_handler(ctx, data, /*retryIsActive*/ true,
                                         !handleUnauthorizedByRefresh);
+  cloud_manager_end_attempt(ctx, ret == CLOUD_OK);
   if (ret == CLOUD_OK) {
     uint64_t next_ping = 0;
     on_keepalive_response(ctx, true, &next_ping);
     cloud_reset_delayed_callback_ms(ctx, cloud_manager_send_ping_async,
                                     next_ping);
     if (ctx->store.expires_in > 0) {
-      cloud_reset_delayed_callback(ctx, cloud_manager_refresh_token_async,
-                                   check_expires_in(ctx->store.expires_in));
+      cloud_reset_delayed_callback_ms(
+        ctx, cloud_manager_refresh_token_async,
+        cloud_manager_refresh_token_delay_ms(ctx->store.expires_in));
     }
     goto finish;
   }
@@ -628,6 +779,10 @@ cloud_manager_login_async(void *data)
     return OC_EVENT_DONE;
   }
 
+  if (!cloud_manager_begin_attempt(ctx, cloud_manager_login_async)) {
+    return OC_EVENT_DONE;
+  }
+
   oc_cloud_access_conf_t conf = {
     .device = ctx->device,
     .selected_identity_cred_id = ctx->selected_identity_cred_id,
@@ -651,9 +806,8 @@ cloud_manager_login_async(void *data)
 retry:
   // While retrying, keep last error (clec) to CLOUD_OK
   cloud_set_last_error(ctx, CLOUD_OK);
-  oc_set_delayed_callback(ctx, cloud_manager_login_async,
-                          g_retry_timeout[ctx->retry_count]);
-  ++ctx->retry_count;
+  cloud_manager_end_attempt(ctx, false);
+  cloud_schedule_retry(ctx, cloud_manager_login_async, false, false);
   return OC_EVENT_DONE;
 }
 
@@ -789,10 +943,12 @@ cloud_manager_refresh_token_handler(oc_client_response_t *data)
   oc_remove_delayed_callback(ctx, cloud_manager_refresh_token_async);
   bool retry = false;
   if (_refresh_token_handler(ctx, data, /*retryIsActive*/ true) == CLOUD_OK) {
+    cloud_manager_end_attempt(ctx, true);
     cloud_reset_delayed_callback(ctx, cloud_manager_login_async,
                                  g_retry_timeout[ctx->retry_count]);
     goto finish;
   }
+  cloud_manager_end_attempt(ctx, false);
 
   if ((ctx->store.status & OC_CLOUD_REGISTERED) != 0 &&
       !is_refresh_token_retry_over(ctx)) {
@@ -823,6 +979,10 @@ cloud_manager_refresh_token_async(void *data)
     return OC_EVENT_DONE;
   }
 
+  if (!cloud_manager_begin_attempt(ctx, cloud_manager_refresh_token_async)) {
+    return OC_EVENT_DONE;
+  }
+
   oc_cloud_access_conf_t conf = {
     .device = ctx->device,
     .selected_identity_cred_id = ctx->selected_identity_cred_id,
@@ -846,12 +1006,30 @@ cloud_manager_refresh_token_async(void *data)
 
 retry:
   cloud_set_last_error(ctx, CLOUD_ERROR_REFRESH_ACCESS_TOKEN);
-  oc_set_delayed_callback(ctx, cloud_manager_refresh_token_async,
-                          g_retry_timeout[ctx->retry_refresh_token_count]);
-  ++ctx->retry_refresh_token_count;
+  cloud_manager_end_attempt(ctx, false);
+  cloud_schedule_retry(ctx, cloud_manager_refresh_token_async, false, true);
   return OC_EVENT_DONE;
 }
 
+/* A ping response proves that the shared session is alive for all devices
+ * connected through it, their pings are postponed after the next ping of the
+ * session. */
+static void
+cloud_manager_keepalive_session_peer(oc_cloud_context_t *ctx, void *user_data)
+{
+  (void)user_data;
+  if ((ctx->store.status & OC_CLOUD_LOGGED_IN) == 0) {
+    return;
+  }
+  uint64_t next_ping = 0;
+  if (!on_keepalive_response(ctx, true, &next_ping)) {
+    return;
+  }
+  next_ping += (uint64_t)ctx->keepalive.ping_timeout * 1000;
+  cloud_reset_delayed_callback_ms(ctx, cloud_manager_send_ping_async,
+                                  next_ping);
+}
+
 static void
 cloud_manager_send_ping_handler(oc_client_response_t *data)
 {
@@ -873,6 +1051,10 @@ cloud_manager_send_ping_handler(oc_client_response_t *data)
   if (want_continue) {
     cloud_reset_delayed_callback_ms(ctx, cloud_manager_send_ping_async,
                                     next_ping);
+    if (response_received) {
+      cloud_context_iterate_session(ctx->cloud_ep, ctx,
+                                    cloud_manager_keepalive_session_peer, NULL);
+    }
     return;
   }
   OC_DBG("[CM] ping fails with code(%d)", data->code);
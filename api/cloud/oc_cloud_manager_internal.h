@@ -19,6 +19,7 @@
 #ifndef OC_CLOUD_MANAGER_INTERNAL_H
 #define OC_CLOUD_MANAGER_INTERNAL_H
 
+#include "oc_cloud.h"
 #include "oc_rep.h"
 
 #include <stddef.h>
@@ -59,6 +60,42 @@ bool cloud_manager_set_retry(const uint8_t retry_timeout[],
  */
 size_t cloud_manager_get_retry(uint8_t *buffer, size_t buffer_size);
 
+/**
+ * Default maximal number of sign-up, sign-in and refresh token requests of all
+ * cloud contexts waiting for a response at the same time.
+ */
+#ifndef OC_CLOUD_MAX_CONCURRENT_ATTEMPTS
+#define OC_CLOUD_MAX_CONCURRENT_ATTEMPTS (4)
+#endif /* OC_CLOUD_MAX_CONCURRENT_ATTEMPTS */
+
+/**
+ * @brief Get the delay of the next retry with decorrelated jitter.
+ *
+ * The delay is random between the first retry timeout and three times the
+ * previous delay of the context, and it is capped by the retry timeout of the
+ * attempt. When the cap isn't above the first retry timeout the delay is
+ * random between half the cap and the cap. The delay is stored in the context
+ * as the previous delay.
+ *
+ * @param ctx cloud context (cannot be NULL)
+ * @param interval retry timeout of the attempt in seconds
+ * @return uint64_t delay in milliseconds
+ */
+uint64_t cloud_manager_retry_delay_ms(oc_cloud_context_t *ctx,
+                                      uint16_t interval);
+
+/**
+ * @brief Get the delay before the access token is refreshed.
+ *
+ * The token is refreshed at a random point between 3/4 and 9/10 of its
+ * lifetime, so that devices that signed in at the same time don't refresh
+ * their tokens at the same time.
+ *
+ * @param expires_in lifetime of the access token in seconds
+ * @return uint64_t delay in milliseconds
+ */
+uint64_t cloud_manager_refresh_token_delay_ms(int64_t expires_in);
+
 #define ACCESS_TOKEN_KEY "accesstoken"
 #define REFRESH_TOKEN_KEY "refreshtoken"
 #define REDIRECTURI_KEY "redirecturi"
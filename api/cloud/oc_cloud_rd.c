@@ -19,15 +19,23 @@
 
 #include "oc_api.h"
 #include "oc_cloud_internal.h"
+#include "oc_cloud_store_internal.h"
 #include "oc_collection.h"
 #include "rd_client.h"
+#include "util/oc_hash.h"
 #ifdef OC_SECURITY
 #include "security/oc_pstat.h"
 #endif /* OC_SECURITY */
+
+#include <inttypes.h>
+#include <string.h>
+
 #define ONE_HOUR 3600
 #define OC_RSRVD_LINKS "links"
 #define OC_RSRVD_HREF "href"
 #define OC_RSRVD_INSTANCEID "ins"
+/* number of instance ids that fit into the URI query of rd_delete */
+#define RD_DELETE_BATCH_SIZE (8)
 
 static oc_link_t *
 rd_link_find(oc_link_t *head, const oc_resource_t *res)
@@ -104,42 +112,246 @@ rd_link_remove_by_resource(oc_link_t **head, const oc_resource_t *res)
   return rd_link_remove(head, rd_link_find(*head, res));
 }
 
+/* The instance id is derived from the href, so a link published again after a
+ * restart of the device is identified by the same instance id. */
+static int64_t
+rd_link_instance_id(const oc_resource_t *res)
+{
+  uint64_t id = oc_hash_fnv1a64(OC_HASH_FNV1A64_BASIS, oc_string(res->uri),
+                                oc_string_len(res->uri));
+  return (int64_t)(id & INT64_MAX);
+}
+
+static const char *
+rd_link_rel(const oc_link_t *link)
+{
+  if (oc_string_array_get_allocated_size(link->rel) == 0) {
+    return NULL;
+  }
+  return oc_string_array_get_item(link->rel, 0);
+}
+
+static uint64_t
+rd_link_digest(const oc_cloud_context_t *ctx, const oc_link_t *link)
+{
+  const oc_resource_t *res = link->resource;
+  uint64_t digest =
+    oc_hash_fnv1a64(OC_HASH_FNV1A64_BASIS, oc_string(ctx->store.sid),
+                    oc_string_len(ctx->store.sid));
+  digest =
+    oc_hash_fnv1a64(digest, oc_string(res->uri), oc_string_len(res->uri));
+  for (size_t i = 0; i < oc_string_array_get_allocated_size(res->types); ++i) {
+    const char *rt = oc_string_array_get_item(res->types, i);
+    digest = oc_hash_fnv1a64(digest, rt, strlen(rt) + 1);
+  }
+  const char *rel = rd_link_rel(link);
+  if (rel != NULL) {
+    digest = oc_hash_fnv1a64(digest, rel, strlen(rel) + 1);
+  }
+  uint32_t interfaces = (uint32_t)res->interfaces;
+  digest = oc_hash_fnv1a64(digest, &interfaces, sizeof(interfaces));
+  uint8_t bm = (uint8_t)(res->properties & ~(OC_PERIODIC | OC_SECURE));
+  digest = oc_hash_fnv1a64(digest, &bm, sizeof(bm));
+  return oc_hash_fnv1a64(digest, &link->ins, sizeof(link->ins));
+}
+
+size_t
+cloud_rd_link_bucket(const oc_link_t *link)
+{
+  return (size_t)((uint64_t)link->ins % OC_CLOUD_RD_DIGESTS);
+}
+
+void
+cloud_rd_links_digests(const oc_cloud_context_t *ctx, const oc_link_t *head,
+                       uint64_t digests[OC_CLOUD_RD_DIGESTS])
+{
+  // the sum of the digests of the links doesn't depend on their order
+  for (const oc_link_t *link = head; link != NULL; link = link->next) {
+    digests[cloud_rd_link_bucket(link)] += rd_link_digest(ctx, link);
+  }
+}
+
+/* Digests of the buckets of all links of the device, 0 is reserved for an
+ * unknown digest. */
+static void
+rd_digests(const oc_cloud_context_t *ctx,
+           uint64_t digests[OC_CLOUD_RD_DIGESTS])
+{
+  memset(digests, 0, sizeof(uint64_t) * OC_CLOUD_RD_DIGESTS);
+  cloud_rd_links_digests(ctx, ctx->rd_published_resources, digests);
+  cloud_rd_links_digests(ctx, ctx->rd_publishing_resources, digests);
+  cloud_rd_links_digests(ctx, ctx->rd_publish_resources, digests);
+  for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+    if (digests[i] == 0) {
+      digests[i] = 1;
+    }
+  }
+}
+
+static size_t
+rd_link_encoded_size(const oc_link_t *link)
+{
+  const oc_resource_t *res = link->resource;
+  // map, keys, the instance id and the policy
+  size_t size = 40 + oc_string_len(res->uri);
+  for (size_t i = 0; i < oc_string_array_get_allocated_size(res->types); ++i) {
+    size += strlen(oc_string_array_get_item(res->types, i)) + 2;
+  }
+  // "oic.if.baseline" is the longest interface name
+  for (unsigned interfaces = (unsigned)res->interfaces; interfaces != 0;
+       interfaces &= interfaces - 1) {
+    size += 17;
+  }
+  const char *rel = rd_link_rel(link);
+  if (rel != NULL) {
+    size += strlen(rel) + 2;
+  }
+  return size;
+}
+
+size_t
+cloud_rd_links_batch_size(const oc_link_t *head, size_t max_size)
+{
+  size_t count = 0;
+  size_t size = 0;
+  for (const oc_link_t *link = head; link != NULL; link = link->next) {
+    size_t link_size = rd_link_encoded_size(link);
+    if (count > 0 && size + link_size > max_size) {
+      break;
+    }
+    size += link_size;
+    ++count;
+  }
+  return count;
+}
+
+/* Detach up to count links from the head of the list. */
+static oc_link_t *
+rd_link_split(oc_link_t **head, size_t count)
+{
+  oc_link_t *batch = *head;
+  if (batch == NULL || count == 0) {
+    return NULL;
+  }
+  oc_link_t *last = batch;
+  for (size_t i = 1; i < count && last->next != NULL; ++i) {
+    last = last->next;
+  }
+  *head = last->next;
+  last->next = NULL;
+  return batch;
+}
+
+/* Move all links of the source list to the tail of the destination list. */
+static void
+rd_link_move_all(oc_link_t **dst, oc_link_t **src)
+{
+  for (oc_link_t *link = rd_link_pop(src); link != NULL;
+       link = rd_link_pop(src)) {
+    rd_link_add(dst, link);
+  }
+}
+
+/* Store the digests of the published links once all changes were acknowledged
+ * by the resource directory, until then the stored digests are invalid. */
+static void
+rd_update_published_digests(oc_cloud_context_t *ctx)
+{
+  uint64_t digests[OC_CLOUD_RD_DIGESTS];
+  if (ctx->rd_publishing || ctx->rd_deleting ||
+      ctx->rd_publish_resources != NULL || ctx->rd_delete_resources != NULL) {
+    memset(digests, 0, sizeof(digests));
+  } else {
+    rd_digests(ctx, digests);
+  }
+  if (memcmp(digests, ctx->store.rd_digests, sizeof(digests)) != 0) {
+    memcpy(ctx->store.rd_digests, digests, sizeof(digests));
+    cloud_store_dump_async(&ctx->store);
+  }
+}
+
+static oc_event_callback_retval_t publish_changes_async(void *data);
+
+/* Retry a failed request with an exponential backoff. */
+static void
+rd_schedule_retry(oc_cloud_context_t *ctx)
+{
+  uint64_t delay_ms = OC_CLOUD_RD_RETRY_MAX_DELAY_MS;
+  if (ctx->rd_retry_count < 16) {
+    delay_ms = (uint64_t)OC_CLOUD_RD_RETRY_DELAY_MS << ctx->rd_retry_count;
+    if (delay_ms > OC_CLOUD_RD_RETRY_MAX_DELAY_MS) {
+      delay_ms = OC_CLOUD_RD_RETRY_MAX_DELAY_MS;
+    }
+  }
+  if (ctx->rd_retry_count < UINT8_MAX) {
+    ++ctx->rd_retry_count;
+  }
+  OC_DBG("[CRD] retry in %" PRIu64 "ms", delay_ms);
+  oc_remove_delayed_callback(ctx, publish_changes_async);
+  oc_set_delayed_callback_ms_v1(ctx, publish_changes_async, delay_ms);
+}
+
+static void publish_resources(oc_cloud_context_t *ctx);
+
+static bool
+publish_resources_acknowledge(oc_cloud_context_t *ctx, const oc_rep_t *payload)
+{
+  bool acknowledged = false;
+  oc_rep_t *link = NULL;
+  if (!oc_rep_get_object_array(payload, OC_RSRVD_LINKS, &link)) {
+    return false;
+  }
+  for (; link != NULL; link = link->next) {
+    char *href = NULL;
+    size_t href_size = 0;
+    int64_t instance_id = -1;
+    if (!oc_rep_get_string(link->value.object, OC_RSRVD_HREF, &href,
+                           &href_size) ||
+        !oc_rep_get_int(link->value.object, OC_RSRVD_INSTANCEID,
+                        &instance_id)) {
+      continue;
+    }
+    oc_link_t *l =
+      rd_link_find_by_href(ctx->rd_publishing_resources, href, href_size);
+    if (l) {
+      l->ins = instance_id;
+      rd_link_remove(&ctx->rd_publishing_resources, l);
+      rd_link_add(&ctx->rd_published_resources, l);
+      acknowledged = true;
+    }
+  }
+  return acknowledged;
+}
+
 static void
 publish_resources_handler(oc_client_response_t *data)
 {
   oc_cloud_context_t *ctx = (oc_cloud_context_t *)data->user_data;
   OC_DBG("[CRD] publish resources handler(%d)", data->code);
+  ctx->rd_publishing = false;
+
+  // the links of the batch might have been deleted in the meantime
+  bool acknowledged = data->code == OC_STATUS_CHANGED &&
+                      (publish_resources_acknowledge(ctx, data->payload) ||
+                       ctx->rd_publishing_resources == NULL);
+  // links that weren't acknowledged are published after the following batches
+  rd_link_move_all(&ctx->rd_publish_resources, &ctx->rd_publishing_resources);
 
   if ((ctx->store.status & OC_CLOUD_LOGGED_IN) == 0) {
     return;
   }
-  if (data->code != OC_STATUS_CHANGED) {
+  if (!acknowledged) {
+    OC_ERR("[CRD] cannot publish resource links(%d)", data->code);
+    rd_schedule_retry(ctx);
     return;
   }
-
-  oc_rep_t *link = NULL;
-  if (oc_rep_get_object_array(data->payload, OC_RSRVD_LINKS, &link)) {
-    while (link != NULL) {
-      char *href = NULL;
-      size_t href_size = 0;
-      int64_t instance_id = -1;
-      if (oc_rep_get_string(link->value.object, OC_RSRVD_HREF, &href,
-                            &href_size) &&
-          oc_rep_get_int(link->value.object, OC_RSRVD_INSTANCEID,
-                         &instance_id)) {
-        oc_link_t *l =
-          rd_link_find_by_href(ctx->rd_publish_resources, href, href_size);
-        if (l) {
-          l->ins = instance_id;
-          rd_link_remove(&ctx->rd_publish_resources, l);
-          rd_link_add(&ctx->rd_published_resources, l);
-        }
-      }
-      link = link->next;
-    }
-  }
+  ctx->rd_retry_count = 0;
+  publish_resources(ctx);
+  rd_update_published_digests(ctx);
 }
 
+/* Publish the next batch of links, the following batch is published when the
+ * resource directory responds. */
 static void
 publish_resources(oc_cloud_context_t *ctx)
 {
@@ -152,9 +364,74 @@ publish_resources(oc_cloud_context_t *ctx)
   if ((ctx->store.status & OC_CLOUD_LOGGED_IN) == 0) {
     return;
   }
+  if (ctx->rd_publishing || ctx->rd_publish_resources == NULL) {
+    return;
+  }
+
+  size_t count = cloud_rd_links_batch_size(ctx->rd_publish_resources,
+                                           OC_CLOUD_RD_PUBLISH_BATCH_SIZE);
+  ctx->rd_publishing_resources =
+    rd_link_split(&ctx->rd_publish_resources, count);
+  ctx->rd_publishing =
+    rd_publish(ctx->cloud_ep, ctx->rd_publishing_resources, ctx->device,
+               ctx->time_to_live, publish_resources_handler, LOW_QOS, ctx);
+  if (!ctx->rd_publishing) {
+    OC_ERR("[CRD] cannot send publish resource links request");
+    rd_link_move_all(&ctx->rd_publish_resources,
+                     &ctx->rd_publishing_resources);
+    rd_schedule_retry(ctx);
+  }
+}
+
+/* After a restart of the device or a reconnect all links are in the list of
+ * links to publish. Links in a bucket whose digest matches the digest that was
+ * acknowledged by the resource directory don't need to be published again.
+ * Links with a limited time to live might have expired, so they are always
+ * published. */
+static void
+publish_resources_diff(oc_cloud_context_t *ctx)
+{
+  if (ctx->time_to_live != RD_PUBLISH_TTL_UNLIMITED ||
+      ctx->rd_publish_resources == NULL) {
+    return;
+  }
+  uint64_t digests[OC_CLOUD_RD_DIGESTS];
+  rd_digests(ctx, digests);
+  oc_link_t *link = ctx->rd_publish_resources;
+  while (link != NULL) {
+    oc_link_t *next = link->next;
+    size_t bucket = cloud_rd_link_bucket(link);
+    if (ctx->store.rd_digests[bucket] == digests[bucket]) {
+      rd_link_remove(&ctx->rd_publish_resources, link);
+      rd_link_add(&ctx->rd_published_resources, link);
+    }
+    link = next;
+  }
+}
+
+static void delete_resources(oc_cloud_context_t *ctx);
+
+static void
+publish_changes(oc_cloud_context_t *ctx)
+{
+  publish_resources(ctx);
+  delete_resources(ctx);
+}
+
+static oc_event_callback_retval_t
+publish_changes_async(void *data)
+{
+  publish_changes((oc_cloud_context_t *)data);
+  return OC_EVENT_DONE;
+}
 
-  rd_publish(ctx->cloud_ep, ctx->rd_publish_resources, ctx->device,
-             ctx->time_to_live, publish_resources_handler, LOW_QOS, ctx);
+static void
+schedule_publish_changes(oc_cloud_context_t *ctx)
+{
+  if (!oc_has_delayed_callback(ctx, publish_changes_async, false)) {
+    oc_set_delayed_callback_ms_v1(ctx, publish_changes_async,
+                                  OC_CLOUD_RD_PUBLISH_DELAY_MS);
+  }
 }
 
 int
@@ -167,12 +444,9 @@ oc_cloud_add_resource(oc_resource_t *res)
   if (ctx == NULL) {
     return -1;
   }
-  const oc_link_t *publish = rd_link_find(ctx->rd_publish_resources, res);
-  if (publish != NULL) {
-    return 0;
-  }
-  const oc_link_t *published = rd_link_find(ctx->rd_published_resources, res);
-  if (published != NULL) {
+  if (rd_link_find(ctx->rd_publish_resources, res) != NULL ||
+      rd_link_find(ctx->rd_publishing_resources, res) != NULL ||
+      rd_link_find(ctx->rd_published_resources, res) != NULL) {
     return 0;
   }
   oc_link_t *delete =
@@ -182,18 +456,19 @@ oc_cloud_add_resource(oc_resource_t *res)
   }
 
   oc_link_t *link = oc_new_link(res);
+  if (link == NULL) {
+    return -1;
+  }
+  link->ins = rd_link_instance_id(res);
   rd_link_add(&ctx->rd_publish_resources, link);
-  publish_resources(ctx);
+  schedule_publish_changes(ctx);
   return 0;
 }
 
 static void
 move_published_to_publish_resources(oc_cloud_context_t *ctx)
 {
-  while (ctx->rd_published_resources) {
-    oc_link_t *link = rd_link_pop(&ctx->rd_published_resources);
-    rd_link_add(&ctx->rd_publish_resources, link);
-  }
+  rd_link_move_all(&ctx->rd_publish_resources, &ctx->rd_published_resources);
 }
 
 static oc_event_callback_retval_t
@@ -208,10 +483,34 @@ publish_published_resources(void *data)
 static void
 delete_resources_handler(oc_client_response_t *data)
 {
+  oc_cloud_context_t *ctx = (oc_cloud_context_t *)data->user_data;
   OC_DBG("[CRD] delete resources handler(%d)", data->code);
-  (void)data;
+  ctx->rd_deleting = false;
+
+  // links unknown to the resource directory don't need to be deleted
+  bool deleted =
+    data->code == OC_STATUS_DELETED || data->code == OC_STATUS_NOT_FOUND;
+  if (deleted) {
+    rd_link_free(&ctx->rd_deleting_resources);
+  } else {
+    rd_link_move_all(&ctx->rd_delete_resources, &ctx->rd_deleting_resources);
+  }
+
+  if ((ctx->store.status & OC_CLOUD_LOGGED_IN) == 0) {
+    return;
+  }
+  if (!deleted) {
+    OC_ERR("[CRD] cannot unpublish resource links(%d)", data->code);
+    rd_schedule_retry(ctx);
+    return;
+  }
+  ctx->rd_retry_count = 0;
+  delete_resources(ctx);
+  rd_update_published_digests(ctx);
 }
 
+/* Delete the next batch of links, the following batch is deleted when the
+ * resource directory responds. */
 static void
 delete_resources(oc_cloud_context_t *ctx)
 {
@@ -225,17 +524,30 @@ delete_resources(oc_cloud_context_t *ctx)
     OC_DBG("cannot unpublish resource links when not logged in");
     return;
   }
-
-  if (ctx->rd_delete_resources == NULL) {
+  if (ctx->rd_deleting || ctx->rd_delete_resources == NULL) {
     return;
   }
 
-  if (!rd_delete(ctx->cloud_ep, ctx->rd_delete_resources, ctx->device,
-                 delete_resources_handler, LOW_QOS, ctx)) {
+  ctx->rd_deleting_resources =
+    rd_link_split(&ctx->rd_delete_resources, RD_DELETE_BATCH_SIZE);
+  ctx->rd_deleting = rd_delete(ctx->cloud_ep, ctx->rd_deleting_resources,
+                               ctx->device, delete_resources_handler, LOW_QOS,
+                               ctx);
+  if (!ctx->rd_deleting) {
     OC_ERR("cannot send unpublish resource links request");
-    return;
+    rd_link_move_all(&ctx->rd_delete_resources, &ctx->rd_deleting_resources);
+    rd_schedule_retry(ctx);
   }
-  rd_link_free(&ctx->rd_delete_resources);
+}
+
+/* Links of requests without a response are sent again after a login. */
+static void
+rd_cancel_requests(oc_cloud_context_t *ctx)
+{
+  ctx->rd_publishing = false;
+  ctx->rd_deleting = false;
+  rd_link_move_all(&ctx->rd_publish_resources, &ctx->rd_publishing_resources);
+  rd_link_move_all(&ctx->rd_delete_resources, &ctx->rd_deleting_resources);
 }
 
 void
@@ -243,16 +555,20 @@ cloud_rd_manager_status_changed(oc_cloud_context_t *ctx)
 {
   if ((ctx->store.status & OC_CLOUD_LOGGED_IN) == 0) {
     oc_remove_delayed_callback(ctx, publish_published_resources);
+    oc_remove_delayed_callback(ctx, publish_changes_async);
+    rd_cancel_requests(ctx);
     return;
   }
   if ((ctx->store.status & OC_CLOUD_REFRESHED_TOKEN) != 0) {
     // when refresh occurs we don't want to publish resources.
     return;
   }
-  if (ctx->rd_publish_resources != NULL) {
-    publish_resources(ctx);
-  }
-  delete_resources(ctx);
+  oc_remove_delayed_callback(ctx, publish_changes_async);
+  ctx->rd_retry_count = 0;
+  publish_resources_diff(ctx);
+  publish_changes(ctx);
+  // the digests are invalid until the changes are acknowledged
+  rd_update_published_digests(ctx);
   oc_remove_delayed_callback(ctx, publish_published_resources);
   if (ctx->time_to_live != RD_PUBLISH_TTL_UNLIMITED) {
     oc_set_delayed_callback(ctx, publish_published_resources, ONE_HOUR);
@@ -263,8 +579,14 @@ void
 cloud_rd_deinit(oc_cloud_context_t *ctx)
 {
   oc_remove_delayed_callback(ctx, publish_published_resources);
+  oc_remove_delayed_callback(ctx, publish_changes_async);
+  ctx->rd_publishing = false;
+  ctx->rd_deleting = false;
+  ctx->rd_retry_count = 0;
 
+  rd_link_free(&ctx->rd_deleting_resources);
   rd_link_free(&ctx->rd_delete_resources);
+  rd_link_free(&ctx->rd_publishing_resources);
   rd_link_free(&ctx->rd_published_resources);
   rd_link_free(&ctx->rd_publish_resources);
 }
@@ -273,6 +595,9 @@ void
 cloud_rd_reset_context(oc_cloud_context_t *ctx)
 {
   oc_remove_delayed_callback(ctx, publish_published_resources);
+  oc_remove_delayed_callback(ctx, publish_changes_async);
+  rd_cancel_requests(ctx);
+  ctx->rd_retry_count = 0;
 
   rd_link_free(&ctx->rd_delete_resources);
   move_published_to_publish_resources(ctx);
@@ -294,6 +619,10 @@ oc_cloud_delete_resource(oc_resource_t *res)
 
   oc_link_t *published =
     rd_link_remove_by_resource(&ctx->rd_published_resources, res);
+  if (published == NULL) {
+    // the link might be acknowledged by the pending response
+    published = rd_link_remove_by_resource(&ctx->rd_publishing_resources, res);
+  }
 
 #ifdef OC_SECURITY
   const oc_sec_pstat_t *pstat = oc_sec_get_pstat(res->device);
@@ -308,11 +637,9 @@ oc_cloud_delete_resource(oc_resource_t *res)
 #endif /* OC_SECURITY */
 
   if (published != NULL) {
-    if (published->resource) {
-      published->resource = NULL;
-    }
+    published->resource = NULL;
     rd_link_add(&ctx->rd_delete_resources, published);
-    delete_resources(ctx);
+    schedule_publish_changes(ctx);
   }
 }
 
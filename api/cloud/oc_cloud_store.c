@@ -21,6 +21,7 @@
 
 #ifdef OC_CLOUD
 
+#include "api/oc_rep_encode_internal.h"
 #include "api/oc_rep_internal.h"
 #include "oc_api.h"
 #include "oc_cloud_internal.h"
@@ -31,6 +32,7 @@
 #ifdef OC_DYNAMIC_ALLOCATION
 #include <stdlib.h>
 #endif /* OC_DYNAMIC_ALLOCATION */
+#include <string.h>
 
 #ifndef OC_STORAGE
 #error Preprocessor macro OC_CLOUD is defined but OC_STORAGE is not defined \
@@ -47,6 +49,7 @@ check oc_config.h and make sure OC_STORAGE is defined if OC_CLOUD is defined.
 #define CLOUD_EXPIRES_IN expires_in
 #define CLOUD_STATUS status
 #define CLOUD_CPS cps
+#define CLOUD_RD_DIGESTS rd_digests
 
 #define CLOUD_STR(s) #s
 #define CLOUD_XSTR(s) CLOUD_STR(s)
@@ -84,6 +87,20 @@ rep_set_int(CborEncoder *object_map, const char *key, int64_t value)
   g_err |= oc_rep_encode_int(object_map, value);
 }
 
+static void
+rep_set_uint_array(CborEncoder *object_map, const char *key,
+                   const uint64_t *values, size_t size)
+{
+  g_err |= oc_rep_encode_text_string(object_map, key, strlen(key));
+  CborEncoder array;
+  memset(&array, 0, sizeof(array));
+  g_err |= oc_rep_encoder_create_array(object_map, &array, size);
+  for (size_t i = 0; i < size; ++i) {
+    g_err |= oc_rep_encode_int(&array, (int64_t)values[i]);
+  }
+  g_err |= oc_rep_encoder_close_container(object_map, &array);
+}
+
 static void
 gen_cloud_tag(const char *name, size_t device, char *cloud_tag)
 {
@@ -110,6 +127,8 @@ encode_cloud_with_map(CborEncoder *object_map, const oc_cloud_store_t *store)
   rep_set_int(object_map, CLOUD_XSTR(CLOUD_STATUS), store->status);
   rep_set_int(object_map, CLOUD_XSTR(CLOUD_CPS), store->cps);
   rep_set_int(object_map, CLOUD_XSTR(CLOUD_EXPIRES_IN), store->expires_in);
+  rep_set_uint_array(object_map, CLOUD_XSTR(CLOUD_RD_DIGESTS),
+                     store->rd_digests, OC_CLOUD_RD_DIGESTS);
 }
 
 static void
@@ -131,9 +150,16 @@ cloud_store_dump_internal(const char *store_name, const oc_cloud_store_t *store)
   uint8_t *buf = malloc(OC_MIN_APP_DATA_SIZE);
   if (!buf)
     return -1;
-  oc_rep_new_realloc(&buf, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
 #else  /* OC_DYNAMIC_ALLOCATION */
   uint8_t buf[OC_MIN_APP_DATA_SIZE];
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  // the store might be dumped while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+#ifdef OC_DYNAMIC_ALLOCATION
+  oc_rep_new_realloc(&buf, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
+#else  /* OC_DYNAMIC_ALLOCATION */
   oc_rep_new(buf, OC_MIN_APP_DATA_SIZE);
 #endif /* !OC_DYNAMIC_ALLOCATION */
 
@@ -143,6 +169,7 @@ cloud_store_dump_internal(const char *store_name, const oc_cloud_store_t *store)
   buf = oc_rep_shrink_encoder_buf(buf);
 #endif /* OC_DYNAMIC_ALLOCATION */
   long size = oc_rep_get_encoded_payload_size();
+  oc_rep_encoder_set_context(prev_encoder_ctx);
   if (size > 0) {
     size = oc_storage_write(store_name, buf, size);
   }
@@ -255,6 +282,29 @@ cloud_store_parse_int_property(const oc_rep_t *rep, oc_cloud_store_t *store)
   return false;
 }
 
+static bool
+cloud_store_parse_int_array_property(const oc_rep_t *rep,
+                                     oc_cloud_store_t *store)
+{
+  assert(rep->type == OC_REP_INT_ARRAY);
+
+  if (oc_rep_is_property(rep, CLOUD_XSTR(CLOUD_RD_DIGESTS),
+                         CLOUD_XSTRLEN(CLOUD_RD_DIGESTS))) {
+    // digests stored with a different number of buckets are unknown
+    size_t size = oc_int_array_size(rep->value.array);
+    const int64_t *digests = oc_int_array(rep->value.array);
+    for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+      store->rd_digests[i] =
+        size == OC_CLOUD_RD_DIGESTS ? (uint64_t)digests[i] : 0;
+    }
+    return true;
+  }
+
+  OC_ERR("[CLOUD_STORE] Unknown integer array property %s",
+         oc_string(rep->name));
+  return false;
+}
+
 static int
 cloud_store_decode(const oc_rep_t *rep, oc_cloud_store_t *store)
 {
@@ -270,6 +320,11 @@ cloud_store_decode(const oc_rep_t *rep, oc_cloud_store_t *store)
         return -1;
       }
       break;
+    case OC_REP_INT_ARRAY:
+      if (!cloud_store_parse_int_array_property(rep, store)) {
+        return -1;
+      }
+      break;
     default:
       OC_ERR("[CLOUD_STORE] Unknown property %s", oc_string(rep->name));
       return -1;
@@ -341,6 +396,7 @@ cloud_store_deinitialize(oc_cloud_store_t *store)
   store->status = 0;
   store->expires_in = 0;
   store->cps = OC_CPS_UNINITIALIZED;
+  memset(store->rd_digests, 0, sizeof(store->rd_digests));
 }
 
 #endif /* OC_CLOUD */
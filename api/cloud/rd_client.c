@@ -30,6 +30,11 @@
 #include <inttypes.h>
 #include <stdlib.h>
 
+/* Timeout in seconds of a publish request */
+#ifndef RD_PUBLISH_TIMEOUT
+#define RD_PUBLISH_TIMEOUT (30)
+#endif /* RD_PUBLISH_TIMEOUT */
+
 static void
 _add_resource_payload(CborEncoder *parent, oc_resource_t *resource,
                       const char *rel, int64_t ins)
@@ -84,7 +89,7 @@ rd_publish_with_device_id(const oc_endpoint_t *endpoint, const oc_link_t *links,
     return false;
   }
 
-  return oc_do_post();
+  return oc_do_post_with_timeout(RD_PUBLISH_TIMEOUT);
 }
 
 bool
@@ -44,6 +44,7 @@ extern "C" {
   @param ttl Time in seconds to indicate a RD, i.e. how long to keep this
     published item.
   @param handler To refer to the request sent out on behalf of calling this API.
+    Invoked with OC_REQUEST_TIMEOUT if no response is received in time.
   @param qos Quality of service.
   @param user_data The user data passed from the registration function.
   @return Returns true if success.
@@ -25,6 +25,7 @@
 #include "oc_cloud_store_internal.h"
 #include "oc_rep.h"
 
+#include <algorithm>
 #include <gtest/gtest.h>
 #include <pthread.h>
 #include <string>
@@ -393,3 +394,55 @@ TEST_F(TestCloudManagerData, cloud_manager_parse_refresh_token_data)
   EXPECT_STREQ(rt.c_str(), oc_string(GetContext()->store.refresh_token));
   EXPECT_EQ(expiresin, GetContext()->store.expires_in);
 }
+
+TEST_F(TestCloudManagerData, cloud_manager_retry_delay)
+{
+  uint8_t retry[6] = { 0 };
+  size_t retry_size =
+    cloud_manager_get_retry(retry, sizeof(retry) / sizeof(retry[0]));
+  ASSERT_LT(0, retry_size);
+  uint64_t base = retry[0] * 1000;
+
+  for (size_t i = 0; i < retry_size; ++i) {
+    uint64_t prev = std::max<uint64_t>(GetContext()->retry_delay_ms, base);
+    uint64_t max = std::min<uint64_t>(3 * prev, retry[i] * 1000);
+    uint64_t delay = cloud_manager_retry_delay_ms(GetContext(), retry[i]);
+    EXPECT_LE(base < max ? base : max / 2, delay);
+    EXPECT_GE(max, delay);
+    EXPECT_EQ(delay, GetContext()->retry_delay_ms);
+  }
+
+  // the first retry is jittered as well
+  GetContext()->retry_delay_ms = 0;
+  bool jittered = false;
+  for (int i = 0; i < 100 && !jittered; ++i) {
+    uint64_t delay = cloud_manager_retry_delay_ms(GetContext(), retry[0]);
+    EXPECT_LE(base / 2, delay);
+    EXPECT_GE(base, delay);
+    jittered = delay != base;
+    GetContext()->retry_delay_ms = 0;
+  }
+  EXPECT_TRUE(jittered);
+}
+
+TEST_F(TestCloudManagerData, cloud_manager_refresh_token_delay)
+{
+  EXPECT_EQ(0, cloud_manager_refresh_token_delay_ms(-1));
+  EXPECT_EQ(0, cloud_manager_refresh_token_delay_ms(0));
+  EXPECT_EQ(20 * 1000, cloud_manager_refresh_token_delay_ms(20));
+  for (int i = 0; i < 10; ++i) {
+    uint64_t delay = cloud_manager_refresh_token_delay_ms(3600);
+    EXPECT_LE(3600 * 1000 * 3 / 4, delay);
+    EXPECT_GE(3600 * 1000 * 9 / 10, delay);
+  }
+  // lifetimes longer than UINT16_MAX seconds aren't truncated
+  uint64_t day_ms = 24 * 3600 * 1000ULL;
+  uint64_t delay = cloud_manager_refresh_token_delay_ms(24 * 3600);
+  EXPECT_LE(day_ms * 3 / 4, delay);
+  EXPECT_GE(day_ms * 9 / 10, delay);
+  // and don't overflow
+  uint64_t max_ms = UINT32_MAX * 1000ULL;
+  delay = cloud_manager_refresh_token_delay_ms(INT64_MAX / 4);
+  EXPECT_LE(max_ms / 4 * 3, delay);
+  EXPECT_GE(max_ms / 10 * 9, delay);
+}
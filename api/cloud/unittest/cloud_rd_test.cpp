@@ -17,6 +17,7 @@
  ******************************************************************/
 
 #include <gtest/gtest.h>
+#include <cstring>
 #include <pthread.h>
 
 #include "oc_api.h"
@@ -142,3 +143,206 @@ TEST_F(TestCloudRD, cloud_delete)
   // Clean-up
   EXPECT_TRUE(oc_delete_resource(res1));
 }
+
+TEST_F(TestCloudRD, cloud_publish_stable_instance_id)
+{
+  // When
+  oc_resource_t *res1 = oc_new_resource(nullptr, "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res1, "test");
+  ASSERT_EQ(0, oc_cloud_add_resource(res1));
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(nullptr, ctx);
+  ASSERT_NE(nullptr, ctx->rd_publish_resources);
+  int64_t ins = ctx->rd_publish_resources->ins;
+  oc_cloud_delete_resource(res1);
+  ASSERT_EQ(0, oc_cloud_add_resource(res1));
+
+  // Then
+  ASSERT_NE(nullptr, ctx->rd_publish_resources);
+  EXPECT_LE(0, ins);
+  EXPECT_EQ(ins, ctx->rd_publish_resources->ins);
+
+  // Clean-up
+  oc_cloud_delete_resource(res1);
+  EXPECT_TRUE(oc_delete_resource(res1));
+}
+
+TEST_F(TestCloudRD, cloud_publish_batch)
+{
+  // Given
+  oc_resource_t *res1 = oc_new_resource(nullptr, "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res1, "test");
+  oc_resource_t *res2 = oc_new_resource(nullptr, "/light/2", 1, 0);
+  oc_resource_bind_resource_type(res2, "test");
+  oc_link_t *l1 = oc_new_link(res1);
+  oc_link_t *l2 = oc_new_link(res2);
+  ASSERT_NE(nullptr, l1);
+  ASSERT_NE(nullptr, l2);
+  l1->next = l2;
+
+  // Then
+  EXPECT_EQ(0, cloud_rd_links_batch_size(nullptr, 1024));
+  // a link larger than the bound is published alone
+  EXPECT_EQ(1, cloud_rd_links_batch_size(l1, 1));
+  EXPECT_EQ(2, cloud_rd_links_batch_size(l1, 1024));
+
+  // Clean-up
+  l1->next = nullptr;
+  oc_delete_link(l1);
+  oc_delete_link(l2);
+  EXPECT_TRUE(oc_delete_resource(res1));
+  EXPECT_TRUE(oc_delete_resource(res2));
+}
+
+TEST_F(TestCloudRD, cloud_publish_digest)
+{
+  // Given
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(nullptr, ctx);
+  oc_resource_t *res1 = oc_new_resource(nullptr, "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res1, "test");
+  oc_resource_t *res2 = oc_new_resource(nullptr, "/light/2", 1, 0);
+  oc_resource_bind_resource_type(res2, "test");
+  oc_link_t *l1 = oc_new_link(res1);
+  oc_link_t *l2 = oc_new_link(res2);
+  ASSERT_NE(nullptr, l1);
+  ASSERT_NE(nullptr, l2);
+  // both links in the same bucket
+  l2->ins = l1->ins + OC_CLOUD_RD_DIGESTS;
+  ASSERT_EQ(cloud_rd_link_bucket(l1), cloud_rd_link_bucket(l2));
+  size_t bucket = cloud_rd_link_bucket(l1);
+
+  // Then
+  uint64_t empty[OC_CLOUD_RD_DIGESTS] = { 0 };
+  uint64_t digests[OC_CLOUD_RD_DIGESTS] = { 0 };
+  cloud_rd_links_digests(ctx, nullptr, digests);
+  EXPECT_EQ(0, memcmp(empty, digests, sizeof(digests)));
+  l1->next = l2;
+  cloud_rd_links_digests(ctx, l1, digests);
+  uint64_t digest = digests[bucket];
+  EXPECT_NE(0, digest);
+  // other buckets are not affected
+  digests[bucket] = 0;
+  EXPECT_EQ(0, memcmp(empty, digests, sizeof(digests)));
+  // the order of the links doesn't matter
+  l1->next = nullptr;
+  l2->next = l1;
+  memset(digests, 0, sizeof(digests));
+  cloud_rd_links_digests(ctx, l2, digests);
+  EXPECT_EQ(digest, digests[bucket]);
+  // the instance id assigned by the resource directory does
+  l1->ins += 2 * OC_CLOUD_RD_DIGESTS;
+  memset(digests, 0, sizeof(digests));
+  cloud_rd_links_digests(ctx, l2, digests);
+  EXPECT_NE(digest, digests[bucket]);
+
+  // Clean-up
+  l2->next = nullptr;
+  oc_delete_link(l1);
+  oc_delete_link(l2);
+  EXPECT_TRUE(oc_delete_resource(res1));
+  EXPECT_TRUE(oc_delete_resource(res2));
+}
+
+TEST_F(TestCloudRD, cloud_publish_diff)
+{
+  // Given
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(nullptr, ctx);
+  oc_resource_t *res1 = oc_new_resource(nullptr, "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res1, "test");
+  oc_resource_t *res2 = oc_new_resource(nullptr, "/light/2", 1, 0);
+  oc_resource_bind_resource_type(res2, "test");
+  ASSERT_EQ(0, oc_cloud_add_resource(res1));
+  ASSERT_EQ(0, oc_cloud_add_resource(res2));
+  size_t bucket1 = 0;
+  size_t bucket2 = 0;
+  for (oc_link_t *l = ctx->rd_publish_resources; l != nullptr; l = l->next) {
+    (l->resource == res1 ? bucket1 : bucket2) = cloud_rd_link_bucket(l);
+  }
+  // the digests acknowledged by the resource directory before a restart
+  uint64_t digests[OC_CLOUD_RD_DIGESTS] = { 0 };
+  cloud_rd_links_digests(ctx, ctx->rd_publish_resources, digests);
+  for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+    ctx->store.rd_digests[i] = digests[i] != 0 ? digests[i] : 1;
+  }
+  // nothing is sent by the test
+  oc_endpoint_t *cloud_ep = ctx->cloud_ep;
+  ctx->cloud_ep = nullptr;
+
+  // When
+  ctx->store.status = OC_CLOUD_LOGGED_IN;
+  cloud_rd_manager_status_changed(ctx);
+
+  // Then
+  EXPECT_EQ(nullptr, ctx->rd_publish_resources);
+  EXPECT_EQ(res1, findResource(ctx->rd_published_resources, res1));
+  EXPECT_EQ(res2, findResource(ctx->rd_published_resources, res2));
+
+  // When
+  cloud_rd_reset_context(ctx);
+  if (bucket1 != bucket2) {
+    ctx->store.rd_digests[bucket2] = 0;
+  }
+  cloud_rd_manager_status_changed(ctx);
+
+  // Then
+  EXPECT_EQ(bucket1 != bucket2,
+            res1 == findResource(ctx->rd_published_resources, res1));
+  EXPECT_EQ(nullptr, findResource(ctx->rd_published_resources, res2));
+
+  // Clean-up
+  ctx->store.status = 0;
+  cloud_rd_manager_status_changed(ctx);
+  ctx->cloud_ep = cloud_ep;
+  memset(ctx->store.rd_digests, 0, sizeof(ctx->store.rd_digests));
+  oc_cloud_delete_resource(res1);
+  oc_cloud_delete_resource(res2);
+  EXPECT_TRUE(oc_delete_resource(res1));
+  EXPECT_TRUE(oc_delete_resource(res2));
+}
+
+#ifndef OC_SECURITY
+
+TEST_F(TestCloudRD, cloud_publish_retry)
+{
+  // Given
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(nullptr, ctx);
+  oc_resource_t *res1 = oc_new_resource(nullptr, "/light/1", 1, 0);
+  oc_resource_bind_resource_type(res1, "test");
+  ASSERT_EQ(0, oc_cloud_add_resource(res1));
+  // the request cannot be sent without an endpoint
+  oc_endpoint_t *cloud_ep = ctx->cloud_ep;
+  ctx->cloud_ep = nullptr;
+
+  // When
+  ctx->store.status = OC_CLOUD_LOGGED_IN;
+  cloud_rd_manager_status_changed(ctx);
+
+  // Then
+  EXPECT_FALSE(ctx->rd_publishing);
+  EXPECT_EQ(nullptr, ctx->rd_publishing_resources);
+  EXPECT_EQ(res1, findResource(ctx->rd_publish_resources, res1));
+  EXPECT_EQ(1, ctx->rd_retry_count);
+  // the digests are invalid until the links are acknowledged
+  uint64_t empty[OC_CLOUD_RD_DIGESTS] = { 0 };
+  EXPECT_EQ(0, memcmp(empty, ctx->store.rd_digests, sizeof(empty)));
+
+  // When
+  poolEvents(OC_CLOUD_RD_RETRY_DELAY_MS / 1000 + 1);
+
+  // Then
+  EXPECT_EQ(2, ctx->rd_retry_count);
+  EXPECT_EQ(res1, findResource(ctx->rd_publish_resources, res1));
+
+  // Clean-up
+  ctx->store.status = 0;
+  cloud_rd_manager_status_changed(ctx);
+  ctx->rd_retry_count = 0;
+  ctx->cloud_ep = cloud_ep;
+  oc_cloud_delete_resource(res1);
+  EXPECT_TRUE(oc_delete_resource(res1));
+}
+
+#endif /* !OC_SECURITY */
@@ -0,0 +1,207 @@
+/******************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "oc_api.h"
+#include "oc_client_state.h"
+#include "oc_cloud_context_internal.h"
+#include "oc_cloud_internal.h"
+#include "tests/gtest/Endpoint.h"
+
+#include <cstring>
+#include <vector>
+
+static const std::string kServer{ "coaps+tcp://10.0.0.1:5684" };
+
+class TestCloudSession : public testing::Test {
+public:
+  static oc_handler_t s_handler;
+
+  static int appInit(void)
+  {
+    int result = oc_init_platform("OCFCloud", nullptr, nullptr);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp 1", "ocf.1.0.0",
+                            "ocf.res.1.0.0", nullptr, nullptr);
+    result |= oc_add_device("/oic/d", "oic.d.light", "Lamp 2", "ocf.1.0.0",
+                            "ocf.res.1.0.0", nullptr, nullptr);
+    return result;
+  }
+
+  static void signalEventLoop(void)
+  {
+    // no-op for tests
+  }
+
+  struct Response
+  {
+    const void *user_data;
+    oc_status_t code;
+  };
+
+  static std::vector<Response> s_responses;
+
+  static void onResponse(oc_client_response_t *data)
+  {
+    s_responses.push_back({ data->user_data, data->code });
+  }
+
+  static oc_client_cb_t *pendingRequest(const oc_endpoint_t *ep,
+                                        void *user_data)
+  {
+    oc_client_handler_t handler{};
+    handler.response = onResponse;
+    return oc_ri_alloc_client_cb("/oic/rd", ep, OC_POST, nullptr, handler,
+                                 LOW_QOS, user_data);
+  }
+
+  static void countContext(oc_cloud_context_t *, void *user_data)
+  {
+    ++*static_cast<int *>(user_data);
+  }
+
+protected:
+  static void SetUpTestCase()
+  {
+    s_handler.init = &appInit;
+    s_handler.signal_event_loop = &signalEventLoop;
+    ASSERT_EQ(0, oc_main_init(&s_handler));
+  }
+
+  static void TearDownTestCase() { oc_main_shutdown(); }
+
+  void SetUp() override
+  {
+    m_ctx1 = oc_cloud_get_context(0);
+    m_ctx2 = oc_cloud_get_context(1);
+    ASSERT_NE(nullptr, m_ctx1);
+    ASSERT_NE(nullptr, m_ctx2);
+    m_ep = oc::endpoint::FromString(kServer);
+    s_responses.clear();
+  }
+
+  void TearDown() override
+  {
+    oc_ri_free_client_cbs_by_endpoint_v1(&m_ep, OC_CANCELLED);
+    memset(m_ctx1->cloud_ep, 0, sizeof(oc_endpoint_t));
+    memset(m_ctx2->cloud_ep, 0, sizeof(oc_endpoint_t));
+    m_ctx1->cloud_manager = false;
+    m_ctx2->cloud_manager = false;
+    s_responses.clear();
+  }
+
+  oc_cloud_context_t *m_ctx1{ nullptr };
+  oc_cloud_context_t *m_ctx2{ nullptr };
+  oc_endpoint_t m_ep{};
+};
+
+oc_handler_t TestCloudSession::s_handler;
+std::vector<TestCloudSession::Response> TestCloudSession::s_responses;
+
+TEST_F(TestCloudSession, SessionRefs)
+{
+  EXPECT_EQ(0, cloud_context_session_refs(&m_ep));
+  oc_endpoint_copy(m_ctx1->cloud_ep, &m_ep);
+  EXPECT_EQ(1, cloud_context_session_refs(&m_ep));
+  oc_endpoint_copy(m_ctx2->cloud_ep, &m_ep);
+  EXPECT_EQ(2, cloud_context_session_refs(&m_ep));
+
+  oc_endpoint_t other = oc::endpoint::FromString("coaps+tcp://10.0.0.2:5684");
+  EXPECT_EQ(0, cloud_context_session_refs(&other));
+  oc_endpoint_t empty{};
+  EXPECT_EQ(0, cloud_context_session_refs(&empty));
+}
+
+TEST_F(TestCloudSession, DispatchSessionEvents)
+{
+  oc_endpoint_copy(m_ctx1->cloud_ep, &m_ep);
+  oc_endpoint_copy(m_ctx2->cloud_ep, &m_ep);
+  m_ctx1->cloud_manager = true;
+  m_ctx2->cloud_manager = true;
+
+  // an event of the shared session is dispatched to both devices
+  int count = 0;
+  cloud_context_iterate_session(&m_ep, nullptr, countContext, &count);
+  EXPECT_EQ(2, count);
+  count = 0;
+  cloud_context_iterate_session(&m_ep, m_ctx1, countContext, &count);
+  EXPECT_EQ(1, count);
+
+  // a device connected to another server isn't affected
+  oc_endpoint_t other = oc::endpoint::FromString("coaps+tcp://10.0.0.2:5684");
+  oc_endpoint_copy(m_ctx2->cloud_ep, &other);
+  count = 0;
+  cloud_context_iterate_session(&m_ep, nullptr, countContext, &count);
+  EXPECT_EQ(1, count);
+  count = 0;
+  cloud_context_iterate_session(&other, nullptr, countContext, &count);
+  EXPECT_EQ(1, count);
+}
+
+TEST_F(TestCloudSession, InterruptRequestsOfDevice)
+{
+  oc_endpoint_copy(m_ctx1->cloud_ep, &m_ep);
+  oc_endpoint_copy(m_ctx2->cloud_ep, &m_ep);
+  ASSERT_NE(nullptr, pendingRequest(&m_ep, m_ctx1));
+  ASSERT_NE(nullptr, pendingRequest(&m_ep, m_ctx2));
+  // requests of cloud API calls carry the parameters of the call
+  cloud_api_param_t *p = alloc_api_param();
+  ASSERT_NE(nullptr, p);
+  p->ctx = m_ctx1;
+  ASSERT_NE(nullptr, pendingRequest(&m_ep, p));
+  EXPECT_EQ(p, cloud_api_param_find(p));
+
+  cloud_interrupt_requests(m_ctx1);
+
+  ASSERT_EQ(2, s_responses.size());
+  for (const auto &response : s_responses) {
+    EXPECT_TRUE(response.user_data == m_ctx1 || response.user_data == p);
+    EXPECT_EQ(OC_CONNECTION_CLOSED, response.code);
+  }
+  EXPECT_NE(nullptr, oc_ri_get_client_cb("/oic/rd", &m_ep, OC_POST));
+
+  free_api_param(p);
+  EXPECT_EQ(nullptr, cloud_api_param_find(p));
+}
+
+TEST_F(TestCloudSession, ReleaseSharedSession)
+{
+  oc_endpoint_copy(m_ctx1->cloud_ep, &m_ep);
+  oc_endpoint_copy(m_ctx2->cloud_ep, &m_ep);
+  ASSERT_NE(nullptr, pendingRequest(&m_ep, m_ctx1));
+  ASSERT_NE(nullptr, pendingRequest(&m_ep, m_ctx2));
+
+  // the session stays open for the other device
+  cloud_release_endpoint(m_ctx1);
+
+  EXPECT_TRUE(oc_endpoint_is_empty(m_ctx1->cloud_ep));
+  EXPECT_EQ(OC_SESSION_DISCONNECTED, m_ctx1->cloud_ep_state);
+  EXPECT_EQ(0, oc_endpoint_compare(&m_ep, m_ctx2->cloud_ep));
+  EXPECT_EQ(1, cloud_context_session_refs(&m_ep));
+  ASSERT_EQ(1, s_responses.size());
+  EXPECT_EQ(m_ctx1, s_responses[0].user_data);
+  oc_client_cb_t *cb = oc_ri_get_client_cb("/oic/rd", &m_ep, OC_POST);
+  ASSERT_NE(nullptr, cb);
+  EXPECT_EQ(m_ctx2, cb->user_data);
+
+  // the last device closes the session
+  cloud_release_endpoint(m_ctx2);
+
+  EXPECT_TRUE(oc_endpoint_is_empty(m_ctx2->cloud_ep));
+  EXPECT_EQ(0, cloud_context_session_refs(&m_ep));
+}
@@ -40,6 +40,7 @@
 #define STATUS (OC_CLOUD_LOGGED_IN)
 #define UID ("uid")
 #define CPS (OC_CPS_READYTOREGISTER)
+#define RD_DIGEST (0xfedcba9876543210ULL)
 #define CLOUD_STORAGE ("storage_cloud")
 
 #define DEFAULT_CLOUD_CIS ("coaps+tcp://127.0.0.1")
@@ -60,6 +61,9 @@ public:
     EXPECT_EQ(0, store->expires_in);
     EXPECT_EQ(0, store->status);
     EXPECT_EQ(0, store->cps);
+    for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+      EXPECT_EQ(0, store->rd_digests[i]);
+    }
   }
 
 #ifdef OC_STORAGE
@@ -76,6 +80,9 @@ public:
     EXPECT_EQ(s1->device, s2->device);
     EXPECT_EQ(s1->cps, s2->cps);
     EXPECT_EQ(s1->status, s2->status);
+    for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+      EXPECT_EQ(s1->rd_digests[i], s2->rd_digests[i]);
+    }
   }
 #endif /* OC_STORAGE */
 
@@ -122,6 +129,9 @@ public:
     m_store.device = DEVICE;
     m_store.cps = CPS;
     m_store.status = STATUS;
+    for (size_t i = 0; i < OC_CLOUD_RD_DIGESTS; ++i) {
+      m_store.rd_digests[i] = RD_DIGEST + i;
+    }
   }
 
   void TearDown() override
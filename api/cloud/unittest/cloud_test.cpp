@@ -20,8 +20,10 @@
 #include <pthread.h>
 
 #include "oc_api.h"
+#include "oc_cloud_context_internal.h"
 #include "oc_cloud_internal.h"
 #include "oc_collection.h"
+#include "tests/gtest/Endpoint.h"
 
 class TestCloud : public testing::Test {
 public:
@@ -158,3 +160,42 @@ TEST_F(TestCloud, oc_cloud_provision_conf_resource)
   EXPECT_STREQ(sid, oc_string(ctx->store.sid));
   EXPECT_EQ(OC_CLOUD_INITIALIZED, ctx->store.status);
 }
+
+static void
+countContext(oc_cloud_context_t *, void *user_data)
+{
+  ++*static_cast<int *>(user_data);
+}
+
+TEST_F(TestCloud, cloud_context_iterate_session)
+{
+  oc_cloud_context_t *ctx = oc_cloud_get_context(0);
+  ASSERT_NE(nullptr, ctx);
+  oc_endpoint_t ep = oc::endpoint::FromString("coaps+tcp://10.0.0.1:5684");
+  oc_endpoint_copy(ctx->cloud_ep, &ep);
+  bool cloud_manager = ctx->cloud_manager;
+
+  // contexts without a running cloud manager are skipped
+  ctx->cloud_manager = false;
+  int count = 0;
+  cloud_context_iterate_session(&ep, nullptr, countContext, &count);
+  EXPECT_EQ(0, count);
+
+  ctx->cloud_manager = true;
+  cloud_context_iterate_session(&ep, nullptr, countContext, &count);
+  EXPECT_EQ(1, count);
+  count = 0;
+  cloud_context_iterate_session(&ep, ctx, countContext, &count);
+  EXPECT_EQ(0, count);
+  oc_endpoint_t other = oc::endpoint::FromString("coaps+tcp://10.0.0.2:5684");
+  cloud_context_iterate_session(&other, nullptr, countContext, &count);
+  EXPECT_EQ(0, count);
+
+  // the context itself is never returned
+  ctx->store.status = OC_CLOUD_LOGGED_IN;
+  EXPECT_EQ(nullptr, cloud_context_find_logged_in_to_server(ctx));
+
+  ctx->store.status = 0;
+  ctx->cloud_manager = cloud_manager;
+  memset(ctx->cloud_ep, 0, sizeof(oc_endpoint_t));
+}
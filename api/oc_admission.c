@@ -0,0 +1,318 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "api/oc_admission_internal.h"
+#include "port/oc_clock.h"
+#include "port/oc_log_internal.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+
+#ifdef OC_SERVER
+#include "api/oc_deferred_response_internal.h"
+#endif /* OC_SERVER */
+
+#ifdef OC_CLOUD
+#include "oc_cloud.h"
+#endif /* OC_CLOUD */
+
+#include <assert.h>
+#include <string.h>
+
+typedef struct
+{
+  uint32_t rate;  ///< tokens added per second, 0 if the limit is disabled
+  uint32_t burst; ///< size of the bucket
+} admission_limit_t;
+
+typedef struct admission_bucket_t
+{
+  struct admission_bucket_t *next;
+  oc_endpoint_t peer;
+  size_t device;
+  bool security; ///< bucket of the requests to the security resources
+  uint64_t tokens; ///< available tokens multiplied by OC_CLOCK_SECOND
+  oc_clock_time_t updated;
+} admission_bucket_t;
+
+static admission_limit_t g_peer_limit = { 0, 0 };
+static admission_limit_t g_device_limit = { 0, 0 };
+static uint32_t g_max_concurrent_requests = 0;
+static uint32_t g_retry_after = OC_ADMISSION_DEFAULT_RETRY_AFTER;
+static oc_admission_stats_t g_stats;
+
+/* Peers are ordered from the most recently seen one. */
+OC_LIST(g_peer_buckets);
+OC_MEMB(g_peer_buckets_s, admission_bucket_t, OC_ADMISSION_MAX_PEERS);
+static size_t g_peer_buckets_count = 0;
+OC_LIST(g_device_buckets);
+OC_MEMB(g_device_buckets_s, admission_bucket_t, 2 * OC_MAX_NUM_DEVICES);
+
+static void
+admission_set_limit(admission_limit_t *limit, uint32_t rate, uint32_t burst)
+{
+  limit->rate = rate;
+  limit->burst = burst > 0 ? burst : rate;
+}
+
+void
+oc_admission_set_peer_rate_limit(uint32_t rate, uint32_t burst)
+{
+  admission_set_limit(&g_peer_limit, rate, burst);
+}
+
+void
+oc_admission_set_device_rate_limit(uint32_t rate, uint32_t burst)
+{
+  admission_set_limit(&g_device_limit, rate, burst);
+}
+
+void
+oc_admission_set_max_concurrent_requests(uint32_t max)
+{
+  g_max_concurrent_requests = max;
+}
+
+void
+oc_admission_set_retry_after(uint32_t seconds)
+{
+  g_retry_after = seconds;
+}
+
+uint32_t
+oc_admission_retry_after(void)
+{
+  return g_retry_after;
+}
+
+void
+oc_admission_get_stats(oc_admission_stats_t *stats)
+{
+  assert(stats != NULL);
+  *stats = g_stats;
+}
+
+void
+oc_admission_reset_stats(void)
+{
+  memset(&g_stats, 0, sizeof(g_stats));
+}
+
+static void
+admission_bucket_init(admission_bucket_t *bucket,
+                      const admission_limit_t *limit, oc_clock_time_t now)
+{
+  bucket->tokens = (uint64_t)limit->burst * OC_CLOCK_SECOND;
+  bucket->updated = now;
+}
+
+static bool
+admission_bucket_take(admission_bucket_t *bucket,
+                      const admission_limit_t *limit, oc_clock_time_t now)
+{
+  uint64_t capacity = (uint64_t)limit->burst * OC_CLOCK_SECOND;
+  if (bucket->tokens > capacity) {
+    // the limit was lowered
+    bucket->tokens = capacity;
+  }
+  if (now > bucket->updated) {
+    uint64_t elapsed = (uint64_t)(now - bucket->updated);
+    // avoid overflow of the refill after a long pause
+    uint64_t refill =
+      elapsed > capacity / limit->rate ? capacity : elapsed * limit->rate;
+    bucket->tokens = refill > capacity - bucket->tokens
+                       ? capacity
+                       : bucket->tokens + refill;
+  }
+  bucket->updated = now;
+  if (bucket->tokens < OC_CLOCK_SECOND) {
+    return false;
+  }
+  bucket->tokens -= OC_CLOCK_SECOND;
+  return true;
+}
+
+/* Requests to the security resources are needed to onboard and manage the
+ * device, they are charged to separate buckets with larger limits so a flood
+ * of other requests cannot lock the owner out. */
+static admission_limit_t
+admission_get_limit(const admission_limit_t *limit, bool security)
+{
+  admission_limit_t l = *limit;
+  if (security) {
+    l.rate *= OC_ADMISSION_SECURITY_LIMIT_FACTOR;
+    l.burst *= OC_ADMISSION_SECURITY_LIMIT_FACTOR;
+  }
+  return l;
+}
+
+static admission_bucket_t *
+admission_get_peer_bucket(const oc_endpoint_t *endpoint, bool security,
+                          const admission_limit_t *limit, oc_clock_time_t now)
+{
+  admission_bucket_t *bucket =
+    (admission_bucket_t *)oc_list_head(g_peer_buckets);
+  admission_bucket_t *last = NULL;
+  for (; bucket != NULL; bucket = bucket->next) {
+    if (bucket->security == security &&
+        oc_endpoint_compare_address(&bucket->peer, endpoint) == 0) {
+      // move to the front of the list
+      oc_list_remove(g_peer_buckets, bucket);
+      oc_list_push(g_peer_buckets, bucket);
+      return bucket;
+    }
+    last = bucket;
+  }
+  if (g_peer_buckets_count < OC_ADMISSION_MAX_PEERS) {
+    bucket = (admission_bucket_t *)oc_memb_alloc(&g_peer_buckets_s);
+  }
+  if (bucket != NULL) {
+    ++g_peer_buckets_count;
+  } else {
+    if (last == NULL) {
+      return NULL;
+    }
+    // forget the least recently seen peer
+    oc_list_remove(g_peer_buckets, last);
+    bucket = last;
+  }
+  memcpy(&bucket->peer, endpoint, sizeof(oc_endpoint_t));
+  bucket->security = security;
+  admission_bucket_init(bucket, limit, now);
+  oc_list_push(g_peer_buckets, bucket);
+  return bucket;
+}
+
+static admission_bucket_t *
+admission_get_device_bucket(size_t device, bool security,
+                            const admission_limit_t *limit,
+                            oc_clock_time_t now)
+{
+  admission_bucket_t *bucket =
+    (admission_bucket_t *)oc_list_head(g_device_buckets);
+  for (; bucket != NULL; bucket = bucket->next) {
+    if (bucket->device == device && bucket->security == security) {
+      return bucket;
+    }
+  }
+  bucket = (admission_bucket_t *)oc_memb_alloc(&g_device_buckets_s);
+  if (bucket == NULL) {
+    return NULL;
+  }
+  bucket->device = device;
+  bucket->security = security;
+  admission_bucket_init(bucket, limit, now);
+  oc_list_add(g_device_buckets, bucket);
+  return bucket;
+}
+
+static bool
+admission_is_security(const char *uri, size_t uri_len)
+{
+  if (uri_len > 0 && uri[0] == '/') {
+    ++uri;
+    --uri_len;
+  }
+  return uri_len > 8 && memcmp(uri, "oic/sec/", 8) == 0;
+}
+
+/* Requests from the connected cloud keep the device connected, they are not
+ * limited. */
+static bool
+admission_is_prioritized(const oc_endpoint_t *endpoint)
+{
+#ifdef OC_CLOUD
+  const oc_cloud_context_t *ctx = oc_cloud_get_context(endpoint->device);
+  if (ctx != NULL && ctx->cloud_ep_state == OC_SESSION_CONNECTED &&
+      oc_endpoint_compare(ctx->cloud_ep, endpoint) == 0) {
+    return true;
+  }
+#else  /* !OC_CLOUD */
+  (void)endpoint;
+#endif /* OC_CLOUD */
+  return false;
+}
+
+bool
+oc_admission_admit_request(const oc_endpoint_t *endpoint, const char *uri,
+                           size_t uri_len)
+{
+  assert(endpoint != NULL);
+  bool limited = g_peer_limit.rate > 0 || g_device_limit.rate > 0;
+#ifdef OC_SERVER
+  limited = limited || g_max_concurrent_requests > 0;
+#endif /* OC_SERVER */
+  if (!limited) {
+    ++g_stats.admitted;
+    return true;
+  }
+  if (admission_is_prioritized(endpoint)) {
+    ++g_stats.admitted;
+    ++g_stats.prioritized;
+    return true;
+  }
+#ifdef OC_SERVER
+  if (g_max_concurrent_requests > 0 &&
+      oc_deferred_response_count() >= g_max_concurrent_requests) {
+    OC_DBG("request rejected: too many concurrent requests");
+    ++g_stats.shed_concurrency;
+    return false;
+  }
+#endif /* OC_SERVER */
+  bool security = admission_is_security(uri, uri_len);
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  if (g_peer_limit.rate > 0) {
+    admission_limit_t limit = admission_get_limit(&g_peer_limit, security);
+    admission_bucket_t *bucket =
+      admission_get_peer_bucket(endpoint, security, &limit, now);
+    if (bucket != NULL && !admission_bucket_take(bucket, &limit, now)) {
+      OC_DBG("request rejected: peer rate limit exceeded");
+      ++g_stats.shed_peer;
+      return false;
+    }
+  }
+  if (g_device_limit.rate > 0) {
+    admission_limit_t limit = admission_get_limit(&g_device_limit, security);
+    admission_bucket_t *bucket =
+      admission_get_device_bucket(endpoint->device, security, &limit, now);
+    if (bucket != NULL && !admission_bucket_take(bucket, &limit, now)) {
+      OC_DBG("request rejected: device rate limit exceeded");
+      ++g_stats.shed_device;
+      return false;
+    }
+  }
+  ++g_stats.admitted;
+  return true;
+}
+
+static void
+admission_free_list(oc_list_t list, struct oc_memb *pool)
+{
+  admission_bucket_t *bucket = (admission_bucket_t *)oc_list_pop(list);
+  while (bucket != NULL) {
+    oc_memb_free(pool, bucket);
+    bucket = (admission_bucket_t *)oc_list_pop(list);
+  }
+}
+
+void
+oc_admission_free_buckets(void)
+{
+  admission_free_list(g_peer_buckets, &g_peer_buckets_s);
+  g_peer_buckets_count = 0;
+  admission_free_list(g_device_buckets, &g_device_buckets_s);
+}
@@ -0,0 +1,67 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_ADMISSION_INTERNAL_H
+#define OC_ADMISSION_INTERNAL_H
+
+#include "oc_admission.h"
+#include "oc_endpoint.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximal number of peers with a tracked token bucket, the least recently
+ * seen peer is forgotten when a new peer arrives. */
+#ifndef OC_ADMISSION_MAX_PEERS
+#define OC_ADMISSION_MAX_PEERS (32)
+#endif /* OC_ADMISSION_MAX_PEERS */
+
+/* Requests to the security resources (/oic/sec/...) have their own per-peer
+ * and per-device buckets, with the limits multiplied by this factor. */
+#ifndef OC_ADMISSION_SECURITY_LIMIT_FACTOR
+#define OC_ADMISSION_SECURITY_LIMIT_FACTOR (4)
+#endif /* OC_ADMISSION_SECURITY_LIMIT_FACTOR */
+
+/**
+ * @brief Decide whether the incoming request is passed to the handlers.
+ *
+ * @param endpoint endpoint of the client (cannot be NULL)
+ * @param uri URI path of the request
+ * @param uri_len length of the URI path
+ * @return true the request is admitted
+ * @return false the request must be rejected
+ */
+bool oc_admission_admit_request(const oc_endpoint_t *endpoint, const char *uri,
+                                size_t uri_len);
+
+/** @brief Max-Age of the response to a rejected request (in seconds) */
+uint32_t oc_admission_retry_after(void);
+
+/** @brief Free the token buckets of all peers and devices. */
+void oc_admission_free_buckets(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_ADMISSION_INTERNAL_H */
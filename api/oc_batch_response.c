@@ -0,0 +1,391 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "oc_config.h"
+
+#ifdef OC_SERVER
+
+#include "api/oc_batch_response_internal.h"
+#include "api/oc_deferred_response_internal.h"
+#include "api/oc_rep_encode_internal.h"
+#include "oc_api.h"
+#include "port/oc_connectivity.h"
+#include "port/oc_log_internal.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#include <stdlib.h>
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+typedef struct oc_batch_item_t
+{
+  struct oc_batch_item_t *next;
+  oc_batch_response_t *batch;
+  oc_deferred_response_t *handle;
+  oc_string_t href;
+  oc_string_t rep; ///< encoded representation of the completed item
+  int code;
+  bool completed;
+} oc_batch_item_t;
+
+struct oc_batch_response_t
+{
+  struct oc_batch_response_t *next;
+  oc_deferred_response_handle_t response; ///< deferred response of the batch
+                                          ///< request
+  oc_string_t items; ///< encoded items that responded synchronously
+  OC_LIST_STRUCT(deferred); ///< items that deferred their responses
+  size_t pending;           ///< number of deferred items not completed yet
+  oc_content_format_t content_format;
+  oc_method_t method;
+  bool item_codes;
+  int ecode;
+  int pcode;
+};
+
+OC_LIST(g_batch_responses);
+OC_MEMB(g_batch_responses_s, oc_batch_response_t, OC_MAX_NUM_BATCH_RESPONSES);
+OC_MEMB(g_batch_items_s, oc_batch_item_t, OC_MAX_NUM_DEFERRED_RESPONSES);
+
+#ifndef OC_DYNAMIC_ALLOCATION
+static uint8_t g_batch_response_buffer[OC_MAX_APP_DATA_SIZE];
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+static oc_event_callback_retval_t batch_response_deadline(void *data);
+
+static bool
+batch_is_cbor(oc_content_format_t content_format)
+{
+  return content_format == APPLICATION_CBOR ||
+         content_format == APPLICATION_VND_OCF_CBOR;
+}
+
+oc_status_t
+oc_batch_response_status(oc_method_t method, int ecode, int pcode)
+{
+  if (ecode >= oc_status_code(OC_STATUS_BAD_REQUEST) ||
+      pcode >= oc_status_code(OC_STATUS_BAD_REQUEST)) {
+    return OC_STATUS_BAD_REQUEST;
+  }
+  switch (method) {
+  case OC_GET:
+    return OC_STATUS_OK;
+  case OC_POST:
+  case OC_PUT:
+    return OC_STATUS_CHANGED;
+  case OC_DELETE:
+    return OC_STATUS_DELETED;
+  default:
+    break;
+  }
+  return OC_STATUS_BAD_REQUEST;
+}
+
+static void
+batch_response_free(oc_batch_response_t *batch)
+{
+  oc_list_remove(g_batch_responses, batch);
+  oc_batch_item_t *item = (oc_batch_item_t *)oc_list_pop(batch->deferred);
+  while (item != NULL) {
+    if (!item->completed) {
+      // the application still holds the handle, it is freed on completion
+      oc_deferred_response_drop(item->handle);
+    }
+    oc_free_string(&item->href);
+    oc_free_string(&item->rep);
+    oc_memb_free(&g_batch_items_s, item);
+    item = (oc_batch_item_t *)oc_list_pop(batch->deferred);
+  }
+  oc_free_string(&batch->items);
+  oc_memb_free(&g_batch_responses_s, batch);
+}
+
+static int
+batch_response_encode(oc_batch_response_t *batch)
+{
+  oc_rep_start_links_array();
+  if (oc_string_len(batch->items) > 0) {
+    g_err |= oc_rep_encode_raw_items(
+      &links_array, (const uint8_t *)oc_string(batch->items),
+      oc_string_len(batch->items));
+  }
+  const oc_batch_item_t *item =
+    (const oc_batch_item_t *)oc_list_head(batch->deferred);
+  for (; item != NULL; item = item->next) {
+    if (!item->completed) {
+      // partial result, the item missed the deadline
+      continue;
+    }
+    oc_rep_object_array_begin_item(links);
+    oc_rep_set_text_string(links, href, oc_string(item->href));
+    oc_rep_set_key(oc_rep_object(links), "rep");
+    if (oc_string_len(item->rep) > 0) {
+      g_err |= oc_rep_encode_raw_items(&links_map,
+                                       (const uint8_t *)oc_string(item->rep),
+                                       oc_string_len(item->rep));
+    } else {
+      oc_rep_begin_object(&links_map, rep);
+      oc_rep_end_object(&links_map, rep);
+    }
+    oc_rep_object_array_end_item(links);
+  }
+  oc_rep_end_links_array();
+  return oc_rep_get_encoded_payload_size();
+}
+
+static void
+batch_response_complete(oc_batch_response_t *batch)
+{
+  int ecode = batch->ecode;
+  int pcode = batch->pcode;
+  if (batch->item_codes) {
+    const oc_batch_item_t *item =
+      (const oc_batch_item_t *)oc_list_head(batch->deferred);
+    for (; item != NULL; item = item->next) {
+      if (!item->completed) {
+        continue;
+      }
+      if (item->code < oc_status_code(OC_STATUS_BAD_REQUEST)) {
+        pcode = item->code;
+      } else {
+        ecode = item->code;
+      }
+    }
+  }
+
+  oc_rep_encoder_context_t ctx;
+  oc_rep_encoder_context_t *prev_ctx = oc_rep_encoder_set_context(&ctx);
+#ifdef OC_DYNAMIC_ALLOCATION
+  uint8_t *buffer = (uint8_t *)malloc(OC_MIN_APP_DATA_SIZE);
+  int size = -1;
+  if (buffer != NULL) {
+    oc_rep_new_realloc(&buffer, (int)OC_MIN_APP_DATA_SIZE,
+                       (int)OC_MAX_APP_DATA_SIZE);
+    size = batch_response_encode(batch);
+  }
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  uint8_t *buffer = g_batch_response_buffer;
+  oc_rep_new(buffer, OC_MAX_APP_DATA_SIZE);
+  int size = batch_response_encode(batch);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_rep_encoder_set_context(prev_ctx);
+
+  if (size < 0) {
+    OC_ERR("cannot encode batch response");
+    oc_complete_deferred_response(batch->response,
+                                  OC_STATUS_INTERNAL_SERVER_ERROR,
+                                  batch->content_format, NULL, 0);
+  } else {
+    oc_complete_deferred_response(
+      batch->response, oc_batch_response_status(batch->method, ecode, pcode),
+      batch->content_format, buffer, (size_t)size);
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  free(buffer);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_ri_remove_timed_event_callback(batch, batch_response_deadline);
+  batch_response_free(batch);
+}
+
+static oc_event_callback_retval_t
+batch_response_deadline(void *data)
+{
+  oc_batch_response_t *batch = (oc_batch_response_t *)data;
+  OC_DBG("batch response deadline expired: %zu item(s) left out",
+         batch->pending);
+  batch_response_complete(batch);
+  return OC_EVENT_DONE;
+}
+
+static void
+batch_item_completed(void *data, int code, oc_content_format_t content_format,
+                     const uint8_t *payload, size_t payload_size)
+{
+  oc_batch_item_t *item = (oc_batch_item_t *)data;
+  oc_batch_response_t *batch = item->batch;
+  item->completed = true;
+  item->code = code;
+  if (payload_size > 0) {
+    if (batch_is_cbor(content_format)) {
+      oc_new_string(&item->rep, (const char *)payload, payload_size);
+    } else {
+      OC_ERR("cannot embed deferred response of %s in batch response: "
+             "unsupported content format(%d)",
+             oc_string(item->href), (int)content_format);
+      item->code = oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+    }
+  }
+  assert(batch->pending > 0);
+  if (--batch->pending == 0) {
+    batch_response_complete(batch);
+  }
+}
+
+void
+oc_batch_dispatch_init(oc_batch_dispatch_t *dispatch,
+                       const oc_request_t *request, bool item_codes)
+{
+  assert(dispatch != NULL);
+  assert(request != NULL);
+  memset(dispatch, 0, sizeof(oc_batch_dispatch_t));
+  dispatch->item_codes = item_codes;
+  oc_response_buffer_t *response_buffer =
+    request->response != NULL ? request->response->response_buffer : NULL;
+  // the encoded items are spliced into the deferred response, which is
+  // possible only with CBOR
+  if (oc_deferred_response_is_enabled(response_buffer) &&
+      oc_rep_encoder_get_type() == OC_REP_CBOR_ENCODER) {
+    dispatch->response_buffer = response_buffer;
+  }
+}
+
+void
+oc_batch_dispatch_item_begin(const oc_batch_dispatch_t *dispatch,
+                             oc_response_buffer_t *response_buffer)
+{
+  assert(dispatch != NULL);
+  if (response_buffer != NULL) {
+    response_buffer->deferred = NULL;
+  }
+  if (dispatch->response_buffer != NULL) {
+    oc_deferred_response_enable(response_buffer);
+  }
+}
+
+bool
+oc_batch_dispatch_item_end(oc_batch_dispatch_t *dispatch,
+                           oc_response_buffer_t *response_buffer,
+                           const char *href)
+{
+  assert(dispatch != NULL);
+  assert(href != NULL);
+  if (dispatch->response_buffer == NULL) {
+    return false;
+  }
+  oc_deferred_response_enable(dispatch->response_buffer);
+  if (response_buffer == NULL || response_buffer->deferred == NULL) {
+    return false;
+  }
+  oc_deferred_response_t *handle = response_buffer->deferred;
+  response_buffer->deferred = NULL;
+
+  if (dispatch->batch == NULL) {
+    dispatch->batch =
+      (oc_batch_response_t *)oc_memb_alloc(&g_batch_responses_s);
+    if (dispatch->batch != NULL) {
+      OC_LIST_STRUCT_INIT(dispatch->batch, deferred);
+    }
+  }
+  oc_batch_item_t *item = NULL;
+  if (dispatch->batch != NULL) {
+    item = (oc_batch_item_t *)oc_memb_alloc(&g_batch_items_s);
+  }
+  if (item == NULL) {
+    OC_WRN("insufficient memory to defer batch item %s", href);
+    oc_deferred_response_drop(handle);
+    return true;
+  }
+  item->batch = dispatch->batch;
+  item->handle = handle;
+  oc_new_string(&item->href, href, strlen(href));
+  oc_list_add(dispatch->batch->deferred, item);
+  ++dispatch->batch->pending;
+  oc_deferred_response_bind(handle, batch_item_completed, item);
+  return true;
+}
+
+bool
+oc_batch_dispatch_finish(oc_batch_dispatch_t *dispatch, oc_request_t *request,
+                         oc_method_t method, int ecode, int pcode)
+{
+  assert(dispatch != NULL);
+  assert(request != NULL);
+  oc_batch_response_t *batch = dispatch->batch;
+  dispatch->batch = NULL;
+  if (batch == NULL) {
+    return false;
+  }
+  if (batch->pending == 0) {
+    // no deferred item could be tracked
+    batch_response_free(batch);
+    return false;
+  }
+
+  // keep the items of the encoded links array, without the array header and
+  // the break byte of the indefinite length array
+  const uint8_t *buffer = oc_rep_get_encoder_buf();
+  int size = oc_rep_get_encoded_payload_size();
+  if (size < 2 || buffer[0] != 0x9f || buffer[size - 1] != 0xff) {
+    OC_ERR("cannot defer batch response: unexpected encoding");
+    batch_response_free(batch);
+    return false;
+  }
+  if (size > 2) {
+    oc_new_string(&batch->items, (const char *)buffer + 1, (size_t)size - 2);
+  }
+  oc_content_format_t content_format = oc_rep_encoder_get_content_format();
+
+  batch->response = oc_defer_response(request);
+  if (batch->response == 0) {
+    batch_response_free(batch);
+    return false;
+  }
+  batch->content_format = content_format;
+  batch->method = method;
+  batch->item_codes = dispatch->item_codes;
+  batch->ecode = ecode;
+  batch->pcode = pcode;
+  oc_list_add(g_batch_responses, batch);
+  oc_ri_add_timed_event_callback_ticks(batch, batch_response_deadline,
+                                       OC_BATCH_RESPONSE_DEADLINE);
+  OC_DBG("batch response deferred: %zu item(s) pending", batch->pending);
+  return true;
+}
+
+void
+oc_batch_dispatch_abort(oc_batch_dispatch_t *dispatch)
+{
+  assert(dispatch != NULL);
+  if (dispatch->response_buffer != NULL) {
+    oc_deferred_response_enable(dispatch->response_buffer);
+  }
+  if (dispatch->batch != NULL) {
+    batch_response_free(dispatch->batch);
+    dispatch->batch = NULL;
+  }
+}
+
+void
+oc_batch_response_free_all(void)
+{
+  oc_batch_response_t *batch =
+    (oc_batch_response_t *)oc_list_head(g_batch_responses);
+  while (batch != NULL) {
+    oc_ri_remove_timed_event_callback(batch, batch_response_deadline);
+    batch_response_free(batch);
+    batch = (oc_batch_response_t *)oc_list_head(g_batch_responses);
+  }
+}
+
+#else  /* !OC_SERVER */
+typedef int dummy_declaration;
+#endif /* OC_SERVER */
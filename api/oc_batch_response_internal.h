@@ -0,0 +1,160 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_BATCH_RESPONSE_INTERNAL_H
+#define OC_BATCH_RESPONSE_INTERNAL_H
+
+#include "oc_clock.h"
+#include "oc_ri.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct oc_batch_dispatch_t oc_batch_dispatch_t;
+
+#ifdef OC_SERVER
+
+/* Maximal number of batch requests waiting for deferred responses of their
+ * items in static builds, dynamic builds are limited only by available
+ * memory. */
+#ifndef OC_MAX_NUM_BATCH_RESPONSES
+#define OC_MAX_NUM_BATCH_RESPONSES (OC_MAX_NUM_CONCURRENT_REQUESTS)
+#endif /* OC_MAX_NUM_BATCH_RESPONSES */
+
+/* How long a batch request waits for the deferred responses of its items.
+ * The items that are not completed in time are left out of the response. */
+#ifndef OC_BATCH_RESPONSE_DEADLINE
+#define OC_BATCH_RESPONSE_DEADLINE (2 * OC_CLOCK_SECOND)
+#endif /* OC_BATCH_RESPONSE_DEADLINE */
+
+typedef struct oc_batch_response_t oc_batch_response_t;
+
+/**
+ * @brief State of the dispatching of a batch request to the handlers of its
+ * items.
+ *
+ * The handlers are invoked one after another. A handler of a slow resource
+ * defers its response, the dispatching continues with the next item and the
+ * response of the batch request is deferred until the deferred items are
+ * completed or until the deadline expires.
+ */
+struct oc_batch_dispatch_t
+{
+  oc_response_buffer_t *response_buffer; ///< deferrable response buffer of the
+                                         ///< batch request, NULL if the items
+                                         ///< cannot defer
+  oc_batch_response_t *batch; ///< created when the first item defers
+  bool item_codes; ///< the codes of the deferred items affect the code of the
+                   ///< batch response
+};
+
+/**
+ * @brief Initialize dispatching of the batch request. The items can defer
+ * their responses only if the batch request itself can be deferred and its
+ * response is encoded in CBOR.
+ *
+ * @param dispatch the dispatch state (cannot be NULL)
+ * @param request the batch request (cannot be NULL)
+ * @param item_codes codes of the deferred items affect the code of the batch
+ * response
+ */
+void oc_batch_dispatch_init(oc_batch_dispatch_t *dispatch,
+                            const oc_request_t *request, bool item_codes);
+
+/**
+ * @brief Prepare the response buffer of an item before its handler is
+ * invoked.
+ *
+ * @param dispatch the dispatch state (cannot be NULL)
+ * @param response_buffer response buffer of the item (NULL if the item
+ * cannot defer its response)
+ */
+void oc_batch_dispatch_item_begin(const oc_batch_dispatch_t *dispatch,
+                                  oc_response_buffer_t *response_buffer);
+
+/**
+ * @brief Finish the item after its handler returned. If the handler deferred
+ * its response, the item is added to the batch response and its encoded
+ * representation must be discarded by the caller.
+ *
+ * @param dispatch the dispatch state (cannot be NULL)
+ * @param response_buffer response buffer of the item (can be NULL)
+ * @param href href of the item in the batch response (cannot be NULL)
+ * @return true the item deferred its response
+ */
+bool oc_batch_dispatch_item_end(oc_batch_dispatch_t *dispatch,
+                                oc_response_buffer_t *response_buffer,
+                                const char *href);
+
+/**
+ * @brief Finish dispatching of the batch request, the links array with the
+ * items that responded synchronously must be fully encoded.
+ *
+ * If some items deferred their responses, the response of the batch request
+ * is deferred. It is completed with the items of the encoded links array and
+ * the deferred items once they are all completed or when the deadline
+ * expires.
+ *
+ * @param dispatch the dispatch state (cannot be NULL)
+ * @param request the batch request (cannot be NULL)
+ * @param method method of the batch request
+ * @param ecode error code of the items that responded synchronously
+ * @param pcode success code of the items that responded synchronously
+ * @return true the response of the batch request is deferred
+ * @return false no item deferred its response or the response cannot be
+ * deferred, the encoded links array is the response and the deferred items
+ * are left out
+ */
+bool oc_batch_dispatch_finish(oc_batch_dispatch_t *dispatch,
+                              oc_request_t *request, oc_method_t method,
+                              int ecode, int pcode);
+
+/**
+ * @brief Abort dispatching of the batch request, the results of the deferred
+ * items are dropped.
+ *
+ * @param dispatch the dispatch state (cannot be NULL)
+ */
+void oc_batch_dispatch_abort(oc_batch_dispatch_t *dispatch);
+
+/**
+ * @brief Get the code of a batch response.
+ *
+ * @param method method of the batch request
+ * @param ecode error code of the items
+ * @param pcode success code of the items
+ * @return the success code of the method if both codes are successful,
+ * OC_STATUS_BAD_REQUEST otherwise
+ */
+oc_status_t oc_batch_response_status(oc_method_t method, int ecode,
+                                     int pcode);
+
+/** @brief Free all batch responses waiting for their items. */
+void oc_batch_response_free_all(void);
+
+#endif /* OC_SERVER */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_BATCH_RESPONSE_INTERNAL_H */
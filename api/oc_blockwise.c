@@ -54,23 +54,26 @@ oc_blockwise_init_buffer(struct oc_memb *pool, const char *href,
   oc_blockwise_state_t *buffer = (oc_blockwise_state_t *)oc_memb_alloc(pool);
   if (buffer) {
 #ifdef OC_DYNAMIC_ALLOCATION
+    // streamed requests are passed to the consumer without being stored
+    if (buffer_size > 0) {
 #ifdef OC_APP_DATA_BUFFER_POOL
-    oc_app_data_buffer_t *app_buffer =
-      (oc_app_data_buffer_t *)oc_memb_alloc(&oc_app_data_s);
-    if (app_buffer) {
-      buffer->block = app_buffer;
-      buffer->buffer = app_buffer->buffer;
-      buffer->buffer_size = OC_APP_DATA_BUFFER_SIZE;
-    }
+      oc_app_data_buffer_t *app_buffer =
+        (oc_app_data_buffer_t *)oc_memb_alloc(&oc_app_data_s);
+      if (app_buffer) {
+        buffer->block = app_buffer;
+        buffer->buffer = app_buffer->buffer;
+        buffer->buffer_size = OC_APP_DATA_BUFFER_SIZE;
+      }
 #endif /* OC_APP_DATA_BUFFER_POOL */
-    if (!buffer->buffer) {
-      buffer->buffer = (uint8_t *)malloc(buffer_size);
-      buffer->buffer_size = buffer_size;
-      OC_DBG("block-wise buffer allocated with size %" PRIu32, buffer_size);
-    }
-    if (!buffer->buffer) {
-      oc_memb_free(pool, buffer);
-      return NULL;
+      if (!buffer->buffer) {
+        buffer->buffer = (uint8_t *)malloc(buffer_size);
+        buffer->buffer_size = buffer_size;
+        OC_DBG("block-wise buffer allocated with size %" PRIu32, buffer_size);
+      }
+      if (!buffer->buffer) {
+        oc_memb_free(pool, buffer);
+        return NULL;
+      }
     }
 #else  /* OC_DYNAMIC_ALLOCATION */
     (void)buffer_size;
@@ -86,6 +89,7 @@ oc_blockwise_init_buffer(struct oc_memb *pool, const char *href,
     oc_new_string(&buffer->href, href, href_len);
     buffer->next = NULL;
     buffer->finish_cb = NULL;
+    memset(&buffer->stream, 0, sizeof(buffer->stream));
 #ifdef OC_CLIENT
     buffer->mid = 0;
     buffer->client_cb = NULL;
@@ -108,6 +112,14 @@ oc_blockwise_free_buffer(oc_list_t list, struct oc_memb *pool,
   oc_free_string(&buffer->uri_query);
   oc_free_string(&buffer->href);
   oc_list_remove(list, buffer);
+  // let the application release the user data of the stream
+  if (buffer->stream.produce != NULL) {
+    buffer->stream.produce(buffer->stream.block_offset, NULL, 0, NULL,
+                           buffer->stream.user_data);
+  } else if (buffer->stream.consume != NULL && !buffer->stream.done) {
+    buffer->stream.consume(&buffer->endpoint, buffer->next_block_offset, NULL,
+                           0, false, buffer->stream.user_data);
+  }
 #ifdef OC_DYNAMIC_ALLOCATION
 #ifdef OC_APP_DATA_BUFFER_POOL
   if (buffer->block) {
@@ -188,6 +200,9 @@ oc_blockwise_alloc_response_buffer(const char *href, size_t href_len,
     oc_random_buffer(buffer->etag, sizeof(buffer->etag));
 #ifdef OC_CLIENT
     buffer->observe_seq = -1;
+    buffer->etag_len = 0;
+    buffer->restarts = 0;
+    memset(&buffer->window, 0, sizeof(buffer->window));
 #endif /* OC_CLIENT */
     oc_ri_add_timed_event_callback_seconds(
       buffer, oc_blockwise_response_timeout, OC_EXCHANGE_LIFETIME);
@@ -387,11 +402,127 @@ oc_blockwise_find_response_buffer(const char *href, size_t href_len,
                                   endpoint, method, query, query_len, role);
 }
 
+static bool
+oc_blockwise_stream_resize(oc_blockwise_state_t *buffer, uint32_t size)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+#ifdef OC_APP_DATA_BUFFER_POOL
+  if (buffer->block) {
+    return true;
+  }
+#endif /* OC_APP_DATA_BUFFER_POOL */
+  if (buffer->buffer_size != size) {
+    uint8_t *block = (uint8_t *)realloc(buffer->buffer, size);
+    if (block == NULL) {
+      OC_ERR("cannot allocate block-wise stream buffer");
+      return false;
+    }
+    buffer->buffer = block;
+    buffer->buffer_size = size;
+  }
+#else  /* OC_DYNAMIC_ALLOCATION */
+  (void)buffer;
+  (void)size;
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  return true;
+}
+
+bool
+oc_blockwise_set_response_stream(oc_blockwise_state_t *buffer,
+                                 oc_response_stream_cb_t produce,
+                                 void *user_data)
+{
+  // a single block is held in the buffer at a time
+  if (!oc_blockwise_stream_resize(buffer, (uint32_t)OC_BLOCK_SIZE)) {
+    return false;
+  }
+  memset(&buffer->stream, 0, sizeof(buffer->stream));
+  buffer->stream.produce = produce;
+  buffer->stream.user_data = user_data;
+  buffer->next_block_offset = 0;
+  // the size of the payload is unknown until the last block is produced, it
+  // is kept one byte ahead of the produced data while more data follows
+  buffer->payload_size = 1;
+  return true;
+}
+
+void
+oc_blockwise_set_request_stream(oc_blockwise_state_t *buffer,
+                                oc_request_stream_cb_t consume,
+                                void *user_data)
+{
+  memset(&buffer->stream, 0, sizeof(buffer->stream));
+  buffer->stream.consume = consume;
+  buffer->stream.user_data = user_data;
+}
+
+static bool
+oc_blockwise_produce_block(oc_blockwise_state_t *buffer, uint32_t block_offset,
+                           uint32_t block_size)
+{
+  oc_blockwise_stream_t *stream = &buffer->stream;
+  uint32_t size = 0;
+  bool more = true;
+  // all blocks but the last one must be full
+  while (more && size < block_size) {
+    more = false;
+    long len =
+      stream->produce(block_offset + size, &buffer->buffer[size],
+                      block_size - size, &more, stream->user_data);
+    if (len < 0 || (uint32_t)len > block_size - size ||
+        (len == 0 && more)) {
+      OC_ERR("failed to produce block at offset %" PRIu32, block_offset);
+      return false;
+    }
+    size += (uint32_t)len;
+  }
+  stream->block_offset = block_offset;
+  stream->block_size = size;
+  stream->done = !more;
+  buffer->payload_size = block_offset + size + (more ? 1 : 0);
+  return true;
+}
+
+static const void *
+oc_blockwise_dispatch_stream_block(oc_blockwise_state_t *buffer,
+                                   uint32_t block_offset,
+                                   uint32_t requested_block_size,
+                                   uint32_t *payload_size)
+{
+  const oc_blockwise_stream_t *stream = &buffer->stream;
+  uint32_t end = stream->block_offset + stream->block_size;
+  if (block_offset == end && !stream->done) {
+    // BERT blocks over TCP can be larger than the initial block buffer
+    if (requested_block_size > oc_blockwise_get_buffer_size(buffer) &&
+        !oc_blockwise_stream_resize(buffer, requested_block_size)) {
+      return NULL;
+    }
+    if (!oc_blockwise_produce_block(
+          buffer, block_offset,
+          MIN(requested_block_size, oc_blockwise_get_buffer_size(buffer)))) {
+      return NULL;
+    }
+    end = stream->block_offset + stream->block_size;
+  }
+  // only the block held in the buffer can be dispatched (again)
+  if (block_offset < stream->block_offset || block_offset >= end) {
+    return NULL;
+  }
+  *payload_size = MIN(requested_block_size, end - block_offset);
+  buffer->next_block_offset = block_offset + *payload_size;
+  return (const void *)&buffer->buffer[block_offset - stream->block_offset];
+}
+
 const void *
 oc_blockwise_dispatch_block(oc_blockwise_state_t *buffer, uint32_t block_offset,
                             uint32_t requested_block_size,
                             uint32_t *payload_size)
 {
+  if (buffer->stream.produce != NULL) {
+    return oc_blockwise_dispatch_stream_block(buffer, block_offset,
+                                              requested_block_size,
+                                              payload_size);
+  }
   if (block_offset < buffer->payload_size) {
     if (buffer->payload_size < requested_block_size)
       *payload_size = (uint32_t)buffer->payload_size;
@@ -427,4 +558,169 @@ oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
 
   return true;
 }
+
+bool
+oc_blockwise_handle_stream_block(oc_blockwise_state_t *buffer,
+                                 uint32_t incoming_block_offset,
+                                 const uint8_t *incoming_block,
+                                 uint32_t incoming_block_size, bool last)
+{
+  oc_blockwise_stream_t *stream = &buffer->stream;
+  if (incoming_block_offset != buffer->next_block_offset) {
+    // retransmitted blocks were already consumed
+    return incoming_block_offset < buffer->next_block_offset;
+  }
+  if (stream->done) {
+    return false;
+  }
+  if (!stream->consume(&buffer->endpoint, incoming_block_offset,
+                       incoming_block, incoming_block_size, last,
+                       stream->user_data)) {
+    OC_DBG("block-wise request stream aborted by the consumer");
+    stream->done = true;
+    return false;
+  }
+  buffer->next_block_offset += incoming_block_size;
+  stream->done = last;
+  return true;
+}
+
+#ifdef OC_CLIENT
+// bounds the retrievals of a representation that keeps changing
+#define OC_BLOCKWISE_MAX_RESTARTS (2)
+// the received bitmap of the window
+#define OC_BLOCKWISE_MAX_WINDOW_SIZE (32)
+
+bool
+oc_blockwise_response_match_etag(oc_blockwise_state_t *buffer,
+                                 uint32_t incoming_block_offset,
+                                 const uint8_t *etag, size_t etag_len)
+{
+  oc_blockwise_response_state_t *state =
+    (oc_blockwise_response_state_t *)buffer;
+  if (buffer->next_block_offset == 0) {
+    if (incoming_block_offset != 0 || etag_len > sizeof(state->etag)) {
+      return false;
+    }
+    if (etag_len > 0) {
+      memcpy(state->etag, etag, etag_len);
+    }
+    state->etag_len = (uint8_t)etag_len;
+    return true;
+  }
+  // the check applies only if the first block carried an ETag, blocks without
+  // an ETag cannot be checked
+  return state->etag_len == 0 || etag_len == 0 ||
+         (state->etag_len == etag_len &&
+          memcmp(state->etag, etag, etag_len) == 0);
+}
+
+bool
+oc_blockwise_response_restart(oc_blockwise_state_t *buffer)
+{
+  oc_blockwise_response_state_t *state =
+    (oc_blockwise_response_state_t *)buffer;
+  if (state->restarts >= OC_BLOCKWISE_MAX_RESTARTS) {
+    OC_ERR("representation of %s keeps changing", oc_string(buffer->href));
+    return false;
+  }
+  ++state->restarts;
+  OC_DBG("representation of %s changed, restarting the transfer",
+         oc_string(buffer->href));
+  buffer->next_block_offset = 0;
+  buffer->payload_size = 0;
+  state->etag_len = 0;
+  memset(&state->window, 0, sizeof(state->window));
+  return true;
+}
+
+bool
+oc_blockwise_window_start(oc_blockwise_state_t *buffer, uint32_t total_size,
+                          uint16_t block_size)
+{
+  oc_blockwise_window_t *window =
+    &((oc_blockwise_response_state_t *)buffer)->window;
+  if (block_size == 0 || buffer->next_block_offset != block_size ||
+      total_size <= buffer->next_block_offset ||
+      total_size > oc_blockwise_get_buffer_size(buffer)) {
+    return false;
+  }
+  window->total_size = total_size;
+  window->request_offset = buffer->next_block_offset;
+  window->received = 0;
+  window->block_size = block_size;
+  return true;
+}
+
+bool
+oc_blockwise_window_handle_block(oc_blockwise_state_t *buffer,
+                                 uint32_t incoming_block_offset,
+                                 const uint8_t *incoming_block,
+                                 uint32_t incoming_block_size)
+{
+  oc_blockwise_window_t *window =
+    &((oc_blockwise_response_state_t *)buffer)->window;
+  if (incoming_block_offset < buffer->next_block_offset) {
+    // retransmitted blocks were already received
+    return true;
+  }
+  // all blocks except for the last one are full
+  if (incoming_block_offset >= window->total_size ||
+      incoming_block_size > window->total_size - incoming_block_offset ||
+      (incoming_block_size != window->block_size &&
+       incoming_block_offset + incoming_block_size != window->total_size)) {
+    return false;
+  }
+  uint32_t ahead = incoming_block_offset - buffer->next_block_offset;
+  uint32_t distance = ahead / window->block_size;
+  if (ahead % window->block_size != 0 ||
+      distance >= OC_BLOCKWISE_MAX_WINDOW_SIZE) {
+    return false;
+  }
+  memcpy(&buffer->buffer[incoming_block_offset], incoming_block,
+         incoming_block_size);
+  if (distance > 0) {
+    window->received |= (uint32_t)1 << distance;
+    return true;
+  }
+  buffer->next_block_offset += incoming_block_size;
+  window->received >>= 1;
+  while ((window->received & 1) != 0) {
+    buffer->next_block_offset =
+      MIN(buffer->next_block_offset + window->block_size, window->total_size);
+    window->received >>= 1;
+  }
+  return true;
+}
+
+bool
+oc_blockwise_window_next_request(oc_blockwise_state_t *buffer,
+                                 uint8_t window_size, uint32_t *block_offset)
+{
+  oc_blockwise_window_t *window =
+    &((oc_blockwise_response_state_t *)buffer)->window;
+  if (window->block_size == 0 ||
+      window->request_offset >= window->total_size) {
+    return false;
+  }
+  if (window->request_offset < buffer->next_block_offset) {
+    window->request_offset = buffer->next_block_offset;
+  }
+  uint32_t last_block_offset =
+    (window->total_size - 1) / window->block_size * window->block_size;
+  if (window->request_offset == last_block_offset &&
+      buffer->next_block_offset < last_block_offset) {
+    return false;
+  }
+  window_size = MIN(window_size, OC_BLOCKWISE_MAX_WINDOW_SIZE);
+  uint32_t in_flight =
+    (window->request_offset - buffer->next_block_offset) / window->block_size;
+  if (in_flight >= window_size) {
+    return false;
+  }
+  *block_offset = window->request_offset;
+  window->request_offset += window->block_size;
+  return true;
+}
+#endif /* OC_CLIENT */
 #endif /* OC_BLOCK_WISE */
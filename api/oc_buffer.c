@@ -47,6 +47,10 @@ OC_MEMB_STATIC(oc_outgoing_buffers, oc_message_t, OC_INOUT_BUFFER_POOL);
 OC_MEMB(oc_incoming_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 OC_MEMB(oc_outgoing_buffers, oc_message_t, OC_MAX_NUM_CONCURRENT_REQUESTS);
 #endif /* !OC_INOUT_BUFFER_POOL */
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+/* unsecured messages refused by full send queues of tcp sessions */
+OC_LIST(g_tcp_blocked_messages);
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
 
 static oc_message_t *
 allocate_message(struct oc_memb *pool)
@@ -188,6 +192,16 @@ oc_send_message(oc_message_t *message)
   _oc_signal_event_loop();
 }
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+void
+oc_tcp_send_queue_drained(void)
+{
+  oc_process_post(&message_buffer_handler, oc_events[TCP_SEND_QUEUE_DRAINED],
+                  NULL);
+  _oc_signal_event_loop();
+}
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
 void
 oc_tcp_connect_session(oc_tcp_on_connect_event_t *event)
@@ -237,6 +251,71 @@ handle_inbound_network_event(oc_process_data_t data)
   oc_process_post(&g_coap_engine, oc_events[INBOUND_RI_EVENT], data);
 }
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+/* Check if an older message for the endpoint is waiting to be sent again. */
+static bool
+tcp_is_blocked(const oc_message_t *message)
+{
+  for (const oc_message_t *m =
+         (const oc_message_t *)oc_list_head(g_tcp_blocked_messages);
+       m != NULL && m != message; m = m->next) {
+    if (oc_endpoint_compare(&m->endpoint, &message->endpoint) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* The message refused by the full send queue of the tcp session is kept and
+ * sent again once the queue is drained, the newer messages for the same
+ * endpoint are kept behind it to preserve the order. */
+static int
+tcp_send_buffer(oc_message_t *message)
+{
+  if (!tcp_is_blocked(message)) {
+    int ret = oc_send_buffer(message);
+    if (ret != OC_TCP_SOCKET_ERROR_WOULD_BLOCK) {
+      return ret;
+    }
+  }
+  OC_DBG("send queue of tcp session is full, message(%p) postponed",
+         (void *)message);
+  oc_message_add_ref(message);
+  oc_list_add(g_tcp_blocked_messages, message);
+  return 0;
+}
+
+static void
+tcp_send_blocked_messages(void)
+{
+  oc_message_t *message = (oc_message_t *)oc_list_head(g_tcp_blocked_messages);
+  while (message != NULL) {
+    oc_message_t *next = message->next;
+    if (!tcp_is_blocked(message)) {
+      int ret = oc_send_buffer(message);
+      if (ret != OC_TCP_SOCKET_ERROR_WOULD_BLOCK) {
+        if (ret < 0) {
+          OC_ERR("failed to send postponed message");
+        }
+        oc_list_remove(g_tcp_blocked_messages, message);
+        oc_message_unref(message);
+      }
+    }
+    message = next;
+  }
+}
+
+static void
+tcp_free_blocked_messages(void)
+{
+  oc_message_t *message = (oc_message_t *)oc_list_pop(g_tcp_blocked_messages);
+  while (message != NULL) {
+    oc_message_unref(message);
+    message = (oc_message_t *)oc_list_pop(g_tcp_blocked_messages);
+  }
+}
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 static void
 handle_outbound_network_event(oc_process_data_t data)
 {
@@ -281,6 +360,15 @@ handle_outbound_network_event(oc_process_data_t data)
 #endif /* OC_OSCORE */
 #endif /* OC_SECURITY */
   OC_DBG("Outbound network event: unicast message");
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+  if ((message->endpoint.flags & TCP) != 0) {
+    if (tcp_send_buffer(message) < 0) {
+      OC_ERR("failed to send unicast message");
+    }
+    oc_message_unref(message);
+    return;
+  }
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
   if (oc_send_buffer(message) < 0) {
     OC_ERR("failed to send unicast message");
   }
@@ -302,6 +390,9 @@ handle_tcp_connect_event(oc_process_data_t data)
 
 OC_PROCESS_THREAD(message_buffer_handler, ev, data)
 {
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+  OC_PROCESS_EXITHANDLER(tcp_free_blocked_messages());
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
   OC_PROCESS_BEGIN();
   OC_DBG("Started buffer handler process");
   while (true) {
@@ -328,6 +419,15 @@ OC_PROCESS_THREAD(message_buffer_handler, ev, data)
       continue;
     }
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+    if (ev == oc_events[TCP_SEND_QUEUE_DRAINED]) {
+      tcp_send_blocked_messages();
+#ifdef OC_SECURITY
+      oc_process_post(&oc_tls_handler, oc_events[TCP_SEND_QUEUE_DRAINED], NULL);
+#endif /* OC_SECURITY */
+      continue;
+    }
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
   }
   OC_PROCESS_END();
 }
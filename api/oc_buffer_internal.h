@@ -33,6 +33,13 @@
 void oc_tcp_connect_session(oc_tcp_on_connect_event_t *event);
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+/**
+ * @brief send again the messages refused by full send queues of tcp sessions
+ */
+void oc_tcp_send_queue_drained(void);
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 #ifdef OC_SECURITY
 /**
  * @brief close all tls session for the specific device
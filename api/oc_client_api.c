@@ -16,11 +16,18 @@
  *
  ****************************************************************************/
 
+#include "api/oc_client_api_internal.h"
 #include "api/oc_helpers_internal.h"
+#include "api/oc_rep_encode_internal.h"
 #include "messaging/coap/coap.h"
 #include "messaging/coap/transactions.h"
 #include "oc_api.h"
 #include "oc_ri_internal.h"
+#include "oc_signal_event_loop.h"
+#include "port/oc_log_internal.h"
+#include "port/oc_network_event_handler_internal.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
 
 #ifdef OC_TCP
 #include "messaging/coap/coap_signal.h"
@@ -31,6 +38,11 @@
 #endif /* OC_SECURITY */
 
 #include <assert.h>
+#include <string.h>
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#include <stdlib.h>
+#endif /* OC_DYNAMIC_ALLOCATION */
 
 #ifdef OC_CLIENT
 
@@ -38,106 +50,200 @@ typedef struct oc_dispatch_context_t
 {
   coap_transaction_t *transaction;
   oc_client_cb_t *client_cb;
+  coap_packet_t request;
+#ifdef OC_BLOCK_WISE
+  oc_blockwise_state_t *request_buffer;
+#endif /* OC_BLOCK_WISE */
 } oc_dispatch_context_t;
 
-// TODO returning a handle from oc_init_post / oc_init_put would be cleaner than
-// a global variable
-static oc_dispatch_context_t g_dispatch = { NULL, NULL };
-
-static coap_packet_t g_request[1];
+/* Payloads of requests are encoded into the buffer of a request builder, with
+ * a block-wise transfer the buffer holds the whole payload. */
 #ifdef OC_BLOCK_WISE
-static oc_blockwise_state_t *g_request_buffer = NULL;
+#define OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE (OC_MAX_APP_DATA_SIZE)
+#else /* !OC_BLOCK_WISE */
+#define OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE (OC_BLOCK_SIZE)
 #endif /* OC_BLOCK_WISE */
 
+struct oc_client_request_t
+{
+  struct oc_client_request_t *next;
+  oc_method_t method;
+  oc_string_t uri;
+  oc_string_t query;
+  oc_endpoint_t endpoint;
+  oc_response_handler_t handler;
+  oc_qos_t qos;
+  void *user_data;
+  uint16_t timeout_seconds;
+  oc_content_format_t accept; ///< 0 for the default format
+  size_t payload_size;
+  uint8_t *payload;
+  oc_rep_encoder_context_t encoder_ctx; ///< context encoding the payload
+  oc_rep_encoder_context_t *prev_encoder_ctx;
+  bool encoding; ///< encoder_ctx is the current context of the encoder
+};
+
+/* Requests submitted from any thread, sent by oc_client_request_process. */
+OC_LIST(g_submitted_requests);
+OC_MEMB(g_client_requests_s, oc_client_request_t, OC_MAX_NUM_CLIENT_REQUESTS);
+
+#ifndef OC_DYNAMIC_ALLOCATION
+/* Payload buffers are allocated only by the requests carrying a payload. */
+typedef struct oc_client_request_payload_t
+{
+  uint8_t data[OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE];
+} oc_client_request_payload_t;
+
+OC_MEMB(g_client_request_payloads_s, oc_client_request_payload_t,
+        OC_MAX_NUM_CLIENT_REQUEST_PAYLOADS);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+OC_PROCESS(oc_client_request_process, "Client request process");
+
+/* Requests without a payload are dispatched right after they are prepared. */
+static oc_dispatch_context_t g_dispatch;
+
+/* Request initialized by oc_init_put / oc_init_post, it doesn't use the pools
+ * of the request builders so they don't block each other. */
+static oc_client_request_t g_legacy_request;
+#ifndef OC_DYNAMIC_ALLOCATION
+static uint8_t g_legacy_payload[OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE];
+#endif /* !OC_DYNAMIC_ALLOCATION */
+static oc_client_request_t *g_pending_request = NULL;
+
 #ifdef OC_OSCORE
 static oc_message_t *g_multicast_update = NULL;
+static coap_packet_t g_multicast_request[1];
+static oc_rep_encoder_context_t g_multicast_encoder_ctx;
+static oc_rep_encoder_context_t *g_multicast_prev_encoder_ctx = NULL;
 #endif /* OC_OSCORE */
 
+#ifdef OC_BLOCK_WISE
 static bool
-dispatch_coap_request(void)
+dispatch_set_request_buffer(oc_dispatch_context_t *ctx, const uint8_t *payload,
+                            size_t payload_size)
 {
-  int payload_size = oc_rep_get_encoded_payload_size();
-
-  if ((g_dispatch.client_cb->method == OC_PUT ||
-       g_dispatch.client_cb->method == OC_POST) &&
-      payload_size > 0) {
+  const oc_client_cb_t *cb = ctx->client_cb;
+  ctx->request_buffer = oc_blockwise_alloc_request_buffer(
+    oc_string(cb->uri) + 1, oc_string_len(cb->uri) - 1, &cb->endpoint,
+    cb->method, OC_BLOCKWISE_CLIENT, (uint32_t)payload_size);
+  if (ctx->request_buffer == NULL) {
+    OC_ERR("cannot allocate request buffer");
+    return false;
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (ctx->request_buffer->buffer_size < payload_size) {
+    OC_ERR("request buffer is too small for the payload(%zu)", payload_size);
+    oc_blockwise_free_request_buffer(ctx->request_buffer);
+    ctx->request_buffer = NULL;
+    return false;
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  memcpy(ctx->request_buffer->buffer, payload, payload_size);
+  ctx->request_buffer->payload_size = (uint32_t)payload_size;
+  ctx->request_buffer->mid = cb->mid;
+  ctx->request_buffer->client_cb = ctx->client_cb;
+  return true;
+}
+#endif /* OC_BLOCK_WISE */
 
+static bool
+dispatch_set_payload(oc_dispatch_context_t *ctx, const uint8_t *payload,
+                     size_t payload_size)
+{
+  coap_packet_t *request = &ctx->request;
 #ifdef OC_BLOCK_WISE
-    g_request_buffer->payload_size = (uint32_t)payload_size;
-    uint32_t block_size;
+  if (!dispatch_set_request_buffer(ctx, payload, payload_size)) {
+    return false;
+  }
 #ifdef OC_TCP
-    if (!(g_dispatch.transaction->message->endpoint.flags & TCP) &&
-        payload_size > OC_BLOCK_SIZE) {
+  if (!(ctx->transaction->message->endpoint.flags & TCP) &&
+      payload_size > (size_t)OC_BLOCK_SIZE) {
 #else  /* OC_TCP */
-    if ((long)payload_size > OC_BLOCK_SIZE) {
+  if (payload_size > (size_t)OC_BLOCK_SIZE) {
 #endif /* !OC_TCP */
-      const void *payload = oc_blockwise_dispatch_block(
-        g_request_buffer, 0, (uint32_t)OC_BLOCK_SIZE, &block_size);
-      if (payload) {
-        coap_set_payload(g_request, payload, block_size);
-        coap_set_header_block1(g_request, 0, 1, (uint16_t)block_size);
-        coap_set_header_size1(g_request, (uint32_t)payload_size);
-        g_request->type = COAP_TYPE_CON;
-        g_dispatch.client_cb->qos = HIGH_QOS;
-      }
-    } else {
-      coap_set_payload(g_request, g_request_buffer->buffer, payload_size);
-      g_request_buffer->ref_count = 0;
+    uint32_t block_size;
+    const void *block = oc_blockwise_dispatch_block(
+      ctx->request_buffer, 0, (uint32_t)OC_BLOCK_SIZE, &block_size);
+    if (block) {
+      coap_set_payload(request, block, block_size);
+      coap_set_header_block1(request, 0, 1, (uint16_t)block_size);
+      coap_set_header_size1(request, (uint32_t)payload_size);
+      request->type = COAP_TYPE_CON;
+      ctx->client_cb->qos = HIGH_QOS;
     }
+  } else {
+    coap_set_payload(request, ctx->request_buffer->buffer, payload_size);
+    ctx->request_buffer->ref_count = 0;
+  }
 #else  /* OC_BLOCK_WISE */
-    coap_set_payload(
-      g_request, g_dispatch.transaction->message->data + COAP_MAX_HEADER_SIZE,
-      payload_size);
-#endif /* !OC_BLOCK_WISE */
+  if (payload_size > (size_t)OC_BLOCK_SIZE) {
+    OC_ERR("payload(%zu) of the request is too large", payload_size);
+    return false;
   }
+  uint8_t *buffer = ctx->transaction->message->data + COAP_MAX_HEADER_SIZE;
+  memcpy(buffer, payload, payload_size);
+  coap_set_payload(request, buffer, payload_size);
+#endif /* !OC_BLOCK_WISE */
 
-  if (payload_size > 0) {
 #ifdef OC_SPEC_VER_OIC
-    if (g_dispatch.client_cb->endpoint.version == OIC_VER_1_1_0) {
-      coap_set_header_content_format(g_request, APPLICATION_CBOR);
-    } else
+  if (ctx->client_cb->endpoint.version == OIC_VER_1_1_0) {
+    coap_set_header_content_format(request, APPLICATION_CBOR);
+  } else
 #endif /* OC_SPEC_VER_OIC */
-    {
-      coap_set_header_content_format(g_request, APPLICATION_VND_OCF_CBOR);
-    }
+  {
+    coap_set_header_content_format(request, APPLICATION_VND_OCF_CBOR);
   }
+  return true;
+}
 
+static bool
+dispatch_send(oc_dispatch_context_t *ctx, const uint8_t *payload,
+              size_t payload_size)
+{
   bool success = false;
-  g_dispatch.transaction->message->length =
-    coap_serialize_message(g_request, g_dispatch.transaction->message->data);
-  if (g_dispatch.transaction->message->length > 0) {
-    coap_send_transaction(g_dispatch.transaction);
-
-    if (g_dispatch.client_cb->observe_seq == -1) {
-      if (g_dispatch.client_cb->qos == LOW_QOS)
-        oc_set_delayed_callback(g_dispatch.client_cb, &oc_ri_remove_client_cb,
+  if ((ctx->client_cb->method == OC_PUT || ctx->client_cb->method == OC_POST) &&
+      payload_size > 0 && !dispatch_set_payload(ctx, payload, payload_size)) {
+    coap_clear_transaction(ctx->transaction);
+    oc_ri_remove_client_cb(ctx->client_cb);
+    goto dispatch_done;
+  }
+
+  ctx->transaction->message->length =
+    coap_serialize_message(&ctx->request, ctx->transaction->message->data);
+  if (ctx->transaction->message->length > 0) {
+    coap_send_transaction(ctx->transaction);
+
+    if (ctx->client_cb->observe_seq == -1) {
+      if (ctx->client_cb->qos == LOW_QOS)
+        oc_set_delayed_callback(ctx->client_cb, &oc_ri_remove_client_cb,
                                 OC_NON_LIFETIME);
       else
-        oc_set_delayed_callback(g_dispatch.client_cb, &oc_ri_remove_client_cb,
+        oc_set_delayed_callback(ctx->client_cb, &oc_ri_remove_client_cb,
                                 OC_EXCHANGE_LIFETIME);
     }
 
     success = true;
   } else {
-    coap_clear_transaction(g_dispatch.transaction);
-    oc_ri_remove_client_cb(g_dispatch.client_cb);
+    coap_clear_transaction(ctx->transaction);
+    oc_ri_remove_client_cb(ctx->client_cb);
   }
 
+dispatch_done:
 #ifdef OC_BLOCK_WISE
-  if (g_request_buffer && g_request_buffer->ref_count == 0) {
-    oc_blockwise_free_request_buffer(g_request_buffer);
+  if (ctx->request_buffer && ctx->request_buffer->ref_count == 0) {
+    oc_blockwise_free_request_buffer(ctx->request_buffer);
   }
-  g_request_buffer = NULL;
+  ctx->request_buffer = NULL;
 #endif /* OC_BLOCK_WISE */
 
-  g_dispatch.transaction = NULL;
-  g_dispatch.client_cb = NULL;
-
+  ctx->transaction = NULL;
+  ctx->client_cb = NULL;
   return success;
 }
 
 static bool
-prepare_coap_request(oc_client_cb_t *cb)
+dispatch_prepare(oc_dispatch_context_t *ctx, oc_client_cb_t *cb)
 {
   coap_message_type_t type = COAP_TYPE_NON;
 
@@ -152,72 +258,55 @@ prepare_coap_request(oc_client_cb_t *cb)
     return false;
   }
 
-  g_dispatch.transaction = transaction;
-  oc_rep_new(g_dispatch.transaction->message->data + COAP_MAX_HEADER_SIZE,
-             OC_BLOCK_SIZE);
-
-#ifdef OC_BLOCK_WISE
-  if (cb->method == OC_PUT || cb->method == OC_POST) {
-    g_request_buffer = oc_blockwise_alloc_request_buffer(
-      oc_string(cb->uri) + 1, oc_string_len(cb->uri) - 1, &cb->endpoint,
-      cb->method, OC_BLOCKWISE_CLIENT, OC_MIN_APP_DATA_SIZE);
-    if (!g_request_buffer) {
-      OC_ERR("g_request_buffer is NULL");
-      return false;
-    }
-#ifdef OC_DYNAMIC_ALLOCATION
-#ifdef OC_APP_DATA_BUFFER_POOL
-    if (g_request_buffer->block) {
-      oc_rep_new(g_request_buffer->buffer, g_request_buffer->buffer_size);
-    } else
-#endif
-    {
-      oc_rep_new_realloc(&g_request_buffer->buffer,
-                         g_request_buffer->buffer_size, OC_MAX_APP_DATA_SIZE);
-    }
-#else  /* OC_DYNAMIC_ALLOCATION */
-    oc_rep_new(g_request_buffer->buffer, OC_MIN_APP_DATA_SIZE);
-#endif /* !OC_DYNAMIC_ALLOCATION */
-    g_request_buffer->mid = cb->mid;
-    g_request_buffer->client_cb = cb;
-  }
-#endif /* OC_BLOCK_WISE */
+  ctx->transaction = transaction;
+  coap_packet_t *request = &ctx->request;
 
 #ifdef OC_TCP
   if (cb->endpoint.flags & TCP) {
-    coap_tcp_init_message(g_request, (uint8_t)cb->method);
+    coap_tcp_init_message(request, (uint8_t)cb->method);
   } else
 #endif /* OC_TCP */
   {
-    coap_udp_init_message(g_request, type, (uint8_t)cb->method, cb->mid);
+    coap_udp_init_message(request, type, (uint8_t)cb->method, cb->mid);
   }
 
 #ifdef OC_SPEC_VER_OIC
   if (cb->endpoint.version == OIC_VER_1_1_0) {
-    coap_set_header_accept(g_request, APPLICATION_CBOR);
+    coap_set_header_accept(request, APPLICATION_CBOR);
   } else
 #endif /* OC_SPEC_VER_OIC */
   {
-    coap_set_header_accept(g_request, APPLICATION_VND_OCF_CBOR);
+    coap_set_header_accept(request, APPLICATION_VND_OCF_CBOR);
   }
 
-  coap_set_token(g_request, cb->token, cb->token_len);
+  coap_set_token(request, cb->token, cb->token_len);
 
-  coap_set_header_uri_path(g_request, oc_string(cb->uri),
-                           oc_string_len(cb->uri));
+  coap_set_header_uri_path(request, oc_string(cb->uri), oc_string_len(cb->uri));
 
   if (cb->observe_seq != -1)
-    coap_set_header_observe(g_request, cb->observe_seq);
+    coap_set_header_observe(request, cb->observe_seq);
 
   if (oc_string_len(cb->query) > 0) {
-    coap_set_header_uri_query(g_request, oc_string(cb->query));
+    coap_set_header_uri_query(request, oc_string(cb->query));
   }
 
-  g_dispatch.client_cb = cb;
+  ctx->client_cb = cb;
 
   return true;
 }
 
+static bool
+prepare_coap_request(oc_client_cb_t *cb)
+{
+  return dispatch_prepare(&g_dispatch, cb);
+}
+
+static bool
+dispatch_coap_request(void)
+{
+  return dispatch_send(&g_dispatch, NULL, 0);
+}
+
 #ifdef OC_OSCORE
 
 #ifdef OC_IPV4
@@ -246,18 +335,20 @@ oc_do_multicast_update(void)
   int payload_size = oc_rep_get_encoded_payload_size();
 
   if (payload_size > 0) {
-    coap_set_payload(g_request, g_multicast_update->data + COAP_MAX_HEADER_SIZE,
+    coap_set_payload(g_multicast_request,
+                     g_multicast_update->data + COAP_MAX_HEADER_SIZE,
                      payload_size);
   } else {
     goto do_multicast_update_error;
   }
 
   if (payload_size > 0) {
-    coap_set_header_content_format(g_request, APPLICATION_VND_OCF_CBOR);
+    coap_set_header_content_format(g_multicast_request,
+                                   APPLICATION_VND_OCF_CBOR);
   }
 
   g_multicast_update->length =
-    coap_serialize_message(g_request, g_multicast_update->data);
+    coap_serialize_message(g_multicast_request, g_multicast_update->data);
   if (g_multicast_update->length > 0) {
     oc_send_message(g_multicast_update);
   } else {
@@ -269,10 +360,14 @@ oc_do_multicast_update(void)
 #endif /* OC_IPV4 */
 
   g_multicast_update = NULL;
+  oc_rep_encoder_set_context(g_multicast_prev_encoder_ctx);
+  g_multicast_prev_encoder_ctx = NULL;
   return true;
 do_multicast_update_error:
   oc_message_unref(g_multicast_update);
   g_multicast_update = NULL;
+  oc_rep_encoder_set_context(g_multicast_prev_encoder_ctx);
+  g_multicast_prev_encoder_ctx = NULL;
   return false;
 }
 
@@ -293,19 +388,21 @@ oc_init_multicast_update(const char *uri, const char *query)
 
   memcpy(&g_multicast_update->endpoint, &mcast, sizeof(oc_endpoint_t));
 
+  g_multicast_prev_encoder_ctx =
+    oc_rep_encoder_set_context(&g_multicast_encoder_ctx);
   oc_rep_new(g_multicast_update->data + COAP_MAX_HEADER_SIZE, OC_BLOCK_SIZE);
 
-  coap_udp_init_message(g_request, type, OC_POST, coap_get_mid());
+  coap_udp_init_message(g_multicast_request, type, OC_POST, coap_get_mid());
 
-  coap_set_header_accept(g_request, APPLICATION_VND_OCF_CBOR);
+  coap_set_header_accept(g_multicast_request, APPLICATION_VND_OCF_CBOR);
 
-  g_request->token_len = sizeof(g_request->token);
-  oc_random_buffer(g_request->token, g_request->token_len);
+  g_multicast_request->token_len = sizeof(g_multicast_request->token);
+  oc_random_buffer(g_multicast_request->token, g_multicast_request->token_len);
 
-  coap_set_header_uri_path(g_request, uri, strlen(uri));
+  coap_set_header_uri_path(g_multicast_request, uri, strlen(uri));
 
   if (query) {
-    coap_set_header_uri_query(g_request, query);
+    coap_set_header_uri_query(g_multicast_request, query);
   }
 
   return true;
@@ -439,51 +536,414 @@ oc_do_get_with_timeout(const char *uri, const oc_endpoint_t *endpoint,
                                     timeout_seconds, handler, qos, user_data);
 }
 
-// preparation step for sending coap request using async methods (POST or PUT)
-static bool
-oc_init_async_request(oc_method_t method, const char *uri,
+/* must be called with the network event handler mutex locked */
+static void
+client_request_init(oc_client_request_t *request, oc_method_t method,
+                    const char *uri, const oc_endpoint_t *endpoint,
+                    const char *query, oc_response_handler_t handler,
+                    oc_qos_t qos, void *user_data)
+{
+  oc_new_string(&request->uri, uri, strlen(uri));
+  if (query != NULL && query[0] != '\0') {
+    oc_new_string(&request->query, query, strlen(query));
+  }
+  request->method = method;
+  memcpy(&request->endpoint, endpoint, sizeof(oc_endpoint_t));
+  request->endpoint.next = NULL;
+  request->handler = handler;
+  request->qos = qos;
+  request->user_data = user_data;
+}
+
+oc_client_request_t *
+oc_client_request_new(oc_method_t method, const char *uri,
                       const oc_endpoint_t *endpoint, const char *query,
                       oc_response_handler_t handler, oc_qos_t qos,
                       void *user_data)
+{
+  assert(uri != NULL);
+  assert(endpoint != NULL);
+  assert(handler != NULL);
+  oc_network_event_handler_mutex_lock();
+  oc_client_request_t *request =
+    (oc_client_request_t *)oc_memb_alloc(&g_client_requests_s);
+  if (request != NULL) {
+    client_request_init(request, method, uri, endpoint, query, handler, qos,
+                        user_data);
+  }
+  oc_network_event_handler_mutex_unlock();
+  if (request == NULL) {
+    OC_ERR("insufficient memory to create client request");
+  }
+  return request;
+}
+
+/* must be called with the network event handler mutex locked */
+static void
+client_request_free_payload(oc_client_request_t *request)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  free(request->payload);
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  if (request->payload != NULL && request->payload != g_legacy_payload) {
+    oc_memb_free(&g_client_request_payloads_s, request->payload);
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  request->payload = NULL;
+  request->payload_size = 0;
+}
+
+static bool
+client_request_alloc_payload(oc_client_request_t *request, size_t size)
+{
+#ifdef OC_DYNAMIC_ALLOCATION
+  uint8_t *payload = NULL;
+  if (size > 0) {
+    payload = (uint8_t *)malloc(size);
+    if (payload == NULL) {
+      return false;
+    }
+  }
+  oc_network_event_handler_mutex_lock();
+  client_request_free_payload(request);
+  request->payload = payload;
+  oc_network_event_handler_mutex_unlock();
+  return true;
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  (void)size;
+  if (request->payload != NULL) {
+    return true;
+  }
+  if (request == &g_legacy_request) {
+    request->payload = g_legacy_payload;
+    return true;
+  }
+  oc_network_event_handler_mutex_lock();
+  request->payload = (uint8_t *)oc_memb_alloc(&g_client_request_payloads_s);
+  oc_network_event_handler_mutex_unlock();
+  return request->payload != NULL;
+#endif /* OC_DYNAMIC_ALLOCATION */
+}
+
+void
+oc_client_request_free(oc_client_request_t *request)
+{
+  if (request == NULL) {
+    return;
+  }
+  if (request->encoding &&
+      oc_rep_encoder_get_context() == &request->encoder_ctx) {
+    oc_rep_encoder_set_context(request->prev_encoder_ctx);
+  }
+  oc_network_event_handler_mutex_lock();
+  oc_free_string(&request->uri);
+  oc_free_string(&request->query);
+  client_request_free_payload(request);
+  if (request == &g_legacy_request) {
+    memset(request, 0, sizeof(oc_client_request_t));
+  } else {
+    oc_memb_free(&g_client_requests_s, request);
+  }
+  oc_network_event_handler_mutex_unlock();
+}
+
+void
+oc_client_request_set_timeout(oc_client_request_t *request,
+                              uint16_t timeout_seconds)
+{
+  assert(request != NULL);
+  request->timeout_seconds = timeout_seconds;
+}
+
+void
+oc_client_request_set_accept(oc_client_request_t *request,
+                             oc_content_format_t accept)
+{
+  assert(request != NULL);
+  request->accept = accept;
+}
+
+static bool
+client_request_has_payload(const oc_client_request_t *request)
+{
+  if (request->method != OC_PUT && request->method != OC_POST) {
+    OC_ERR("only PUT and POST requests carry a payload");
+    return false;
+  }
+  return true;
+}
+
+bool
+oc_client_request_begin_payload(oc_client_request_t *request)
+{
+  assert(request != NULL);
+  if (!client_request_has_payload(request)) {
+    return false;
+  }
+  size_t max_size = (size_t)OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE;
+#ifdef OC_DYNAMIC_ALLOCATION
+  size_t size = (size_t)OC_MIN_APP_DATA_SIZE;
+  if (size > max_size) {
+    size = max_size;
+  }
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  size_t size = max_size;
+#endif /* OC_DYNAMIC_ALLOCATION */
+  if (!client_request_alloc_payload(request, size)) {
+    OC_ERR("insufficient memory to encode payload of client request");
+    return false;
+  }
+  if (!request->encoding) {
+    request->prev_encoder_ctx =
+      oc_rep_encoder_set_context(&request->encoder_ctx);
+    request->encoding = true;
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  oc_rep_new_realloc(&request->payload, (int)size, (int)max_size);
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  oc_rep_new(request->payload, (int)size);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  request->payload_size = 0;
+  return true;
+}
+
+bool
+oc_client_request_end_payload(oc_client_request_t *request)
+{
+  assert(request != NULL);
+  if (!request->encoding) {
+    return false;
+  }
+  request->encoding = false;
+  // the encoder contexts of the payloads are restored in LIFO order
+  assert(oc_rep_encoder_get_context() == &request->encoder_ctx);
+  if (oc_rep_encoder_get_context() != &request->encoder_ctx) {
+    OC_ERR("payload of client request must be finished before the payloads "
+           "started after it and in the same callback");
+    request->prev_encoder_ctx = NULL;
+    return false;
+  }
+  int payload_size = oc_rep_get_encoded_payload_size();
+  oc_rep_encoder_set_context(request->prev_encoder_ctx);
+  request->prev_encoder_ctx = NULL;
+  if (payload_size < 0) {
+    OC_ERR("cannot encode payload of client request");
+    return false;
+  }
+  request->payload_size = (size_t)payload_size;
+  return true;
+}
+
+bool
+oc_client_request_set_payload(oc_client_request_t *request,
+                              const uint8_t *payload, size_t payload_size)
+{
+  assert(request != NULL);
+  assert(!request->encoding);
+  if (!client_request_has_payload(request)) {
+    return false;
+  }
+  if (payload_size > (size_t)OC_CLIENT_REQUEST_MAX_PAYLOAD_SIZE) {
+    OC_ERR("payload(%zu) of client request is too large", payload_size);
+    return false;
+  }
+  if (!client_request_alloc_payload(request, payload_size)) {
+    OC_ERR("insufficient memory to store payload of client request");
+    return false;
+  }
+  if (payload_size > 0) {
+    memcpy(request->payload, payload, payload_size);
+  }
+  request->payload_size = payload_size;
+  return true;
+}
+
+static bool
+client_request_dispatch(const oc_client_request_t *request)
 {
   oc_client_handler_t client_handler = {
-    .response = handler,
+    .response = request->handler,
     .discovery = NULL,
     .discovery_all = NULL,
   };
-
-  oc_client_cb_t *cb = oc_ri_alloc_client_cb(uri, endpoint, method, query,
-                                             client_handler, qos, user_data);
+  oc_client_cb_t *cb = oc_ri_alloc_client_cb(
+    oc_string(request->uri), &request->endpoint, request->method,
+    oc_string(request->query), client_handler, request->qos,
+    request->user_data);
   if (cb == NULL) {
     return false;
   }
 
-  if (!prepare_coap_request(cb)) {
+  oc_dispatch_context_t ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  if (!dispatch_prepare(&ctx, cb)) {
     oc_ri_remove_client_cb(cb);
     return false;
   }
+  if (request->accept != 0) {
+    coap_set_header_accept(&ctx.request, request->accept);
+  }
+  // the client callback is removed by dispatch_send on failure
+  if (!dispatch_send(&ctx, request->payload, request->payload_size)) {
+    return false;
+  }
+  if (request->timeout_seconds > 0) {
+    oc_set_delayed_callback(cb,
+                            oc_ri_remove_client_cb_with_notify_timeout_async,
+                            request->timeout_seconds);
+  }
   return true;
 }
 
-// execution step for sending coap request using async methods (POST or PUT)
+bool
+oc_client_request_send(oc_client_request_t *request)
+{
+  assert(request != NULL);
+  bool sent = false;
+  if (request->encoding) {
+    OC_ERR("payload of client request is not finished");
+  } else {
+    sent = client_request_dispatch(request);
+  }
+  oc_client_request_free(request);
+  return sent;
+}
+
+void
+oc_client_request_submit(oc_client_request_t *const *requests, size_t count)
+{
+  assert(requests != NULL || count == 0);
+  if (count == 0) {
+    return;
+  }
+  oc_network_event_handler_mutex_lock();
+  for (size_t i = 0; i < count; ++i) {
+    assert(!requests[i]->encoding);
+    oc_list_add(g_submitted_requests, requests[i]);
+  }
+  oc_network_event_handler_mutex_unlock();
+  oc_process_poll(&oc_client_request_process);
+  _oc_signal_event_loop();
+}
+
+static void
+client_request_notify_cancelled(oc_client_request_t *request)
+{
+  oc_client_response_t response;
+  memset(&response, 0, sizeof(oc_client_response_t));
+  response.code = OC_CANCELLED;
+  response.endpoint = &request->endpoint;
+  response.user_data = request->user_data;
+  request->handler(&response);
+}
+
+static void
+client_request_process_submitted(void)
+{
+  // take out all submitted requests and send them without the lock
+  oc_client_request_t *ready = NULL;
+  oc_client_request_t *last = NULL;
+  oc_network_event_handler_mutex_lock();
+  oc_client_request_t *request =
+    (oc_client_request_t *)oc_list_pop(g_submitted_requests);
+  while (request != NULL) {
+    request->next = NULL;
+    if (last == NULL) {
+      ready = request;
+    } else {
+      last->next = request;
+    }
+    last = request;
+    request = (oc_client_request_t *)oc_list_pop(g_submitted_requests);
+  }
+  oc_network_event_handler_mutex_unlock();
+
+  while (ready != NULL) {
+    request = ready;
+    ready = request->next;
+    if (!client_request_dispatch(request)) {
+      OC_ERR("cannot send submitted client request");
+      client_request_notify_cancelled(request);
+    }
+    oc_client_request_free(request);
+  }
+}
+
+OC_PROCESS_THREAD(oc_client_request_process, ev, data)
+{
+  (void)ev;
+  (void)data;
+  OC_PROCESS_POLLHANDLER(client_request_process_submitted());
+  OC_PROCESS_BEGIN();
+  while (oc_process_is_running(&oc_client_request_process)) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+void
+oc_client_requests_free_all(void)
+{
+  oc_client_request_free(g_pending_request);
+  g_pending_request = NULL;
+  oc_client_request_t *request;
+  do {
+    oc_network_event_handler_mutex_lock();
+    request = (oc_client_request_t *)oc_list_pop(g_submitted_requests);
+    oc_network_event_handler_mutex_unlock();
+    oc_client_request_free(request);
+  } while (request != NULL);
+}
+
+// preparation step for sending coap request using async methods (POST or PUT)
 static bool
-oc_do_async_request_with_timeout(uint16_t timeout_seconds, oc_method_t method)
+oc_init_async_request(oc_method_t method, const char *uri,
+                      const oc_endpoint_t *endpoint, const char *query,
+                      oc_response_handler_t handler, oc_qos_t qos,
+                      void *user_data)
 {
-  oc_client_cb_t *cb = g_dispatch.client_cb;
-  if (cb == NULL || cb->method != method) {
+  if (g_pending_request != NULL) {
+    OC_WRN("previously initialized request was not dispatched");
+    oc_client_request_free(g_pending_request);
+    g_pending_request = NULL;
+  }
+  oc_client_request_t *request = &g_legacy_request;
+  oc_network_event_handler_mutex_lock();
+  client_request_init(request, method, uri, endpoint, query, handler, qos,
+                      user_data);
+  oc_network_event_handler_mutex_unlock();
+  if (!oc_client_request_begin_payload(request)) {
+    oc_client_request_free(request);
     return false;
   }
+  g_pending_request = request;
+  return true;
+}
 
-  bool dispatch = dispatch_coap_request();
-  if (!dispatch) {
+// execution step for sending coap request using async methods (POST or PUT)
+static bool
+oc_do_async_request(uint16_t timeout_seconds)
+{
+  oc_client_request_t *request = g_pending_request;
+  if (request == NULL) {
     return false;
   }
+  g_pending_request = NULL;
+  if (!oc_client_request_end_payload(request)) {
+    oc_client_request_free(request);
+    return false;
+  }
+  oc_client_request_set_timeout(request, timeout_seconds);
+  return oc_client_request_send(request);
+}
 
-  if (timeout_seconds > 0) {
-    oc_set_delayed_callback(
-      cb, oc_ri_remove_client_cb_with_notify_timeout_async, timeout_seconds);
+static bool
+oc_do_async_request_with_timeout(uint16_t timeout_seconds, oc_method_t method)
+{
+  if (g_pending_request == NULL || g_pending_request->method != method) {
+    return false;
   }
-  return true;
+  return oc_do_async_request(timeout_seconds);
 }
 
 bool
@@ -505,7 +965,7 @@ oc_init_post(const char *uri, const oc_endpoint_t *endpoint, const char *query,
 bool
 oc_do_put(void)
 {
-  return dispatch_coap_request();
+  return oc_do_async_request(0);
 }
 
 bool
@@ -517,7 +977,7 @@ oc_do_put_with_timeout(uint16_t timeout_seconds)
 bool
 oc_do_post(void)
 {
-  return dispatch_coap_request();
+  return oc_do_async_request(0);
 }
 
 bool
@@ -0,0 +1,54 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_CLIENT_API_INTERNAL_H
+#define OC_CLIENT_API_INTERNAL_H
+
+#ifdef OC_CLIENT
+
+#include "util/oc_process.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximal number of client requests being built or waiting to be sent in
+ * static builds. Dynamic builds are limited only by available memory. The
+ * requests of oc_init_put / oc_init_post are not counted. */
+#ifndef OC_MAX_NUM_CLIENT_REQUESTS
+#define OC_MAX_NUM_CLIENT_REQUESTS (1)
+#endif /* OC_MAX_NUM_CLIENT_REQUESTS */
+
+/* Maximal number of payloads of the client requests in static builds, each
+ * takes a buffer for the whole payload. */
+#ifndef OC_MAX_NUM_CLIENT_REQUEST_PAYLOADS
+#define OC_MAX_NUM_CLIENT_REQUEST_PAYLOADS (1)
+#endif /* OC_MAX_NUM_CLIENT_REQUEST_PAYLOADS */
+
+OC_PROCESS_NAME(oc_client_request_process);
+
+/** @brief Free all client requests that were not sent. */
+void oc_client_requests_free_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_CLIENT */
+
+#endif /* OC_CLIENT_API_INTERNAL_H */
@@ -19,11 +19,14 @@
 #include "oc_collection.h"
 
 #if defined(OC_COLLECTIONS) && defined(OC_SERVER)
+#include "api/oc_batch_response_internal.h"
+#include "api/oc_rep_encode_internal.h"
 #include "messaging/coap/observe.h"
 #include "oc_api.h"
 #include "oc_core_res.h"
 #include "oc_core_res_internal.h"
 #include "oc_discovery_internal.h"
+#include "util/oc_hash.h"
 #include "util/oc_memb.h"
 
 #ifdef OC_COLLECTIONS_IF_CREATE
@@ -49,6 +52,169 @@ OC_LIST(rt_factories);
 OC_LIST(params_list);
 #endif /* OC_COLLECTIONS_IF_CREATE */
 
+/* Number of buckets of the hash indexes of collections and links, must be a
+ * power of two. */
+#ifndef OC_COLLECTION_INDEX_SIZE
+#define OC_COLLECTION_INDEX_SIZE (32)
+#endif /* OC_COLLECTION_INDEX_SIZE */
+
+/* collections indexed by pointer and by uri and device */
+static oc_collection_t *g_collection_by_ptr[OC_COLLECTION_INDEX_SIZE];
+static oc_collection_t *g_collection_by_uri[OC_COLLECTION_INDEX_SIZE];
+/* links of all collections indexed by the linked resource (the reverse map
+ * from a resource to the collections containing it) and by collection and
+ * href */
+static oc_link_t *g_link_by_resource[OC_COLLECTION_INDEX_SIZE];
+static oc_link_t *g_link_by_uri[OC_COLLECTION_INDEX_SIZE];
+
+static size_t
+collection_hash_ptr(const void *ptr)
+{
+  uintptr_t value = (uintptr_t)ptr;
+  return oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, &value, sizeof(value)) &
+         (OC_COLLECTION_INDEX_SIZE - 1);
+}
+
+/* the uri is hashed without the leading slashes */
+static size_t
+collection_hash_uri(uintptr_t key, const char *uri, size_t uri_len)
+{
+  while (uri_len > 0 && uri[0] == '/') {
+    ++uri;
+    --uri_len;
+  }
+  uint32_t hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, &key, sizeof(key));
+  return oc_hash_fnv1a(hash, uri, uri_len) & (OC_COLLECTION_INDEX_SIZE - 1);
+}
+
+static void
+collection_index_add(oc_collection_t *collection)
+{
+  size_t b = collection_hash_ptr(collection);
+  collection->index_next = g_collection_by_ptr[b];
+  g_collection_by_ptr[b] = collection;
+  b = collection_hash_uri((uintptr_t)collection->res.device,
+                          oc_string(collection->res.uri),
+                          oc_string_len(collection->res.uri));
+  collection->uri_next = g_collection_by_uri[b];
+  g_collection_by_uri[b] = collection;
+}
+
+static void
+collection_index_remove(const oc_collection_t *collection)
+{
+  oc_collection_t **c = &g_collection_by_ptr[collection_hash_ptr(collection)];
+  for (; *c != NULL; c = &(*c)->index_next) {
+    if (*c == collection) {
+      *c = collection->index_next;
+      break;
+    }
+  }
+  c = &g_collection_by_uri[collection_hash_uri(
+    (uintptr_t)collection->res.device, oc_string(collection->res.uri),
+    oc_string_len(collection->res.uri))];
+  for (; *c != NULL; c = &(*c)->uri_next) {
+    if (*c == collection) {
+      *c = collection->uri_next;
+      break;
+    }
+  }
+}
+
+static void
+collection_index_add_link(oc_collection_t *collection, oc_link_t *link)
+{
+  link->collection = collection;
+  if (link->resource == NULL) {
+    return;
+  }
+  size_t b = collection_hash_ptr(link->resource);
+  link->index_next = g_link_by_resource[b];
+  g_link_by_resource[b] = link;
+  b = collection_hash_uri((uintptr_t)collection, oc_string(link->resource->uri),
+                          oc_string_len(link->resource->uri));
+  link->uri_next = g_link_by_uri[b];
+  g_link_by_uri[b] = link;
+}
+
+static void
+collection_index_remove_link(oc_link_t *link)
+{
+  if (link->collection != NULL && link->resource != NULL) {
+    oc_link_t **l = &g_link_by_resource[collection_hash_ptr(link->resource)];
+    for (; *l != NULL; l = &(*l)->index_next) {
+      if (*l == link) {
+        *l = link->index_next;
+        break;
+      }
+    }
+    l = &g_link_by_uri[collection_hash_uri((uintptr_t)link->collection,
+                                           oc_string(link->resource->uri),
+                                           oc_string_len(link->resource->uri))];
+    for (; *l != NULL; l = &(*l)->uri_next) {
+      if (*l == link) {
+        *l = link->uri_next;
+        break;
+      }
+    }
+  }
+  link->collection = NULL;
+  link->index_next = NULL;
+  link->uri_next = NULL;
+}
+
+static bool
+collection_link_has_uri(const oc_link_t *link, const char *uri_path,
+                        size_t uri_path_len)
+{
+  // uri_path is without the leading slashes, the uri of a resource always
+  // starts with a single slash
+  return link->resource != NULL &&
+         oc_string_len(link->resource->uri) == uri_path_len + 1 &&
+         memcmp(oc_string(link->resource->uri) + 1, uri_path, uri_path_len) ==
+           0;
+}
+
+/* Find the next link of the collection with the given href (without the
+ * leading slashes), following start if it is not NULL. */
+static oc_link_t *
+collection_next_link_by_uri(const oc_collection_t *collection,
+                            const char *uri_path, size_t uri_path_len,
+                            const oc_link_t *start)
+{
+  oc_link_t *link =
+    start != NULL
+      ? start->uri_next
+      : g_link_by_uri[collection_hash_uri((uintptr_t)collection, uri_path,
+                                          uri_path_len)];
+  for (; link != NULL; link = link->uri_next) {
+    if (link->collection == collection &&
+        collection_link_has_uri(link, uri_path, uri_path_len)) {
+      return link;
+    }
+  }
+  return NULL;
+}
+
+/* Find the next link of the collection to the resource, following start if
+ * it is not NULL. */
+static oc_link_t *
+collection_next_link_by_resource(const oc_collection_t *collection,
+                                 const oc_resource_t *resource,
+                                 const oc_link_t *start)
+{
+  oc_link_t *link = start != NULL
+                      ? start->index_next
+                      : g_link_by_resource[collection_hash_ptr(resource)];
+  for (; link != NULL; link = link->index_next) {
+    if (link->resource == resource &&
+        (collection == NULL || link->collection == collection)) {
+      return link;
+    }
+  }
+  return NULL;
+}
+
 oc_collection_t *
 oc_collection_alloc(void)
 {
@@ -69,6 +235,7 @@ oc_collection_free(oc_collection_t *collection)
 {
   if (collection != NULL) {
     oc_list_remove(oc_collections, collection);
+    collection_index_remove(collection);
     oc_ri_free_resource_properties((oc_resource_t *)collection);
 
     oc_link_t *link;
@@ -123,6 +290,7 @@ void
 oc_delete_link(oc_link_t *link)
 {
   if (link) {
+    collection_index_remove_link(link);
     oc_link_params_t *p = (oc_link_params_t *)oc_list_pop(link->params);
     while (p) {
       oc_free_string(&p->key);
@@ -203,6 +371,8 @@ oc_collection_add_link(oc_resource_t *collection, oc_link_t *link)
   } else {
     oc_list_push(c->links, link);
   }
+  collection_index_remove_link(link);
+  collection_index_add_link(c, link);
   if (link->resource == collection) {
     oc_string_array_add_item(link->rel, "self");
   }
@@ -218,6 +388,7 @@ oc_collection_remove_link(oc_resource_t *collection, oc_link_t *link)
   if (collection && link) {
     oc_collection_t *c = (oc_collection_t *)collection;
     oc_list_remove(c->links, link);
+    collection_index_remove_link(link);
     oc_set_delayed_callback(collection, links_list_notify_collection, 0);
 #if defined(OC_RES_BATCH_SUPPORT) && defined(OC_DISCOVERY_RESOURCE_OBSERVABLE)
     coap_notify_discovery_batch_observers(collection);
@@ -264,56 +435,46 @@ oc_collection_t *
 oc_get_collection_by_uri(const char *uri_path, size_t uri_path_len,
                          size_t device)
 {
-  while (uri_path[0] == '/') {
+  while (uri_path_len > 0 && uri_path[0] == '/') {
     uri_path++;
     uri_path_len--;
   }
-  oc_resource_t *collection = (oc_resource_t *)oc_list_head(oc_collections);
-  while (collection != NULL) {
-    if (oc_string_len(collection->uri) == (uri_path_len + 1) &&
-        strncmp(oc_string(collection->uri) + 1, uri_path, uri_path_len) == 0 &&
-        collection->device == device)
+  oc_collection_t *collection = g_collection_by_uri[collection_hash_uri(
+    (uintptr_t)device, uri_path, uri_path_len)];
+  for (; collection != NULL; collection = collection->uri_next) {
+    const oc_resource_t *res = &collection->res;
+    if (res->device == device && oc_string_len(res->uri) == uri_path_len + 1 &&
+        memcmp(oc_string(res->uri) + 1, uri_path, uri_path_len) == 0) {
       break;
-    collection = collection->next;
+    }
   }
-  return (oc_collection_t *)collection;
+  return collection;
 }
 
 oc_link_t *
 oc_get_link_by_uri(oc_collection_t *collection, const char *uri_path,
                    int uri_path_len)
 {
-  oc_link_t *link = NULL;
-
-  if (collection && uri_path && uri_path_len > 0) {
-    while (uri_path[0] == '/') {
-      uri_path++;
-      uri_path_len--;
-    }
-
-    link = (oc_link_t *)oc_list_head(collection->links);
-    while (link != NULL) {
-      if (link->resource &&
-          (int)oc_string_len(link->resource->uri) == (uri_path_len + 1) &&
-          strncmp(oc_string(link->resource->uri) + 1, uri_path, uri_path_len) ==
-            0) {
-        break;
-      }
-      link = link->next;
-    }
+  if (collection == NULL || uri_path == NULL || uri_path_len <= 0) {
+    return NULL;
   }
-
-  return link;
+  while (uri_path_len > 0 && uri_path[0] == '/') {
+    uri_path++;
+    uri_path_len--;
+  }
+  return collection_next_link_by_uri(collection, uri_path,
+                                     (size_t)uri_path_len, NULL);
 }
 
 bool
 oc_check_if_collection(const oc_resource_t *resource)
 {
-  oc_resource_t *collection = (oc_resource_t *)oc_list_head(oc_collections);
-  while (collection != NULL) {
-    if (resource == collection)
+  const oc_collection_t *collection =
+    g_collection_by_ptr[collection_hash_ptr(resource)];
+  for (; collection != NULL; collection = collection->index_next) {
+    if (resource == &collection->res) {
       return true;
-    collection = collection->next;
+    }
   }
   return false;
 }
@@ -322,6 +483,9 @@ void
 oc_collection_add(oc_collection_t *collection)
 {
   oc_list_add(oc_collections, collection);
+  // adding a collection again must not create a cycle in its bucket
+  collection_index_remove(collection);
+  collection_index_add(collection);
 }
 
 static oc_rt_t *
@@ -578,31 +742,31 @@ oc_collection_t *
 oc_get_next_collection_with_link(const oc_resource_t *resource,
                                  oc_collection_t *start)
 {
-  oc_collection_t *collection = start;
-
-  if (!collection) {
-    collection = oc_collection_get_all();
-  } else {
-    collection = (oc_collection_t *)collection->res.next;
-  }
-
-  while (collection && collection->res.device == resource->device) {
-    oc_link_t *link = (oc_link_t *)oc_list_head(collection->links);
-    while (link) {
-      if (link->resource == resource) {
-        return collection;
-      }
-      link = link->next;
+  // The collections containing the resource are found through the reverse
+  // index. They are returned ordered by address, so that a collection with
+  // several links to the resource is returned only once and the iteration
+  // stays valid when the link is removed from the returned collection.
+  oc_collection_t *next = NULL;
+  for (const oc_link_t *link =
+         collection_next_link_by_resource(NULL, resource, NULL);
+       link != NULL;
+       link = collection_next_link_by_resource(NULL, resource, link)) {
+    oc_collection_t *collection = link->collection;
+    if (collection->res.device != resource->device ||
+        (start != NULL && (uintptr_t)collection <= (uintptr_t)start)) {
+      continue;
+    }
+    if (next == NULL || (uintptr_t)collection < (uintptr_t)next) {
+      next = collection;
     }
-    collection = (oc_collection_t *)collection->res.next;
   }
-
-  return collection;
+  return next;
 }
 
 typedef struct oc_handle_collection_request_result_t
 {
   bool ok;
+  bool deferred; ///< the response is sent once the deferred links complete
   int ecode;
   int pcode;
 } oc_handle_collection_request_result_t;
@@ -825,6 +989,31 @@ oc_handle_collection_linked_list_request(oc_request_t *request)
   oc_rep_end_links_array();
 }
 
+/* Iterate the links addressed by a batch request. Only the links to the
+ * notifying resource or with the requested href are visited, they are found
+ * through the indexes instead of scanning all links of the collection. */
+static oc_link_t *
+collection_batch_next_link(const oc_collection_t *collection,
+                           const oc_string_t *href,
+                           const oc_resource_t *notify_resource,
+                           const oc_link_t *link)
+{
+  if (notify_resource != NULL) {
+    return collection_next_link_by_resource(collection, notify_resource, link);
+  }
+  if (href != NULL && oc_string_len(*href) > 0) {
+    // the href must be equal to the uri of the resource, which always starts
+    // with a slash
+    const char *uri = oc_string(*href);
+    if (uri[0] != '/') {
+      return NULL;
+    }
+    return collection_next_link_by_uri(collection, uri + 1,
+                                       oc_string_len(*href) - 1, link);
+  }
+  return link != NULL ? link->next : oc_list_head(collection->links);
+}
+
 OC_NO_DISCARD_RETURN
 static oc_handle_collection_request_result_t
 oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
@@ -841,6 +1030,8 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
   oc_string_t *href = NULL;
   const oc_collection_t *collection = (oc_collection_t *)request->resource;
   oc_link_t *link = NULL;
+  oc_batch_dispatch_t dispatch;
+  oc_batch_dispatch_init(&dispatch, request, true);
 
   response.response_buffer = &response_buffer;
   rest_request.response = &response;
@@ -879,7 +1070,8 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
         goto processed_request;
       }
     process_request:
-      link = (oc_link_t *)oc_list_head(collection->links);
+      link = collection_batch_next_link(collection, get_delete ? NULL : href,
+                                        notify_resource, NULL);
       while (link != NULL) {
         if (link->resource &&
             (!notify_resource == !(link->resource == notify_resource))) {
@@ -905,19 +1097,30 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
             response_buffer.code = 0;
             response_buffer.response_length = 0;
             method_not_found = false;
+            bool deferred = false;
 #ifdef OC_SECURITY
             if (request && request->origin &&
                 !oc_sec_check_acl(method, link->resource, request->origin)) {
               response_buffer.code = oc_status_code(OC_STATUS_FORBIDDEN);
             } else
 #endif /* OC_SECURITY */
-            {
+              if (!get_delete &&
+                  link->resource->request_stream_handler.cb != NULL) {
+              // the payload of the link is embedded in the batch payload, it
+              // cannot be passed to the stream consumer of the resource
+              OC_WRN("cannot update resource(%s) with a stream consumer by a "
+                     "batch request", oc_string(link->resource->uri));
+              response_buffer.code = oc_status_code(OC_STATUS_BAD_REQUEST);
+            } else {
               if ((link->resource != (oc_resource_t *)collection) &&
                   oc_check_if_collection(link->resource)) {
                 request->resource = link->resource;
+                // the links of a nested collection cannot defer
+                oc_batch_dispatch_item_begin(&dispatch, NULL);
                 if (!oc_handle_collection_request(
                       method, request, link->resource->default_interface,
                       NULL)) {
+                  oc_batch_dispatch_abort(&dispatch);
                   oc_handle_collection_request_result_t res = {
                     .ok = false,
                     .ecode = oc_status_code(OC_STATUS_OK),
@@ -925,6 +1128,8 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
                   };
                   return res;
                 }
+                oc_batch_dispatch_item_end(&dispatch, NULL,
+                                           oc_string(link->resource->uri));
                 request->resource = (oc_resource_t *)collection;
               } else {
                 oc_interface_mask_t req_iface =
@@ -932,6 +1137,7 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
                 if (link->resource == (oc_resource_t *)collection) {
                   req_iface = OC_IF_BASELINE;
                 }
+                oc_batch_dispatch_item_begin(&dispatch, &response_buffer);
                 switch (method) {
                 case OC_GET:
                   if (link->resource->get_handler.cb)
@@ -968,8 +1174,15 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
                 default:
                   break;
                 }
+                deferred = oc_batch_dispatch_item_end(
+                  &dispatch, &response_buffer, oc_string(link->resource->uri));
               }
             }
+            if (deferred) {
+              // the item is added once its handler completes the response
+              memcpy(&links_array, &prev_link, sizeof(CborEncoder));
+              goto next;
+            }
             if (method_not_found) {
               ecode = oc_status_code(OC_STATUS_METHOD_NOT_ALLOWED);
               memcpy(&links_array, &prev_link, sizeof(CborEncoder));
@@ -997,7 +1210,8 @@ oc_handle_collection_batch_request(oc_method_t method, oc_request_t *request,
           }
         }
       next:
-        link = link->next;
+        link = collection_batch_next_link(collection, get_delete ? NULL : href,
+                                          notify_resource, link);
       }
       if (get_delete) {
         goto processed_request;
@@ -1015,6 +1229,8 @@ processed_request:
 
   oc_handle_collection_request_result_t result = {
     .ok = true,
+    .deferred =
+      oc_batch_dispatch_finish(&dispatch, request, method, ecode, pcode),
     .ecode = ecode,
     .pcode = pcode,
   };
@@ -1058,6 +1274,12 @@ oc_handle_collection_request(oc_method_t method, oc_request_t *request,
     if (!res.ok) {
       return false;
     }
+    if (res.deferred) {
+      if (method == OC_PUT || method == OC_POST) {
+        oc_set_delayed_callback(request->resource, batch_notify_collection, 0);
+      }
+      return true;
+    }
     pcode = res.pcode;
     ecode = res.ecode;
     break;
@@ -1098,7 +1320,8 @@ oc_handle_collection_request(oc_method_t method, oc_request_t *request,
       break;
     }
   }
-  request->response->response_buffer->content_format = APPLICATION_VND_OCF_CBOR;
+  request->response->response_buffer->content_format =
+    oc_rep_encoder_get_content_format();
   request->response->response_buffer->response_length = size;
   request->response->response_buffer->code = code;
 
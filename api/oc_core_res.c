@@ -24,6 +24,7 @@
 #include "oc_endpoint.h"
 #include "oc_introspection_internal.h"
 #include "oc_rep.h"
+#include "oc_rep_fragment_internal.h"
 #include "oc_resource_internal.h"
 #include "oc_ri_internal.h"
 #include "oc_main.h"
@@ -120,6 +121,7 @@ oc_core_free_device_info_properties(oc_device_info_t *oc_device_info_item)
 void
 oc_core_shutdown(void)
 {
+  oc_rep_fragment_invalidate(NULL);
   oc_core_free_platform_info_properties();
 
   uint32_t device_count = OC_ATOMIC_LOAD32(g_device_count);
@@ -195,6 +197,29 @@ oc_core_encode_interfaces_mask(CborEncoder *parent, unsigned iface_mask)
   oc_rep_end_array((parent), if);
 }
 
+/* The fragments of /oic/d and /oic/p are not fingerprinted, they are
+ * invalidated by oc_core_device_info_changed and
+ * oc_core_platform_info_changed whenever the properties are modified. */
+#define CORE_FRAGMENT_FINGERPRINT (0)
+
+static void
+core_device_encode_properties(const oc_resource_t *resource, void *data)
+{
+  bool encode_piid = *(const bool *)data;
+  const oc_device_info_t *info = &g_oc_device_info[resource->device];
+  char di[OC_UUID_LEN];
+  oc_uuid_to_str(&info->di, di, OC_UUID_LEN);
+  oc_rep_set_text_string(root, di, di);
+  if (encode_piid) {
+    char piid[OC_UUID_LEN];
+    oc_uuid_to_str(&info->piid, piid, OC_UUID_LEN);
+    oc_rep_set_text_string(root, piid, piid);
+  }
+  oc_rep_set_text_string(root, n, oc_string(info->name));
+  oc_rep_set_text_string(root, icv, oc_string(info->icv));
+  oc_rep_set_text_string(root, dmv, oc_string(info->dmv));
+}
+
 static void
 oc_core_device_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
                        void *data)
@@ -203,24 +228,21 @@ oc_core_device_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
   size_t device = request->resource->device;
   oc_rep_start_root_object();
 
-  char di[OC_UUID_LEN], piid[OC_UUID_LEN];
-  oc_uuid_to_str(&g_oc_device_info[device].di, di, OC_UUID_LEN);
-  if (request->origin && request->origin->version != OIC_VER_1_1_0) {
-    oc_uuid_to_str(&g_oc_device_info[device].piid, piid, OC_UUID_LEN);
-  }
-
   switch (iface_mask) {
   case OC_IF_BASELINE:
     oc_process_baseline_interface(request->resource);
     OC_FALLTHROUGH;
   case OC_IF_R: {
-    oc_rep_set_text_string(root, di, di);
-    if (request->origin && request->origin->version != OIC_VER_1_1_0) {
-      oc_rep_set_text_string(root, piid, piid);
+    bool encode_piid =
+      request->origin && request->origin->version != OIC_VER_1_1_0;
+    if (encode_piid) {
+      // the same properties are encoded for both interfaces
+      oc_rep_fragment_encode(request->resource, OC_IF_R,
+                             CORE_FRAGMENT_FINGERPRINT,
+                             core_device_encode_properties, &encode_piid);
+    } else {
+      core_device_encode_properties(request->resource, &encode_piid);
     }
-    oc_rep_set_text_string(root, n, oc_string(g_oc_device_info[device].name));
-    oc_rep_set_text_string(root, icv, oc_string(g_oc_device_info[device].icv));
-    oc_rep_set_text_string(root, dmv, oc_string(g_oc_device_info[device].dmv));
     if (g_oc_device_info[device].add_device_cb) {
       g_oc_device_info[device].add_device_cb(g_oc_device_info[device].data);
     }
@@ -284,6 +306,7 @@ oc_core_con_handler_post(oc_request_t *request, oc_interface_mask_t iface_mask,
       oc_new_string(&g_oc_device_info[device].name,
                     oc_string(rep->value.string),
                     oc_string_len(rep->value.string));
+      oc_core_device_info_changed(device);
       oc_rep_start_root_object();
       oc_rep_set_text_string(root, n, oc_string(g_oc_device_info[device].name));
       oc_rep_end_root_object();
@@ -515,6 +538,17 @@ oc_device_bind_resource_type(size_t device, const char *type)
   oc_device_bind_rt(device, type);
 }
 
+static void
+core_platform_encode_properties(const oc_resource_t *resource, void *data)
+{
+  (void)resource;
+  (void)data;
+  char pi[OC_UUID_LEN];
+  oc_uuid_to_str(&g_oc_platform_info.pi, pi, OC_UUID_LEN);
+  oc_rep_set_text_string(root, pi, pi);
+  oc_rep_set_text_string(root, mnmn, oc_string(g_oc_platform_info.mfg_name));
+}
+
 static void
 oc_core_platform_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
                          void *data)
@@ -522,16 +556,14 @@ oc_core_platform_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
   (void)data;
   oc_rep_start_root_object();
 
-  char pi[OC_UUID_LEN];
-  oc_uuid_to_str(&g_oc_platform_info.pi, pi, OC_UUID_LEN);
-
   switch (iface_mask) {
   case OC_IF_BASELINE:
     oc_process_baseline_interface(request->resource);
   /* fall through */
   case OC_IF_R: {
-    oc_rep_set_text_string(root, pi, pi);
-    oc_rep_set_text_string(root, mnmn, oc_string(g_oc_platform_info.mfg_name));
+    oc_rep_fragment_encode(request->resource, OC_IF_R,
+                           CORE_FRAGMENT_FINGERPRINT,
+                           core_platform_encode_properties, NULL);
     if (g_oc_platform_info.init_platform_cb) {
       g_oc_platform_info.init_platform_cb(g_oc_platform_info.data);
     }
@@ -674,6 +706,24 @@ oc_core_get_platform_info(void)
   return &g_oc_platform_info;
 }
 
+void
+oc_core_device_info_changed(size_t device)
+{
+  const oc_resource_t *r = oc_core_get_resource_by_index(OCF_D, device);
+  if (r != NULL) {
+    oc_rep_fragment_invalidate(r);
+  }
+}
+
+void
+oc_core_platform_info_changed(void)
+{
+  const oc_resource_t *r = oc_core_get_resource_by_index(OCF_P, 0);
+  if (r != NULL) {
+    oc_rep_fragment_invalidate(r);
+  }
+}
+
 #ifdef OC_SECURITY
 bool
 oc_core_is_SVR(const oc_resource_t *resource, size_t device)
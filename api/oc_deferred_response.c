@@ -0,0 +1,693 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "oc_config.h"
+
+#ifdef OC_SERVER
+
+#include "api/oc_deferred_response_internal.h"
+#include "api/oc_server_api_internal.h"
+#include "messaging/coap/oc_coap.h"
+#include "messaging/coap/transactions.h"
+#include "oc_api.h"
+#include "oc_buffer.h"
+#include "oc_signal_event_loop.h"
+#include "port/oc_connectivity.h"
+#include "port/oc_log_internal.h"
+#include "port/oc_network_event_handler_internal.h"
+#include "util/oc_hash.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#include <stdlib.h>
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+#ifdef OC_BLOCK_WISE
+#define OC_DEFERRED_RESPONSE_MAX_PAYLOAD_SIZE (OC_MAX_APP_DATA_SIZE)
+#else /* !OC_BLOCK_WISE */
+#define OC_DEFERRED_RESPONSE_MAX_PAYLOAD_SIZE (OC_BLOCK_SIZE)
+#endif /* OC_BLOCK_WISE */
+
+struct oc_deferred_response_t
+{
+  struct oc_deferred_response_t *next;
+  struct oc_deferred_response_t *id_next;    ///< next in the bucket of the
+                                             ///< index by handle
+  struct oc_deferred_response_t *index_next; ///< next in the bucket of the
+                                             ///< index by endpoint and mid
+  oc_deferred_response_handle_t id; ///< handle held by the application
+  bool indexed;
+  oc_endpoint_t endpoint;
+  oc_string_t uri;
+  oc_method_t method;
+  coap_message_type_t type;
+  uint16_t mid;
+  uint8_t token_len;
+  uint8_t token[COAP_TOKEN_LEN];
+  uint16_t block2_size;
+  int32_t observe; ///< value of the Observe option, -1 if not set
+  bool accepted;   ///< bound to the request after the handler returned
+  bool acked;      ///< the request doesn't need or already got an ACK
+  bool completed;  ///< completed by the application
+  bool dropped;    ///< the result is not needed anymore
+  oc_deferred_response_cb_t cb; ///< consumer of the response, if not NULL the
+                                ///< response is not sent to the client
+  void *cb_data;
+  int code;
+  oc_content_format_t content_format;
+  size_t payload_size;
+  uint8_t *payload; ///< allocated when the response is completed
+};
+
+#ifndef OC_DYNAMIC_ALLOCATION
+typedef struct oc_deferred_response_payload_t
+{
+  uint8_t data[OC_DEFERRED_RESPONSE_MAX_PAYLOAD_SIZE];
+} oc_deferred_response_payload_t;
+#endif /* !OC_DYNAMIC_ALLOCATION */
+
+/* Handles are allocated and removed only by the main loop, the list and the
+ * state of the handles is guarded by the network event handler mutex because
+ * the handles are completed from any thread. */
+OC_LIST(g_deferred_responses);
+OC_MEMB(g_deferred_responses_s, oc_deferred_response_t,
+        OC_MAX_NUM_DEFERRED_RESPONSES);
+#ifndef OC_DYNAMIC_ALLOCATION
+/* Payloads are copied by the thread completing the response, the pool is
+ * guarded by the network event handler mutex. */
+OC_MEMB(g_deferred_response_payloads_s, oc_deferred_response_payload_t,
+        OC_MAX_NUM_DEFERRED_RESPONSE_PAYLOADS);
+#endif /* !OC_DYNAMIC_ALLOCATION */
+static oc_response_buffer_t *g_deferrable_response_buffer = NULL;
+/* Deferred responses by the handle held by the application and Confirmable
+ * requests with a deferred response by endpoint and message ID, guarded by the
+ * network event handler mutex too. */
+static oc_deferred_response_handle_t g_deferred_response_last_id = 0;
+static oc_deferred_response_t
+  *g_deferred_responses_by_id[OC_DEFERRED_RESPONSE_INDEX_SIZE];
+static oc_deferred_response_t
+  *g_deferred_responses_by_mid[OC_DEFERRED_RESPONSE_INDEX_SIZE];
+
+OC_PROCESS(oc_deferred_response_process, "Deferred response process");
+
+/* hashes the message ID and the fields compared by oc_endpoint_compare */
+static size_t
+deferred_response_hash(const oc_endpoint_t *endpoint, uint16_t mid)
+{
+  uint32_t hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, &mid, sizeof(mid));
+  hash = oc_hash_fnv1a(hash, &endpoint->device, sizeof(endpoint->device));
+  if ((endpoint->flags & IPV6) != 0) {
+    hash = oc_hash_fnv1a(hash, endpoint->addr.ipv6.address,
+                         sizeof(endpoint->addr.ipv6.address));
+    hash = oc_hash_fnv1a(hash, &endpoint->addr.ipv6.port,
+                         sizeof(endpoint->addr.ipv6.port));
+  }
+#ifdef OC_IPV4
+  else if ((endpoint->flags & IPV4) != 0) {
+    hash = oc_hash_fnv1a(hash, endpoint->addr.ipv4.address,
+                         sizeof(endpoint->addr.ipv4.address));
+    hash = oc_hash_fnv1a(hash, &endpoint->addr.ipv4.port,
+                         sizeof(endpoint->addr.ipv4.port));
+  }
+#endif /* OC_IPV4 */
+  return hash & (OC_DEFERRED_RESPONSE_INDEX_SIZE - 1);
+}
+
+/* must be called with the network event handler mutex locked */
+static void
+deferred_response_index_add(oc_deferred_response_t *handle)
+{
+  size_t b = deferred_response_hash(&handle->endpoint, handle->mid);
+  handle->index_next = g_deferred_responses_by_mid[b];
+  g_deferred_responses_by_mid[b] = handle;
+  handle->indexed = true;
+}
+
+/* must be called with the network event handler mutex locked */
+static void
+deferred_response_index_remove(oc_deferred_response_t *handle)
+{
+  if (!handle->indexed) {
+    return;
+  }
+  oc_deferred_response_t **h =
+    &g_deferred_responses_by_mid[deferred_response_hash(&handle->endpoint,
+                                                        handle->mid)];
+  for (; *h != NULL; h = &(*h)->index_next) {
+    if (*h == handle) {
+      *h = handle->index_next;
+      break;
+    }
+  }
+  handle->index_next = NULL;
+  handle->indexed = false;
+}
+
+/* must be called with the network event handler mutex locked */
+static oc_deferred_response_t *
+deferred_response_find(oc_deferred_response_handle_t id)
+{
+  oc_deferred_response_t *handle =
+    g_deferred_responses_by_id[id & (OC_DEFERRED_RESPONSE_INDEX_SIZE - 1)];
+  while (handle != NULL && handle->id != id) {
+    handle = handle->id_next;
+  }
+  return handle;
+}
+
+/* must be called with the network event handler mutex locked */
+static void
+deferred_response_id_add(oc_deferred_response_t *handle)
+{
+  // a stale handle of the application must never match another response, skip
+  // 0 and the handles still in use once the counter wraps around
+  do {
+    ++g_deferred_response_last_id;
+  } while (g_deferred_response_last_id == 0 ||
+           deferred_response_find(g_deferred_response_last_id) != NULL);
+  handle->id = g_deferred_response_last_id;
+  size_t b = handle->id & (OC_DEFERRED_RESPONSE_INDEX_SIZE - 1);
+  handle->id_next = g_deferred_responses_by_id[b];
+  g_deferred_responses_by_id[b] = handle;
+}
+
+/* must be called with the network event handler mutex locked */
+static void
+deferred_response_id_remove(const oc_deferred_response_t *handle)
+{
+  oc_deferred_response_t **h =
+    &g_deferred_responses_by_id[handle->id &
+                                (OC_DEFERRED_RESPONSE_INDEX_SIZE - 1)];
+  for (; *h != NULL; h = &(*h)->id_next) {
+    if (*h == handle) {
+      *h = handle->id_next;
+      return;
+    }
+  }
+}
+
+static oc_event_callback_retval_t
+deferred_response_expire(void *data)
+{
+  oc_deferred_response_t *handle = (oc_deferred_response_t *)data;
+  oc_network_event_handler_mutex_lock();
+  if (handle->completed) {
+    oc_network_event_handler_mutex_unlock();
+    return OC_EVENT_DONE;
+  }
+  OC_WRN("deferred response not completed in time: mid=%u", handle->mid);
+  handle->code = oc_status_code(OC_STATUS_SERVICE_UNAVAILABLE);
+  handle->payload_size = 0;
+  handle->completed = true;
+  if (!handle->accepted) {
+    // there is nobody to respond to
+    handle->dropped = true;
+    handle->accepted = true;
+  }
+  oc_network_event_handler_mutex_unlock();
+  oc_process_poll(&oc_deferred_response_process);
+  return OC_EVENT_DONE;
+}
+
+static void
+deferred_response_free(oc_deferred_response_t *handle)
+{
+  oc_ri_remove_timed_event_callback(handle, deferred_response_expire);
+  oc_free_string(&handle->uri);
+#ifdef OC_DYNAMIC_ALLOCATION
+  free(handle->payload);
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  if (handle->payload != NULL) {
+    oc_network_event_handler_mutex_lock();
+    oc_memb_free(&g_deferred_response_payloads_s, handle->payload);
+    oc_network_event_handler_mutex_unlock();
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_memb_free(&g_deferred_responses_s, handle);
+}
+
+static void
+deferred_response_send_empty_ack(const oc_deferred_response_t *handle)
+{
+  OC_DBG("sending ACK for deferred response: mid=%u", handle->mid);
+  coap_packet_t ack[1];
+  coap_udp_init_message(ack, COAP_TYPE_ACK, 0, handle->mid);
+  oc_message_t *message = oc_internal_allocate_outgoing_message();
+  if (message == NULL) {
+    OC_ERR("cannot allocate ACK for deferred response");
+    return;
+  }
+  memcpy(&message->endpoint, &handle->endpoint, sizeof(oc_endpoint_t));
+  message->length = coap_serialize_message(ack, message->data);
+  if (message->length > 0) {
+    coap_send_message(message);
+  }
+  if (message->ref_count == 0) {
+    oc_message_unref(message);
+  }
+}
+
+static oc_event_callback_retval_t
+deferred_response_send_ack(void *data)
+{
+  oc_deferred_response_t *handle = (oc_deferred_response_t *)data;
+  deferred_response_send_empty_ack(handle);
+  oc_network_event_handler_mutex_lock();
+  handle->acked = true;
+  oc_network_event_handler_mutex_unlock();
+  return OC_EVENT_DONE;
+}
+
+static void
+deferred_response_init_message(coap_packet_t *response,
+                               const oc_deferred_response_t *handle)
+{
+  assert(handle->code <= UINT8_MAX);
+#ifdef OC_TCP
+  if ((handle->endpoint.flags & TCP) != 0) {
+    coap_tcp_init_message(response, (uint8_t)handle->code);
+    return;
+  }
+#endif /* OC_TCP */
+  if (!handle->acked) {
+    // piggybacked on the ACK of the request
+    coap_udp_init_message(response, COAP_TYPE_ACK, (uint8_t)handle->code,
+                          handle->mid);
+    return;
+  }
+  // separate response, a Confirmable request gets a Confirmable response
+  coap_udp_init_message(response, handle->type, (uint8_t)handle->code,
+                        coap_get_mid());
+}
+
+static void
+deferred_response_send(oc_deferred_response_t *handle)
+{
+  coap_packet_t response;
+  deferred_response_init_message(&response, handle);
+  coap_transaction_t *t =
+    coap_new_transaction(response.mid, handle->token, handle->token_len,
+                         &handle->endpoint);
+  if (t == NULL) {
+    OC_ERR("cannot allocate transaction for deferred response");
+    return;
+  }
+  if (handle->token_len > 0) {
+    coap_set_token(&response, handle->token, handle->token_len);
+  }
+  if (handle->observe >= 0) {
+    coap_set_header_observe(&response, (uint32_t)handle->observe);
+  }
+  if (handle->payload_size > 0) {
+    coap_set_header_content_format(&response, handle->content_format);
+  }
+  if (!oc_server_set_response_payload(
+        &response, &handle->endpoint, oc_string(handle->uri),
+        oc_string_len(handle->uri), handle->method, handle->block2_size,
+        handle->payload, handle->payload_size)) {
+    coap_clear_transaction(t);
+    return;
+  }
+  t->message->length = coap_serialize_message(&response, t->message->data);
+  if (t->message->length == 0) {
+    coap_clear_transaction(t);
+    return;
+  }
+  coap_send_transaction(t);
+}
+
+static void
+deferred_response_process_completed(void)
+{
+  // take out all responses ready to be sent and send them without the lock
+  oc_deferred_response_t *ready = NULL;
+  oc_network_event_handler_mutex_lock();
+  oc_deferred_response_t *handle =
+    (oc_deferred_response_t *)oc_list_head(g_deferred_responses);
+  while (handle != NULL) {
+    oc_deferred_response_t *next = handle->next;
+    if (handle->accepted && handle->completed) {
+      oc_list_remove(g_deferred_responses, handle);
+      deferred_response_id_remove(handle);
+      deferred_response_index_remove(handle);
+      handle->next = ready;
+      ready = handle;
+    }
+    handle = next;
+  }
+  oc_network_event_handler_mutex_unlock();
+
+  while (ready != NULL) {
+    handle = ready;
+    ready = handle->next;
+    if (handle->dropped) {
+      deferred_response_free(handle);
+      continue;
+    }
+    if (handle->cb != NULL) {
+      handle->cb(handle->cb_data, handle->code, handle->content_format,
+                 handle->payload_size > 0 ? handle->payload : NULL,
+                 handle->payload_size);
+      deferred_response_free(handle);
+      continue;
+    }
+    if (!handle->acked) {
+      oc_ri_remove_timed_event_callback(handle, deferred_response_send_ack);
+    }
+    deferred_response_send(handle);
+    deferred_response_free(handle);
+  }
+}
+
+OC_PROCESS_THREAD(oc_deferred_response_process, ev, data)
+{
+  (void)ev;
+  (void)data;
+  OC_PROCESS_POLLHANDLER(deferred_response_process_completed());
+  OC_PROCESS_BEGIN();
+  while (oc_process_is_running(&oc_deferred_response_process)) {
+    OC_PROCESS_YIELD();
+  }
+  OC_PROCESS_END();
+}
+
+oc_response_buffer_t *
+oc_deferred_response_enable(oc_response_buffer_t *response_buffer)
+{
+  oc_response_buffer_t *prev = g_deferrable_response_buffer;
+  g_deferrable_response_buffer = response_buffer;
+  return prev;
+}
+
+bool
+oc_deferred_response_is_enabled(const oc_response_buffer_t *response_buffer)
+{
+  return response_buffer != NULL &&
+         response_buffer == g_deferrable_response_buffer;
+}
+
+oc_deferred_response_handle_t
+oc_defer_response(oc_request_t *request)
+{
+  if (request == NULL || request->response == NULL) {
+    return 0;
+  }
+  oc_response_buffer_t *response_buffer = request->response->response_buffer;
+  if (response_buffer == NULL ||
+      response_buffer != g_deferrable_response_buffer) {
+    OC_ERR("response cannot be deferred outside of a request handler");
+    return 0;
+  }
+  if (response_buffer->deferred != NULL) {
+    return response_buffer->deferred->id;
+  }
+  oc_deferred_response_t *handle =
+    (oc_deferred_response_t *)oc_memb_alloc(&g_deferred_responses_s);
+  if (handle == NULL) {
+    OC_WRN("insufficient memory to defer response");
+    return 0;
+  }
+  handle->observe = -1;
+  oc_network_event_handler_mutex_lock();
+  oc_list_add(g_deferred_responses, handle);
+  deferred_response_id_add(handle);
+  oc_network_event_handler_mutex_unlock();
+  oc_ri_add_timed_event_callback_ticks(handle, deferred_response_expire,
+                                       OC_DEFERRED_RESPONSE_TIMEOUT);
+
+  response_buffer->deferred = handle;
+  // the request is handled successfully, which allows to register an observer
+  response_buffer->response_length = 0;
+  response_buffer->code = oc_status_code(OC_STATUS_OK);
+  return handle->id;
+}
+
+bool
+oc_deferred_response_set_timeout_ms(oc_deferred_response_handle_t handle,
+                                    uint64_t timeout_ms)
+{
+  // responses are freed only by the main loop, which calls this function too
+  oc_network_event_handler_mutex_lock();
+  oc_deferred_response_t *dr = deferred_response_find(handle);
+  bool pending = dr != NULL && !dr->completed;
+  oc_network_event_handler_mutex_unlock();
+  if (!pending) {
+    OC_ERR("cannot set timeout: deferred response is already completed");
+    return false;
+  }
+  oc_ri_remove_timed_event_callback(dr, deferred_response_expire);
+  oc_clock_time_t ticks = timeout_ms * OC_CLOCK_SECOND / 1000;
+  oc_ri_add_timed_event_callback_ticks(dr, deferred_response_expire, ticks);
+  return true;
+}
+
+#ifdef OC_BLOCK_WISE
+void
+oc_deferred_response_accept(oc_deferred_response_t *handle,
+                            coap_packet_t *request, coap_packet_t *response,
+                            const oc_endpoint_t *endpoint, uint16_t block2_size)
+#else  /* !OC_BLOCK_WISE */
+void
+oc_deferred_response_accept(oc_deferred_response_t *handle,
+                            coap_packet_t *request, coap_packet_t *response,
+                            const oc_endpoint_t *endpoint)
+#endif /* OC_BLOCK_WISE */
+{
+  assert(handle != NULL);
+  assert(request != NULL);
+  assert(response != NULL);
+  assert(endpoint != NULL);
+
+  memcpy(&handle->endpoint, endpoint, sizeof(oc_endpoint_t));
+  const char *uri = NULL;
+  size_t uri_len = coap_get_header_uri_path(request, &uri);
+  oc_new_string(&handle->uri, uri, uri_len);
+  handle->method = request->code;
+  handle->type = request->type;
+  handle->mid = request->mid;
+  handle->token_len = request->token_len;
+  memcpy(handle->token, request->token, request->token_len);
+#ifdef OC_BLOCK_WISE
+  handle->block2_size = block2_size;
+#else  /* !OC_BLOCK_WISE */
+  handle->block2_size = 0;
+#endif /* OC_BLOCK_WISE */
+  uint32_t observe = 0;
+  if (coap_get_header_observe(response, &observe) == 1) {
+    handle->observe = (int32_t)observe;
+  }
+#ifdef OC_TCP
+  bool acked = (endpoint->flags & TCP) != 0 || request->type != COAP_TYPE_CON;
+#else  /* !OC_TCP */
+  bool acked = request->type != COAP_TYPE_CON;
+#endif /* OC_TCP */
+
+  oc_network_event_handler_mutex_lock();
+  handle->acked = acked;
+  handle->accepted = true;
+  if (handle->type == COAP_TYPE_CON) {
+    deferred_response_index_add(handle);
+  }
+  bool completed = handle->completed;
+  oc_network_event_handler_mutex_unlock();
+
+  if (completed) {
+    // completed already by the request handler
+    oc_process_poll(&oc_deferred_response_process);
+    return;
+  }
+  if (!acked) {
+    oc_ri_add_timed_event_callback_ticks(handle, deferred_response_send_ack,
+                                         OC_DEFERRED_RESPONSE_ACK_DELAY);
+  }
+}
+
+void
+oc_deferred_response_bind(oc_deferred_response_t *handle,
+                          oc_deferred_response_cb_t cb, void *data)
+{
+  assert(handle != NULL);
+  assert(cb != NULL);
+  oc_network_event_handler_mutex_lock();
+  handle->cb = cb;
+  handle->cb_data = data;
+  handle->acked = true;
+  handle->accepted = true;
+  bool completed = handle->completed;
+  oc_network_event_handler_mutex_unlock();
+
+  if (completed) {
+    oc_process_poll(&oc_deferred_response_process);
+  }
+}
+
+void
+oc_deferred_response_drop(oc_deferred_response_t *handle)
+{
+  assert(handle != NULL);
+  oc_network_event_handler_mutex_lock();
+  handle->dropped = true;
+  handle->acked = true;
+  handle->accepted = true;
+  bool completed = handle->completed;
+  oc_network_event_handler_mutex_unlock();
+
+  if (completed) {
+    oc_process_poll(&oc_deferred_response_process);
+  }
+}
+
+bool
+oc_complete_deferred_response(oc_deferred_response_handle_t handle,
+                              oc_status_t response_code,
+                              oc_content_format_t content_format,
+                              const uint8_t *payload, size_t payload_size)
+{
+  int code = oc_status_code(response_code);
+  bool success = true;
+  if (payload_size > (size_t)OC_DEFERRED_RESPONSE_MAX_PAYLOAD_SIZE) {
+    OC_ERR("deferred response payload too large (%zu)", payload_size);
+    success = false;
+  }
+#ifdef OC_DYNAMIC_ALLOCATION
+  uint8_t *payload_copy = NULL;
+  if (success && payload_size > 0) {
+    payload_copy = (uint8_t *)malloc(payload_size);
+    if (payload_copy == NULL) {
+      OC_ERR("cannot allocate deferred response payload");
+      success = false;
+    } else {
+      memcpy(payload_copy, payload, payload_size);
+    }
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+  oc_network_event_handler_mutex_lock();
+  oc_deferred_response_t *dr = deferred_response_find(handle);
+  if (dr == NULL || dr->completed) {
+    oc_network_event_handler_mutex_unlock();
+    OC_ERR("deferred response is already completed");
+#ifdef OC_DYNAMIC_ALLOCATION
+    free(payload_copy);
+#endif /* OC_DYNAMIC_ALLOCATION */
+    return false;
+  }
+#ifndef OC_DYNAMIC_ALLOCATION
+  uint8_t *payload_copy = NULL;
+  if (success && payload_size > 0) {
+    payload_copy = (uint8_t *)oc_memb_alloc(&g_deferred_response_payloads_s);
+    if (payload_copy == NULL) {
+      OC_ERR("no free buffer for deferred response payload");
+      success = false;
+    } else {
+      memcpy(payload_copy, payload, payload_size);
+    }
+  }
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  if (!success || code < 0) {
+    code = oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+    payload_size = 0;
+  }
+  dr->code = code;
+  dr->content_format = content_format;
+  dr->payload_size = payload_size;
+  dr->payload = payload_copy;
+  dr->completed = true;
+  bool accepted = dr->accepted;
+  oc_network_event_handler_mutex_unlock();
+
+  if (accepted) {
+    oc_process_poll(&oc_deferred_response_process);
+    _oc_signal_event_loop();
+  }
+  return success;
+}
+
+bool
+oc_deferred_response_is_duplicate(const coap_packet_t *request,
+                                  const oc_endpoint_t *endpoint)
+{
+  if (request->type != COAP_TYPE_CON) {
+    return false;
+  }
+  oc_deferred_response_t *found = NULL;
+  bool acked = false;
+  oc_network_event_handler_mutex_lock();
+  oc_deferred_response_t *handle =
+    g_deferred_responses_by_mid[deferred_response_hash(endpoint, request->mid)];
+  for (; handle != NULL; handle = handle->index_next) {
+    if (handle->cb == NULL && !handle->dropped &&
+        handle->mid == request->mid &&
+        oc_endpoint_compare(&handle->endpoint, endpoint) == 0) {
+      found = handle;
+      acked = handle->acked;
+      handle->acked = true;
+      break;
+    }
+  }
+  oc_network_event_handler_mutex_unlock();
+  if (found == NULL) {
+    return false;
+  }
+  OC_DBG("retransmitted request with deferred response: mid=%u", request->mid);
+  // the client didn't receive the ACK, the response follows separately
+  if (!acked) {
+    oc_ri_remove_timed_event_callback(found, deferred_response_send_ack);
+  }
+  deferred_response_send_empty_ack(found);
+  return true;
+}
+
+size_t
+oc_deferred_response_count(void)
+{
+  oc_network_event_handler_mutex_lock();
+  size_t count = (size_t)oc_list_length(g_deferred_responses);
+  oc_network_event_handler_mutex_unlock();
+  return count;
+}
+
+void
+oc_deferred_response_free_all(void)
+{
+  // take out all responses and free them without the lock
+  oc_network_event_handler_mutex_lock();
+  oc_deferred_response_t *handle =
+    (oc_deferred_response_t *)oc_list_head(g_deferred_responses);
+  oc_list_init(g_deferred_responses);
+  memset(g_deferred_responses_by_id, 0, sizeof(g_deferred_responses_by_id));
+  memset(g_deferred_responses_by_mid, 0, sizeof(g_deferred_responses_by_mid));
+  oc_network_event_handler_mutex_unlock();
+  while (handle != NULL) {
+    oc_deferred_response_t *next = handle->next;
+    if (handle->accepted && !handle->acked) {
+      oc_ri_remove_timed_event_callback(handle, deferred_response_send_ack);
+    }
+    deferred_response_free(handle);
+    handle = next;
+  }
+  g_deferrable_response_buffer = NULL;
+}
+
+#else  /* !OC_SERVER */
+typedef int dummy_declaration;
+#endif /* OC_SERVER */
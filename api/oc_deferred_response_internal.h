@@ -0,0 +1,176 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_DEFERRED_RESPONSE_INTERNAL_H
+#define OC_DEFERRED_RESPONSE_INTERNAL_H
+
+#ifdef OC_SERVER
+
+#include "messaging/coap/coap.h"
+#include "oc_clock.h"
+#include "oc_endpoint.h"
+#include "oc_ri.h"
+#include "util/oc_process.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximal number of outstanding deferred responses in static builds, dynamic
+ * builds are limited only by available memory. */
+#ifndef OC_MAX_NUM_DEFERRED_RESPONSES
+#define OC_MAX_NUM_DEFERRED_RESPONSES (OC_MAX_NUM_CONCURRENT_REQUESTS)
+#endif /* OC_MAX_NUM_DEFERRED_RESPONSES */
+
+/* Number of payload buffers of completed deferred responses in static builds.
+ * A buffer is held from the completion until the main loop sends the response,
+ * a completion that finds no free buffer is answered with
+ * OC_STATUS_INTERNAL_SERVER_ERROR. */
+#ifndef OC_MAX_NUM_DEFERRED_RESPONSE_PAYLOADS
+#define OC_MAX_NUM_DEFERRED_RESPONSE_PAYLOADS (1)
+#endif /* OC_MAX_NUM_DEFERRED_RESPONSE_PAYLOADS */
+
+/* How long a Confirmable request waits for its deferred response to be
+ * piggybacked on the ACK. If the response is not completed in time, an empty
+ * ACK is sent and the response follows as a separate message. Must be shorter
+ * than the ACK timeout of the client. */
+#ifndef OC_DEFERRED_RESPONSE_ACK_DELAY
+#define OC_DEFERRED_RESPONSE_ACK_DELAY (OC_CLOCK_SECOND / 2)
+#endif /* OC_DEFERRED_RESPONSE_ACK_DELAY */
+
+/* How long a deferred response waits to be completed. A response that is not
+ * completed in time is completed with OC_STATUS_SERVICE_UNAVAILABLE and its
+ * handle is freed. */
+#ifndef OC_DEFERRED_RESPONSE_TIMEOUT
+#define OC_DEFERRED_RESPONSE_TIMEOUT (60 * OC_CLOCK_SECOND)
+#endif /* OC_DEFERRED_RESPONSE_TIMEOUT */
+
+/* Number of buckets of the indexes of deferred responses by handle and by
+ * endpoint and message ID, must be a power of 2. */
+#ifndef OC_DEFERRED_RESPONSE_INDEX_SIZE
+#define OC_DEFERRED_RESPONSE_INDEX_SIZE (16)
+#endif /* OC_DEFERRED_RESPONSE_INDEX_SIZE */
+
+OC_PROCESS_NAME(oc_deferred_response_process);
+
+/**
+ * @brief Callback consuming a completed deferred response instead of sending
+ * it to the client, invoked from the main loop.
+ *
+ * @param data user data passed to oc_deferred_response_bind
+ * @param code CoAP code of the response
+ * @param content_format content format of the payload
+ * @param payload the payload (NULL if payload_size is 0)
+ * @param payload_size size of the payload
+ */
+typedef void (*oc_deferred_response_cb_t)(void *data, int code,
+                                          oc_content_format_t content_format,
+                                          const uint8_t *payload,
+                                          size_t payload_size);
+
+/**
+ * @brief Allow the request handler writing into the response buffer to defer
+ * its response.
+ *
+ * @param response_buffer response buffer of the request being handled (NULL
+ * to disallow deferring)
+ * @return the response buffer that was allowed to defer before
+ */
+oc_response_buffer_t *oc_deferred_response_enable(
+  oc_response_buffer_t *response_buffer);
+
+/** @brief Check if the request handler writing into the response buffer can
+ * defer its response */
+bool oc_deferred_response_is_enabled(
+  const oc_response_buffer_t *response_buffer);
+
+/**
+ * @brief Bind the deferred response to a consumer in the stack (e.g. a batch
+ * response) instead of a request from the network.
+ *
+ * @param handle the deferred response (cannot be NULL)
+ * @param cb callback invoked once the response is completed (cannot be NULL)
+ * @param data user data passed to the callback
+ */
+void oc_deferred_response_bind(oc_deferred_response_t *handle,
+                               oc_deferred_response_cb_t cb, void *data);
+
+/**
+ * @brief Drop the result of a deferred response that is not bound to a
+ * request, a bound callback is not invoked. The handle stays valid for the
+ * application and is freed once it is completed.
+ *
+ * @param handle the deferred response (cannot be NULL)
+ */
+void oc_deferred_response_drop(oc_deferred_response_t *handle);
+
+#ifdef OC_BLOCK_WISE
+/**
+ * @brief Bind the deferred response to the request after the request handler
+ * returned, the response is then sent once it is completed.
+ *
+ * @param handle the deferred response (cannot be NULL)
+ * @param request the request (cannot be NULL)
+ * @param response the response prepared by the engine, its Observe option is
+ * copied to the deferred response (cannot be NULL)
+ * @param endpoint endpoint of the client (cannot be NULL)
+ * @param block2_size preferred block size of the client
+ */
+void oc_deferred_response_accept(oc_deferred_response_t *handle,
+                                 coap_packet_t *request,
+                                 coap_packet_t *response,
+                                 const oc_endpoint_t *endpoint,
+                                 uint16_t block2_size);
+#else  /* !OC_BLOCK_WISE */
+void oc_deferred_response_accept(oc_deferred_response_t *handle,
+                                 coap_packet_t *request,
+                                 coap_packet_t *response,
+                                 const oc_endpoint_t *endpoint);
+#endif /* OC_BLOCK_WISE */
+
+/**
+ * @brief Check if the Confirmable request is a retransmission of a request
+ * with a deferred response. The retransmission is acknowledged with an empty
+ * ACK and must be dropped.
+ *
+ * @param request the request (cannot be NULL)
+ * @param endpoint endpoint of the client (cannot be NULL)
+ * @return true the request is a retransmission
+ */
+bool oc_deferred_response_is_duplicate(const coap_packet_t *request,
+                                       const oc_endpoint_t *endpoint);
+
+/** @brief Number of deferred responses that have not been sent yet */
+size_t oc_deferred_response_count(void);
+
+/**
+ * @brief Free all deferred responses, the handles held by the application
+ * become invalid.
+ */
+void oc_deferred_response_free_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_SERVER */
+
+#endif /* OC_DEFERRED_RESPONSE_INTERNAL_H */
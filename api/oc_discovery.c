@@ -16,6 +16,7 @@
  *
  ****************************************************************************/
 
+#include "api/oc_rep_encode_internal.h"
 #include "messaging/coap/oc_coap.h"
 #include "oc_api.h"
 #include "oc_core_res.h"
@@ -32,6 +33,7 @@
 #endif /* OC_CLIENT */
 
 #ifdef OC_RES_BATCH_SUPPORT
+#include "api/oc_batch_response_internal.h"
 #include "oc_server_api_internal.h"
 #ifdef OC_SECURITY
 #include "security/oc_acl_internal.h"
@@ -654,9 +656,13 @@ oc_core_1_1_discovery_handler(oc_request_t *request,
 
 #ifdef OC_RES_BATCH_SUPPORT
 static void
-process_batch_response(CborEncoder *links_array, oc_resource_t *resource,
-                       const oc_endpoint_t *endpoint)
+process_batch_response(CborEncoder *links_encoder, oc_resource_t *resource,
+                       const oc_endpoint_t *endpoint,
+                       oc_batch_dispatch_t *dispatch)
 {
+#ifndef OC_SERVER
+  (void)dispatch;
+#endif /* !OC_SERVER */
   if (resource == NULL || (resource->properties & OC_DISCOVERABLE) == 0) {
     return;
   }
@@ -672,7 +678,10 @@ process_batch_response(CborEncoder *links_array, oc_resource_t *resource,
 #ifdef OC_SECURITY
   if (oc_sec_check_acl(OC_GET, resource, endpoint)) {
 #endif /* OC_SECURITY */
-    oc_rep_start_object((links_array), links);
+    CborEncoder prev_links;
+    memcpy(&prev_links, links_encoder, sizeof(CborEncoder));
+    bool deferred = false;
+    oc_rep_start_object((links_encoder), links);
 
     char href[OC_MAX_OCF_URI_SIZE];
     memcpy(href, "ocf://", 6);
@@ -701,8 +710,17 @@ process_batch_response(CborEncoder *links_array, oc_resource_t *resource,
     } else
 #endif /* OC_SERVER && OC_COLLECTIONS */
     {
+#ifdef OC_SERVER
+      if (dispatch != NULL) {
+        oc_batch_dispatch_item_begin(dispatch, &response_buffer);
+      }
+#endif /* OC_SERVER */
       resource->get_handler.cb(&rest_request, resource->default_interface,
                                resource->get_handler.user_data);
+#ifdef OC_SERVER
+      deferred = dispatch != NULL &&
+                 oc_batch_dispatch_item_end(dispatch, &response_buffer, href);
+#endif /* OC_SERVER */
     }
 
     int size_after = oc_rep_get_encoded_payload_size();
@@ -711,61 +729,68 @@ process_batch_response(CborEncoder *links_array, oc_resource_t *resource,
       oc_rep_end_root_object();
     }
     memcpy(&links_map, oc_rep_get_encoder(), sizeof(CborEncoder));
-    oc_rep_end_object((links_array), links);
+    oc_rep_end_object((links_encoder), links);
+    if (deferred) {
+      // the item is added once its handler completes the response
+      memcpy(links_encoder, &prev_links, sizeof(CborEncoder));
+    }
 #ifdef OC_SECURITY
   }
 #endif /* OC_SECURITY */
 }
 
 void
-oc_discovery_create_batch_for_resource(CborEncoder *links_array,
+oc_discovery_create_batch_for_resource(CborEncoder *links_encoder,
                                        oc_resource_t *resource,
                                        const oc_endpoint_t *endpoint)
 {
-  process_batch_response(links_array, resource, endpoint);
+  process_batch_response(links_encoder, resource, endpoint, NULL);
 }
 
 static void
-process_batch_request(CborEncoder *links_array, const oc_endpoint_t *endpoint,
-                      size_t device_index)
+process_batch_request(CborEncoder *links_encoder, const oc_endpoint_t *endpoint,
+                      size_t device_index, oc_batch_dispatch_t *dispatch)
 {
-  process_batch_response(links_array, oc_core_get_resource_by_index(OCF_P, 0),
-                         endpoint);
+  process_batch_response(links_encoder, oc_core_get_resource_by_index(OCF_P, 0),
+                         endpoint, dispatch);
 #ifdef OC_HAS_FEATURE_PLGD_TIME
-  process_batch_response(links_array,
-                         oc_core_get_resource_by_index(PLGD_TIME, 0), endpoint);
+  process_batch_response(links_encoder,
+                         oc_core_get_resource_by_index(PLGD_TIME, 0), endpoint,
+                         dispatch);
 #endif /* OC_HAS_FEATURE_PLGD_TIME */
 
-  process_batch_response(
-    links_array, oc_core_get_resource_by_index(OCF_D, device_index), endpoint);
+  process_batch_response(links_encoder,
+                         oc_core_get_resource_by_index(OCF_D, device_index),
+                         endpoint, dispatch);
 
   process_batch_response(
-    links_array,
+    links_encoder,
     oc_core_get_resource_by_index(OCF_INTROSPECTION_WK, device_index),
-    endpoint);
+    endpoint, dispatch);
 
   if (oc_get_con_res_announced()) {
-    process_batch_response(links_array,
+    process_batch_response(links_encoder,
                            oc_core_get_resource_by_index(OCF_CON, device_index),
-                           endpoint);
+                           endpoint, dispatch);
   }
 
 #ifdef OC_MNT
-  process_batch_response(links_array,
+  process_batch_response(links_encoder,
                          oc_core_get_resource_by_index(OCF_MNT, device_index),
-                         endpoint);
+                         endpoint, dispatch);
 #endif /* OC_MNT */
 
 #ifdef OC_SOFTWARE_UPDATE
   process_batch_response(
-    links_array, oc_core_get_resource_by_index(OCF_SW_UPDATE, device_index),
-    endpoint);
+    links_encoder, oc_core_get_resource_by_index(OCF_SW_UPDATE, device_index),
+    endpoint, dispatch);
 #endif /* OC_SOFTWARE_UPDATE */
 
 #if defined(OC_CLIENT) && defined(OC_SERVER) && defined(OC_CLOUD)
   process_batch_response(
-    links_array, oc_core_get_resource_by_index(OCF_COAPCLOUDCONF, device_index),
-    endpoint);
+    links_encoder,
+    oc_core_get_resource_by_index(OCF_COAPCLOUDCONF, device_index), endpoint,
+    dispatch);
 #endif /* OC_CLIENT && OC_SERVER && OC_CLOUD */
 
 #ifdef OC_SERVER
@@ -773,7 +798,7 @@ process_batch_request(CborEncoder *links_array, const oc_endpoint_t *endpoint,
   for (; resource; resource = resource->next) {
     if (resource->device != device_index)
       continue;
-    process_batch_response(links_array, resource, endpoint);
+    process_batch_response(links_encoder, resource, endpoint, dispatch);
   }
 
 #if defined(OC_COLLECTIONS)
@@ -782,7 +807,7 @@ process_batch_request(CborEncoder *links_array, const oc_endpoint_t *endpoint,
     if (collection->device != device_index)
       continue;
 
-    process_batch_response(links_array, collection, endpoint);
+    process_batch_response(links_encoder, collection, endpoint, dispatch);
   }
 #endif /* OC_COLLECTIONS */
 #endif /* OC_SERVER */
@@ -845,12 +870,27 @@ oc_core_discovery_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
         && request->origin->flags & SECURED
 #endif /* OC_SECURITY */
     ) {
+      oc_batch_dispatch_t *dispatch = NULL;
+#ifdef OC_SERVER
+      // slow resources can defer their responses, the response is deferred
+      // until they complete
+      oc_batch_dispatch_t batch_dispatch;
+      oc_batch_dispatch_init(&batch_dispatch, request, false);
+      dispatch = &batch_dispatch;
+#endif /* OC_SERVER */
       CborEncoder encoder;
       oc_rep_start_links_array();
       memcpy(&encoder, oc_rep_get_encoder(), sizeof(CborEncoder));
-      process_batch_request(&links_array, request->origin, device);
+      process_batch_request(&links_array, request->origin, device, dispatch);
       memcpy(oc_rep_get_encoder(), &encoder, sizeof(CborEncoder));
       oc_rep_end_links_array();
+#ifdef OC_SERVER
+      if (oc_batch_dispatch_finish(dispatch, request, OC_GET,
+                                   oc_status_code(OC_STATUS_OK),
+                                   oc_status_code(OC_STATUS_OK))) {
+        return;
+      }
+#endif /* OC_SERVER */
       matches++;
     }
   } break;
@@ -881,7 +921,8 @@ oc_core_discovery_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
     break;
   }
   int response_length = oc_rep_get_encoded_payload_size();
-  request->response->response_buffer->content_format = APPLICATION_VND_OCF_CBOR;
+  request->response->response_buffer->content_format =
+    oc_rep_encoder_get_content_format();
   if (matches && response_length > 0) {
     request->response->response_buffer->response_length = response_length;
     request->response->response_buffer->code = oc_status_code(OC_STATUS_OK);
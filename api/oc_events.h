@@ -41,6 +41,9 @@ typedef enum {
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
   TCP_CONNECT_SESSION,
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+  TCP_SEND_QUEUE_DRAINED,
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
 #ifdef OC_OSCORE
   INBOUND_OSCORE_EVENT,
   OUTBOUND_OSCORE_EVENT,
@@ -64,6 +64,10 @@
 #include "util/oc_mem_trace.h"
 #endif /* OC_MEMORY_TRACE */
 
+#ifdef OC_STORAGE
+#include "api/oc_storage_internal.h"
+#endif /* OC_STORAGE */
+
 #ifdef OC_HAS_FEATURE_PUSH
 #include "api/oc_push_internal.h"
 #endif /* OC_HAS_FEATURE_PUSH */
@@ -403,6 +407,10 @@ oc_main_shutdown(void)
   oc_push_free();
 #endif /* OC_HAS_FEATURE_PUSH */
 
+#ifdef OC_STORAGE
+  oc_storage_flush_deferred_dumps();
+#endif /* OC_STORAGE */
+
   oc_ri_shutdown();
 
 #ifdef OC_SECURITY
@@ -35,6 +35,9 @@ OC_LIST(g_network_events);
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
 OC_LIST(g_network_tcp_connect_events);
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+static bool g_tcp_send_queue_drained;
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
 #ifdef OC_NETWORK_MONITOR
 static bool g_interface_up;
 static bool g_interface_down;
@@ -58,6 +61,12 @@ oc_process_network_event(void)
     oc_recv_message(message);
     message = (oc_message_t *)oc_list_pop(g_network_events);
   }
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+  if (g_tcp_send_queue_drained) {
+    oc_tcp_send_queue_drained();
+    g_tcp_send_queue_drained = false;
+  }
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
 #ifdef OC_NETWORK_MONITOR
   if (g_interface_up) {
     oc_process_post(&oc_network_events, oc_events[INTERFACE_UP], NULL);
@@ -133,6 +142,22 @@ oc_network_tcp_connect_event(oc_tcp_on_connect_event_t *event)
 }
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+void
+oc_network_tcp_send_queue_drained_event(void)
+{
+  if (!oc_process_is_running(&oc_network_events)) {
+    return;
+  }
+  oc_network_event_handler_mutex_lock();
+  g_tcp_send_queue_drained = true;
+  oc_network_event_handler_mutex_unlock();
+
+  oc_process_poll(&oc_network_events);
+  _oc_signal_event_loop();
+}
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 #ifdef OC_NETWORK_MONITOR
 void
 oc_network_interface_event(oc_interface_event_t event)
@@ -51,6 +51,14 @@ void oc_network_receive_event(oc_message_t *message);
 void oc_network_tcp_connect_event(oc_tcp_on_connect_event_t *event);
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+/**
+ * @brief network event notifying that messages refused by full send queues of
+ * TCP sessions can be sent again
+ */
+void oc_network_tcp_send_queue_drained_event(void);
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 #ifdef OC_NETWORK_MONITOR
 /**
  * Structure to manage network interface handler list.
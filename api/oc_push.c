@@ -35,10 +35,13 @@
 #include "oc_ri.h"
 #include "oc_signal_event_loop.h"
 #include "util/oc_compiler.h"
+#include "util/oc_hash.h"
 #include "util/oc_list.h"
+#include "util/oc_macros.h"
 #include "util/oc_mmem.h"
 #include "util/oc_process.h"
 #include <arpa/inet.h>
+#include <stdint.h>
 
 // TODO: add push component to logs and use standard logging functions
 #if defined(OC_PUSHDEBUG) || defined(OC_DEBUG)
@@ -80,6 +83,7 @@ typedef enum {
 typedef struct oc_ns
 {
   struct oc_ns *next;
+  struct oc_ns *index_next; ///< next selector in the same bucket of the index
   oc_resource_t
     *resource; ///< used to point ["oic.r.notificationselector",
                ///< "oic.r.pushproxy"] Resource managed by iotivity-lite
@@ -97,8 +101,42 @@ typedef struct oc_ns
   oc_string_array_t sourcert; ///< oic.r.pushproxy:sourcert
   oc_string_t state;          ///< oic.r.pushproxy:state
   void *user_data;            ///< used to point updated pushable Resource
+  /* match index (see _update_ns_index()) */
+  uint32_t phref_hash;          ///< hash of phref
+  size_t index_bucket;          ///< bucket of the selector in the index
+  uint32_t prt_filter;          ///< bloom filter of prt
+  oc_interface_mask_t pif_mask; ///< interfaces of pif
+  uint16_t batch_id; ///< id of the batch waiting for a response (0: none)
 } oc_ns_t;
 
+/**
+ * @brief update of pushable Resource waiting in the queue of push target
+ */
+typedef struct oc_push_entry
+{
+  struct oc_push_entry *next;
+  oc_ns_t *ns_instance;     ///< notification selector of the update
+  oc_string_t uri;          ///< path of updated pushable Resource
+  oc_clock_time_t enqueued; ///< time of the first coalesced update
+} oc_push_entry_t;
+
+/**
+ * @brief outbound queue and circuit breaker of push target
+ */
+typedef struct oc_push_target
+{
+  struct oc_push_target *next;
+  oc_endpoint_t endpoint; ///< endpoint of push target
+  oc_string_t path;       ///< path in push target
+  OC_LIST_STRUCT(queue);  ///< updates waiting to be pushed, oldest first
+  OC_LIST_STRUCT(sent);   ///< updates of the batch in flight
+  uint16_t batch_id;      ///< id of the batch in flight (0: none)
+  oc_clock_time_t sent_enqueued; ///< time of the oldest update in flight
+  uint8_t failures;              ///< number of consecutive failures
+  oc_clock_time_t retry_at;      ///< circuit is open until this time
+  oc_push_target_stats_t stats;  ///< delivery statistics
+} oc_push_target_t;
+
 /**
  * @brief structure for member of "oic.r.pushreceiver:receivers" object array
  */
@@ -134,6 +172,12 @@ OC_MEMB(g_ns_instance_memb, oc_ns_t, 1);
  */
 OC_LIST(g_ns_list);
 
+/**
+ * @brief index of Notification Selectors, selectors with "phref" are in the
+ * bucket of the hash of "phref", the other selectors are in the first bucket
+ */
+static oc_ns_t *g_ns_index[OC_PUSH_NS_INDEX_SIZE + 1];
+
 /**
  * @brief	memory block definition for storing new Receiver object array of Push
  * Receiver Resource
@@ -171,6 +215,44 @@ OC_MEMB(g_pushd_rsc_rep_instance_memb, oc_pushd_resource_rep_t, 1);
  */
 OC_LIST(g_pushd_rsc_rep_list);
 
+/**
+ * @brief interval during which updates of pushable Resources are coalesced
+ */
+static uint32_t g_push_coalescing_interval_ms = OC_PUSH_COALESCING_INTERVAL_MS;
+
+/**
+ * @brief send coalesced updates for the same push target as an array in one
+ * request
+ */
+static bool g_push_batching = false;
+
+/**
+ * @brief id of the last batch of pushes sent to a target
+ */
+static uint16_t g_push_batch_id = 0;
+
+static oc_event_callback_retval_t _push_target_flush_async(void *data);
+static void _push_dequeue_ns(const oc_ns_t *ns_instance);
+static void _push_target_free(oc_push_target_t *target);
+
+/**
+ * @brief	memory block definition for storing push targets
+ */
+OC_MEMB(g_push_target_memb, oc_push_target_t, OC_PUSH_MAX_TARGETS);
+
+/**
+ * @brief	memory block definition for storing queued updates
+ */
+OC_MEMB(g_push_entry_memb, oc_push_entry_t,
+        OC_PUSH_MAX_TARGETS *
+          (OC_PUSH_TARGET_QUEUE_SIZE + OC_PUSH_MAX_BATCH_SIZE));
+
+/**
+ * @brief	`g_push_target_list` keeps outbound queues of all push targets
+ */
+OC_LIST(g_push_target_list);
+static size_t g_push_target_count = 0;
+
 /**
  * @brief	process which handles push notification
  */
@@ -249,7 +331,7 @@ oc_set_on_push_arrived(oc_on_push_arrived_t func)
  * @return true:success, false:fail
  */
 static bool
-set_ns_properties(oc_resource_t *resource, oc_rep_t *rep, void *data)
+_set_ns_properties(oc_resource_t *resource, oc_rep_t *rep, void *data)
 {
   (void)resource;
   bool pushtarget_is_updated = false;
@@ -491,6 +573,88 @@ set_ns_properties(oc_resource_t *resource, oc_rep_t *rep, void *data)
   return true;
 }
 
+/**
+ * @brief bloom filter of resource types, arrays with a common item have
+ * a common bit set in their filters
+ */
+static uint32_t
+_rt_filter(const oc_string_array_t *types)
+{
+  uint32_t filter = 0;
+  for (size_t i = 0; i < oc_string_array_get_allocated_size(*types); i++) {
+    uint32_t hash =
+      oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, oc_string_array_get_item(*types, i),
+                    oc_string_array_get_item_size(*types, i));
+    filter |= (1U << (hash & 31)) | (1U << ((hash >> 5) & 31));
+  }
+  return filter;
+}
+
+static size_t
+_ns_index_bucket(uint32_t phref_hash)
+{
+  return 1 + (phref_hash & (OC_PUSH_NS_INDEX_SIZE - 1));
+}
+
+static void
+_ns_index_add(oc_ns_t *ns_instance)
+{
+  ns_instance->index_bucket = oc_string(ns_instance->phref)
+                                ? _ns_index_bucket(ns_instance->phref_hash)
+                                : 0;
+  ns_instance->index_next = g_ns_index[ns_instance->index_bucket];
+  g_ns_index[ns_instance->index_bucket] = ns_instance;
+}
+
+static void
+_ns_index_remove(oc_ns_t *ns_instance)
+{
+  for (oc_ns_t **it = &g_ns_index[ns_instance->index_bucket]; *it != NULL;
+       it = &(*it)->index_next) {
+    if (*it == ns_instance) {
+      *it = ns_instance->index_next;
+      break;
+    }
+  }
+  ns_instance->index_next = NULL;
+}
+
+/**
+ * @brief update the match index of `notification selector`, so that
+ * mismatching Resources are rejected without string comparisons
+ *
+ * @param ns_instance notification selector
+ */
+static void
+_update_ns_index(oc_ns_t *ns_instance)
+{
+  _ns_index_remove(ns_instance);
+  ns_instance->phref_hash =
+    oc_string(ns_instance->phref)
+      ? oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, oc_string(ns_instance->phref),
+                      oc_string_len(ns_instance->phref))
+      : 0;
+  ns_instance->prt_filter = _rt_filter(&ns_instance->prt);
+  ns_instance->pif_mask = 0;
+  for (size_t i = 0; i < oc_string_array_get_allocated_size(ns_instance->pif);
+       i++) {
+    const char *pif = oc_string_array_get_item(ns_instance->pif, i);
+    ns_instance->pif_mask |= oc_ri_get_interface_mask(pif, strlen(pif));
+  }
+  _ns_index_add(ns_instance);
+}
+
+static bool
+set_ns_properties(oc_resource_t *resource, oc_rep_t *rep, void *data)
+{
+  bool ok = _set_ns_properties(resource, rep, data);
+  /* properties may be partially updated even if the update failed */
+  _update_ns_index((oc_ns_t *)data);
+  /* queued updates may belong to the previous push target */
+  _push_dequeue_ns((oc_ns_t *)data);
+  return ok;
+}
+
 /**
  * @brief callback to be called to fill the contents of `notification
  * selector` from existing data structure (`oc_ns_t`)
@@ -741,6 +905,11 @@ get_ns_instance(const char *href, oc_string_array_t *types,
   oc_new_string(&ns_instance->state, pp_statestr(OC_PP_WFP),
                 strlen(pp_statestr(OC_PP_WFP)));
   ns_instance->user_data = NULL;
+  ns_instance->phref_hash = 0;
+  ns_instance->index_next = NULL;
+  ns_instance->prt_filter = 0;
+  ns_instance->pif_mask = 0;
+  ns_instance->batch_id = 0;
 
   OC_PUSH_DBG("state of Push Proxy (\"%s\") is initialized (%s)",
               oc_string(ns_instance->resource->uri), pp_statestr(OC_PP_WFP));
@@ -750,6 +919,7 @@ get_ns_instance(const char *href, oc_string_array_t *types,
    * which keeps all Notification Selectors of all Devices
    */
   oc_list_add(g_ns_list, ns_instance);
+  _ns_index_add(ns_instance);
   return ns_instance->resource;
 }
 
@@ -773,6 +943,8 @@ free_ns_instance(oc_resource_t *resource)
 
       /* remove oc_ns_t instance from list */
       oc_list_remove(g_ns_list, ns_instance);
+      _ns_index_remove(ns_instance);
+      _push_dequeue_ns(ns_instance);
 
       /* free each field of ns_instance */
       oc_free_string(&ns_instance->phref);
@@ -1471,43 +1643,24 @@ _rep_list_remove(oc_rep_t **rep_list, oc_rep_t **item)
 }
 
 /**
- * @brief callback for UPDATE of pushed Resource
+ * @brief store one pushed Resource representation ("oic.r.pushpayload")
  *
  * @param request request delivered from stack
- * @param iface_mask OCF interface delivered from stack
- * @param user_data not used
+ * @param recv_obj receiver object of the target Resource
+ * @param payload pushed representation, common properties are removed from it
+ * @return status of the update
  */
-static void
-post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
-               void *user_data)
+static oc_status_t
+_update_pushd_rsc(oc_request_t *request, oc_recv_t *recv_obj,
+                  oc_rep_t **payload)
 {
-  (void)iface_mask;
-  (void)user_data;
-
-  int result = OC_STATUS_CHANGED;
-  oc_rep_t *rep = request->request_payload;
+  oc_status_t result = OC_STATUS_CHANGED;
+  oc_rep_t *rep = *payload;
   oc_rep_t *common_property;
-  oc_pushd_resource_rep_t *pushd_rsc_rep;
-  oc_recvs_t *recvs_instance;
-  oc_recv_t *recv_obj;
-
-  recvs_instance = _find_recvs_by_device(request->resource->device);
-  if (recvs_instance) {
-    recv_obj = _find_recv_obj_by_uri2(recvs_instance, request->resource->uri);
-    if (!recv_obj) {
-      OC_PUSH_ERR("can't find receiver object for (%s)",
-                  oc_string(request->resource->uri));
-      return;
-    }
-  } else {
-    OC_PUSH_ERR("can't find push receiver properties for (%s) in device (%ld), "
-                "the target resource may not be a \"push receiver resource\"",
-                oc_string(request->resource->uri), request->resource->device);
-    return;
-  }
+  oc_pushd_resource_rep_t *pushd_rsc_rep = NULL;
 
   /* check if rt of pushed resource is part of configured rts */
-  if (!_check_pushd_rsc_rt(recv_obj, rep)) {
+  if (!_check_pushd_rsc_rt(recv_obj, *payload)) {
     OC_PUSH_ERR(
       "pushed resource type(s) is not in \"rts\" of push recerver object");
     result = OC_STATUS_FORBIDDEN;
@@ -1539,7 +1692,7 @@ post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
            * - remove rep from list and move pointer to the next rep...
            * - removed rep is handed over as return value
            */
-          common_property = _rep_list_remove(&request->request_payload, &rep);
+          common_property = _rep_list_remove(payload, &rep);
           oc_free_rep(common_property);
           continue;
 
@@ -1554,7 +1707,7 @@ post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
               oc_string_array_get_item_size(rep->value.array, i));
           }
 
-          common_property = _rep_list_remove(&request->request_payload, &rep);
+          common_property = _rep_list_remove(payload, &rep);
           oc_free_rep(common_property);
           continue;
         }
@@ -1565,7 +1718,7 @@ post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
           oc_set_string(&request->resource->name, oc_string(rep->value.string),
                         oc_string_len(rep->value.string));
 
-          common_property = _rep_list_remove(&request->request_payload, &rep);
+          common_property = _rep_list_remove(payload, &rep);
           oc_free_rep(common_property);
           continue;
         }
@@ -1588,8 +1741,7 @@ post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
       oc_rep_set_pool(&g_rep_instance_memb);
       oc_free_rep(pushd_rsc_rep->rep);
 
-      if (!(pushd_rsc_rep->rep =
-              _create_pushd_rsc_rep(request->request_payload))) {
+      if (!(pushd_rsc_rep->rep = _create_pushd_rsc_rep(*payload))) {
         OC_PUSH_ERR("something wrong!, creating corresponding pushed resource "
                     "representation faild (%s) ! ",
                     oc_string(request->resource->uri));
@@ -1622,6 +1774,60 @@ post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
     oc_resource_set_discoverable(pushd_rsc_rep->resource, true);
   }
 
+  return result;
+}
+
+/**
+ * @brief callback for UPDATE of pushed Resource
+ *
+ * @details the payload is a single "oic.r.pushpayload" object, or an array of
+ * them when the origin server pushes a batch of coalesced updates
+ *
+ * @param request request delivered from stack
+ * @param iface_mask OCF interface delivered from stack
+ * @param user_data not used
+ */
+static void
+post_pushd_rsc(oc_request_t *request, oc_interface_mask_t iface_mask,
+               void *user_data)
+{
+  (void)iface_mask;
+  (void)user_data;
+
+  oc_recvs_t *recvs_instance;
+  oc_recv_t *recv_obj;
+
+  recvs_instance = _find_recvs_by_device(request->resource->device);
+  if (recvs_instance) {
+    recv_obj = _find_recv_obj_by_uri2(recvs_instance, request->resource->uri);
+    if (!recv_obj) {
+      OC_PUSH_ERR("can't find receiver object for (%s)",
+                  oc_string(request->resource->uri));
+      return;
+    }
+  } else {
+    OC_PUSH_ERR("can't find push receiver properties for (%s) in device (%ld), "
+                "the target resource may not be a \"push receiver resource\"",
+                oc_string(request->resource->uri), request->resource->device);
+    return;
+  }
+
+  oc_status_t result;
+  oc_rep_t *rep = request->request_payload;
+  if (rep && rep->type == OC_REP_OBJECT && oc_string_len(rep->name) == 0) {
+    /* batch: objects of the root array don't have a name */
+    result = OC_STATUS_CHANGED;
+    for (; rep; rep = rep->next) {
+      oc_status_t item_result =
+        _update_pushd_rsc(request, recv_obj, &rep->value.object);
+      if (item_result != OC_STATUS_CHANGED) {
+        result = item_result;
+      }
+    }
+  } else {
+    result = _update_pushd_rsc(request, recv_obj, &request->request_payload);
+  }
+
   oc_send_response(request, result);
 }
 
@@ -2273,8 +2479,11 @@ void
 oc_push_init(void)
 {
   oc_list_init(g_ns_list);
+  memset(g_ns_index, 0, sizeof(g_ns_index));
   oc_list_init(g_recvs_list);
   oc_list_init(g_pushd_rsc_rep_list);
+  oc_list_init(g_push_target_list);
+  g_push_target_count = 0;
 }
 
 /*
@@ -2286,6 +2495,14 @@ oc_push_init(void)
 void
 oc_push_free(void)
 {
+  oc_push_target_t *target =
+    (oc_push_target_t *)oc_list_pop(g_push_target_list);
+  while (target) {
+    _push_target_free(target);
+    target = (oc_push_target_t *)oc_list_pop(g_push_target_list);
+  }
+  g_push_target_count = 0;
+
   OC_PUSH_DBG("begin to free push receiver list!!!");
 
   oc_recvs_t *recvs_instance = (oc_recvs_t *)oc_list_pop(g_recvs_list);
@@ -2299,56 +2516,241 @@ oc_push_free(void)
   }
 }
 
+void
+oc_push_set_coalescing_interval(uint32_t interval_ms)
+{
+  g_push_coalescing_interval_ms = interval_ms;
+}
+
+uint32_t
+oc_push_get_coalescing_interval(void)
+{
+  return g_push_coalescing_interval_ms;
+}
+
+void
+oc_push_set_batching(bool enabled)
+{
+  g_push_batching = enabled;
+}
+
+bool
+oc_push_is_batching_enabled(void)
+{
+  return g_push_batching;
+}
+
+static bool
+_pp_state_is(const oc_ns_t *ns_instance, oc_pp_state_t state)
+{
+  return strcmp(oc_string(ns_instance->state), pp_statestr(state)) == 0;
+}
+
+/**
+ * @brief schedule push of updates queued for push target
+ *
+ * @param target push target
+ * @param delay_ms delay of the push, unless the push is already scheduled
+ */
+static void
+_schedule_push_flush(oc_push_target_t *target, uint64_t delay_ms)
+{
+  if (!oc_has_delayed_callback(target, _push_target_flush_async, false)) {
+    oc_set_delayed_callback_ms_v1(target, _push_target_flush_async, delay_ms);
+  }
+}
+
+static uint32_t
+_clock_to_ms(oc_clock_time_t ticks)
+{
+  uint64_t ms = (uint64_t)ticks * 1000 / OC_CLOCK_SECOND;
+  return ms > UINT32_MAX ? UINT32_MAX : (uint32_t)ms;
+}
+
+static void
+_push_entry_free(oc_push_entry_t *entry)
+{
+  oc_free_string(&entry->uri);
+  oc_memb_free(&g_push_entry_memb, entry);
+}
+
+static void
+_push_entry_free_all(oc_list_t list)
+{
+  oc_push_entry_t *entry = (oc_push_entry_t *)oc_list_pop(list);
+  while (entry) {
+    _push_entry_free(entry);
+    entry = (oc_push_entry_t *)oc_list_pop(list);
+  }
+}
+
+/**
+ * @brief find update of Resource queued for `notification selector`
+ */
+static oc_push_entry_t *
+_push_entry_find(oc_list_t list, const oc_ns_t *ns_instance, const char *uri,
+                 size_t uri_len)
+{
+  for (oc_push_entry_t *entry = (oc_push_entry_t *)oc_list_head(list); entry;
+       entry = entry->next) {
+    if (entry->ns_instance == ns_instance &&
+        oc_string_len(entry->uri) == uri_len &&
+        memcmp(oc_string(entry->uri), uri, uri_len) == 0) {
+      return entry;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * @brief return updates of the failed batch to the front of the queue, so
+ * that they are pushed again when the circuit closes
+ *
+ * @details an update of the same Resource queued while the batch was in
+ * flight is merged into the returned update, the oldest updates are dropped
+ * if the queue is full
+ *
+ * @param target push target
+ */
+static void
+_push_target_requeue_sent(oc_push_target_t *target)
+{
+  oc_push_entry_t *entry = (oc_push_entry_t *)oc_list_pop(target->queue);
+  while (entry) {
+    if (_push_entry_find(target->sent, entry->ns_instance,
+                         oc_string(entry->uri), oc_string_len(entry->uri))) {
+      _push_entry_free(entry);
+    } else {
+      oc_list_add(target->sent, entry);
+    }
+    entry = (oc_push_entry_t *)oc_list_pop(target->queue);
+  }
+  entry = (oc_push_entry_t *)oc_list_pop(target->sent);
+  while (entry) {
+    oc_list_add(target->queue, entry);
+    entry = (oc_push_entry_t *)oc_list_pop(target->sent);
+  }
+  while (oc_list_length(target->queue) > OC_PUSH_TARGET_QUEUE_SIZE) {
+    entry = (oc_push_entry_t *)oc_list_pop(target->queue);
+    OC_PUSH_DBG("queue of push target \"%s\" is full, update of \"%s\" "
+                "is dropped",
+                oc_string(target->path), oc_string(entry->uri));
+    ++target->stats.dropped;
+    _push_entry_free(entry);
+  }
+}
+
+/**
+ * @brief update circuit breaker and statistics of push target with the result
+ * of the batch in flight
+ *
+ * @details updates of the failed batch are pushed again after the backoff
+ *
+ * @param target push target
+ * @param delivered true: the batch was delivered, false: it failed
+ */
+static void
+_push_target_done(oc_push_target_t *target, bool delivered)
+{
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  size_t count = oc_list_length(target->sent);
+  target->batch_id = 0;
+  if (delivered) {
+    _push_entry_free_all(target->sent);
+    target->failures = 0;
+    target->retry_at = 0;
+    target->stats.delivered += (uint32_t)count;
+    uint32_t latency = _clock_to_ms(now - target->sent_enqueued);
+    target->stats.last_latency_ms = latency;
+    target->stats.avg_latency_ms =
+      target->stats.avg_latency_ms == 0
+        ? latency
+        : (uint32_t)(((uint64_t)target->stats.avg_latency_ms * 7 + latency) /
+                     8);
+    if (latency > target->stats.max_latency_ms) {
+      target->stats.max_latency_ms = latency;
+    }
+    return;
+  }
+
+  /* open the circuit, the backoff is doubled with each consecutive failure */
+  target->stats.failed += (uint32_t)count;
+  _push_target_requeue_sent(target);
+  if (target->failures < UINT8_MAX) {
+    ++target->failures;
+  }
+  uint64_t backoff_ms = OC_PUSH_BACKOFF_MIN_MS;
+  for (uint8_t i = 1;
+       i < target->failures && backoff_ms < OC_PUSH_BACKOFF_MAX_MS; i++) {
+    backoff_ms *= 2;
+  }
+  if (backoff_ms > OC_PUSH_BACKOFF_MAX_MS) {
+    backoff_ms = OC_PUSH_BACKOFF_MAX_MS;
+  }
+  target->retry_at = now + backoff_ms * OC_CLOCK_SECOND / 1000;
+  OC_PUSH_DBG("push target \"%s\" failed %d times, retry in %d ms",
+              oc_string(target->path), target->failures, (int)backoff_ms);
+}
+
 /**
  * @brief Response callback for PUSH Update request
  *
- * @param data response payload
+ * @param data response payload, user_data is the id of the pushed batch
  */
 static void
 response_to_push_rsc(oc_client_response_t *data)
 {
-  oc_ns_t *ns_instance = (oc_ns_t *)data->user_data;
+  uint16_t batch_id = (uint16_t)(uintptr_t)data->user_data;
 
   OC_PUSH_DBG("\n   => return status code: [ %s ]",
               oc_status_to_str(data->code));
 
-  if (data->code == OC_REQUEST_TIMEOUT) {
-    /*
-     * TODO4ME <2022/4/17> if update request fails... retry to resolve endpoint
-     * of target device ID...
-     */
-    OC_PUSH_DBG("state of Push Proxy (\"%s\") is changed (%s => %s)",
-                oc_string(ns_instance->resource->uri),
-                oc_string(ns_instance->state), pp_statestr(OC_PP_TOUT));
-    pp_update_state(ns_instance->state, pp_statestr(OC_PP_TOUT));
-  } else if (data->code == OC_STATUS_CHANGED) {
-    OC_PUSH_DBG("state of Push Proxy (\"%s\") is changed (%s => %s)",
-                oc_string(ns_instance->resource->uri),
-                oc_string(ns_instance->state), pp_statestr(OC_PP_WFU));
-    pp_update_state(ns_instance->state, pp_statestr(OC_PP_WFU));
-  } else {
-    /*
-     * <2022/4/17> check condition to enter ERR
-     */
+  /* Push Proxy waits for the next update even if the push failed, failed
+   * updates are pushed again by the circuit breaker of push target */
+  oc_pp_state_t new_state = OC_PP_WFU;
+  for (oc_ns_t *ns_instance = (oc_ns_t *)oc_list_head(g_ns_list); ns_instance;
+       ns_instance = ns_instance->next) {
+    if (ns_instance->batch_id != batch_id) {
+      continue;
+    }
+    ns_instance->batch_id = 0;
     OC_PUSH_DBG("state of Push Proxy (\"%s\") is changed (%s => %s)",
                 oc_string(ns_instance->resource->uri),
-                oc_string(ns_instance->state), pp_statestr(OC_PP_ERR));
-    pp_update_state(ns_instance->state, pp_statestr(OC_PP_ERR));
+                oc_string(ns_instance->state), pp_statestr(new_state));
+    pp_update_state(ns_instance->state, pp_statestr(new_state));
+  }
+
+  for (oc_push_target_t *target =
+         (oc_push_target_t *)oc_list_head(g_push_target_list);
+       target; target = target->next) {
+    if (target->batch_id != batch_id) {
+      continue;
+    }
+    _push_target_done(target, data->code == OC_STATUS_CHANGED);
+    /* updates arrived while waiting for the response or updates of the failed
+     * batch are pushed now, or when the circuit closes */
+    if (oc_list_length(target->queue) > 0) {
+      oc_clock_time_t now = oc_clock_time_monotonic();
+      _schedule_push_flush(target, target->retry_at > now
+                                     ? _clock_to_ms(target->retry_at - now)
+                                     : 0);
+    }
+    break;
   }
 }
 
 /**
- * @brief send PUSH update request
+ * @brief check if pushable Resource of `notification selector` can be pushed
  *
  * @param ns_instance composition of `oic.r.notificationselector` +
  * `oic.r.pushproxy`
- * @return true:success, false:fail
+ * @return true:can be pushed, false:not
  */
 static bool
-push_update(oc_ns_t *ns_instance)
+_push_is_valid(const oc_ns_t *ns_instance)
 {
-  oc_resource_t *src_rsc = (oc_resource_t *)ns_instance->user_data;
-  if (!ns_instance || !src_rsc) {
+  const oc_resource_t *src_rsc = (const oc_resource_t *)ns_instance->user_data;
+  if (!src_rsc) {
     OC_PUSH_ERR("something wrong! corresponding notification selector source "
                 "resource is NULL, or updated resource is NULL!");
     return false;
@@ -2358,17 +2760,20 @@ push_update(oc_ns_t *ns_instance)
     OC_PUSH_ERR("payload_builder() of source resource is NULL!");
     return false;
   }
+  return true;
+}
+
+/**
+ * @brief encode properties of "oic.r.pushpayload" Resource to the root object
+ *
+ * @param ns_instance composition of `oic.r.notificationselector` +
+ * `oic.r.pushproxy`
+ */
+static void
+_push_encode_payload(const oc_ns_t *ns_instance)
+{
+  const oc_resource_t *src_rsc = (const oc_resource_t *)ns_instance->user_data;
 
-  /*
-   * 1. find `notification selector` which monitors `src_rsc` from `ns_col_list`
-   * 2. post UPDATE by using URI, endpoint (use oc_sting_to_endpoint())
-   */
-  if (!oc_init_post(oc_string(ns_instance->targetpath),
-                    &ns_instance->pushtarget_ep, "if=oic.if.rw",
-                    &response_to_push_rsc, HIGH_QOS, ns_instance)) {
-    OC_PUSH_ERR("Could not init POST");
-    return false;
-  }
   /*
    * add other properties than "rep" object of "oic.r.pushpayload" Resource
    * here. payload_builder() only "rep" object.
@@ -2376,7 +2781,6 @@ push_update(oc_ns_t *ns_instance)
    * payload_builder() doesn't need to have "oc_rep_start_root_object()" and
    * "oc_rep_end_root_object()" they should be added here...
    */
-  oc_rep_begin_root_object();
 
   /* anchor */
   char di[OC_UUID_LEN + 10];
@@ -2404,37 +2808,353 @@ push_update(oc_ns_t *ns_instance)
 
   /* build rep object */
   src_rsc->payload_builder();
+}
 
-  oc_rep_end_root_object();
+/**
+ * @brief send PUSH update request with the latest contents of pushable
+ * Resources of all `notification selectors` in the batch
+ *
+ * @details a single update is sent as "oic.r.pushpayload" object, a batch is
+ * sent as an array of "oic.r.pushpayload" objects (see oc_push_set_batching())
+ *
+ * @param target push target
+ * @param batch `notification selectors` with the same push target
+ * @param count number of `notification selectors` in the batch
+ * @return true:success, false:fail
+ */
+static bool
+push_update(oc_push_target_t *target, oc_ns_t **batch, size_t count)
+{
+
+  if (++g_push_batch_id == 0) {
+    g_push_batch_id = 1;
+  }
+
+  /*
+   * 1. find `notification selector` which monitors `src_rsc` from `ns_col_list`
+   * 2. post UPDATE by using URI, endpoint (use oc_sting_to_endpoint())
+   */
+  if (!oc_init_post(oc_string(target->path), &target->endpoint, "if=oic.if.rw",
+                    &response_to_push_rsc, HIGH_QOS,
+                    (void *)(uintptr_t)g_push_batch_id)) {
+    OC_PUSH_ERR("Could not init POST");
+    return false;
+  }
+
+  if (count == 1) {
+    oc_rep_begin_root_object();
+    _push_encode_payload(batch[0]);
+    oc_rep_end_root_object();
+  } else {
+    oc_rep_begin_links_array();
+    for (size_t i = 0; i < count; i++) {
+      g_err |= oc_rep_encoder_create_map(&links_array, &root_map,
+                                         CborIndefiniteLength);
+      _push_encode_payload(batch[i]);
+      g_err |= oc_rep_encoder_close_container(&links_array, &root_map);
+    }
+    oc_rep_end_links_array();
+  }
 
   if (!oc_do_post()) {
     OC_PUSH_ERR("Could not send POST");
     return false;
   }
+
+  for (size_t i = 0; i < count; i++) {
 #ifdef OC_PUSHDEBUG
-  oc_string_t ep, full_uri;
+    oc_string_t ep, full_uri;
 
-  oc_endpoint_to_string(&ns_instance->pushtarget_ep, &ep);
-  if (oc_string_len(ns_instance->targetpath)) {
-    oc_concat_strings(&full_uri, oc_string(ep),
-                      oc_string(ns_instance->targetpath));
-  } else {
-    oc_new_string(&full_uri, oc_string(ep), oc_string_len(ep));
-  }
+    oc_endpoint_to_string(&batch[i]->pushtarget_ep, &ep);
+    if (oc_string_len(batch[i]->targetpath)) {
+      oc_concat_strings(&full_uri, oc_string(ep),
+                        oc_string(batch[i]->targetpath));
+    } else {
+      oc_new_string(&full_uri, oc_string(ep), oc_string_len(ep));
+    }
 
-  OC_PUSH_DBG("push \"%s\" ====> \"%s\"", oc_string(src_rsc->uri),
-              oc_string(full_uri));
-  oc_free_string(&ep);
-  oc_free_string(&full_uri);
+    OC_PUSH_DBG("push \"%s\" ====> \"%s\"",
+                oc_string(((oc_resource_t *)batch[i]->user_data)->uri),
+                oc_string(full_uri));
+    oc_free_string(&ep);
+    oc_free_string(&full_uri);
 #endif
-  OC_PUSH_DBG("state of Push Proxy (\"%s\") is changed (%s => %s)",
-              oc_string(ns_instance->resource->uri),
-              oc_string(ns_instance->state), pp_statestr(OC_PP_WFR));
-  pp_update_state(ns_instance->state, pp_statestr(OC_PP_WFR));
+    OC_PUSH_DBG("state of Push Proxy (\"%s\") is changed (%s => %s)",
+                oc_string(batch[i]->resource->uri),
+                oc_string(batch[i]->state), pp_statestr(OC_PP_WFR));
+    pp_update_state(batch[i]->state, pp_statestr(OC_PP_WFR));
+    batch[i]->batch_id = g_push_batch_id;
+  }
+  target->batch_id = g_push_batch_id;
 
   return true;
 }
 
+static bool
+_is_push_target(const oc_push_target_t *target, const oc_ns_t *ns_instance)
+{
+  return oc_endpoint_compare(&target->endpoint, &ns_instance->pushtarget_ep) ==
+           0 &&
+         strcmp(oc_string(target->path), oc_string(ns_instance->targetpath)) ==
+           0;
+}
+
+static void
+_push_target_free(oc_push_target_t *target)
+{
+  oc_remove_delayed_callback(target, _push_target_flush_async);
+  _push_entry_free_all(target->queue);
+  _push_entry_free_all(target->sent);
+  oc_free_string(&target->path);
+  oc_memb_free(&g_push_target_memb, target);
+}
+
+/**
+ * @brief forget the least recently added push target without queued updates
+ * and update in flight, the state of its circuit breaker is lost
+ */
+static bool
+_push_target_evict_idle(void)
+{
+  for (oc_push_target_t *target =
+         (oc_push_target_t *)oc_list_head(g_push_target_list);
+       target; target = target->next) {
+    if (oc_list_length(target->queue) == 0 && target->batch_id == 0) {
+      oc_list_remove(g_push_target_list, target);
+      _push_target_free(target);
+      --g_push_target_count;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief find push target of `notification selector`
+ *
+ * @param ns_instance notification selector
+ * @param create create push target if it doesn't exist
+ * @return push target, NULL if not found or all push targets are busy
+ */
+static oc_push_target_t *
+_push_target_get(const oc_ns_t *ns_instance, bool create)
+{
+  for (oc_push_target_t *target =
+         (oc_push_target_t *)oc_list_head(g_push_target_list);
+       target; target = target->next) {
+    if (_is_push_target(target, ns_instance)) {
+      return target;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (g_push_target_count >= OC_PUSH_MAX_TARGETS &&
+      !_push_target_evict_idle()) {
+    OC_PUSH_ERR("all push targets are busy!");
+    return NULL;
+  }
+  oc_push_target_t *target =
+    (oc_push_target_t *)oc_memb_alloc(&g_push_target_memb);
+  if (!target) {
+    OC_PUSH_ERR("oc_memb_alloc() error!");
+    return NULL;
+  }
+  memset(target, 0, sizeof(oc_push_target_t));
+  OC_LIST_STRUCT_INIT(target, queue);
+  OC_LIST_STRUCT_INIT(target, sent);
+  oc_endpoint_copy(&target->endpoint, &ns_instance->pushtarget_ep);
+  oc_new_string(&target->path, oc_string(ns_instance->targetpath),
+                oc_string_len(ns_instance->targetpath));
+  oc_list_add(g_push_target_list, target);
+  ++g_push_target_count;
+  return target;
+}
+
+/**
+ * @brief queue update of pushable Resource for push target of `notification
+ * selector`
+ *
+ * @details the Resource is identified by its path, it is looked up when the
+ * update is pushed, so that a Resource deleted meanwhile is never accessed.
+ * An update of the Resource already queued for the `notification selector` is
+ * kept (the latest value wins, the contents are read when pushed), the oldest
+ * update is dropped if the queue is full
+ *
+ * @param ns_instance notification selector
+ * @param uri path of updated pushable Resource
+ * @param uri_len length of uri
+ */
+static void
+_push_enqueue(oc_ns_t *ns_instance, const char *uri, size_t uri_len)
+{
+  oc_push_target_t *target = _push_target_get(ns_instance, true);
+  if (!target) {
+    return;
+  }
+
+  oc_push_entry_t *entry =
+    _push_entry_find(target->queue, ns_instance, uri, uri_len);
+  if (entry) {
+    return;
+  }
+
+  if (oc_list_length(target->queue) >= OC_PUSH_TARGET_QUEUE_SIZE) {
+    entry = (oc_push_entry_t *)oc_list_pop(target->queue);
+    OC_PUSH_DBG("queue of push target \"%s\" is full, update of \"%s\" "
+                "is dropped",
+                oc_string(target->path), oc_string(entry->uri));
+    ++target->stats.dropped;
+    oc_free_string(&entry->uri);
+  } else {
+    entry = (oc_push_entry_t *)oc_memb_alloc(&g_push_entry_memb);
+    if (!entry) {
+      OC_PUSH_ERR("oc_memb_alloc() error!");
+      ++target->stats.dropped;
+      return;
+    }
+  }
+  entry->ns_instance = ns_instance;
+  oc_new_string(&entry->uri, uri, uri_len);
+  entry->enqueued = oc_clock_time_monotonic();
+  oc_list_add(target->queue, entry);
+
+  if (target->batch_id == 0) {
+    oc_clock_time_t now = entry->enqueued;
+    uint64_t delay_ms = g_push_coalescing_interval_ms;
+    if (target->retry_at > now) {
+      delay_ms = _clock_to_ms(target->retry_at - now);
+    }
+    _schedule_push_flush(target, delay_ms);
+  }
+}
+
+static void
+_push_entry_remove_ns(oc_list_t list, const oc_ns_t *ns_instance)
+{
+  oc_push_entry_t *entry = (oc_push_entry_t *)oc_list_head(list);
+  while (entry) {
+    oc_push_entry_t *next = entry->next;
+    if (entry->ns_instance == ns_instance) {
+      oc_list_remove(list, entry);
+      _push_entry_free(entry);
+    }
+    entry = next;
+  }
+}
+
+/**
+ * @brief remove queued updates and updates in flight of `notification
+ * selector`
+ */
+static void
+_push_dequeue_ns(const oc_ns_t *ns_instance)
+{
+  for (oc_push_target_t *target =
+         (oc_push_target_t *)oc_list_head(g_push_target_list);
+       target; target = target->next) {
+    _push_entry_remove_ns(target->queue, ns_instance);
+    _push_entry_remove_ns(target->sent, ns_instance);
+  }
+}
+
+/**
+ * @brief push updates queued for push target, up to OC_PUSH_MAX_BATCH_SIZE
+ * updates are sent in one request if batching is enabled, only one request is
+ * in flight
+ */
+static oc_event_callback_retval_t
+_push_target_flush_async(void *data)
+{
+  oc_push_target_t *target = (oc_push_target_t *)data;
+  if (target->batch_id != 0) {
+    /* the response schedules the next push */
+    return OC_EVENT_DONE;
+  }
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  if (target->retry_at > now) {
+    oc_set_delayed_callback_ms_v1(target, _push_target_flush_async,
+                                  _clock_to_ms(target->retry_at - now));
+    return OC_EVENT_DONE;
+  }
+
+  oc_ns_t *batch[OC_PUSH_MAX_BATCH_SIZE];
+  size_t max_count = g_push_batching ? OC_PUSH_MAX_BATCH_SIZE : 1;
+  size_t count = 0;
+  oc_clock_time_t oldest = now;
+  oc_push_entry_t *entry = (oc_push_entry_t *)oc_list_head(target->queue);
+  while (entry && count < max_count) {
+    oc_push_entry_t *next = entry->next;
+    oc_ns_t *ns_instance = entry->ns_instance;
+    if (_pp_state_is(ns_instance, OC_PP_WFR)) {
+      /* previous update of the selector waits for response */
+      entry = next;
+      continue;
+    }
+    oc_list_remove(target->queue, entry);
+    if (_pp_state_is(ns_instance, OC_PP_WFU)) {
+      /* the Resource may have been deleted since the update */
+      ns_instance->user_data = oc_ri_get_app_resource_by_uri(
+        oc_string(entry->uri), oc_string_len(entry->uri),
+        ns_instance->resource->device);
+      if (_push_is_valid(ns_instance)) {
+        batch[count++] = ns_instance;
+        if (entry->enqueued < oldest) {
+          oldest = entry->enqueued;
+        }
+        oc_list_add(target->sent, entry);
+        entry = next;
+        continue;
+      }
+    }
+    /* the Resource was deleted or the Push Proxy doesn't push anymore */
+    ++target->stats.dropped;
+    _push_entry_free(entry);
+    entry = next;
+  }
+
+  if (count == 0) {
+    return OC_EVENT_DONE;
+  }
+
+  target->stats.sent += (uint32_t)count;
+  target->sent_enqueued = oldest;
+  if (!push_update(target, batch, count)) {
+    OC_PUSH_ERR("sending PUSH Update to \"%s\" failed!",
+                oc_string(target->path));
+    _push_target_done(target, false);
+  }
+  /* the pushed Resources are looked up again by the next push */
+  for (size_t i = 0; i < count; i++) {
+    batch[i]->user_data = NULL;
+  }
+  if (target->batch_id == 0 && oc_list_length(target->queue) > 0) {
+    oc_set_delayed_callback_ms_v1(
+      target, _push_target_flush_async,
+      target->retry_at > now ? _clock_to_ms(target->retry_at - now) : 0);
+  }
+  return OC_EVENT_DONE;
+}
+
+bool
+oc_push_get_target_stats(const oc_endpoint_t *endpoint, const char *path,
+                         oc_push_target_stats_t *stats)
+{
+  for (oc_push_target_t *target =
+         (oc_push_target_t *)oc_list_head(g_push_target_list);
+       target; target = target->next) {
+    if (oc_endpoint_compare(&target->endpoint, endpoint) != 0 ||
+        strcmp(oc_string(target->path), path) != 0) {
+      continue;
+    }
+    *stats = target->stats;
+    stats->queued = (uint32_t)oc_list_length(target->queue);
+    stats->circuit_open = target->retry_at > oc_clock_time_monotonic();
+    return true;
+  }
+  return false;
+}
+
 OC_PROCESS_THREAD(oc_push_process, ev, data)
 {
   oc_resource_t *src_rsc;
@@ -2564,9 +3284,102 @@ _check_string_array_inclusion(oc_string_array_t *target,
   return false;
 }
 
+/**
+ * @brief check if updated Resource matches `notification selector`
+ *
+ * @details each configured property (phref, prt, pif) must match, at least
+ * one of them must be configured. Properties are checked by the match index
+ * first, strings are compared only if the index matches.
+ *
+ * @param ns_instance notification selector
+ * @param resource updated Resource
+ * @param uri path of updated Resource
+ * @param uri_len length of uri
+ * @param uri_hash hash of uri
+ * @param rt_filter bloom filter of resource types of updated Resource
+ * @return true:matches, false:mismatches
+ */
+static bool
+_ns_matches(oc_ns_t *ns_instance, oc_resource_t *resource, const char *uri,
+            size_t uri_len, uint32_t uri_hash, uint32_t rt_filter)
+{
+  bool configured = false;
+
+  if (oc_string(ns_instance->phref)) {
+    if (ns_instance->phref_hash != uri_hash ||
+        oc_string_len(ns_instance->phref) != uri_len ||
+        memcmp(oc_string(ns_instance->phref), uri, uri_len) != 0) {
+      OC_PUSH_DBG("%s:phref exists, but mismatches (phref:%s - uri:%s)",
+                  oc_string(ns_instance->resource->uri),
+                  oc_string(ns_instance->phref), uri);
+      return false;
+    }
+    configured = true;
+  }
+
+  if (oc_string_array_get_allocated_size(ns_instance->prt) > 0) {
+    if ((ns_instance->prt_filter & rt_filter) == 0 ||
+        !_check_string_array_inclusion(&ns_instance->prt, &resource->types)) {
+      OC_PUSH_DBG("%s:prt exists, but mismatches",
+                  oc_string(ns_instance->resource->uri));
+      return false;
+    }
+    configured = true;
+  }
+
+  if (oc_string_array_get_allocated_size(ns_instance->pif) > 0) {
+    if (!(ns_instance->pif_mask & resource->interfaces)) {
+      OC_PUSH_DBG(
+        "%s:pif exists, but mismatches (pif:%#x - if of updated rsc:%#x)",
+        oc_string(ns_instance->resource->uri), ns_instance->pif_mask,
+        resource->interfaces);
+      return false;
+    }
+    configured = true;
+  }
+
+  return configured;
+}
+
+/**
+ * @brief queue update of Resource for matching `notification selectors` of
+ * one bucket of the index
+ */
+static void
+_push_enqueue_matching(oc_ns_t *ns_instance, oc_resource_t *resource,
+                       const char *uri, size_t uri_len, uint32_t uri_hash,
+                       uint32_t rt_filter)
+{
+  for (; ns_instance; ns_instance = ns_instance->index_next) {
+    if (ns_instance->resource->device != resource->device)
+      continue;
+
+    /* if push proxy is not waiting for update or for response of previous
+     * update, just skip it... */
+    if (!_pp_state_is(ns_instance, OC_PP_WFU) &&
+        !_pp_state_is(ns_instance, OC_PP_WFR))
+      continue;
+
+    if (!_ns_matches(ns_instance, resource, uri, uri_len, uri_hash,
+                     rt_filter))
+      continue;
+
+    OC_PUSH_DBG("resource \"%s\" matches notification selector \"%s\"!",
+                oc_string(resource->uri),
+                oc_string(ns_instance->resource->uri));
+
+    _push_enqueue(ns_instance, uri, uri_len);
+  }
+}
+
 /**
  * @brief trigger PUSH procedure
  *
+ * @details updates for matching `notification selectors` are queued per push
+ * target and pushed after the coalescing interval elapses (see
+ * oc_push_set_coalescing_interval()), with the contents of the Resource at
+ * that time
+ *
  * @param uri path of updated Resource
  * @param device_index device index which the updated Resource belongs to
  */
@@ -2575,8 +3388,6 @@ oc_resource_state_changed(const char *uri, size_t uri_len, size_t device_index)
 {
   oc_resource_t *resource =
     oc_ri_get_app_resource_by_uri(uri, uri_len, device_index);
-  oc_ns_t *ns_instance = (oc_ns_t *)oc_list_head(g_ns_list);
-  char all_matched = 0x7;
 
   OC_PUSH_DBG("resource \"%s\"@device(%ld) is updated!", uri, device_index);
 
@@ -2590,121 +3401,20 @@ oc_resource_state_changed(const char *uri, size_t uri_len, size_t device_index)
                 device_index);
     return;
   }
+  if (!oc_process_is_running(&oc_push_process)) {
+    OC_PUSH_DBG("oc_push_process is not running!");
+    return;
+  }
 
-  for (; ns_instance; ns_instance = ns_instance->next) {
-    if (ns_instance->resource->device != device_index)
-      continue;
-
-    /* if push proxy is not in "wait for update" state, just skip it... */
-    if (strcmp(oc_string(ns_instance->state), pp_statestr(OC_PP_WFU)))
-      continue;
-
-    if (oc_string(ns_instance->phref)) {
-      if (strcmp(oc_string(ns_instance->phref), uri)) {
-        OC_PUSH_DBG("%s:phref exists, but mismatches (phref:%s - uri:%s)",
-                    oc_string(ns_instance->resource->uri),
-                    oc_string(ns_instance->phref), uri);
-        all_matched = 0;
-      } else {
-        OC_PUSH_DBG("%s:phref matches (phref:%s - uri:%s)",
-                    oc_string(ns_instance->resource->uri),
-                    oc_string(ns_instance->phref), uri);
-      }
-    } else {
-      OC_PUSH_DBG("%s:phref does not exist",
-                  oc_string(ns_instance->resource->uri));
-      all_matched &= 0x6;
-    }
-
-    if (oc_string_array_get_allocated_size(ns_instance->prt) > 0) {
-      if (!_check_string_array_inclusion(&ns_instance->prt, &resource->types)) {
-#ifdef OC_PUSHDEBUG
-        OC_PUSH_PRINT("%s:prt exists, but mismatches (prt: [",
-                      oc_string(ns_instance->resource->uri));
-        for (size_t i = 0;
-             i < oc_string_array_get_allocated_size(ns_instance->prt); i++) {
-          OC_PUSH_PRINT("%s ", oc_string_array_get_item(ns_instance->prt, i));
-        }
-        OC_PUSH_PRINT("] - rt of updated rsc: [");
-        for (size_t i = 0;
-             i < oc_string_array_get_allocated_size(resource->types); i++) {
-          OC_PUSH_PRINT("%s ", oc_string_array_get_item(resource->types, i));
-        }
-        OC_PUSH_PRINT("])\n");
-#endif
-        all_matched = 0;
-      } else {
-#ifdef OC_PUSHDEBUG
-        OC_PUSH_PRINT("%s:prt matches (prt: [",
-                      oc_string(ns_instance->resource->uri));
-        for (size_t i = 0;
-             i < oc_string_array_get_allocated_size(ns_instance->prt); i++) {
-          OC_PUSH_PRINT("%s ", oc_string_array_get_item(ns_instance->prt, i));
-        }
-        OC_PUSH_PRINT("] - rt of updated rsc: [");
-        for (size_t i = 0;
-             i < oc_string_array_get_allocated_size(resource->types); i++) {
-          OC_PUSH_PRINT("%s ", oc_string_array_get_item(resource->types, i));
-        }
-        OC_PUSH_PRINT("])\n");
-#endif
-      }
-    } else {
-      OC_PUSH_DBG("%s:prt does not exist",
-                  oc_string(ns_instance->resource->uri));
-      all_matched &= 0x5;
-    }
-
-    if (oc_string_array_get_allocated_size(ns_instance->pif) > 0) {
-      oc_interface_mask_t pif = 0;
-      for (int i = 0;
-           i < (int)oc_string_array_get_allocated_size(ns_instance->pif); i++) {
-        pif |= oc_ri_get_interface_mask(
-          oc_string_array_get_item(ns_instance->pif, i),
-          oc_byte_string_array_get_item_size(ns_instance->pif, i));
-      }
-
-      if (!(pif & resource->interfaces)) {
-        OC_PUSH_DBG(
-          "%s:pif exists, but mismatches (pif:%#x - if of updated rsc:%#x)",
-          oc_string(ns_instance->resource->uri), pif, resource->interfaces);
-        all_matched = 0;
-      } else {
-        OC_PUSH_DBG("%s:pif matches (pif:%#x - if of updated rsc:%#x)",
-                    oc_string(ns_instance->resource->uri), pif,
-                    resource->interfaces);
-      }
-    } else {
-      OC_PUSH_DBG("%s:pif does not exist",
-                  oc_string(ns_instance->resource->uri));
-      all_matched &= 0x3;
-    }
-
-    if (all_matched) {
-      if (!oc_process_is_running(&oc_push_process)) {
-        OC_PUSH_DBG("oc_push_process is not running!");
-        return;
-      }
-
-      OC_PUSH_DBG("resource \"%s\" matches notification selector \"%s\"!",
-                  oc_string(resource->uri),
-                  oc_string(ns_instance->resource->uri));
-
-      /* resource is necessary to identify which resource is being pushed..,
-       * before sending update to target server */
-      ns_instance->user_data = resource;
+  uint32_t uri_hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, uri, uri_len);
+  uint32_t rt_filter = _rt_filter(&resource->types);
 
-      /* post "event" for Resource which has just been updated */
-      if (!push_update(ns_instance)) {
-        OC_PUSH_ERR("sensing PUSH Update of \"%s\" failed!",
-                    oc_string(resource->uri));
-      }
-#if 0
-      oc_process_post(&oc_push_process,
-          oc_events[PUSH_RSC_STATE_CHANGED], ns_instance);
-#endif
-    }
-    all_matched = 0x7;
+  /* only selectors without "phref" and selectors whose "phref" has the same
+   * hash as uri can match */
+  const size_t buckets[] = { 0, _ns_index_bucket(uri_hash) };
+  for (size_t b = 0; b < OC_ARRAY_SIZE(buckets); b++) {
+    _push_enqueue_matching(g_ns_index[buckets[b]], resource, uri, uri_len,
+                           uri_hash, rt_filter);
   }
 }
 
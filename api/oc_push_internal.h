@@ -29,6 +29,61 @@
 extern "C" {
 #endif
 
+/**
+ * @brief default interval in milliseconds during which updates of pushable
+ * Resources are coalesced before they are pushed
+ */
+#ifndef OC_PUSH_COALESCING_INTERVAL_MS
+#define OC_PUSH_COALESCING_INTERVAL_MS (100)
+#endif /* OC_PUSH_COALESCING_INTERVAL_MS */
+
+/**
+ * @brief maximal number of updates sent to a push target in one request when
+ * batching is enabled (see oc_push_set_batching())
+ */
+#ifndef OC_PUSH_MAX_BATCH_SIZE
+#define OC_PUSH_MAX_BATCH_SIZE (8)
+#endif /* OC_PUSH_MAX_BATCH_SIZE */
+
+/**
+ * @brief number of buckets of the index of Notification Selectors by the hash
+ * of "phref", must be a power of 2
+ */
+#ifndef OC_PUSH_NS_INDEX_SIZE
+#define OC_PUSH_NS_INDEX_SIZE (8)
+#endif /* OC_PUSH_NS_INDEX_SIZE */
+
+/**
+ * @brief maximal number of push targets with an outbound queue, idle push
+ * targets are forgotten when a new push target arrives
+ */
+#ifndef OC_PUSH_MAX_TARGETS
+#define OC_PUSH_MAX_TARGETS (8)
+#endif /* OC_PUSH_MAX_TARGETS */
+
+/**
+ * @brief maximal number of updates queued for a push target, the oldest
+ * update is dropped when a new update arrives to the full queue
+ */
+#ifndef OC_PUSH_TARGET_QUEUE_SIZE
+#define OC_PUSH_TARGET_QUEUE_SIZE (16)
+#endif /* OC_PUSH_TARGET_QUEUE_SIZE */
+
+/**
+ * @brief backoff of push target after its first failure in milliseconds, the
+ * backoff is doubled with each consecutive failure
+ */
+#ifndef OC_PUSH_BACKOFF_MIN_MS
+#define OC_PUSH_BACKOFF_MIN_MS (1000)
+#endif /* OC_PUSH_BACKOFF_MIN_MS */
+
+/**
+ * @brief upper bound of the backoff of push target in milliseconds
+ */
+#ifndef OC_PUSH_BACKOFF_MAX_MS
+#define OC_PUSH_BACKOFF_MAX_MS (5 * 60 * 1000)
+#endif /* OC_PUSH_BACKOFF_MAX_MS */
+
 void oc_push_init(void);
 
 void oc_push_free(void);
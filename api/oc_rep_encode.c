@@ -24,14 +24,164 @@
 #include <stddef.h>
 #include <stdint.h>
 
-CborEncoder g_encoder;
-static uint8_t *g_buf;
-#ifdef OC_DYNAMIC_ALLOCATION
-static bool g_enable_realloc;
-static size_t g_buf_size;
-static size_t g_buf_max_size;
-static uint8_t **g_buf_ptr;
-#endif /* OC_DYNAMIC_ALLOCATION */
+
+static size_t
+rep_cbor_get_buffer_size(const CborEncoder *encoder, const uint8_t *buffer)
+{
+  return cbor_encoder_get_buffer_size(encoder, buffer);
+}
+
+static size_t
+rep_cbor_get_extra_bytes_needed(const CborEncoder *encoder)
+{
+  return cbor_encoder_get_extra_bytes_needed(encoder);
+}
+
+static CborError
+rep_cbor_encode_null(CborEncoder *encoder)
+{
+  return cbor_encode_null(encoder);
+}
+
+static CborError
+rep_cbor_encode_boolean(CborEncoder *encoder, bool value)
+{
+  return cbor_encode_boolean(encoder, value);
+}
+
+static CborError
+rep_cbor_encode_double(CborEncoder *encoder, double value)
+{
+  return cbor_encode_double(encoder, value);
+}
+
+static const oc_rep_encoder_t g_cbor_encoder = {
+  .type = OC_REP_CBOR_ENCODER,
+  .content_format = APPLICATION_VND_OCF_CBOR,
+  .get_buffer_size = &rep_cbor_get_buffer_size,
+  .get_extra_bytes_needed = &rep_cbor_get_extra_bytes_needed,
+  .encode_null = &rep_cbor_encode_null,
+  .encode_boolean = &rep_cbor_encode_boolean,
+  .encode_int = &cbor_encode_int,
+  .encode_uint = &cbor_encode_uint,
+  .encode_floating_point = &cbor_encode_floating_point,
+  .encode_double = &rep_cbor_encode_double,
+  .encode_text_string = &cbor_encode_text_string,
+  .encode_byte_string = &cbor_encode_byte_string,
+  .create_array = &cbor_encoder_create_array,
+  .create_map = &cbor_encoder_create_map,
+  .close_container = &cbor_encoder_close_container,
+};
+
+// context used when no other context is set
+static oc_rep_encoder_context_t g_default_context = {
+  .impl = &g_cbor_encoder,
+};
+// not thread-local: contexts separate nested encodings on the thread running
+// the stack, they don't make the encoder reentrant
+static oc_rep_encoder_context_t *g_context = &g_default_context;
+
+const oc_rep_encoder_t *
+oc_rep_cbor_encoder(void)
+{
+  return &g_cbor_encoder;
+}
+
+oc_rep_encoder_context_t *
+oc_rep_encoder_set_context(oc_rep_encoder_context_t *ctx)
+{
+  oc_rep_encoder_context_t *prev = g_context;
+  if (ctx == NULL) {
+    ctx = &g_default_context;
+  }
+  if (ctx == prev) {
+    return prev;
+  }
+  // the encoders of the current context live in the globals used by the
+  // oc_rep_* macros
+  prev->root = root_map;
+  prev->links = links_array;
+  prev->err = g_err;
+  root_map = ctx->root;
+  links_array = ctx->links;
+  g_err = ctx->err;
+  g_context = ctx;
+  return prev;
+}
+
+oc_rep_encoder_context_t *
+oc_rep_encoder_get_context(void)
+{
+  return g_context;
+}
+
+void
+oc_rep_encoder_set_type(oc_rep_encoder_type_t type)
+{
+  switch (type) {
+#ifdef OC_JSON_ENCODER
+  case OC_REP_JSON_ENCODER:
+    g_context->impl = oc_rep_json_encoder();
+    return;
+#endif /* OC_JSON_ENCODER */
+#ifdef OC_SENML_ENCODER
+  case OC_REP_SENML_CBOR_ENCODER:
+#ifdef OC_JSON_ENCODER
+  case OC_REP_SENML_JSON_ENCODER:
+#endif /* OC_JSON_ENCODER */
+    g_context->impl = oc_rep_senml_encoder_init(type);
+    return;
+#endif /* OC_SENML_ENCODER */
+  default:
+    break;
+  }
+  g_context->impl = &g_cbor_encoder;
+}
+
+oc_rep_encoder_type_t
+oc_rep_encoder_get_type(void)
+{
+  return g_context->impl->type;
+}
+
+bool
+oc_rep_encoder_set_type_by_accept(oc_content_format_t accept)
+{
+  switch (accept) {
+  // accept is 0 (text/plain) when the Accept option is not present
+  case TEXT_PLAIN:
+  case APPLICATION_CBOR:
+  case APPLICATION_VND_OCF_CBOR:
+    oc_rep_encoder_set_type(OC_REP_CBOR_ENCODER);
+    return true;
+#ifdef OC_JSON_ENCODER
+  case APPLICATION_JSON:
+    oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+    return true;
+#endif /* OC_JSON_ENCODER */
+#ifdef OC_SENML_ENCODER
+  case APPLICATION_SENML_CBOR:
+    oc_rep_encoder_set_type(OC_REP_SENML_CBOR_ENCODER);
+    return true;
+#ifdef OC_JSON_ENCODER
+  case APPLICATION_SENML_JSON:
+    oc_rep_encoder_set_type(OC_REP_SENML_JSON_ENCODER);
+    return true;
+#endif /* OC_JSON_ENCODER */
+#endif /* OC_SENML_ENCODER */
+  default:
+    break;
+  }
+  OC_DBG("unsupported accept format %d, using cbor", (int)accept);
+  oc_rep_encoder_set_type(OC_REP_CBOR_ENCODER);
+  return false;
+}
+
+oc_content_format_t
+oc_rep_encoder_get_content_format(void)
+{
+  return g_context->impl->content_format;
+}
 
 CborEncoder *
 oc_rep_encoder_convert_offset_to_ptr(CborEncoder *encoder)
@@ -39,11 +189,12 @@ oc_rep_encoder_convert_offset_to_ptr(CborEncoder *encoder)
   if (!encoder || (encoder->data.ptr && !encoder->end)) {
     return encoder;
   }
-  encoder->data.ptr = g_buf + (intptr_t)encoder->data.ptr;
+  const oc_rep_encoder_context_t *ctx = g_context;
+  encoder->data.ptr = ctx->buf + (intptr_t)encoder->data.ptr;
 #ifdef OC_DYNAMIC_ALLOCATION
-  encoder->end = g_buf ? g_buf + g_buf_size : NULL;
+  encoder->end = ctx->buf ? ctx->buf + ctx->buf_size : NULL;
 #else  /* OC_DYNAMIC_ALLOCATION */
-  encoder->end = g_buf + (intptr_t)encoder->end;
+  encoder->end = ctx->buf + (intptr_t)encoder->end;
 #endif /* !OC_DYNAMIC_ALLOCATION */
   return encoder;
 }
@@ -54,8 +205,8 @@ oc_rep_encoder_convert_ptr_to_offset(CborEncoder *encoder)
   if (!encoder || (encoder->data.ptr && !encoder->end)) {
     return encoder;
   }
-  encoder->data.ptr = (uint8_t *)(encoder->data.ptr - g_buf);
-  encoder->end = (uint8_t *)(encoder->end - g_buf);
+  encoder->data.ptr = (uint8_t *)(encoder->data.ptr - g_context->buf);
+  encoder->end = (uint8_t *)(encoder->end - g_context->buf);
   return encoder;
 }
 
@@ -64,7 +215,7 @@ static size_t
 oc_rep_encoder_get_extra_bytes_needed(CborEncoder *encoder)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  size_t size = cbor_encoder_get_extra_bytes_needed(encoder);
+  size_t size = g_context->impl->get_extra_bytes_needed(encoder);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return size;
 }
@@ -72,22 +223,23 @@ oc_rep_encoder_get_extra_bytes_needed(CborEncoder *encoder)
 static CborError
 realloc_buffer(size_t needed)
 {
-  if (!g_enable_realloc || g_buf_size + needed > g_buf_max_size) {
+  oc_rep_encoder_context_t *ctx = g_context;
+  if (!ctx->enable_realloc || ctx->buf_size + needed > ctx->buf_max_size) {
     return CborErrorOutOfMemory;
   }
   // preallocate buffer to avoid reallocation
-  if (2 * (g_buf_size + needed) < (g_buf_max_size / 4)) {
-    needed += g_buf_size + needed;
+  if (2 * (ctx->buf_size + needed) < (ctx->buf_max_size / 4)) {
+    needed += ctx->buf_size + needed;
   } else {
-    needed = g_buf_max_size - g_buf_size;
+    needed = ctx->buf_max_size - ctx->buf_size;
   }
-  uint8_t *tmp = (uint8_t *)realloc(*g_buf_ptr, g_buf_size + needed);
+  uint8_t *tmp = (uint8_t *)realloc(*ctx->buf_ptr, ctx->buf_size + needed);
   if (tmp == NULL) {
     return CborErrorOutOfMemory;
   }
-  *g_buf_ptr = tmp;
-  g_buf = tmp;
-  g_buf_size = g_buf_size + needed;
+  *ctx->buf_ptr = tmp;
+  ctx->buf = tmp;
+  ctx->buf_size = ctx->buf_size + needed;
   return CborNoError;
 }
 
@@ -96,15 +248,17 @@ realloc_buffer(size_t needed)
 void
 oc_rep_encoder_init(uint8_t *buffer, size_t size)
 {
-  g_buf = buffer;
+  oc_rep_encoder_context_t *ctx = g_context;
+  ctx->buf = buffer;
 #ifdef OC_DYNAMIC_ALLOCATION
-  g_enable_realloc = false;
-  g_buf_size = size;
-  g_buf_ptr = NULL;
-  g_buf_max_size = size;
+  ctx->enable_realloc = false;
+  ctx->buf_size = size;
+  ctx->buf_ptr = NULL;
+  ctx->buf_max_size = size;
 #endif /* OC_DYNAMIC_ALLOCATION */
-  cbor_encoder_init(&g_encoder, g_buf, size, 0);
-  oc_rep_encoder_convert_ptr_to_offset(&g_encoder);
+  oc_rep_encoder_set_type(OC_REP_CBOR_ENCODER);
+  cbor_encoder_init(&ctx->encoder, ctx->buf, size, 0);
+  oc_rep_encoder_convert_ptr_to_offset(&ctx->encoder);
 }
 
 #ifdef OC_DYNAMIC_ALLOCATION
@@ -112,33 +266,35 @@ void
 oc_rep_encoder_realloc_init(uint8_t **buffer, size_t size, size_t max_size)
 {
   assert(buffer != NULL);
-  g_enable_realloc = true;
-  g_buf_size = size;
-  g_buf_max_size = max_size;
-  g_buf_ptr = buffer;
-  g_buf = *buffer;
-  cbor_encoder_init(&g_encoder, g_buf, size, 0);
-  oc_rep_encoder_convert_ptr_to_offset(&g_encoder);
+  oc_rep_encoder_context_t *ctx = g_context;
+  ctx->enable_realloc = true;
+  ctx->buf_size = size;
+  ctx->buf_max_size = max_size;
+  ctx->buf_ptr = buffer;
+  ctx->buf = *buffer;
+  oc_rep_encoder_set_type(OC_REP_CBOR_ENCODER);
+  cbor_encoder_init(&ctx->encoder, ctx->buf, size, 0);
+  oc_rep_encoder_convert_ptr_to_offset(&ctx->encoder);
 }
 #endif /* OC_DYNAMIC_ALLOCATION */
 
 CborEncoder *
 oc_rep_get_encoder(void)
 {
-  return &g_encoder;
+  return &g_context->encoder;
 }
 
 const uint8_t *
 oc_rep_get_encoder_buf(void)
 {
-  return g_buf;
+  return g_context->buf;
 }
 
 #ifdef OC_DYNAMIC_ALLOCATION
 int
 oc_rep_get_encoder_buffer_size(void)
 {
-  return (int)g_buf_size;
+  return (int)g_context->buf_size;
 }
 #endif /* OC_DYNAMIC_ALLOCATION */
 
@@ -148,7 +304,8 @@ oc_rep_shrink_encoder_buf(uint8_t *buf)
 #ifndef OC_DYNAMIC_ALLOCATION
   return buf;
 #else  /* !OC_DYNAMIC_ALLOCATION */
-  if (!g_enable_realloc || !buf || !g_buf_ptr || buf != g_buf)
+  oc_rep_encoder_context_t *ctx = g_context;
+  if (!ctx->enable_realloc || !buf || !ctx->buf_ptr || buf != ctx->buf)
     return buf;
   int size = oc_rep_get_encoded_payload_size();
   if (size <= 0) {
@@ -159,11 +316,11 @@ oc_rep_shrink_encoder_buf(uint8_t *buf)
   if (tmp == NULL && size > 0) {
     return buf;
   }
-  OC_DBG("cbor encoder buffer was shrinked from %d to %d", (int)g_buf_size,
+  OC_DBG("cbor encoder buffer was shrinked from %d to %d", (int)ctx->buf_size,
          size);
-  g_buf_size = (size_t)size;
-  *g_buf_ptr = tmp;
-  g_buf = tmp;
+  ctx->buf_size = (size_t)size;
+  *ctx->buf_ptr = tmp;
+  ctx->buf = tmp;
   return tmp;
 #endif /* OC_DYNAMIC_ALLOCATION */
 }
@@ -171,10 +328,11 @@ oc_rep_shrink_encoder_buf(uint8_t *buf)
 int
 oc_rep_get_encoded_payload_size(void)
 {
-  oc_rep_encoder_convert_offset_to_ptr(&g_encoder);
-  size_t size = cbor_encoder_get_buffer_size(&g_encoder, g_buf);
-  size_t needed = cbor_encoder_get_extra_bytes_needed(&g_encoder);
-  oc_rep_encoder_convert_ptr_to_offset(&g_encoder);
+  oc_rep_encoder_context_t *ctx = g_context;
+  oc_rep_encoder_convert_offset_to_ptr(&ctx->encoder);
+  size_t size = ctx->impl->get_buffer_size(&ctx->encoder, ctx->buf);
+  size_t needed = ctx->impl->get_extra_bytes_needed(&ctx->encoder);
+  oc_rep_encoder_convert_ptr_to_offset(&ctx->encoder);
   if (g_err == CborErrorOutOfMemory) {
     OC_WRN("Insufficient memory: Increase OC_MAX_APP_DATA_SIZE to "
            "accomodate a larger payload(+%d)",
@@ -190,16 +348,17 @@ oc_rep_get_encoded_payload_size(void)
 void
 oc_rep_encode_raw(const uint8_t *data, size_t len)
 {
-  if (g_encoder.end == NULL) {
+  oc_rep_encoder_context_t *ctx = g_context;
+  if (ctx->encoder.end == NULL) {
     OC_WRN("encoder has not set end pointer.");
     g_err = CborErrorInternalError;
     return;
   }
 #ifdef OC_DYNAMIC_ALLOCATION
-  size_t remaining = g_buf_size - (size_t)g_encoder.data.ptr;
+  size_t remaining = ctx->buf_size - (size_t)ctx->encoder.data.ptr;
   if (remaining < len) {
     size_t needed = len - remaining;
-    if (!g_enable_realloc) {
+    if (!ctx->enable_realloc) {
       OC_WRN("Insufficient memory: Increase OC_MAX_APP_DATA_SIZE to "
              "accomodate a larger payload(+%d)",
              (int)needed);
@@ -207,16 +366,17 @@ oc_rep_encode_raw(const uint8_t *data, size_t len)
       return;
     }
     CborEncoder prevEncoder;
-    memcpy(&prevEncoder, &g_encoder, sizeof(prevEncoder));
+    memcpy(&prevEncoder, &ctx->encoder, sizeof(prevEncoder));
     CborError err = realloc_buffer(needed);
     if (err != CborNoError) {
       g_err = err;
       return;
     }
-    memcpy(&g_encoder, &prevEncoder, sizeof(prevEncoder));
+    memcpy(&ctx->encoder, &prevEncoder, sizeof(prevEncoder));
   }
 #else  /* OC_DYNAMIC_ALLOCATION */
-  intptr_t needed = (intptr_t)g_encoder.end - (intptr_t)g_encoder.data.ptr;
+  intptr_t needed =
+    (intptr_t)ctx->encoder.end - (intptr_t)ctx->encoder.data.ptr;
   if (needed < (intptr_t)len) {
     OC_WRN("Insufficient memory: Increase OC_MAX_APP_DATA_SIZE to "
            "accomodate a larger payload(+%d)",
@@ -225,18 +385,63 @@ oc_rep_encode_raw(const uint8_t *data, size_t len)
     return;
   }
 #endif /* !OC_DYNAMIC_ALLOCATION */
-  oc_rep_encoder_convert_offset_to_ptr(&g_encoder);
-  memcpy(g_encoder.data.ptr, data, len);
-  g_encoder.data.ptr = g_encoder.data.ptr + len;
+  oc_rep_encoder_convert_offset_to_ptr(&ctx->encoder);
+  memcpy(ctx->encoder.data.ptr, data, len);
+  ctx->encoder.data.ptr = ctx->encoder.data.ptr + len;
   g_err = CborNoError;
-  oc_rep_encoder_convert_ptr_to_offset(&g_encoder);
+  oc_rep_encoder_convert_ptr_to_offset(&ctx->encoder);
+}
+
+static CborError
+oc_rep_encode_raw_items_internal(CborEncoder *encoder, const uint8_t *data,
+                                 size_t len)
+{
+  oc_rep_encoder_convert_offset_to_ptr(encoder);
+  CborError err = CborNoError;
+  if (encoder->end == NULL) {
+    // the buffer has already run out, only count the missing bytes
+    encoder->data.bytes_needed += (ptrdiff_t)len;
+    err = CborErrorOutOfMemory;
+  } else if ((size_t)(encoder->end - encoder->data.ptr) < len) {
+    encoder->data.bytes_needed =
+      (ptrdiff_t)(len - (size_t)(encoder->end - encoder->data.ptr));
+    encoder->end = NULL;
+    err = CborErrorOutOfMemory;
+  } else {
+    memcpy(encoder->data.ptr, data, len);
+    encoder->data.ptr += len;
+  }
+  oc_rep_encoder_convert_ptr_to_offset(encoder);
+  return err;
+}
+
+CborError
+oc_rep_encode_raw_items(CborEncoder *encoder, const uint8_t *data, size_t len)
+{
+  assert(g_context->impl->type == OC_REP_CBOR_ENCODER);
+#ifndef OC_DYNAMIC_ALLOCATION
+  return oc_rep_encode_raw_items_internal(encoder, data, len);
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  CborEncoder prevEncoder;
+  memcpy(&prevEncoder, encoder, sizeof(prevEncoder));
+  CborError err = oc_rep_encode_raw_items_internal(encoder, data, len);
+  if (err == CborErrorOutOfMemory) {
+    err = realloc_buffer(oc_rep_encoder_get_extra_bytes_needed(encoder));
+    if (err != CborNoError) {
+      return err;
+    }
+    memcpy(encoder, &prevEncoder, sizeof(prevEncoder));
+    return oc_rep_encode_raw_items_internal(encoder, data, len);
+  }
+  return err;
+#endif /* OC_DYNAMIC_ALLOCATION */
 }
 
 static CborError
 oc_rep_encode_null_internal(CborEncoder *encoder)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_null(encoder);
+  CborError err = g_context->impl->encode_null(encoder);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -266,7 +471,7 @@ static CborError
 oc_rep_encode_boolean_internal(CborEncoder *encoder, bool value)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_boolean(encoder, value);
+  CborError err = g_context->impl->encode_boolean(encoder, value);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -296,7 +501,7 @@ static CborError
 oc_rep_encode_int_internal(CborEncoder *encoder, int64_t value)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_int(encoder, value);
+  CborError err = g_context->impl->encode_int(encoder, value);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -326,7 +531,7 @@ static CborError
 oc_rep_encode_uint_internal(CborEncoder *encoder, uint64_t value)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_uint(encoder, value);
+  CborError err = g_context->impl->encode_uint(encoder, value);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -357,7 +562,8 @@ oc_rep_encode_floating_point_internal(CborEncoder *encoder, CborType fpType,
                                       const void *value)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_floating_point(encoder, fpType, value);
+  CborError err =
+    g_context->impl->encode_floating_point(encoder, fpType, value);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -388,7 +594,7 @@ static CborError
 oc_rep_encode_double_internal(CborEncoder *encoder, double value)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_double(encoder, value);
+  CborError err = g_context->impl->encode_double(encoder, value);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -419,7 +625,8 @@ oc_rep_encode_text_string_internal(CborEncoder *encoder, const char *string,
                                    size_t length)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_text_string(encoder, string, length);
+  CborError err =
+    g_context->impl->encode_text_string(encoder, string, length);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -451,7 +658,8 @@ oc_rep_encode_byte_string_internal(CborEncoder *encoder, const uint8_t *string,
                                    size_t length)
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
-  CborError err = cbor_encode_byte_string(encoder, string, length);
+  CborError err =
+    g_context->impl->encode_byte_string(encoder, string, length);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   return err;
 }
@@ -484,7 +692,7 @@ oc_rep_encoder_create_array_internal(CborEncoder *encoder,
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
   oc_rep_encoder_convert_offset_to_ptr(arrayEncoder);
-  CborError err = cbor_encoder_create_array(encoder, arrayEncoder, length);
+  CborError err = g_context->impl->create_array(encoder, arrayEncoder, length);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   oc_rep_encoder_convert_ptr_to_offset(arrayEncoder);
   return err;
@@ -522,7 +730,7 @@ oc_rep_encoder_create_map_internal(CborEncoder *encoder,
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
   oc_rep_encoder_convert_offset_to_ptr(mapEncoder);
-  CborError err = cbor_encoder_create_map(encoder, mapEncoder, length);
+  CborError err = g_context->impl->create_map(encoder, mapEncoder, length);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   oc_rep_encoder_convert_ptr_to_offset(mapEncoder);
   return err;
@@ -560,7 +768,7 @@ oc_rep_encoder_close_container_internal(CborEncoder *encoder,
 {
   oc_rep_encoder_convert_offset_to_ptr(encoder);
   oc_rep_encoder_convert_offset_to_ptr(containerEncoder);
-  CborError err = cbor_encoder_close_container(encoder, containerEncoder);
+  CborError err = g_context->impl->close_container(encoder, containerEncoder);
   oc_rep_encoder_convert_ptr_to_offset(encoder);
   oc_rep_encoder_convert_ptr_to_offset(containerEncoder);
   return err;
@@ -19,7 +19,9 @@
 #ifndef OC_REP_ENCODE_INTERNAL_H
 #define OC_REP_ENCODE_INTERNAL_H
 
+#include "oc_ri.h"
 #include <cbor.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -27,28 +29,221 @@
 extern "C" {
 #endif
 
+/** @brief Payload formats produced by the encoder */
+typedef enum oc_rep_encoder_type_t {
+  OC_REP_CBOR_ENCODER = 0, ///< application/vnd.ocf+cbor
+#ifdef OC_JSON_ENCODER
+  OC_REP_JSON_ENCODER, ///< application/json
+#endif                 /* OC_JSON_ENCODER */
+#ifdef OC_SENML_ENCODER
+  OC_REP_SENML_CBOR_ENCODER, ///< application/senml+cbor
+#ifdef OC_JSON_ENCODER
+  OC_REP_SENML_JSON_ENCODER, ///< application/senml+json
+#endif                       /* OC_JSON_ENCODER */
+#endif                       /* OC_SENML_ENCODER */
+} oc_rep_encoder_type_t;
+
+/**
+ * @brief Encoder backend used by the oc_rep_encode_* functions.
+ *
+ * All functions work with encoders holding pointers to the buffer (not
+ * offsets), the conversion is done by the oc_rep_encode_* wrappers. The
+ * functions follow the conventions of the tinycbor encoder: when the buffer
+ * is too small the encoder keeps counting the missing bytes and
+ * CborErrorOutOfMemory is returned.
+ */
+typedef struct oc_rep_encoder_t
+{
+  oc_rep_encoder_type_t type;
+  oc_content_format_t content_format;
+
+  size_t (*get_buffer_size)(const CborEncoder *encoder, const uint8_t *buffer);
+  size_t (*get_extra_bytes_needed)(const CborEncoder *encoder);
+
+  CborError (*encode_null)(CborEncoder *encoder);
+  CborError (*encode_boolean)(CborEncoder *encoder, bool value);
+  CborError (*encode_int)(CborEncoder *encoder, int64_t value);
+  CborError (*encode_uint)(CborEncoder *encoder, uint64_t value);
+  CborError (*encode_floating_point)(CborEncoder *encoder, CborType fpType,
+                                     const void *value);
+  CborError (*encode_double)(CborEncoder *encoder, double value);
+  CborError (*encode_text_string)(CborEncoder *encoder, const char *string,
+                                  size_t length);
+  CborError (*encode_byte_string)(CborEncoder *encoder, const uint8_t *string,
+                                  size_t length);
+  CborError (*create_array)(CborEncoder *encoder, CborEncoder *arrayEncoder,
+                            size_t length);
+  CborError (*create_map)(CborEncoder *encoder, CborEncoder *mapEncoder,
+                          size_t length);
+  CborError (*close_container)(CborEncoder *encoder,
+                               const CborEncoder *containerEncoder);
+} oc_rep_encoder_t;
+
+/** @brief Get the CBOR encoder backend */
+const oc_rep_encoder_t *oc_rep_cbor_encoder(void);
+
+#ifdef OC_JSON_ENCODER
+/** @brief Get the JSON encoder backend */
+const oc_rep_encoder_t *oc_rep_json_encoder(void);
+
+/**
+ * @brief Encode a byte string as a base64url string without padding, as
+ * required by SenML JSON (RFC 8428, section 4.3).
+ */
+CborError oc_rep_json_encode_base64url(CborEncoder *encoder,
+                                       const uint8_t *string, size_t length);
+#endif /* OC_JSON_ENCODER */
+
+#ifdef OC_SENML_ENCODER
+/* Maximal length of the name of a SenML record */
+#ifndef OC_SENML_MAX_NAME_LENGTH
+#define OC_SENML_MAX_NAME_LENGTH (64)
+#endif /* OC_SENML_MAX_NAME_LENGTH */
+
+/* Maximal nesting of maps and arrays encoded to SenML */
+#ifndef OC_SENML_MAX_DEPTH
+#define OC_SENML_MAX_DEPTH (8)
+#endif /* OC_SENML_MAX_DEPTH */
+
+typedef struct oc_rep_senml_level_t
+{
+  uint32_t index;      ///< index of the next item of an array
+  uint16_t name_len;   ///< length of the name of the container
+  bool map;            ///< the container is a map
+  bool value_expected; ///< a key of the map was written
+} oc_rep_senml_level_t;
+
+/**
+ * @brief State of the SenML encoder.
+ *
+ * The records are written by the base encoder to a single array created when
+ * the root container is opened, the containers nested in it only extend the
+ * names of the records. The encoders of the containers are not used, the
+ * containers are strictly nested so the current one is on top of the stack.
+ */
+typedef struct oc_rep_senml_state_t
+{
+  const oc_rep_encoder_t *base;
+  bool json;
+  CborEncoder records; ///< array of records, holds offsets to the buffer
+  size_t bytes_needed; ///< bytes missing to finish the last failed operation
+  uint8_t depth;
+  oc_rep_senml_level_t levels[OC_SENML_MAX_DEPTH];
+  char name[OC_SENML_MAX_NAME_LENGTH];
+  size_t name_len;
+} oc_rep_senml_state_t;
+
+/**
+ * @brief Reset the state of the SenML encoder of the current context and get
+ * its backend.
+ *
+ * The SenML backends convert the representation into a SenML pack (RFC 8428).
+ * Every value is written as a record named by the path of keys and array
+ * indexes leading to it (e.g. "light/0/on"). Null values have no SenML
+ * representation and are omitted.
+ *
+ * @param type OC_REP_SENML_CBOR_ENCODER or OC_REP_SENML_JSON_ENCODER
+ * @return backend writing the SenML pack in the selected format
+ */
+const oc_rep_encoder_t *oc_rep_senml_encoder_init(oc_rep_encoder_type_t type);
+#endif /* OC_SENML_ENCODER */
+
+struct oc_rep_encoder_context_t
+{
+  const oc_rep_encoder_t *impl; ///< backend producing the payload format
+  CborEncoder encoder;          ///< root encoder, holds offsets to the buffer
+  // root_map, links_array and g_err of the context while it is not current
+  CborEncoder root;
+  CborEncoder links;
+  int err;
+  uint8_t *buf;
+#ifdef OC_DYNAMIC_ALLOCATION
+  bool enable_realloc;
+  size_t buf_size;
+  size_t buf_max_size;
+  uint8_t **buf_ptr;
+#endif /* OC_DYNAMIC_ALLOCATION */
+#ifdef OC_SENML_ENCODER
+  oc_rep_senml_state_t senml;
+#endif /* OC_SENML_ENCODER */
+};
+
+/**
+ * @brief Make the context the current context of the encoder.
+ *
+ * The context must stay valid until it is replaced by another context. Users
+ * encoding a payload in a scope where another payload might be in progress
+ * (a request handler, a client request being built) should switch to their
+ * own context and restore the previous one when done:
+ *
+ * @code{.c}
+ * oc_rep_encoder_context_t ctx;
+ * oc_rep_encoder_context_t *prev = oc_rep_encoder_set_context(&ctx);
+ * oc_rep_new_realloc(&buffer, size, max_size);
+ * ...
+ * oc_rep_encoder_set_context(prev);
+ * @endcode
+ *
+ * @note The current context is a process global and switching copies
+ * root_map, links_array and g_err in and out of the contexts, so the encoder
+ * must be used by a single thread at a time.
+ *
+ * @param ctx the context (NULL for the default context of the stack)
+ * @return the previous current context
+ */
+oc_rep_encoder_context_t *oc_rep_encoder_set_context(
+  oc_rep_encoder_context_t *ctx);
+
+/** @brief Get the current context of the encoder */
+oc_rep_encoder_context_t *oc_rep_encoder_get_context(void);
+
+/**
+ * @brief Set the payload format produced by the current encoder.
+ *
+ * @note oc_rep_encoder_init and oc_rep_encoder_realloc_init reset the format
+ * to CBOR, so the format must be set after the encoder is initialized and
+ * before anything is encoded.
+ */
+void oc_rep_encoder_set_type(oc_rep_encoder_type_t type);
+
+/** @brief Get the payload format produced by the current encoder */
+oc_rep_encoder_type_t oc_rep_encoder_get_type(void);
+
+/**
+ * @brief Set the payload format of the current encoder from the value of the
+ * Accept option.
+ *
+ * @param accept value of the Accept option (0 if not present)
+ * @return true the format was set
+ * @return false the format is not supported, the format was set to CBOR
+ */
+bool oc_rep_encoder_set_type_by_accept(oc_content_format_t accept);
+
+/** @brief Get the Content-Format of the payload of the current encoder */
+oc_content_format_t oc_rep_encoder_get_content_format(void);
+
 /**
- * @brief Initialize global cbor encoder with buffer.
+ * @brief Initialize the cbor encoder of the current context with buffer.
  *
  * @note the encoder doesn't store the pointer to the buffer directly, instead
- * it stores an offset from the global buffer to allow reallocation.
+ * it stores an offset from the buffer of the context to allow reallocation.
  *
- * @param buffer buffer used by the global encoder (cannot be NULL)
+ * @param buffer buffer used by the encoder (cannot be NULL)
  * @param size size of the buffer
  */
 void oc_rep_encoder_init(uint8_t *buffer, size_t size);
 
 /**
- * @brief Initialize global cbor encoder with buffer and enable buffer
- * reallocation.
+ * @brief Initialize the cbor encoder of the current context with buffer and
+ * enable buffer reallocation.
  *
  * If the buffer is too small then the buffer will be enlarged using the realloc
  * syscall. The size of the buffer cannot exceed the maximal allowed size.
  *
  * @note the encoder doesn't store the pointer to the buffer directly, instead
- * it stores an offset from the global buffer to allow reallocation.
+ * it stores an offset from the buffer of the context to allow reallocation.
  *
- * @param buffer pointer buffer used by the global encoder (cannot be NULL)
+ * @param buffer pointer buffer used by the encoder (cannot be NULL)
  * @param size size of the buffer
  * @param max_size maximal allowed size of the buffer
  */
@@ -57,7 +252,7 @@ void oc_rep_encoder_realloc_init(uint8_t **buffer, size_t size,
 
 /**
  * @brief Recalcute the pointer to the buffer and the pointer to the end of the
- * buffer to be offsets from the global buffer.
+ * buffer to be offsets from the buffer of the current context.
  */
 CborEncoder *oc_rep_encoder_convert_ptr_to_offset(CborEncoder *encoder);
 
@@ -67,6 +262,22 @@ CborEncoder *oc_rep_encoder_convert_ptr_to_offset(CborEncoder *encoder);
  */
 CborEncoder *oc_rep_encoder_convert_offset_to_ptr(CborEncoder *encoder);
 
+/**
+ * @brief Write already encoded CBOR items into the container, the bytes are
+ * copied as they are.
+ *
+ * Only usable with the CBOR encoder and with containers of indefinite length
+ * (e.g. root_map), the encoder doesn't count the written items.
+ *
+ * @param encoder encoder of the container (cannot be NULL)
+ * @param data encoded items
+ * @param len length of the data
+ * @return CborNoError on success
+ * @return CborErrorOutOfMemory the buffer is too small
+ */
+CborError oc_rep_encode_raw_items(CborEncoder *encoder, const uint8_t *data,
+                                  size_t len);
+
 #ifdef __cplusplus
 }
 #endif
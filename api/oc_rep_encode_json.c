@@ -0,0 +1,355 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifdef OC_JSON_ENCODER
+
+#include "oc_base64.h"
+#include "oc_rep_encode_internal.h"
+#include "port/oc_log_internal.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* The JSON writer keeps its state in the CborEncoder structure:
+ *  - data.ptr and end: position in the buffer, after the buffer runs out end
+ *    is NULL and data.bytes_needed counts the missing bytes (same as tinycbor)
+ *  - remaining: number of items written to the container
+ *  - flags: type of the container and whether a map expects a value
+ */
+#define JSON_FLAG_MAP (1 << 0)
+#define JSON_FLAG_ARRAY (1 << 1)
+#define JSON_FLAG_VALUE_EXPECTED (1 << 2)
+
+static size_t
+json_get_buffer_size(const CborEncoder *encoder, const uint8_t *buffer)
+{
+  return (size_t)(encoder->data.ptr - buffer);
+}
+
+static size_t
+json_get_extra_bytes_needed(const CborEncoder *encoder)
+{
+  return encoder->end != NULL ? 0 : (size_t)encoder->data.bytes_needed;
+}
+
+/* Reserve len bytes in the buffer, returns NULL if the buffer is too small */
+static uint8_t *
+json_reserve(CborEncoder *encoder, size_t len)
+{
+  if (encoder->end == NULL) {
+    encoder->data.bytes_needed += (ptrdiff_t)len;
+    return NULL;
+  }
+  size_t remaining = (size_t)(encoder->end - encoder->data.ptr);
+  if (len > remaining) {
+    encoder->end = NULL;
+    encoder->data.bytes_needed = (ptrdiff_t)(len - remaining);
+    return NULL;
+  }
+  uint8_t *ptr = encoder->data.ptr;
+  encoder->data.ptr += len;
+  return ptr;
+}
+
+static CborError
+json_write(CborEncoder *encoder, const char *data, size_t len)
+{
+  uint8_t *ptr = json_reserve(encoder, len);
+  if (ptr == NULL) {
+    return CborErrorOutOfMemory;
+  }
+  memcpy(ptr, data, len);
+  return CborNoError;
+}
+
+/* Write the separator preceding a value and update the container state */
+static CborError
+json_begin_value(CborEncoder *encoder)
+{
+  if ((encoder->flags & JSON_FLAG_MAP) != 0) {
+    if ((encoder->flags & JSON_FLAG_VALUE_EXPECTED) == 0) {
+      OC_ERR("json: map key must be a text string");
+      return CborErrorIllegalType;
+    }
+    encoder->flags &= ~JSON_FLAG_VALUE_EXPECTED;
+    return CborNoError;
+  }
+  if ((encoder->flags & JSON_FLAG_ARRAY) != 0 && encoder->remaining++ > 0) {
+    return json_write(encoder, ",", 1);
+  }
+  return CborNoError;
+}
+
+static CborError
+json_write_escaped(CborEncoder *encoder, const char *string, size_t length)
+{
+  CborError err = json_write(encoder, "\"", 1);
+  size_t start = 0;
+  for (size_t i = 0; i < length; ++i) {
+    unsigned char c = (unsigned char)string[i];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      continue;
+    }
+    err |= json_write(encoder, string + start, i - start);
+    char escaped[7];
+    switch (c) {
+    case '"':
+    case '\\':
+      escaped[0] = '\\';
+      escaped[1] = (char)c;
+      err |= json_write(encoder, escaped, 2);
+      break;
+    case '\b':
+      err |= json_write(encoder, "\\b", 2);
+      break;
+    case '\f':
+      err |= json_write(encoder, "\\f", 2);
+      break;
+    case '\n':
+      err |= json_write(encoder, "\\n", 2);
+      break;
+    case '\r':
+      err |= json_write(encoder, "\\r", 2);
+      break;
+    case '\t':
+      err |= json_write(encoder, "\\t", 2);
+      break;
+    default:
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      err |= json_write(encoder, escaped, 6);
+      break;
+    }
+    start = i + 1;
+  }
+  err |= json_write(encoder, string + start, length - start);
+  err |= json_write(encoder, "\"", 1);
+  return err;
+}
+
+static CborError
+json_encode_literal(CborEncoder *encoder, const char *literal)
+{
+  CborError err = json_begin_value(encoder);
+  if (err == CborErrorIllegalType) {
+    return err;
+  }
+  return err | json_write(encoder, literal, strlen(literal));
+}
+
+static CborError
+json_encode_null(CborEncoder *encoder)
+{
+  return json_encode_literal(encoder, "null");
+}
+
+static CborError
+json_encode_boolean(CborEncoder *encoder, bool value)
+{
+  return json_encode_literal(encoder, value ? "true" : "false");
+}
+
+static CborError
+json_encode_int(CborEncoder *encoder, int64_t value)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%" PRId64, value);
+  return json_encode_literal(encoder, buf);
+}
+
+static CborError
+json_encode_uint(CborEncoder *encoder, uint64_t value)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%" PRIu64, value);
+  return json_encode_literal(encoder, buf);
+}
+
+static CborError
+json_encode_double(CborEncoder *encoder, double value)
+{
+  if (isnan(value) || isinf(value)) {
+    OC_ERR("json: cannot encode NaN or infinity");
+    return CborErrorIllegalNumber;
+  }
+  // 17 significant digits are enough to restore the exact double value
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.17g", value);
+  return json_encode_literal(encoder, buf);
+}
+
+static CborError
+json_encode_floating_point(CborEncoder *encoder, CborType fpType,
+                           const void *value)
+{
+  if (fpType == CborDoubleType) {
+    return json_encode_double(encoder, *(const double *)value);
+  }
+  if (fpType == CborFloatType) {
+    return json_encode_double(encoder, (double)*(const float *)value);
+  }
+  OC_ERR("json: unsupported floating point type %d", (int)fpType);
+  return CborErrorIllegalType;
+}
+
+static CborError
+json_encode_text_string(CborEncoder *encoder, const char *string,
+                        size_t length)
+{
+  if ((encoder->flags & JSON_FLAG_MAP) != 0 &&
+      (encoder->flags & JSON_FLAG_VALUE_EXPECTED) == 0) {
+    // map key
+    CborError err = CborNoError;
+    if (encoder->remaining++ > 0) {
+      err |= json_write(encoder, ",", 1);
+    }
+    err |= json_write_escaped(encoder, string, length);
+    err |= json_write(encoder, ":", 1);
+    encoder->flags |= JSON_FLAG_VALUE_EXPECTED;
+    return err;
+  }
+  CborError err = json_begin_value(encoder);
+  if (err == CborErrorIllegalType) {
+    return err;
+  }
+  return err | json_write_escaped(encoder, string, length);
+}
+
+static CborError
+json_encode_base64(CborEncoder *encoder, const uint8_t *string, size_t length,
+                   bool url)
+{
+  CborError err = json_begin_value(encoder);
+  if (err == CborErrorIllegalType) {
+    return err;
+  }
+  err |= json_write(encoder, "\"", 1);
+  size_t output_len = ((length + 2) / 3) * 4;
+  uint8_t *output = json_reserve(encoder, output_len);
+  if (output != NULL) {
+    if (oc_base64_encode(string, length, output, output_len) < 0) {
+      return CborErrorInternalError;
+    }
+    if (url) {
+      // base64url alphabet and no padding
+      while (output_len > 0 && output[output_len - 1] == '=') {
+        --output_len;
+        --encoder->data.ptr;
+      }
+      for (size_t i = 0; i < output_len; ++i) {
+        if (output[i] == '+') {
+          output[i] = '-';
+        } else if (output[i] == '/') {
+          output[i] = '_';
+        }
+      }
+    }
+  } else {
+    err |= CborErrorOutOfMemory;
+  }
+  err |= json_write(encoder, "\"", 1);
+  return err;
+}
+
+static CborError
+json_encode_byte_string(CborEncoder *encoder, const uint8_t *string,
+                        size_t length)
+{
+  return json_encode_base64(encoder, string, length, false);
+}
+
+CborError
+oc_rep_json_encode_base64url(CborEncoder *encoder, const uint8_t *string,
+                             size_t length)
+{
+  return json_encode_base64(encoder, string, length, true);
+}
+
+static CborError
+json_create_container(CborEncoder *encoder, CborEncoder *container,
+                      const char *open, int flags)
+{
+  CborError err = json_begin_value(encoder);
+  if (err == CborErrorIllegalType) {
+    return err;
+  }
+  err |= json_write(encoder, open, 1);
+  container->data = encoder->data;
+  container->end = encoder->end;
+  container->remaining = 0;
+  container->flags = flags;
+  return err;
+}
+
+static CborError
+json_create_array(CborEncoder *encoder, CborEncoder *arrayEncoder,
+                  size_t length)
+{
+  (void)length;
+  return json_create_container(encoder, arrayEncoder, "[", JSON_FLAG_ARRAY);
+}
+
+static CborError
+json_create_map(CborEncoder *encoder, CborEncoder *mapEncoder, size_t length)
+{
+  (void)length;
+  return json_create_container(encoder, mapEncoder, "{", JSON_FLAG_MAP);
+}
+
+static CborError
+json_close_container(CborEncoder *encoder, const CborEncoder *containerEncoder)
+{
+  encoder->data = containerEncoder->data;
+  encoder->end = containerEncoder->end;
+  if ((containerEncoder->flags & JSON_FLAG_VALUE_EXPECTED) != 0) {
+    OC_ERR("json: missing value of the last map key");
+    return CborErrorIllegalType;
+  }
+  const char *close =
+    (containerEncoder->flags & JSON_FLAG_MAP) != 0 ? "}" : "]";
+  return json_write(encoder, close, 1);
+}
+
+static const oc_rep_encoder_t g_json_encoder = {
+  .type = OC_REP_JSON_ENCODER,
+  .content_format = APPLICATION_JSON,
+  .get_buffer_size = &json_get_buffer_size,
+  .get_extra_bytes_needed = &json_get_extra_bytes_needed,
+  .encode_null = &json_encode_null,
+  .encode_boolean = &json_encode_boolean,
+  .encode_int = &json_encode_int,
+  .encode_uint = &json_encode_uint,
+  .encode_floating_point = &json_encode_floating_point,
+  .encode_double = &json_encode_double,
+  .encode_text_string = &json_encode_text_string,
+  .encode_byte_string = &json_encode_byte_string,
+  .create_array = &json_create_array,
+  .create_map = &json_create_map,
+  .close_container = &json_close_container,
+};
+
+const oc_rep_encoder_t *
+oc_rep_json_encoder(void)
+{
+  return &g_json_encoder;
+}
+
+#else  /* !OC_JSON_ENCODER */
+typedef int dummy_declaration;
+#endif /* OC_JSON_ENCODER */
@@ -0,0 +1,446 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifdef OC_SENML_ENCODER
+
+#include "oc_rep_encode_internal.h"
+#include "port/oc_log_internal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/* SenML labels, RFC 8428 section 6 */
+typedef enum {
+  SENML_NAME = 0,
+  SENML_VALUE = 2,
+  SENML_STRING_VALUE = 3,
+  SENML_BOOLEAN_VALUE = 4,
+  SENML_DATA_VALUE = 8,
+} senml_label_t;
+
+typedef enum {
+  SENML_TYPE_BOOLEAN,
+  SENML_TYPE_INT,
+  SENML_TYPE_UINT,
+  SENML_TYPE_DOUBLE,
+  SENML_TYPE_TEXT_STRING,
+  SENML_TYPE_BYTE_STRING,
+} senml_value_type_t;
+
+typedef struct
+{
+  senml_value_type_t type;
+  union {
+    bool boolean;
+    int64_t i;
+    uint64_t u;
+    double d;
+    struct
+    {
+      const void *data;
+      size_t length;
+    } string;
+  } value;
+} senml_value_t;
+
+static oc_rep_senml_state_t *
+senml_state(void)
+{
+  return &oc_rep_encoder_get_context()->senml;
+}
+
+static size_t
+senml_get_buffer_size(const CborEncoder *encoder, const uint8_t *buffer)
+{
+  return senml_state()->base->get_buffer_size(encoder, buffer);
+}
+
+static size_t
+senml_get_extra_bytes_needed(const CborEncoder *encoder)
+{
+  (void)encoder;
+  return senml_state()->bytes_needed;
+}
+
+static CborError
+senml_set_name(const oc_rep_senml_level_t *level, const char *segment,
+               size_t length)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  size_t len = level->name_len;
+  if (len + (len > 0 ? 1 : 0) + length > sizeof(senml->name)) {
+    OC_ERR("senml: record name exceeds %d characters",
+           OC_SENML_MAX_NAME_LENGTH);
+    return CborErrorIllegalType;
+  }
+  if (len > 0) {
+    senml->name[len++] = '/';
+  }
+  memcpy(senml->name + len, segment, length);
+  senml->name_len = len + length;
+  return CborNoError;
+}
+
+/* Set the name of the next value of the current container */
+static CborError
+senml_resolve_name(void)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  if (senml->depth == 0) {
+    OC_ERR("senml: value must be nested in a map or an array");
+    return CborErrorIllegalType;
+  }
+  oc_rep_senml_level_t *level = &senml->levels[senml->depth - 1];
+  if (level->map) {
+    if (!level->value_expected) {
+      OC_ERR("senml: map key must be a text string");
+      return CborErrorIllegalType;
+    }
+    level->value_expected = false;
+    return CborNoError;
+  }
+  char index[12];
+  int len = snprintf(index, sizeof(index), "%u", (unsigned)level->index);
+  CborError err = senml_set_name(level, index, (size_t)len);
+  if (err == CborNoError) {
+    ++level->index;
+  }
+  return err;
+}
+
+static CborError
+senml_encode_label(CborEncoder *record, senml_label_t label)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  if (senml->json) {
+    const char *str = "n";
+    switch (label) {
+    case SENML_NAME:
+      break;
+    case SENML_VALUE:
+      str = "v";
+      break;
+    case SENML_STRING_VALUE:
+      str = "vs";
+      break;
+    case SENML_BOOLEAN_VALUE:
+      str = "vb";
+      break;
+    case SENML_DATA_VALUE:
+      str = "vd";
+      break;
+    }
+    return senml->base->encode_text_string(record, str, strlen(str));
+  }
+  return senml->base->encode_int(record, label);
+}
+
+static CborError
+senml_encode_record_value(CborEncoder *record, const senml_value_t *value)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  const oc_rep_encoder_t *base = senml->base;
+  switch (value->type) {
+  case SENML_TYPE_BOOLEAN:
+    return senml_encode_label(record, SENML_BOOLEAN_VALUE) |
+           base->encode_boolean(record, value->value.boolean);
+  case SENML_TYPE_INT:
+    return senml_encode_label(record, SENML_VALUE) |
+           base->encode_int(record, value->value.i);
+  case SENML_TYPE_UINT:
+    return senml_encode_label(record, SENML_VALUE) |
+           base->encode_uint(record, value->value.u);
+  case SENML_TYPE_DOUBLE:
+    return senml_encode_label(record, SENML_VALUE) |
+           base->encode_double(record, value->value.d);
+  case SENML_TYPE_TEXT_STRING:
+    return senml_encode_label(record, SENML_STRING_VALUE) |
+           base->encode_text_string(record,
+                                    (const char *)value->value.string.data,
+                                    value->value.string.length);
+  case SENML_TYPE_BYTE_STRING: {
+    CborError err = senml_encode_label(record, SENML_DATA_VALUE);
+#ifdef OC_JSON_ENCODER
+    if (senml->json) {
+      return err | oc_rep_json_encode_base64url(
+                     record, (const uint8_t *)value->value.string.data,
+                     value->value.string.length);
+    }
+#endif /* OC_JSON_ENCODER */
+    return err | base->encode_byte_string(
+                   record, (const uint8_t *)value->value.string.data,
+                   value->value.string.length);
+  }
+  }
+  return CborErrorInternalError;
+}
+
+static CborError
+senml_encode_value(const senml_value_t *value)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  CborError err = senml_resolve_name();
+  if (err != CborNoError) {
+    return err;
+  }
+  oc_rep_senml_level_t *level = &senml->levels[senml->depth - 1];
+  oc_rep_senml_level_t prev_level = *level;
+  if (level->map) {
+    prev_level.value_expected = true;
+  } else {
+    --prev_level.index;
+  }
+  // keep the state to retry the operation after the buffer is reallocated
+  CborEncoder records = senml->records;
+  oc_rep_encoder_convert_offset_to_ptr(&senml->records);
+  CborEncoder record;
+  memset(&record, 0, sizeof(record));
+  const oc_rep_encoder_t *base = senml->base;
+  err = base->create_map(&senml->records, &record, 2);
+  err |= senml_encode_label(&record, SENML_NAME);
+  err |= base->encode_text_string(&record, senml->name, senml->name_len);
+  err |= senml_encode_record_value(&record, value);
+  err |= base->close_container(&senml->records, &record);
+  if (err == CborErrorOutOfMemory) {
+    senml->bytes_needed = base->get_extra_bytes_needed(&senml->records);
+    senml->records = records;
+    *level = prev_level;
+    return err;
+  }
+  oc_rep_encoder_convert_ptr_to_offset(&senml->records);
+  return err;
+}
+
+static CborError
+senml_encode_null(CborEncoder *encoder)
+{
+  (void)encoder;
+  // SenML has no null value, the record is omitted
+  return senml_resolve_name();
+}
+
+static CborError
+senml_encode_boolean(CborEncoder *encoder, bool value)
+{
+  (void)encoder;
+  senml_value_t v = { .type = SENML_TYPE_BOOLEAN, .value.boolean = value };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_encode_int(CborEncoder *encoder, int64_t value)
+{
+  (void)encoder;
+  senml_value_t v = { .type = SENML_TYPE_INT, .value.i = value };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_encode_uint(CborEncoder *encoder, uint64_t value)
+{
+  (void)encoder;
+  senml_value_t v = { .type = SENML_TYPE_UINT, .value.u = value };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_encode_double(CborEncoder *encoder, double value)
+{
+  (void)encoder;
+  senml_value_t v = { .type = SENML_TYPE_DOUBLE, .value.d = value };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_encode_floating_point(CborEncoder *encoder, CborType fpType,
+                            const void *value)
+{
+  if (fpType == CborDoubleType) {
+    return senml_encode_double(encoder, *(const double *)value);
+  }
+  if (fpType == CborFloatType) {
+    return senml_encode_double(encoder, (double)*(const float *)value);
+  }
+  OC_ERR("senml: unsupported floating point type %d", (int)fpType);
+  return CborErrorIllegalType;
+}
+
+static CborError
+senml_encode_text_string(CborEncoder *encoder, const char *string,
+                         size_t length)
+{
+  (void)encoder;
+  oc_rep_senml_state_t *senml = senml_state();
+  if (senml->depth > 0) {
+    oc_rep_senml_level_t *level = &senml->levels[senml->depth - 1];
+    if (level->map && !level->value_expected) {
+      CborError err = senml_set_name(level, string, length);
+      if (err == CborNoError) {
+        level->value_expected = true;
+      }
+      return err;
+    }
+  }
+  senml_value_t v = { .type = SENML_TYPE_TEXT_STRING,
+                      .value.string = { string, length } };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_encode_byte_string(CborEncoder *encoder, const uint8_t *string,
+                         size_t length)
+{
+  (void)encoder;
+  senml_value_t v = { .type = SENML_TYPE_BYTE_STRING,
+                      .value.string = { string, length } };
+  return senml_encode_value(&v);
+}
+
+static CborError
+senml_create_container(CborEncoder *encoder, CborEncoder *container, bool map)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  if (senml->depth == OC_SENML_MAX_DEPTH) {
+    OC_ERR("senml: containers nested deeper than %d", OC_SENML_MAX_DEPTH);
+    return CborErrorIllegalType;
+  }
+  if (senml->depth == 0) {
+    // the root container is the array of records
+    CborError err = senml->base->create_array(encoder, &senml->records,
+                                               CborIndefiniteLength);
+    memcpy(container, &senml->records, sizeof(CborEncoder));
+    if (err == CborErrorOutOfMemory) {
+      senml->bytes_needed =
+        senml->base->get_extra_bytes_needed(&senml->records);
+    }
+    oc_rep_encoder_convert_ptr_to_offset(&senml->records);
+    if (err != CborNoError) {
+      return err;
+    }
+    senml->name_len = 0;
+  } else {
+    CborError err = senml_resolve_name();
+    if (err != CborNoError) {
+      return err;
+    }
+    memcpy(container, encoder, sizeof(CborEncoder));
+  }
+  oc_rep_senml_level_t *level = &senml->levels[senml->depth++];
+  memset(level, 0, sizeof(*level));
+  level->name_len = (uint16_t)senml->name_len;
+  level->map = map;
+  return CborNoError;
+}
+
+static CborError
+senml_create_array(CborEncoder *encoder, CborEncoder *arrayEncoder,
+                   size_t length)
+{
+  (void)length;
+  return senml_create_container(encoder, arrayEncoder, false);
+}
+
+static CborError
+senml_create_map(CborEncoder *encoder, CborEncoder *mapEncoder, size_t length)
+{
+  (void)length;
+  return senml_create_container(encoder, mapEncoder, true);
+}
+
+static CborError
+senml_close_container(CborEncoder *encoder, const CborEncoder *containerEncoder)
+{
+  (void)containerEncoder;
+  oc_rep_senml_state_t *senml = senml_state();
+  if (senml->depth == 0) {
+    OC_ERR("senml: no container to close");
+    return CborErrorInternalError;
+  }
+  if (senml->depth > 1) {
+    --senml->depth;
+    return CborNoError;
+  }
+  oc_rep_encoder_convert_offset_to_ptr(&senml->records);
+  CborError err = senml->base->close_container(encoder, &senml->records);
+  oc_rep_encoder_convert_ptr_to_offset(&senml->records);
+  if (err == CborErrorOutOfMemory) {
+    senml->bytes_needed = senml->base->get_extra_bytes_needed(encoder);
+    return err;
+  }
+  --senml->depth;
+  return err;
+}
+
+static const oc_rep_encoder_t g_senml_cbor_encoder = {
+  .type = OC_REP_SENML_CBOR_ENCODER,
+  .content_format = APPLICATION_SENML_CBOR,
+  .get_buffer_size = &senml_get_buffer_size,
+  .get_extra_bytes_needed = &senml_get_extra_bytes_needed,
+  .encode_null = &senml_encode_null,
+  .encode_boolean = &senml_encode_boolean,
+  .encode_int = &senml_encode_int,
+  .encode_uint = &senml_encode_uint,
+  .encode_floating_point = &senml_encode_floating_point,
+  .encode_double = &senml_encode_double,
+  .encode_text_string = &senml_encode_text_string,
+  .encode_byte_string = &senml_encode_byte_string,
+  .create_array = &senml_create_array,
+  .create_map = &senml_create_map,
+  .close_container = &senml_close_container,
+};
+
+#ifdef OC_JSON_ENCODER
+static const oc_rep_encoder_t g_senml_json_encoder = {
+  .type = OC_REP_SENML_JSON_ENCODER,
+  .content_format = APPLICATION_SENML_JSON,
+  .get_buffer_size = &senml_get_buffer_size,
+  .get_extra_bytes_needed = &senml_get_extra_bytes_needed,
+  .encode_null = &senml_encode_null,
+  .encode_boolean = &senml_encode_boolean,
+  .encode_int = &senml_encode_int,
+  .encode_uint = &senml_encode_uint,
+  .encode_floating_point = &senml_encode_floating_point,
+  .encode_double = &senml_encode_double,
+  .encode_text_string = &senml_encode_text_string,
+  .encode_byte_string = &senml_encode_byte_string,
+  .create_array = &senml_create_array,
+  .create_map = &senml_create_map,
+  .close_container = &senml_close_container,
+};
+#endif /* OC_JSON_ENCODER */
+
+const oc_rep_encoder_t *
+oc_rep_senml_encoder_init(oc_rep_encoder_type_t type)
+{
+  oc_rep_senml_state_t *senml = senml_state();
+  memset(senml, 0, sizeof(*senml));
+#ifdef OC_JSON_ENCODER
+  if (type == OC_REP_SENML_JSON_ENCODER) {
+    senml->base = oc_rep_json_encoder();
+    senml->json = true;
+    return &g_senml_json_encoder;
+  }
+#endif /* OC_JSON_ENCODER */
+  (void)type;
+  senml->base = oc_rep_cbor_encoder();
+  return &g_senml_cbor_encoder;
+}
+
+#else  /* !OC_SENML_ENCODER */
+typedef int dummy_declaration;
+#endif /* OC_SENML_ENCODER */
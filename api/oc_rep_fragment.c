@@ -0,0 +1,179 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "api/oc_rep_encode_internal.h"
+#include "api/oc_rep_fragment_internal.h"
+#include "oc_rep.h"
+#include "port/oc_log_internal.h"
+#include "util/oc_hash.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef OC_DYNAMIC_ALLOCATION
+#include <stdlib.h>
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+typedef struct oc_rep_fragment_t
+{
+  struct oc_rep_fragment_t *next;
+  const oc_resource_t *resource;
+  oc_interface_mask_t iface_mask;
+  uint64_t fingerprint;
+  bool valid; ///< false if the fragment cannot be cached
+  size_t size;
+#ifdef OC_DYNAMIC_ALLOCATION
+  uint8_t *data;
+#else  /* !OC_DYNAMIC_ALLOCATION */
+  uint8_t data[OC_REP_FRAGMENT_MAX_SIZE];
+#endif /* OC_DYNAMIC_ALLOCATION */
+} oc_rep_fragment_t;
+
+OC_LIST(g_rep_fragments);
+OC_MEMB(g_rep_fragments_s, oc_rep_fragment_t, OC_REP_FRAGMENTS_MAX_NUM);
+
+uint64_t
+oc_rep_fragment_fingerprint(uint64_t fingerprint, const void *data, size_t len)
+{
+  // the length separates consecutive values, ("ab", "c") and ("a", "bc") must
+  // not produce the same fingerprint
+  fingerprint = oc_hash_fnv1a64(fingerprint, &len, sizeof(len));
+  return oc_hash_fnv1a64(fingerprint, data, len);
+}
+
+static oc_rep_fragment_t *
+rep_fragment_find(const oc_resource_t *resource, oc_interface_mask_t iface_mask)
+{
+  oc_rep_fragment_t *fragment =
+    (oc_rep_fragment_t *)oc_list_head(g_rep_fragments);
+  while (fragment != NULL) {
+    if (fragment->resource == resource && fragment->iface_mask == iface_mask) {
+      return fragment;
+    }
+    fragment = fragment->next;
+  }
+  return NULL;
+}
+
+static void
+rep_fragment_free(oc_rep_fragment_t *fragment)
+{
+  oc_list_remove(g_rep_fragments, fragment);
+#ifdef OC_DYNAMIC_ALLOCATION
+  free(fragment->data);
+#endif /* OC_DYNAMIC_ALLOCATION */
+  oc_memb_free(&g_rep_fragments_s, fragment);
+}
+
+/* Encode the properties as a root object into a temporary buffer, the fragment
+ * is the content of the object without the header of the indefinite length
+ * map and the terminating break. */
+static bool
+rep_fragment_encode_data(oc_rep_fragment_t *fragment,
+                         oc_rep_fragment_encode_cb_t encode, void *data)
+{
+  uint8_t buf[OC_REP_FRAGMENT_MAX_SIZE + 2];
+  oc_rep_encoder_context_t ctx;
+  oc_rep_encoder_context_t *prev_ctx = oc_rep_encoder_set_context(&ctx);
+  oc_rep_new(buf, sizeof(buf));
+  oc_rep_start_root_object();
+  encode(fragment->resource, data);
+  oc_rep_end_root_object();
+  int size = oc_rep_get_encoded_payload_size();
+  oc_rep_encoder_set_context(prev_ctx);
+  if (size < 2) {
+    OC_DBG("cannot encode fragment of resource(%s)",
+           oc_string(fragment->resource->uri));
+    return false;
+  }
+  size_t fragment_size = (size_t)size - 2;
+#ifdef OC_DYNAMIC_ALLOCATION
+  if (fragment_size != fragment->size || fragment->data == NULL) {
+    uint8_t *fragment_data = (uint8_t *)realloc(
+      fragment->data, fragment_size > 0 ? fragment_size : 1);
+    if (fragment_data == NULL) {
+      return false;
+    }
+    fragment->data = fragment_data;
+  }
+#endif /* OC_DYNAMIC_ALLOCATION */
+  memcpy(fragment->data, buf + 1, fragment_size);
+  fragment->size = fragment_size;
+  return true;
+}
+
+static const oc_rep_fragment_t *
+rep_fragment_get(const oc_resource_t *resource, oc_interface_mask_t iface_mask,
+                 uint64_t fingerprint, oc_rep_fragment_encode_cb_t encode,
+                 void *data)
+{
+  oc_rep_fragment_t *fragment = rep_fragment_find(resource, iface_mask);
+  if (fragment == NULL) {
+    fragment = (oc_rep_fragment_t *)oc_memb_alloc(&g_rep_fragments_s);
+    if (fragment == NULL) {
+      OC_DBG("cannot allocate fragment of resource(%s)",
+             oc_string(resource->uri));
+      return NULL;
+    }
+    fragment->resource = resource;
+    fragment->iface_mask = iface_mask;
+    oc_list_add(g_rep_fragments, fragment);
+  } else if (fragment->fingerprint == fingerprint) {
+    return fragment->valid ? fragment : NULL;
+  }
+  // an uncacheable fragment is not retried until the encoded values change
+  fragment->fingerprint = fingerprint;
+  fragment->valid = rep_fragment_encode_data(fragment, encode, data);
+  return fragment->valid ? fragment : NULL;
+}
+
+void
+oc_rep_fragment_encode(const oc_resource_t *resource,
+                       oc_interface_mask_t iface_mask, uint64_t fingerprint,
+                       oc_rep_fragment_encode_cb_t encode, void *data)
+{
+  assert(resource != NULL);
+  assert(encode != NULL);
+  if (oc_rep_encoder_get_type() != OC_REP_CBOR_ENCODER) {
+    encode(resource, data);
+    return;
+  }
+  const oc_rep_fragment_t *fragment =
+    rep_fragment_get(resource, iface_mask, fingerprint, encode, data);
+  if (fragment == NULL) {
+    encode(resource, data);
+    return;
+  }
+  g_err |= oc_rep_encode_raw_items(&root_map, fragment->data, fragment->size);
+}
+
+void
+oc_rep_fragment_invalidate(const oc_resource_t *resource)
+{
+  oc_rep_fragment_t *fragment =
+    (oc_rep_fragment_t *)oc_list_head(g_rep_fragments);
+  while (fragment != NULL) {
+    oc_rep_fragment_t *next = fragment->next;
+    if (resource == NULL || fragment->resource == resource) {
+      rep_fragment_free(fragment);
+    }
+    fragment = next;
+  }
+}
@@ -0,0 +1,102 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef OC_REP_FRAGMENT_INTERNAL_H
+#define OC_REP_FRAGMENT_INTERNAL_H
+
+#include "oc_ri.h"
+#include "util/oc_hash.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximal size of a pre-encoded fragment, larger fragments are not cached and
+ * are encoded with each response. */
+#ifndef OC_REP_FRAGMENT_MAX_SIZE
+#define OC_REP_FRAGMENT_MAX_SIZE (256)
+#endif /* OC_REP_FRAGMENT_MAX_SIZE */
+
+/* Number of cached fragments (/oic/d of each device and /oic/p) */
+#ifndef OC_REP_FRAGMENTS_MAX_NUM
+#define OC_REP_FRAGMENTS_MAX_NUM (OC_MAX_NUM_DEVICES + 1)
+#endif /* OC_REP_FRAGMENTS_MAX_NUM */
+
+/** Initial value of a fingerprint */
+#define OC_REP_FRAGMENT_FINGERPRINT_INIT (OC_HASH_FNV1A64_BASIS)
+
+/**
+ * @brief Callback encoding the properties of the fragment into root_map.
+ *
+ * @param resource resource of the fragment
+ * @param data user data passed to oc_rep_fragment_encode
+ */
+typedef void (*oc_rep_fragment_encode_cb_t)(const oc_resource_t *resource,
+                                            void *data);
+
+/**
+ * @brief Add data to the fingerprint of the values a fragment is encoded from.
+ *
+ * The length of the data is added together with the data, so a sequence of
+ * values can be fingerprinted by consecutive calls.
+ *
+ * @param fingerprint current fingerprint (OC_REP_FRAGMENT_FINGERPRINT_INIT for
+ * the first call)
+ * @param data data to add
+ * @param len length of the data
+ * @return updated fingerprint
+ */
+uint64_t oc_rep_fragment_fingerprint(uint64_t fingerprint, const void *data,
+                                     size_t len);
+
+/**
+ * @brief Encode properties of a resource into root_map of the current encoder
+ * from a pre-encoded fragment.
+ *
+ * The properties are encoded by the callback into a fragment, which is cached
+ * for the resource and interface and copied into the following responses. The
+ * fragment is encoded again when the fingerprint of the values it was encoded
+ * from changes. If the current encoder doesn't produce CBOR or the fragment
+ * cannot be cached then the callback encodes the properties directly.
+ *
+ * @param resource resource of the fragment (cannot be NULL)
+ * @param iface_mask interface of the fragment
+ * @param fingerprint fingerprint of the encoded values
+ * @param encode callback encoding the properties (cannot be NULL)
+ * @param data user data passed to the callback
+ */
+void oc_rep_fragment_encode(const oc_resource_t *resource,
+                            oc_interface_mask_t iface_mask,
+                            uint64_t fingerprint,
+                            oc_rep_fragment_encode_cb_t encode, void *data);
+
+/**
+ * @brief Remove cached fragments of the resource.
+ *
+ * @param resource resource of the fragments (NULL for all fragments)
+ */
+void oc_rep_fragment_invalidate(const oc_resource_t *resource);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_REP_FRAGMENT_INTERNAL_H */
@@ -16,7 +16,12 @@
  *
  ***************************************************************************/
 
+#include "api/oc_admission_internal.h"
+#include "api/oc_batch_response_internal.h"
+#include "api/oc_deferred_response_internal.h"
 #include "api/oc_helpers_internal.h"
+#include "api/oc_rep_encode_internal.h"
+#include "api/oc_server_api_internal.h"
 #include "messaging/coap/coap_internal.h"
 #include "messaging/coap/constants.h"
 #include "messaging/coap/engine.h"
@@ -43,6 +48,7 @@
 #endif /* OC_BLOCK_WISE */
 
 #ifdef OC_CLIENT
+#include "api/oc_client_api_internal.h"
 #include "oc_client_state.h"
 #endif /* OC_CLIENT */
 
@@ -454,6 +460,12 @@ start_processes(void)
 #ifdef OC_TCP
   oc_process_start(&oc_session_events, NULL);
 #endif /* OC_TCP */
+#ifdef OC_SERVER
+  oc_process_start(&oc_deferred_response_process, NULL);
+#endif /* OC_SERVER */
+#ifdef OC_CLIENT
+  oc_process_start(&oc_client_request_process, NULL);
+#endif /* OC_CLIENT */
 
 #ifdef OC_HAS_FEATURE_PUSH
   oc_process_start(&oc_push_process, NULL);
@@ -463,6 +475,12 @@ start_processes(void)
 static void
 stop_processes(void)
 {
+#ifdef OC_CLIENT
+  oc_process_exit(&oc_client_request_process);
+#endif /* OC_CLIENT */
+#ifdef OC_SERVER
+  oc_process_exit(&oc_deferred_response_process);
+#endif /* OC_SERVER */
 #ifdef OC_TCP
   oc_process_exit(&oc_session_events);
 #endif /* OC_TCP */
@@ -779,8 +797,12 @@ poll_event_callback_timers(oc_list_t list, struct oc_memb *cb_pool)
     }
     g_currently_processed_event_cb = event_cb;
     g_currently_processed_event_cb_delete = false;
-    if ((event_cb->callback(event_cb->data) == OC_EVENT_DONE) ||
-        g_currently_processed_event_cb_delete) {
+    // a callback encoding a payload (e.g. a separate response) might leave its
+    // encoder context current
+    oc_rep_encoder_context_t *encoder_ctx = oc_rep_encoder_get_context();
+    oc_event_callback_retval_t retval = event_cb->callback(event_cb->data);
+    oc_rep_encoder_set_context(encoder_ctx);
+    if (retval == OC_EVENT_DONE || g_currently_processed_event_cb_delete) {
       oc_list_remove(list, event_cb);
       if (g_currently_processed_event_on_delete != NULL) {
         g_currently_processed_event_on_delete(event_cb->data);
@@ -1092,6 +1114,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   oc_request_t request_obj;
   oc_response_buffer_t response_buffer;
   oc_response_t response_obj;
+  oc_rep_encoder_context_t encoder_ctx;
 
 #ifdef OC_BLOCK_WISE
 #ifndef OC_SERVER
@@ -1104,6 +1127,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
    *  in order to reducing peak memory in OC_BLOCK_WISE & OC_DYNAMIC_ALLOCATION
    */
   memset(&response_buffer, 0, sizeof(response_buffer));
+  memset(&encoder_ctx, 0, sizeof(encoder_ctx));
 
   response_obj.separate_response = NULL;
   response_obj.response_buffer = &response_buffer;
@@ -1162,7 +1186,8 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   const uint8_t *payload = NULL;
   int payload_len = 0;
 #ifdef OC_BLOCK_WISE
-  if (*request_state) {
+  // streamed payloads were already passed to the request stream handler
+  if (*request_state && (*request_state)->stream.consume == NULL) {
     payload = (*request_state)->buffer;
     payload_len = (*request_state)->payload_size;
   }
@@ -1294,6 +1319,14 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   response_buffer.buffer_size = OC_BLOCK_SIZE;
 #endif /* !OC_BLOCK_WISE */
 
+  /* The response is encoded in a context of its own, payloads encoded while
+   * the request is handled (e.g. data written to the storage) cannot clobber
+   * it.
+   */
+  response_buffer.encoder = &encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+
   if (cur_resource && !bad_request) {
 
     /* Process a request against a valid resource, request payload, and
@@ -1314,6 +1347,9 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
 #else  /* OC_DYNAMIC_ALLOCATION */
     oc_rep_new(response_buffer.buffer, response_buffer.buffer_size);
 #endif /* !OC_DYNAMIC_ALLOCATION */
+    /* Encode the response payload in the format requested by the Accept
+     * option, unsupported formats fall back to CBOR. */
+    oc_rep_encoder_set_type_by_accept((oc_content_format_t)accept);
 
 #ifdef OC_SECURITY
     /* If cur_resource is a coaps:// resource, then query ACL to check if
@@ -1326,6 +1362,16 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
     } else
 #endif /* OC_SECURITY */
     {
+#ifdef OC_SERVER
+      /* Only the handler invoked for this request may defer its response,
+       * the batch interface of a collection defers the response while its
+       * links defer theirs.
+       */
+      oc_deferred_response_enable(&response_buffer);
+#ifdef OC_BLOCK_WISE
+      oc_response_stream_enable(&response_buffer);
+#endif /* OC_BLOCK_WISE */
+#endif /* OC_SERVER */
 /* If cur_resource is a collection resource, invoke the framework's
  * internal handler for collections.
  */
@@ -1338,6 +1384,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
         }
       } else
 #endif /* OC_COLLECTIONS && OC_SERVER */
+      {
         /* If cur_resource is a non-collection resource, invoke
          * its handler for the requested method. If it has not
          * implemented that method, then return a 4.05 response.
@@ -1357,6 +1404,16 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
         } else {
           method_impl = false;
         }
+      }
+      // the handler might have switched to another context (e.g. to encode a
+      // separate response)
+      oc_rep_encoder_set_context(&encoder_ctx);
+#ifdef OC_SERVER
+      oc_deferred_response_enable(NULL);
+#ifdef OC_BLOCK_WISE
+      oc_response_stream_enable(NULL);
+#endif /* OC_BLOCK_WISE */
+#endif /* OC_SERVER */
     }
   }
 
@@ -1373,6 +1430,7 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   }
 #endif
 #endif
+  oc_rep_encoder_set_context(prev_encoder_ctx);
 
   if (request_obj.request_payload) {
     /* To the extent that the request payload was parsed, free the
@@ -1533,6 +1591,20 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
   }
 
 #ifdef OC_SERVER
+  /* A deferred response is sent once it is completed by the application,
+   * either piggybacked on the ACK or as a separate response.
+   */
+  if (response_buffer.deferred != NULL) {
+#ifdef OC_BLOCK_WISE
+    oc_deferred_response_accept(response_buffer.deferred, packet,
+                                (coap_packet_t *)response, endpoint,
+                                block2_size);
+#else  /* OC_BLOCK_WISE */
+    oc_deferred_response_accept(response_buffer.deferred, packet,
+                                (coap_packet_t *)response, endpoint);
+#endif /* !OC_BLOCK_WISE */
+    coap_set_global_status_code(CLEAR_TRANSACTION);
+  } else
   /* The presence of a separate response handle here indicates a
    * successful handling of the request by a slow resource.
    */
@@ -1590,6 +1662,21 @@ oc_ri_invoke_coap_entity_handler(void *request, void *response, uint8_t *buffer,
       }
 
 #endif /* OC_SERVER */
+#ifdef OC_BLOCK_WISE
+      if (response_buffer.stream_cb != NULL) {
+        if (oc_blockwise_set_response_stream(*response_state,
+                                             response_buffer.stream_cb,
+                                             response_buffer.stream_data)) {
+          coap_set_header_content_format(response,
+                                         response_buffer.content_format);
+        } else {
+          response_buffer.stream_cb(0, NULL, 0, NULL,
+                                    response_buffer.stream_data);
+          response_buffer.code =
+            oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+        }
+      } else
+#endif /* OC_BLOCK_WISE */
       if (response_buffer.response_length > 0) {
 #ifdef OC_BLOCK_WISE
         (*response_state)->payload_size = response_buffer.response_length;
@@ -1750,6 +1837,25 @@ oc_ri_free_client_cbs_by_endpoint(const oc_endpoint_t *endpoint)
   oc_ri_free_client_cbs_by_endpoint_v1(endpoint, OC_CANCELLED);
 }
 
+void
+oc_ri_free_client_cbs_by_filter(oc_ri_client_cb_filter_t filter,
+                                const void *filter_data, oc_status_t code)
+{
+  assert(filter != NULL);
+  oc_client_cb_t *cb = (oc_client_cb_t *)oc_list_head(g_client_cbs);
+  while (cb != NULL) {
+    oc_client_cb_t *next = cb->next;
+    if (!cb->multicast && !cb->discovery && cb->ref_count == 0 &&
+        filter(cb, filter_data)) {
+      cb->ref_count = 1;
+      notify_client_cb_with_code(cb, code);
+      cb = (oc_client_cb_t *)oc_list_head(g_client_cbs);
+      continue;
+    }
+    cb = next;
+  }
+}
+
 oc_client_cb_t *
 oc_ri_find_client_cb_by_mid(uint16_t mid)
 {
@@ -2073,12 +2179,19 @@ oc_ri_shutdown(void)
 {
 #ifdef OC_SERVER
   coap_free_all_observers();
+  oc_batch_response_free_all();
+  oc_deferred_response_free_all();
 #endif /* OC_SERVER */
   coap_free_all_transactions();
+  oc_admission_free_buckets();
   free_all_event_timers();
 #ifdef OC_CLIENT
+  oc_client_requests_free_all();
   free_all_client_cbs();
 #endif /* OC_CLIENT */
+#ifdef OC_TCP
+  coap_signal_free_all_peers();
+#endif /* OC_TCP */
 #ifdef OC_BLOCK_WISE
   oc_blockwise_scrub_buffers(true);
 #endif /* OC_BLOCK_WISE */
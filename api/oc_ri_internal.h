@@ -23,6 +23,10 @@
 #include "oc_endpoint.h"
 #include "oc_ri.h"
 
+#ifdef OC_CLIENT
+#include "oc_client_state.h"
+#endif /* OC_CLIENT */
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -101,6 +105,29 @@ extern bool oc_ri_invoke_coap_entity_handler(void *request, void *response,
 oc_event_callback_retval_t oc_remove_ping_handler_async(void *data);
 #endif /* OC_TCP */
 
+#ifdef OC_CLIENT
+/**
+ * @brief Filtering function of client callbacks.
+ *
+ * @param cb the client callback
+ * @param filter_data user data passed to oc_ri_free_client_cbs_by_filter
+ * @return true if the client callback matches the filter
+ */
+typedef bool (*oc_ri_client_cb_filter_t)(const oc_client_cb_t *cb,
+                                         const void *filter_data);
+
+/**
+ * @brief free the client callbacks matching the filter with a specific code
+ *
+ * @param filter filtering function (cannot be NULL)
+ * @param filter_data user data passed to the filtering function
+ * @param code the propagated code to client callback
+ */
+void oc_ri_free_client_cbs_by_filter(oc_ri_client_cb_filter_t filter,
+                                     const void *filter_data,
+                                     oc_status_t code);
+#endif /* OC_CLIENT */
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,6 +17,7 @@
  ****************************************************************************/
 
 #include "oc_server_api_internal.h"
+#include "api/oc_rep_encode_internal.h"
 #include "api/oc_ri_internal.h"
 #include "messaging/coap/engine.h"
 #include "messaging/coap/oc_coap.h"
@@ -109,7 +110,7 @@ oc_send_response(oc_request_t *request, oc_status_t response_code)
 #endif /* OC_SPEC_VER_OIC */
   {
     request->response->response_buffer->content_format =
-      APPLICATION_VND_OCF_CBOR;
+      oc_rep_encoder_get_content_format();
   }
   request->response->response_buffer->response_length = response_length();
   request->response->response_buffer->code = oc_status_code(response_code);
@@ -131,6 +132,7 @@ oc_set_immutable_device_identifier(size_t device, const oc_uuid_t *piid)
       oc_sec_load_unique_ids(device);
 #endif /* OC_SECURITY */
       memcpy(info->piid.id, piid->id, sizeof(oc_uuid_t));
+      oc_core_device_info_changed(device);
 #ifdef OC_SECURITY
       oc_sec_dump_unique_ids(device);
 #endif /* OC_SECURITY */
@@ -378,6 +380,39 @@ oc_send_response_raw(oc_request_t *request, const uint8_t *payload, size_t size,
   request->response->response_buffer->code = oc_status_code(response_code);
 }
 
+#ifdef OC_BLOCK_WISE
+static const oc_response_buffer_t *g_stream_response_buffer = NULL;
+
+void
+oc_response_stream_enable(const oc_response_buffer_t *response_buffer)
+{
+  g_stream_response_buffer = response_buffer;
+}
+
+void
+oc_send_response_stream(oc_request_t *request,
+                        oc_content_format_t content_format,
+                        oc_response_stream_cb_t callback, void *user_data,
+                        oc_status_t response_code)
+{
+  oc_response_buffer_t *response_buffer = request->response->response_buffer;
+  if (response_buffer != g_stream_response_buffer) {
+    OC_ERR("cannot stream response of resource(%s): streams are supported "
+           "only for requests addressed directly to the resource",
+           request->resource != NULL ? oc_string(request->resource->uri) : "");
+    callback(0, NULL, 0, NULL, user_data);
+    response_buffer->response_length = 0;
+    response_buffer->code = oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR);
+    return;
+  }
+  response_buffer->content_format = content_format;
+  response_buffer->response_length = 0;
+  response_buffer->stream_cb = callback;
+  response_buffer->stream_data = user_data;
+  response_buffer->code = oc_status_code(response_code);
+}
+#endif /* OC_BLOCK_WISE */
+
 void
 oc_send_diagnostic_message(oc_request_t *request, const char *msg,
                            size_t msg_len, oc_status_t response_code)
@@ -570,6 +605,24 @@ oc_resource_set_request_handler(oc_resource_t *resource, oc_method_t method,
   }
 }
 
+#ifdef OC_BLOCK_WISE
+void
+oc_resource_set_request_stream_handler(oc_resource_t *resource,
+                                       oc_request_stream_cb_t callback,
+                                       void *user_data)
+{
+#if defined(OC_COLLECTIONS) && defined(OC_SERVER)
+  if (callback != NULL && oc_check_if_collection(resource)) {
+    OC_ERR("cannot set stream consumer of collection(%s)",
+           oc_string(resource->uri));
+    return;
+  }
+#endif /* OC_COLLECTIONS && OC_SERVER */
+  resource->request_stream_handler.cb = callback;
+  resource->request_stream_handler.user_data = user_data;
+}
+#endif /* OC_BLOCK_WISE */
+
 #ifdef OC_OSCORE
 void
 oc_resource_set_secure_mcast(oc_resource_t *resource, bool supported)
@@ -643,9 +696,21 @@ oc_indicate_separate_response(oc_request_t *request,
   oc_send_response(request, OC_STATUS_OK);
 }
 
+/* The payload of a separate response is encoded in a context of its own, from
+ * oc_set_separate_response_buffer until oc_send_separate_response or until the
+ * request handler or the timed callback calling them returns, whichever comes
+ * first. */
+static oc_rep_encoder_context_t g_separate_encoder_ctx;
+static oc_rep_encoder_context_t *g_separate_prev_encoder_ctx = NULL;
+
 void
 oc_set_separate_response_buffer(oc_separate_response_t *handle)
 {
+  oc_rep_encoder_context_t *prev =
+    oc_rep_encoder_set_context(&g_separate_encoder_ctx);
+  if (prev != &g_separate_encoder_ctx) {
+    g_separate_prev_encoder_ctx = prev;
+  }
 #ifdef OC_BLOCK_WISE
   oc_rep_new(handle->buffer, OC_MAX_APP_DATA_SIZE);
 #else  /* OC_BLOCK_WISE */
@@ -667,71 +732,89 @@ handle_separate_response_transaction(coap_transaction_t *t,
   coap_send_transaction(t);
 }
 
-static void
-handle_separate_response_request(coap_separate_t *request,
-                                 const oc_response_buffer_t *response_buffer)
+bool
+oc_server_set_response_payload(coap_packet_t *response,
+                               const oc_endpoint_t *endpoint, const char *uri,
+                               size_t uri_len, oc_method_t method,
+                               uint16_t block2_size, const uint8_t *payload,
+                               size_t payload_size)
 {
-  coap_packet_t response;
-  coap_transaction_t *t = coap_new_transaction(
-    coap_get_mid(), request->token, request->token_len, &request->endpoint);
-  if (t == NULL) {
-    return;
-  }
-  assert(response_buffer->code <= UINT8_MAX);
-  coap_separate_resume(&response, request, (uint8_t)response_buffer->code,
-                       t->mid);
-  coap_set_header_content_format(&response, response_buffer->content_format);
-
 #ifdef OC_BLOCK_WISE
-  oc_blockwise_state_t *response_state = NULL;
 #ifdef OC_TCP
-  bool blockwise = (request->endpoint.flags & TCP) == 0 &&
-                   response_buffer->response_length > request->block2_size;
+  bool blockwise = (endpoint->flags & TCP) == 0 && payload_size > block2_size;
 #else  /* !OC_TCP */
-  bool blockwise = response_buffer->response_length > request->block2_size;
+  bool blockwise = payload_size > block2_size;
 #endif /* OC_TCP */
   if (blockwise) {
-    response_state = oc_blockwise_find_response_buffer(
-      oc_string(request->uri), oc_string_len(request->uri), &request->endpoint,
-      request->method, NULL, 0, OC_BLOCKWISE_SERVER);
+    oc_blockwise_state_t *response_state = oc_blockwise_find_response_buffer(
+      uri, uri_len, endpoint, method, NULL, 0, OC_BLOCKWISE_SERVER);
     if (response_state != NULL) {
       if (response_state->payload_size != response_state->next_block_offset) {
-        return;
+        return false;
       }
       oc_blockwise_free_response_buffer(response_state);
-      response_state = NULL;
     }
     response_state = oc_blockwise_alloc_response_buffer(
-      oc_string(request->uri), oc_string_len(request->uri), &request->endpoint,
-      request->method, OC_BLOCKWISE_SERVER,
-      (uint32_t)response_buffer->response_length);
+      uri, uri_len, endpoint, method, OC_BLOCKWISE_SERVER,
+      (uint32_t)payload_size);
     if (response_state == NULL) {
-      return;
+      return false;
     }
 
-    memcpy(response_state->buffer, response_buffer->buffer,
-           response_buffer->response_length);
-    response_state->payload_size = (uint32_t)response_buffer->response_length;
-
-    uint32_t payload_size = 0;
-    const void *payload = oc_blockwise_dispatch_block(
-      response_state, 0, request->block2_size, &payload_size);
-    if (payload != NULL) {
-      coap_set_payload(&response, payload, payload_size);
-      coap_set_header_block2(&response, 0, 1, request->block2_size);
-      coap_set_header_size2(&response, response_state->payload_size);
-      oc_blockwise_response_state_t *bwt_res_state =
+    memcpy(response_state->buffer, payload, payload_size);
+    response_state->payload_size = (uint32_t)payload_size;
+
+    uint32_t block_size = 0;
+    const void *block = oc_blockwise_dispatch_block(response_state, 0,
+                                                    block2_size, &block_size);
+    if (block != NULL) {
+      coap_set_payload(response, block, block_size);
+      coap_set_header_block2(response, 0, 1, block2_size);
+      coap_set_header_size2(response, response_state->payload_size);
+      const oc_blockwise_response_state_t *bwt_res_state =
         (oc_blockwise_response_state_t *)response_state;
-      coap_set_header_etag(&response, bwt_res_state->etag, COAP_ETAG_LEN);
+      coap_set_header_etag(response, bwt_res_state->etag, COAP_ETAG_LEN);
     }
-    handle_separate_response_transaction(t, &response,
-                                         (uint8_t)response_buffer->code);
+    return true;
+  }
+#else  /* !OC_BLOCK_WISE */
+  (void)endpoint;
+  (void)uri;
+  (void)uri_len;
+  (void)method;
+  (void)block2_size;
+#endif /* OC_BLOCK_WISE */
+  if (payload_size > 0) {
+    coap_set_payload(response, payload, payload_size);
+  }
+  return true;
+}
+
+static void
+handle_separate_response_request(coap_separate_t *request,
+                                 const oc_response_buffer_t *response_buffer)
+{
+  coap_packet_t response;
+  coap_transaction_t *t = coap_new_transaction(
+    coap_get_mid(), request->token, request->token_len, &request->endpoint);
+  if (t == NULL) {
     return;
   }
+  assert(response_buffer->code <= UINT8_MAX);
+  coap_separate_resume(&response, request, (uint8_t)response_buffer->code,
+                       t->mid);
+  coap_set_header_content_format(&response, response_buffer->content_format);
+#ifdef OC_BLOCK_WISE
+  uint16_t block2_size = request->block2_size;
+#else  /* !OC_BLOCK_WISE */
+  uint16_t block2_size = 0;
 #endif /* OC_BLOCK_WISE */
-  if (response_buffer->response_length > 0) {
-    coap_set_payload(&response, response_buffer->buffer,
-                     response_buffer->response_length);
+  if (!oc_server_set_response_payload(
+        &response, &request->endpoint, oc_string(request->uri),
+        oc_string_len(request->uri), request->method, block2_size,
+        response_buffer->buffer, response_buffer->response_length)) {
+    coap_clear_transaction(t);
+    return;
   }
   handle_separate_response_transaction(t, &response,
                                        (uint8_t)response_buffer->code);
@@ -743,11 +826,19 @@ oc_send_separate_response(oc_separate_response_t *handle,
 {
   oc_response_buffer_t response_buffer;
   response_buffer.buffer = handle->buffer;
+  oc_rep_encoder_context_t *prev =
+    oc_rep_encoder_set_context(&g_separate_encoder_ctx);
   if (handle->len != 0) {
     response_buffer.response_length = handle->len;
   } else {
     response_buffer.response_length = response_length();
   }
+  // the context replaced by oc_set_separate_response_buffer is still valid if
+  // the caller hasn't returned in between
+  oc_rep_encoder_set_context(prev == &g_separate_encoder_ctx
+                               ? g_separate_prev_encoder_ctx
+                               : prev);
+  g_separate_prev_encoder_ctx = NULL;
 
   response_buffer.code = oc_status_code(response_code);
   response_buffer.content_format = APPLICATION_VND_OCF_CBOR;
@@ -21,6 +21,10 @@
 
 #include "oc_ri.h"
 
+#ifdef OC_SERVER
+#include "messaging/coap/coap.h"
+#endif /* OC_SERVER */
+
 #ifdef OC_CLOUD
 #include "oc_api.h"
 #endif /* OC_CLOUD */
@@ -63,7 +67,7 @@ void oc_set_on_delayed_delete_resource_cb(oc_delete_resource_cb_t callback);
  */
 #define OC_MAX_OCF_URI_SIZE (OC_UUID_LEN + 6 + 256)
 
-void oc_discovery_create_batch_for_resource(CborEncoder *links_array,
+void oc_discovery_create_batch_for_resource(CborEncoder *links_encoder,
                                             oc_resource_t *resource,
                                             const oc_endpoint_t *endpoint);
 
@@ -84,4 +88,51 @@ void oc_process_baseline_interface_with_filter(
   const oc_resource_t *resource,
   oc_process_baseline_interface_filter_fn_t filter, void *filter_data);
 
+#ifdef OC_SERVER
+
+/**
+ * @brief Set the payload of a response sent after the request handler has
+ * returned (separate and deferred responses).
+ *
+ * Over UDP a payload larger than block2_size is stored in a block-wise
+ * response state of the request and the first block is set.
+ *
+ * @param response the response
+ * @param endpoint endpoint of the client
+ * @param uri URI path of the request
+ * @param uri_len length of the URI path
+ * @param method method of the request
+ * @param block2_size preferred block size of the client
+ * @param payload the payload
+ * @param payload_size size of the payload
+ * @return true the payload was set
+ * @return false a block-wise transfer of a previous response is in progress or
+ * the state of the transfer cannot be allocated
+ */
+bool oc_server_set_response_payload(coap_packet_t *response,
+                                    const oc_endpoint_t *endpoint,
+                                    const char *uri, size_t uri_len,
+                                    oc_method_t method, uint16_t block2_size,
+                                    const uint8_t *payload,
+                                    size_t payload_size);
+
+#ifdef OC_BLOCK_WISE
+
+/**
+ * @brief Allow oc_send_response_stream only for the given response buffer.
+ *
+ * Only the handler of the request dispatched by the engine can stream its
+ * response. The responses of the links of a batch request and notifications
+ * are encoded into a payload shared with other responses, so a stream is
+ * rejected there.
+ *
+ * @param response_buffer response buffer of the dispatched request (NULL
+ * disallows streaming)
+ */
+void oc_response_stream_enable(const oc_response_buffer_t *response_buffer);
+
+#endif /* OC_BLOCK_WISE */
+
+#endif /* OC_SERVER */
+
 #endif /* OC_SERVER_API_INTERNAL_H */
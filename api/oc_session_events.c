@@ -35,6 +35,9 @@
 #if defined(OC_SERVER)
 #include "messaging/coap/observe.h"
 #endif /* OC_SERVER */
+#ifdef OC_TCP
+#include "messaging/coap/coap_signal.h"
+#endif /* OC_TCP */
 
 #ifdef OC_SESSION_EVENTS
 
@@ -338,6 +341,11 @@ handle_session_disconnected(const oc_endpoint_t *endpoint)
   /* remove all observations for the endpoint */
   coap_remove_observer_by_client(endpoint);
 #endif /* OC_SERVER */
+#ifdef OC_TCP
+  if ((endpoint->flags & TCP) != 0) {
+    coap_signal_remove_peer(endpoint);
+  }
+#endif /* OC_TCP */
 }
 
 void
@@ -20,10 +20,14 @@
 
 #ifdef OC_STORAGE
 
+#include "api/oc_rep_encode_internal.h"
+#include "oc_api.h"
 #include "oc_storage_internal.h"
 #include "port/oc_connectivity.h"
 #include "port/oc_log_internal.h"
 #include "port/oc_storage.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
 
 #include <stdio.h>
 
@@ -35,6 +39,19 @@
 static uint8_t g_oc_storage_buf[OC_APP_DATA_BUFFER_SIZE] = { 0 };
 #endif /* OC_APP_DATA_STORAGE_BUFFER */
 
+typedef struct oc_storage_deferred_dump_t
+{
+  struct oc_storage_deferred_dump_t *next;
+  oc_storage_dump_fn_t dump;
+  size_t device;
+} oc_storage_deferred_dump_t;
+
+OC_LIST(g_storage_deferred_dumps);
+OC_MEMB(g_storage_deferred_dumps_s, oc_storage_deferred_dump_t,
+        OC_STORAGE_DEFERRED_DUMPS_MAX);
+static uint64_t g_storage_write_behind_ms = 0;
+static oc_clock_time_t g_storage_flush_time = 0; ///< time of the pending flush
+
 int
 oc_storage_gen_svr_tag(const char *name, size_t device_index, char *svr_tag,
                        size_t svr_tag_size)
@@ -109,6 +126,12 @@ oc_storage_load_resource(const char *name, size_t device,
     return -1;
   }
 
+#ifdef OC_STORAGE_KV
+  // the data are parsed directly from the storage, no staging buffer needed
+  oc_storage_buffer_t buf = { NULL, 0 };
+  const uint8_t *data = NULL;
+  long ret = oc_storage_read_view(svr_tag, &data);
+#else  /* !OC_STORAGE_KV */
   oc_storage_buffer_t buf = oc_storage_get_buffer(OC_MAX_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
   if (buf.buffer == NULL) {
@@ -118,6 +141,8 @@ oc_storage_load_resource(const char *name, size_t device,
 #endif /* !OC_APP_DATA_STORAGE_BUFFER */
 
   long ret = oc_storage_read(svr_tag, buf.buffer, buf.size);
+  const uint8_t *data = buf.buffer;
+#endif /* OC_STORAGE_KV */
   if (ret < 0) {
     OC_ERR("cannot load from %s from store: read error(%ld)", name, ret);
     goto error;
@@ -125,7 +150,7 @@ oc_storage_load_resource(const char *name, size_t device,
   OC_MEMB_LOCAL(rep_objects, oc_rep_t, OC_MAX_NUM_REP_OBJECTS);
   oc_rep_set_pool(&rep_objects);
   oc_rep_t *rep = NULL;
-  if (oc_parse_rep(buf.buffer, (int)ret, &rep) != 0) {
+  if (oc_parse_rep(data, (size_t)ret, &rep) != 0) {
     OC_ERR("cannot load from %s from store: cannot parse representation", name);
     goto error;
   }
@@ -155,6 +180,12 @@ oc_storage_save_resource(const char *name, size_t device,
     OC_ERR("cannot dump %s to storage: cannot allocate buffer", name);
     return -1;
   }
+#endif /* !OC_APP_DATA_STORAGE_BUFFER */
+  // the resource might be saved while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+#ifndef OC_APP_DATA_STORAGE_BUFFER
   oc_rep_new_realloc(&sb.buffer, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
 #else  /* !OC_APP_DATA_STORAGE_BUFFER */
   oc_rep_new(sb.buffer, OC_MIN_APP_DATA_SIZE);
@@ -180,13 +211,163 @@ oc_storage_save_resource(const char *name, size_t device,
     OC_ERR("cannot dump %s to storage: cannot generate svr tag", name);
     goto error;
   }
+  oc_rep_encoder_set_context(prev_encoder_ctx);
   long ret = oc_storage_write(svr_tag, sb.buffer, size);
   oc_storage_free_buffer(sb);
   return ret;
 
 error:
+  oc_rep_encoder_set_context(prev_encoder_ctx);
   oc_storage_free_buffer(sb);
   return -1;
 }
 
+static oc_storage_deferred_dump_t *
+storage_find_deferred_dump(oc_storage_dump_fn_t dump, size_t device)
+{
+  oc_storage_deferred_dump_t *dd =
+    (oc_storage_deferred_dump_t *)oc_list_head(g_storage_deferred_dumps);
+  for (; dd != NULL; dd = dd->next) {
+    if (dd->dump == dump && dd->device == device) {
+      return dd;
+    }
+  }
+  return NULL;
+}
+
+/* Dumps can be requested while a response is being encoded, so every dump is
+ * encoded in a context of its own */
+static void
+storage_run_dump(oc_storage_dump_fn_t dump, size_t device)
+{
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+  dump(device);
+  oc_rep_encoder_set_context(prev_encoder_ctx);
+}
+
+static void
+storage_run_deferred_dump(oc_storage_deferred_dump_t *dd)
+{
+  oc_list_remove(g_storage_deferred_dumps, dd);
+  oc_storage_dump_fn_t dump = dd->dump;
+  size_t device = dd->device;
+  oc_memb_free(&g_storage_deferred_dumps_s, dd);
+  storage_run_dump(dump, device);
+}
+
+static oc_event_callback_retval_t
+storage_flush_deferred_dumps_async(void *data)
+{
+  (void)data;
+  OC_DBG("oc_storage: flushing %d deferred dump(s)",
+         oc_list_length(g_storage_deferred_dumps));
+#ifdef OC_STORAGE_KV
+  // all dumps are synchronized to the storage by a single commit
+  bool batch = oc_storage_batch_begin() == 0;
+#endif /* OC_STORAGE_KV */
+  g_storage_flush_time = 0;
+  oc_storage_deferred_dump_t *dd;
+  while ((dd = (oc_storage_deferred_dump_t *)oc_list_head(
+            g_storage_deferred_dumps)) != NULL) {
+    storage_run_deferred_dump(dd);
+  }
+#ifdef OC_STORAGE_KV
+  if (batch && oc_storage_batch_commit() != 0) {
+    OC_ERR("oc_storage: failed to commit deferred dumps");
+  }
+#endif /* OC_STORAGE_KV */
+  return OC_EVENT_DONE;
+}
+
+void
+oc_storage_set_write_behind_window(uint64_t milliseconds)
+{
+  g_storage_write_behind_ms = milliseconds;
+  if (milliseconds == 0) {
+    oc_storage_flush_deferred_dumps();
+  }
+}
+
+uint64_t
+oc_storage_get_write_behind_window(void)
+{
+  return g_storage_write_behind_ms;
+}
+
+void
+oc_storage_dump(oc_storage_dump_fn_t dump, size_t device)
+{
+  oc_storage_dump_coalesced(dump, device, 0);
+}
+
+void
+oc_storage_dump_coalesced(oc_storage_dump_fn_t dump, size_t device,
+                          uint64_t window_ms)
+{
+  assert(dump != NULL);
+  if (window_ms < g_storage_write_behind_ms) {
+    window_ms = g_storage_write_behind_ms;
+  }
+  if (window_ms == 0) {
+    storage_run_dump(dump, device);
+    return;
+  }
+  if (storage_find_deferred_dump(dump, device) != NULL) {
+    OC_DBG("oc_storage: dump for device(%zu) coalesced", device);
+    return;
+  }
+  oc_storage_deferred_dump_t *dd = (oc_storage_deferred_dump_t *)oc_memb_alloc(
+    &g_storage_deferred_dumps_s);
+  if (dd == NULL) {
+    OC_WRN("oc_storage: cannot defer dump for device(%zu), writing now",
+           device);
+    storage_run_dump(dump, device);
+    return;
+  }
+  dd->dump = dump;
+  dd->device = device;
+  oc_list_add(g_storage_deferred_dumps, dd);
+
+  // the window is not extended by subsequent dumps to bound the time for which
+  // a change stays only in memory, a shorter window brings the flush forward
+  oc_clock_time_t ticks =
+    (oc_clock_time_t)(window_ms * (uint64_t)OC_CLOCK_SECOND / 1000);
+  oc_clock_time_t flush_time = oc_clock_time() + ticks;
+  if (g_storage_flush_time != 0 && g_storage_flush_time <= flush_time &&
+      oc_ri_has_timed_event_callback(NULL, storage_flush_deferred_dumps_async,
+                                     false)) {
+    return;
+  }
+  oc_ri_remove_timed_event_callback(NULL, storage_flush_deferred_dumps_async);
+  oc_ri_add_timed_event_callback_ticks(NULL, storage_flush_deferred_dumps_async,
+                                       ticks);
+  g_storage_flush_time = flush_time;
+}
+
+bool
+oc_storage_flush_deferred_dump(oc_storage_dump_fn_t dump, size_t device)
+{
+  oc_storage_deferred_dump_t *dd = storage_find_deferred_dump(dump, device);
+  if (dd == NULL) {
+    return false;
+  }
+  storage_run_deferred_dump(dd);
+  return true;
+}
+
+void
+oc_storage_flush_deferred_dumps(void)
+{
+  oc_ri_remove_timed_event_callback(NULL, storage_flush_deferred_dumps_async);
+  storage_flush_deferred_dumps_async(NULL);
+}
+
+bool
+oc_storage_has_deferred_dumps(void)
+{
+  return oc_list_length(g_storage_deferred_dumps) > 0;
+}
+
 #endif /* OC_STORAGE */
@@ -38,6 +38,12 @@ extern "C" {
 
 #define OC_STORAGE_SVR_TAG_MAX (32)
 
+#ifndef OC_STORAGE_DEFERRED_DUMPS_MAX
+/* Maximal number of pending deferred dumps (only used without
+ * OC_DYNAMIC_ALLOCATION) */
+#define OC_STORAGE_DEFERRED_DUMPS_MAX (8 * OC_MAX_NUM_DEVICES)
+#endif /* OC_STORAGE_DEFERRED_DUMPS_MAX */
+
 typedef struct oc_storage_buffer_t
 {
   uint8_t *buffer;
@@ -114,6 +120,62 @@ long oc_storage_save_resource(const char *name, size_t device,
                               oc_encode_to_storage_fn_t encode,
                               void *encode_data);
 
+/**
+ * @brief Function that encodes and writes a resource of a device to storage.
+ */
+typedef void (*oc_storage_dump_fn_t)(size_t device);
+
+/**
+ * @brief Dump a resource to storage, coalescing repeated dumps.
+ *
+ * If the write-behind window is 0 then the dump function is invoked
+ * immediately. Otherwise the dump is scheduled to run at the end of the
+ * current window and further calls with the same dump function and device
+ * before the window elapses are merged into the single pending write.
+ *
+ * @param dump function that writes the resource to storage (cannot be NULL)
+ * @param device device index
+ *
+ * @see oc_storage_set_write_behind_window
+ */
+void oc_storage_dump(oc_storage_dump_fn_t dump, size_t device);
+
+/**
+ * @brief Dump a resource to storage, coalescing repeated dumps within at least
+ * the given window.
+ *
+ * Used by resources that change often, the larger of the given window and the
+ * write-behind window is used. A pending write of any resource flushes all
+ * pending writes.
+ *
+ * @param dump function that writes the resource to storage (cannot be NULL)
+ * @param device device index
+ * @param window_ms minimal length of the window in milliseconds
+ *
+ * @see oc_storage_dump
+ */
+void oc_storage_dump_coalesced(oc_storage_dump_fn_t dump, size_t device,
+                               uint64_t window_ms);
+
+/**
+ * @brief Execute a pending deferred dump immediately.
+ *
+ * Should be called before the resource is loaded from storage, so that the
+ * load doesn't read stale data.
+ *
+ * @param dump function that writes the resource to storage
+ * @param device device index
+ * @return true a pending dump was found and executed
+ * @return false otherwise
+ */
+bool oc_storage_flush_deferred_dump(oc_storage_dump_fn_t dump, size_t device);
+
+/** @brief Execute all pending deferred dumps immediately. */
+void oc_storage_flush_deferred_dumps(void);
+
+/** @brief Check if there are pending deferred dumps. */
+bool oc_storage_has_deferred_dumps(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,7 @@
 
 #include "oc_config.h"
 #ifdef OC_SOFTWARE_UPDATE
+#include "api/oc_rep_encode_internal.h"
 #include "oc_api.h"
 #include "oc_core_res.h"
 #include "oc_core_res_internal.h"
@@ -77,9 +78,16 @@ oc_dump_sw(size_t device)
   uint8_t *buf = malloc(OC_MIN_APP_DATA_SIZE);
   if (!buf)
     return;
-  oc_rep_new_realloc(&buf, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
 #else  /* OC_DYNAMIC_ALLOCATION */
   uint8_t buf[OC_MIN_APP_DATA_SIZE];
+#endif /* !OC_DYNAMIC_ALLOCATION */
+  // called from the request handler after the response was encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+#ifdef OC_DYNAMIC_ALLOCATION
+  oc_rep_new_realloc(&buf, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
+#else  /* OC_DYNAMIC_ALLOCATION */
   oc_rep_new(buf, OC_MIN_APP_DATA_SIZE);
 #endif /* !OC_DYNAMIC_ALLOCATION */
 
@@ -94,6 +102,7 @@ oc_dump_sw(size_t device)
     oc_storage_gen_svr_tag("sw", device, svr_tag, sizeof(svr_tag));
     oc_storage_write(svr_tag, buf, size);
   }
+  oc_rep_encoder_set_context(prev_encoder_ctx);
 
 #ifdef OC_DYNAMIC_ALLOCATION
   free(buf);
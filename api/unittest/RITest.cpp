@@ -301,6 +301,44 @@ TEST_F(TestOcRi, RiCleanupCollection_P)
   EXPECT_EQ(nullptr, res);
 }
 
+TEST_F(TestOcRi, RiCollectionIndex_P)
+{
+  oc_resource_t *col = oc_new_collection(nullptr, "/switches", 1, 0);
+  ASSERT_NE(nullptr, col);
+  EXPECT_FALSE(oc_check_if_collection(col));
+  oc_add_collection(col);
+  EXPECT_TRUE(oc_check_if_collection(col));
+  auto *collection = reinterpret_cast<oc_collection_t *>(col);
+  EXPECT_EQ(collection, oc_get_collection_by_uri("switches", 8, 0));
+  EXPECT_EQ(collection, oc_get_collection_by_uri("/switches", 9, 0));
+  EXPECT_EQ(nullptr, oc_get_collection_by_uri("switches", 8, 1));
+  EXPECT_EQ(nullptr, oc_get_collection_by_uri("switch", 6, 0));
+
+  oc_resource_t *res =
+    oc_new_resource(kResourceName.c_str(), kResourceURI.c_str(), 1, 0);
+  ASSERT_NE(nullptr, res);
+  EXPECT_EQ(nullptr, oc_get_next_collection_with_link(res, nullptr));
+  oc_link_t *l = oc_new_link(res);
+  ASSERT_NE(nullptr, l);
+  oc_collection_add_link(col, l);
+  EXPECT_EQ(l, oc_get_link_by_uri(collection, kResourceURI.c_str(),
+                                  static_cast<int>(kResourceURI.length())));
+  EXPECT_EQ(nullptr, oc_get_link_by_uri(collection, "/unknown", 8));
+  EXPECT_EQ(collection, oc_get_next_collection_with_link(res, nullptr));
+  EXPECT_EQ(nullptr, oc_get_next_collection_with_link(res, collection));
+
+  oc_collection_remove_link(col, l);
+  oc_delete_link(l);
+  EXPECT_EQ(nullptr, oc_get_next_collection_with_link(res, nullptr));
+  EXPECT_EQ(nullptr,
+            oc_get_link_by_uri(collection, kResourceURI.c_str(),
+                               static_cast<int>(kResourceURI.length())));
+  oc_delete_resource(res);
+  oc_delete_collection(col);
+  EXPECT_FALSE(oc_check_if_collection(col));
+  EXPECT_EQ(nullptr, oc_get_collection_by_uri("switches", 8, 0));
+}
+
 #endif /* OC_COLLECTIONS */
 
 static oc_event_callback_retval_t
@@ -0,0 +1,163 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "api/oc_admission_internal.h"
+#include "oc_admission.h"
+#include "tests/gtest/Endpoint.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+class TestAdmission : public testing::Test {
+protected:
+  void TearDown() override
+  {
+    oc_admission_set_peer_rate_limit(0, 0);
+    oc_admission_set_device_rate_limit(0, 0);
+    oc_admission_set_max_concurrent_requests(0);
+    oc_admission_set_retry_after(OC_ADMISSION_DEFAULT_RETRY_AFTER);
+    oc_admission_reset_stats();
+    oc_admission_free_buckets();
+  }
+
+  static bool Admit(const oc_endpoint_t &ep, const std::string &uri = "light")
+  {
+    return oc_admission_admit_request(&ep, uri.c_str(), uri.length());
+  }
+
+  static oc_admission_stats_t Stats()
+  {
+    oc_admission_stats_t stats{};
+    oc_admission_get_stats(&stats);
+    return stats;
+  }
+};
+
+TEST_F(TestAdmission, Unlimited)
+{
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://[ff02::158]:5683");
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_TRUE(Admit(ep));
+  }
+  EXPECT_EQ(100, Stats().admitted);
+  EXPECT_EQ(OC_ADMISSION_DEFAULT_RETRY_AFTER, oc_admission_retry_after());
+}
+
+TEST_F(TestAdmission, PeerRateLimit)
+{
+  oc_admission_set_peer_rate_limit(1, 2);
+  oc_endpoint_t ep1 = oc::endpoint::FromString("coap://[ff02::158]:5683");
+  EXPECT_TRUE(Admit(ep1));
+  EXPECT_TRUE(Admit(ep1));
+  EXPECT_FALSE(Admit(ep1));
+  // the peer is identified by its address, the port doesn't matter
+  oc_endpoint_t ep1_port = oc::endpoint::FromString("coap://[ff02::158]:4242");
+  EXPECT_FALSE(Admit(ep1_port));
+
+  // other peers have their own bucket
+  oc_endpoint_t ep2 = oc::endpoint::FromString("coap://[ff02::159]:5683");
+  EXPECT_TRUE(Admit(ep2));
+
+  oc_admission_stats_t stats = Stats();
+  EXPECT_EQ(3, stats.admitted);
+  EXPECT_EQ(2, stats.shed_peer);
+  EXPECT_EQ(0, stats.shed_device);
+}
+
+TEST_F(TestAdmission, PeerRateLimitEvict)
+{
+  oc_admission_set_peer_rate_limit(1, 1);
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  EXPECT_TRUE(Admit(ep));
+  EXPECT_FALSE(Admit(ep));
+  // the least recently seen peer is forgotten when the table is full
+  for (int i = 0; i < OC_ADMISSION_MAX_PEERS; ++i) {
+    oc_endpoint_t other = oc::endpoint::FromString(
+      "coap://10.0.1." + std::to_string(i + 1) + ":5683");
+    EXPECT_TRUE(Admit(other));
+  }
+  EXPECT_TRUE(Admit(ep));
+}
+
+TEST_F(TestAdmission, DeviceRateLimit)
+{
+  oc_admission_set_device_rate_limit(1, 3);
+  for (int i = 0; i < 4; ++i) {
+    oc_endpoint_t ep = oc::endpoint::FromString(
+      "coap://10.0.0." + std::to_string(i + 1) + ":5683");
+    EXPECT_EQ(i < 3, Admit(ep));
+  }
+  // another device has its own bucket
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  ep.device = 1;
+  EXPECT_TRUE(Admit(ep));
+
+  oc_admission_stats_t stats = Stats();
+  EXPECT_EQ(4, stats.admitted);
+  EXPECT_EQ(1, stats.shed_device);
+}
+
+TEST_F(TestAdmission, Security)
+{
+  oc_admission_set_peer_rate_limit(1, 1);
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  EXPECT_TRUE(Admit(ep));
+  EXPECT_FALSE(Admit(ep));
+  // onboarding isn't blocked by a flood of other requests
+  EXPECT_TRUE(Admit(ep, "oic/sec/doxm"));
+  EXPECT_TRUE(Admit(ep, "/oic/sec/pstat"));
+  EXPECT_FALSE(Admit(ep, "oic/secret"));
+
+  oc_admission_stats_t stats = Stats();
+  EXPECT_EQ(3, stats.admitted);
+  EXPECT_EQ(0, stats.prioritized);
+  EXPECT_EQ(2, stats.shed_peer);
+}
+
+TEST_F(TestAdmission, SecurityFlood)
+{
+  oc_admission_set_peer_rate_limit(1, 1);
+  oc_admission_set_device_rate_limit(1, 2);
+  // a flood of requests to the security resources is still throttled
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  for (int i = 0; i < OC_ADMISSION_SECURITY_LIMIT_FACTOR; ++i) {
+    EXPECT_TRUE(Admit(ep, "/oic/sec/doxm"));
+  }
+  EXPECT_FALSE(Admit(ep, "/oic/sec/doxm"));
+  EXPECT_FALSE(Admit(ep, "/oic/sec/pstat"));
+  EXPECT_EQ(2, Stats().shed_peer);
+
+  // so is a flood spread over many peers
+  int admitted = 0;
+  for (int i = 0; i < 4 * OC_ADMISSION_SECURITY_LIMIT_FACTOR; ++i) {
+    oc_endpoint_t other = oc::endpoint::FromString(
+      "coap://10.0.1." + std::to_string(i + 1) + ":5683");
+    if (Admit(other, "/oic/sec/doxm")) {
+      ++admitted;
+    }
+  }
+  // the first peer has used half of the device bucket
+  EXPECT_EQ(OC_ADMISSION_SECURITY_LIMIT_FACTOR, admitted);
+  EXPECT_LT(0, Stats().shed_device);
+}
+
+TEST_F(TestAdmission, RetryAfter)
+{
+  oc_admission_set_retry_after(10);
+  EXPECT_EQ(10, oc_admission_retry_after());
+}
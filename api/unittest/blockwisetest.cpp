@@ -0,0 +1,405 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "oc_config.h"
+
+#ifdef OC_BLOCK_WISE
+
+#include "api/oc_server_api_internal.h"
+#include "messaging/coap/oc_coap.h"
+#include "oc_api.h"
+#include "oc_blockwise.h"
+#include "oc_endpoint.h"
+#include "oc_ri.h"
+#include "port/oc_network_event_handler_internal.h"
+
+#include <algorithm>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static const std::string kHref{ "/stream" };
+
+struct StreamData
+{
+  std::vector<uint8_t> payload;
+  size_t calls;
+  bool released;
+  bool aborted;
+};
+
+class TestBlockwise : public testing::Test {
+protected:
+  void SetUp() override
+  {
+    oc_network_event_handler_mutex_init();
+    oc_ri_init();
+    memset(&endpoint_, 0, sizeof(endpoint_));
+  }
+
+  void TearDown() override
+  {
+    oc_blockwise_scrub_buffers(true);
+    oc_ri_shutdown();
+    oc_network_event_handler_mutex_destroy();
+  }
+
+  static std::vector<uint8_t> Payload(size_t size)
+  {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; ++i) {
+      payload[i] = static_cast<uint8_t>(i % 251);
+    }
+    return payload;
+  }
+
+  static long Produce(size_t offset, uint8_t *block, size_t block_size,
+                      bool *more, void *user_data)
+  {
+    auto *data = static_cast<StreamData *>(user_data);
+    if (block == nullptr) {
+      data->released = true;
+      return 0;
+    }
+    ++data->calls;
+    // produce at most 100 bytes per call to exercise refilling of the block
+    size_t len = std::min({ block_size, data->payload.size() - offset,
+                            static_cast<size_t>(100) });
+    memcpy(block, &data->payload[offset], len);
+    *more = offset + len < data->payload.size();
+    return static_cast<long>(len);
+  }
+
+  static bool Consume(const oc_endpoint_t *, size_t offset,
+                      const uint8_t *block, size_t block_size, bool last,
+                      void *user_data)
+  {
+    auto *data = static_cast<StreamData *>(user_data);
+    if (block == nullptr) {
+      data->aborted = true;
+      return false;
+    }
+    EXPECT_EQ(data->payload.size(), offset);
+    data->payload.insert(data->payload.end(), block, block + block_size);
+    data->released = last;
+    return true;
+  }
+
+  oc_endpoint_t endpoint_;
+};
+
+TEST_F(TestBlockwise, DispatchStream)
+{
+  StreamData data{ Payload(OC_BLOCK_SIZE * 3 + 17), 0, false, false };
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_SERVER,
+    OC_MIN_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+  ASSERT_TRUE(oc_blockwise_set_response_stream(buffer, Produce, &data));
+
+  std::vector<uint8_t> received{};
+  uint32_t offset = 0;
+  while (true) {
+    uint32_t size = 0;
+    const auto *block = static_cast<const uint8_t *>(
+      oc_blockwise_dispatch_block(buffer, offset, OC_BLOCK_SIZE, &size));
+    ASSERT_NE(nullptr, block);
+    // a retransmitted request is served from the held block
+    uint32_t resend_size = 0;
+    EXPECT_EQ(block, oc_blockwise_dispatch_block(buffer, offset, OC_BLOCK_SIZE,
+                                                 &resend_size));
+    EXPECT_EQ(size, resend_size);
+    received.insert(received.end(), block, block + size);
+    offset += size;
+    if (buffer->next_block_offset >= buffer->payload_size) {
+      break;
+    }
+    EXPECT_EQ(static_cast<uint32_t>(OC_BLOCK_SIZE), size);
+  }
+  EXPECT_EQ(data.payload, received);
+  EXPECT_EQ(data.payload.size(), buffer->payload_size);
+  // blocks that are no longer held cannot be dispatched
+  uint32_t size = 0;
+  EXPECT_EQ(nullptr, oc_blockwise_dispatch_block(buffer, 0, OC_BLOCK_SIZE,
+                                                 &size));
+
+  oc_blockwise_free_response_buffer(buffer);
+  EXPECT_TRUE(data.released);
+}
+
+#ifdef OC_TCP
+TEST_F(TestBlockwise, DispatchStreamBERT)
+{
+  StreamData data{ Payload(OC_BLOCKWISE_BERT_BLOCK_SIZE + 100), 0, false,
+                   false };
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_SERVER,
+    OC_MIN_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+  ASSERT_TRUE(oc_blockwise_set_response_stream(buffer, Produce, &data));
+
+  // a BERT block spans multiple units, the block buffer grows to hold it
+  uint32_t size = 0;
+  const auto *block = static_cast<const uint8_t *>(oc_blockwise_dispatch_block(
+    buffer, 0, OC_BLOCKWISE_BERT_BLOCK_SIZE, &size));
+  ASSERT_NE(nullptr, block);
+  EXPECT_EQ(OC_BLOCKWISE_BERT_BLOCK_SIZE, size);
+  EXPECT_EQ(0, memcmp(data.payload.data(), block, size));
+  EXPECT_LT(buffer->next_block_offset, buffer->payload_size);
+
+  block = static_cast<const uint8_t *>(oc_blockwise_dispatch_block(
+    buffer, size, OC_BLOCKWISE_BERT_BLOCK_SIZE, &size));
+  ASSERT_NE(nullptr, block);
+  EXPECT_EQ(100U, size);
+  EXPECT_EQ(buffer->next_block_offset, buffer->payload_size);
+  oc_blockwise_free_response_buffer(buffer);
+}
+#endif /* OC_TCP */
+
+TEST_F(TestBlockwise, DispatchStreamError)
+{
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_SERVER,
+    OC_MIN_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+  ASSERT_TRUE(oc_blockwise_set_response_stream(
+    buffer,
+    [](size_t, uint8_t *, size_t, bool *, void *) -> long { return -1; },
+    nullptr));
+  uint32_t size = 0;
+  EXPECT_EQ(nullptr,
+            oc_blockwise_dispatch_block(buffer, 0, OC_BLOCK_SIZE, &size));
+  oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestBlockwise, HandleStreamBlock)
+{
+  StreamData data{ {}, 0, false, false };
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_request_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_POST, OC_BLOCKWISE_SERVER, 0);
+  ASSERT_NE(nullptr, buffer);
+  oc_blockwise_set_request_stream(buffer, Consume, &data);
+
+  std::vector<uint8_t> payload = Payload(OC_BLOCK_SIZE * 2 + 5);
+  uint32_t offset = 0;
+  while (offset < payload.size()) {
+    auto size = static_cast<uint32_t>(
+      std::min(payload.size() - offset, static_cast<size_t>(OC_BLOCK_SIZE)));
+    bool last = offset + size == payload.size();
+    ASSERT_TRUE(oc_blockwise_handle_stream_block(buffer, offset,
+                                                 &payload[offset], size, last));
+    // duplicates are accepted but not passed to the consumer again
+    ASSERT_TRUE(oc_blockwise_handle_stream_block(buffer, offset,
+                                                 &payload[offset], size, last));
+    offset += size;
+  }
+  EXPECT_EQ(payload, data.payload);
+  EXPECT_TRUE(data.released);
+  // blocks from the future are rejected
+  EXPECT_FALSE(oc_blockwise_handle_stream_block(buffer, offset + 1,
+                                                payload.data(), 1, true));
+
+  oc_blockwise_free_request_buffer(buffer);
+  EXPECT_FALSE(data.aborted);
+}
+
+TEST_F(TestBlockwise, HandleStreamBlockAbort)
+{
+  StreamData data{ {}, 0, false, false };
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_request_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_PUT, OC_BLOCKWISE_SERVER, 0);
+  ASSERT_NE(nullptr, buffer);
+  oc_blockwise_set_request_stream(buffer, Consume, &data);
+
+  std::vector<uint8_t> payload = Payload(OC_BLOCK_SIZE);
+  ASSERT_TRUE(oc_blockwise_handle_stream_block(buffer, 0, payload.data(),
+                                               OC_BLOCK_SIZE, false));
+  // the transfer expires before the last block arrives
+  oc_blockwise_free_request_buffer(buffer);
+  EXPECT_TRUE(data.aborted);
+}
+
+#ifdef OC_SERVER
+TEST_F(TestBlockwise, SendResponseStream)
+{
+  StreamData data{ Payload(OC_BLOCK_SIZE), 0, false, false };
+  oc_response_buffer_t response_buffer{};
+  oc_response_t response{};
+  response.response_buffer = &response_buffer;
+  oc_request_t request{};
+  request.response = &response;
+
+  // only the response of the request dispatched by the engine can stream
+  oc_response_stream_enable(&response_buffer);
+  oc_send_response_stream(&request, APPLICATION_CBOR, Produce, &data,
+                          OC_STATUS_OK);
+  oc_response_stream_enable(nullptr);
+  EXPECT_EQ(reinterpret_cast<void *>(Produce),
+            reinterpret_cast<void *>(response_buffer.stream_cb));
+  EXPECT_EQ(oc_status_code(OC_STATUS_OK), response_buffer.code);
+  EXPECT_FALSE(data.released);
+
+  // e.g. a link of a batch request, the stream is released and rejected
+  oc_response_buffer_t link_buffer{};
+  response.response_buffer = &link_buffer;
+  oc_send_response_stream(&request, APPLICATION_CBOR, Produce, &data,
+                          OC_STATUS_OK);
+  EXPECT_EQ(nullptr, link_buffer.stream_cb);
+  EXPECT_EQ(oc_status_code(OC_STATUS_INTERNAL_SERVER_ERROR), link_buffer.code);
+  EXPECT_TRUE(data.released);
+}
+#endif /* OC_SERVER */
+
+#ifdef OC_CLIENT
+
+TEST_F(TestBlockwise, WindowReassembly)
+{
+  const uint16_t block_size = 64;
+  std::vector<uint8_t> payload = Payload(block_size * 5 + 10);
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_CLIENT,
+    OC_MAX_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+  ASSERT_TRUE(oc_blockwise_handle_block(buffer, 0, payload.data(), block_size));
+  ASSERT_TRUE(oc_blockwise_window_start(
+    buffer, static_cast<uint32_t>(payload.size()), block_size));
+
+  auto handle = [&](uint32_t block) {
+    uint32_t offset = block * block_size;
+    auto size = static_cast<uint32_t>(
+      std::min(payload.size() - offset, static_cast<size_t>(block_size)));
+    return oc_blockwise_window_handle_block(buffer, offset, &payload[offset],
+                                            size);
+  };
+  // blocks received ahead are kept until the missing block arrives
+  ASSERT_TRUE(handle(3));
+  ASSERT_TRUE(handle(2));
+  EXPECT_EQ(block_size, buffer->next_block_offset);
+  ASSERT_TRUE(handle(1));
+  EXPECT_EQ(block_size * 4U, buffer->next_block_offset);
+  // duplicates are accepted, misaligned blocks are not
+  EXPECT_TRUE(handle(2));
+  EXPECT_FALSE(oc_blockwise_window_handle_block(
+    buffer, block_size * 4 + 1, payload.data(), block_size));
+  ASSERT_TRUE(handle(5));
+  EXPECT_EQ(block_size * 4U, buffer->next_block_offset);
+  ASSERT_TRUE(handle(4));
+  ASSERT_EQ(payload.size(), buffer->next_block_offset);
+  EXPECT_EQ(0, memcmp(payload.data(), buffer->buffer, payload.size()));
+  oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestBlockwise, WindowNextRequest)
+{
+  const uint16_t block_size = 64;
+  std::vector<uint8_t> payload = Payload(block_size * 4 + 10);
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_CLIENT,
+    OC_MAX_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+  ASSERT_TRUE(oc_blockwise_handle_block(buffer, 0, payload.data(), block_size));
+  // the representation must fit into the buffer
+  EXPECT_FALSE(oc_blockwise_window_start(buffer, OC_MAX_APP_DATA_SIZE + 1,
+                                         block_size));
+  ASSERT_TRUE(oc_blockwise_window_start(
+    buffer, static_cast<uint32_t>(payload.size()), block_size));
+
+  std::vector<uint32_t> requested{};
+  uint32_t offset = 0;
+  while (oc_blockwise_window_next_request(buffer, 2, &offset)) {
+    requested.push_back(offset);
+  }
+  EXPECT_EQ(std::vector<uint32_t>({ block_size, block_size * 2U }), requested);
+
+  // the last block is requested once all the preceding blocks arrived
+  requested.clear();
+  for (uint32_t block = 1; block < 4; ++block) {
+    offset = block * block_size;
+    ASSERT_TRUE(oc_blockwise_window_handle_block(buffer, offset,
+                                                 &payload[offset], block_size));
+    while (oc_blockwise_window_next_request(buffer, 2, &offset)) {
+      requested.push_back(offset);
+    }
+  }
+  EXPECT_EQ(std::vector<uint32_t>({ block_size * 3U, block_size * 4U }),
+            requested);
+  EXPECT_FALSE(oc_blockwise_window_next_request(buffer, 2, &offset));
+  oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestBlockwise, ResponseETag)
+{
+  const std::vector<uint8_t> etag1{ 1, 2, 3, 4 };
+  const std::vector<uint8_t> etag2{ 5, 6, 7, 8 };
+  const uint32_t block_size = 64;
+  std::vector<uint8_t> payload = Payload(block_size);
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_CLIENT,
+    OC_MAX_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+
+  // the first block must be received first
+  EXPECT_FALSE(oc_blockwise_response_match_etag(buffer, block_size,
+                                                etag1.data(), etag1.size()));
+  ASSERT_TRUE(oc_blockwise_response_match_etag(buffer, 0, etag1.data(),
+                                               etag1.size()));
+  ASSERT_TRUE(oc_blockwise_handle_block(buffer, 0, payload.data(), block_size));
+  EXPECT_TRUE(oc_blockwise_response_match_etag(buffer, block_size,
+                                               etag1.data(), etag1.size()));
+  EXPECT_TRUE(oc_blockwise_response_match_etag(buffer, block_size, nullptr, 0));
+  EXPECT_FALSE(oc_blockwise_response_match_etag(buffer, block_size,
+                                                etag2.data(), etag2.size()));
+
+  // the transfer starts over with the new representation, a representation
+  // that keeps changing fails the transfer
+  int restarts = 0;
+  while (oc_blockwise_response_restart(buffer)) {
+    ++restarts;
+    EXPECT_EQ(0U, buffer->next_block_offset);
+    EXPECT_FALSE(oc_blockwise_response_match_etag(buffer, block_size,
+                                                  etag1.data(), etag1.size()));
+    ASSERT_TRUE(oc_blockwise_response_match_etag(buffer, 0, etag2.data(),
+                                                 etag2.size()));
+  }
+  EXPECT_LT(0, restarts);
+  oc_blockwise_free_response_buffer(buffer);
+}
+
+TEST_F(TestBlockwise, ResponseWithoutETag)
+{
+  const std::vector<uint8_t> etag{ 1, 2, 3, 4 };
+  const uint32_t block_size = 64;
+  std::vector<uint8_t> payload = Payload(block_size);
+  oc_blockwise_state_t *buffer = oc_blockwise_alloc_response_buffer(
+    kHref.c_str(), kHref.length(), &endpoint_, OC_GET, OC_BLOCKWISE_CLIENT,
+    OC_MAX_APP_DATA_SIZE);
+  ASSERT_NE(nullptr, buffer);
+
+  // without an ETag in the first block the following blocks are not checked
+  ASSERT_TRUE(oc_blockwise_response_match_etag(buffer, 0, nullptr, 0));
+  ASSERT_TRUE(oc_blockwise_handle_block(buffer, 0, payload.data(), block_size));
+  EXPECT_TRUE(oc_blockwise_response_match_etag(buffer, block_size, etag.data(),
+                                               etag.size()));
+  EXPECT_TRUE(oc_blockwise_response_match_etag(buffer, block_size, nullptr, 0));
+  oc_blockwise_free_response_buffer(buffer);
+}
+
+#endif /* OC_CLIENT */
+
+#endif /* OC_BLOCK_WISE */
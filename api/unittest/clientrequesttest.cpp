@@ -0,0 +1,270 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#if defined(OC_SERVER) && defined(OC_CLIENT) &&                                \
+  defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_SECURITY)
+
+#include "oc_api.h"
+#include "oc_endpoint.h"
+#include "oc_ri.h"
+#include "tests/gtest/Device.h"
+
+#include <array>
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// {"v": 42}
+static const std::array<uint8_t, 5> kPayload = { 0xa1, 0x61, 0x76, 0x18, 0x2a };
+
+class TestClientRequest : public testing::Test {
+public:
+  static void SetUpTestCase()
+  {
+    EXPECT_TRUE(oc::TestDevice::StartServer());
+
+    oc::DynamicResourceHandler handlers{};
+    handlers.onPost = onPost;
+    oc::DynamicResourceToAdd dr{
+      "Builder",
+      "/builder",
+      { "oic.r.test" },
+      { OC_IF_BASELINE, OC_IF_RW },
+      handlers,
+    };
+    ASSERT_NE(nullptr, oc::TestDevice::AddDynamicResource(dr, /*device*/ 0));
+  }
+
+  static void TearDownTestCase()
+  {
+    oc::TestDevice::ClearDynamicResources();
+    oc::TestDevice::StopServer();
+  }
+
+  // echo the value of the request
+  static void onPost(oc_request_t *request, oc_interface_mask_t, void *)
+  {
+    int64_t value = -1;
+    oc_rep_get_int(request->request_payload, "v", &value);
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, v, value);
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_CHANGED);
+  }
+
+  struct Responses
+  {
+    size_t expected;
+    std::vector<oc_status_t> codes;
+    std::set<int64_t> values;
+  };
+
+  static void onResponse(oc_client_response_t *data)
+  {
+    auto *responses = static_cast<Responses *>(data->user_data);
+    responses->codes.push_back(data->code);
+    int64_t value = -1;
+    if (oc_rep_get_int(data->payload, "v", &value)) {
+      responses->values.insert(value);
+    }
+    if (responses->codes.size() == responses->expected) {
+      oc::TestDevice::Terminate();
+    }
+  }
+
+  static const oc_endpoint_t *endpoint()
+  {
+    unsigned exclude = SECURED;
+#ifdef OC_TCP
+    exclude |= TCP;
+#endif /* OC_TCP */
+    const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+    EXPECT_NE(nullptr, ep);
+    return ep;
+  }
+
+  static oc_client_request_t *post(int64_t value, Responses *responses)
+  {
+    oc_client_request_t *request =
+      oc_client_request_new(OC_POST, "/builder", endpoint(), nullptr,
+                            onResponse, HIGH_QOS, responses);
+    EXPECT_NE(nullptr, request);
+    EXPECT_TRUE(oc_client_request_begin_payload(request));
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, v, value);
+    oc_rep_end_root_object();
+    EXPECT_TRUE(oc_client_request_end_payload(request));
+    return request;
+  }
+};
+
+TEST_F(TestClientRequest, Send)
+{
+  Responses responses{ 1, {}, {} };
+  EXPECT_TRUE(oc_client_request_send(post(42, &responses)));
+  oc::TestDevice::PoolEvents(5);
+  ASSERT_EQ(1, responses.codes.size());
+  EXPECT_EQ(OC_STATUS_CHANGED, responses.codes[0]);
+  EXPECT_EQ(1, responses.values.count(42));
+}
+
+TEST_F(TestClientRequest, SendPrepared)
+{
+  constexpr size_t kCount = 4;
+  Responses responses{ kCount, {}, {} };
+  // all payloads are built before any request is sent
+  std::vector<oc_client_request_t *> requests{};
+  for (size_t i = 0; i < kCount; ++i) {
+    requests.push_back(post(static_cast<int64_t>(i), &responses));
+  }
+  for (oc_client_request_t *request : requests) {
+    EXPECT_TRUE(oc_client_request_send(request));
+  }
+  oc::TestDevice::PoolEvents(10);
+  ASSERT_EQ(kCount, responses.codes.size());
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_EQ(OC_STATUS_CHANGED, responses.codes[i]);
+    EXPECT_EQ(1, responses.values.count(static_cast<int64_t>(i)));
+  }
+}
+
+TEST_F(TestClientRequest, NestedPayloads)
+{
+  Responses responses{ 2, {}, {} };
+  oc_client_request_t *outer = oc_client_request_new(
+    OC_POST, "/builder", endpoint(), nullptr, onResponse, HIGH_QOS, &responses);
+  ASSERT_NE(nullptr, outer);
+  ASSERT_TRUE(oc_client_request_begin_payload(outer));
+  oc_rep_start_root_object();
+  // the payload of another request is built in between
+  oc_client_request_t *inner = post(2, &responses);
+  oc_rep_set_int(root, v, 1);
+  oc_rep_end_root_object();
+  EXPECT_TRUE(oc_client_request_end_payload(outer));
+
+  EXPECT_TRUE(oc_client_request_send(outer));
+  EXPECT_TRUE(oc_client_request_send(inner));
+  oc::TestDevice::PoolEvents(5);
+  ASSERT_EQ(2, responses.codes.size());
+  EXPECT_EQ(1, responses.values.count(1));
+  EXPECT_EQ(1, responses.values.count(2));
+}
+
+TEST_F(TestClientRequest, LegacyWithPendingBuilder)
+{
+  // a request builder waiting to be sent doesn't block oc_init_post
+  Responses responses{ 2, {}, {} };
+  oc_client_request_t *pending = post(1, &responses);
+  ASSERT_TRUE(oc_init_post("/builder", endpoint(), nullptr, onResponse,
+                           HIGH_QOS, &responses));
+  oc_rep_start_root_object();
+  oc_rep_set_int(root, v, 2);
+  oc_rep_end_root_object();
+  EXPECT_TRUE(oc_do_post());
+  EXPECT_TRUE(oc_client_request_send(pending));
+  oc::TestDevice::PoolEvents(5);
+  ASSERT_EQ(2, responses.codes.size());
+  EXPECT_EQ(1, responses.values.count(1));
+  EXPECT_EQ(1, responses.values.count(2));
+}
+
+TEST_F(TestClientRequest, SubmitFromThread)
+{
+  Responses responses{ 1, {}, {} };
+  const oc_endpoint_t *ep = endpoint();
+  std::thread([ep, &responses] {
+    oc_client_request_t *request =
+      oc_client_request_new(OC_POST, "/builder", ep, nullptr, onResponse,
+                            HIGH_QOS, &responses);
+    ASSERT_NE(nullptr, request);
+    EXPECT_TRUE(
+      oc_client_request_set_payload(request, kPayload.data(), kPayload.size()));
+    oc_client_request_submit(&request, 1);
+  }).join();
+  oc::TestDevice::PoolEvents(5);
+  ASSERT_EQ(1, responses.codes.size());
+  EXPECT_EQ(OC_STATUS_CHANGED, responses.codes[0]);
+  EXPECT_EQ(1, responses.values.count(42));
+}
+
+TEST_F(TestClientRequest, PayloadOfGet)
+{
+  Responses responses{ 1, {}, {} };
+  oc_client_request_t *request = oc_client_request_new(
+    OC_GET, "/builder", endpoint(), nullptr, onResponse, HIGH_QOS, &responses);
+  ASSERT_NE(nullptr, request);
+  EXPECT_FALSE(oc_client_request_begin_payload(request));
+  EXPECT_FALSE(
+    oc_client_request_set_payload(request, kPayload.data(), kPayload.size()));
+  oc_client_request_free(request);
+}
+
+TEST_F(TestClientRequest, PayloadTooLarge)
+{
+  Responses responses{ 1, {}, {} };
+  oc_client_request_t *request = oc_client_request_new(
+    OC_PUT, "/builder", endpoint(), nullptr, onResponse, HIGH_QOS, &responses);
+  ASSERT_NE(nullptr, request);
+  std::vector<uint8_t> payload(OC_MAX_APP_DATA_SIZE + 1);
+  EXPECT_FALSE(
+    oc_client_request_set_payload(request, payload.data(), payload.size()));
+  oc_client_request_free(request);
+}
+
+#ifdef OC_JSON_ENCODER
+
+TEST_F(TestClientRequest, AcceptJSON)
+{
+  struct RawResponse
+  {
+    oc_status_t code;
+    oc_content_format_t content_format;
+    std::string payload;
+  };
+  auto handler = [](oc_client_response_t *data) {
+    oc::TestDevice::Terminate();
+    auto *response = static_cast<RawResponse *>(data->user_data);
+    response->code = data->code;
+    // a JSON payload is not parsed
+    EXPECT_EQ(nullptr, data->payload);
+    const uint8_t *payload = nullptr;
+    size_t size = 0;
+    if (oc_get_response_payload_raw(data, &payload, &size,
+                                    &response->content_format)) {
+      response->payload.assign(reinterpret_cast<const char *>(payload), size);
+    }
+  };
+  RawResponse response{ OC_STATUS_OK, TEXT_PLAIN, {} };
+  oc_client_request_t *request = oc_client_request_new(
+    OC_POST, "/builder", endpoint(), nullptr, handler, HIGH_QOS, &response);
+  ASSERT_NE(nullptr, request);
+  oc_client_request_set_accept(request, APPLICATION_JSON);
+  EXPECT_TRUE(
+    oc_client_request_set_payload(request, kPayload.data(), kPayload.size()));
+  EXPECT_TRUE(oc_client_request_send(request));
+  oc::TestDevice::PoolEvents(5);
+  EXPECT_EQ(OC_STATUS_CHANGED, response.code);
+  EXPECT_EQ(APPLICATION_JSON, response.content_format);
+  EXPECT_EQ(R"({"v":42})", response.payload);
+}
+
+#endif /* OC_JSON_ENCODER */
+
+#endif /* OC_SERVER && OC_CLIENT && OC_DYNAMIC_ALLOCATION && !OC_SECURITY */
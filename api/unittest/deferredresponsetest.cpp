@@ -0,0 +1,510 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#if defined(OC_SERVER) && defined(OC_CLIENT) &&                                \
+  defined(OC_DYNAMIC_ALLOCATION) && !defined(OC_SECURITY)
+
+#include "api/oc_deferred_response_internal.h"
+#include "messaging/coap/coap.h"
+#include "oc_api.h"
+#include "oc_collection.h"
+#include "oc_endpoint.h"
+#include "oc_ri.h"
+#include "tests/gtest/Device.h"
+
+#include <array>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// {"v": 42}
+static const std::array<uint8_t, 5> kPayload = { 0xa1, 0x61, 0x76, 0x18, 0x2a };
+
+class TestDeferredResponse : public testing::Test {
+public:
+  enum class Complete {
+    IN_HANDLER,
+    FROM_THREAD,
+    AFTER_ACK,
+    TOO_LARGE,
+    TWICE,
+    NEVER,
+  };
+
+  static void SetUpTestCase()
+  {
+    EXPECT_TRUE(oc::TestDevice::StartServer());
+
+    oc::DynamicResourceHandler handlers{};
+    handlers.onGet = onGet;
+    oc::DynamicResourceToAdd dr{
+      "Deferred",
+      "/deferred",
+      { "oic.r.test" },
+      { OC_IF_BASELINE, OC_IF_R },
+      handlers,
+    };
+    ASSERT_NE(nullptr, oc::TestDevice::AddDynamicResource(dr, /*device*/ 0));
+  }
+
+  static void TearDownTestCase()
+  {
+    oc::TestDevice::ClearDynamicResources();
+    oc::TestDevice::StopServer();
+  }
+
+  void TearDown() override { EXPECT_EQ(0, oc_deferred_response_count()); }
+
+  static bool complete(oc_deferred_response_handle_t handle)
+  {
+    if (complete_ == Complete::TOO_LARGE) {
+      std::vector<uint8_t> payload(OC_MAX_APP_DATA_SIZE + 1);
+      return oc_complete_deferred_response(handle, OC_STATUS_OK,
+                                           APPLICATION_VND_OCF_CBOR,
+                                           payload.data(), payload.size());
+    }
+    return oc_complete_deferred_response(handle, OC_STATUS_OK,
+                                         APPLICATION_VND_OCF_CBOR,
+                                         kPayload.data(), kPayload.size());
+  }
+
+  static oc_event_callback_retval_t completeDelayed(void *)
+  {
+    EXPECT_TRUE(complete(delayed_));
+    return OC_EVENT_DONE;
+  }
+
+  static void onGet(oc_request_t *request, oc_interface_mask_t, void *)
+  {
+    oc_deferred_response_handle_t handle = oc_defer_response(request);
+    ASSERT_NE(0U, handle);
+    // deferring twice returns the same handle
+    EXPECT_EQ(handle, oc_defer_response(request));
+    switch (complete_) {
+    case Complete::IN_HANDLER:
+      EXPECT_TRUE(complete(handle));
+      break;
+    case Complete::FROM_THREAD:
+      std::thread([handle] { EXPECT_TRUE(complete(handle)); }).detach();
+      break;
+    case Complete::AFTER_ACK:
+      delayed_ = handle;
+      oc_set_delayed_callback_ms_v1(nullptr, completeDelayed,
+                                    2 * OC_DEFERRED_RESPONSE_ACK_DELAY *
+                                      1000 / OC_CLOCK_SECOND);
+      break;
+    case Complete::TOO_LARGE:
+      EXPECT_FALSE(complete(handle));
+      break;
+    case Complete::TWICE:
+      EXPECT_TRUE(complete(handle));
+      // the first payload is sent
+      EXPECT_FALSE(oc_complete_deferred_response(
+        handle, OC_STATUS_BAD_REQUEST, APPLICATION_VND_OCF_CBOR, nullptr, 0));
+      break;
+    case Complete::NEVER:
+      EXPECT_TRUE(oc_deferred_response_set_timeout_ms(handle, 200));
+      expired_ = handle;
+      break;
+    }
+  }
+
+  struct Response
+  {
+    bool invoked;
+    oc_status_t code;
+    int64_t value;
+  };
+
+  static Response get(oc_qos_t qos)
+  {
+    unsigned exclude = SECURED;
+#ifdef OC_TCP
+    exclude |= TCP;
+#endif /* OC_TCP */
+    const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+    EXPECT_NE(nullptr, ep);
+
+    auto handler = [](oc_client_response_t *data) {
+      oc::TestDevice::Terminate();
+      auto *response = static_cast<Response *>(data->user_data);
+      response->invoked = true;
+      response->code = data->code;
+      oc_rep_get_int(data->payload, "v", &response->value);
+    };
+    Response response{ false, OC_STATUS_OK, 0 };
+    EXPECT_TRUE(oc_do_get("/deferred", ep, nullptr, handler, qos, &response));
+    oc::TestDevice::PoolEvents(5);
+    return response;
+  }
+
+  static oc_deferred_response_t *deferLocal(oc_response_buffer_t *buffer,
+                                            oc_deferred_response_handle_t *id)
+  {
+    oc_response_t response{};
+    response.response_buffer = buffer;
+    oc_request_t request{};
+    request.response = &response;
+    oc_deferred_response_enable(buffer);
+    *id = oc_defer_response(&request);
+    oc_deferred_response_enable(nullptr);
+    return buffer->deferred;
+  }
+
+  // binds the response to a Non-confirmable request of the device itself
+  static void acceptNon(oc_deferred_response_t *dr, uint16_t mid)
+  {
+    unsigned exclude = SECURED;
+#ifdef OC_TCP
+    exclude |= TCP;
+#endif /* OC_TCP */
+    const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+    ASSERT_NE(nullptr, ep);
+    coap_packet_t packet{};
+    coap_udp_init_message(&packet, COAP_TYPE_NON, COAP_GET, mid);
+    coap_set_header_uri_path(&packet, "/deferred", strlen("/deferred"));
+    coap_packet_t response{};
+    coap_udp_init_message(&response, COAP_TYPE_NON, CONTENT_2_05, mid);
+#ifdef OC_BLOCK_WISE
+    oc_deferred_response_accept(dr, &packet, &response, ep, 0);
+#else  /* !OC_BLOCK_WISE */
+    oc_deferred_response_accept(dr, &packet, &response, ep);
+#endif /* OC_BLOCK_WISE */
+  }
+
+  static Complete complete_;
+  static oc_deferred_response_handle_t delayed_;
+  static oc_deferred_response_handle_t expired_;
+};
+
+TestDeferredResponse::Complete TestDeferredResponse::complete_ =
+  TestDeferredResponse::Complete::IN_HANDLER;
+oc_deferred_response_handle_t TestDeferredResponse::delayed_ = 0;
+oc_deferred_response_handle_t TestDeferredResponse::expired_ = 0;
+
+TEST_F(TestDeferredResponse, DeferOutsideHandler)
+{
+  oc_response_buffer_t response_buffer{};
+  oc_response_t response{};
+  response.response_buffer = &response_buffer;
+  oc_request_t request{};
+  request.response = &response;
+  EXPECT_EQ(0U, oc_defer_response(&request));
+  EXPECT_EQ(0U, oc_defer_response(nullptr));
+}
+
+TEST_F(TestDeferredResponse, CompleteInHandler)
+{
+  complete_ = Complete::IN_HANDLER;
+  for (oc_qos_t qos : { HIGH_QOS, LOW_QOS }) {
+    Response response = get(qos);
+    EXPECT_TRUE(response.invoked);
+    EXPECT_EQ(OC_STATUS_OK, response.code);
+    EXPECT_EQ(42, response.value);
+  }
+}
+
+TEST_F(TestDeferredResponse, CompleteFromThread)
+{
+  complete_ = Complete::FROM_THREAD;
+  for (oc_qos_t qos : { HIGH_QOS, LOW_QOS }) {
+    Response response = get(qos);
+    EXPECT_TRUE(response.invoked);
+    EXPECT_EQ(OC_STATUS_OK, response.code);
+    EXPECT_EQ(42, response.value);
+  }
+}
+
+TEST_F(TestDeferredResponse, CompleteAfterAck)
+{
+  // an empty ACK is sent and the response follows as a separate message
+  complete_ = Complete::AFTER_ACK;
+  for (oc_qos_t qos : { HIGH_QOS, LOW_QOS }) {
+    Response response = get(qos);
+    EXPECT_TRUE(response.invoked);
+    EXPECT_EQ(OC_STATUS_OK, response.code);
+    EXPECT_EQ(42, response.value);
+  }
+}
+
+TEST_F(TestDeferredResponse, CompleteTooLarge)
+{
+  complete_ = Complete::TOO_LARGE;
+  Response response = get(HIGH_QOS);
+  EXPECT_TRUE(response.invoked);
+  EXPECT_EQ(OC_STATUS_INTERNAL_SERVER_ERROR, response.code);
+}
+
+TEST_F(TestDeferredResponse, CompleteTwice)
+{
+  complete_ = Complete::TWICE;
+  Response response = get(HIGH_QOS);
+  EXPECT_TRUE(response.invoked);
+  EXPECT_EQ(OC_STATUS_OK, response.code);
+  EXPECT_EQ(42, response.value);
+}
+
+TEST_F(TestDeferredResponse, Timeout)
+{
+  complete_ = Complete::NEVER;
+  expired_ = 0;
+  Response response = get(HIGH_QOS);
+  EXPECT_TRUE(response.invoked);
+  EXPECT_EQ(OC_STATUS_SERVICE_UNAVAILABLE, response.code);
+  ASSERT_NE(0U, expired_);
+  // the handle was freed, completing it is rejected
+  EXPECT_FALSE(complete(expired_));
+  EXPECT_FALSE(oc_deferred_response_set_timeout_ms(expired_, 200));
+}
+
+TEST_F(TestDeferredResponse, StaleHandle)
+{
+  oc_response_buffer_t first_buffer{};
+  oc_deferred_response_handle_t first = 0;
+  oc_deferred_response_t *dr = deferLocal(&first_buffer, &first);
+  ASSERT_NE(nullptr, dr);
+  ASSERT_NE(0U, first);
+  acceptNon(dr, 42);
+  EXPECT_TRUE(complete(first));
+  oc::TestDevice::PoolEventsMs(200);
+  EXPECT_EQ(0, oc_deferred_response_count());
+
+  // the next response may reuse the memory of the freed one, but not its handle
+  oc_response_buffer_t second_buffer{};
+  oc_deferred_response_handle_t second = 0;
+  dr = deferLocal(&second_buffer, &second);
+  ASSERT_NE(nullptr, dr);
+  ASSERT_NE(0U, second);
+  EXPECT_NE(first, second);
+  acceptNon(dr, 43);
+  EXPECT_FALSE(complete(first));
+  EXPECT_EQ(1, oc_deferred_response_count());
+  EXPECT_TRUE(complete(second));
+  oc::TestDevice::PoolEventsMs(200);
+}
+
+TEST_F(TestDeferredResponse, IsDuplicate)
+{
+  complete_ = Complete::IN_HANDLER;
+  unsigned exclude = SECURED;
+#ifdef OC_TCP
+  exclude |= TCP;
+#endif /* OC_TCP */
+  const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+  ASSERT_NE(nullptr, ep);
+
+  oc_response_buffer_t response_buffer{};
+  oc_deferred_response_handle_t id = 0;
+  oc_deferred_response_t *handle = deferLocal(&response_buffer, &id);
+  ASSERT_NE(nullptr, handle);
+
+  coap_packet_t packet{};
+  coap_udp_init_message(&packet, COAP_TYPE_CON, COAP_GET, 42);
+  coap_set_header_uri_path(&packet, "/deferred", strlen("/deferred"));
+  coap_packet_t ack{};
+  coap_udp_init_message(&ack, COAP_TYPE_ACK, CONTENT_2_05, 42);
+#ifdef OC_BLOCK_WISE
+  oc_deferred_response_accept(handle, &packet, &ack, ep, 0);
+#else  /* !OC_BLOCK_WISE */
+  oc_deferred_response_accept(handle, &packet, &ack, ep);
+#endif /* OC_BLOCK_WISE */
+
+  EXPECT_TRUE(oc_deferred_response_is_duplicate(&packet, ep));
+  // another message ID
+  coap_packet_t other{};
+  coap_udp_init_message(&other, COAP_TYPE_CON, COAP_GET, 43);
+  EXPECT_FALSE(oc_deferred_response_is_duplicate(&other, ep));
+  // another endpoint
+  oc_endpoint_t other_ep = *ep;
+  if ((other_ep.flags & IPV6) != 0) {
+    ++other_ep.addr.ipv6.port;
+  }
+#ifdef OC_IPV4
+  else {
+    ++other_ep.addr.ipv4.port;
+  }
+#endif /* OC_IPV4 */
+  EXPECT_FALSE(oc_deferred_response_is_duplicate(&packet, &other_ep));
+  // a non-confirmable message is never a duplicate
+  coap_packet_t non{};
+  coap_udp_init_message(&non, COAP_TYPE_NON, COAP_GET, 42);
+  EXPECT_FALSE(oc_deferred_response_is_duplicate(&non, ep));
+
+  EXPECT_TRUE(complete(id));
+  oc::TestDevice::PoolEventsMs(200);
+  // the sent response is removed from the index
+  EXPECT_FALSE(oc_deferred_response_is_duplicate(&packet, ep));
+}
+
+#ifdef OC_COLLECTIONS
+
+class TestDeferredBatchResponse : public testing::Test {
+public:
+  static void SetUpTestCase()
+  {
+    EXPECT_TRUE(oc::TestDevice::StartServer());
+
+    oc::DynamicResourceHandler fast{};
+    fast.onGet = onGetFast;
+    oc::DynamicResourceToAdd fastResource{
+      "Fast", "/fast", { "oic.r.test" }, { OC_IF_BASELINE, OC_IF_R }, fast,
+    };
+    oc_resource_t *fastRes =
+      oc::TestDevice::AddDynamicResource(fastResource, /*device*/ 0);
+    ASSERT_NE(nullptr, fastRes);
+
+    oc::DynamicResourceHandler slow{};
+    slow.onGet = onGetSlow;
+    oc::DynamicResourceToAdd slowResource{
+      "Slow", "/slow", { "oic.r.test" }, { OC_IF_BASELINE, OC_IF_R }, slow,
+    };
+    oc_resource_t *slowRes =
+      oc::TestDevice::AddDynamicResource(slowResource, /*device*/ 0);
+    ASSERT_NE(nullptr, slowRes);
+
+    collection_ = oc_new_collection("Batch", "/batch", 1, /*device*/ 0);
+    ASSERT_NE(nullptr, collection_);
+    oc_resource_bind_resource_type(collection_, "oic.wk.col");
+    oc_collection_add_link(collection_, oc_new_link(fastRes));
+    oc_collection_add_link(collection_, oc_new_link(slowRes));
+    oc_add_collection(collection_);
+  }
+
+  static void TearDownTestCase()
+  {
+    oc_delete_collection(collection_);
+    oc::TestDevice::ClearDynamicResources();
+    oc::TestDevice::StopServer();
+  }
+
+  void TearDown() override
+  {
+    if (pending_ != 0) {
+      EXPECT_TRUE(oc_complete_deferred_response(
+        pending_, OC_STATUS_OK, APPLICATION_VND_OCF_CBOR, kPayload.data(),
+        kPayload.size()));
+      pending_ = 0;
+      oc::TestDevice::PoolEventsMs(200);
+    }
+    EXPECT_EQ(0, oc_deferred_response_count());
+  }
+
+  static void onGetFast(oc_request_t *request, oc_interface_mask_t, void *)
+  {
+    oc_rep_start_root_object();
+    oc_rep_set_int(root, v, 1);
+    oc_rep_end_root_object();
+    oc_send_response(request, OC_STATUS_OK);
+  }
+
+  static void onGetSlow(oc_request_t *request, oc_interface_mask_t, void *)
+  {
+    oc_deferred_response_handle_t handle = oc_defer_response(request);
+    ASSERT_NE(0U, handle);
+    if (missDeadline_) {
+      // completed after the batch response is sent
+      pending_ = handle;
+      return;
+    }
+    std::thread([handle] {
+      EXPECT_TRUE(oc_complete_deferred_response(handle, OC_STATUS_OK,
+                                                APPLICATION_VND_OCF_CBOR,
+                                                kPayload.data(),
+                                                kPayload.size()));
+    }).detach();
+  }
+
+  struct Response
+  {
+    bool invoked;
+    oc_status_t code;
+    std::map<std::string, int64_t, std::less<>> values;
+  };
+
+  static Response get()
+  {
+    unsigned exclude = SECURED;
+#ifdef OC_TCP
+    exclude |= TCP;
+#endif /* OC_TCP */
+    const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+    EXPECT_NE(nullptr, ep);
+
+    auto handler = [](oc_client_response_t *data) {
+      oc::TestDevice::Terminate();
+      auto *response = static_cast<Response *>(data->user_data);
+      response->invoked = true;
+      response->code = data->code;
+      for (const oc_rep_t *item = data->payload; item != nullptr;
+           item = item->next) {
+        char *href = nullptr;
+        size_t href_len = 0;
+        oc_rep_t *rep = nullptr;
+        int64_t value = -1;
+        if (oc_rep_get_string(item->value.object, "href", &href, &href_len) &&
+            oc_rep_get_object(item->value.object, "rep", &rep)) {
+          oc_rep_get_int(rep, "v", &value);
+          response->values[std::string(href, href_len)] = value;
+        }
+      }
+    };
+    Response response{ false, OC_STATUS_OK, {} };
+    EXPECT_TRUE(oc_do_get("/batch", ep, "if=oic.if.b", handler, HIGH_QOS,
+                          &response));
+    oc::TestDevice::PoolEvents(5);
+    return response;
+  }
+
+  static oc_resource_t *collection_;
+  static oc_deferred_response_handle_t pending_;
+  static bool missDeadline_;
+};
+
+oc_resource_t *TestDeferredBatchResponse::collection_ = nullptr;
+oc_deferred_response_handle_t TestDeferredBatchResponse::pending_ = 0;
+bool TestDeferredBatchResponse::missDeadline_ = false;
+
+TEST_F(TestDeferredBatchResponse, DeferredItem)
+{
+  missDeadline_ = false;
+  Response response = get();
+  EXPECT_TRUE(response.invoked);
+  EXPECT_EQ(OC_STATUS_OK, response.code);
+  ASSERT_EQ(2, response.values.size());
+  EXPECT_EQ(1, response.values["/fast"]);
+  EXPECT_EQ(42, response.values["/slow"]);
+}
+
+TEST_F(TestDeferredBatchResponse, MissedDeadline)
+{
+  // the deferred item is left out of the response
+  missDeadline_ = true;
+  Response response = get();
+  EXPECT_TRUE(response.invoked);
+  EXPECT_EQ(OC_STATUS_OK, response.code);
+  ASSERT_EQ(1, response.values.size());
+  EXPECT_EQ(1, response.values["/fast"]);
+  EXPECT_NE(0U, pending_);
+}
+
+#endif /* OC_COLLECTIONS */
+
+#endif /* OC_SERVER && OC_CLIENT && OC_DYNAMIC_ALLOCATION && !OC_SECURITY */
@@ -0,0 +1,509 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "util/oc_features.h"
+
+#if defined(OC_HAS_FEATURE_PUSH) && !defined(OC_SECURITY)
+
+#include "api/oc_push_internal.h"
+#include "oc_api.h"
+#include "oc_endpoint.h"
+#include "oc_push.h"
+#include "oc_ri.h"
+#include "tests/gtest/Device.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static const std::string kReceiverURI{ "/pushed" };
+static const std::string kResourceType{ "oic.r.temp" };
+
+class TestPush : public testing::Test {
+public:
+  static void SetUpTestCase()
+  {
+    ASSERT_TRUE(oc::TestDevice::StartServer());
+    oc_set_on_push_arrived(onPushArrived);
+    s_temp1 = addPushable("/temp1", buildTemp1);
+    ASSERT_NE(nullptr, s_temp1);
+    s_temp2 = addPushable("/temp2", buildTemp2);
+    ASSERT_NE(nullptr, s_temp2);
+
+    // the device pushes to its own push receiver
+    ASSERT_EQ(OC_STATUS_CHANGED, configureReceiver(kReceiverURI));
+    s_target = targetOf(kReceiverURI);
+    ASSERT_FALSE(s_target.empty());
+    s_selector = createSelector(s_target);
+    ASSERT_FALSE(s_selector.empty());
+  }
+
+  static void TearDownTestCase()
+  {
+    oc_set_on_push_arrived(nullptr);
+    deleteResource(s_selector);
+    oc_delete_resource(s_temp1);
+    oc_delete_resource(s_temp2);
+    oc::TestDevice::StopServer();
+  }
+
+  void SetUp() override
+  {
+    oc_push_set_coalescing_interval(kCoalescingIntervalMs);
+    oc_push_set_batching(false);
+    s_pushed.clear();
+  }
+
+  void TearDown() override
+  {
+    oc_push_set_coalescing_interval(OC_PUSH_COALESCING_INTERVAL_MS);
+    oc_push_set_batching(false);
+  }
+
+  static oc_resource_t *addPushable(const std::string &uri,
+                                    oc_payload_callback_t builder,
+                                    const std::string &rt = kResourceType)
+  {
+    oc_resource_t *res = oc_new_resource(nullptr, uri.c_str(), 1, 0);
+    if (res == nullptr) {
+      return nullptr;
+    }
+    oc_resource_bind_resource_type(res, rt.c_str());
+    oc_resource_bind_resource_interface(res, OC_IF_RW);
+    oc_resource_set_default_interface(res, OC_IF_RW);
+    oc_resource_set_request_handler(res, OC_GET, oc::TestDevice::DummyHandler,
+                                    nullptr);
+    oc_resource_set_pushable(res, true);
+    res->payload_builder = builder;
+    if (!oc_add_resource(res)) {
+      oc_delete_resource(res);
+      return nullptr;
+    }
+    return res;
+  }
+
+  static void buildTemp1(void) { buildValue(s_value1); }
+
+  static void buildTemp2(void) { buildValue(s_value2); }
+
+  static void buildValue(int64_t value)
+  {
+    oc_rep_open_object(root, rep);
+    oc_rep_set_int(rep, value, value);
+    oc_rep_close_object(root, rep);
+  }
+
+  static void onPushArrived(oc_pushd_resource_rep_t *pushd_rsc)
+  {
+    oc_rep_t *rep = nullptr;
+    int64_t value = -1;
+    if (oc_rep_get_object(pushd_rsc->rep, "rep", &rep) &&
+        oc_rep_get_int(rep, "value", &value)) {
+      s_pushed.push_back(value);
+    }
+  }
+
+  static const oc_endpoint_t *endpoint()
+  {
+    unsigned exclude = SECURED;
+#ifdef OC_TCP
+    exclude |= TCP;
+#endif /* OC_TCP */
+    const oc_endpoint_t *ep = oc::TestDevice::GetEndpoint(0, 0, exclude);
+    EXPECT_NE(nullptr, ep);
+    return ep;
+  }
+
+  static std::string targetOf(const std::string &path)
+  {
+    oc_string_t ep_str;
+    if (oc_endpoint_to_string(endpoint(), &ep_str) != 0) {
+      return {};
+    }
+    std::string target = oc_string(ep_str) + path;
+    oc_free_string(&ep_str);
+    return target;
+  }
+
+  struct Response
+  {
+    bool received;
+    oc_status_t code;
+    std::string href;
+  };
+
+  static void onResponse(oc_client_response_t *data)
+  {
+    auto *response = static_cast<Response *>(data->user_data);
+    response->received = true;
+    response->code = data->code;
+    char *href = nullptr;
+    size_t href_len = 0;
+    if (oc_rep_get_string(data->payload, "href", &href, &href_len)) {
+      response->href = std::string(href, href_len);
+    }
+    oc::TestDevice::Terminate();
+  }
+
+  static oc_status_t configureReceiver(const std::string &uri)
+  {
+    Response response{};
+    std::string query = "receiveruri=" + uri + "&if=oic.if.rw";
+    if (!oc_init_post(PUSHRECEIVERS_RESOURCE_PATH, endpoint(), query.c_str(),
+                      onResponse, HIGH_QOS, &response)) {
+      return OC_STATUS_INTERNAL_SERVER_ERROR;
+    }
+    oc_rep_begin_root_object();
+    oc_rep_set_text_string(root, receiveruri, uri.c_str());
+    oc_rep_open_array(root, rts);
+    oc_rep_add_text_string(rts, kResourceType.c_str());
+    oc_rep_close_array(root, rts);
+    oc_rep_end_root_object();
+    if (!oc_do_post()) {
+      return OC_STATUS_INTERNAL_SERVER_ERROR;
+    }
+    oc::TestDevice::PoolEvents(5);
+    return response.received ? response.code : OC_REQUEST_TIMEOUT;
+  }
+
+  // selector of all Resources with the resource type
+  static std::string createSelector(const std::string &pushtarget,
+                                    const std::string &rt = kResourceType)
+  {
+    Response response{};
+    if (!oc_init_post(PUSHCONFIG_RESOURCE_PATH, endpoint(), "if=oic.if.create",
+                      onResponse, HIGH_QOS, &response)) {
+      return {};
+    }
+    oc_rep_begin_root_object();
+    oc_rep_open_array(root, rt);
+    oc_rep_add_text_string(rt, "oic.r.notificationselector");
+    oc_rep_add_text_string(rt, "oic.r.pushproxy");
+    oc_rep_close_array(root, rt);
+    oc_rep_open_array(root, if);
+    oc_rep_add_text_string(if, "oic.if.rw");
+    oc_rep_add_text_string(if, "oic.if.baseline");
+    oc_rep_close_array(root, if);
+    oc_rep_open_object(root, p);
+    oc_rep_set_uint(p, bm, 3);
+    oc_rep_close_object(root, p);
+    oc_rep_open_object(root, rep);
+    oc_rep_open_array(rep, prt);
+    oc_rep_add_text_string(prt, rt.c_str());
+    oc_rep_close_array(rep, prt);
+    oc_rep_set_text_string(rep, pushtarget, pushtarget.c_str());
+    oc_rep_open_array(rep, sourcert);
+    oc_rep_add_text_string(sourcert, "oic.r.pushpayload");
+    oc_rep_close_array(rep, sourcert);
+    oc_rep_close_object(root, rep);
+    oc_rep_end_root_object();
+    if (!oc_do_post()) {
+      return {};
+    }
+    oc::TestDevice::PoolEvents(5);
+    return response.code == OC_STATUS_CREATED ? response.href : std::string{};
+  }
+
+  static void deleteResource(const std::string &uri)
+  {
+    oc_resource_t *res =
+      oc_ri_get_app_resource_by_uri(uri.c_str(), uri.length(), 0);
+    if (res != nullptr) {
+      oc_delete_resource(res);
+    }
+  }
+
+  static oc_push_target_stats_t stats(const std::string &path = kReceiverURI)
+  {
+    // zeros until the first update creates the push target
+    oc_push_target_stats_t stats{};
+    oc_push_get_target_stats(endpoint(), path.c_str(), &stats);
+    return stats;
+  }
+
+  static void changed(const oc_resource_t *res)
+  {
+    oc_resource_state_changed(oc_string(res->uri), oc_string_len(res->uri),
+                              res->device);
+  }
+
+  static constexpr uint32_t kCoalescingIntervalMs = 100;
+
+  static oc_resource_t *s_temp1;
+  static oc_resource_t *s_temp2;
+  static int64_t s_value1;
+  static int64_t s_value2;
+  static std::string s_target;
+  static std::string s_selector;
+  static std::vector<int64_t> s_pushed;
+};
+
+oc_resource_t *TestPush::s_temp1{ nullptr };
+oc_resource_t *TestPush::s_temp2{ nullptr };
+int64_t TestPush::s_value1{ 0 };
+int64_t TestPush::s_value2{ 0 };
+std::string TestPush::s_target{};
+std::string TestPush::s_selector{};
+std::vector<int64_t> TestPush::s_pushed{};
+
+TEST_F(TestPush, CoalesceUpdates)
+{
+  // the first update creates the outbound queue of the push target
+  s_value1 = 1;
+  changed(s_temp1);
+  oc::TestDevice::PoolEventsMs(500);
+  ASSERT_EQ(1, s_pushed.size());
+  oc_push_target_stats_t before = stats();
+  s_pushed.clear();
+
+  // only the latest value is pushed when the interval elapses
+  for (int64_t value = 2; value <= 4; ++value) {
+    s_value1 = value;
+    changed(s_temp1);
+  }
+  oc::TestDevice::PoolEventsMs(500);
+
+  ASSERT_EQ(1, s_pushed.size());
+  EXPECT_EQ(4, s_pushed[0]);
+  oc_push_target_stats_t after = stats();
+  EXPECT_EQ(before.sent + 1, after.sent);
+  EXPECT_EQ(before.delivered + 1, after.delivered);
+  EXPECT_EQ(0, after.queued);
+  EXPECT_FALSE(after.circuit_open);
+}
+
+TEST_F(TestPush, LatestValueWins)
+{
+  s_value1 = 10;
+  changed(s_temp1);
+  // contents of the Resource are read when the update is pushed
+  s_value1 = 11;
+  oc::TestDevice::PoolEventsMs(500);
+
+  ASSERT_EQ(1, s_pushed.size());
+  EXPECT_EQ(11, s_pushed[0]);
+}
+
+TEST_F(TestPush, UpdatesOneByOne)
+{
+  oc_push_target_stats_t before = stats();
+  s_value1 = 20;
+  s_value2 = 21;
+  changed(s_temp1);
+  changed(s_temp2);
+  oc::TestDevice::PoolEventsMs(1000);
+
+  ASSERT_EQ(2, s_pushed.size());
+  EXPECT_EQ(20, s_pushed[0]);
+  EXPECT_EQ(21, s_pushed[1]);
+  EXPECT_EQ(before.delivered + 2, stats().delivered);
+}
+
+TEST_F(TestPush, Batch)
+{
+  oc_push_set_batching(true);
+  EXPECT_TRUE(oc_push_is_batching_enabled());
+  oc_push_target_stats_t before = stats();
+  s_value1 = 30;
+  s_value2 = 31;
+  changed(s_temp1);
+  changed(s_temp2);
+  oc::TestDevice::PoolEventsMs(500);
+
+  // both updates are parsed from the array payload by the receiver
+  ASSERT_EQ(2, s_pushed.size());
+  EXPECT_EQ(30, s_pushed[0]);
+  EXPECT_EQ(31, s_pushed[1]);
+  oc_push_target_stats_t after = stats();
+  EXPECT_EQ(before.sent + 2, after.sent);
+  EXPECT_EQ(before.delivered + 2, after.delivered);
+}
+
+TEST_F(TestPush, DeletedResource)
+{
+  s_value1 = 40;
+  changed(s_temp1);
+  oc::TestDevice::PoolEventsMs(500);
+  ASSERT_EQ(1, s_pushed.size());
+  s_pushed.clear();
+
+  oc_resource_t *temp3 = addPushable("/temp3", buildTemp1);
+  ASSERT_NE(nullptr, temp3);
+  oc_push_target_stats_t before = stats();
+  changed(temp3);
+  // the Resource is deleted before its update is pushed
+  oc_delete_resource(temp3);
+  oc::TestDevice::PoolEventsMs(500);
+
+  EXPECT_TRUE(s_pushed.empty());
+  oc_push_target_stats_t after = stats();
+  EXPECT_EQ(before.sent, after.sent);
+  EXPECT_EQ(0, after.queued);
+}
+
+TEST_F(TestPush, ReceiveArray)
+{
+  Response response{};
+  ASSERT_TRUE(oc_init_post(kReceiverURI.c_str(), endpoint(), "if=oic.if.rw",
+                           onResponse, HIGH_QOS, &response));
+  oc_rep_begin_links_array();
+  for (int64_t value = 50; value <= 51; ++value) {
+    oc_rep_object_array_begin_item(links);
+    oc_rep_open_array(links, rt);
+    oc_rep_add_text_string(rt, kResourceType.c_str());
+    oc_rep_close_array(links, rt);
+    oc_rep_open_object(links, rep);
+    oc_rep_set_int(rep, value, value);
+    oc_rep_close_object(links, rep);
+    oc_rep_object_array_end_item(links);
+  }
+  oc_rep_end_links_array();
+  ASSERT_TRUE(oc_do_post());
+  oc::TestDevice::PoolEvents(5);
+
+  ASSERT_TRUE(response.received);
+  EXPECT_EQ(OC_STATUS_CHANGED, response.code);
+  ASSERT_EQ(2, s_pushed.size());
+  EXPECT_EQ(50, s_pushed[0]);
+  EXPECT_EQ(51, s_pushed[1]);
+}
+
+// the push target responds with 4.04 until its receiver is configured
+TEST_F(TestPush, RetryFailedPush)
+{
+  const std::string path{ "/retry" };
+  std::string selector = createSelector(targetOf(path));
+  ASSERT_FALSE(selector.empty());
+
+  s_value1 = 60;
+  changed(s_temp1);
+  oc::TestDevice::PoolEventsMs(500);
+  oc_push_target_stats_t st = stats(path);
+  EXPECT_EQ(1, st.sent);
+  EXPECT_EQ(1, st.failed);
+  EXPECT_EQ(0, st.delivered);
+  // the failed update waits for the circuit to close
+  EXPECT_EQ(1, st.queued);
+  EXPECT_TRUE(st.circuit_open);
+
+  // retried after OC_PUSH_BACKOFF_MIN_MS
+  oc::TestDevice::PoolEventsMs(1000);
+  st = stats(path);
+  EXPECT_EQ(2, st.sent);
+  EXPECT_EQ(2, st.failed);
+  EXPECT_EQ(1, st.queued);
+
+  // the backoff is doubled
+  oc::TestDevice::PoolEventsMs(1000);
+  EXPECT_EQ(2, stats(path).sent);
+  oc::TestDevice::PoolEventsMs(1500);
+  st = stats(path);
+  EXPECT_EQ(3, st.sent);
+  EXPECT_EQ(3, st.failed);
+
+  // the next retry is delivered and the circuit closes
+  ASSERT_EQ(OC_STATUS_CHANGED, configureReceiver(path));
+  s_pushed.clear();
+  oc::TestDevice::PoolEventsMs(4500);
+  st = stats(path);
+  EXPECT_EQ(4, st.sent);
+  EXPECT_EQ(1, st.delivered);
+  EXPECT_EQ(3, st.failed);
+  EXPECT_EQ(0, st.queued);
+  EXPECT_EQ(0, st.dropped);
+  EXPECT_FALSE(st.circuit_open);
+  ASSERT_EQ(1, s_pushed.size());
+  EXPECT_EQ(60, s_pushed[0]);
+
+  deleteResource(selector);
+}
+
+TEST_F(TestPush, DropOldest)
+{
+  const std::string path{ "/dropped" };
+  std::string selector = createSelector(targetOf(path));
+  ASSERT_FALSE(selector.empty());
+
+  // open the circuit, the failed update of /temp1 is queued again
+  s_value1 = 70;
+  changed(s_temp1);
+  oc::TestDevice::PoolEventsMs(500);
+  oc_push_target_stats_t before = stats(path);
+  ASSERT_TRUE(before.circuit_open);
+  ASSERT_EQ(1, before.queued);
+
+  std::vector<oc_resource_t *> resources{};
+  for (size_t i = 0; i < OC_PUSH_TARGET_QUEUE_SIZE; ++i) {
+    oc_resource_t *res = addPushable("/drop" + std::to_string(i), buildTemp2);
+    ASSERT_NE(nullptr, res);
+    resources.push_back(res);
+    changed(res);
+  }
+
+  // the update of /temp1 is the oldest one
+  oc_push_target_stats_t after = stats(path);
+  EXPECT_EQ(OC_PUSH_TARGET_QUEUE_SIZE, after.queued);
+  EXPECT_EQ(before.dropped + 1, after.dropped);
+  EXPECT_EQ(before.sent, after.sent);
+
+  // let the updates of the other push target be delivered
+  oc::TestDevice::PoolEventsMs(500);
+  deleteResource(selector);
+  for (oc_resource_t *res : resources) {
+    oc_delete_resource(res);
+  }
+}
+
+TEST_F(TestPush, EvictFailedTarget)
+{
+  // Resource pushed only to the push targets of this test
+  const std::string rt{ "oic.r.evict" };
+  oc_resource_t *res = addPushable("/evictsrc", buildTemp1, rt);
+  ASSERT_NE(nullptr, res);
+  std::vector<std::string> selectors{};
+  for (size_t i = 0; i < OC_PUSH_MAX_TARGETS; ++i) {
+    std::string selector =
+      createSelector(targetOf("/evict" + std::to_string(i)), rt);
+    ASSERT_FALSE(selector.empty());
+    selectors.push_back(selector);
+  }
+
+  // all push targets fail
+  s_value1 = 80;
+  changed(res);
+  oc::TestDevice::PoolEventsMs(500);
+  for (size_t i = 0; i < OC_PUSH_MAX_TARGETS; ++i) {
+    EXPECT_TRUE(stats("/evict" + std::to_string(i)).circuit_open);
+  }
+
+  // failed push targets are forgotten when they have nothing to push
+  for (const auto &selector : selectors) {
+    deleteResource(selector);
+  }
+  std::string path = "/evict" + std::to_string(OC_PUSH_MAX_TARGETS);
+  std::string selector = createSelector(targetOf(path), rt);
+  ASSERT_FALSE(selector.empty());
+  changed(res);
+  EXPECT_EQ(1, stats(path).queued);
+
+  oc::TestDevice::PoolEventsMs(500);
+  deleteResource(selector);
+  oc_delete_resource(res);
+}
+
+#endif /* OC_HAS_FEATURE_PUSH && !OC_SECURITY */
@@ -0,0 +1,258 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "api/oc_rep_encode_internal.h"
+#include "oc_rep.h"
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+class TestRepEncodeFormat : public testing::Test {
+protected:
+  void SetUp() override { oc_rep_new(buffer_.data(), buffer_.size()); }
+
+  static void EncodeRepresentation()
+  {
+    oc_rep_start_root_object();
+    oc_rep_set_text_string(root, name, "a \"b\"\n");
+    oc_rep_set_double(root, temp, 21.5);
+    oc_rep_set_boolean(root, on, true);
+    oc_rep_set_int(root, delta, -3);
+    std::vector<uint8_t> data = { 0xfb, 0xff, 0x00 };
+    oc_rep_set_byte_string(root, data, data.data(), data.size());
+    oc_rep_set_null(root, none);
+    oc_rep_set_array(root, levels);
+    oc_rep_add_int(levels, 1);
+    oc_rep_add_int(levels, 2);
+    oc_rep_close_array(root, levels);
+    oc_rep_set_object(root, light);
+    oc_rep_set_uint(light, power, 7);
+    oc_rep_close_object(root, light);
+    oc_rep_end_root_object();
+  }
+
+  std::string Payload() const
+  {
+    int size = oc_rep_get_encoded_payload_size();
+    if (size < 0) {
+      return {};
+    }
+    const uint8_t *buf = oc_rep_get_encoder_buf();
+    return std::string(reinterpret_cast<const char *>(buf),
+                       static_cast<size_t>(size));
+  }
+
+  std::vector<uint8_t> buffer_ = std::vector<uint8_t>(512);
+};
+
+TEST_F(TestRepEncodeFormat, SetTypeByAccept)
+{
+  EXPECT_EQ(OC_REP_CBOR_ENCODER, oc_rep_encoder_get_type());
+  EXPECT_EQ(APPLICATION_VND_OCF_CBOR, oc_rep_encoder_get_content_format());
+  EXPECT_TRUE(oc_rep_encoder_set_type_by_accept(APPLICATION_CBOR));
+  EXPECT_EQ(OC_REP_CBOR_ENCODER, oc_rep_encoder_get_type());
+  EXPECT_FALSE(oc_rep_encoder_set_type_by_accept(APPLICATION_XML));
+  EXPECT_EQ(OC_REP_CBOR_ENCODER, oc_rep_encoder_get_type());
+
+#ifdef OC_JSON_ENCODER
+  EXPECT_TRUE(oc_rep_encoder_set_type_by_accept(APPLICATION_JSON));
+  EXPECT_EQ(OC_REP_JSON_ENCODER, oc_rep_encoder_get_type());
+  EXPECT_EQ(APPLICATION_JSON, oc_rep_encoder_get_content_format());
+#else  /* !OC_JSON_ENCODER */
+  EXPECT_FALSE(oc_rep_encoder_set_type_by_accept(APPLICATION_JSON));
+#endif /* OC_JSON_ENCODER */
+
+#ifdef OC_SENML_ENCODER
+  EXPECT_TRUE(oc_rep_encoder_set_type_by_accept(APPLICATION_SENML_CBOR));
+  EXPECT_EQ(OC_REP_SENML_CBOR_ENCODER, oc_rep_encoder_get_type());
+  EXPECT_EQ(APPLICATION_SENML_CBOR, oc_rep_encoder_get_content_format());
+#else  /* !OC_SENML_ENCODER */
+  EXPECT_FALSE(oc_rep_encoder_set_type_by_accept(APPLICATION_SENML_CBOR));
+#endif /* OC_SENML_ENCODER */
+
+  // initialization of the encoder resets the format
+  oc_rep_new(buffer_.data(), buffer_.size());
+  EXPECT_EQ(OC_REP_CBOR_ENCODER, oc_rep_encoder_get_type());
+}
+
+TEST_F(TestRepEncodeFormat, NestedContext)
+{
+  oc_rep_start_root_object();
+  oc_rep_set_int(root, outer, 1);
+
+  // a payload encoded in another context doesn't affect the current one
+  std::vector<uint8_t> nested(64);
+  oc_rep_encoder_context_t ctx{};
+  oc_rep_encoder_context_t *prev = oc_rep_encoder_set_context(&ctx);
+  EXPECT_EQ(&ctx, oc_rep_encoder_get_context());
+  oc_rep_new(nested.data(), nested.size());
+  oc_rep_start_root_object();
+  oc_rep_set_int(root, inner, 2);
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  std::string inner = Payload();
+  EXPECT_EQ(nested.data(), oc_rep_get_encoder_buf());
+  EXPECT_EQ(&ctx, oc_rep_encoder_set_context(prev));
+
+  oc_rep_set_int(root, last, 3);
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  EXPECT_EQ(buffer_.data(), oc_rep_get_encoder_buf());
+
+  // {"inner": 2}
+  std::vector<uint8_t> expected_inner = { 0xbf, 0x65, 'i', 'n',  'n',
+                                          'e',  'r',  0x02, 0xff };
+  EXPECT_EQ(std::string(expected_inner.begin(), expected_inner.end()), inner);
+  // {"outer": 1, "last": 3}
+  std::vector<uint8_t> expected = { 0xbf, 0x65, 'o', 'u', 't',  'e', 'r', 0x01,
+                                    0x64, 'l',  'a', 's', 't',  0x03, 0xff };
+  EXPECT_EQ(std::string(expected.begin(), expected.end()), Payload());
+}
+
+#ifdef OC_JSON_ENCODER
+
+static const std::string kJSON =
+  R"({"name":"a \"b\"\n","temp":21.5,"on":true,"delta":-3,"data":"+/8A",)"
+  R"("none":null,"levels":[1,2],"light":{"power":7}})";
+
+TEST_F(TestRepEncodeFormat, EncodeJSON)
+{
+  oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+  EncodeRepresentation();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  EXPECT_EQ(kJSON, Payload());
+}
+
+TEST_F(TestRepEncodeFormat, EncodeJSONEscaped)
+{
+  oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+  oc_rep_start_root_object();
+  std::string value{ "\\\t\x01" };
+  oc_rep_set_text_string(root, value, value.c_str());
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  EXPECT_EQ(R"({"value":"\\\t\u0001"})", Payload());
+}
+
+TEST_F(TestRepEncodeFormat, EncodeJSONOutOfMemory)
+{
+  oc_rep_new(buffer_.data(), kJSON.length() - 1);
+  oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+  EncodeRepresentation();
+  EXPECT_EQ(CborErrorOutOfMemory, oc_rep_get_cbor_errno());
+  EXPECT_EQ(-1, oc_rep_get_encoded_payload_size());
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+TEST_F(TestRepEncodeFormat, EncodeJSONRealloc)
+{
+  auto *buf = static_cast<uint8_t *>(malloc(1));
+  oc_rep_new_realloc(&buf, 1, 512);
+  oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+  EncodeRepresentation();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  buf = oc_rep_shrink_encoder_buf(buf);
+  EXPECT_EQ(kJSON, Payload());
+  free(buf);
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+#endif /* OC_JSON_ENCODER */
+
+#ifdef OC_SENML_ENCODER
+
+TEST_F(TestRepEncodeFormat, EncodeSenMLCBOR)
+{
+  oc_rep_encoder_set_type(OC_REP_SENML_CBOR_ENCODER);
+  oc_rep_start_root_object();
+  oc_rep_set_boolean(root, on, true);
+  oc_rep_set_null(root, none);
+  oc_rep_set_array(root, levels);
+  oc_rep_add_int(levels, 1);
+  oc_rep_close_array(root, levels);
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+
+  std::vector<uint8_t> expected = {
+    // array of records
+    0x9f,
+    // {n: "on", vb: true}
+    0xa2, 0x00, 0x62, 'o', 'n', 0x04, 0xf5,
+    // {n: "levels/0", v: 1}
+    0xa2, 0x00, 0x68, 'l', 'e', 'v', 'e', 'l', 's', '/', '0', 0x02, 0x01,
+    // end of the array
+    0xff,
+  };
+  std::string payload = Payload();
+  EXPECT_EQ(std::string(expected.begin(), expected.end()), payload);
+}
+
+TEST_F(TestRepEncodeFormat, EncodeSenMLNameTooLong)
+{
+  oc_rep_encoder_set_type(OC_REP_SENML_CBOR_ENCODER);
+  oc_rep_start_root_object();
+  std::string key(OC_SENML_MAX_NAME_LENGTH + 1, 'k');
+  oc_rep_set_key(oc_rep_object(root), key.c_str());
+  oc_rep_end_root_object();
+  EXPECT_NE(CborNoError, oc_rep_get_cbor_errno());
+}
+
+TEST_F(TestRepEncodeFormat, EncodeSenMLScalarAtRoot)
+{
+  oc_rep_encoder_set_type(OC_REP_SENML_CBOR_ENCODER);
+  EXPECT_EQ(CborErrorIllegalType, oc_rep_encode_int(oc_rep_get_encoder(), 1));
+}
+
+#ifdef OC_JSON_ENCODER
+TEST_F(TestRepEncodeFormat, EncodeSenMLJSON)
+{
+  oc_rep_encoder_set_type(OC_REP_SENML_JSON_ENCODER);
+  EncodeRepresentation();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  EXPECT_EQ(R"([{"n":"name","vs":"a \"b\"\n"},{"n":"temp","v":21.5},)"
+            R"({"n":"on","vb":true},{"n":"delta","v":-3},)"
+            R"({"n":"data","vd":"-_8A"},{"n":"levels/0","v":1},)"
+            R"({"n":"levels/1","v":2},{"n":"light/power","v":7}])",
+            Payload());
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+TEST_F(TestRepEncodeFormat, EncodeSenMLJSONRealloc)
+{
+  auto *buf = static_cast<uint8_t *>(malloc(1));
+  oc_rep_new_realloc(&buf, 1, 512);
+  oc_rep_encoder_set_type(OC_REP_SENML_JSON_ENCODER);
+  oc_rep_start_root_object();
+  oc_rep_set_array(root, levels);
+  for (int i = 0; i < 20; ++i) {
+    oc_rep_add_int(levels, i);
+  }
+  oc_rep_close_array(root, levels);
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  std::string payload = Payload();
+  EXPECT_EQ(0, payload.find(R"([{"n":"levels/0","v":0},)"));
+  EXPECT_NE(std::string::npos, payload.find(R"({"n":"levels/19","v":19}])"));
+  free(buf);
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+#endif /* OC_JSON_ENCODER */
+
+#endif /* OC_SENML_ENCODER */
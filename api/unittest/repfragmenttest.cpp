@@ -0,0 +1,197 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "api/oc_rep_encode_internal.h"
+#include "api/oc_rep_fragment_internal.h"
+#include "oc_rep.h"
+#include "oc_ri.h"
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+class TestRepFragment : public testing::Test {
+protected:
+  void SetUp() override
+  {
+    oc_rep_new(buffer_.data(), buffer_.size());
+    encoded_ = 0;
+  }
+
+  void TearDown() override { oc_rep_fragment_invalidate(nullptr); }
+
+  static void EncodeProperties(const oc_resource_t *, void *data)
+  {
+    ++encoded_;
+    oc_rep_set_text_string(root, n, static_cast<const char *>(data));
+    oc_rep_set_int(root, power, 42);
+  }
+
+  static uint64_t Fingerprint(const std::string &name)
+  {
+    return oc_rep_fragment_fingerprint(OC_REP_FRAGMENT_FINGERPRINT_INIT,
+                                       name.c_str(), name.length());
+  }
+
+  // encode {"n": name, "power": 42, "last": true}
+  std::string Encode(const std::string &name)
+  {
+    oc_rep_new(buffer_.data(), buffer_.size());
+    oc_rep_start_root_object();
+    oc_rep_fragment_encode(&resource_, OC_IF_R, Fingerprint(name),
+                           EncodeProperties,
+                           const_cast<char *>(name.c_str()));
+    oc_rep_set_boolean(root, last, true);
+    oc_rep_end_root_object();
+    EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+    int size = oc_rep_get_encoded_payload_size();
+    if (size < 0) {
+      return {};
+    }
+    return std::string(reinterpret_cast<const char *>(buffer_.data()),
+                       static_cast<size_t>(size));
+  }
+
+  static std::string Expected(const std::string &name)
+  {
+    std::vector<uint8_t> buf(1024);
+    oc_rep_encoder_context_t ctx{};
+    oc_rep_encoder_context_t *prev = oc_rep_encoder_set_context(&ctx);
+    oc_rep_new(buf.data(), buf.size());
+    oc_rep_start_root_object();
+    oc_rep_set_text_string(root, n, name.c_str());
+    oc_rep_set_int(root, power, 42);
+    oc_rep_set_boolean(root, last, true);
+    oc_rep_end_root_object();
+    int size = oc_rep_get_encoded_payload_size();
+    oc_rep_encoder_set_context(prev);
+    return std::string(reinterpret_cast<const char *>(buf.data()),
+                       static_cast<size_t>(size));
+  }
+
+  static int encoded_;
+  oc_resource_t resource_{};
+  std::vector<uint8_t> buffer_ = std::vector<uint8_t>(256);
+};
+
+int TestRepFragment::encoded_ = 0;
+
+TEST_F(TestRepFragment, Encode)
+{
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(1, encoded_);
+  // the fragment is copied from the cache
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(1, encoded_);
+}
+
+TEST_F(TestRepFragment, FingerprintChanged)
+{
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(Expected("lamp"), Encode("lamp"));
+  EXPECT_EQ(2, encoded_);
+  EXPECT_EQ(Expected("lamp"), Encode("lamp"));
+  EXPECT_EQ(2, encoded_);
+}
+
+TEST_F(TestRepFragment, FingerprintSeparatesValues)
+{
+  uint64_t ab_c = oc_rep_fragment_fingerprint(OC_REP_FRAGMENT_FINGERPRINT_INIT,
+                                              "ab", 2);
+  ab_c = oc_rep_fragment_fingerprint(ab_c, "c", 1);
+  uint64_t a_bc = oc_rep_fragment_fingerprint(OC_REP_FRAGMENT_FINGERPRINT_INIT,
+                                              "a", 1);
+  a_bc = oc_rep_fragment_fingerprint(a_bc, "bc", 2);
+  EXPECT_NE(ab_c, a_bc);
+}
+
+TEST_F(TestRepFragment, Invalidate)
+{
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  oc_rep_fragment_invalidate(&resource_);
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(2, encoded_);
+}
+
+TEST_F(TestRepFragment, TooLarge)
+{
+  // fragments larger than OC_REP_FRAGMENT_MAX_SIZE are encoded directly
+  std::string name(OC_REP_FRAGMENT_MAX_SIZE, 'n');
+  buffer_.resize(2 * OC_REP_FRAGMENT_MAX_SIZE);
+  EXPECT_EQ(Expected(name), Encode(name));
+  EXPECT_EQ(2, encoded_);
+  // without another attempt to cache them until the values change
+  EXPECT_EQ(Expected(name), Encode(name));
+  EXPECT_EQ(3, encoded_);
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(4, encoded_);
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  EXPECT_EQ(4, encoded_);
+}
+
+TEST_F(TestRepFragment, OutOfMemory)
+{
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  oc_rep_new(buffer_.data(), 8);
+  oc_rep_start_root_object();
+  oc_rep_fragment_encode(&resource_, OC_IF_R, Fingerprint("light"),
+                         EncodeProperties, const_cast<char *>("light"));
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborErrorOutOfMemory, oc_rep_get_cbor_errno());
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+TEST_F(TestRepFragment, Realloc)
+{
+  EXPECT_EQ(Expected("light"), Encode("light"));
+  auto *buf = static_cast<uint8_t *>(malloc(1));
+  oc_rep_new_realloc(&buf, 1, 256);
+  oc_rep_start_root_object();
+  oc_rep_fragment_encode(&resource_, OC_IF_R, Fingerprint("light"),
+                         EncodeProperties, const_cast<char *>("light"));
+  oc_rep_set_boolean(root, last, true);
+  oc_rep_end_root_object();
+  EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  int size = oc_rep_get_encoded_payload_size();
+  ASSERT_LT(0, size);
+  EXPECT_EQ(Expected("light"), std::string(reinterpret_cast<const char *>(buf),
+                                           static_cast<size_t>(size)));
+  EXPECT_EQ(1, encoded_);
+  free(buf);
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+#ifdef OC_JSON_ENCODER
+TEST_F(TestRepFragment, NotCBOR)
+{
+  // fragments are used only by the CBOR encoder
+  for (int i = 0; i < 2; ++i) {
+    oc_rep_new(buffer_.data(), buffer_.size());
+    oc_rep_encoder_set_type(OC_REP_JSON_ENCODER);
+    oc_rep_start_root_object();
+    oc_rep_fragment_encode(&resource_, OC_IF_R, Fingerprint("light"),
+                           EncodeProperties, const_cast<char *>("light"));
+    oc_rep_end_root_object();
+    EXPECT_EQ(CborNoError, oc_rep_get_cbor_errno());
+  }
+  EXPECT_EQ(2, encoded_);
+  EXPECT_EQ(R"({"n":"light","power":42})",
+            std::string(reinterpret_cast<const char *>(buffer_.data()),
+                        oc_rep_get_encoded_payload_size()));
+}
+#endif /* OC_JSON_ENCODER */
@@ -23,6 +23,8 @@
 #include "api/oc_rep_internal.h"
 #include "api/oc_storage_internal.h"
 #include "oc_api.h"
+#include "oc_ri.h"
+#include "port/oc_network_event_handler_internal.h"
 #include "port/oc_storage.h"
 #include "port/oc_storage_internal.h"
 #include "util/oc_macros.h"
@@ -190,4 +192,84 @@ TEST_F(TestCommonStorage, SaveAndLoad)
   EXPECT_EQ(td.num, outTd.num);
 }
 
+class TestStorageWriteBehind : public testing::Test {
+public:
+  void SetUp() override
+  {
+    oc_network_event_handler_mutex_init();
+    oc_ri_init();
+    dumpCount_ = 0;
+  }
+
+  void TearDown() override
+  {
+    oc_storage_set_write_behind_window(0);
+    oc_ri_shutdown();
+    oc_network_event_handler_mutex_destroy();
+  }
+
+  static void Dump(size_t) { ++dumpCount_; }
+
+  static int dumpCount_;
+};
+
+int TestStorageWriteBehind::dumpCount_{ 0 };
+
+TEST_F(TestStorageWriteBehind, DumpImmediately)
+{
+  ASSERT_EQ(0, oc_storage_get_write_behind_window());
+  oc_storage_dump(Dump, 0);
+  oc_storage_dump(Dump, 0);
+  EXPECT_EQ(2, dumpCount_);
+  EXPECT_FALSE(oc_storage_has_deferred_dumps());
+}
+
+TEST_F(TestStorageWriteBehind, DumpCoalesced)
+{
+  oc_storage_set_write_behind_window(1000);
+  EXPECT_EQ(1000, oc_storage_get_write_behind_window());
+  for (int i = 0; i < 10; ++i) {
+    oc_storage_dump(Dump, 0);
+    oc_storage_dump(Dump, 1);
+  }
+  EXPECT_EQ(0, dumpCount_);
+  EXPECT_TRUE(oc_storage_has_deferred_dumps());
+
+  // flush of a single dump
+  EXPECT_TRUE(oc_storage_flush_deferred_dump(Dump, 1));
+  EXPECT_FALSE(oc_storage_flush_deferred_dump(Dump, 1));
+  EXPECT_EQ(1, dumpCount_);
+
+  oc_storage_flush_deferred_dumps();
+  EXPECT_EQ(2, dumpCount_);
+  EXPECT_FALSE(oc_storage_has_deferred_dumps());
+}
+
+TEST_F(TestStorageWriteBehind, DumpCoalescedWindow)
+{
+  ASSERT_EQ(0, oc_storage_get_write_behind_window());
+  oc_storage_dump_coalesced(Dump, 0, 1000);
+  oc_storage_dump_coalesced(Dump, 0, 1000);
+  EXPECT_EQ(0, dumpCount_);
+  EXPECT_TRUE(oc_storage_has_deferred_dumps());
+  // other resources are still written immediately
+  oc_storage_dump(Dump, 1);
+  EXPECT_EQ(1, dumpCount_);
+
+  oc_storage_flush_deferred_dumps();
+  EXPECT_EQ(2, dumpCount_);
+  EXPECT_FALSE(oc_storage_has_deferred_dumps());
+}
+
+TEST_F(TestStorageWriteBehind, DisableWindowFlushes)
+{
+  oc_storage_set_write_behind_window(1000);
+  oc_storage_dump(Dump, 0);
+  EXPECT_EQ(0, dumpCount_);
+
+  oc_storage_set_write_behind_window(0);
+  EXPECT_EQ(1, dumpCount_);
+  EXPECT_FALSE(oc_storage_has_deferred_dumps());
+}
+
 #endif /* OC_STORAGE */
@@ -118,6 +118,7 @@ app_init(void)
 
   oc_device_info_t *info = oc_core_get_device_info(0);
   oc_str_to_uuid(deviceid, &info->di);
+  oc_core_device_info_changed(0);
   return ret;
 }
 
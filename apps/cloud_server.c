@@ -724,6 +724,7 @@ factory_presets_cb(size_t device, void *data)
   oc_device_info_t *dev = oc_core_get_device_info(device);
   oc_free_string(&dev->name);
   oc_new_string(&dev->name, device_name, strlen(device_name));
+  oc_core_device_info_changed(device);
 
   unsigned char cloud_ca[4096];
   size_t cert_len = 4096;
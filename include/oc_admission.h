@@ -0,0 +1,122 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+/**
+ * @file oc_admission.h
+ *
+ * @brief Admission control of incoming requests.
+ *
+ * Incoming requests can be limited by token buckets per peer (address of the
+ * client) and per logical device, and by a cap on the number of requests with
+ * a pending response. A rejected request is answered with 5.03 Service
+ * Unavailable and a Max-Age option telling the client when to retry, rejected
+ * multicast requests are dropped silently.
+ *
+ * Requests to the security resources (/oic/sec/...), used to onboard the
+ * device, are charged to separate buckets with larger limits, so a flood of
+ * other requests cannot lock the owner out. Requests from the connected cloud
+ * are always admitted.
+ *
+ * All limits are disabled by default.
+ */
+
+#ifndef OC_ADMISSION_H
+#define OC_ADMISSION_H
+
+#include "oc_export.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default value of the Max-Age option of rejected requests (in seconds) */
+#define OC_ADMISSION_DEFAULT_RETRY_AFTER (2)
+
+/**
+ * @brief Counters of the admission control.
+ */
+typedef struct oc_admission_stats_t
+{
+  uint32_t admitted;         ///< admitted requests
+  uint32_t prioritized;      ///< admitted requests exempt from the limits
+  uint32_t shed_peer;        ///< requests rejected by the per-peer limit
+  uint32_t shed_device;      ///< requests rejected by the per-device limit
+  uint32_t shed_concurrency; ///< requests rejected by the concurrency cap
+} oc_admission_stats_t;
+
+/**
+ * @brief Limit the rate of requests from a single peer.
+ *
+ * Each peer (identified by its address, regardless of the port) gets a token
+ * bucket holding at most burst tokens, which is refilled by rate tokens per
+ * second. Each admitted request consumes a token.
+ *
+ * @param rate tokens added per second (0 disables the limit)
+ * @param burst size of the bucket (0 to use the rate)
+ */
+OC_API
+void oc_admission_set_peer_rate_limit(uint32_t rate, uint32_t burst);
+
+/**
+ * @brief Limit the rate of requests to a single logical device.
+ *
+ * @param rate tokens added per second (0 disables the limit)
+ * @param burst size of the bucket (0 to use the rate)
+ *
+ * @see oc_admission_set_peer_rate_limit
+ */
+OC_API
+void oc_admission_set_device_rate_limit(uint32_t rate, uint32_t burst);
+
+/**
+ * @brief Limit the number of requests with a pending (deferred) response.
+ *
+ * @param max maximal number of pending responses (0 disables the limit)
+ *
+ * @see oc_defer_response
+ */
+OC_API
+void oc_admission_set_max_concurrent_requests(uint32_t max);
+
+/**
+ * @brief Set the value of the Max-Age option of rejected requests.
+ *
+ * @param seconds number of seconds the client should wait before retrying
+ * (OC_ADMISSION_DEFAULT_RETRY_AFTER by default)
+ */
+OC_API
+void oc_admission_set_retry_after(uint32_t seconds);
+
+/**
+ * @brief Get the counters of the admission control.
+ *
+ * @param[out] stats the counters (cannot be NULL)
+ */
+OC_API
+void oc_admission_get_stats(oc_admission_stats_t *stats);
+
+/** @brief Reset the counters of the admission control. */
+OC_API
+void oc_admission_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_ADMISSION_H */
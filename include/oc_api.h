@@ -272,6 +272,35 @@ oc_clock_time_t oc_main_poll(void);
  */
 void oc_main_shutdown(void);
 
+#ifdef OC_STORAGE
+/**
+ * @brief Set the write-behind window for persisting resources to storage.
+ *
+ * When the window is non-zero, dumps of the security resources (acl, cred,
+ * pstat, doxm) are not written immediately. The first dump schedules a write
+ * at the end of the window and all dumps of the same resource during the
+ * window are coalesced into that single write. Pending writes are flushed on
+ * oc_main_shutdown, before the resource is loaded from storage and when the
+ * window is set back to 0.
+ *
+ * Writes of the audit event log are always coalesced, in a window of at least
+ * OC_SEC_AEL_WRITE_BEHIND_WINDOW_MS.
+ *
+ * @param milliseconds length of the window in milliseconds (0 = write
+ * immediately, which is the default)
+ */
+OC_API
+void oc_storage_set_write_behind_window(uint64_t milliseconds);
+
+/**
+ * @brief Get the write-behind window for persisting resources to storage.
+ *
+ * @return length of the window in milliseconds
+ */
+OC_API
+uint64_t oc_storage_get_write_behind_window(void);
+#endif /* OC_STORAGE */
+
 /**
  * Callback invoked by the stack initialization to perform any
  * "factory settings", e.g., this may be used to load a manufacturer
@@ -1293,6 +1322,29 @@ void oc_resource_set_properties_cbs(oc_resource_t *resource,
                                     oc_set_properties_cb_t set_properties,
                                     void *set_props_user_data);
 
+/**
+ * @brief consume the payloads of POST and PUT requests to the resource block
+ * by block instead of reassembling them in memory
+ *
+ * The callback receives each block of the payload once the client is
+ * authorized to update the resource. The request handler of the method is
+ * invoked afterwards with an empty request payload.
+ *
+ * Only requests addressed to the resource itself are streamed. Collections
+ * cannot have a stream consumer, and an update of the resource by a batch
+ * request to a collection is rejected with 4.00 because its payload is
+ * embedded in the batch payload.
+ *
+ * @param resource the resource (cannot be NULL)
+ * @param callback the consumer of the blocks (NULL disables streaming)
+ * @param user_data context pointer passed to the callback. The pointer must
+ *                  remain valid as long as the resource exists.
+ */
+OC_API
+void oc_resource_set_request_stream_handler(oc_resource_t *resource,
+                                            oc_request_stream_cb_t callback,
+                                            void *user_data);
+
 #ifdef OC_OSCORE
 /**
  * @brief sets the support of the secure multicast feature
@@ -1535,6 +1587,32 @@ void oc_send_response_raw(oc_request_t *request, const uint8_t *payload,
                           size_t size, oc_content_format_t content_format,
                           oc_status_t response_code);
 
+/**
+ * @brief send a response whose payload is produced block by block on demand
+ *
+ * Instead of encoding the whole payload into the response buffer, the
+ * callback is invoked for each block requested by the client (Block2), so at
+ * most one block of the payload is held in memory for the transfer. Streams
+ * are supported only for responses sent directly from the handler of a
+ * request addressed to the resource, not for separate responses,
+ * notifications to observers or the links of batch requests. In those cases
+ * the callback is invoked with a NULL block to release its state and the
+ * request is answered with 5.00.
+ *
+ * @param request the request being responded to
+ * @param content_format the content format of the payload
+ * @param callback the producer of the blocks (cannot be NULL)
+ * @param user_data context pointer passed to the callback
+ * @param response_code the response code to send
+ *
+ * @see oc_response_stream_cb_t
+ */
+OC_API
+void oc_send_response_stream(oc_request_t *request,
+                             oc_content_format_t content_format,
+                             oc_response_stream_cb_t callback, void *user_data,
+                             oc_status_t response_code);
+
 /**
  * @brief retrieve the response payload, without processing
  *
@@ -1669,6 +1747,94 @@ void oc_set_separate_response_buffer(oc_separate_response_t *handle);
 void oc_send_separate_response(oc_separate_response_t *handle,
                                oc_status_t response_code);
 
+/**
+ * Defer the response to the request being handled.
+ *
+ * Call from the request handler instead of oc_send_response when the response
+ * depends on a slow backend. The handler returns immediately and the response
+ * is sent once oc_complete_deferred_response is called with the returned
+ * handle. A Confirmable request gets the response piggybacked on its ACK if
+ * it is completed within OC_DEFERRED_RESPONSE_ACK_DELAY, otherwise an empty
+ * ACK is sent and the response follows as a separate message.
+ *
+ * Responses can be deferred only by request handlers of non-collection
+ * resources invoked for a request from the network, not when the handler is
+ * invoked to produce a notification. A handler invoked for an item of a batch
+ * request (oic.if.b of a collection or of /oic/res) can defer its response
+ * too, as long as the payload is CBOR. The other items are evaluated
+ * meanwhile, and the batch response is sent once all deferred items complete
+ * or after OC_BATCH_RESPONSE_DEADLINE. Items that miss the deadline are left
+ * out of the response.
+ *
+ * A response that is not completed within OC_DEFERRED_RESPONSE_TIMEOUT
+ * (see oc_deferred_response_set_timeout_ms) is completed by the stack with
+ * OC_STATUS_SERVICE_UNAVAILABLE and its handle becomes invalid. Handles are
+ * not reused by later responses, completing an invalid handle is rejected.
+ *
+ * Example:
+ * ```
+ * static void
+ * get_handler(oc_request_t *request, oc_interface_mask_t iface_mask,
+ *             void *user_data)
+ * {
+ *   oc_deferred_response_handle_t handle = oc_defer_response(request);
+ *   if (handle == 0) {
+ *     oc_send_response(request, OC_STATUS_SERVICE_UNAVAILABLE);
+ *     return;
+ *   }
+ *   // the backend calls oc_complete_deferred_response(handle, ...) from its
+ *   // own thread once the value is read
+ *   backend_read_async(handle);
+ * }
+ * ```
+ *
+ * @param[in] request the request being handled
+ * @return handle of the deferred response
+ * @return 0 the response cannot be deferred, respond synchronously
+ *
+ * @see oc_complete_deferred_response
+ */
+OC_API
+oc_deferred_response_handle_t oc_defer_response(oc_request_t *request);
+
+/**
+ * Set how long the deferred response waits to be completed, replacing
+ * OC_DEFERRED_RESPONSE_TIMEOUT. Must be called from the request handler that
+ * deferred the response.
+ *
+ * @param[in] handle the handle returned by oc_defer_response
+ * @param[in] timeout_ms the timeout in milliseconds
+ * @return true the timeout was set
+ * @return false the handle is invalid
+ */
+OC_API
+bool oc_deferred_response_set_timeout_ms(oc_deferred_response_handle_t handle,
+                                         uint64_t timeout_ms);
+
+/**
+ * Send the deferred response.
+ *
+ * The function can be called from any thread, the payload is copied and the
+ * response is sent from the main loop. Each deferred response must be
+ * completed exactly once, the handle is invalid afterwards, after the response
+ * times out and after the stack is shut down. A second completion is rejected.
+ *
+ * @param[in] handle the handle returned by oc_defer_response
+ * @param[in] response_code the status of the response
+ * @param[in] content_format content format of the payload
+ * @param[in] payload the encoded payload (can be NULL if payload_size is 0)
+ * @param[in] payload_size size of the payload (at most OC_MAX_APP_DATA_SIZE)
+ * @return true the response was queued to be sent
+ * @return false the payload is too large or cannot be copied, the response is
+ * completed with OC_STATUS_INTERNAL_SERVER_ERROR instead
+ * @return false the response is already completed or timed out
+ */
+OC_API
+bool oc_complete_deferred_response(oc_deferred_response_handle_t handle,
+                                   oc_status_t response_code,
+                                   oc_content_format_t content_format,
+                                   const uint8_t *payload, size_t payload_size);
+
 /**
  * Notify all observers of a change to a given resource's property
  *
@@ -2152,6 +2318,157 @@ bool oc_do_post(void);
 OC_API
 bool oc_do_post_with_timeout(uint16_t timeout_seconds);
 
+/**
+ * @brief Request built by a request builder.
+ *
+ * Unlike oc_init_post / oc_do_post, which build a single request at a time,
+ * each builder owns its payload buffer, so any number of requests can be
+ * prepared and then sent together. Static builds keep at most
+ * OC_MAX_NUM_CLIENT_REQUESTS builders and OC_MAX_NUM_CLIENT_REQUEST_PAYLOADS
+ * payloads.
+ *
+ * Example:
+ * ```
+ * oc_client_request_t *req = oc_client_request_new(
+ *   OC_POST, "/switch", server_ep, NULL, &post_switch, LOW_QOS, NULL);
+ * if (req != NULL && oc_client_request_begin_payload(req)) {
+ *   oc_rep_start_root_object();
+ *   oc_rep_set_boolean(root, value, true);
+ *   oc_rep_end_root_object();
+ *   oc_client_request_end_payload(req);
+ * }
+ * requests[n++] = req;
+ * ...
+ * for (size_t i = 0; i < n; ++i) {
+ *   oc_client_request_send(requests[i]);
+ * }
+ * ```
+ *
+ * @note oc_client_request_new, oc_client_request_set_payload,
+ * oc_client_request_set_timeout, oc_client_request_submit and
+ * oc_client_request_free can be called from any thread in builds with
+ * OC_DYNAMIC_ALLOCATION. The remaining functions must be called from the
+ * thread running the stack.
+ */
+typedef struct oc_client_request_t oc_client_request_t;
+
+/**
+ * @brief Create a request builder.
+ *
+ * @param method the method of the request
+ * @param uri the uri of the resource (cannot be NULL)
+ * @param endpoint the endpoint of the server (cannot be NULL)
+ * @param query the query of the request (can be NULL)
+ * @param handler function invoked with the response (cannot be NULL)
+ * @param qos the quality of service
+ * @param user_data context pointer passed to the handler
+ * @return the request, it must be sent, submitted or freed
+ * @return NULL on allocation failure
+ */
+OC_API
+oc_client_request_t *oc_client_request_new(oc_method_t method, const char *uri,
+                                           const oc_endpoint_t *endpoint,
+                                           const char *query,
+                                           oc_response_handler_t handler,
+                                           oc_qos_t qos, void *user_data);
+
+/**
+ * @brief Free a request that won't be sent.
+ *
+ * @param request the request (NULL is ignored)
+ */
+OC_API
+void oc_client_request_free(oc_client_request_t *request);
+
+/**
+ * @brief Set the timeout of the response, the handler is invoked with
+ * OC_REQUEST_TIMEOUT code if the response doesn't arrive in time.
+ *
+ * @param request the request (cannot be NULL)
+ * @param timeout_seconds the timeout (0 for no timeout)
+ */
+OC_API
+void oc_client_request_set_timeout(oc_client_request_t *request,
+                                   uint16_t timeout_seconds);
+
+/**
+ * @brief Set the Accept option of the request.
+ *
+ * The server answers in the requested format if it supports it, the payload
+ * of a response in a format other than CBOR is not parsed and must be read by
+ * oc_get_response_payload_raw.
+ *
+ * @param request the request (cannot be NULL)
+ * @param accept the content format of the response (0 for the default
+ * format)
+ */
+OC_API
+void oc_client_request_set_accept(oc_client_request_t *request,
+                                  oc_content_format_t accept);
+
+/**
+ * @brief Start encoding the payload of a PUT or POST request with the
+ * `oc_rep_*` functions, the payload is encoded into the buffer of the request.
+ *
+ * @note The payload must be finished by oc_client_request_end_payload in the
+ * same callback. Payloads of several requests can be nested, the payload
+ * started last must be finished first.
+ *
+ * @param request the request (cannot be NULL)
+ * @return true the payload can be encoded
+ * @return false the request doesn't carry a payload or allocation failed
+ */
+OC_API
+bool oc_client_request_begin_payload(oc_client_request_t *request);
+
+/**
+ * @brief Finish encoding the payload started by
+ * oc_client_request_begin_payload.
+ *
+ * @param request the request (cannot be NULL)
+ * @return true the payload was encoded
+ * @return false encoding of the payload failed or a payload started after it
+ * is not finished
+ */
+OC_API
+bool oc_client_request_end_payload(oc_client_request_t *request);
+
+/**
+ * @brief Set an already encoded payload of a PUT or POST request.
+ *
+ * @param request the request (cannot be NULL)
+ * @param payload the encoded payload (copied)
+ * @param payload_size the size of the payload
+ * @return true the payload was set
+ * @return false the request doesn't carry a payload, the payload is too large
+ * or allocation failed
+ */
+OC_API
+bool oc_client_request_set_payload(oc_client_request_t *request,
+                                   const uint8_t *payload, size_t payload_size);
+
+/**
+ * @brief Send the request, the request is freed.
+ *
+ * @param request the request (cannot be NULL)
+ * @return true the request was sent
+ * @return false sending of the request failed
+ */
+OC_API
+bool oc_client_request_send(oc_client_request_t *request);
+
+/**
+ * @brief Hand the requests over to the thread running the stack, which sends
+ * and frees them. The handler of a request that cannot be sent is invoked with
+ * OC_CANCELLED code.
+ *
+ * @param requests the requests with finished payloads
+ * @param count the number of requests
+ */
+OC_API
+void oc_client_request_submit(oc_client_request_t *const *requests,
+                              size_t count);
+
 /**
  * Dispatch a GET request with the CoAP Observe option to subscribe for
  * notifications from a resource.
@@ -40,8 +40,37 @@ typedef enum {
   OC_BLOCKWISE_SERVER      ///< server
 } oc_blockwise_role_t;
 
+#ifdef OC_TCP
+/**
+ * @brief size of the BERT blocks sent over TCP, the largest multiple of the
+ * BERT unit that fits into the application data buffer (at least one unit)
+ */
+#define OC_BLOCKWISE_BERT_BLOCK_SIZE                                           \
+  ((OC_MAX_APP_DATA_SIZE) < COAP_BERT_UNIT_SIZE                                \
+     ? (uint32_t)COAP_BERT_UNIT_SIZE                                           \
+     : (uint32_t)((OC_MAX_APP_DATA_SIZE) / COAP_BERT_UNIT_SIZE) *              \
+         COAP_BERT_UNIT_SIZE)
+#endif /* OC_TCP */
+
 typedef void oc_blockwise_finish_cb_t(void);
 
+/**
+ * @brief state of a streamed transfer
+ *
+ * A streamed transfer holds a single block of the payload in the buffer of
+ * the transfer. Response blocks are produced on demand and request blocks are
+ * passed to the consumer as they arrive.
+ */
+typedef struct oc_blockwise_stream_s
+{
+  oc_response_stream_cb_t produce; ///< producer of the response blocks
+  oc_request_stream_cb_t consume;  ///< consumer of the request blocks
+  void *user_data;                 ///< user data of the callbacks
+  uint32_t block_offset;           ///< offset of the block held in the buffer
+  uint32_t block_size;             ///< size of the block held in the buffer
+  bool done; ///< the last block was produced or consumed
+} oc_blockwise_stream_t;
+
 typedef struct oc_blockwise_state_s
 {
   struct oc_blockwise_state_s *next;
@@ -63,6 +92,7 @@ typedef struct oc_blockwise_state_s
 #endif                   /* !OC_DYNAMIC_ALLOCATION */
   oc_string_t uri_query; ///< the query
   oc_blockwise_finish_cb_t *finish_cb;
+  oc_blockwise_stream_t stream; ///< streamed transfer (if a callback is set)
 #ifdef OC_CLIENT
   uint8_t token[COAP_TOKEN_LEN]; ///< the token
   uint8_t token_len;             ///< token lenght
@@ -76,6 +106,24 @@ typedef struct oc_blockwise_request_state_s
   oc_blockwise_state_t base;
 } oc_blockwise_request_state_t;
 
+#ifdef OC_CLIENT
+/**
+ * @brief window of Block2 requests kept in flight by the client
+ *
+ * Blocks received ahead of next_block_offset are stored in the buffer and
+ * marked in the received bitmap, bit i marks the block that is i blocks after
+ * next_block_offset.
+ */
+typedef struct oc_blockwise_window_s
+{
+  uint32_t total_size;     ///< size of the representation (Size2)
+  uint32_t request_offset; ///< offset of the next block to be requested
+  uint32_t received;       ///< blocks received ahead of next_block_offset
+  uint16_t block_size;     ///< size of the blocks, 0 if the window is unused
+  uint16_t mids[COAP_BLOCK2_WINDOW_SIZE]; ///< message ids of the requests
+} oc_blockwise_window_t;
+#endif /* OC_CLIENT */
+
 typedef struct oc_blockwise_response_state_s
 {
   oc_blockwise_state_t base;
@@ -83,6 +131,9 @@ typedef struct oc_blockwise_response_state_s
 
 #ifdef OC_CLIENT
   int32_t observe_seq;
+  uint8_t etag_len; ///< length of the ETag of the received representation
+  uint8_t restarts; ///< number of restarts due to a changed representation
+  oc_blockwise_window_t window; ///< window of Block2 requests
 #endif /* OC_CLIENT */
 } oc_blockwise_response_state_t;
 
@@ -249,6 +300,131 @@ bool oc_blockwise_handle_block(oc_blockwise_state_t *buffer,
                                const uint8_t *incoming_block,
                                uint32_t incoming_block_size);
 
+/**
+ * @brief produce the response payload of the transfer block by block
+ *
+ * The buffer of the transfer is resized to hold a single block and the
+ * blocks are produced on demand by oc_blockwise_dispatch_block.
+ *
+ * @param buffer the response buffer
+ * @param produce the producer of the blocks (cannot be NULL)
+ * @param user_data user data passed to the producer
+ * @return true on success
+ * @return false if the buffer could not be resized
+ */
+bool oc_blockwise_set_response_stream(oc_blockwise_state_t *buffer,
+                                      oc_response_stream_cb_t produce,
+                                      void *user_data);
+
+/**
+ * @brief pass the request payload of the transfer to the consumer block by
+ * block
+ *
+ * @param buffer the request buffer
+ * @param consume the consumer of the blocks (cannot be NULL)
+ * @param user_data user data passed to the consumer
+ */
+void oc_blockwise_set_request_stream(oc_blockwise_state_t *buffer,
+                                     oc_request_stream_cb_t consume,
+                                     void *user_data);
+
+/**
+ * @brief handle the incoming block of a streamed request
+ *
+ * The block is passed to the consumer if it is the next expected block,
+ * duplicates of the already consumed blocks are ignored.
+ *
+ * @param buffer the request buffer
+ * @param incoming_block_offset the block offset
+ * @param incoming_block the incoming block
+ * @param incoming_block_size the size of the incoming block
+ * @param last true for the last block of the payload
+ * @return true if the block was accepted
+ * @return false if the block is out of order or the consumer aborted the
+ * transfer
+ */
+bool oc_blockwise_handle_stream_block(oc_blockwise_state_t *buffer,
+                                      uint32_t incoming_block_offset,
+                                      const uint8_t *incoming_block,
+                                      uint32_t incoming_block_size, bool last);
+
+#ifdef OC_CLIENT
+/**
+ * @brief check that a block of the response belongs to the representation
+ * being retrieved
+ *
+ * The ETag of the first block is recorded and, if the first block carried
+ * one, every following block that carries an ETag must carry the same one.
+ *
+ * @param buffer the client response buffer
+ * @param incoming_block_offset the block offset
+ * @param etag the ETag of the block (can be NULL if etag_len is 0)
+ * @param etag_len the length of the ETag
+ * @return true if the block belongs to the representation
+ * @return false if the representation changed or the first block is missing
+ */
+bool oc_blockwise_response_match_etag(oc_blockwise_state_t *buffer,
+                                      uint32_t incoming_block_offset,
+                                      const uint8_t *etag, size_t etag_len);
+
+/**
+ * @brief discard the received blocks and retrieve the representation again
+ * from the first block
+ *
+ * @param buffer the client response buffer
+ * @return true on success
+ * @return false if the transfer was restarted too many times
+ */
+bool oc_blockwise_response_restart(oc_blockwise_state_t *buffer);
+
+/**
+ * @brief start retrieving the rest of the representation with several Block2
+ * requests in flight
+ *
+ * @param buffer the client response buffer holding the first block
+ * @param total_size size of the representation (from the Size2 option)
+ * @param block_size size of the blocks
+ * @return true if the window was started
+ * @return false if the representation does not fit into the buffer
+ */
+bool oc_blockwise_window_start(oc_blockwise_state_t *buffer,
+                               uint32_t total_size, uint16_t block_size);
+
+/**
+ * @brief handle the incoming block of a windowed transfer
+ *
+ * Blocks can arrive in any order, a block at next_block_offset is appended
+ * together with the blocks received ahead of it.
+ *
+ * @param buffer the client response buffer
+ * @param incoming_block_offset the block offset
+ * @param incoming_block the incoming block
+ * @param incoming_block_size the size of the incoming block
+ * @return true if the block was accepted (or is a duplicate)
+ * @return false if the block does not fit into the window
+ */
+bool oc_blockwise_window_handle_block(oc_blockwise_state_t *buffer,
+                                      uint32_t incoming_block_offset,
+                                      const uint8_t *incoming_block,
+                                      uint32_t incoming_block_size);
+
+/**
+ * @brief get the offset of the next block to request
+ *
+ * The last block ends the transfer at the server, so it is requested only
+ * after all the preceding blocks were received.
+ *
+ * @param buffer the client response buffer
+ * @param window_size maximal number of blocks in flight
+ * @param[out] block_offset the offset of the block to request
+ * @return true if a block should be requested
+ * @return false if the window is full or all blocks were requested
+ */
+bool oc_blockwise_window_next_request(oc_blockwise_state_t *buffer,
+                                      uint8_t window_size,
+                                      uint32_t *block_offset);
+#endif /* OC_CLIENT */
+
 /**
  * @brief free all blocks that are handled (refcount = 0)
  *
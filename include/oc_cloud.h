@@ -55,6 +55,15 @@ typedef enum oc_cps_t {
   OC_CPS_DEREGISTERING
 } oc_cps_t;
 
+/**
+ * Number of buckets of resource links with a separate digest of the links
+ * acknowledged by the resource directory. A link is published again after a
+ * restart only if the digest of its bucket changed.
+ */
+#ifndef OC_CLOUD_RD_DIGESTS
+#define OC_CLOUD_RD_DIGESTS (16)
+#endif /* OC_CLOUD_RD_DIGESTS */
+
 typedef struct oc_cloud_store_t
 {
   oc_string_t ci_server;
@@ -67,6 +76,10 @@ typedef struct oc_cloud_store_t
   uint8_t status;
   oc_cps_t cps;
   size_t device;
+  uint64_t rd_digests[OC_CLOUD_RD_DIGESTS]; /**< Digests of the buckets of
+                                              resource links acknowledged by
+                                              the resource directory, 0 if
+                                              unknown */
 } oc_cloud_store_t;
 
 typedef enum {
@@ -117,6 +130,18 @@ typedef struct oc_cloud_keepalive_t
   uint16_t ping_timeout; /**< Timeout for keepalive ping in seconds */
 } oc_cloud_keepalive_t;
 
+/**
+ * @brief Statistics of the connection attempts of the cloud manager.
+ */
+typedef struct oc_cloud_reconnect_stats_t
+{
+  uint32_t attempts;      /**< Sign-up, sign-in and refresh token requests */
+  uint32_t failures;      /**< Failed attempts */
+  uint32_t deferred;      /**< Attempts deferred by the concurrency limit */
+  uint32_t reconnects;    /**< Restarts after all retries failed */
+  uint32_t last_delay_ms; /**< Delay of the last scheduled attempt in ms */
+} oc_cloud_reconnect_stats_t;
+
 typedef struct oc_cloud_context_t
 {
   struct oc_cloud_context_t *next;
@@ -138,6 +163,11 @@ typedef struct oc_cloud_context_t
   oc_link_t *rd_publish_resources;   /**< Resource links to publish */
   oc_link_t *rd_published_resources; /**< Resource links already published */
   oc_link_t *rd_delete_resources;    /**< Resource links to delete */
+  oc_link_t *rd_publishing_resources; /**< Resource links being published */
+  oc_link_t *rd_deleting_resources;   /**< Resource links being deleted */
+  bool rd_publishing; /**< A batch of resource links is being published */
+  bool rd_deleting;   /**< A batch of resource links is being deleted */
+  uint8_t rd_retry_count; /**< Failed resource directory requests in a row */
 
   oc_resource_t *cloud_conf;
 
@@ -146,6 +176,12 @@ typedef struct oc_cloud_context_t
   bool cloud_manager;
 
   oc_cloud_keepalive_t keepalive; /**< Keepalive configuration */
+
+  uint32_t retry_delay_ms; /**< Previous retry delay in milliseconds */
+  bool attempt_in_flight;  /**< A connection attempt waits for a response */
+  oc_trigger_t deferred_attempt; /**< Attempt waiting for a free slot */
+  uint32_t deferred_order; /**< Position of the deferred attempt in the queue */
+  oc_cloud_reconnect_stats_t reconnect_stats; /**< Connection statistics */
 } oc_cloud_context_t;
 
 /**
@@ -355,6 +391,28 @@ void oc_cloud_set_keepalive(
   oc_cloud_context_t *ctx,
   oc_cloud_on_keepalive_response_cb_t on_keepalive_response, void *user_data);
 
+/**
+ * @brief Get statistics of the connection attempts of the cloud manager.
+ *
+ * @param ctx Cloud context, must not be NULL.
+ * @param[out] stats Output statistics, must not be NULL.
+ */
+OC_API
+void oc_cloud_get_reconnect_stats(const oc_cloud_context_t *ctx,
+                                  oc_cloud_reconnect_stats_t *stats);
+
+/**
+ * @brief Set the maximal number of connection attempts (sign-up, sign-in and
+ * refresh token requests) of all cloud contexts waiting for a response at the
+ * same time. Further attempts are queued and started in order as slots free,
+ * so that devices reconnecting after an outage don't overload the cloud.
+ *
+ * @param max_attempts Maximal number of concurrent attempts, 0 means unlimited
+ * (default is OC_CLOUD_MAX_CONCURRENT_ATTEMPTS)
+ */
+OC_API
+void oc_cloud_manager_set_max_concurrent_attempts(uint8_t max_attempts);
+
 /**
  * @brief Remove cloud context values, disconnect, and stop the cloud manager,
  * without releasing the context.
@@ -39,6 +39,9 @@ typedef struct oc_link_params_t
 struct oc_link_s
 {
   struct oc_link_s *next;
+  struct oc_link_s *index_next; ///< next link in the resource bucket
+  struct oc_link_s *uri_next;   ///< next link in the href bucket
+  struct oc_collection_s *collection; ///< collection containing the link
   oc_resource_t *resource;
   oc_interface_mask_t interfaces;
   int64_t ins;
@@ -58,6 +61,8 @@ struct oc_collection_s
   OC_LIST_STRUCT(mandatory_rts);
   OC_LIST_STRUCT(supported_rts);
   OC_LIST_STRUCT(links); ///< list of links ordered by href length and value
+  struct oc_collection_s *index_next; ///< next collection in the same bucket
+  struct oc_collection_s *uri_next;   ///< next collection in the uri bucket
 };
 
 void oc_link_set_interfaces(oc_link_t *link,
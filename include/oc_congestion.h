@@ -0,0 +1,90 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+/**
+ * @file oc_congestion.h
+ *
+ * @brief Congestion control of Confirmable messages sent over UDP.
+ *
+ * The retransmission timeout (RTO) is estimated for each peer from the
+ * round-trip times of its exchanges following CoCoA: a strong estimator is
+ * updated by exchanges acknowledged without a retransmission, a weak estimator
+ * by exchanges acknowledged after one or two retransmissions. The number of
+ * outstanding Confirmable messages to a peer can be limited by NSTART, excess
+ * messages are queued and sent once an outstanding exchange completes. A
+ * message that waits too long for its turn times out.
+ */
+
+#ifndef OC_CONGESTION_H
+#define OC_CONGESTION_H
+
+#include "oc_endpoint.h"
+#include "oc_export.h"
+#include "port/oc_clock.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Congestion control state of a peer.
+ */
+typedef struct oc_congestion_stats_t
+{
+  oc_clock_time_t rto;        ///< overall retransmission timeout (ticks)
+  oc_clock_time_t rto_strong; ///< RTO of the strong estimator (ticks)
+  oc_clock_time_t rto_weak;   ///< RTO of the weak estimator (ticks)
+  uint32_t strong_samples;    ///< RTT samples of the strong estimator
+  uint32_t weak_samples;      ///< RTT samples of the weak estimator
+  uint32_t retransmissions;   ///< retransmitted messages
+  uint8_t outstanding;        ///< Confirmable messages waiting for an ACK
+  uint16_t queued;            ///< messages waiting for a free NSTART slot
+} oc_congestion_stats_t;
+
+/**
+ * @brief Set the maximal number of outstanding Confirmable messages to a peer
+ * (NSTART, unlimited by default).
+ *
+ * @param nstart maximal number of outstanding messages (0 for unlimited)
+ */
+OC_API
+void oc_congestion_set_nstart(uint8_t nstart);
+
+/** @brief Get the maximal number of outstanding messages to a peer. */
+OC_API
+uint8_t oc_congestion_get_nstart(void);
+
+/**
+ * @brief Get the congestion control state of a peer.
+ *
+ * @param endpoint endpoint of the peer (cannot be NULL)
+ * @param[out] stats the state of the peer (cannot be NULL)
+ * @return true the peer is tracked and stats were filled
+ * @return false the peer is not tracked
+ */
+OC_API
+bool oc_congestion_get_stats(const oc_endpoint_t *endpoint,
+                             oc_congestion_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_CONGESTION_H */
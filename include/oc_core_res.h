@@ -96,6 +96,26 @@ oc_device_info_t *oc_core_get_device_info(size_t device);
  */
 oc_platform_info_t *oc_core_get_platform_info(void);
 
+/**
+ * @brief notify that the device info was modified
+ *
+ * Responses of /oic/d are encoded from a cached copy of the device info, the
+ * function must be called after the properties returned by
+ * oc_core_get_device_info are changed.
+ *
+ * @param device the device index
+ */
+void oc_core_device_info_changed(size_t device);
+
+/**
+ * @brief notify that the platform info was modified
+ *
+ * Responses of /oic/p are encoded from a cached copy of the platform info, the
+ * function must be called after the properties returned by
+ * oc_core_get_platform_info are changed.
+ */
+void oc_core_platform_info_changed(void);
+
 /**
  * @brief retrieve the resource by type (e.g. index) on a specific device
  *
@@ -62,6 +62,23 @@ typedef struct oc_pushd_resource_rep
   oc_rep_t *rep; ///< payload of pushed Resource
 } oc_pushd_resource_rep_t;
 
+/**
+ * @brief delivery statistics of push target
+ */
+typedef struct oc_push_target_stats
+{
+  uint32_t sent;            ///< updates sent to push target
+  uint32_t delivered;       ///< updates acknowledged by push target
+  uint32_t failed;          ///< updates failed to be delivered
+  uint32_t dropped;         ///< updates dropped from the full queue or not
+                            ///< pushed because the Resource was deleted
+  uint32_t queued;          ///< updates waiting in the queue
+  uint32_t last_latency_ms; ///< delivery latency of the last batch
+  uint32_t avg_latency_ms;  ///< smoothed delivery latency
+  uint32_t max_latency_ms;  ///< maximal delivery latency
+  bool circuit_open; ///< updates are held back after failures of push target
+} oc_push_target_stats_t;
+
 /**
  * @brief callback function called whenever new push arrives
  */
@@ -97,6 +114,60 @@ OC_API
 void oc_resource_state_changed(const char *uri, size_t uri_len,
                                size_t device_index);
 
+/**
+ * @brief set interval during which updates of pushable Resources are
+ * coalesced. Only the latest contents of an updated Resource is pushed when
+ * the interval elapses, updates for the same push target are sent in one
+ * request if batching is enabled (see oc_push_set_batching()).
+ *
+ * @param[in] interval_ms interval in milliseconds (0: push in the next
+ * iteration of the event loop)
+ */
+OC_API
+void oc_push_set_coalescing_interval(uint32_t interval_ms);
+
+/**
+ * @brief get interval during which updates of pushable Resources are
+ * coalesced
+ *
+ * @return interval in milliseconds
+ */
+OC_API
+uint32_t oc_push_get_coalescing_interval(void);
+
+/**
+ * @brief enable sending of coalesced updates for the same push target in one
+ * request. The payload of such request is an array of "oic.r.pushpayload"
+ * objects, so it can be enabled only if all push targets accept it. Disabled
+ * by default, each update is sent in a separate request.
+ *
+ * @param[in] enabled true: send updates in batches, false: one by one
+ */
+OC_API
+void oc_push_set_batching(bool enabled);
+
+/**
+ * @brief check if coalesced updates are sent in batches
+ *
+ * @return true: updates are sent in batches, false: one by one
+ */
+OC_API
+bool oc_push_is_batching_enabled(void);
+
+/**
+ * @brief get delivery statistics of push target. The delivery latency is
+ * measured from the first coalesced update of Resource to the response of
+ * push target.
+ *
+ * @param[in] endpoint endpoint of push target (cannot be NULL)
+ * @param[in] path path in push target (cannot be NULL)
+ * @param[out] stats delivery statistics (cannot be NULL)
+ * @return true: statistics were found, false: push target is not known
+ */
+OC_API
+bool oc_push_get_target_stats(const oc_endpoint_t *endpoint, const char *path,
+                              oc_push_target_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
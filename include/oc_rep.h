@@ -35,6 +35,23 @@
 extern "C" {
 #endif
 
+/**
+ * @brief State of the encoder: the buffer, the root encoder, the encoders of
+ * the root object and of the links array and the error of the encoding.
+ *
+ * The oc_rep_* functions and macros work with the current context. The stack
+ * invokes every request handler with its own context, so encoding a payload
+ * from a handler (e.g. to store data) doesn't clobber the response.
+ *
+ * @note Contexts only keep nested encodings apart. The current context and
+ * root_map, links_array and g_err are process globals, so the encoder is not
+ * reentrant: payloads must not be encoded by several threads at once.
+ */
+typedef struct oc_rep_encoder_context_t oc_rep_encoder_context_t;
+
+/* Encoder of the root object, the links array and the error of the encoding
+ * in the current context. They are saved to the context and replaced when
+ * another context becomes current. */
 extern CborEncoder root_map;
 extern CborEncoder links_array;
 extern int g_err;
@@ -64,9 +81,9 @@ OC_API
 void oc_rep_new(uint8_t *payload, int size);
 
 /**
- * @brief Get the global cbor encoder
+ * @brief Get the root cbor encoder of the current context
  *
- * @return global cbor encoder
+ * @return root cbor encoder
  */
 OC_API
 CborEncoder *oc_rep_get_encoder(void);
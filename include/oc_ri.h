@@ -30,6 +30,7 @@
 #include "util/oc_etimer.h"
 #include "util/oc_features.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -164,6 +165,19 @@ typedef enum {
  */
 typedef struct oc_separate_response_s oc_separate_response_t;
 
+/**
+ * @brief deferred response type
+ *
+ */
+typedef struct oc_deferred_response_t oc_deferred_response_t;
+
+/**
+ * @brief handle of a deferred response held by the application, 0 is not a
+ * valid handle
+ *
+ */
+typedef uint32_t oc_deferred_response_handle_t;
+
 /**
  * @brief reponse buffer type
  *
@@ -281,6 +295,57 @@ typedef struct oc_request_handler_s
   void *user_data;
 } oc_request_handler_t;
 
+/**
+ * @brief callback producing the payload of a streamed response one block at a
+ * time
+ *
+ * The callback is invoked with increasing offsets as the client requests the
+ * blocks of the response, so only a single block is held in memory. When the
+ * transfer ends (completed, aborted or expired) the callback is invoked one
+ * more time with block set to NULL so that user_data can be released.
+ *
+ * @param offset offset of the block within the payload
+ * @param block buffer to write the block to (NULL when the transfer ended)
+ * @param block_size size of the buffer
+ * @param[out] more set to true if the payload continues after this block
+ * @param user_data user data passed to oc_send_response_stream
+ * @return number of bytes written to block (at most block_size)
+ * @return -1 on error, the transfer is aborted
+ */
+typedef long (*oc_response_stream_cb_t)(size_t offset, uint8_t *block,
+                                        size_t block_size, bool *more,
+                                        void *user_data);
+
+/**
+ * @brief callback consuming the payload of a request one block at a time
+ *
+ * The blocks are delivered in order and before the request handler of the
+ * resource is invoked. The request handler is then invoked without a payload.
+ *
+ * @param origin endpoint of the client
+ * @param offset offset of the block within the payload
+ * @param block the block (NULL if the transfer was aborted)
+ * @param block_size size of the block
+ * @param last true for the last block of the payload
+ * @param user_data user data passed to oc_resource_set_request_stream_handler
+ * @return true to continue the transfer
+ * @return false to abort the transfer
+ */
+typedef bool (*oc_request_stream_cb_t)(const oc_endpoint_t *origin,
+                                       size_t offset, const uint8_t *block,
+                                       size_t block_size, bool last,
+                                       void *user_data);
+
+/**
+ * @brief request stream handler type
+ *
+ */
+typedef struct oc_request_stream_handler_s
+{
+  oc_request_stream_cb_t cb;
+  void *user_data;
+} oc_request_stream_handler_t;
+
 /**
  * @brief set properties callback
  *
@@ -354,6 +419,8 @@ struct oc_resource_s
 #endif
 #endif
   uint16_t observe_period_seconds; ///< observe period in seconds
+  oc_request_stream_handler_t
+    request_stream_handler; ///< consumer of streamed request payloads
 #ifdef OC_HAS_FEATURE_RESOURCE_ACCESS_IN_RFOTM
   oc_ace_permissions_t
     anon_permission_in_rfotm; ///< permissions for anonymous connection in RFOTM
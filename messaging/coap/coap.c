@@ -47,6 +47,7 @@
  * This file is part of the Contiki operating system.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
@@ -103,13 +104,23 @@
     }                                                                          \
     current_number = number;                                                   \
   }
+#ifdef OC_TCP
+#define COAP_BLOCK_IS_BERT(coap_pkt, field) ((coap_pkt)->field##_bert != 0)
+#else /* !OC_TCP */
+#define COAP_BLOCK_IS_BERT(coap_pkt, field) false
+#endif /* OC_TCP */
+
 #define COAP_SERIALIZE_BLOCK_OPTION(number, field, text)                       \
   if (IS_OPTION(coap_pkt, number)) {                                           \
     uint32_t block = coap_pkt->field##_num << 4;                               \
     if (coap_pkt->field##_more) {                                              \
       block |= 0x8;                                                            \
     }                                                                          \
-    block |= 0xF & coap_log_2(coap_pkt->field##_size / 16);                    \
+    if (COAP_BLOCK_IS_BERT(coap_pkt, field)) {                                 \
+      block |= COAP_BERT_SZX;                                                  \
+    } else {                                                                   \
+      block |= 0xF & coap_log_2(coap_pkt->field##_size / 16);                  \
+    }                                                                          \
     option_length +=                                                           \
       coap_serialize_int_option(number, current_number, option, block);        \
     if (option) {                                                              \
@@ -156,6 +167,50 @@ coap_parse_int_option(const uint8_t *bytes, size_t length)
   return var;
 }
 /*---------------------------------------------------------------------------*/
+/* Decodes the delta and the length of the option that starts at option,
+ * returns the start of the option value or NULL if the option header is
+ * malformed or does not fit into the message. */
+static const uint8_t *
+coap_parse_option_header(const uint8_t *option, const uint8_t *end,
+                         unsigned int *delta, size_t *length)
+{
+  *delta = option[0] >> 4;
+  *length = option[0] & 0x0F;
+  ++option;
+
+  if (*delta == 13) {
+    if (option >= end) {
+      return NULL;
+    }
+    *delta += option[0];
+    ++option;
+  } else if (*delta == 14) {
+    if (end - option < 2) {
+      return NULL;
+    }
+    *delta += 255 + ((unsigned int)option[0] << 8 | option[1]);
+    option += 2;
+  }
+
+  if (*length == 13) {
+    if (option >= end) {
+      return NULL;
+    }
+    *length += option[0];
+    ++option;
+  } else if (*length == 14) {
+    if (end - option < 2) {
+      return NULL;
+    }
+    *length += 255 + ((size_t)option[0] << 8 | option[1]);
+    option += 2;
+  } else if (*length == 15) {
+    /* reserved for the payload marker */
+    return NULL;
+  }
+  return option;
+}
+/*---------------------------------------------------------------------------*/
 static uint8_t
 coap_option_nibble(size_t value)
 {
@@ -356,6 +411,44 @@ coap_merge_multi_option(char **dst, size_t *dst_len, uint8_t *option,
   }
 }
 /*---------------------------------------------------------------------------*/
+/* The parse only records the first value and the number of the consecutive
+ * options of a repeated option, they are merged in place in the packet buffer
+ * once the option is accessed. The option headers were validated by the
+ * parse. */
+static void
+coap_merge_repeated_option(const char **value, size_t *value_len,
+                           uint32_t *count, char separator)
+{
+  if (*count <= 1) {
+    return;
+  }
+  char *dst = (char *)*value;
+  size_t dst_len = *value_len;
+  uint8_t *option = (uint8_t *)dst + dst_len;
+  for (uint32_t i = 1; i < *count; ++i) {
+    unsigned int delta = 0;
+    size_t length = 0;
+    /* an option header takes at most 5 bytes */
+    uint8_t *next = (uint8_t *)coap_parse_option_header(option, option + 5,
+                                                        &delta, &length);
+    assert(next != NULL && delta == 0);
+    coap_merge_multi_option(&dst, &dst_len, next, length, separator);
+    option = next + length;
+  }
+  *value = dst;
+  *value_len = dst_len;
+  *count = 1;
+}
+
+static void
+coap_merge_uri_options(coap_packet_t *coap_pkt)
+{
+  coap_merge_repeated_option(&coap_pkt->uri_path, &coap_pkt->uri_path_len,
+                             &coap_pkt->uri_path_count, '/');
+  coap_merge_repeated_option(&coap_pkt->uri_query, &coap_pkt->uri_query_len,
+                             &coap_pkt->uri_query_count, '&');
+}
+/*---------------------------------------------------------------------------*/
 #if 0
 static int
 coap_get_variable(const char *buffer, size_t length, const char *name,
@@ -683,6 +776,15 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
 #ifdef OC_SPEC_VER_OIC
           && coap_pkt->content_format != APPLICATION_CBOR
 #endif /* OC_SPEC_VER_OIC */
+#ifdef OC_JSON_ENCODER
+          && coap_pkt->content_format != APPLICATION_JSON
+#endif /* OC_JSON_ENCODER */
+#ifdef OC_SENML_ENCODER
+          && coap_pkt->content_format != APPLICATION_SENML_CBOR
+#ifdef OC_JSON_ENCODER
+          && coap_pkt->content_format != APPLICATION_SENML_JSON
+#endif /* OC_JSON_ENCODER */
+#endif /* OC_SENML_ENCODER */
       )
         return UNSUPPORTED_MEDIA_TYPE_4_15;
       break;
@@ -715,10 +817,19 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
 #endif /* OC_SPEC_VER_OIC */
 #ifdef OC_WKCORE
           && coap_pkt->accept != APPLICATION_LINK_FORMAT
-#endif /* OC_SPEC_VER_OIC */
+#endif /* OC_WKCORE */
 #ifdef OC_CBOR
           && coap_pkt->accept != APPLICATION_CBOR
-#endif /* OC_SPEC_VER_OIC */
+#endif /* OC_CBOR */
+#ifdef OC_JSON_ENCODER
+          && coap_pkt->accept != APPLICATION_JSON
+#endif /* OC_JSON_ENCODER */
+#ifdef OC_SENML_ENCODER
+          && coap_pkt->accept != APPLICATION_SENML_CBOR
+#ifdef OC_JSON_ENCODER
+          && coap_pkt->accept != APPLICATION_SENML_JSON
+#endif /* OC_JSON_ENCODER */
+#endif /* OC_SENML_ENCODER */
       )
         return NOT_ACCEPTABLE_4_06;
       break;
@@ -793,13 +904,12 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
       if (validate) {
         break;
       }
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final
-       * packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_path),
-                              &(coap_pkt->uri_path_len), current_option,
-                              option_length, '/');
-      OC_DBG("  Uri-Path [%.*s]", (int)coap_pkt->uri_path_len,
-             coap_pkt->uri_path);
+      /* the segments are merged by coap_get_header_uri_path() */
+      if (coap_pkt->uri_path_count++ == 0) {
+        coap_pkt->uri_path = (const char *)current_option;
+        coap_pkt->uri_path_len = option_length;
+      }
+      OC_DBG("  Uri-Path [%.*s]", (int)option_length, current_option);
       break;
     case COAP_OPTION_URI_QUERY:
       if (!inner) {
@@ -808,13 +918,12 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
       if (validate) {
         break;
       }
-      /* coap_merge_multi_option() operates in-place on the IPBUF, but final
-       * packet field should be const string -> cast to string */
-      coap_merge_multi_option((char **)&(coap_pkt->uri_query),
-                              &(coap_pkt->uri_query_len), current_option,
-                              option_length, '&');
-      OC_DBG("  Uri-Query [%.*s]", (int)coap_pkt->uri_query_len,
-             coap_pkt->uri_query);
+      /* the segments are merged by coap_get_header_uri_query() */
+      if (coap_pkt->uri_query_count++ == 0) {
+        coap_pkt->uri_query = (const char *)current_option;
+        coap_pkt->uri_query_len = option_length;
+      }
+      OC_DBG("  Uri-Query [%.*s]", (int)option_length, current_option);
       break;
 #if 0
     case COAP_OPTION_LOCATION_PATH:
@@ -859,6 +968,14 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
       coap_pkt->block2_offset = (coap_pkt->block2_num & ~0x0000000F)
                                 << (coap_pkt->block2_num & 0x07);
       coap_pkt->block2_num >>= 4;
+#ifdef OC_TCP
+      if (coap_pkt->transport_type == COAP_TRANSPORT_TCP &&
+          coap_pkt->block2_size == (16 << COAP_BERT_SZX)) {
+        coap_pkt->block2_bert = 1;
+        coap_pkt->block2_size = COAP_BERT_UNIT_SIZE;
+        coap_pkt->block2_offset = coap_pkt->block2_num * COAP_BERT_UNIT_SIZE;
+      }
+#endif /* OC_TCP */
       OC_DBG("  Block2 [%lu%s (%u B/blk)]", (unsigned long)coap_pkt->block2_num,
              coap_pkt->block2_more ? "+" : "", coap_pkt->block2_size);
       break;
@@ -873,6 +990,14 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
       coap_pkt->block1_offset = (coap_pkt->block1_num & ~0x0000000F)
                                 << (coap_pkt->block1_num & 0x07);
       coap_pkt->block1_num >>= 4;
+#ifdef OC_TCP
+      if (coap_pkt->transport_type == COAP_TRANSPORT_TCP &&
+          coap_pkt->block1_size == (16 << COAP_BERT_SZX)) {
+        coap_pkt->block1_bert = 1;
+        coap_pkt->block1_size = COAP_BERT_UNIT_SIZE;
+        coap_pkt->block1_offset = coap_pkt->block1_num * COAP_BERT_UNIT_SIZE;
+      }
+#endif /* OC_TCP */
       OC_DBG("  Block1 [%lu%s (%u B/blk)]", (unsigned long)coap_pkt->block1_num,
              coap_pkt->block1_more ? "+" : "", coap_pkt->block1_size);
       break;
@@ -919,6 +1044,34 @@ coap_oscore_parse_option(coap_packet_t *const coap_pkt, uint8_t *current_option,
   return COAP_NO_ERROR;
 }
 
+coap_status_t
+coap_validate_options(const uint8_t *data, size_t data_len,
+                      size_t options_offset)
+{
+  if (options_offset > data_len || data_len > UINT32_MAX) {
+    return BAD_REQUEST_4_00;
+  }
+
+  const uint8_t *end = data + data_len;
+  const uint8_t *current_option = data + options_offset;
+  while (current_option < end) {
+    /* payload marker 0xFF, currently only checking for 0xF* because rest is
+     * reserved */
+    if ((current_option[0] & 0xF0) == 0xF0) {
+      break;
+    }
+    unsigned int option_delta = 0;
+    size_t option_length = 0;
+    const uint8_t *value = coap_parse_option_header(
+      current_option, end, &option_delta, &option_length);
+    if (value == NULL || option_length > (size_t)(end - value)) {
+      return BAD_REQUEST_4_00;
+    }
+    current_option = value + option_length;
+  }
+  return COAP_NO_ERROR;
+}
+
 coap_status_t
 coap_oscore_parse_options(void *packet, const uint8_t *data, size_t data_len,
                           uint8_t *current_option, bool inner, bool outer,
@@ -938,6 +1091,7 @@ coap_oscore_parse_options(void *packet, const uint8_t *data, size_t data_len,
   unsigned int option_delta = 0;
   size_t option_length = 0;
   coap_status_t last_error = COAP_NO_ERROR;
+  const uint8_t *end = data + data_len;
 
   while (current_option < data + data_len) {
     /* payload marker 0xFF, currently only checking for 0xF* because rest is
@@ -959,31 +1113,13 @@ coap_oscore_parse_options(void *packet, const uint8_t *data, size_t data_len,
       break;
     }
 
-    option_delta = current_option[0] >> 4;
-    option_length = current_option[0] & 0x0F;
-    ++current_option;
-
-    if (option_delta == 13) {
-      option_delta += current_option[0];
-      ++current_option;
-    } else if (option_delta == 14) {
-      option_delta += 255;
-      option_delta += current_option[0] << 8;
-      ++current_option;
-      option_delta += current_option[0];
-      ++current_option;
-    }
-
-    if (option_length == 13) {
-      option_length += current_option[0];
-      ++current_option;
-    } else if (option_length == 14) {
-      option_length += 255;
-      option_length += current_option[0] << 8;
-      ++current_option;
-      option_length += current_option[0];
-      ++current_option;
+    const uint8_t *value = coap_parse_option_header(
+      current_option, end, &option_delta, &option_length);
+    if (value == NULL) {
+      OC_WRN("Invalid option - malformed option header");
+      return BAD_REQUEST_4_00;
     }
+    current_option += value - current_option;
 
     option_number += option_delta;
 
@@ -992,7 +1128,7 @@ coap_oscore_parse_options(void *packet, const uint8_t *data, size_t data_len,
              option_length);
       SET_OPTION(coap_pkt, option_number);
     }
-    if (current_option + option_length > data + data_len) {
+    if (option_length > (size_t)(end - current_option)) {
       OC_WRN("Invalid option - option length exceeds packet length");
       return BAD_REQUEST_4_00;
     }
@@ -1198,6 +1334,7 @@ coap_oscore_serialize_message(void *packet, uint8_t *buffer, bool inner,
   }
 
   coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+  coap_merge_uri_options(coap_pkt);
   uint8_t *option;
   unsigned int current_number = 0;
   uint8_t token_location = 0;
@@ -1335,7 +1472,7 @@ coap_send_message(oc_message_t *message)
       message->endpoint.version == OCF_VER_1_0_0) {
     tcp_csm_state_t state = oc_tcp_get_csm_state(&message->endpoint);
     if (state == CSM_NONE) {
-      coap_send_csm_message(&message->endpoint, OC_PDU_SIZE, 0);
+      coap_send_csm_message(&message->endpoint, OC_PDU_SIZE, 1);
     }
   }
 #endif /* OC_TCP */
@@ -1360,9 +1497,15 @@ coap_udp_parse_message(void *packet, uint8_t *data, size_t data_len,
            (unsigned)UINT16_MAX);
     return BAD_REQUEST_4_00;
   }
+  if (data_len < COAP_HEADER_LEN) {
+    OC_WRN("message size(%zu) is smaller than the CoAP header", data_len);
+    return BAD_REQUEST_4_00;
+  }
   coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
-  /* initialize packet */
-  memset(coap_pkt, 0, sizeof(coap_packet_t));
+  /* initialize packet, a validated packet only gets the header fields */
+  if (!validate) {
+    memset(coap_pkt, 0, sizeof(coap_packet_t));
+  }
   /* pointer to packet bytes */
   coap_pkt->buffer = data;
   coap_pkt->transport_type = COAP_TRANSPORT_UDP;
@@ -1386,6 +1529,18 @@ coap_udp_parse_message(void *packet, uint8_t *data, size_t data_len,
     return BAD_REQUEST_4_00;
   }
 
+  if (data_len < (size_t)COAP_HEADER_LEN + coap_pkt->token_len) {
+    OC_WRN("Token exceeds the message size(%zu)", data_len);
+    return BAD_REQUEST_4_00;
+  }
+
+  if (validate) {
+    /* the options are checked in a single pass without decoding them, the
+     * message is parsed again once it is processed */
+    return coap_validate_options(data, data_len,
+                                 COAP_HEADER_LEN + coap_pkt->token_len);
+  }
+
   uint8_t *current_option = data + COAP_HEADER_LEN;
 
   memcpy(coap_pkt->token, current_option, coap_pkt->token_len);
@@ -1699,6 +1854,8 @@ coap_get_header_uri_path(void *packet, const char **path)
   if (!IS_OPTION(coap_pkt, COAP_OPTION_URI_PATH)) {
     return 0;
   }
+  coap_merge_repeated_option(&coap_pkt->uri_path, &coap_pkt->uri_path_len,
+                             &coap_pkt->uri_path_count, '/');
   *path = coap_pkt->uri_path;
   return coap_pkt->uri_path_len;
 }
@@ -1714,6 +1871,7 @@ coap_set_header_uri_path(void *packet, const char *path, size_t path_len)
 
   coap_pkt->uri_path = path;
   coap_pkt->uri_path_len = path_len;
+  coap_pkt->uri_path_count = 1;
 
   SET_OPTION(coap_pkt, COAP_OPTION_URI_PATH);
   return coap_pkt->uri_path_len;
@@ -1727,6 +1885,8 @@ coap_get_header_uri_query(void *packet, const char **query)
   if (!IS_OPTION(coap_pkt, COAP_OPTION_URI_QUERY)) {
     return 0;
   }
+  coap_merge_repeated_option(&coap_pkt->uri_query, &coap_pkt->uri_query_len,
+                             &coap_pkt->uri_query_count, '&');
   *query = coap_pkt->uri_query;
   return coap_pkt->uri_query_len;
 }
@@ -1741,6 +1901,7 @@ coap_set_header_uri_query(void *packet, const char *query)
 
   coap_pkt->uri_query = query;
   coap_pkt->uri_query_len = strlen(query);
+  coap_pkt->uri_query_count = 1;
 
   SET_OPTION(coap_pkt, COAP_OPTION_URI_QUERY);
   return coap_pkt->uri_query_len;
@@ -1869,6 +2030,9 @@ coap_set_header_block2(void *packet, uint32_t num, uint8_t more, uint16_t size)
   coap_pkt->block2_num = num;
   coap_pkt->block2_more = more ? 1 : 0;
   coap_pkt->block2_size = size;
+#ifdef OC_TCP
+  coap_pkt->block2_bert = 0;
+#endif /* OC_TCP */
 
   SET_OPTION(coap_pkt, COAP_OPTION_BLOCK2);
   return 1;
@@ -1915,11 +2079,56 @@ coap_set_header_block1(void *packet, uint32_t num, uint8_t more, uint16_t size)
   coap_pkt->block1_num = num;
   coap_pkt->block1_more = more;
   coap_pkt->block1_size = size;
+#ifdef OC_TCP
+  coap_pkt->block1_bert = 0;
+#endif /* OC_TCP */
 
   SET_OPTION(coap_pkt, COAP_OPTION_BLOCK1);
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#ifdef OC_TCP
+int
+coap_set_header_block2_bert(void *packet, uint32_t num, uint8_t more)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (coap_pkt->transport_type != COAP_TRANSPORT_TCP ||
+      !coap_set_header_block2(packet, num, more, COAP_BERT_UNIT_SIZE)) {
+    return 0;
+  }
+  coap_pkt->block2_bert = 1;
+  return 1;
+}
+
+int
+coap_set_header_block1_bert(void *packet, uint32_t num, uint8_t more)
+{
+  coap_packet_t *const coap_pkt = (coap_packet_t *)packet;
+
+  if (coap_pkt->transport_type != COAP_TRANSPORT_TCP ||
+      !coap_set_header_block1(packet, num, more, COAP_BERT_UNIT_SIZE)) {
+    return 0;
+  }
+  coap_pkt->block1_bert = 1;
+  return 1;
+}
+
+bool
+coap_header_block2_is_bert(const void *packet)
+{
+  const coap_packet_t *const coap_pkt = (const coap_packet_t *)packet;
+  return IS_OPTION(coap_pkt, COAP_OPTION_BLOCK2) && coap_pkt->block2_bert != 0;
+}
+
+bool
+coap_header_block1_is_bert(const void *packet)
+{
+  const coap_packet_t *const coap_pkt = (const coap_packet_t *)packet;
+  return IS_OPTION(coap_pkt, COAP_OPTION_BLOCK1) && coap_pkt->block1_bert != 0;
+}
+#endif /* OC_TCP */
+/*---------------------------------------------------------------------------*/
 int
 coap_get_header_size2(void *packet, uint32_t *size)
 {
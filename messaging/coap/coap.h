@@ -127,6 +127,7 @@ typedef struct
   const char *location_query;
   size_t uri_path_len;
   const char *uri_path;
+  uint32_t uri_path_count; /* segments of a parsed Uri-Path, merged on demand */
   int32_t observe;
   uint16_t accept;
   uint8_t if_match_len;
@@ -139,10 +140,15 @@ typedef struct
   uint8_t block1_more;
   uint16_t block1_size;
   uint32_t block1_offset;
+#ifdef OC_TCP
+  uint8_t block2_bert; /* BERT block (SZX 7 over reliable transport) */
+  uint8_t block1_bert;
+#endif /* OC_TCP */
   uint32_t size2;
   uint32_t size1;
   size_t uri_query_len;
   const char *uri_query;
+  uint32_t uri_query_count; /* segments of a parsed Uri-Query */
   uint8_t if_none_match;
 
 #ifdef OC_TCP
@@ -199,13 +205,28 @@ coap_status_t coap_oscore_parse_options(void *packet, const uint8_t *data,
                                         size_t data_len,
                                         uint8_t *current_option, bool inner,
                                         bool outer, bool oscore, bool validate);
+/**
+ * @brief Check that the options of a message fit into the message without
+ * decoding their values
+ *
+ * @param data raw message data
+ * @param data_len length of raw message data
+ * @param options_offset offset of the first option in raw message data
+ * @return COAP_NO_ERROR on success
+ * @return BAD_REQUEST_4_00 if the options are malformed
+ */
+coap_status_t coap_validate_options(const uint8_t *data, size_t data_len,
+                                    size_t options_offset);
+
 /**
  * @brief Parse UDP CoAP message
  *
  * @param request pointer to coap_packet_t struct
  * @param data raw message data
  * @param data_len length of raw message data
- * @param validate if true, it doesn't modify data
+ * @param validate if true, it doesn't modify data, only the header fields are
+ * parsed and the options are checked to be well-formed without being decoded
+ * (only BAD_REQUEST_4_00 is reported)
  * @return coap_status_t
  */
 coap_status_t coap_udp_parse_message(void *request, uint8_t *data,
@@ -293,6 +314,15 @@ int coap_get_header_block1(void *packet, uint32_t *num, uint8_t *more,
 int coap_set_header_block1(void *packet, uint32_t num, uint8_t more,
                            uint16_t size);
 
+#ifdef OC_TCP
+/* BERT (RFC 8323, section 6): over reliable transports SZX 7 denotes blocks
+ * made of one or more 1024 byte units and the block number counts units */
+int coap_set_header_block2_bert(void *packet, uint32_t num, uint8_t more);
+int coap_set_header_block1_bert(void *packet, uint32_t num, uint8_t more);
+bool coap_header_block2_is_bert(const void *packet);
+bool coap_header_block1_is_bert(const void *packet);
+#endif /* OC_TCP */
+
 int coap_get_header_size2(void *packet, uint32_t *size);
 int coap_set_header_size2(void *packet, uint32_t size);
 
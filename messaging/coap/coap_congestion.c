@@ -0,0 +1,239 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "messaging/coap/coap_congestion_internal.h"
+#include "port/oc_log_internal.h"
+#include "port/oc_random.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
+
+#include <assert.h>
+#include <string.h>
+
+/* Peers are ordered from the most recently used one. */
+OC_LIST(g_congestion_peers);
+OC_MEMB(g_congestion_peers_s, coap_congestion_peer_t,
+        COAP_CONGESTION_MAX_PEERS);
+static size_t g_congestion_peers_count = 0;
+static uint8_t g_nstart = COAP_DEFAULT_NSTART;
+
+void
+oc_congestion_set_nstart(uint8_t nstart)
+{
+  g_nstart = nstart;
+}
+
+uint8_t
+oc_congestion_get_nstart(void)
+{
+  return g_nstart;
+}
+
+static coap_congestion_peer_t *
+congestion_find_peer(const oc_endpoint_t *endpoint)
+{
+  coap_congestion_peer_t *peer =
+    (coap_congestion_peer_t *)oc_list_head(g_congestion_peers);
+  for (; peer != NULL; peer = peer->next) {
+    if (oc_endpoint_compare(&peer->endpoint, endpoint) == 0) {
+      return peer;
+    }
+  }
+  return NULL;
+}
+
+static coap_congestion_peer_t *
+congestion_reuse_idle_peer(void)
+{
+  coap_congestion_peer_t *idle = NULL;
+  coap_congestion_peer_t *peer =
+    (coap_congestion_peer_t *)oc_list_head(g_congestion_peers);
+  for (; peer != NULL; peer = peer->next) {
+    if (peer->outstanding == 0 && peer->queued == 0) {
+      idle = peer;
+    }
+  }
+  if (idle != NULL) {
+    oc_list_remove(g_congestion_peers, idle);
+  }
+  return idle;
+}
+
+coap_congestion_peer_t *
+coap_congestion_get_peer(const oc_endpoint_t *endpoint, bool create)
+{
+  coap_congestion_peer_t *peer = congestion_find_peer(endpoint);
+  if (peer != NULL) {
+    oc_list_remove(g_congestion_peers, peer);
+    oc_list_push(g_congestion_peers, peer);
+    return peer;
+  }
+  if (!create) {
+    return NULL;
+  }
+  if (g_congestion_peers_count < COAP_CONGESTION_MAX_PEERS) {
+    peer = (coap_congestion_peer_t *)oc_memb_alloc(&g_congestion_peers_s);
+  }
+  if (peer != NULL) {
+    ++g_congestion_peers_count;
+  } else {
+    // forget the least recently used peer without outstanding messages
+    peer = congestion_reuse_idle_peer();
+    if (peer == NULL) {
+      OC_DBG("congestion state of all peers is in use");
+      return NULL;
+    }
+    memset(peer, 0, sizeof(coap_congestion_peer_t));
+  }
+  memcpy(&peer->endpoint, endpoint, sizeof(oc_endpoint_t));
+  peer->rto = COAP_CONGESTION_DEFAULT_RTO;
+  peer->rto_strong = COAP_CONGESTION_DEFAULT_RTO;
+  peer->rto_weak = COAP_CONGESTION_DEFAULT_RTO;
+  peer->updated = oc_clock_time_monotonic();
+  oc_list_push(g_congestion_peers, peer);
+  return peer;
+}
+
+bool
+coap_congestion_can_send(const coap_congestion_peer_t *peer)
+{
+  return g_nstart == 0 || peer->outstanding < g_nstart;
+}
+
+static void
+congestion_age_rto(coap_congestion_peer_t *peer, oc_clock_time_t now)
+{
+  if (now <= peer->updated) {
+    return;
+  }
+  oc_clock_time_t idle = now - peer->updated;
+  if (peer->rto < OC_CLOCK_SECOND && idle > 16 * peer->rto) {
+    // a small RTO is doubled, the network conditions might have changed
+    peer->rto *= 2;
+    peer->updated = now;
+  } else if (peer->rto > 3 * OC_CLOCK_SECOND && idle > 4 * peer->rto) {
+    // a large RTO is moved towards the default
+    peer->rto = OC_CLOCK_SECOND + peer->rto / 2;
+    peer->updated = now;
+  }
+}
+
+oc_clock_time_t
+coap_congestion_initial_timeout(coap_congestion_peer_t *peer,
+                                oc_clock_time_t now, uint8_t *backoff)
+{
+  assert(peer != NULL);
+  assert(backoff != NULL);
+  congestion_age_rto(peer, now);
+  // variable backoff factor
+  if (peer->rto < OC_CLOCK_SECOND) {
+    *backoff = 6;
+  } else if (peer->rto > 3 * OC_CLOCK_SECOND) {
+    *backoff = 3;
+  } else {
+    *backoff = 4;
+  }
+  return peer->rto + (oc_random_value() % (peer->rto / 2 + 1));
+}
+
+oc_clock_time_t
+coap_congestion_backoff(oc_clock_time_t timeout, uint8_t backoff)
+{
+  oc_clock_time_t next = timeout * backoff / 2;
+  return next < COAP_CONGESTION_MAX_RTO ? next : COAP_CONGESTION_MAX_RTO;
+}
+
+static oc_clock_time_t
+congestion_estimate(oc_clock_time_t *srtt, oc_clock_time_t *rttvar,
+                    uint32_t samples, oc_clock_time_t rtt, unsigned k)
+{
+  if (samples == 0) {
+    *srtt = rtt;
+    *rttvar = rtt / 2;
+  } else {
+    oc_clock_time_t diff = *srtt > rtt ? *srtt - rtt : rtt - *srtt;
+    *rttvar = (3 * *rttvar + diff) / 4;
+    *srtt = (7 * *srtt + rtt) / 8;
+  }
+  oc_clock_time_t rto = *srtt + k * *rttvar;
+  return rto < COAP_CONGESTION_MAX_RTO ? rto : COAP_CONGESTION_MAX_RTO;
+}
+
+void
+coap_congestion_rtt_sample(coap_congestion_peer_t *peer, oc_clock_time_t rtt,
+                           uint8_t retransmissions, oc_clock_time_t now)
+{
+  assert(peer != NULL);
+  if (retransmissions == 0) {
+    peer->rto_strong = congestion_estimate(&peer->srtt_strong,
+                                           &peer->rttvar_strong,
+                                           peer->strong_samples, rtt, 4);
+    ++peer->strong_samples;
+    peer->rto = (peer->rto_strong + peer->rto) / 2;
+  } else if (retransmissions <= 2) {
+    // the ACK cannot be matched to a transmission, the RTT is measured from
+    // the first one
+    peer->rto_weak = congestion_estimate(
+      &peer->srtt_weak, &peer->rttvar_weak, peer->weak_samples, rtt, 1);
+    ++peer->weak_samples;
+    peer->rto = (peer->rto_weak + 3 * peer->rto) / 4;
+  } else {
+    return;
+  }
+  if (peer->rto == 0) {
+    peer->rto = 1;
+  }
+  peer->updated = now;
+  OC_DBG("RTO updated: %u ms (strong %u ms, weak %u ms)",
+         (unsigned)(peer->rto * 1000 / OC_CLOCK_SECOND),
+         (unsigned)(peer->rto_strong * 1000 / OC_CLOCK_SECOND),
+         (unsigned)(peer->rto_weak * 1000 / OC_CLOCK_SECOND));
+}
+
+bool
+oc_congestion_get_stats(const oc_endpoint_t *endpoint,
+                        oc_congestion_stats_t *stats)
+{
+  assert(endpoint != NULL);
+  assert(stats != NULL);
+  const coap_congestion_peer_t *peer = congestion_find_peer(endpoint);
+  if (peer == NULL) {
+    return false;
+  }
+  stats->rto = peer->rto;
+  stats->rto_strong = peer->rto_strong;
+  stats->rto_weak = peer->rto_weak;
+  stats->strong_samples = peer->strong_samples;
+  stats->weak_samples = peer->weak_samples;
+  stats->retransmissions = peer->retransmissions;
+  stats->outstanding = peer->outstanding;
+  stats->queued = peer->queued;
+  return true;
+}
+
+void
+coap_congestion_free_all(void)
+{
+  coap_congestion_peer_t *peer =
+    (coap_congestion_peer_t *)oc_list_pop(g_congestion_peers);
+  while (peer != NULL) {
+    oc_memb_free(&g_congestion_peers_s, peer);
+    peer = (coap_congestion_peer_t *)oc_list_pop(g_congestion_peers);
+  }
+  g_congestion_peers_count = 0;
+}
@@ -0,0 +1,135 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef COAP_CONGESTION_INTERNAL_H
+#define COAP_CONGESTION_INTERNAL_H
+
+#include "messaging/coap/constants.h"
+#include "oc_congestion.h"
+#include "oc_endpoint.h"
+#include "port/oc_clock.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximal number of peers with a tracked congestion state, idle peers are
+ * forgotten from the least recently used one when a new peer arrives. */
+#ifndef COAP_CONGESTION_MAX_PEERS
+#define COAP_CONGESTION_MAX_PEERS (16)
+#endif /* COAP_CONGESTION_MAX_PEERS */
+
+/* Default maximal number of outstanding Confirmable messages to a peer, 0
+ * disables the limit. */
+#ifndef COAP_DEFAULT_NSTART
+#define COAP_DEFAULT_NSTART (0)
+#endif /* COAP_DEFAULT_NSTART */
+
+/* Maximal time a Confirmable message waits for a free NSTART slot, the
+ * exchange times out afterwards. Defaults to MAX_TRANSMIT_SPAN of RFC 7252. */
+#ifndef COAP_CONGESTION_MAX_QUEUE_WAIT
+#define COAP_CONGESTION_MAX_QUEUE_WAIT (45 * OC_CLOCK_SECOND)
+#endif /* COAP_CONGESTION_MAX_QUEUE_WAIT */
+
+/* RTO of a peer without RTT samples */
+#define COAP_CONGESTION_DEFAULT_RTO (COAP_RESPONSE_TIMEOUT * OC_CLOCK_SECOND)
+
+/* Upper bound of the RTO and of the backed off retransmission timeout */
+#define COAP_CONGESTION_MAX_RTO (60 * OC_CLOCK_SECOND)
+
+typedef struct coap_congestion_peer_t
+{
+  struct coap_congestion_peer_t *next;
+  oc_endpoint_t endpoint;
+  oc_clock_time_t rto;
+  oc_clock_time_t srtt_strong;
+  oc_clock_time_t rttvar_strong;
+  oc_clock_time_t rto_strong;
+  oc_clock_time_t srtt_weak;
+  oc_clock_time_t rttvar_weak;
+  oc_clock_time_t rto_weak;
+  oc_clock_time_t updated; ///< time of the last RTO update
+  uint32_t strong_samples;
+  uint32_t weak_samples;
+  uint32_t retransmissions;
+  uint8_t outstanding;
+  uint16_t queued;
+} coap_congestion_peer_t;
+
+/**
+ * @brief Find the congestion state of the peer.
+ *
+ * @param endpoint endpoint of the peer (cannot be NULL)
+ * @param create create the state if it doesn't exist
+ * @return the state of the peer
+ * @return NULL the peer is not tracked or all tracked peers are busy
+ */
+coap_congestion_peer_t *coap_congestion_get_peer(const oc_endpoint_t *endpoint,
+                                                 bool create);
+
+/** @brief Check if a new Confirmable message can be sent to the peer */
+bool coap_congestion_can_send(const coap_congestion_peer_t *peer);
+
+/**
+ * @brief Get the timeout before the first retransmission of a new exchange.
+ *
+ * The RTO of a peer that was not updated for a while is aged first. The
+ * timeout is randomized between RTO and 1.5 * RTO.
+ *
+ * @param peer the state of the peer (cannot be NULL)
+ * @param now current monotonic time
+ * @param[out] backoff variable backoff factor of the exchange in halves
+ * @return oc_clock_time_t the timeout
+ */
+oc_clock_time_t coap_congestion_initial_timeout(coap_congestion_peer_t *peer,
+                                                oc_clock_time_t now,
+                                                uint8_t *backoff);
+
+/**
+ * @brief Back off the retransmission timeout.
+ *
+ * @param timeout the previous timeout
+ * @param backoff the backoff factor in halves
+ * @return oc_clock_time_t the next timeout
+ */
+oc_clock_time_t coap_congestion_backoff(oc_clock_time_t timeout,
+                                        uint8_t backoff);
+
+/**
+ * @brief Update the RTO of the peer with an RTT sample.
+ *
+ * @param peer the state of the peer (cannot be NULL)
+ * @param rtt time from the first transmission to the ACK
+ * @param retransmissions number of retransmissions of the exchange
+ * @param now current monotonic time
+ */
+void coap_congestion_rtt_sample(coap_congestion_peer_t *peer,
+                                oc_clock_time_t rtt, uint8_t retransmissions,
+                                oc_clock_time_t now);
+
+/** @brief Free the congestion state of all peers. */
+void coap_congestion_free_all(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COAP_CONGESTION_INTERNAL_H */
@@ -20,9 +20,77 @@
 #include "coap_signal.h"
 #include "coap.h"
 #include "transactions.h"
+#include "util/oc_list.h"
+#include "util/oc_memb.h"
 #include <string.h>
 
 #ifdef OC_TCP
+typedef struct coap_signal_peer_t
+{
+  struct coap_signal_peer_t *next;
+  oc_endpoint_t endpoint;
+  uint32_t max_msg_size;
+} coap_signal_peer_t;
+
+OC_LIST(g_signal_peers);
+OC_MEMB(g_signal_peers_s, coap_signal_peer_t, COAP_SIGNAL_MAX_PEERS);
+
+static coap_signal_peer_t *
+coap_signal_find_peer(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = (coap_signal_peer_t *)oc_list_head(g_signal_peers);
+  while (peer != NULL) {
+    if (oc_endpoint_compare(&peer->endpoint, endpoint) == 0) {
+      return peer;
+    }
+    peer = peer->next;
+  }
+  return NULL;
+}
+
+static void
+coap_signal_set_peer_max_msg_size(const oc_endpoint_t *endpoint,
+                                  uint32_t max_msg_size)
+{
+  coap_signal_peer_t *peer = coap_signal_find_peer(endpoint);
+  if (peer == NULL) {
+    peer = (coap_signal_peer_t *)oc_memb_alloc(&g_signal_peers_s);
+    if (peer == NULL) {
+      OC_WRN("cannot store Max-Message-Size of peer, default is used");
+      return;
+    }
+    memcpy(&peer->endpoint, endpoint, sizeof(oc_endpoint_t));
+    oc_list_add(g_signal_peers, peer);
+  }
+  peer->max_msg_size = max_msg_size;
+}
+
+uint32_t
+coap_signal_get_peer_max_msg_size(const oc_endpoint_t *endpoint)
+{
+  const coap_signal_peer_t *peer = coap_signal_find_peer(endpoint);
+  return peer != NULL ? peer->max_msg_size : COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE;
+}
+
+void
+coap_signal_remove_peer(const oc_endpoint_t *endpoint)
+{
+  coap_signal_peer_t *peer = coap_signal_find_peer(endpoint);
+  if (peer != NULL) {
+    oc_list_remove(g_signal_peers, peer);
+    oc_memb_free(&g_signal_peers_s, peer);
+  }
+}
+
+void
+coap_signal_free_all_peers(void)
+{
+  coap_signal_peer_t *peer;
+  while ((peer = (coap_signal_peer_t *)oc_list_pop(g_signal_peers)) != NULL) {
+    oc_memb_free(&g_signal_peers_s, peer);
+  }
+}
+
 static void
 coap_make_token(coap_packet_t *packet)
 {
@@ -67,8 +135,6 @@ coap_send_csm_message(const oc_endpoint_t *endpoint, uint32_t max_message_size,
       OC_ERR("coap_signal_set_blockwise_transfer failed");
       return 0;
     }
-    // Add this line below to remain until we start supporting BERT
-    max_message_size = 1152;
   }
 #endif /* OC_BLOCK_WISE */
 
@@ -217,12 +283,15 @@ handle_coap_signal_message(void *packet, const oc_endpoint_t *endpoint)
 
   OC_DBG("Coap signal message received.(code: %d)", coap_pkt->code);
   if (coap_pkt->code == CSM_7_01) {
+    uint32_t max_msg_size = COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE;
+    coap_signal_get_max_msg_size(coap_pkt, &max_msg_size);
+    coap_signal_set_peer_max_msg_size(endpoint, max_msg_size);
     tcp_csm_state_t state = oc_tcp_get_csm_state(endpoint);
     if (state == CSM_DONE) {
-      // TODO: max-message-size, blockwise_transfer handling
+      // TODO: blockwise_transfer handling
       return COAP_NO_ERROR;
     } else if (state == CSM_NONE) {
-      coap_send_csm_message(endpoint, OC_PDU_SIZE, 0);
+      coap_send_csm_message(endpoint, OC_PDU_SIZE, 1);
     }
     oc_tcp_update_csm_state(endpoint, CSM_DONE);
   } else if (coap_pkt->code == PING_7_02) {
@@ -76,6 +76,34 @@ int coap_signal_get_hold_off(void *packet, uint32_t *time_seconds);
 int coap_signal_set_hold_off(void *packet, uint32_t time_seconds);
 int coap_signal_get_bad_csm(void *packet, uint16_t *opt);
 int coap_signal_set_bad_csm(void *packet, uint16_t opt);
+
+/* Max-Message-Size of a peer that did not indicate one (RFC 8323, section
+ * 5.3.1) */
+#define COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE (1152)
+
+/* Number of peers whose Max-Message-Size is remembered */
+#ifndef COAP_SIGNAL_MAX_PEERS
+#define COAP_SIGNAL_MAX_PEERS (OC_MAX_NUM_ENDPOINTS)
+#endif /* COAP_SIGNAL_MAX_PEERS */
+
+/**
+ * @brief Get the Max-Message-Size indicated by the CSM message of the peer.
+ *
+ * @param endpoint endpoint of the peer (cannot be NULL)
+ * @return the Max-Message-Size of the peer or COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE
+ * if the peer has not sent a CSM message with the option
+ */
+uint32_t coap_signal_get_peer_max_msg_size(const oc_endpoint_t *endpoint);
+
+/**
+ * @brief Forget the capabilities of the peer, called when its session ends.
+ *
+ * @param endpoint endpoint of the peer (cannot be NULL)
+ */
+void coap_signal_remove_peer(const oc_endpoint_t *endpoint);
+
+/** @brief Forget the capabilities of all peers. */
+void coap_signal_free_all_peers(void);
 #endif /* OC_TCP */
 
 #ifdef __cplusplus
@@ -90,6 +90,17 @@ extern "C" {
  * check client. */
 #define COAP_OBSERVE_REFRESH_INTERVAL 5
 
+/* Number of Block2 requests a client keeps in flight while retrieving a large
+ * representation of known size (at most 32), 1 retrieves the blocks one at a
+ * time. */
+#ifndef COAP_BLOCK2_WINDOW_SIZE
+#define COAP_BLOCK2_WINDOW_SIZE (1)
+#endif /* COAP_BLOCK2_WINDOW_SIZE */
+
+#if COAP_BLOCK2_WINDOW_SIZE < 1 || COAP_BLOCK2_WINDOW_SIZE > 32
+#error "COAP_BLOCK2_WINDOW_SIZE must be in the range 1 to 32"
+#endif
+
 #ifdef __cplusplus
 }
 #endif
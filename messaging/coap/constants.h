@@ -81,6 +81,9 @@ extern "C" {
 #define COAP_TOKEN_LEN 8 /* The maximum number of bytes for the Token */
 #define COAP_ETAG_LEN 8  /* The maximum number of bytes for the ETag */
 
+#define COAP_BERT_SZX 7 /* SZX of BERT blocks over reliable transports */
+#define COAP_BERT_UNIT_SIZE 1024 /* BERT blocks are multiples of this size */
+
 #define COAP_HEADER_VERSION_MASK 0xC0
 #define COAP_HEADER_VERSION_POSITION 6
 #define COAP_HEADER_TYPE_MASK 0x30
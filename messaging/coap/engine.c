@@ -49,7 +49,9 @@
 
 #include "engine.h"
 
+#include "api/oc_admission_internal.h"
 #include "api/oc_buffer_internal.h"
+#include "api/oc_deferred_response_internal.h"
 #include "api/oc_helpers_internal.h"
 #include "api/oc_events.h"
 #include "api/oc_main.h"
@@ -59,6 +61,7 @@
 #include "oc_buffer.h"
 
 #ifdef OC_SECURITY
+#include "security/oc_acl_internal.h"
 #include "security/oc_audit.h"
 #include "security/oc_tls_internal.h"
 #endif /* OC_SECURITY */
@@ -75,6 +78,7 @@
 #include "coap_signal.h"
 #endif
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -158,6 +162,220 @@ coap_audit_log(const oc_message_t *msg)
 }
 #endif /* OC_SECURITY */
 
+#ifdef OC_BLOCK_WISE
+static oc_blockwise_state_t *
+coap_alloc_request_buffer(const coap_packet_t *message, const char *href,
+                          size_t href_len, const oc_endpoint_t *endpoint,
+                          uint32_t buffer_size)
+{
+  oc_method_t method = (oc_method_t)message->code;
+#ifdef OC_SERVER
+  // payloads of authorized updates of resources with a request stream handler
+  // are passed to the handler as they arrive instead of being reassembled
+  const oc_resource_t *resource = NULL;
+  if (method == OC_POST || method == OC_PUT) {
+    resource = oc_ri_get_app_resource_by_uri(href, href_len, endpoint->device);
+  }
+  if (resource != NULL && resource->request_stream_handler.cb != NULL
+#ifdef OC_SECURITY
+      && oc_sec_check_acl(method, resource, endpoint)
+#endif /* OC_SECURITY */
+  ) {
+    oc_blockwise_state_t *request_buffer = oc_blockwise_alloc_request_buffer(
+      href, href_len, endpoint, method, OC_BLOCKWISE_SERVER, 0);
+    if (request_buffer != NULL) {
+      oc_blockwise_set_request_stream(
+        request_buffer, resource->request_stream_handler.cb,
+        resource->request_stream_handler.user_data);
+    }
+    return request_buffer;
+  }
+#endif /* OC_SERVER */
+  return oc_blockwise_alloc_request_buffer(href, href_len, endpoint, method,
+                                           OC_BLOCKWISE_SERVER, buffer_size);
+}
+
+static bool
+coap_handle_request_block(oc_blockwise_state_t *request_buffer,
+                          uint32_t block_offset, const uint8_t *block,
+                          uint32_t block_size, bool last)
+{
+  if (request_buffer->stream.consume != NULL) {
+    return oc_blockwise_handle_stream_block(request_buffer, block_offset,
+                                            block, block_size, last);
+  }
+  return oc_blockwise_handle_block(request_buffer, block_offset, block,
+                                   block_size);
+}
+
+/* The block number of a response is expressed in the block size of the
+ * response, which can be smaller than the one used by the peer (RFC 7959,
+ * section 2.5), or in BERT units. */
+static void
+coap_set_response_block1(coap_packet_t *response, uint32_t block_offset,
+                         uint8_t more, uint16_t block_size, bool bert)
+{
+#ifdef OC_TCP
+  if (bert) {
+    coap_set_header_block1_bert(response, block_offset / COAP_BERT_UNIT_SIZE,
+                                more);
+    return;
+  }
+#else  /* !OC_TCP */
+  (void)bert;
+#endif /* OC_TCP */
+  coap_set_header_block1(response, block_offset / block_size, more,
+                         block_size);
+}
+
+static void
+coap_set_response_block2(coap_packet_t *response, uint32_t block_offset,
+                         uint8_t more, uint16_t block_size, bool bert)
+{
+#ifdef OC_TCP
+  if (bert) {
+    coap_set_header_block2_bert(response, block_offset / COAP_BERT_UNIT_SIZE,
+                                more);
+    return;
+  }
+#else  /* !OC_TCP */
+  (void)bert;
+#endif /* OC_TCP */
+  coap_set_header_block2(response, block_offset / block_size, more,
+                         block_size);
+}
+
+#ifdef OC_TCP
+/* BERT blocks carry as many units as the buffers can hold, but a block with
+ * the header must fit into the Max-Message-Size indicated by the peer. */
+static uint32_t
+coap_bert_block_size(const oc_endpoint_t *endpoint)
+{
+  uint32_t max_msg_size = coap_signal_get_peer_max_msg_size(endpoint);
+  if (max_msg_size >= OC_BLOCKWISE_BERT_BLOCK_SIZE + COAP_MAX_HEADER_SIZE) {
+    return OC_BLOCKWISE_BERT_BLOCK_SIZE;
+  }
+  if (max_msg_size <= COAP_MAX_HEADER_SIZE) {
+    return 0;
+  }
+  return ((max_msg_size - COAP_MAX_HEADER_SIZE) / COAP_BERT_UNIT_SIZE) *
+         COAP_BERT_UNIT_SIZE;
+}
+#endif /* OC_TCP */
+
+/* Messages that start a new exchange within a block-wise transfer keep the
+ * framing of the transport they are sent over. */
+static void
+coap_init_block_message(coap_packet_t *packet, const oc_endpoint_t *endpoint,
+                        uint8_t code, uint16_t mid)
+{
+#ifdef OC_TCP
+  if (endpoint->flags & TCP) {
+    coap_tcp_init_message(packet, code);
+    return;
+  }
+#else  /* !OC_TCP */
+  (void)endpoint;
+#endif /* OC_TCP */
+  coap_udp_init_message(packet, COAP_TYPE_CON, code, mid);
+}
+
+/* Over UDP, the final response of a block-wise transfer is sent as a separate
+ * confirmable response, so the request has to be acknowledged first. */
+static void
+coap_ack_final_block(const coap_packet_t *message,
+                     const oc_endpoint_t *endpoint)
+{
+#ifdef OC_TCP
+  if (endpoint->flags & TCP) {
+    return;
+  }
+#endif /* OC_TCP */
+  if (message->type == COAP_TYPE_CON) {
+    coap_send_empty_response(COAP_TYPE_ACK, message->mid, NULL, 0, 0,
+                             endpoint);
+  }
+}
+
+#ifdef OC_CLIENT
+/* Requests a block of the representation in a separate exchange that carries
+ * the token of the client callback. */
+static bool
+coap_send_block2_request(oc_client_cb_t *client_cb,
+                         const oc_endpoint_t *endpoint, uint32_t block_offset,
+                         uint16_t block_size, uint16_t *mid)
+{
+  uint16_t request_mid = coap_get_mid();
+  coap_transaction_t *t = coap_new_transaction(
+    request_mid, client_cb->token, client_cb->token_len, endpoint);
+  if (t == NULL) {
+    return false;
+  }
+  coap_packet_t request[1];
+  coap_init_block_message(request, endpoint, client_cb->method, request_mid);
+  coap_set_token(request, client_cb->token, client_cb->token_len);
+  coap_set_header_accept(request, APPLICATION_VND_OCF_CBOR);
+  coap_set_header_block2(request, block_offset / block_size, 0, block_size);
+  coap_set_header_uri_path(request, oc_string(client_cb->uri),
+                           oc_string_len(client_cb->uri));
+  if (oc_string_len(client_cb->query) > 0) {
+    coap_set_header_uri_query(request, oc_string(client_cb->query));
+  }
+  t->message->length = coap_serialize_message(request, t->message->data);
+  if (t->message->length == 0) {
+    coap_clear_transaction(t);
+    return false;
+  }
+  *mid = request_mid;
+  coap_send_transaction(t);
+  return true;
+}
+
+/* Keeps the window of Block2 requests full. The request for the first
+ * missing block is repeated if it timed out while the window was ahead of it,
+ * the client callback follows this request so that its timeout ends the
+ * transfer. */
+static void
+coap_fill_block2_window(oc_client_cb_t *client_cb,
+                        oc_blockwise_state_t *response_buffer,
+                        const oc_endpoint_t *endpoint)
+{
+  oc_blockwise_window_t *window =
+    &((oc_blockwise_response_state_t *)response_buffer)->window;
+  size_t head = (response_buffer->next_block_offset / window->block_size) %
+                COAP_BLOCK2_WINDOW_SIZE;
+  bool reliable = false;
+#ifdef OC_TCP
+  reliable = (endpoint->flags & TCP) != 0;
+#endif /* OC_TCP */
+  if (!reliable &&
+      response_buffer->next_block_offset < window->request_offset &&
+      coap_get_transaction_by_mid(window->mids[head]) == NULL) {
+    OC_DBG("requesting block %" PRIu32 " again",
+           response_buffer->next_block_offset / window->block_size);
+    coap_send_block2_request(client_cb, endpoint,
+                             response_buffer->next_block_offset,
+                             window->block_size, &window->mids[head]);
+  }
+  uint32_t block_offset = 0;
+  while (oc_blockwise_window_next_request(
+    response_buffer, COAP_BLOCK2_WINDOW_SIZE, &block_offset)) {
+    size_t index =
+      (block_offset / window->block_size) % COAP_BLOCK2_WINDOW_SIZE;
+    if (!coap_send_block2_request(client_cb, endpoint, block_offset,
+                                  window->block_size, &window->mids[index])) {
+      OC_WRN("could not request block %" PRIu32,
+             block_offset / window->block_size);
+      window->request_offset = block_offset;
+      break;
+    }
+  }
+  client_cb->mid = window->mids[head];
+  response_buffer->mid = client_cb->mid;
+}
+#endif /* OC_CLIENT */
+#endif /* OC_BLOCK_WISE */
+
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -244,6 +462,22 @@ coap_receive(oc_message_t *msg)
 #ifdef OC_BLOCK_WISE
     block1_size = MIN(block1_size, (uint16_t)OC_BLOCK_SIZE);
     block2_size = MIN(block2_size, (uint16_t)OC_BLOCK_SIZE);
+    // BERT blocks carry as many 1024 byte units as the buffers can hold
+    bool block1_bert = false, block2_bert = false;
+    uint32_t block2_len = block2_size;
+#ifdef OC_TCP
+    block1_bert = block1 && coap_header_block1_is_bert(message);
+    block2_bert = block2 && coap_header_block2_is_bert(message);
+    if (block2_bert) {
+      uint32_t bert_len = coap_bert_block_size(&msg->endpoint);
+      if (bert_len > 0) {
+        block2_len = bert_len;
+      } else {
+        // not even a single unit fits into a message of the peer
+        block2_bert = false;
+      }
+    }
+#endif /* OC_TCP */
 #endif /* OC_BLOCK_WISE */
 
 #ifdef OC_TCP
@@ -252,6 +486,9 @@ coap_receive(oc_message_t *msg)
     {
       transaction = coap_get_transaction_by_mid(message->mid);
       if (transaction) {
+        if (message->type == COAP_TYPE_ACK) {
+          coap_transaction_acknowledged(transaction);
+        }
         coap_clear_transaction(transaction);
       }
       transaction = NULL;
@@ -275,12 +512,21 @@ coap_receive(oc_message_t *msg)
         OC_DBG("  method: DELETE");
         break;
       }
-      OC_DBG("  URL: %.*s", (int)message->uri_path_len, message->uri_path);
-      OC_DBG("  QUERY: %.*s", (int)message->uri_query_len, message->uri_query);
-      OC_DBG("  Payload: %.*s", (int)message->payload_len, message->payload);
 #endif /* OC_DBG_IS_ENABLED */
-      const char *href;
+      /* the Uri-Path and Uri-Query segments are merged by the getters */
+      const char *href = NULL;
       size_t href_len = coap_get_header_uri_path(message, &href);
+#ifdef OC_BLOCK_WISE
+      const char *query = NULL;
+      size_t query_len = coap_get_header_uri_query(message, &query);
+#endif /* OC_BLOCK_WISE */
+#if OC_DBG_IS_ENABLED
+      const char *dbg_query = NULL;
+      size_t dbg_query_len = coap_get_header_uri_query(message, &dbg_query);
+      OC_DBG("  URL: %.*s", (int)href_len, href);
+      OC_DBG("  QUERY: %.*s", (int)dbg_query_len, dbg_query);
+      OC_DBG("  Payload: %.*s", (int)message->payload_len, message->payload);
+#endif /* OC_DBG_IS_ENABLED */
 #ifdef OC_TCP
       if (msg->endpoint.flags & TCP) {
         coap_tcp_init_message(response, CONTENT_2_05);
@@ -288,6 +534,12 @@ coap_receive(oc_message_t *msg)
 #endif /* OC_TCP */
       {
         if (message->type == COAP_TYPE_CON) {
+#ifdef OC_SERVER
+          // the response is deferred, the retransmission only needs an ACK
+          if (oc_deferred_response_is_duplicate(message, &msg->endpoint)) {
+            return 0;
+          }
+#endif /* OC_SERVER */
           coap_udp_init_message(response, COAP_TYPE_ACK, CONTENT_2_05,
                                 message->mid);
         } else {
@@ -315,6 +567,15 @@ coap_receive(oc_message_t *msg)
         coap_new_transaction(response->mid, NULL, 0, &msg->endpoint);
 
       if (transaction) {
+        if (!oc_admission_admit_request(&msg->endpoint, href, href_len)) {
+          if ((msg->endpoint.flags & MULTICAST) != 0) {
+            coap_set_global_status_code(CLEAR_TRANSACTION);
+          } else {
+            coap_set_status_code(response, SERVICE_UNAVAILABLE_5_03);
+            coap_set_header_max_age(response, oc_admission_retry_after());
+          }
+          goto send_message;
+        }
 #ifdef OC_BLOCK_WISE
         const uint8_t *incoming_block;
         uint32_t incoming_block_len =
@@ -322,8 +583,8 @@ coap_receive(oc_message_t *msg)
         if (block1) {
           OC_DBG("processing block1 option");
           request_buffer = oc_blockwise_find_request_buffer(
-            href, href_len, &msg->endpoint, message->code, message->uri_query,
-            message->uri_query_len, OC_BLOCKWISE_SERVER);
+            href, href_len, &msg->endpoint, message->code, query, query_len,
+            OC_BLOCKWISE_SERVER);
 
           if (request_buffer && request_buffer->payload_size ==
                                   request_buffer->next_block_offset) {
@@ -346,42 +607,43 @@ coap_receive(oc_message_t *msg)
               buffer_size = OC_MAX_APP_DATA_SIZE;
             }
             OC_DBG("creating new block-wise request buffer");
-            request_buffer = oc_blockwise_alloc_request_buffer(
-              href, href_len, &msg->endpoint, message->code,
-              OC_BLOCKWISE_SERVER, buffer_size);
+            request_buffer = coap_alloc_request_buffer(
+              message, href, href_len, &msg->endpoint, buffer_size);
 
             if (request_buffer) {
-              if (message->uri_query_len > 0) {
-                oc_new_string(&request_buffer->uri_query, message->uri_query,
-                              message->uri_query_len);
+              if (query_len > 0) {
+                oc_new_string(&request_buffer->uri_query, query, query_len);
               }
             }
           }
 
           if (request_buffer) {
             OC_DBG("processing incoming block");
-            if (oc_blockwise_handle_block(
-                  request_buffer, block1_offset, incoming_block,
-                  MIN((uint16_t)incoming_block_len, block1_size))) {
+            // a block larger than the local block size is stored whole, the
+            // response then asks the peer for smaller blocks
+            uint32_t block1_len = incoming_block_len;
+            if (!block1_bert) {
+              block1_len = MIN(block1_len, (uint32_t)message->block1_size);
+            }
+            if (coap_handle_request_block(request_buffer, block1_offset,
+                                          incoming_block, block1_len,
+                                          block1_more == 0)) {
               if (block1_more) {
                 OC_DBG(
                   "more blocks expected; issuing request for the next block");
                 response->code = CONTINUE_2_31;
-                coap_set_header_block1(response, block1_num, block1_more,
-                                       block1_size);
+                coap_set_response_block1(response, block1_offset, block1_more,
+                                         block1_size, block1_bert);
                 request_buffer->ref_count = 1;
                 goto send_message;
               } else {
                 OC_DBG("received all blocks for payload");
-                if (message->type == COAP_TYPE_CON) {
-                  coap_send_empty_response(COAP_TYPE_ACK, message->mid, NULL, 0,
-                                           0, &msg->endpoint);
-                }
-                coap_udp_init_message(response, COAP_TYPE_CON, CONTENT_2_05,
-                                      coap_get_mid());
+                coap_ack_final_block(message, &msg->endpoint);
+                coap_init_block_message(response, &msg->endpoint, CONTENT_2_05,
+                                        coap_get_mid());
                 transaction->mid = response->mid;
-                coap_set_header_block1(response, block1_num, block1_more,
-                                       block1_size);
+                coap_set_response_block1(response, block1_offset, block1_more,
+                                         block1_size, block1_bert);
                 coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
                 request_buffer->payload_size =
                   request_buffer->next_block_offset;
@@ -395,11 +657,11 @@ coap_receive(oc_message_t *msg)
         } else if (block2) {
           OC_DBG("processing block2 option");
           response_buffer = oc_blockwise_find_response_buffer(
-            href, href_len, &msg->endpoint, message->code, message->uri_query,
-            message->uri_query_len, OC_BLOCKWISE_SERVER);
+            href, href_len, &msg->endpoint, message->code, query, query_len,
+            OC_BLOCKWISE_SERVER);
 
           if (response_buffer && (response_buffer->next_block_offset -
-                                  block2_offset) > block2_size) {
+                                  block2_offset) > block2_len) {
             // UDP transfer can duplicate messages and we want to avoid
             // terminate BWT, so we drop the message.
             OC_DBG("dropped message because message was already provided for "
@@ -412,7 +674,7 @@ coap_receive(oc_message_t *msg)
             OC_DBG("continuing ongoing block-wise transfer");
             uint32_t payload_size = 0;
             const void *payload = oc_blockwise_dispatch_block(
-              response_buffer, block2_offset, block2_size, &payload_size);
+              response_buffer, block2_offset, block2_len, &payload_size);
             if (payload) {
               OC_DBG("dispatching next block");
               uint8_t more = (response_buffer->next_block_offset <
@@ -420,27 +682,30 @@ coap_receive(oc_message_t *msg)
                                ? 1
                                : 0;
               if (more == 0) {
-                if (message->type == COAP_TYPE_CON) {
-                  coap_send_empty_response(COAP_TYPE_ACK, message->mid, NULL, 0,
-                                           0, &msg->endpoint);
-                }
-                coap_udp_init_message(response, COAP_TYPE_CON, CONTENT_2_05,
-                                      coap_get_mid());
+                coap_ack_final_block(message, &msg->endpoint);
+                coap_init_block_message(response, &msg->endpoint, CONTENT_2_05,
+                                        coap_get_mid());
                 transaction->mid = response->mid;
                 coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
               }
               coap_set_header_content_format(response,
                                              APPLICATION_VND_OCF_CBOR);
               coap_set_payload(response, payload, payload_size);
-              coap_set_header_block2(response, block2_num, more, block2_size);
+              coap_set_response_block2(response, block2_offset, more,
+                                       block2_size, block2_bert);
               oc_blockwise_response_state_t *response_state =
                 (oc_blockwise_response_state_t *)response_buffer;
               coap_set_header_etag(response, response_state->etag,
                                    COAP_ETAG_LEN);
               response_buffer->ref_count = more;
               goto send_message;
-            } else {
-              OC_ERR("could not dispatch block");
+            }
+            OC_ERR("could not dispatch block");
+            if (response_buffer->stream.produce != NULL) {
+              // the stream cannot continue, the transfer is aborted
+              response_buffer->ref_count = 0;
+              coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+              goto send_message;
             }
           } else {
             OC_DBG("requesting block-wise transfer; creating new block-wise "
@@ -448,9 +713,8 @@ coap_receive(oc_message_t *msg)
             if (block2_num == 0) {
               if (incoming_block_len > 0) {
                 request_buffer = oc_blockwise_find_request_buffer(
-                  href, href_len, &msg->endpoint, message->code,
-                  message->uri_query, message->uri_query_len,
-                  OC_BLOCKWISE_SERVER);
+                  href, href_len, &msg->endpoint, message->code, query,
+                  query_len, OC_BLOCKWISE_SERVER);
                 if (!request_buffer) {
                   if (oc_drop_command(msg->endpoint.device) &&
                       message->code >= COAP_GET &&
@@ -465,19 +729,19 @@ coap_receive(oc_message_t *msg)
                     buffer_size = OC_MAX_APP_DATA_SIZE;
                   }
 
-                  request_buffer = oc_blockwise_alloc_request_buffer(
-                    href, href_len, &msg->endpoint, message->code,
-                    OC_BLOCKWISE_SERVER, buffer_size);
+                  request_buffer = coap_alloc_request_buffer(
+                    message, href, href_len, &msg->endpoint, buffer_size);
 
-                  if (!(request_buffer && oc_blockwise_handle_block(
+                  if (!(request_buffer && coap_handle_request_block(
                                             request_buffer, 0, incoming_block,
-                                            (uint16_t)incoming_block_len))) {
+                                            (uint16_t)incoming_block_len,
+                                            true))) {
                     OC_ERR("could not create buffer to hold request payload");
                     goto init_reset_message;
                   }
-                  if (message->uri_query_len > 0) {
-                    oc_new_string(&request_buffer->uri_query,
-                                  message->uri_query, message->uri_query_len);
+                  if (query_len > 0) {
+                    oc_new_string(&request_buffer->uri_query, query,
+                                  query_len);
                   }
                   request_buffer->payload_size = incoming_block_len;
                 }
@@ -507,9 +771,8 @@ coap_receive(oc_message_t *msg)
             if (incoming_block_len > 0) {
               OC_DBG("creating request buffer");
               request_buffer = oc_blockwise_find_request_buffer(
-                href, href_len, &msg->endpoint, message->code,
-                message->uri_query, message->uri_query_len,
-                OC_BLOCKWISE_SERVER);
+                href, href_len, &msg->endpoint, message->code, query,
+                query_len, OC_BLOCKWISE_SERVER);
 
               if (request_buffer) {
                 oc_blockwise_free_request_buffer(request_buffer);
@@ -520,26 +783,25 @@ coap_receive(oc_message_t *msg)
                   buffer_size == 0) {
                 buffer_size = OC_MAX_APP_DATA_SIZE;
               }
-              request_buffer = oc_blockwise_alloc_request_buffer(
-                href, href_len, &msg->endpoint, message->code,
-                OC_BLOCKWISE_SERVER, buffer_size);
+              request_buffer = coap_alloc_request_buffer(
+                message, href, href_len, &msg->endpoint, buffer_size);
 
               if (!(request_buffer &&
-                    oc_blockwise_handle_block(request_buffer, 0, incoming_block,
-                                              (uint16_t)incoming_block_len))) {
+                    coap_handle_request_block(request_buffer, 0, incoming_block,
+                                              (uint16_t)incoming_block_len,
+                                              true))) {
                 OC_ERR("could not create buffer to hold request payload");
                 goto init_reset_message;
               }
-              if (message->uri_query_len > 0) {
-                oc_new_string(&request_buffer->uri_query, message->uri_query,
-                              message->uri_query_len);
+              if (query_len > 0) {
+                oc_new_string(&request_buffer->uri_query, query, query_len);
               }
               request_buffer->payload_size = incoming_block_len;
               request_buffer->ref_count = 0;
             }
             response_buffer = oc_blockwise_find_response_buffer(
-              href, href_len, &msg->endpoint, message->code, message->uri_query,
-              message->uri_query_len, OC_BLOCKWISE_SERVER);
+              href, href_len, &msg->endpoint, message->code, query, query_len,
+              OC_BLOCKWISE_SERVER);
             if (response_buffer) {
               if ((msg->endpoint.flags & MULTICAST) &&
                   response_buffer->next_block_offset <
@@ -578,7 +840,9 @@ coap_receive(oc_message_t *msg)
 #ifdef OC_BLOCK_WISE
           uint32_t payload_size = 0;
 #ifdef OC_TCP
-          if (msg->endpoint.flags & TCP) {
+          // streamed responses are always sent block by block
+          if ((msg->endpoint.flags & TCP) &&
+              response_buffer->stream.produce == NULL) {
             const void *payload = oc_blockwise_dispatch_block(
               response_buffer, 0, response_buffer->payload_size + 1,
               &payload_size);
@@ -589,16 +853,23 @@ coap_receive(oc_message_t *msg)
           } else {
 #endif /* OC_TCP */
             const void *payload = oc_blockwise_dispatch_block(
-              response_buffer, 0, block2_size, &payload_size);
+              response_buffer, 0, block2_len, &payload_size);
             if (payload) {
               coap_set_payload(response, payload, payload_size);
             }
-            if (block2 || response_buffer->payload_size > block2_size) {
-              coap_set_header_block2(
+            if (payload == NULL && response_buffer->stream.produce != NULL) {
+              OC_ERR("could not dispatch first block of stream");
+              response_buffer->ref_count = 0;
+              coap_set_status_code(response, INTERNAL_SERVER_ERROR_5_00);
+            } else if (block2 || response_buffer->payload_size > block2_len) {
+              coap_set_response_block2(
                 response, 0,
-                (response_buffer->payload_size > block2_size) ? 1 : 0,
-                block2_size);
-              coap_set_header_size2(response, response_buffer->payload_size);
+                (response_buffer->payload_size > block2_len) ? 1 : 0,
+                block2_size, block2_bert);
+              // the size of a streamed payload is not known in advance
+              if (response_buffer->stream.produce == NULL) {
+                coap_set_header_size2(response, response_buffer->payload_size);
+              }
               oc_blockwise_response_state_t *response_state =
                 (oc_blockwise_response_state_t *)response_buffer;
               coap_set_header_etag(response, response_state->etag,
@@ -694,8 +965,8 @@ coap_receive(oc_message_t *msg)
           transaction =
             coap_new_transaction(response_mid, NULL, 0, &msg->endpoint);
           if (transaction) {
-            coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                                  response_mid);
+            coap_init_block_message(response, &msg->endpoint,
+                                    client_cb->method, response_mid);
             uint8_t more =
               (request_buffer->next_block_offset < request_buffer->payload_size)
                 ? 1
@@ -764,22 +1035,82 @@ coap_receive(oc_message_t *msg)
         const uint8_t *incoming_block;
         uint32_t incoming_block_len =
           (uint32_t)coap_get_payload(message, &incoming_block);
+        if (block2 && incoming_block_len > 0) {
+          const uint8_t *etag = NULL;
+          size_t etag_len = (size_t)coap_get_header_etag(message, &etag);
+          if (!oc_blockwise_response_match_etag(response_buffer, block2_offset,
+                                                etag, etag_len)) {
+            if (response_buffer->next_block_offset == 0 && block2_offset != 0) {
+              OC_DBG("dropping block of a previous representation");
+              goto send_message;
+            }
+            if (!oc_blockwise_response_restart(response_buffer)) {
+              // the response buffer is freed together with the client callback
+              oc_ri_free_client_cbs_by_mid_v1(client_cb->mid,
+                                              OC_STATUS_SERVICE_UNAVAILABLE);
+              response_buffer = NULL;
+              goto send_message;
+            }
+            if (block2_offset != 0) {
+              coap_send_block2_request(client_cb, &msg->endpoint, 0,
+                                       block2_size, &client_cb->mid);
+              response_buffer->mid = client_cb->mid;
+              goto send_message;
+            }
+            oc_blockwise_response_match_etag(response_buffer, 0, etag,
+                                             etag_len);
+          }
+        }
+        bool windowed = response_state->window.block_size > 0;
         if (incoming_block_len > 0 &&
-            oc_blockwise_handle_block(response_buffer, block2_offset,
-                                      incoming_block,
-                                      (uint32_t)incoming_block_len)) {
+            (windowed
+               ? oc_blockwise_window_handle_block(response_buffer,
+                                                  block2_offset, incoming_block,
+                                                  incoming_block_len)
+               : oc_blockwise_handle_block(response_buffer, block2_offset,
+                                           incoming_block,
+                                           (uint32_t)incoming_block_len))) {
           OC_DBG("processing incoming block");
-          if (block2 && block2_more) {
+          // representations of known size are retrieved with several
+          // requests in flight
+          uint32_t size2 = 0;
+          if (COAP_BLOCK2_WINDOW_SIZE > 1 && !windowed && block2 &&
+              block2_more && block2_offset == 0 && !block2_bert &&
+              client_cb->method == OC_GET &&
+              response_state->observe_seq == -1 &&
+              coap_get_header_size2(message, &size2) == 1) {
+            windowed =
+              oc_blockwise_window_start(response_buffer, size2, block2_size);
+          }
+          if (windowed) {
+            if (response_buffer->next_block_offset <
+                response_state->window.total_size) {
+              coap_fill_block2_window(client_cb, response_buffer,
+                                      &msg->endpoint);
+              goto send_message;
+            }
+          } else if (block2 && block2_more) {
             OC_DBG("issuing request for next block");
             transaction =
               coap_new_transaction(response_mid, NULL, 0, &msg->endpoint);
             if (transaction) {
-              coap_udp_init_message(response, COAP_TYPE_CON, client_cb->method,
-                                    response_mid);
+              coap_init_block_message(response, &msg->endpoint,
+                                      client_cb->method, response_mid);
               response_buffer->mid = response_mid;
               client_cb->mid = response_mid;
               coap_set_header_accept(response, APPLICATION_VND_OCF_CBOR);
-              coap_set_header_block2(response, block2_num + 1, 0, block2_size);
+#ifdef OC_TCP
+              if (block2_bert) {
+                // a BERT block can span multiple units
+                coap_set_header_block2_bert(
+                  response,
+                  response_buffer->next_block_offset / COAP_BERT_UNIT_SIZE, 0);
+              } else
+#endif /* OC_TCP */
+              {
+                coap_set_header_block2(response, block2_num + 1, 0,
+                                       block2_size);
+              }
               coap_set_header_uri_path(response, oc_string(client_cb->uri),
                                        oc_string_len(client_cb->uri));
               if (oc_string_len(client_cb->query) > 0) {
@@ -80,6 +80,7 @@
 #include "oc_ri.h"
 #include "oc_core_res.h"
 #include "api/oc_server_api_internal.h"
+#include "api/oc_rep_encode_internal.h"
 
 #ifndef OC_MAX_OBSERVE_SIZE
 #define OC_MAX_OBSERVE_SIZE OC_MAX_APP_DATA_SIZE
@@ -638,6 +639,11 @@ coap_notify_collection(oc_collection_t *collection,
   response.response_buffer = &response_buffer;
   request.response = &response;
   request.request_payload = NULL;
+  // notifications might be sent while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  response_buffer.encoder = &encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_rep_new_realloc(&response_buffer.buffer, response_buffer.buffer_size,
                      OC_MAX_OBSERVE_SIZE);
@@ -663,6 +669,7 @@ coap_notify_collection(oc_collection_t *collection,
   coap_notify_collection_observers(collection, &response_buffer, iface_mask);
 
 cleanup:
+  oc_rep_encoder_set_context(prev_encoder_ctx);
 #ifdef OC_DYNAMIC_ALLOCATION
   buffer = response_buffer.buffer;
   if (buffer)
@@ -712,11 +719,18 @@ coap_notify_collections(oc_resource_t *resource)
   response.response_buffer = &response_buffer;
   request.response = &response;
   request.request_payload = NULL;
+  oc_rep_encoder_context_t encoder_ctx;
+  response_buffer.encoder = &encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
 
   for (oc_collection_t *collection =
          oc_get_next_collection_with_link(resource, NULL);
-       collection != NULL && collection->res.num_observers > 0;
+       collection != NULL;
        collection = oc_get_next_collection_with_link(resource, collection)) {
+    if (collection->res.num_observers == 0) {
+      continue;
+    }
     OC_DBG("coap_notify_collections: Issue GET request to collection for "
            "resource");
 
@@ -737,6 +751,7 @@ coap_notify_collections(oc_resource_t *resource)
 #endif
     coap_notify_collection_observers(collection, &response_buffer, OC_IF_B);
   }
+  oc_rep_encoder_set_context(prev_encoder_ctx);
 
 #ifdef OC_DYNAMIC_ALLOCATION
   buffer = response_buffer.buffer;
@@ -781,6 +796,11 @@ fill_response(oc_resource_t *resource, const oc_endpoint_t *endpoint,
   if (iface_mask == 0) {
     iface_mask = resource->default_interface;
   }
+  // notifications might be sent while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  response->response_buffer->encoder = &encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
 #ifdef OC_DYNAMIC_ALLOCATION
   oc_rep_new_realloc(&response->response_buffer->buffer,
                      response->response_buffer->buffer_size,
@@ -798,6 +818,8 @@ fill_response(oc_resource_t *resource, const oc_endpoint_t *endpoint,
 #ifdef OC_DYNAMIC_ALLOCATION
   response->response_buffer->buffer_size = oc_rep_get_encoded_payload_size();
 #endif /* OC_DYNAMIC_ALLOCATION */
+  oc_rep_encoder_set_context(prev_encoder_ctx);
+  response->response_buffer->encoder = NULL;
   if (response->response_buffer->code == OC_IGNORE) {
     OC_DBG("fill_response: Resource ignored request");
     return false;
@@ -992,12 +1014,12 @@ dispatch_process_batch_observers(void)
 }
 
 static void
-create_batch_for_removed_resource(CborEncoder *links_array,
+create_batch_for_removed_resource(CborEncoder *links_encoder,
                                   batch_observer_t *batch_obs)
 {
   OC_DBG("create_batch_for_removed_resource: resource %s",
          oc_string(batch_obs->removed_resource_uri));
-  oc_rep_start_object((links_array), links);
+  oc_rep_start_object((links_encoder), links);
   char href[OC_MAX_OCF_URI_SIZE];
   memcpy(href, "ocf://", 6);
   oc_uuid_to_str(oc_core_get_device_id(batch_obs->obs->resource->device),
@@ -1012,20 +1034,20 @@ create_batch_for_removed_resource(CborEncoder *links_array,
   oc_rep_start_root_object();
   oc_rep_end_root_object();
   memcpy(&links_map, oc_rep_get_encoder(), sizeof(CborEncoder));
-  oc_rep_end_object((links_array), links);
+  oc_rep_end_object((links_encoder), links);
 }
 
 static void
-create_batch_for_batch_observer(CborEncoder *links_array,
+create_batch_for_batch_observer(CborEncoder *links_encoder,
                                 batch_observer_t *batch_obs,
                                 oc_endpoint_t *endpoint)
 {
   if (batch_obs->resource) {
-    oc_discovery_create_batch_for_resource(links_array, batch_obs->resource,
+    oc_discovery_create_batch_for_resource(links_encoder, batch_obs->resource,
                                            endpoint);
     return;
   }
-  create_batch_for_removed_resource(links_array, batch_obs);
+  create_batch_for_removed_resource(links_encoder, batch_obs);
 }
 
 static oc_event_callback_retval_t
@@ -1320,14 +1342,15 @@ coap_observe_handler(void *request, void *response, oc_resource_t *resource,
   if (coap_req->code == COAP_GET && coap_res->code < 128) {
     if (IS_OPTION(coap_req, COAP_OPTION_OBSERVE)) {
       if (coap_req->observe == 0) {
+        const char *uri = NULL;
+        size_t uri_len = coap_get_header_uri_path(coap_req, &uri);
         dup =
 #ifdef OC_BLOCK_WISE
           add_observer(resource, block2_size, endpoint, coap_req->token,
-                       coap_req->token_len, coap_req->uri_path,
-                       coap_req->uri_path_len, iface_mask);
+                       coap_req->token_len, uri, uri_len, iface_mask);
 #else  /* OC_BLOCK_WISE */
           add_observer(resource, endpoint, coap_req->token, coap_req->token_len,
-                       coap_req->uri_path, coap_req->uri_path_len, iface_mask);
+                       uri, uri_len, iface_mask);
 #endif /* !OC_BLOCK_WISE */
       } else if (coap_req->observe == 1) {
         dup = coap_remove_observer_by_token(endpoint, coap_req->token,
@@ -46,6 +46,10 @@ struct oc_response_buffer_s
   size_t response_length;
   int code;
   oc_content_format_t content_format;
+  oc_rep_encoder_context_t *encoder; ///< context encoding the payload
+  oc_deferred_response_t *deferred;  ///< response deferred by the handler
+  oc_response_stream_cb_t stream_cb; ///< producer of a streamed payload
+  void *stream_data;
 };
 
 #ifdef __cplusplus
@@ -125,6 +125,7 @@ coap_separate_accept(const coap_packet_t *request,
     memcpy(separate_store->token, request->token, request->token_len);
     separate_store->token_len = request->token_len;
 
+    /* the Uri-Path segments were merged when the request was dispatched */
     oc_new_string(&separate_store->uri, request->uri_path,
                   request->uri_path_len);
 
@@ -49,6 +49,7 @@
 
 #include "transactions.h"
 #include "api/oc_main.h"
+#include "messaging/coap/coap_congestion_internal.h"
 #include "observe.h"
 #include "oc_buffer.h"
 #include "util/oc_list.h"
@@ -72,6 +73,7 @@ OC_MEMB(transactions_memb, coap_transaction_t, COAP_MAX_OPEN_TRANSACTIONS);
 OC_LIST(transactions_list);
 
 static struct oc_process *transaction_handler_process = NULL;
+static bool g_send_queued_transactions = true;
 
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
@@ -116,6 +118,59 @@ coap_new_transaction(uint16_t mid, uint8_t *token, uint8_t token_len,
 }
 
 /*---------------------------------------------------------------------------*/
+/* Start a new Confirmable exchange, the transaction is queued instead if the
+ * peer has NSTART outstanding exchanges. */
+static bool
+transaction_start_exchange(coap_transaction_t *t)
+{
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  t->peer = coap_congestion_get_peer(&t->message->endpoint, true);
+  if (t->peer == NULL) {
+    t->retrans_timer.timer.interval =
+      COAP_RESPONSE_TIMEOUT_TICKS +
+      (oc_random_value() % (oc_clock_time_t)COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
+    t->backoff = 4;
+  } else {
+    if (!coap_congestion_can_send(t->peer)) {
+      OC_DBG("Queueing transaction %u: %p", t->mid, (void *)t);
+      t->queued = true;
+      ++t->peer->queued;
+      t->sent = now;
+      // bounds the wait for a free slot
+      t->retrans_timer.timer.interval = COAP_CONGESTION_MAX_QUEUE_WAIT;
+      OC_PROCESS_CONTEXT_BEGIN(transaction_handler_process);
+      oc_etimer_restart(&t->retrans_timer);
+      OC_PROCESS_CONTEXT_END(transaction_handler_process);
+      return false;
+    }
+    ++t->peer->outstanding;
+    t->retrans_timer.timer.interval =
+      coap_congestion_initial_timeout(t->peer, now, &t->backoff);
+  }
+  t->sent = now;
+  OC_DBG("Initial interval %d", (int)t->retrans_timer.timer.interval);
+  return true;
+}
+
+static void
+transaction_send_queued(coap_congestion_peer_t *peer)
+{
+  while (peer->queued > 0 && coap_congestion_can_send(peer)) {
+    coap_transaction_t *t =
+      (coap_transaction_t *)oc_list_head(transactions_list);
+    while (t != NULL && (!t->queued || t->peer != peer)) {
+      t = t->next;
+    }
+    if (t == NULL) {
+      return;
+    }
+    t->queued = false;
+    t->peer = NULL;
+    --peer->queued;
+    coap_send_transaction(t);
+  }
+}
+
 void
 coap_send_transaction(coap_transaction_t *t)
 {
@@ -143,14 +198,16 @@ coap_send_transaction(coap_transaction_t *t)
       OC_DBG("Keeping transaction %u: %p", t->mid, (void *)t);
 
       if (t->retrans_counter == 0) {
-        t->retrans_timer.timer.interval =
-          COAP_RESPONSE_TIMEOUT_TICKS +
-          (oc_random_value() %
-           (oc_clock_time_t)COAP_RESPONSE_TIMEOUT_BACKOFF_MASK);
-        OC_DBG("Initial interval %d", (int)t->retrans_timer.timer.interval);
+        if (!transaction_start_exchange(t)) {
+          return;
+        }
       } else {
-        t->retrans_timer.timer.interval <<= 1; /* double */
-        OC_DBG("Doubled %d", (int)t->retrans_timer.timer.interval);
+        t->retrans_timer.timer.interval =
+          coap_congestion_backoff(t->retrans_timer.timer.interval, t->backoff);
+        if (t->peer != NULL) {
+          ++t->peer->retransmissions;
+        }
+        OC_DBG("Backed off %d", (int)t->retrans_timer.timer.interval);
       }
 
       OC_PROCESS_CONTEXT_BEGIN(transaction_handler_process);
@@ -202,12 +259,34 @@ coap_clear_transaction(coap_transaction_t *t)
   if (t) {
     OC_DBG("Freeing transaction %u: %p", t->mid, (void *)t);
 
+    coap_congestion_peer_t *peer = t->peer;
+    bool outstanding = peer != NULL && !t->queued;
+    if (peer != NULL) {
+      if (t->queued) {
+        --peer->queued;
+      } else {
+        --peer->outstanding;
+      }
+    }
     oc_etimer_stop(&t->retrans_timer);
     oc_message_unref(t->message);
     oc_list_remove(transactions_list, t);
     oc_memb_free(&transactions_memb, t);
+    if (outstanding && g_send_queued_transactions) {
+      transaction_send_queued(peer);
+    }
   }
 }
+
+void
+coap_transaction_acknowledged(const coap_transaction_t *t)
+{
+  if (t->peer == NULL || t->queued) {
+    return;
+  }
+  oc_clock_time_t now = oc_clock_time_monotonic();
+  coap_congestion_rtt_sample(t->peer, now - t->sent, t->retrans_counter, now);
+}
 coap_transaction_t *
 coap_get_transaction_by_mid(uint16_t mid)
 {
@@ -237,6 +316,20 @@ coap_get_transaction_by_token(uint8_t *token, uint8_t token_len)
   }
   return NULL;
 }
+/* The queued transaction didn't get a free NSTART slot in time. */
+static void
+transaction_queue_timeout(coap_transaction_t *t)
+{
+  OC_WRN("Queued transaction %u timed out", t->mid);
+  int removed = oc_list_length(transactions_list);
+#ifdef OC_CLIENT
+  oc_ri_free_client_cbs_by_mid_v1(t->mid, OC_TRANSACTION_TIMEOUT);
+#endif /* OC_CLIENT */
+  if (removed == oc_list_length(transactions_list)) {
+    coap_clear_transaction(t);
+  }
+}
+
 /*---------------------------------------------------------------------------*/
 void
 coap_check_transactions(void)
@@ -245,7 +338,13 @@ coap_check_transactions(void)
                      *next;
   while (t != NULL) {
     next = t->next;
-    if (oc_etimer_expired(&t->retrans_timer)) {
+    if (t->queued && oc_etimer_expired(&t->retrans_timer)) {
+      transaction_queue_timeout(t);
+      // the list might have changed
+      t = (coap_transaction_t *)oc_list_head(transactions_list);
+      continue;
+    }
+    if (!t->queued && oc_etimer_expired(&t->retrans_timer)) {
       ++(t->retrans_counter);
       OC_DBG("Retransmitting %u (%u)", t->mid, t->retrans_counter);
       int removed = oc_list_length(transactions_list);
@@ -262,6 +361,7 @@ coap_check_transactions(void)
 void
 coap_free_all_transactions(void)
 {
+  g_send_queued_transactions = false;
   coap_transaction_t *t = (coap_transaction_t *)oc_list_head(transactions_list),
                      *next;
   while (t != NULL) {
@@ -269,6 +369,8 @@ coap_free_all_transactions(void)
     coap_clear_transaction(t);
     t = next;
   }
+  g_send_queued_transactions = true;
+  coap_congestion_free_all();
 }
 
 void
@@ -279,6 +381,8 @@ coap_free_transactions_by_endpoint(const oc_endpoint_t *endpoint,
 #ifndef OC_CLIENT
   (void)code;
 #endif /* !OC_CLIENT */
+  // don't send queued messages to the endpoint that is being cleaned up
+  g_send_queued_transactions = false;
   coap_transaction_t *t = (coap_transaction_t *)oc_list_head(transactions_list);
   while (t != NULL) {
     coap_transaction_t *next = t->next;
@@ -296,4 +400,10 @@ coap_free_transactions_by_endpoint(const oc_endpoint_t *endpoint,
     }
     t = next;
   }
+  g_send_queued_transactions = true;
+  // send messages queued by the client callbacks
+  coap_congestion_peer_t *peer = coap_congestion_get_peer(endpoint, false);
+  if (peer != NULL) {
+    transaction_send_queued(peer);
+  }
 }
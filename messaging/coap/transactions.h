@@ -82,6 +82,11 @@ typedef struct coap_transaction
   uint8_t retrans_counter;
   oc_message_t *message;
 
+  struct coap_congestion_peer_t *peer; ///< set for outstanding or queued
+                                       ///< Confirmable messages
+  oc_clock_time_t sent; ///< time of the first transmission or of queueing
+  uint8_t backoff; ///< backoff factor of the retransmission timeout in halves
+  bool queued;     ///< waiting for the peer to accept another message
 } coap_transaction_t;
 
 void coap_register_as_transaction_handler(void);
@@ -92,6 +97,13 @@ coap_transaction_t *coap_new_transaction(uint16_t mid, uint8_t *token,
 
 void coap_send_transaction(coap_transaction_t *t);
 void coap_clear_transaction(coap_transaction_t *t);
+
+/**
+ * @brief Update the RTO estimation of the peer with the round-trip time of the
+ * transaction acknowledged by a received ACK. The transaction must be cleared
+ * afterwards.
+ */
+void coap_transaction_acknowledged(const coap_transaction_t *t);
 coap_transaction_t *coap_get_transaction_by_mid(uint16_t mid);
 coap_transaction_t *coap_get_transaction_by_token(uint8_t *token,
                                                   uint8_t token_len);
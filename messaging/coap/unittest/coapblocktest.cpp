@@ -0,0 +1,108 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "coap.h"
+
+#include <array>
+#include <gtest/gtest.h>
+
+class TestCoapBlock : public testing::Test {
+protected:
+  std::array<uint8_t, 256> buffer_{};
+};
+
+TEST_F(TestCoapBlock, Block2UDP)
+{
+  coap_packet_t packet{};
+  coap_udp_init_message(&packet, COAP_TYPE_CON, COAP_GET, 1);
+  ASSERT_EQ(1, coap_set_header_block2(&packet, 3, 1, 512));
+  size_t len = coap_serialize_message(&packet, buffer_.data());
+  ASSERT_LT(0U, len);
+
+  coap_packet_t parsed{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&parsed, buffer_.data(), len, false));
+  uint32_t num = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  uint32_t offset = 0;
+  ASSERT_EQ(1, coap_get_header_block2(&parsed, &num, &more, &size, &offset));
+  EXPECT_EQ(3U, num);
+  EXPECT_EQ(1, more);
+  EXPECT_EQ(512, size);
+  EXPECT_EQ(3U * 512U, offset);
+}
+
+#ifdef OC_TCP
+
+TEST_F(TestCoapBlock, Block2BERT)
+{
+  coap_packet_t packet{};
+  coap_tcp_init_message(&packet, CONTENT_2_05);
+  ASSERT_EQ(1, coap_set_header_block2_bert(&packet, 7, 1));
+  EXPECT_TRUE(coap_header_block2_is_bert(&packet));
+  size_t len = coap_serialize_message(&packet, buffer_.data());
+  ASSERT_LT(0U, len);
+
+  coap_packet_t parsed{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_tcp_parse_message(&parsed, buffer_.data(), len, false));
+  EXPECT_TRUE(coap_header_block2_is_bert(&parsed));
+  uint32_t num = 0;
+  uint8_t more = 0;
+  uint16_t size = 0;
+  uint32_t offset = 0;
+  ASSERT_EQ(1, coap_get_header_block2(&parsed, &num, &more, &size, &offset));
+  EXPECT_EQ(7U, num);
+  EXPECT_EQ(1, more);
+  EXPECT_EQ(COAP_BERT_UNIT_SIZE, size);
+  EXPECT_EQ(7U * COAP_BERT_UNIT_SIZE, offset);
+}
+
+TEST_F(TestCoapBlock, Block1BERT)
+{
+  coap_packet_t packet{};
+  coap_tcp_init_message(&packet, COAP_POST);
+  ASSERT_EQ(1, coap_set_header_block1_bert(&packet, 2, 0));
+  size_t len = coap_serialize_message(&packet, buffer_.data());
+  ASSERT_LT(0U, len);
+
+  coap_packet_t parsed{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_tcp_parse_message(&parsed, buffer_.data(), len, false));
+  EXPECT_TRUE(coap_header_block1_is_bert(&parsed));
+  uint32_t offset = 0;
+  ASSERT_EQ(1, coap_get_header_block1(&parsed, nullptr, nullptr, nullptr,
+                                      &offset));
+  EXPECT_EQ(2U * COAP_BERT_UNIT_SIZE, offset);
+}
+
+TEST_F(TestCoapBlock, BERTOnlyOverTCP)
+{
+  coap_packet_t packet{};
+  coap_udp_init_message(&packet, COAP_TYPE_CON, COAP_GET, 1);
+  EXPECT_EQ(0, coap_set_header_block2_bert(&packet, 1, 0));
+
+  // a regular block option resets the BERT flag
+  coap_tcp_init_message(&packet, CONTENT_2_05);
+  ASSERT_EQ(1, coap_set_header_block2_bert(&packet, 1, 0));
+  ASSERT_EQ(1, coap_set_header_block2(&packet, 1, 0, 1024));
+  EXPECT_FALSE(coap_header_block2_is_bert(&packet));
+}
+
+#endif /* OC_TCP */
@@ -0,0 +1,168 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "messaging/coap/coap_congestion_internal.h"
+#include "oc_congestion.h"
+#include "tests/gtest/Endpoint.h"
+
+#include <gtest/gtest.h>
+#include <string>
+
+class TestCoapCongestion : public testing::Test {
+protected:
+  void TearDown() override
+  {
+    oc_congestion_set_nstart(COAP_DEFAULT_NSTART);
+    coap_congestion_free_all();
+  }
+
+  static coap_congestion_peer_t *Peer(const std::string &ep)
+  {
+    oc_endpoint_t endpoint = oc::endpoint::FromString(ep);
+    return coap_congestion_get_peer(&endpoint, true);
+  }
+};
+
+TEST_F(TestCoapCongestion, DefaultTimeout)
+{
+  coap_congestion_peer_t *peer = Peer("coap://[ff02::158]:5683");
+  ASSERT_NE(nullptr, peer);
+  EXPECT_EQ(COAP_CONGESTION_DEFAULT_RTO, peer->rto);
+
+  uint8_t backoff = 0;
+  oc_clock_time_t timeout =
+    coap_congestion_initial_timeout(peer, peer->updated, &backoff);
+  EXPECT_LE(COAP_CONGESTION_DEFAULT_RTO, timeout);
+  EXPECT_GE(COAP_CONGESTION_DEFAULT_RTO * 3 / 2, timeout);
+  EXPECT_EQ(4, backoff);
+}
+
+TEST_F(TestCoapCongestion, StrongSample)
+{
+  coap_congestion_peer_t *peer = Peer("coap://10.0.0.1:5683");
+  ASSERT_NE(nullptr, peer);
+  oc_clock_time_t now = peer->updated;
+  oc_clock_time_t rtt = OC_CLOCK_SECOND / 10;
+  for (int i = 0; i < 10; ++i) {
+    coap_congestion_rtt_sample(peer, rtt, 0, now);
+  }
+  EXPECT_EQ(10, peer->strong_samples);
+  EXPECT_EQ(0, peer->weak_samples);
+  EXPECT_GT(COAP_CONGESTION_DEFAULT_RTO, peer->rto);
+  EXPECT_LT(peer->rto_strong, peer->rto);
+
+  // a small RTO gets a large backoff factor
+  uint8_t backoff = 0;
+  coap_congestion_initial_timeout(peer, now, &backoff);
+  EXPECT_EQ(6, backoff);
+}
+
+TEST_F(TestCoapCongestion, WeakSample)
+{
+  coap_congestion_peer_t *peer = Peer("coap://10.0.0.1:5683");
+  ASSERT_NE(nullptr, peer);
+  oc_clock_time_t now = peer->updated;
+  coap_congestion_rtt_sample(peer, 10 * OC_CLOCK_SECOND, 1, now);
+  EXPECT_EQ(1, peer->weak_samples);
+  EXPECT_LT(COAP_CONGESTION_DEFAULT_RTO, peer->rto);
+  EXPECT_GT(peer->rto_weak, peer->rto);
+
+  // samples of exchanges with more than 2 retransmissions are ignored
+  oc_clock_time_t rto = peer->rto;
+  coap_congestion_rtt_sample(peer, 30 * OC_CLOCK_SECOND, 3, now);
+  EXPECT_EQ(1, peer->weak_samples);
+  EXPECT_EQ(rto, peer->rto);
+}
+
+TEST_F(TestCoapCongestion, AgeRTO)
+{
+  coap_congestion_peer_t *peer = Peer("coap://10.0.0.1:5683");
+  ASSERT_NE(nullptr, peer);
+  oc_clock_time_t now = peer->updated;
+  peer->rto = OC_CLOCK_SECOND / 2;
+  uint8_t backoff = 0;
+  coap_congestion_initial_timeout(peer, now + 16 * OC_CLOCK_SECOND, &backoff);
+  EXPECT_EQ(OC_CLOCK_SECOND, peer->rto);
+
+  peer->rto = 10 * OC_CLOCK_SECOND;
+  coap_congestion_initial_timeout(peer, peer->updated + 50 * OC_CLOCK_SECOND,
+                                  &backoff);
+  EXPECT_EQ(6 * OC_CLOCK_SECOND, peer->rto);
+  EXPECT_EQ(3, backoff);
+}
+
+TEST_F(TestCoapCongestion, Backoff)
+{
+  EXPECT_EQ(4 * OC_CLOCK_SECOND,
+            coap_congestion_backoff(2 * OC_CLOCK_SECOND, 4));
+  EXPECT_EQ(3 * OC_CLOCK_SECOND,
+            coap_congestion_backoff(2 * OC_CLOCK_SECOND, 3));
+  EXPECT_EQ(COAP_CONGESTION_MAX_RTO,
+            coap_congestion_backoff(50 * OC_CLOCK_SECOND, 4));
+}
+
+TEST_F(TestCoapCongestion, NStart)
+{
+  coap_congestion_peer_t *peer = Peer("coap://10.0.0.1:5683");
+  ASSERT_NE(nullptr, peer);
+  // not limited by default
+  EXPECT_EQ(0, oc_congestion_get_nstart());
+  peer->outstanding = 1;
+  EXPECT_TRUE(coap_congestion_can_send(peer));
+  oc_congestion_set_nstart(1);
+  peer->outstanding = 0;
+  EXPECT_TRUE(coap_congestion_can_send(peer));
+  peer->outstanding = 1;
+  EXPECT_FALSE(coap_congestion_can_send(peer));
+  oc_congestion_set_nstart(2);
+  EXPECT_TRUE(coap_congestion_can_send(peer));
+  oc_congestion_set_nstart(0);
+  peer->outstanding = 100;
+  EXPECT_TRUE(coap_congestion_can_send(peer));
+  peer->outstanding = 0;
+}
+
+TEST_F(TestCoapCongestion, Stats)
+{
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  oc_congestion_stats_t stats{};
+  EXPECT_FALSE(oc_congestion_get_stats(&ep, &stats));
+  coap_congestion_peer_t *peer = coap_congestion_get_peer(&ep, true);
+  ASSERT_NE(nullptr, peer);
+  coap_congestion_rtt_sample(peer, OC_CLOCK_SECOND, 0, peer->updated);
+  ASSERT_TRUE(oc_congestion_get_stats(&ep, &stats));
+  EXPECT_EQ(peer->rto, stats.rto);
+  EXPECT_EQ(peer->rto_strong, stats.rto_strong);
+  EXPECT_EQ(1, stats.strong_samples);
+  EXPECT_EQ(0, stats.outstanding);
+}
+
+TEST_F(TestCoapCongestion, Evict)
+{
+  coap_congestion_peer_t *busy = Peer("coap://10.0.0.1:5683");
+  ASSERT_NE(nullptr, busy);
+  busy->outstanding = 1;
+  for (int i = 0; i < COAP_CONGESTION_MAX_PEERS; ++i) {
+    EXPECT_NE(nullptr,
+              Peer("coap://10.0.1." + std::to_string(i + 1) + ":5683"));
+  }
+  // the busy peer is never forgotten
+  oc_endpoint_t ep = oc::endpoint::FromString("coap://10.0.0.1:5683");
+  EXPECT_EQ(busy, coap_congestion_get_peer(&ep, false));
+  busy->outstanding = 0;
+}
@@ -0,0 +1,189 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "coap.h"
+
+#include <array>
+#include <gtest/gtest.h>
+#include <string>
+
+class TestCoapParse : public testing::Test {
+protected:
+  size_t SerializeGet()
+  {
+    coap_packet_t packet{};
+    coap_udp_init_message(&packet, COAP_TYPE_CON, COAP_GET, 42);
+    coap_set_token(&packet, kToken.data(), kToken.size());
+    coap_set_header_uri_path(&packet, kPath.c_str(), kPath.length());
+    coap_set_header_uri_query(&packet, kQuery.c_str());
+    coap_set_header_accept(&packet, APPLICATION_VND_OCF_CBOR);
+    coap_set_header_observe(&packet, 0);
+    coap_set_payload(&packet, kPayload.c_str(), kPayload.length());
+    return coap_serialize_message(&packet, buffer_.data());
+  }
+
+  static const std::array<uint8_t, 4> kToken;
+  static const std::string kPath;
+  static const std::string kQuery;
+  static const std::string kPayload;
+  std::array<uint8_t, 256> buffer_{};
+};
+
+const std::array<uint8_t, 4> TestCoapParse::kToken{ 1, 2, 3, 4 };
+const std::string TestCoapParse::kPath{ "oic/res" };
+const std::string TestCoapParse::kQuery{ "if=oic.if.ll" };
+const std::string TestCoapParse::kPayload{ "payload" };
+
+TEST_F(TestCoapParse, ValidateOptions)
+{
+  size_t len = SerializeGet();
+  ASSERT_LT(0U, len);
+  size_t options_offset = COAP_HEADER_LEN + kToken.size();
+  EXPECT_EQ(COAP_NO_ERROR,
+            coap_validate_options(buffer_.data(), len, options_offset));
+  // without the payload
+  EXPECT_EQ(COAP_NO_ERROR,
+            coap_validate_options(buffer_.data(), len - kPayload.length() - 1,
+                                  options_offset));
+}
+
+TEST_F(TestCoapParse, ValidateMalformedOptions)
+{
+  size_t len = SerializeGet();
+  ASSERT_LT(0U, len);
+  size_t options_offset = COAP_HEADER_LEN + kToken.size();
+
+  // the first option does not fit into the message
+  EXPECT_EQ(BAD_REQUEST_4_00,
+            coap_validate_options(buffer_.data(), options_offset + 2,
+                                  options_offset));
+  // the extended option length is missing
+  std::array<uint8_t, 2> extended{ 0x1D, 0x00 };
+  EXPECT_EQ(BAD_REQUEST_4_00, coap_validate_options(extended.data(), 1, 0));
+  // length 15 is reserved
+  std::array<uint8_t, 1> reserved{ 0x1F };
+  EXPECT_EQ(BAD_REQUEST_4_00,
+            coap_validate_options(reserved.data(), reserved.size(), 0));
+  // the options start past the end of the message
+  EXPECT_EQ(BAD_REQUEST_4_00, coap_validate_options(buffer_.data(), 2, 3));
+}
+
+TEST_F(TestCoapParse, ValidateUDP)
+{
+  size_t len = SerializeGet();
+  ASSERT_LT(0U, len);
+
+  coap_packet_t packet{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&packet, buffer_.data(), len, true));
+  EXPECT_EQ(COAP_GET, packet.code);
+  EXPECT_EQ(42, packet.mid);
+
+  // validation only checks the structure of the message
+  coap_packet_t unsupported{};
+  coap_udp_init_message(&unsupported, COAP_TYPE_CON, COAP_POST, 1);
+  coap_set_header_content_format(&unsupported, TEXT_PLAIN);
+  size_t unsupported_len =
+    coap_serialize_message(&unsupported, buffer_.data());
+  ASSERT_LT(0U, unsupported_len);
+  EXPECT_EQ(COAP_NO_ERROR, coap_udp_parse_message(&packet, buffer_.data(),
+                                                  unsupported_len, true));
+  EXPECT_EQ(UNSUPPORTED_MEDIA_TYPE_4_15,
+            coap_udp_parse_message(&packet, buffer_.data(), unsupported_len,
+                                   false));
+
+  len = SerializeGet();
+  for (size_t truncated : { static_cast<size_t>(COAP_HEADER_LEN - 1),
+                            static_cast<size_t>(COAP_HEADER_LEN + 2) }) {
+    EXPECT_EQ(BAD_REQUEST_4_00,
+              coap_udp_parse_message(&packet, buffer_.data(), truncated, true));
+    EXPECT_EQ(BAD_REQUEST_4_00, coap_udp_parse_message(
+                                  &packet, buffer_.data(), truncated, false));
+  }
+}
+
+TEST_F(TestCoapParse, ParseUDP)
+{
+  size_t len = SerializeGet();
+  ASSERT_LT(0U, len);
+
+  coap_packet_t packet{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&packet, buffer_.data(), len, false));
+  const char *path = nullptr;
+  ASSERT_EQ(kPath.length(), coap_get_header_uri_path(&packet, &path));
+  EXPECT_EQ(kPath, std::string(path, kPath.length()));
+  const char *query = nullptr;
+  ASSERT_EQ(kQuery.length(), coap_get_header_uri_query(&packet, &query));
+  EXPECT_EQ(kQuery, std::string(query, kQuery.length()));
+  uint32_t observe = 1;
+  EXPECT_EQ(1, coap_get_header_observe(&packet, &observe));
+  EXPECT_EQ(0U, observe);
+}
+
+TEST_F(TestCoapParse, MergeUriOnDemand)
+{
+  size_t len = SerializeGet();
+  ASSERT_LT(0U, len);
+
+  coap_packet_t packet{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&packet, buffer_.data(), len, false));
+  // the parse only records the first segment
+  EXPECT_EQ(2U, packet.uri_path_count);
+  EXPECT_EQ(std::string("oic"),
+            std::string(packet.uri_path, packet.uri_path_len));
+
+  const char *path = nullptr;
+  ASSERT_EQ(kPath.length(), coap_get_header_uri_path(&packet, &path));
+  EXPECT_EQ(kPath, std::string(path, kPath.length()));
+  EXPECT_EQ(1U, packet.uri_path_count);
+  // merging again is a no-op
+  ASSERT_EQ(kPath.length(), coap_get_header_uri_path(&packet, &path));
+  EXPECT_EQ(kPath, std::string(path, kPath.length()));
+}
+
+TEST_F(TestCoapParse, SerializeParsed)
+{
+  coap_packet_t packet{};
+  coap_udp_init_message(&packet, COAP_TYPE_NON, COAP_GET, 1);
+  std::string query = "if=oic.if.baseline&rt=oic.wk.res";
+  coap_set_header_uri_path(&packet, kPath.c_str(), kPath.length());
+  coap_set_header_uri_query(&packet, query.c_str());
+  size_t len = coap_serialize_message(&packet, buffer_.data());
+  ASSERT_LT(0U, len);
+
+  // the segments of a parsed message are merged before it is serialized
+  coap_packet_t parsed{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&parsed, buffer_.data(), len, false));
+  EXPECT_EQ(2U, parsed.uri_query_count);
+  std::array<uint8_t, 256> message{};
+  len = coap_serialize_message(&parsed, message.data());
+  ASSERT_LT(0U, len);
+
+  coap_packet_t reparsed{};
+  ASSERT_EQ(COAP_NO_ERROR,
+            coap_udp_parse_message(&reparsed, message.data(), len, false));
+  const char *path = nullptr;
+  ASSERT_EQ(kPath.length(), coap_get_header_uri_path(&reparsed, &path));
+  EXPECT_EQ(kPath, std::string(path, kPath.length()));
+  const char *value = nullptr;
+  ASSERT_EQ(query.length(), coap_get_header_uri_query(&reparsed, &value));
+  EXPECT_EQ(query, std::string(value, query.length()));
+}
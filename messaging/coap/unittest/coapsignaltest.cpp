@@ -723,4 +723,29 @@ TEST_F(TestCoapSignal, SignalSerializeParseTest_ABORT)
   ASSERT_STREQ(diagnostic, (char *)parse_packet.payload);
 }
 
+TEST_F(TestCoapSignal, PeerMaxMsgSize)
+{
+  // a peer that has not sent a CSM message gets the default
+  EXPECT_EQ(static_cast<uint32_t>(COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE),
+            coap_signal_get_peer_max_msg_size(target_ep));
+
+  coap_packet_t packet{};
+  coap_tcp_init_message(&packet, CSM_7_01);
+  coap_signal_set_max_msg_size(&packet, 4096);
+  EXPECT_EQ(COAP_NO_ERROR, handle_coap_signal_message(&packet, target_ep));
+  EXPECT_EQ(4096U, coap_signal_get_peer_max_msg_size(target_ep));
+
+  // a CSM message without the option resets the size to the default
+  coap_tcp_init_message(&packet, CSM_7_01);
+  EXPECT_EQ(COAP_NO_ERROR, handle_coap_signal_message(&packet, target_ep));
+  EXPECT_EQ(static_cast<uint32_t>(COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE),
+            coap_signal_get_peer_max_msg_size(target_ep));
+
+  coap_signal_set_max_msg_size(&packet, 2048);
+  EXPECT_EQ(COAP_NO_ERROR, handle_coap_signal_message(&packet, target_ep));
+  coap_signal_remove_peer(target_ep);
+  EXPECT_EQ(static_cast<uint32_t>(COAP_SIGNAL_DEFAULT_MAX_MSG_SIZE),
+            coap_signal_get_peer_max_msg_size(target_ep));
+}
+
 #endif /* OC_TCP && IPV4 */
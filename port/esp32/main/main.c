@@ -278,6 +278,7 @@ factory_presets_cb_new(size_t device, void *data)
   oc_device_info_t *dev = oc_core_get_device_info(device);
   oc_free_string(&dev->name);
   oc_new_string(&dev->name, device_name, strlen(device_name));
+  oc_core_device_info_changed(device);
   (void)data;
 #if defined(OC_SECURITY) && defined(OC_PKI)
   PRINT("factory_presets_cb: %d\n", (int)device);
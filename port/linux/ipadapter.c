@@ -1060,12 +1060,17 @@ receive:
 static int
 process_socket_write_event(fd_set *wfds)
 {
+#ifdef OC_TCP
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
-  return tcp_process_waiting_sessions(wfds) ? 1 : 0;
-#else  /* !OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+  if (tcp_process_waiting_sessions(wfds)) {
+    return 1;
+  }
+#endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+  return tcp_process_send_queues(wfds) ? 1 : 0;
+#else  /* !OC_TCP */
   (void)wfds;
   return 0;
-#endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+#endif /* OC_TCP */
 }
 
 static int
@@ -1177,9 +1182,11 @@ network_event_thread(void *data)
     struct timeval *timeout = NULL;
     fd_set rdfds = ip_context_rfds_fd_copy(dev);
     fd_set *wfds = NULL;
-#ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
+#ifdef OC_TCP
     fd_set write_fds = tcp_context_cfds_fd_copy(&dev->tcp);
     wfds = &write_fds;
+#endif /* OC_TCP */
+#ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
     struct timeval tv;
     if (expires_in > 0) {
       tv = to_timeval(expires_in);
@@ -18,12 +18,14 @@
 
 #include "oc_config.h"
 
-#ifdef OC_STORAGE
+#if defined(OC_STORAGE) && !defined(OC_STORAGE_KV)
 #include "port/oc_assert.h"
 #include "port/oc_log_internal.h"
 #include "port/oc_storage.h"
 #include "port/oc_storage_internal.h"
+#include "storage_sync.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -31,6 +33,8 @@
 #include <unistd.h>
 
 #define STORE_PATH_SIZE 64
+#define STORE_TMP_SUFFIX ".tmp"
+#define STORE_TMP_SUFFIX_LEN (sizeof(STORE_TMP_SUFFIX) - 1)
 
 static char g_store_path[STORE_PATH_SIZE] = { 0 };
 static size_t g_store_path_len = 0;
@@ -110,7 +114,8 @@ long
 oc_storage_write(const char *store, const uint8_t *buf, size_t size)
 {
   size_t store_len = strlen(store);
-  if (!g_path_set || (store_len + g_store_path_len >= STORE_PATH_SIZE)) {
+  if (!g_path_set || (1 + store_len + g_store_path_len + STORE_TMP_SUFFIX_LEN >=
+                      STORE_PATH_SIZE)) {
     return -ENOENT;
   }
 
@@ -118,8 +123,15 @@ oc_storage_write(const char *store, const uint8_t *buf, size_t size)
   memcpy(g_store_path + g_store_path_len + 1, store, store_len);
   g_store_path[1 + g_store_path_len + store_len] = '\0';
 
+  // write to a temporary file and atomically replace the store with it, so
+  // that a crash in the middle of the write cannot leave a corrupted store
+  char tmp_path[STORE_PATH_SIZE];
+  memcpy(tmp_path, g_store_path, 1 + g_store_path_len + store_len);
+  memcpy(tmp_path + 1 + g_store_path_len + store_len, STORE_TMP_SUFFIX,
+         STORE_TMP_SUFFIX_LEN + 1);
+
   while (true) {
-    FILE *fp = fopen(g_store_path, "wb");
+    FILE *fp = fopen(tmp_path, "wb");
     if (!fp) {
       return -EINVAL;
     }
@@ -131,7 +143,22 @@ oc_storage_write(const char *store, const uint8_t *buf, size_t size)
     if (ret < 0 && (ret == -EAGAIN || ret == -EINTR)) {
       continue;
     }
+    if (ret < 0) {
+      unlink(tmp_path);
+      return ret;
+    }
+    if (rename(tmp_path, g_store_path) != 0) {
+      ret = -errno;
+      OC_ERR("failed to replace storage file(%ld)", ret);
+      unlink(tmp_path);
+      return ret;
+    }
+    int err = oc_storage_sync_parent_directory(g_store_path);
+    if (err != 0) {
+      OC_ERR("failed to sync storage directory(%d)", err);
+      return err;
+    }
     return ret;
   }
 }
-#endif /* OC_STORAGE */
+#endif /* OC_STORAGE && !OC_STORAGE_KV */
@@ -0,0 +1,570 @@
+/****************************************************************************
+ *
+ * Copyright 2023 Daniel Adam, All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+/*
+ * Single-file key-value storage backend.
+ *
+ * All stores are kept in one memory-mapped file (${store}/oc_storage.kv). The
+ * file is an append-only log of records, each record holds the name of the
+ * store, its value and a CRC-32 checksum. The last valid record of a store
+ * holds its current value. On open the log is scanned, the in-memory index is
+ * rebuilt and a torn record at the end (crash during write) is discarded.
+ * When the file runs out of space it is either compacted (only live records
+ * are copied to a new file which atomically replaces the old one) or grown.
+ */
+
+#include "oc_config.h"
+
+#if defined(OC_STORAGE) && defined(OC_STORAGE_KV)
+
+#include "port/oc_log_internal.h"
+#include "port/oc_storage.h"
+#include "port/oc_storage_internal.h"
+#include "storage_sync.h"
+#include "util/oc_hash.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STORE_PATH_SIZE 64
+#define STORE_KV_FILE "/oc_storage.kv"
+#define STORE_KV_FILE_LEN (sizeof(STORE_KV_FILE) - 1)
+#define STORE_KV_TMP_SUFFIX ".tmp"
+#define STORE_KV_TMP_SUFFIX_LEN (sizeof(STORE_KV_TMP_SUFFIX) - 1)
+
+#define STORE_KV_FILE_MAGIC (0x564b434fu) /* "OCKV" */
+#define STORE_KV_RECORD_MAGIC (0x4345524bu) /* "KREC" */
+#define STORE_KV_VERSION (1)
+#define STORE_KV_ALIGN (8)
+#define STORE_KV_INITIAL_SIZE (16 * 1024)
+#define STORE_KV_KEY_MAX (STORE_PATH_SIZE)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+} store_kv_file_header_t;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t crc;
+  uint16_t key_len;
+  uint16_t reserved;
+  uint32_t value_len;
+} store_kv_record_header_t;
+
+typedef struct store_kv_entry_t
+{
+  struct store_kv_entry_t *next;
+  size_t offset; ///< offset of the record in the file
+  size_t size;   ///< aligned size of the whole record
+  uint32_t hash; ///< hash of the key
+  size_t key_len;
+  char key[STORE_KV_KEY_MAX];
+} store_kv_entry_t;
+
+typedef struct
+{
+  char path[STORE_PATH_SIZE];
+  bool path_set;
+  int fd;
+  uint8_t *data;
+  size_t capacity;
+  size_t end;        ///< append offset
+  size_t live_bytes; ///< size of records that are referenced by the index
+  size_t sync_from;  ///< start of data not yet synced in the current batch
+  bool batch;
+  store_kv_entry_t *entries;
+} store_kv_t;
+
+static store_kv_t g_kv = { .fd = -1 };
+
+static uint32_t
+store_kv_crc32(uint32_t crc, const uint8_t *data, size_t size)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; ++k) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+  }
+  return ~crc;
+}
+
+static size_t
+store_kv_align(size_t size)
+{
+  return (size + (STORE_KV_ALIGN - 1)) & ~((size_t)STORE_KV_ALIGN - 1);
+}
+
+static size_t
+store_kv_record_size(size_t key_len, size_t value_len)
+{
+  return store_kv_align(sizeof(store_kv_record_header_t) + key_len +
+                        value_len);
+}
+
+static store_kv_entry_t *
+store_kv_find(const char *key, size_t key_len, uint32_t hash)
+{
+  for (store_kv_entry_t *e = g_kv.entries; e != NULL; e = e->next) {
+    if (e->hash == hash && e->key_len == key_len &&
+        memcmp(e->key, key, key_len) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+static void
+store_kv_free_entries(void)
+{
+  while (g_kv.entries != NULL) {
+    store_kv_entry_t *next = g_kv.entries->next;
+    free(g_kv.entries);
+    g_kv.entries = next;
+  }
+  g_kv.live_bytes = 0;
+}
+
+static bool
+store_kv_index(const char *key, size_t key_len, size_t offset, size_t size)
+{
+  uint32_t hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, key, key_len);
+  store_kv_entry_t *e = store_kv_find(key, key_len, hash);
+  if (e == NULL) {
+    e = (store_kv_entry_t *)calloc(1, sizeof(store_kv_entry_t));
+    if (e == NULL) {
+      OC_ERR("oc_storage_kv: cannot allocate index entry");
+      return false;
+    }
+    memcpy(e->key, key, key_len);
+    e->key[key_len] = '\0';
+    e->key_len = key_len;
+    e->hash = hash;
+    e->next = g_kv.entries;
+    g_kv.entries = e;
+  } else {
+    g_kv.live_bytes -= e->size;
+  }
+  e->offset = offset;
+  e->size = size;
+  g_kv.live_bytes += size;
+  return true;
+}
+
+static const store_kv_record_header_t *
+store_kv_record_at(size_t offset)
+{
+  if (offset + sizeof(store_kv_record_header_t) > g_kv.capacity) {
+    return NULL;
+  }
+  const store_kv_record_header_t *rec =
+    (const store_kv_record_header_t *)(g_kv.data + offset);
+  if (rec->magic != STORE_KV_RECORD_MAGIC || rec->key_len == 0 ||
+      rec->key_len >= STORE_KV_KEY_MAX ||
+      offset + store_kv_record_size(rec->key_len, rec->value_len) >
+        g_kv.capacity) {
+    return NULL;
+  }
+  const uint8_t *payload = (const uint8_t *)(rec + 1);
+  if (store_kv_crc32(0, payload, (size_t)rec->key_len + rec->value_len) !=
+      rec->crc) {
+    return NULL;
+  }
+  return rec;
+}
+
+static int
+store_kv_scan(void)
+{
+  store_kv_free_entries();
+  size_t offset = sizeof(store_kv_file_header_t);
+  const store_kv_record_header_t *rec;
+  while ((rec = store_kv_record_at(offset)) != NULL) {
+    size_t size = store_kv_record_size(rec->key_len, rec->value_len);
+    if (!store_kv_index((const char *)(rec + 1), rec->key_len, offset, size)) {
+      return -ENOMEM;
+    }
+    offset += size;
+  }
+  if (offset + sizeof(store_kv_record_header_t) <= g_kv.capacity &&
+      ((const store_kv_record_header_t *)(g_kv.data + offset))->magic != 0) {
+    OC_WRN("oc_storage_kv: discarding torn record at offset %zu", offset);
+    memset(g_kv.data + offset, 0, sizeof(store_kv_record_header_t));
+  }
+  g_kv.end = offset;
+  g_kv.sync_from = offset;
+  return 0;
+}
+
+static void
+store_kv_unmap(void)
+{
+  if (g_kv.data != NULL) {
+    munmap(g_kv.data, g_kv.capacity);
+    g_kv.data = NULL;
+  }
+  if (g_kv.fd >= 0) {
+    close(g_kv.fd);
+    g_kv.fd = -1;
+  }
+  g_kv.capacity = 0;
+  g_kv.end = 0;
+  g_kv.sync_from = 0;
+}
+
+static int
+store_kv_map(size_t capacity)
+{
+  void *data =
+    mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, g_kv.fd, 0);
+  if (data == MAP_FAILED) {
+    int ret = -errno;
+    OC_ERR("oc_storage_kv: cannot map file(%d)", ret);
+    return ret;
+  }
+  g_kv.data = (uint8_t *)data;
+  g_kv.capacity = capacity;
+  return 0;
+}
+
+static int
+store_kv_gen_path(char *path, const char *suffix, size_t suffix_len)
+{
+  size_t path_len = strlen(g_kv.path);
+  if (path_len + STORE_KV_FILE_LEN + suffix_len >= STORE_PATH_SIZE) {
+    return -ENOENT;
+  }
+  memcpy(path, g_kv.path, path_len);
+  memcpy(path + path_len, STORE_KV_FILE, STORE_KV_FILE_LEN);
+  memcpy(path + path_len + STORE_KV_FILE_LEN, suffix, suffix_len);
+  path[path_len + STORE_KV_FILE_LEN + suffix_len] = '\0';
+  return 0;
+}
+
+static int
+store_kv_open(void)
+{
+  if (g_kv.data != NULL) {
+    return 0;
+  }
+  if (!g_kv.path_set) {
+    return -ENOENT;
+  }
+  char path[STORE_PATH_SIZE];
+  if (store_kv_gen_path(path, "", 0) != 0) {
+    return -ENOENT;
+  }
+  g_kv.fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (g_kv.fd < 0) {
+    return -EINVAL;
+  }
+  struct stat st;
+  if (fstat(g_kv.fd, &st) != 0) {
+    int ret = -errno;
+    store_kv_unmap();
+    return ret;
+  }
+  size_t capacity = (size_t)st.st_size;
+  bool init = capacity < sizeof(store_kv_file_header_t);
+  if (init) {
+    capacity = STORE_KV_INITIAL_SIZE;
+    if (ftruncate(g_kv.fd, (off_t)capacity) != 0) {
+      int ret = -errno;
+      store_kv_unmap();
+      return ret;
+    }
+  }
+  int ret = store_kv_map(capacity);
+  if (ret != 0) {
+    store_kv_unmap();
+    return ret;
+  }
+
+  store_kv_file_header_t *hdr = (store_kv_file_header_t *)g_kv.data;
+  if (init || hdr->magic != STORE_KV_FILE_MAGIC) {
+    if (!init) {
+      OC_WRN("oc_storage_kv: invalid file header, reinitializing storage");
+    }
+    memset(g_kv.data, 0, g_kv.capacity);
+    hdr->magic = STORE_KV_FILE_MAGIC;
+    hdr->version = STORE_KV_VERSION;
+    msync(g_kv.data, g_kv.capacity, MS_SYNC);
+  } else if (hdr->version != STORE_KV_VERSION) {
+    OC_ERR("oc_storage_kv: unsupported version(%u)", (unsigned)hdr->version);
+    store_kv_unmap();
+    return -EINVAL;
+  }
+  ret = store_kv_scan();
+  if (ret != 0) {
+    store_kv_unmap();
+    store_kv_free_entries();
+  }
+  return ret;
+}
+
+static void
+store_kv_close(void)
+{
+  store_kv_unmap();
+  store_kv_free_entries();
+  g_kv.batch = false;
+}
+
+static int
+store_kv_sync(size_t from, size_t to)
+{
+  if (to <= from) {
+    return 0;
+  }
+  long page = sysconf(_SC_PAGESIZE);
+  size_t start = from & ~((size_t)page - 1);
+  if (msync(g_kv.data + start, to - start, MS_SYNC) != 0) {
+    int ret = -errno;
+    OC_ERR("oc_storage_kv: failed to sync file(%d)", ret);
+    return ret;
+  }
+  return 0;
+}
+
+/* Copy all live records to a new file of the given capacity and atomically
+ * replace the current file with it. */
+static int
+store_kv_compact(size_t capacity)
+{
+  char tmp_path[STORE_PATH_SIZE];
+  char path[STORE_PATH_SIZE];
+  if (store_kv_gen_path(tmp_path, STORE_KV_TMP_SUFFIX,
+                        STORE_KV_TMP_SUFFIX_LEN) != 0 ||
+      store_kv_gen_path(path, "", 0) != 0) {
+    return -ENOENT;
+  }
+  int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return -EINVAL;
+  }
+  int ret = 0;
+  if (ftruncate(fd, (off_t)capacity) != 0) {
+    ret = -errno;
+    goto error;
+  }
+  store_kv_file_header_t hdr = { STORE_KV_FILE_MAGIC, STORE_KV_VERSION };
+  if (pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+    ret = -EIO;
+    goto error;
+  }
+  off_t offset = (off_t)sizeof(hdr);
+  for (const store_kv_entry_t *e = g_kv.entries; e != NULL; e = e->next) {
+    if (pwrite(fd, g_kv.data + e->offset, e->size, offset) !=
+        (ssize_t)e->size) {
+      ret = -EIO;
+      goto error;
+    }
+    offset += (off_t)e->size;
+  }
+  if (fsync(fd) != 0 || rename(tmp_path, path) != 0) {
+    ret = -errno;
+    goto error;
+  }
+  ret = oc_storage_sync_parent_directory(path);
+  if (ret != 0) {
+    // the new file already replaced the old one, keep using it
+    OC_ERR("oc_storage_kv: failed to sync directory(%d)", ret);
+  }
+  OC_DBG("oc_storage_kv: compacted %zu bytes to %zu bytes", g_kv.end,
+         (size_t)offset);
+
+  store_kv_unmap();
+  g_kv.fd = fd;
+  ret = store_kv_map(capacity);
+  if (ret != 0) {
+    store_kv_close();
+    return ret;
+  }
+  ret = store_kv_scan();
+  if (ret != 0) {
+    store_kv_close();
+  }
+  return ret;
+
+error:
+  close(fd);
+  unlink(tmp_path);
+  return ret;
+}
+
+static int
+store_kv_reserve(size_t size)
+{
+  if (g_kv.end + size <= g_kv.capacity) {
+    return 0;
+  }
+  // flush the pending batch, compaction and growth both require the data to
+  // be on disk
+  int ret = store_kv_sync(g_kv.sync_from, g_kv.end);
+  if (ret != 0) {
+    return ret;
+  }
+  g_kv.sync_from = g_kv.end;
+
+  size_t needed =
+    sizeof(store_kv_file_header_t) + g_kv.live_bytes + size + size;
+  size_t capacity = g_kv.capacity;
+  while (capacity < needed) {
+    capacity *= 2;
+  }
+  return store_kv_compact(capacity);
+}
+
+int
+oc_storage_config(const char *store)
+{
+  size_t store_len = strlen(store);
+  if (store_len >= STORE_PATH_SIZE) {
+    return -ENOENT;
+  }
+  store_kv_close();
+  memcpy(g_kv.path, store, store_len);
+  g_kv.path[store_len] = '\0';
+  g_kv.path_set = true;
+  return 0;
+}
+
+int
+oc_storage_reset(void)
+{
+  store_kv_close();
+  g_kv.path_set = false;
+  g_kv.path[0] = '\0';
+  return 0;
+}
+
+long
+oc_storage_read_view(const char *store, const uint8_t **data)
+{
+  if (store_kv_open() != 0) {
+    return -ENOENT;
+  }
+  size_t key_len = strlen(store);
+  const store_kv_entry_t *e = store_kv_find(
+    store, key_len, oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, store, key_len));
+  if (e == NULL) {
+    return -EINVAL;
+  }
+  const store_kv_record_header_t *rec =
+    (const store_kv_record_header_t *)(g_kv.data + e->offset);
+  *data = (const uint8_t *)(rec + 1) + rec->key_len;
+  return (long)rec->value_len;
+}
+
+long
+oc_storage_read(const char *store, uint8_t *buf, size_t size)
+{
+  const uint8_t *data = NULL;
+  long ret = oc_storage_read_view(store, &data);
+  if (ret < 0) {
+    return ret;
+  }
+  if ((size_t)ret < size) {
+    size = (size_t)ret;
+  }
+  memcpy(buf, data, size);
+  return (long)size;
+}
+
+long
+oc_storage_write(const char *store, const uint8_t *buf, size_t size)
+{
+  size_t key_len = strlen(store);
+  if (key_len == 0 || key_len >= STORE_KV_KEY_MAX || size > UINT32_MAX ||
+      store_kv_open() != 0) {
+    return -ENOENT;
+  }
+  size_t rec_size = store_kv_record_size(key_len, size);
+  int ret = store_kv_reserve(rec_size);
+  if (ret != 0) {
+    return ret;
+  }
+
+  size_t offset = g_kv.end;
+  store_kv_record_header_t *rec =
+    (store_kv_record_header_t *)(g_kv.data + offset);
+  uint8_t *payload = (uint8_t *)(rec + 1);
+  memcpy(payload, store, key_len);
+  memcpy(payload + key_len, buf, size);
+  memset(payload + key_len + size, 0,
+         rec_size - sizeof(store_kv_record_header_t) - key_len - size);
+  rec->key_len = (uint16_t)key_len;
+  rec->reserved = 0;
+  rec->value_len = (uint32_t)size;
+  rec->crc = store_kv_crc32(0, payload, key_len + size);
+  rec->magic = STORE_KV_RECORD_MAGIC;
+  g_kv.end += rec_size;
+
+  if (!g_kv.batch) {
+    ret = store_kv_sync(g_kv.sync_from, g_kv.end);
+    if (ret != 0) {
+      return ret;
+    }
+    g_kv.sync_from = g_kv.end;
+  }
+  if (!store_kv_index(store, key_len, offset, rec_size)) {
+    return -ENOMEM;
+  }
+  return (long)size;
+}
+
+int
+oc_storage_batch_begin(void)
+{
+  if (store_kv_open() != 0) {
+    return -ENOENT;
+  }
+  g_kv.batch = true;
+  return 0;
+}
+
+int
+oc_storage_batch_commit(void)
+{
+  if (!g_kv.batch) {
+    return 0;
+  }
+  g_kv.batch = false;
+  if (g_kv.data == NULL) {
+    return -ENOENT;
+  }
+  int ret = store_kv_sync(g_kv.sync_from, g_kv.end);
+  if (ret == 0) {
+    g_kv.sync_from = g_kv.end;
+  }
+  return ret;
+}
+
+#endif /* OC_STORAGE && OC_STORAGE_KV */
@@ -0,0 +1,60 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#include "oc_config.h"
+
+#ifdef OC_STORAGE
+
+#include "storage_sync.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+int
+oc_storage_sync_parent_directory(const char *path)
+{
+  char dir[PATH_MAX];
+  const char *sep = strrchr(path, '/');
+  size_t dir_len = sep != NULL ? (size_t)(sep - path) : 0;
+  if (dir_len >= sizeof(dir)) {
+    return -ENAMETOOLONG;
+  }
+  if (dir_len == 0) {
+    dir[0] = sep != NULL ? '/' : '.';
+    dir_len = 1;
+  } else {
+    memcpy(dir, path, dir_len);
+  }
+  dir[dir_len] = '\0';
+
+  int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return -errno;
+  }
+  int ret = 0;
+  if (fsync(fd) != 0) {
+    ret = -errno;
+  }
+  close(fd);
+  return ret;
+}
+
+#endif /* OC_STORAGE */
@@ -0,0 +1,40 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifndef STORAGE_SYNC_H
+#define STORAGE_SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Sync the directory containing the file, which makes a rename of the
+ * file durable.
+ *
+ * @param path path of the file (cannot be NULL)
+ * @return 0 on success
+ * @return <0 negated errno on failure
+ */
+int oc_storage_sync_parent_directory(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STORAGE_SYNC_H */
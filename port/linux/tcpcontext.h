@@ -52,12 +52,13 @@ typedef struct tcp_context_t
 #endif /* OC_IPV4 */
   int connect_pipe[2];
   pthread_mutex_t cfds_mutex;
-  fd_set cfds; ///< set of tcp sockets waiting for connection
+  fd_set cfds; ///< set of tcp sockets waiting for connection or with queued
+               ///< messages to write
 } tcp_context_t;
 
 /**
- * Set a given file descriptor to a set of descriptors waiting for connect
- * (dev->cfds) under the mutex(cfds_mutex).
+ * Set a given file descriptor to a set of descriptors waiting for connect or
+ * for writing (dev->cfds) under the mutex(cfds_mutex).
  *
  * @param[in] dev the device tcp context.
  * @param[in] sockfd the file descriptor.
@@ -25,6 +25,7 @@
 #include "port/oc_assert.h"
 #include "port/oc_connectivity_internal.h"
 #include "util/oc_features.h"
+#include "util/oc_hash.h"
 #include "util/oc_memb.h"
 #include "ipadapter.h"
 #include "ipcontext.h"
@@ -39,6 +40,7 @@
 #include <ifaddrs.h>
 #include <net/if.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef OC_TCP
@@ -48,13 +50,49 @@
 #define DEFAULT_RECEIVE_SIZE                                                   \
   (COAP_TCP_DEFAULT_HEADER_LEN + COAP_TCP_MAX_EXTENDED_LENGTH_LEN)
 
+/* Number of buckets of the hash indexes of sessions by endpoint and by socket,
+ * must be a power of two. */
+#ifndef OC_TCP_SESSION_INDEX_SIZE
+#define OC_TCP_SESSION_INDEX_SIZE (64)
+#endif /* OC_TCP_SESSION_INDEX_SIZE */
+
+/* Maximal number of messages queued for writing or for opening of
+ * a connection in static builds. */
+#ifndef OC_MAX_TCP_QUEUED_MESSAGES
+#define OC_MAX_TCP_QUEUED_MESSAGES (4 * OC_MAX_TCP_PEERS)
+#endif /* OC_MAX_TCP_QUEUED_MESSAGES */
+
+/* Maximal number of queued messages written by a single sendmsg call. */
+#define TCP_SEND_IOV_MAX (16)
+
+typedef struct queued_message_t
+{
+  struct queued_message_t *next;
+  oc_message_t *message;
+  oc_clock_time_t timestamp; // timestamp of when the message was queued
+  size_t offset;             // number of already written bytes
+} queued_message_t;
+
+OC_MEMB(g_queued_message_s, queued_message_t,
+        OC_MAX_TCP_QUEUED_MESSAGES); // guarded by g_mutex
+
 typedef struct tcp_session_t
 {
   struct tcp_session_t *next;
+  struct tcp_session_t *endpoint_next; ///< next session in the endpoint bucket
+  struct tcp_session_t *fd_next;       ///< next session in the socket bucket
+  struct tcp_session_t *ready_next;    ///< next session ready to be read
   ip_context_t *dev;
   oc_endpoint_t endpoint;
   int sock;
   tcp_csm_state_t csm_state;
+  bool ready; ///< the session is in the list of sessions ready to be read
+  bool congested; ///< the send queue reached the high watermark and it has not
+                  ///< been written down to the low watermark yet
+  bool blocked;   ///< a message was refused since the last notification about
+                  ///< the drained send queue
+  OC_LIST_STRUCT(send_queue); ///< messages waiting to be written
+  size_t send_queue_size;     ///< number of queued bytes not yet written
 } tcp_session_t;
 
 static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -63,21 +101,34 @@ OC_LIST(
   g_free_session_list_async); ///< sessions to be closed; guarded by g_mutex
 OC_MEMB(g_tcp_session_s, tcp_session_t, OC_MAX_TCP_PEERS);
 
-#ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
+/* opened sessions indexed by endpoint and by socket; guarded by g_mutex */
+static tcp_session_t *g_session_by_endpoint[OC_TCP_SESSION_INDEX_SIZE];
+static tcp_session_t *g_session_by_fd[OC_TCP_SESSION_INDEX_SIZE];
+static int g_session_fd_max = -1; ///< upper bound of the opened sockets
+/* opened sessions with a socket in the last read set that have not been read
+ * yet; guarded by g_mutex */
+static tcp_session_t *g_ready_sessions;
 
-typedef struct queued_message_t
+static struct
 {
-  struct queued_message_t *next;
-  oc_message_t *message;
-  oc_clock_time_t timestamp; // timestamp of when the message was queued
-} queued_message_t;
+  size_t low;
+  size_t high;
+} g_send_queue_watermarks = {
+  .low = OC_TCP_SEND_QUEUE_LOW_WATERMARK,
+  .high = OC_TCP_SEND_QUEUE_HIGH_WATERMARK,
+}; // guarded by g_mutex
+/* a message was refused because the pool of queued messages was empty;
+ * guarded by g_mutex */
+static bool g_queued_messages_exhausted;
 
-OC_MEMB(g_queued_message_s, queued_message_t,
-        OC_MAX_TCP_PEERS); // guarded by g_mutex
+#ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
 
 typedef struct tcp_waiting_session_t
 {
   struct tcp_waiting_session_t *next;
+  struct tcp_waiting_session_t
+    *endpoint_next;                     ///< next session in the endpoint bucket
+  struct tcp_waiting_session_t *fd_next; ///< next session in the socket bucket
   ip_context_t *dev;
   oc_endpoint_t endpoint;
   int sock;
@@ -100,6 +151,13 @@ OC_LIST(g_free_waiting_session_list_async); ///< waiting sessions to be closed,
 OC_MEMB(g_tcp_waiting_session_s, tcp_waiting_session_t,
         OC_MAX_TCP_PEERS); ///< guarded by g_mutex
 
+/* waiting sessions indexed by endpoint and by socket; guarded by g_mutex */
+static tcp_waiting_session_t
+  *g_waiting_session_by_endpoint[OC_TCP_SESSION_INDEX_SIZE];
+static tcp_waiting_session_t
+  *g_waiting_session_by_fd[OC_TCP_SESSION_INDEX_SIZE];
+static int g_waiting_session_fd_max = -1; ///< upper bound of the sockets
+
 static oc_tcp_connect_retry_t g_connect_retry = {
   .max_count = OC_TCP_CONNECT_RETRY_MAX_COUNT,
   .timeout = OC_TCP_CONNECT_RETRY_TIMEOUT,
@@ -117,6 +175,115 @@ signal_network_thread(const tcp_context_t *tcp)
   } while (len < 0 && errno == EINTR);
 }
 
+/* hashes the fields compared by oc_endpoint_compare */
+static size_t
+tcp_hash_endpoint(const oc_endpoint_t *endpoint)
+{
+  uint32_t hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, &endpoint->device,
+                                sizeof(endpoint->device));
+  if ((endpoint->flags & IPV6) != 0) {
+    hash = oc_hash_fnv1a(hash, endpoint->addr.ipv6.address,
+                         sizeof(endpoint->addr.ipv6.address));
+    hash = oc_hash_fnv1a(hash, &endpoint->addr.ipv6.port,
+                         sizeof(endpoint->addr.ipv6.port));
+  }
+#ifdef OC_IPV4
+  else if ((endpoint->flags & IPV4) != 0) {
+    hash = oc_hash_fnv1a(hash, endpoint->addr.ipv4.address,
+                         sizeof(endpoint->addr.ipv4.address));
+    hash = oc_hash_fnv1a(hash, &endpoint->addr.ipv4.port,
+                         sizeof(endpoint->addr.ipv4.port));
+  }
+#endif /* OC_IPV4 */
+  return hash & (OC_TCP_SESSION_INDEX_SIZE - 1);
+}
+
+/* sockets are small consecutive numbers, so they are used as the hash */
+static size_t
+tcp_hash_fd(int sock)
+{
+  return (size_t)sock & (OC_TCP_SESSION_INDEX_SIZE - 1);
+}
+
+static void
+session_index_add_locked(tcp_session_t *session)
+{
+  size_t b = tcp_hash_endpoint(&session->endpoint);
+  session->endpoint_next = g_session_by_endpoint[b];
+  g_session_by_endpoint[b] = session;
+  b = tcp_hash_fd(session->sock);
+  session->fd_next = g_session_by_fd[b];
+  g_session_by_fd[b] = session;
+  if (session->sock > g_session_fd_max) {
+    g_session_fd_max = session->sock;
+  }
+  session->ready = false;
+}
+
+static void
+session_index_remove_locked(tcp_session_t *session)
+{
+  tcp_session_t **s =
+    &g_session_by_endpoint[tcp_hash_endpoint(&session->endpoint)];
+  for (; *s != NULL; s = &(*s)->endpoint_next) {
+    if (*s == session) {
+      *s = session->endpoint_next;
+      break;
+    }
+  }
+  for (s = &g_session_by_fd[tcp_hash_fd(session->sock)]; *s != NULL;
+       s = &(*s)->fd_next) {
+    if (*s == session) {
+      *s = session->fd_next;
+      break;
+    }
+  }
+  if (session->ready) {
+    for (s = &g_ready_sessions; *s != NULL; s = &(*s)->ready_next) {
+      if (*s == session) {
+        *s = session->ready_next;
+        break;
+      }
+    }
+    session->ready = false;
+  }
+}
+
+static void
+session_list_add_locked(tcp_session_t *session)
+{
+  oc_list_add(g_session_list, session);
+  session_index_add_locked(session);
+}
+
+static void
+session_list_remove_locked(tcp_session_t *session)
+{
+  oc_list_remove(g_session_list, session);
+  session_index_remove_locked(session);
+  if (session->sock < g_session_fd_max) {
+    return;
+  }
+  // the session had the highest socket, find the next one
+  g_session_fd_max = -1;
+  for (const tcp_session_t *s = (tcp_session_t *)oc_list_head(g_session_list);
+       s != NULL; s = s->next) {
+    if (s->sock > g_session_fd_max) {
+      g_session_fd_max = s->sock;
+    }
+  }
+}
+
+static tcp_session_t *
+find_session_by_fd_locked(int sock)
+{
+  tcp_session_t *session = g_session_by_fd[tcp_hash_fd(sock)];
+  while (session != NULL && session->sock != sock) {
+    session = session->fd_next;
+  }
+  return session;
+}
+
 static bool
 is_matching_address(const struct sockaddr *first, const struct sockaddr *second)
 {
@@ -196,7 +363,7 @@ connect_session_locked(tcp_session_t *session, tcp_csm_state_t state,
   session->csm_state = state;
   session->endpoint.interface_index = iface_index;
 
-  oc_list_add(g_session_list, session);
+  session_list_add_locked(session);
 
   if ((session->endpoint.flags & SECURED) == 0) {
     oc_session_start_event(&session->endpoint);
@@ -218,6 +385,10 @@ add_new_session_locked(int sock, ip_context_t *dev, oc_endpoint_t *endpoint,
   memcpy(&session->endpoint, endpoint, sizeof(oc_endpoint_t));
   session->endpoint.next = NULL;
   session->sock = sock;
+  session->congested = false;
+  session->blocked = false;
+  OC_LIST_STRUCT_INIT(session, send_queue);
+  session->send_queue_size = 0;
 
   int iface_index = get_interface_index(session->sock);
   endpoint->interface_index = iface_index;
@@ -270,11 +441,121 @@ accept_new_session_locked(ip_context_t *dev, int fd, fd_set *setfds,
   return 0;
 }
 
+/* Notify the stack that the refused messages can be sent again. */
+static void
+tcp_session_notify_drained_locked(tcp_session_t *session)
+{
+  bool notify = g_queued_messages_exhausted;
+  g_queued_messages_exhausted = false;
+  if (session->blocked && !session->congested) {
+    session->blocked = false;
+    notify = true;
+  }
+  if (notify) {
+    oc_network_tcp_send_queue_drained_event();
+  }
+}
+
+static void
+tcp_session_consume_send_queue_locked(tcp_session_t *session, size_t written)
+{
+  session->send_queue_size -= written;
+  queued_message_t *qm = (queued_message_t *)oc_list_head(session->send_queue);
+  while (qm != NULL) {
+    size_t remaining = qm->message->length - qm->offset;
+    if (written < remaining) {
+      qm->offset += written;
+      break;
+    }
+    written -= remaining;
+    oc_list_remove(session->send_queue, qm);
+    oc_message_unref(qm->message);
+    oc_memb_free(&g_queued_message_s, qm);
+    qm = (queued_message_t *)oc_list_head(session->send_queue);
+  }
+
+  if (qm == NULL) {
+    tcp_context_cfds_fd_clr(&session->dev->tcp, session->sock);
+  }
+  if (session->congested &&
+      session->send_queue_size <= g_send_queue_watermarks.low) {
+    OC_DBG("TCP session(fd=%d) send queue drained below low watermark",
+           session->sock);
+    session->congested = false;
+  }
+  tcp_session_notify_drained_locked(session);
+}
+
+/* Write as many queued messages as possible by a single call without
+ * blocking. Returns false on a socket error. */
+static bool
+tcp_session_write_send_queue_locked(tcp_session_t *session)
+{
+  struct iovec iov[TCP_SEND_IOV_MAX];
+  size_t iovcnt = 0;
+  for (queued_message_t *qm =
+         (queued_message_t *)oc_list_head(session->send_queue);
+       qm != NULL && iovcnt < TCP_SEND_IOV_MAX; qm = qm->next) {
+    iov[iovcnt].iov_base = qm->message->data + qm->offset;
+    iov[iovcnt].iov_len = qm->message->length - qm->offset;
+    ++iovcnt;
+  }
+  if (iovcnt == 0) {
+    return true;
+  }
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = iovcnt;
+  ssize_t written;
+  do {
+    written = sendmsg(session->sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+  } while (written < 0 && errno == EINTR);
+  if (written < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    }
+    OC_WRN("sendmsg() returned errno %d", (int)errno);
+    return false;
+  }
+
+  OC_DBG("Sent %zu bytes of %zu queued messages", (size_t)written, iovcnt);
+  tcp_session_consume_send_queue_locked(session, (size_t)written);
+  return true;
+}
+
+static void
+tcp_session_free_send_queue_locked(tcp_session_t *session)
+{
+  if (oc_list_head(session->send_queue) == NULL) {
+    return;
+  }
+  // best effort, so that messages like the TLS close notify are not lost
+  if (tcp_session_write_send_queue_locked(session) &&
+      oc_list_head(session->send_queue) == NULL) {
+    return;
+  }
+  tcp_context_cfds_fd_clr(&session->dev->tcp, session->sock);
+  queued_message_t *qm = (queued_message_t *)oc_list_pop(session->send_queue);
+  while (qm != NULL) {
+    OC_DBG("queued tcp session message(%p) discarded", (void *)qm->message);
+    oc_message_unref(qm->message);
+    oc_memb_free(&g_queued_message_s, qm);
+    qm = (queued_message_t *)oc_list_pop(session->send_queue);
+  }
+  session->send_queue_size = 0;
+}
+
 static void
 free_session_locked(tcp_session_t *session, bool signal)
 {
-  oc_list_remove(g_session_list, session);
+  session_list_remove_locked(session);
   oc_list_remove(g_free_session_list_async, session);
+  tcp_session_free_send_queue_locked(session);
+  // the retry drops the refused messages of the closed session
+  session->congested = false;
+  tcp_session_notify_drained_locked(session);
 
   if (!oc_session_events_disconnect_is_ongoing()) {
     oc_session_end_event(&session->endpoint);
@@ -373,14 +654,43 @@ tcp_receive_server_message_locked(ip_context_t *dev, fd_set *fds,
   return ADAPTER_STATUS_NONE;
 }
 
+static void
+collect_ready_to_read_sessions_locked(const fd_set *setfds)
+{
+  // iterate backwards, so the sessions are read in the order of their sockets
+  int fd_max =
+    g_session_fd_max < FD_SETSIZE ? g_session_fd_max : FD_SETSIZE - 1;
+  for (int fd = fd_max; fd >= 0; --fd) {
+    if (!FD_ISSET(fd, setfds)) {
+      continue;
+    }
+    tcp_session_t *session = find_session_by_fd_locked(fd);
+    if (session != NULL && !session->ready) {
+      session->ready = true;
+      session->ready_next = g_ready_sessions;
+      g_ready_sessions = session;
+    }
+  }
+}
+
+/* The read set is scanned only once the sessions found by the previous scan
+ * are exhausted, each scan tests the bits of the opened sockets and looks up
+ * the sessions by socket. */
 static tcp_session_t *
 get_ready_to_read_session_locked(const fd_set *setfds)
 {
-  tcp_session_t *session = oc_list_head(g_session_list);
-  while (session != NULL && !FD_ISSET(session->sock, setfds)) {
-    session = session->next;
+  if (g_ready_sessions == NULL) {
+    collect_ready_to_read_sessions_locked(setfds);
+  }
+  while (g_ready_sessions != NULL) {
+    tcp_session_t *session = g_ready_sessions;
+    g_ready_sessions = session->ready_next;
+    session->ready = false;
+    if (FD_ISSET(session->sock, setfds)) {
+      return session;
+    }
   }
-  return session;
+  return NULL;
 }
 
 static adapter_receive_state_t
@@ -499,10 +809,10 @@ log_tcp_session(const void *session, const oc_endpoint_t *endpoint,
 static tcp_session_t *
 find_session_by_endpoint_locked(const oc_endpoint_t *endpoint)
 {
-  tcp_session_t *session = oc_list_head(g_session_list);
+  tcp_session_t *session = g_session_by_endpoint[tcp_hash_endpoint(endpoint)];
   while (session != NULL &&
          oc_endpoint_compare(&session->endpoint, endpoint) != 0) {
-    session = session->next;
+    session = session->endpoint_next;
   }
 #if OC_DBG_IS_ENABLED
   log_tcp_session(session, endpoint, true);
@@ -606,13 +916,107 @@ tcp_create_session_locked(int sock, ip_context_t *dev, oc_endpoint_t *endpoint,
   return session;
 }
 
+static void
+waiting_session_fd_index_add_locked(tcp_waiting_session_t *ws)
+{
+  if (ws->sock < 0) {
+    return;
+  }
+  size_t b = tcp_hash_fd(ws->sock);
+  ws->fd_next = g_waiting_session_by_fd[b];
+  g_waiting_session_by_fd[b] = ws;
+  if (ws->sock > g_waiting_session_fd_max) {
+    g_waiting_session_fd_max = ws->sock;
+  }
+}
+
+static void
+waiting_session_fd_index_remove_locked(const tcp_waiting_session_t *ws)
+{
+  if (ws->sock < 0) {
+    return;
+  }
+  tcp_waiting_session_t **w = &g_waiting_session_by_fd[tcp_hash_fd(ws->sock)];
+  for (; *w != NULL; w = &(*w)->fd_next) {
+    if (*w == ws) {
+      *w = ws->fd_next;
+      break;
+    }
+  }
+}
+
+/* find the highest socket of the waiting sessions */
+static void
+waiting_session_fd_max_update_locked(void)
+{
+  g_waiting_session_fd_max = -1;
+  for (const tcp_waiting_session_t *ws =
+         (tcp_waiting_session_t *)oc_list_head(g_waiting_session_list);
+       ws != NULL; ws = ws->next) {
+    if (ws->sock > g_waiting_session_fd_max) {
+      g_waiting_session_fd_max = ws->sock;
+    }
+  }
+}
+
+static void
+waiting_session_list_add_locked(tcp_waiting_session_t *ws)
+{
+  oc_list_add(g_waiting_session_list, ws);
+  size_t b = tcp_hash_endpoint(&ws->endpoint);
+  ws->endpoint_next = g_waiting_session_by_endpoint[b];
+  g_waiting_session_by_endpoint[b] = ws;
+  waiting_session_fd_index_add_locked(ws);
+}
+
+static void
+waiting_session_list_remove_locked(tcp_waiting_session_t *ws)
+{
+  oc_list_remove(g_waiting_session_list, ws);
+  tcp_waiting_session_t **w =
+    &g_waiting_session_by_endpoint[tcp_hash_endpoint(&ws->endpoint)];
+  for (; *w != NULL; w = &(*w)->endpoint_next) {
+    if (*w == ws) {
+      *w = ws->endpoint_next;
+      break;
+    }
+  }
+  waiting_session_fd_index_remove_locked(ws);
+  if (ws->sock >= g_waiting_session_fd_max) {
+    waiting_session_fd_max_update_locked();
+  }
+}
+
+/* the waiting session must be in the list of waiting sessions */
+static void
+waiting_session_set_sock_locked(tcp_waiting_session_t *ws, int sock)
+{
+  waiting_session_fd_index_remove_locked(ws);
+  int prev_sock = ws->sock;
+  ws->sock = sock;
+  waiting_session_fd_index_add_locked(ws);
+  if (prev_sock >= g_waiting_session_fd_max && sock < prev_sock) {
+    waiting_session_fd_max_update_locked();
+  }
+}
+
+static tcp_waiting_session_t *
+find_waiting_session_by_fd_locked(int sock)
+{
+  tcp_waiting_session_t *ws = g_waiting_session_by_fd[tcp_hash_fd(sock)];
+  while (ws != NULL && ws->sock != sock) {
+    ws = ws->fd_next;
+  }
+  return ws;
+}
+
 static tcp_waiting_session_t *
 find_waiting_session_by_endpoint_locked(const oc_endpoint_t *endpoint)
 {
   tcp_waiting_session_t *ws =
-    (tcp_waiting_session_t *)oc_list_head(g_waiting_session_list);
+    g_waiting_session_by_endpoint[tcp_hash_endpoint(endpoint)];
   while (ws != NULL && oc_endpoint_compare(&ws->endpoint, endpoint) != 0) {
-    ws = ws->next;
+    ws = ws->endpoint_next;
   }
 #if OC_DBG_IS_ENABLED
   log_tcp_session(ws, endpoint, false);
@@ -647,7 +1051,7 @@ add_new_waiting_session_locked(int sock, ip_context_t *dev,
   log_new_session(&ws->endpoint, sock, false);
 #endif /* OC_DBG_IS_ENABLED */
 
-  oc_list_add(g_waiting_session_list, ws);
+  waiting_session_list_add_locked(ws);
   return ws;
 }
 
@@ -734,7 +1138,7 @@ tcp_connect_locked(ip_context_t *dev, oc_endpoint_t *endpoint,
 static void
 free_session_async_locked(tcp_session_t *s)
 {
-  oc_list_remove(g_session_list, s);
+  session_list_remove_locked(s);
   oc_list_add(g_free_session_list_async, s);
 
   signal_network_thread(&s->dev->tcp);
@@ -747,7 +1151,7 @@ free_session_async_locked(tcp_session_t *s)
 static void
 free_waiting_session_async_locked(tcp_waiting_session_t *ws)
 {
-  oc_list_remove(g_waiting_session_list, ws);
+  waiting_session_list_remove_locked(ws);
   oc_list_add(g_free_waiting_session_list_async, ws);
 
   signal_network_thread(&ws->dev->tcp);
@@ -785,7 +1189,7 @@ static void
 free_waiting_session_locked(tcp_waiting_session_t *session, bool has_expired,
                             bool signal)
 {
-  oc_list_remove(g_waiting_session_list, session);
+  waiting_session_list_remove_locked(session);
   oc_list_remove(g_free_waiting_session_list_async, session);
 
   queued_message_t *qm = (queued_message_t *)oc_list_pop(session->messages);
@@ -892,29 +1296,55 @@ oc_tcp_connection_state(const oc_endpoint_t *endpoint)
   return -1;
 }
 
+static void
+tcp_session_enqueue_locked(tcp_session_t *session, queued_message_t *qm)
+{
+  bool was_empty = oc_list_head(session->send_queue) == NULL;
+  oc_list_add(session->send_queue, qm);
+  session->send_queue_size += qm->message->length - qm->offset;
+  if (!session->congested &&
+      session->send_queue_size >= g_send_queue_watermarks.high) {
+    OC_DBG("TCP session(fd=%d) send queue reached high watermark",
+           session->sock);
+    session->congested = true;
+  }
+
+  if (was_empty) {
+    tcp_context_cfds_fd_set(&session->dev->tcp, session->sock);
+    signal_network_thread(&session->dev->tcp);
+  }
+  OC_DBG("message(%p) of %zu bytes added to TCP session(fd=%d) send queue",
+         (void *)qm->message, qm->message->length, session->sock);
+}
+
+/* The message is written by the network thread once the socket is writable,
+ * the messages queued in the meantime are written together. The message is
+ * refused with OC_TCP_SOCKET_ERROR_WOULD_BLOCK while the session is congested,
+ * the stack is notified by oc_network_tcp_send_queue_drained_event once it can
+ * be sent again. */
 static int
-tcp_send_message(int sockfd, const oc_message_t *message)
+tcp_send_message_locked(tcp_session_t *session, oc_message_t *message)
 {
-  size_t bytes_sent = 0;
-  do {
-    ssize_t send_len = send(sockfd, message->data + bytes_sent,
-                            message->length - bytes_sent, MSG_NOSIGNAL);
-    if (send_len < 0) {
-      if (errno == EINTR) {
-        continue;
-      }
-      OC_WRN("send() returned errno %d", (int)errno);
-      if (bytes_sent == 0) {
-        return -1;
-      }
-      return (int)bytes_sent;
-    }
-    bytes_sent += send_len;
-  } while (bytes_sent < message->length);
+  if (session->congested) {
+    OC_DBG("TCP session(fd=%d) send queue is full (%zu bytes)", session->sock,
+           session->send_queue_size);
+    session->blocked = true;
+    return OC_TCP_SOCKET_ERROR_WOULD_BLOCK;
+  }
+  queued_message_t *qm = oc_memb_alloc(&g_queued_message_s);
+  if (qm == NULL) {
+    OC_WRN("could not allocate new queued message");
+    g_queued_messages_exhausted = true;
+    return OC_TCP_SOCKET_ERROR_WOULD_BLOCK;
+  }
 
-  OC_DBG("Sent %zu bytes", bytes_sent);
-  assert(bytes_sent <= INT_MAX);
-  return (int)bytes_sent;
+  oc_message_add_ref(message);
+  qm->message = message;
+  qm->timestamp = oc_clock_time();
+  qm->offset = 0;
+  tcp_session_enqueue_locked(session, qm);
+  assert(message->length <= INT_MAX);
+  return (int)message->length;
 }
 
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
@@ -933,6 +1363,7 @@ add_message_to_waiting_session_locked(tcp_waiting_session_t *session,
   oc_message_add_ref(message);
   qm->message = message;
   qm->timestamp = oc_clock_time();
+  qm->offset = 0;
   oc_list_add(session->messages, qm);
   return true;
 }
@@ -949,7 +1380,7 @@ tcp_connect_and_send_buffer_locked(ip_context_t *dev, oc_message_t *message,
     tcp_connect_locked(dev, &message->endpoint, receiver, NULL, NULL);
 
   if (res.session != NULL) {
-    return tcp_send_message(res.session->sock, message);
+    return tcp_send_message_locked(res.session, message);
   }
 
   if (res.waiting_session != NULL) {
@@ -985,9 +1416,9 @@ oc_tcp_send_buffer2(oc_message_t *message, bool queue)
 {
   const oc_endpoint_t *ep = &message->endpoint;
   pthread_mutex_lock(&g_mutex);
-  const tcp_session_t *s = find_session_by_endpoint_locked(ep);
+  tcp_session_t *s = find_session_by_endpoint_locked(ep);
   if (s != NULL) {
-    int ret = tcp_send_message(s->sock, message);
+    int ret = tcp_send_message_locked(s, message);
     pthread_mutex_unlock(&g_mutex);
     return ret;
   }
@@ -1015,6 +1446,46 @@ oc_tcp_send_buffer2(oc_message_t *message, bool queue)
   return OC_TCP_SOCKET_ERROR_NOT_CONNECTED;
 }
 
+bool
+tcp_process_send_queues(fd_set *fds)
+{
+  bool ret = false;
+  pthread_mutex_lock(&g_mutex);
+  int fd_max =
+    g_session_fd_max < FD_SETSIZE ? g_session_fd_max : FD_SETSIZE - 1;
+  for (int fd = 0; fd <= fd_max; ++fd) {
+    if (!FD_ISSET(fd, fds)) {
+      continue;
+    }
+    tcp_session_t *session = find_session_by_fd_locked(fd);
+    if (session == NULL || oc_list_head(session->send_queue) == NULL) {
+      continue;
+    }
+
+    OC_DBG("tcp session(%p) write (fd=%d): %zu bytes queued", (void *)session,
+           fd, session->send_queue_size);
+    FD_CLR(fd, fds);
+    ret = true;
+    if (!tcp_session_write_send_queue_locked(session)) {
+      free_session_locked(session, false);
+    }
+    break;
+  }
+  pthread_mutex_unlock(&g_mutex);
+  return ret;
+}
+
+void
+oc_tcp_set_send_queue_watermarks(size_t low, size_t high)
+{
+  assert(low <= high);
+  pthread_mutex_lock(&g_mutex);
+  g_send_queue_watermarks.low = low;
+  g_send_queue_watermarks.high = high;
+  pthread_mutex_unlock(&g_mutex);
+  OC_DBG("tcp send queue watermarks: low=%zu high=%zu", low, high);
+}
+
 void
 tcp_session_handle_signal(void)
 {
@@ -1074,27 +1545,22 @@ oc_tcp_set_connect_retry(uint8_t max_count, uint16_t timeout)
 }
 
 static void
-tcp_send_waiting_messages_locked(tcp_waiting_session_t *ws,
-                                 const tcp_session_t *s)
+tcp_send_waiting_messages_locked(tcp_waiting_session_t *ws, tcp_session_t *s)
 {
   assert(s != NULL);
+  // the messages have been already accepted, so they are moved to the send
+  // queue even if it overshoots the high watermark
   queued_message_t *qm = (queued_message_t *)oc_list_pop(ws->messages);
   while (qm != NULL) {
-    if (s != NULL) {
-      qm->message->endpoint.interface_index = s->endpoint.interface_index;
-      if (tcp_send_message(s->sock, qm->message) < -1) {
-        OC_WRN("failed to send queued message");
-      }
-    }
-    oc_message_unref(qm->message);
-    oc_memb_free(&g_queued_message_s, qm);
+    qm->message->endpoint.interface_index = s->endpoint.interface_index;
+    tcp_session_enqueue_locked(s, qm);
     qm = oc_list_pop(ws->messages);
   }
 }
 
 static bool
 tcp_cleanup_connected_waiting_session_locked(tcp_waiting_session_t *ws,
-                                             const tcp_session_t *s)
+                                             tcp_session_t *s)
 {
   if (ws->on_tcp_connect != NULL) {
     oc_tcp_on_connect_event_t *event = oc_tcp_on_connect_event_create(
@@ -1106,7 +1572,7 @@ tcp_cleanup_connected_waiting_session_locked(tcp_waiting_session_t *ws,
     oc_network_tcp_connect_event(event);
   }
 
-  oc_list_remove(g_waiting_session_list, ws);
+  waiting_session_list_remove_locked(ws);
   tcp_send_waiting_messages_locked(ws, s);
   signal_network_thread(&ws->dev->tcp);
   oc_memb_free(&g_tcp_waiting_session_s, ws);
@@ -1140,7 +1606,8 @@ tcp_try_connect_waiting_session_locked(tcp_waiting_session_t *ws, int *err)
     return false;
   }
   tcp_context_cfds_fd_clr(&ws->dev->tcp, ws->sock);
-  ws->sock = -1; // socket was taken by the ongoing session
+  // socket was taken by the ongoing session
+  waiting_session_set_sock_locked(ws, -1);
 
   if (!tcp_cleanup_connected_waiting_session_locked(ws, s)) {
     free_session_locked(s, false);
@@ -1189,7 +1656,7 @@ tcp_retry_waiting_session_locked(tcp_waiting_session_t *ws, oc_clock_time_t now)
     tcp_context_cfds_fd_clr(&ws->dev->tcp, ws->sock);
     OC_DBG("close waiting session socket(fd=%d)", ws->sock);
     close(ws->sock);
-    ws->sock = -1;
+    waiting_session_set_sock_locked(ws, -1);
   }
 
   tcp_connected_socket_t cs = tcp_create_connected_socket(&ws->endpoint, NULL);
@@ -1212,7 +1679,7 @@ tcp_retry_waiting_session_locked(tcp_waiting_session_t *ws, oc_clock_time_t now)
     ++ws->retry.count;
     ws->retry.start = now;
     ws->retry.force = 0;
-    ws->sock = cs.socket;
+    waiting_session_set_sock_locked(ws, cs.socket);
     tcp_waiting_session_set_socked_locked(&ws->dev->tcp, ws->sock);
     return OC_TCP_SOCKET_STATE_CONNECTING;
   }
@@ -1275,7 +1742,7 @@ tcp_process_waiting_session_locked(tcp_waiting_session_t *ws)
     if (ws->sock >= 0) {
       tcp_context_cfds_fd_clr(&ws->dev->tcp, ws->sock);
       close(ws->sock);
-      ws->sock = -1;
+      waiting_session_set_sock_locked(ws, -1);
     }
     if (error == 0) {
       ws->retry.force = 1;
@@ -1292,10 +1759,14 @@ tcp_process_waiting_sessions(fd_set *fds)
 {
   bool ret = false;
   pthread_mutex_lock(&g_mutex);
-  for (tcp_waiting_session_t *ws =
-         (tcp_waiting_session_t *)oc_list_head(g_waiting_session_list);
-       ws != NULL; ws = ws->next) {
-    if (ws->sock == -1 || !FD_ISSET(ws->sock, fds)) {
+  int fd_max = g_waiting_session_fd_max < FD_SETSIZE ? g_waiting_session_fd_max
+                                                      : FD_SETSIZE - 1;
+  for (int fd = 0; fd <= fd_max; ++fd) {
+    if (!FD_ISSET(fd, fds)) {
+      continue;
+    }
+    tcp_waiting_session_t *ws = find_waiting_session_by_fd_locked(fd);
+    if (ws == NULL) {
       continue;
     }
 
@@ -1352,4 +1823,95 @@ oc_tcp_connect(oc_endpoint_t *endpoint, on_tcp_connect_t on_tcp_connect,
 }
 
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
+
+#ifdef OC_TEST
+
+bool
+tcp_session_add_unconnected(const oc_endpoint_t *endpoint, int sock)
+{
+  tcp_session_t *session = oc_memb_alloc(&g_tcp_session_s);
+  if (session == NULL) {
+    return false;
+  }
+  memcpy(&session->endpoint, endpoint, sizeof(oc_endpoint_t));
+  session->endpoint.next = NULL;
+  session->sock = sock;
+  session->csm_state = CSM_NONE;
+  OC_LIST_STRUCT_INIT(session, send_queue);
+  pthread_mutex_lock(&g_mutex);
+  session_list_add_locked(session);
+  pthread_mutex_unlock(&g_mutex);
+  return true;
+}
+
+bool
+tcp_session_remove_unconnected(const oc_endpoint_t *endpoint)
+{
+  pthread_mutex_lock(&g_mutex);
+  tcp_session_t *session = find_session_by_endpoint_locked(endpoint);
+  if (session != NULL) {
+    session_list_remove_locked(session);
+  }
+  pthread_mutex_unlock(&g_mutex);
+  if (session == NULL) {
+    return false;
+  }
+  oc_memb_free(&g_tcp_session_s, session);
+  return true;
+}
+
+int
+tcp_session_find_sock(const oc_endpoint_t *endpoint)
+{
+  pthread_mutex_lock(&g_mutex);
+  const tcp_session_t *session = find_session_by_endpoint_locked(endpoint);
+  int sock = session != NULL ? session->sock : -1;
+  pthread_mutex_unlock(&g_mutex);
+  return sock;
+}
+
+bool
+tcp_session_find_endpoint(int sock, oc_endpoint_t *endpoint)
+{
+  pthread_mutex_lock(&g_mutex);
+  const tcp_session_t *session = find_session_by_fd_locked(sock);
+  if (session != NULL) {
+    memcpy(endpoint, &session->endpoint, sizeof(oc_endpoint_t));
+  }
+  pthread_mutex_unlock(&g_mutex);
+  return session != NULL;
+}
+
+int
+tcp_session_fd_max(void)
+{
+  pthread_mutex_lock(&g_mutex);
+  int fd_max = g_session_fd_max;
+  pthread_mutex_unlock(&g_mutex);
+  return fd_max;
+}
+
+size_t
+tcp_session_send_queue_size(const oc_endpoint_t *endpoint)
+{
+  pthread_mutex_lock(&g_mutex);
+  const tcp_session_t *session = find_session_by_endpoint_locked(endpoint);
+  size_t size = session != NULL ? session->send_queue_size : 0;
+  pthread_mutex_unlock(&g_mutex);
+  return size;
+}
+
+size_t
+tcp_session_endpoint_bucket(const oc_endpoint_t *endpoint)
+{
+  return tcp_hash_endpoint(endpoint);
+}
+
+size_t
+tcp_session_fd_bucket(int sock)
+{
+  return tcp_hash_fd(sock);
+}
+
+#endif /* OC_TEST */
 #endif /* OC_TCP */
@@ -51,12 +51,16 @@ extern "C" {
  * (OC_HAS_FEATURE_TCP_ASYNC_CONNECT is false) then oc_tcp_send_buffer2 is
  * called.
  *
+ * Messages for an opened connection are added to the send queue of the
+ * session and written by the network thread.
+ *
  * @param dev the device network context (cannot be NULL)
  * @param message message with data to send (cannot be NULL)
  * @param receiver address of the receiver (cannot be NULL)
  * @return OC_SEND_MESSAGE_QUEUED message was queued and will be sent once a
  * connection is established
- * @return >=0 number of written bytes
+ * @return >=0 number of bytes added to the send queue
+ * @return OC_TCP_SOCKET_ERROR_WOULD_BLOCK the send queue of the session is full
  * @return -1 on error
  *
  * @note thread-safe
@@ -72,15 +76,22 @@ int oc_tcp_send_buffer(ip_context_t *dev, oc_message_t *message,
  * the oc_tcp_connect has been already called previously or we are a server and
  * we have accepted a connection).
  *
+ * The message is added to the send queue of the session and written by the
+ * network thread once the socket is writable. The message is refused if the
+ * send queue of the session reached the high watermark and it has not been
+ * written down to the low watermark yet. The stack is notified by
+ * oc_network_tcp_send_queue_drained_event once it can be sent again.
+ *
  * @param message message with endpoint address and data to send (cannot be
  * NULL)
  * @param queue true if the message can be queued (the session for given
  * endpoint exists, but it hasn't finished opening yet, the message will be sent
  * once it is opened)
  * @return OC_SEND_MESSAGE_QUEUED message has been queued
- * @return >0 message was sent and that many bytes were sent
+ * @return >0 message was added to the send queue of the session
  * @return OC_TCP_SOCKET_ERROR_NOT_CONNECTED no session for given endpoint
  * exists (ie. oc_tcp_connect has not been called for the endpoint)
+ * @return OC_TCP_SOCKET_ERROR_WOULD_BLOCK the send queue of the session is full
  * @return -1 on other error
  *
  * @note thread-safe
@@ -107,6 +118,21 @@ adapter_receive_state_t tcp_receive_message(ip_context_t *dev, fd_set *fds,
  */
 void tcp_end_session(const oc_endpoint_t *endpoint);
 
+/**
+ * @brief Find a TCP session with queued messages and socket in the file
+ * descriptor set. Remove the socket from the file descriptor set and write
+ * as many queued messages as possible without blocking by a single call. The
+ * session is closed on a socket error.
+ *
+ * @param fds set of file descriptors with available write event(s)
+ * @return true session with socket in the file descriptor set was found and
+ * processed
+ * @return false no session was found
+ *
+ * @note thread-safe
+ */
+bool tcp_process_send_queues(fd_set *fds);
+
 /**
  * @brief Handle data received on the signal pipe.
  */
@@ -148,6 +174,53 @@ oc_clock_time_t tcp_check_expiring_sessions(oc_clock_time_t now);
 bool tcp_process_waiting_sessions(fd_set *fds);
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
 
+#ifdef OC_TEST
+/**
+ * @brief Add a session without a connection to the list and the indexes of
+ * sessions. The socket is neither read, written nor closed.
+ *
+ * @note the network thread must not be running
+ */
+bool tcp_session_add_unconnected(const oc_endpoint_t *endpoint, int sock);
+
+/**
+ * @brief Remove a session added by tcp_session_add_unconnected.
+ */
+bool tcp_session_remove_unconnected(const oc_endpoint_t *endpoint);
+
+/**
+ * @brief Find session by endpoint.
+ *
+ * @return socket of the session, -1 if not found
+ */
+int tcp_session_find_sock(const oc_endpoint_t *endpoint);
+
+/**
+ * @brief Find session by socket and copy its endpoint.
+ *
+ * @return true if the session was found
+ */
+bool tcp_session_find_endpoint(int sock, oc_endpoint_t *endpoint);
+
+/**
+ * @brief Get the upper bound of the sockets of the sessions (-1 if there is no
+ * session).
+ */
+int tcp_session_fd_max(void);
+
+/**
+ * @brief Get the number of queued bytes of the session that have not been
+ * written yet (0 if the session is not found).
+ */
+size_t tcp_session_send_queue_size(const oc_endpoint_t *endpoint);
+
+/** @brief Get the bucket of the endpoint in the index of sessions. */
+size_t tcp_session_endpoint_bucket(const oc_endpoint_t *endpoint);
+
+/** @brief Get the bucket of the socket in the index of sessions. */
+size_t tcp_session_fd_bucket(int sock);
+#endif /* OC_TEST */
+
 #ifdef __cplusplus
 }
 #endif
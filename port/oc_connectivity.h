@@ -214,6 +214,8 @@ typedef enum {
     -4, // waiting connection for given address already exists
   OC_TCP_SOCKET_ERROR_EXISTS_CONNECTED =
     -5, // ongoing connection for given address already exists
+  OC_TCP_SOCKET_ERROR_WOULD_BLOCK =
+    -6, // send queue of the connection is full, send the message later
 } oc_tcp_socket_error_t;
 
 #ifdef OC_HAS_FEATURE_TCP_ASYNC_CONNECT
@@ -27,6 +27,7 @@
 #include "util/oc_features.h"
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -60,6 +61,26 @@ typedef struct
 void oc_tcp_set_connect_retry(uint8_t max_count, uint16_t timeout);
 #endif /* OC_HAS_FEATURE_TCP_ASYNC_CONNECT */
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+#define OC_TCP_SEND_QUEUE_LOW_WATERMARK (16 * 1024)
+#define OC_TCP_SEND_QUEUE_HIGH_WATERMARK (64 * 1024)
+
+/**
+ * @brief Set the watermarks of the send queues of TCP sessions.
+ *
+ * Once the number of queued bytes of a session reaches the high watermark,
+ * new messages for the session are refused with
+ * OC_TCP_SOCKET_ERROR_WOULD_BLOCK until the network thread writes the queue
+ * down to the low watermark. The refused messages are kept by the stack and
+ * sent again in the original order.
+ *
+ * @param low low watermark in bytes (default: 16kB)
+ * @param high high watermark in bytes (default: 64kB), must be greater than or
+ * equal to the low watermark
+ */
+void oc_tcp_set_send_queue_watermarks(size_t low, size_t high);
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 #ifdef OC_NETWORK_MONITOR
 /**
  * @brief the callback function for an network change
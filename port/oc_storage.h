@@ -21,6 +21,8 @@
 #ifndef OC_PORT_STORAGE_H
 #define OC_PORT_STORAGE_H
 
+#include "oc_config.h"
+
 #include <stddef.h>
 #include <stdint.h>
 
@@ -58,6 +60,39 @@ long oc_storage_read(const char *store, uint8_t *buf, size_t size);
  */
 long oc_storage_write(const char *store, const uint8_t *buf, size_t size);
 
+#ifdef OC_STORAGE_KV
+
+/**
+ * @brief get a read-only view of the stored data without copying it
+ *
+ * @param store the store (cannot be NULL)
+ * @param[out] data pointer to the stored data (cannot be NULL), the pointer is
+ * valid only until the next write to the storage
+ * @return long >= 0 size of the stored data on success
+ * @return long < 0 on failure
+ */
+long oc_storage_read_view(const char *store, const uint8_t **data);
+
+/**
+ * @brief start a batch of writes, the written data are synchronized to the
+ * persistent storage only once by oc_storage_batch_commit
+ *
+ * @return 0 on success
+ * @return <0 on failure
+ */
+int oc_storage_batch_begin(void);
+
+/**
+ * @brief finish a batch of writes and synchronize them to the persistent
+ * storage
+ *
+ * @return 0 on success
+ * @return <0 on failure
+ */
+int oc_storage_batch_commit(void);
+
+#endif /* OC_STORAGE_KV */
+
 #ifdef __cplusplus
 }
 #endif
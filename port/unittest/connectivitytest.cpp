@@ -31,6 +31,12 @@
 #include "tests/gtest/Device.h"
 #include "tests/gtest/Endpoint.h"
 
+#if defined(__linux__) && !defined(__ANDROID_API__) && defined(OC_TCP) &&      \
+  defined(OC_TEST) && defined(OC_DYNAMIC_ALLOCATION)
+#define TCP_SESSION_TEST_HOOKS
+#include "port/linux/tcpsession.h"
+#endif
+
 #include <array>
 #include <atomic>
 #include <cstdint>
@@ -39,6 +45,18 @@
 #include <gtest/gtest.h>
 #include <string>
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 static const size_t g_device = 0;
 
 class TestConnectivity : public testing::Test {
@@ -308,6 +326,103 @@ TEST_F(TestConnectivity, oc_tcp_get_csm_state_N)
   EXPECT_EQ(CSM_ERROR, ret);
 }
 
+#ifdef TCP_SESSION_TEST_HOOKS
+
+static oc_endpoint_t
+tcpSessionEndpoint(uint16_t port)
+{
+  return oc::endpoint::FromString("coap+tcp://[::1]:" + std::to_string(port));
+}
+
+TEST_F(TestConnectivity, tcp_session_index)
+{
+  std::array<oc_endpoint_t, 3> eps = { tcpSessionEndpoint(42001),
+                                       tcpSessionEndpoint(42002),
+                                       tcpSessionEndpoint(42003) };
+  std::array<int, 3> socks = { 10, 11, 12 };
+  EXPECT_EQ(-1, tcp_session_fd_max());
+  for (size_t i = 0; i < eps.size(); ++i) {
+    ASSERT_TRUE(tcp_session_add_unconnected(&eps[i], socks[i]));
+  }
+  EXPECT_EQ(12, tcp_session_fd_max());
+  for (size_t i = 0; i < eps.size(); ++i) {
+    EXPECT_EQ(socks[i], tcp_session_find_sock(&eps[i]));
+    oc_endpoint_t ep{};
+    ASSERT_TRUE(tcp_session_find_endpoint(socks[i], &ep));
+    EXPECT_EQ(0, oc_endpoint_compare(&eps[i], &ep));
+  }
+  oc_endpoint_t unknown = tcpSessionEndpoint(42004);
+  EXPECT_EQ(-1, tcp_session_find_sock(&unknown));
+  oc_endpoint_t ep{};
+  EXPECT_FALSE(tcp_session_find_endpoint(13, &ep));
+
+  // removal of a socket below the upper bound keeps it
+  ASSERT_TRUE(tcp_session_remove_unconnected(&eps[1]));
+  EXPECT_EQ(12, tcp_session_fd_max());
+  EXPECT_EQ(-1, tcp_session_find_sock(&eps[1]));
+  EXPECT_FALSE(tcp_session_find_endpoint(11, &ep));
+  EXPECT_FALSE(tcp_session_remove_unconnected(&eps[1]));
+
+  // removal of the upper bound recomputes it from the remaining sessions
+  ASSERT_TRUE(tcp_session_remove_unconnected(&eps[2]));
+  EXPECT_EQ(10, tcp_session_fd_max());
+  EXPECT_EQ(-1, tcp_session_find_sock(&eps[2]));
+  EXPECT_EQ(10, tcp_session_find_sock(&eps[0]));
+
+  ASSERT_TRUE(tcp_session_remove_unconnected(&eps[0]));
+  EXPECT_EQ(-1, tcp_session_fd_max());
+  EXPECT_EQ(-1, tcp_session_find_sock(&eps[0]));
+}
+
+TEST_F(TestConnectivity, tcp_session_index_collision)
+{
+  // find two endpoints in the same bucket
+  oc_endpoint_t ep1 = tcpSessionEndpoint(42000);
+  size_t bucket = tcp_session_endpoint_bucket(&ep1);
+  oc_endpoint_t ep2{};
+  bool found = false;
+  for (uint16_t port = 42001; port < 43000 && !found; ++port) {
+    ep2 = tcpSessionEndpoint(port);
+    found = tcp_session_endpoint_bucket(&ep2) == bucket;
+  }
+  ASSERT_TRUE(found);
+  // and two sockets in the same bucket
+  int sock1 = 10;
+  int sock2 = sock1 + 1;
+  while (tcp_session_fd_bucket(sock2) != tcp_session_fd_bucket(sock1)) {
+    ++sock2;
+  }
+
+  ASSERT_TRUE(tcp_session_add_unconnected(&ep1, sock1));
+  ASSERT_TRUE(tcp_session_add_unconnected(&ep2, sock2));
+  EXPECT_EQ(sock1, tcp_session_find_sock(&ep1));
+  EXPECT_EQ(sock2, tcp_session_find_sock(&ep2));
+  oc_endpoint_t ep{};
+  ASSERT_TRUE(tcp_session_find_endpoint(sock1, &ep));
+  EXPECT_EQ(0, oc_endpoint_compare(&ep1, &ep));
+  ASSERT_TRUE(tcp_session_find_endpoint(sock2, &ep));
+  EXPECT_EQ(0, oc_endpoint_compare(&ep2, &ep));
+
+  // the other session of the bucket stays reachable after removal
+  ASSERT_TRUE(tcp_session_remove_unconnected(&ep2));
+  EXPECT_EQ(sock1, tcp_session_find_sock(&ep1));
+  ASSERT_TRUE(tcp_session_find_endpoint(sock1, &ep));
+  EXPECT_EQ(0, oc_endpoint_compare(&ep1, &ep));
+  EXPECT_EQ(-1, tcp_session_find_sock(&ep2));
+  EXPECT_FALSE(tcp_session_find_endpoint(sock2, &ep));
+  EXPECT_EQ(sock1, tcp_session_fd_max());
+
+  ASSERT_TRUE(tcp_session_add_unconnected(&ep2, sock2));
+  ASSERT_TRUE(tcp_session_remove_unconnected(&ep1));
+  EXPECT_EQ(sock2, tcp_session_find_sock(&ep2));
+  EXPECT_EQ(-1, tcp_session_find_sock(&ep1));
+  EXPECT_FALSE(tcp_session_find_endpoint(sock1, &ep));
+  ASSERT_TRUE(tcp_session_remove_unconnected(&ep2));
+  EXPECT_EQ(-1, tcp_session_fd_max());
+}
+
+#endif /* TCP_SESSION_TEST_HOOKS */
+
 #endif /* OC_TCP */
 
 class TestConnectivityWithServer : public testing::Test {
@@ -520,6 +635,198 @@ TEST_F(TestConnectivityWithServer, oc_tcp_send_buffer2)
   oc_message_unref(msg);
 }
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+/** TCP session with a peer that reads only when asked, so that the socket
+ * buffers and the send queue of the session can be filled */
+class TestTCPSendQueue : public TestConnectivityWithServer {
+public:
+  static constexpr size_t kLowWatermark = 1024;
+  static constexpr size_t kHighWatermark = 4096;
+  static constexpr size_t kMessageSize = 256;
+
+  void SetUp() override
+  {
+    TestConnectivityWithServer::SetUp();
+    m_listener = socket(AF_INET6, SOCK_STREAM, 0);
+    ASSERT_NE(-1, m_listener);
+    // small socket buffers are filled quickly
+    int rcvbuf = 4096;
+    ASSERT_EQ(0, setsockopt(m_listener, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                            sizeof(rcvbuf)));
+    sockaddr_in6 addr{};
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_loopback;
+    ASSERT_EQ(0, bind(m_listener, reinterpret_cast<sockaddr *>(&addr),
+                      sizeof(addr)));
+    ASSERT_EQ(0, listen(m_listener, 1));
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(m_listener, reinterpret_cast<sockaddr *>(&addr),
+                             &addr_len));
+
+    m_ep = oc::endpoint::FromString("coap+tcp://[::1]:" +
+                                    std::to_string(ntohs(addr.sin6_port)));
+    m_ep.device = g_device;
+    ASSERT_LE(0, oc_tcp_connect(&m_ep, on_tcp_connect, this));
+    m_peer = accept(m_listener, nullptr, nullptr);
+    ASSERT_NE(-1, m_peer);
+    ASSERT_NE(-1, fcntl(m_peer, F_SETFL, O_NONBLOCK));
+    for (int i = 0; i < 100 && oc_tcp_connection_state(&m_ep) !=
+                                 OC_TCP_SOCKET_STATE_CONNECTED;
+         ++i) {
+      oc::TestDevice::PoolEventsMs(10);
+    }
+    ASSERT_EQ(OC_TCP_SOCKET_STATE_CONNECTED, oc_tcp_connection_state(&m_ep));
+    oc_tcp_set_send_queue_watermarks(kLowWatermark, kHighWatermark);
+  }
+
+  void TearDown() override
+  {
+    oc_tcp_set_send_queue_watermarks(OC_TCP_SEND_QUEUE_LOW_WATERMARK,
+                                     OC_TCP_SEND_QUEUE_HIGH_WATERMARK);
+    if (m_peer != -1) {
+      close(m_peer);
+    }
+    if (m_listener != -1) {
+      close(m_listener);
+    }
+    TestConnectivityWithServer::TearDown();
+  }
+
+  /* The message starts with its sequence number. */
+  oc_message_t *newMessage()
+  {
+    oc_message_t *msg = oc_allocate_message();
+    if (msg == nullptr) {
+      return nullptr;
+    }
+    memcpy(&msg->endpoint, &m_ep, sizeof(oc_endpoint_t));
+    memset(msg->data, static_cast<int>(m_seq & 0xFF), kMessageSize);
+    memcpy(msg->data, &m_seq, sizeof(m_seq));
+    msg->length = kMessageSize;
+    ++m_seq;
+    return msg;
+  }
+
+  void expectMessage(const oc_message_t *msg)
+  {
+    m_expected.insert(m_expected.end(), msg->data, msg->data + msg->length);
+  }
+
+  int send()
+  {
+    oc_message_t *msg = newMessage();
+    if (msg == nullptr) {
+      return -1;
+    }
+    int ret = oc_send_buffer2(msg, false);
+    if (ret >= 0) {
+      expectMessage(msg);
+    }
+    oc_message_unref(msg);
+    return ret;
+  }
+
+  /* Send messages while the peer doesn't read. The socket buffers and the
+   * send queue are full once the messages are refused for a while. */
+  bool fill()
+  {
+    int refused = 0;
+    for (int i = 0; i < 100000 && refused < 10; ++i) {
+      int ret = send();
+      if (ret == OC_TCP_SOCKET_ERROR_WOULD_BLOCK) {
+        ++refused;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+      if (ret != static_cast<int>(kMessageSize)) {
+        return false;
+      }
+      refused = 0;
+    }
+    return refused == 10;
+  }
+
+  void receive()
+  {
+    std::array<uint8_t, 4096> buf{};
+    ssize_t len;
+    while ((len = recv(m_peer, buf.data(), buf.size(), 0)) > 0) {
+      m_received.insert(m_received.end(), buf.data(), buf.data() + len);
+    }
+  }
+
+  int m_listener{ -1 };
+  int m_peer{ -1 };
+  oc_endpoint_t m_ep{};
+  uint32_t m_seq{ 0 };
+  std::vector<uint8_t> m_expected{};
+  std::vector<uint8_t> m_received{};
+};
+
+/** messages are refused once the send queue of the session reaches the high
+ * watermark and accepted again once it is written down to the low watermark,
+ * the accepted messages arrive in order */
+TEST_F(TestTCPSendQueue, oc_tcp_send_buffer2_burst)
+{
+  ASSERT_TRUE(fill());
+  EXPECT_LE(kHighWatermark, m_expected.size());
+#ifdef TCP_SESSION_TEST_HOOKS
+  EXPECT_LT(kLowWatermark, tcp_session_send_queue_size(&m_ep));
+#endif /* TCP_SESSION_TEST_HOOKS */
+
+  bool resumed = false;
+  for (int i = 0; i < 1000 && !resumed; ++i) {
+    receive();
+    int ret = send();
+    if (ret == OC_TCP_SOCKET_ERROR_WOULD_BLOCK) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      continue;
+    }
+    ASSERT_EQ(kMessageSize, ret);
+    resumed = true;
+  }
+  ASSERT_TRUE(resumed);
+#ifdef TCP_SESSION_TEST_HOOKS
+  EXPECT_GE(kLowWatermark + kMessageSize, tcp_session_send_queue_size(&m_ep));
+#endif /* TCP_SESSION_TEST_HOOKS */
+  // the queue holds at most low watermark + one message, so the following
+  // messages stay below the high watermark
+  size_t count = (kHighWatermark - kLowWatermark) / kMessageSize - 2;
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT_EQ(kMessageSize, send());
+  }
+
+  for (int i = 0; i < 1000 && m_received.size() < m_expected.size(); ++i) {
+    receive();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  ASSERT_EQ(m_expected.size(), m_received.size());
+  EXPECT_TRUE(m_expected == m_received);
+}
+
+/** messages refused by the full send queue are sent again by the stack in
+ * order once the queue is drained */
+TEST_F(TestTCPSendQueue, oc_send_message_congested)
+{
+  ASSERT_TRUE(fill());
+
+  for (int i = 0; i < 16; ++i) {
+    oc_message_t *msg = newMessage();
+    ASSERT_NE(nullptr, msg);
+    expectMessage(msg);
+    oc_send_message(msg);
+  }
+  oc::TestDevice::PoolEventsMs(50);
+
+  for (int i = 0; i < 500 && m_received.size() < m_expected.size(); ++i) {
+    receive();
+    oc::TestDevice::PoolEventsMs(10);
+  }
+  ASSERT_EQ(m_expected.size(), m_received.size());
+  EXPECT_TRUE(m_expected == m_received);
+}
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 /** fail sending a message to an address without an ongoing or waiting TCP
  * session */
 TEST_F(TestConnectivityWithServer, oc_tcp_send_buffer2_not_connected)
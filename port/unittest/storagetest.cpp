@@ -24,6 +24,7 @@
 #include <algorithm>
 #include <array>
 #include <cstdlib>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <string>
 #include <vector>
@@ -78,4 +79,101 @@ TEST(TestStorage, oc_storage_write)
 
   EXPECT_EQ(0, oc_storage_reset());
 }
+#ifdef OC_STORAGE_KV
+
+static std::vector<uint8_t>
+toBytes(const std::string &str)
+{
+  std::vector<uint8_t> out{};
+  std::copy(str.begin(), str.end(), std::back_inserter(out));
+  return out;
+}
+
+static std::string
+readString(const std::string &store)
+{
+  std::array<uint8_t, 4096> buf{};
+  auto ret = oc_storage_read(store.c_str(), buf.data(), buf.size());
+  if (ret < 0) {
+    return {};
+  }
+  return std::string(buf.begin(), buf.begin() + ret);
+}
+
+TEST(TestStorage, oc_storage_kv_overwrite_and_reopen)
+{
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+
+  auto v1 = toBytes("first");
+  auto v2 = toBytes("second value");
+  auto other = toBytes("other");
+  EXPECT_EQ(static_cast<long>(v1.size()),
+            oc_storage_write("kv_a", v1.data(), v1.size()));
+  EXPECT_EQ(static_cast<long>(other.size()),
+            oc_storage_write("kv_b", other.data(), other.size()));
+  EXPECT_EQ(static_cast<long>(v2.size()),
+            oc_storage_write("kv_a", v2.data(), v2.size()));
+  EXPECT_EQ("second value", readString("kv_a"));
+
+  // the index is rebuilt from the file
+  EXPECT_EQ(0, oc_storage_reset());
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+  EXPECT_EQ("second value", readString("kv_a"));
+  EXPECT_EQ("other", readString("kv_b"));
+
+  const uint8_t *data = nullptr;
+  auto ret = oc_storage_read_view("kv_b", &data);
+  ASSERT_EQ(static_cast<long>(other.size()), ret);
+  EXPECT_EQ(0, memcmp(other.data(), data, other.size()));
+  EXPECT_GT(0, oc_storage_read_view("kv_missing", &data));
+
+  EXPECT_EQ(0, oc_storage_reset());
+}
+
+TEST(TestStorage, oc_storage_kv_compact)
+{
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+
+  // rewrite the same stores enough times to force compaction and growth
+  std::string big(3000, 'x');
+  for (int i = 0; i < 100; ++i) {
+    auto value = toBytes(big + std::to_string(i));
+    ASSERT_EQ(static_cast<long>(value.size()),
+              oc_storage_write("kv_big", value.data(), value.size()));
+    auto small = toBytes(std::to_string(i));
+    ASSERT_EQ(static_cast<long>(small.size()),
+              oc_storage_write("kv_small", small.data(), small.size()));
+  }
+  EXPECT_EQ(big + "99", readString("kv_big"));
+  EXPECT_EQ("99", readString("kv_small"));
+
+  EXPECT_EQ(0, oc_storage_reset());
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+  EXPECT_EQ(big + "99", readString("kv_big"));
+  EXPECT_EQ(0, oc_storage_reset());
+}
+
+TEST(TestStorage, oc_storage_kv_batch)
+{
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+  EXPECT_EQ(0, oc_storage_batch_begin());
+  for (int i = 0; i < 10; ++i) {
+    auto value = toBytes("batch" + std::to_string(i));
+    ASSERT_EQ(static_cast<long>(value.size()),
+              oc_storage_write(("kv_batch_" + std::to_string(i)).c_str(),
+                               value.data(), value.size()));
+  }
+  EXPECT_EQ(0, oc_storage_batch_commit());
+
+  EXPECT_EQ(0, oc_storage_reset());
+  EXPECT_EQ(0, oc_storage_config(testStorage.c_str()));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ("batch" + std::to_string(i),
+              readString("kv_batch_" + std::to_string(i)));
+  }
+  EXPECT_EQ(0, oc_storage_reset());
+}
+
+#endif /* OC_STORAGE_KV */
+
 #endif /* OC_SECURITY */
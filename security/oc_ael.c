@@ -37,13 +37,25 @@ static oc_sec_ael_t *ael;
 #else  /* OC_DYNAMIC_ALLOCATION */
 static oc_sec_ael_t ael[OC_MAX_NUM_DEVICES];
 #endif /* !OC_DYNAMIC_ALLOCATION */
-// Can set specific capacity limits to the below allocators for static builds
-OC_MEMB(events_s, oc_sec_ael_event_t, 1);
-OC_MEMB(aux_s, oc_sec_ael_aux_info_t, 1);
 
 // Theoretical maximum number of entries in the auxiliaryinfo
 #define AEL_AUX_INFO_MAX_ITEMS (256)
 
+/* Header of an event in the ring buffer, followed by the zero-terminated aeid,
+ * message and auxiliaryinfo items. Events are never split at the end of the
+ * buffer, a header with size 0 (or less than a header of space left) marks
+ * that the next event starts at the beginning of the buffer. */
+typedef struct oc_sec_ael_record_t
+{
+  oc_clock_time_t timestamp;
+  uint16_t size;        // size of the whole event, 0 = wrap marker
+  uint16_t aeid_len;    // including the terminating zero, 0 = not set
+  uint16_t message_len; // including the terminating zero, 0 = not set
+  uint16_t aux_count;
+  uint8_t category;
+  uint8_t priority;
+} oc_sec_ael_record_t;
+
 static void oc_sec_ael_reset(size_t device);
 
 static bool oc_sec_ael_add_event(size_t device, uint8_t category,
@@ -56,31 +68,6 @@ static size_t oc_sec_ael_calc_event_size(const char *aeid, const char *message,
                                          const char **aux_info,
                                          size_t aux_size);
 
-static oc_sec_ael_event_t *oc_sec_ael_create_event(
-  size_t device, uint8_t category, uint8_t priority, oc_clock_time_t timestamp,
-  const char *aeid, const char *message, const char **aux_info, size_t aux_size,
-  size_t event_sz);
-static inline void
-oc_sec_ael_free_event(oc_sec_ael_event_t *event)
-{
-  if (event) {
-    if (oc_string_len(event->aeid) > 0) {
-      oc_free_string(&event->aeid);
-    }
-    if (oc_string_len(event->message) > 0) {
-      oc_free_string(&event->message);
-    }
-    oc_sec_ael_aux_info_t *aux =
-      (oc_sec_ael_aux_info_t *)oc_list_pop(event->aux_info);
-    while (aux) {
-      oc_free_string(&aux->aux_info);
-      oc_memb_free(&aux_s, aux);
-      aux = (oc_sec_ael_aux_info_t *)oc_list_pop(event->aux_info);
-    }
-    oc_memb_free(&events_s, event);
-  }
-}
-
 static inline size_t
 oc_sec_ael_max_space(size_t device)
 {
@@ -101,7 +88,7 @@ oc_sec_ael_used_space(size_t device)
 {
   oc_sec_ael_t *a = &ael[device];
   size_t res = 0;
-  switch (ael->unit) {
+  switch (a->unit) {
   case OC_SEC_AEL_UNIT_BYTE:
     res = a->events_size;
     break;
@@ -112,6 +99,102 @@ oc_sec_ael_used_space(size_t device)
   return res;
 }
 
+static inline size_t
+oc_sec_ael_capacity(const oc_sec_ael_t *a)
+{
+  return a->maxsize < OC_SEC_AEL_MAX_SIZE ? a->maxsize : OC_SEC_AEL_MAX_SIZE;
+}
+
+static bool
+oc_sec_ael_read_record(const oc_sec_ael_t *a, size_t pos,
+                       oc_sec_ael_record_t *rec)
+{
+  if (OC_SEC_AEL_MAX_SIZE - pos < sizeof(oc_sec_ael_record_t)) {
+    return false;
+  }
+  memcpy(rec, &a->events[pos], sizeof(oc_sec_ael_record_t));
+  return rec->size != 0;
+}
+
+// move the offset of an event to the beginning of the buffer at a wrap
+static inline size_t
+oc_sec_ael_normalize(const oc_sec_ael_t *a, size_t pos)
+{
+  oc_sec_ael_record_t rec;
+  return oc_sec_ael_read_record(a, pos, &rec) ? pos : 0;
+}
+
+static size_t
+oc_sec_ael_event_at(const oc_sec_ael_t *a, size_t pos,
+                    oc_sec_ael_event_t *event)
+{
+  oc_sec_ael_record_t rec;
+  pos = oc_sec_ael_normalize(a, pos);
+  oc_sec_ael_read_record(a, pos, &rec);
+  const char *data = (const char *)&a->events[pos + sizeof(rec)];
+  event->category = rec.category;
+  event->priority = rec.priority;
+  event->timestamp = rec.timestamp;
+  event->aeid = rec.aeid_len > 0 ? data : NULL;
+  data += rec.aeid_len;
+  event->message = rec.message_len > 0 ? data : NULL;
+  data += rec.message_len;
+  event->aux_len = rec.aux_count;
+  event->aux = data;
+  return pos + rec.size;
+}
+
+static void
+oc_sec_ael_pop_event(oc_sec_ael_t *a)
+{
+  // head always points to an event, never to a wrap
+  oc_sec_ael_record_t rec;
+  oc_sec_ael_read_record(a, a->events_head, &rec);
+  a->events_head += rec.size;
+  a->events_size -= rec.size;
+  --a->events_count;
+  if (a->events_count == 0) {
+    a->events_head = 0;
+    a->events_tail = 0;
+    return;
+  }
+  a->events_head = oc_sec_ael_normalize(a, a->events_head);
+}
+
+/* Find a contiguous space for an event of the given size, evicting the oldest
+ * events as needed. */
+static size_t
+oc_sec_ael_reserve(oc_sec_ael_t *a, size_t size)
+{
+  for (;;) {
+    if (a->events_count == 0) {
+      a->events_head = 0;
+      a->events_tail = 0;
+      return 0;
+    }
+    if (a->events_size + size <= oc_sec_ael_capacity(a)) {
+      if (a->events_tail > a->events_head) {
+        // events are in [head, tail)
+        if (OC_SEC_AEL_MAX_SIZE - a->events_tail >= size) {
+          return a->events_tail;
+        }
+        if (OC_SEC_AEL_MAX_SIZE - a->events_tail >=
+            sizeof(oc_sec_ael_record_t)) {
+          oc_sec_ael_record_t marker;
+          memset(&marker, 0, sizeof(marker));
+          memcpy(&a->events[a->events_tail], &marker, sizeof(marker));
+        }
+        a->events_tail = 0;
+      }
+      // events are in [head, end of buffer) and [0, tail)
+      if (a->events_head - a->events_tail >= size) {
+        return a->events_tail;
+      }
+    }
+    oc_sec_ael_pop_event(a);
+  }
+}
+
 void
 oc_sec_ael_init(void)
 {
@@ -123,7 +206,7 @@ oc_sec_ael_init(void)
 #endif /* OC_DYNAMIC_ALLOCATION */
   size_t device;
   for (device = 0; device < oc_core_get_num_devices(); device++) {
-    OC_LIST_STRUCT_INIT(&ael[device], events);
+    oc_sec_ael_reset(device);
   }
 }
 
@@ -153,6 +236,46 @@ oc_sec_ael_default(size_t device)
   oc_sec_dump_ael(device);
 }
 
+const oc_sec_ael_t *
+oc_sec_get_ael(size_t device)
+{
+  return &ael[device];
+}
+
+#ifdef OC_TEST
+
+void
+oc_sec_ael_set_limits(size_t device, uint8_t categoryfilter,
+                      uint8_t priorityfilter, size_t maxsize)
+{
+  oc_sec_ael_t *a = &ael[device];
+  a->categoryfilter = categoryfilter;
+  a->priorityfilter = priorityfilter;
+  a->maxsize = maxsize;
+}
+
+void
+oc_sec_ael_clear(size_t device)
+{
+  oc_sec_ael_reset(device);
+}
+
+#endif /* OC_TEST */
+
+void
+oc_sec_ael_iterate(size_t device, oc_sec_ael_iterate_fn_t fn, void *data)
+{
+  const oc_sec_ael_t *a = &ael[device];
+  size_t pos = a->events_head;
+  for (size_t i = 0; i < a->events_count; ++i) {
+    oc_sec_ael_event_t event;
+    pos = oc_sec_ael_event_at(a, pos, &event);
+    if (!fn(&event, data)) {
+      return;
+    }
+  }
+}
+
 bool
 oc_sec_ael_add(size_t device, uint8_t category, uint8_t priority,
                const char *aeid, const char *message, const char **aux,
@@ -241,38 +364,37 @@ oc_sec_ael_encode(size_t device, oc_interface_mask_t iface_mask,
   }
   /* events */
   oc_rep_set_array(root, events);
-  for (oc_sec_ael_event_t *e = (oc_sec_ael_event_t *)oc_list_head(a->events); e;
-       e = e->next) {
+  size_t pos = a->events_head;
+  for (size_t i = 0; i < a->events_count; ++i) {
+    oc_sec_ael_event_t e;
+    pos = oc_sec_ael_event_at(a, pos, &e);
     oc_rep_object_array_start_item(events);
     /* category */
-    oc_rep_set_int(events, category, e->category);
+    oc_rep_set_int(events, category, e.category);
     /* priority */
-    oc_rep_set_int(events, priority, e->priority);
+    oc_rep_set_int(events, priority, e.priority);
     /* timestamp */
     if (!to_storage) {
-      if (oc_clock_encode_time_rfc3339(e->timestamp, tmpstr, 64) != 0) {
+      if (oc_clock_encode_time_rfc3339(e.timestamp, tmpstr, 64) != 0) {
         oc_rep_set_text_string(events, timestamp, tmpstr);
       }
     } else {
-      oc_rep_set_int(events, timestamp, e->timestamp);
+      oc_rep_set_int(events, timestamp, e.timestamp);
     }
     /* aeid */
-    if (oc_string_len(e->aeid) > 0) {
-      oc_rep_set_text_string(events, aeid, oc_string(e->aeid));
+    if (e.aeid != NULL) {
+      oc_rep_set_text_string(events, aeid, e.aeid);
     }
     /* message */
-    if (oc_string_len(e->message) > 0) {
-      oc_rep_set_text_string(events, message, oc_string(e->message));
+    if (e.message != NULL) {
+      oc_rep_set_text_string(events, message, e.message);
     }
     /* auxiliaryinfo */
     oc_rep_open_array(events, auxiliaryinfo);
-    if (oc_list_length(e->aux_info) > 0) {
-      oc_sec_ael_aux_info_t *aux =
-        (oc_sec_ael_aux_info_t *)oc_list_head(e->aux_info);
-      while (aux) {
-        oc_rep_add_text_string(auxiliaryinfo, oc_string(aux->aux_info));
-        aux = aux->next;
-      }
+    const char *aux = e.aux;
+    for (size_t j = 0; j < e.aux_len; ++j) {
+      oc_rep_add_text_string(auxiliaryinfo, aux);
+      aux += strlen(aux) + 1;
     }
     oc_rep_close_array(events, auxiliaryinfo);
     oc_rep_object_array_end_item(events);
@@ -394,11 +516,10 @@ static void
 oc_sec_ael_reset(size_t device)
 {
   oc_sec_ael_t *a = &ael[device];
-  oc_sec_ael_event_t *e = (oc_sec_ael_event_t *)oc_list_pop(a->events);
-  while (e) {
-    oc_sec_ael_free_event(e);
-    e = (oc_sec_ael_event_t *)oc_list_pop(a->events);
-  }
+  a->events_size = 0;
+  a->events_count = 0;
+  a->events_head = 0;
+  a->events_tail = 0;
 }
 
 static bool
@@ -407,7 +528,6 @@ oc_sec_ael_add_event(size_t device, uint8_t category, uint8_t priority,
                      const char *message, const char **aux, size_t aux_len,
                      bool write_to_storage)
 {
-  bool res = false;
   oc_sec_ael_t *a = &ael[device];
 
   if (!(a->categoryfilter & category) || (a->priorityfilter < priority)) {
@@ -418,48 +538,62 @@ oc_sec_ael_add_event(size_t device, uint8_t category, uint8_t priority,
   // calculate total event size
   size_t event_sz = oc_sec_ael_calc_event_size(aeid, message, aux, aux_len);
   // check size
-  if (event_sz > a->maxsize) {
+  if (event_sz > oc_sec_ael_capacity(a) || event_sz > UINT16_MAX ||
+      aux_len > AEL_AUX_INFO_MAX_ITEMS) {
     OC_ERR("event size exceeds available size!");
-  } else {
-    // delete old events if needed
-    while ((event_sz + a->events_size) > a->maxsize &&
-           oc_list_length(a->events) > 0) {
-      oc_sec_ael_event_t *t = (oc_sec_ael_event_t *)oc_list_pop(a->events);
-      a->events_size -= t->size;
-      oc_sec_ael_free_event(t);
-    }
-    // create/add event
-    oc_sec_ael_event_t *e =
-      oc_sec_ael_create_event(device, category, priority, timestamp, aeid,
-                              message, aux, aux_len, event_sz);
-    if (!e) {
-      OC_ERR("Can't create event!");
-    } else {
-      a->events_size += e->size;
-      // write to storage
-      if (write_to_storage) {
-        oc_sec_dump_ael(device);
-      }
-      res = true;
-    }
+    return false;
   }
-  return res;
+
+  // delete old events if needed and write the event in place
+  size_t pos = oc_sec_ael_reserve(a, event_sz);
+  oc_sec_ael_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.timestamp = timestamp;
+  rec.size = (uint16_t)event_sz;
+  rec.category = category;
+  rec.priority = priority;
+  rec.aux_count = (uint16_t)aux_len;
+  uint8_t *data = &a->events[pos + sizeof(rec)];
+  if (aeid && aeid[0] != '\0') {
+    rec.aeid_len = (uint16_t)(strlen(aeid) + 1);
+    memcpy(data, aeid, rec.aeid_len);
+    data += rec.aeid_len;
+  }
+  if (message && message[0] != '\0') {
+    rec.message_len = (uint16_t)(strlen(message) + 1);
+    memcpy(data, message, rec.message_len);
+    data += rec.message_len;
+  }
+  for (size_t i = 0; i < aux_len; i++) {
+    size_t len = strlen(aux[i]) + 1;
+    memcpy(data, aux[i], len);
+    data += len;
+  }
+  memcpy(&a->events[pos], &rec, sizeof(rec));
+  a->events_tail = pos + event_sz;
+  a->events_size += event_sz;
+  ++a->events_count;
+
+  // write to storage
+  if (write_to_storage) {
+    oc_sec_dump_ael(device);
+  }
+  return true;
 }
 
 static size_t
 oc_sec_ael_calc_event_size(const char *aeid, const char *message,
                            const char **aux_info, size_t aux_size)
 {
-  size_t res = sizeof(oc_sec_ael_event_t);
+  size_t res = sizeof(oc_sec_ael_record_t);
 
-  if (aeid) {
+  if (aeid && aeid[0] != '\0') {
     res += (strlen(aeid) + 1);
   }
-  if (message) {
+  if (message && message[0] != '\0') {
     res += (strlen(message) + 1);
   }
   if (aux_info && aux_size != 0) {
-    res += (aux_size * sizeof(char *));
     for (size_t i = 0; i < aux_size; i++) {
       res += (strlen(aux_info[i]) + 1);
     }
@@ -467,45 +601,4 @@ oc_sec_ael_calc_event_size(const char *aeid, const char *message,
   return res;
 }
 
-static oc_sec_ael_event_t *
-oc_sec_ael_create_event(size_t device, uint8_t category, uint8_t priority,
-                        oc_clock_time_t timestamp, const char *aeid,
-                        const char *message, const char **aux_info,
-                        size_t aux_size, size_t event_sz)
-{
-  // allocate memory
-  oc_sec_ael_event_t *res = (oc_sec_ael_event_t *)oc_memb_alloc(&events_s);
-  if (!res) {
-    OC_ERR("Out of memory!");
-    return NULL;
-  }
-  OC_LIST_STRUCT_INIT(res, aux_info);
-  res->size = event_sz;
-  res->category = category;
-  res->priority = priority;
-  res->timestamp = timestamp;
-  if (aeid && strlen(aeid) > 0) {
-    oc_new_string(&res->aeid, aeid, strlen(aeid));
-  }
-  if (message && strlen(message) > 0) {
-    oc_new_string(&res->message, message, strlen(message));
-  }
-  if (aux_info && aux_size > 0) {
-    size_t i;
-    for (i = 0; i < aux_size; i++) {
-      oc_sec_ael_aux_info_t *a_info =
-        (oc_sec_ael_aux_info_t *)oc_memb_alloc(&aux_s);
-      if (a_info) {
-        oc_new_string(&a_info->aux_info, aux_info[i], strlen(aux_info[i]));
-        oc_list_add(res->aux_info, a_info);
-      }
-    }
-  }
-
-  oc_sec_ael_t *a = &ael[device];
-  oc_list_add(a->events, res);
-
-  return res;
-}
-
 #endif /* OC_SECURITY */
@@ -28,22 +28,19 @@
 extern "C" {
 #endif
 
-typedef struct oc_sec_ael_aux_info_t
-{
-  struct oc_sec_ael_aux_info_t *next;
-  oc_string_t aux_info;
-} oc_sec_ael_aux_info_t;
-
+/**
+ * @brief View of an event stored in the AEL ring buffer. The strings point
+ * into the ring buffer and are valid until the next change of the AEL.
+ */
 typedef struct oc_sec_ael_event_t
 {
-  struct oc_sec_ael_event_t *next;
-  size_t size;
   uint8_t category;
   uint8_t priority;
   oc_clock_time_t timestamp;
-  oc_string_t aeid;
-  oc_string_t message;
-  OC_LIST_STRUCT(aux_info);
+  const char *aeid;    ///< NULL if not set
+  const char *message; ///< NULL if not set
+  size_t aux_len;      ///< number of auxiliaryinfo items
+  const char *aux; ///< aux_len consecutive zero-terminated auxiliaryinfo items
 } oc_sec_ael_event_t;
 
 typedef enum {
@@ -72,6 +69,12 @@ typedef enum {
              // (due to buffer limitations used in file I/O operations (8K)
              // and CBOR format redundancy)
 
+/* Minimal window (in milliseconds) in which the writes of the AEL to storage
+ * are coalesced. */
+#ifndef OC_SEC_AEL_WRITE_BEHIND_WINDOW_MS
+#define OC_SEC_AEL_WRITE_BEHIND_WINDOW_MS (1000)
+#endif /* OC_SEC_AEL_WRITE_BEHIND_WINDOW_MS */
+
 typedef enum {
   OC_SEC_AEL_UNIT_BYTE = 0,
   OC_SEC_AEL_UNIT_KBYTE,
@@ -84,15 +87,42 @@ typedef struct oc_sec_ael_t
   uint8_t priorityfilter;
   size_t maxsize;
   oc_sec_ael_unit_t unit;
-  size_t events_size;
-  OC_LIST_STRUCT(events);
+  size_t events_size;  ///< bytes of the ring buffer used by the events
+  size_t events_count; ///< number of events in the ring buffer
+  size_t events_head;  ///< offset of the oldest event
+  size_t events_tail;  ///< offset at which the next event is written
+  uint8_t events[OC_SEC_AEL_MAX_SIZE]; ///< ring buffer of events
 } oc_sec_ael_t;
 
+/**
+ * @brief Callback invoked for each event by oc_sec_ael_iterate.
+ *
+ * @return true to continue the iteration
+ * @return false to stop the iteration
+ */
+typedef bool (*oc_sec_ael_iterate_fn_t)(const oc_sec_ael_event_t *event,
+                                        void *data);
+
 void oc_sec_ael_init(void);
 void oc_sec_ael_free(void);
 
 void oc_sec_ael_default(size_t device);
 
+/**
+ * @brief Get the AEL of the device, the ring buffer is modified only through
+ * the oc_sec_ael_* functions.
+ */
+const oc_sec_ael_t *oc_sec_get_ael(size_t device);
+
+/**
+ * @brief Iterate the events of the device from the oldest to the newest.
+ *
+ * @param device index of the device
+ * @param fn callback invoked for each event (cannot be NULL)
+ * @param data user data passed to the callback
+ */
+void oc_sec_ael_iterate(size_t device, oc_sec_ael_iterate_fn_t fn, void *data);
+
 bool oc_sec_ael_add(size_t device, uint8_t category, uint8_t priority,
                     const char *aeid, const char *message, const char **aux,
                     size_t aux_len);
@@ -105,6 +135,17 @@ bool oc_sec_ael_encode(size_t device, oc_interface_mask_t iface_mask,
                        bool to_storage);
 bool oc_sec_ael_decode(size_t device, const oc_rep_t *rep, bool from_storage);
 
+#ifdef OC_TEST
+
+/** @brief Set the filters and the maximal size of the AEL. */
+void oc_sec_ael_set_limits(size_t device, uint8_t categoryfilter,
+                           uint8_t priorityfilter, size_t maxsize);
+
+/** @brief Drop all events without writing the AEL to storage. */
+void oc_sec_ael_clear(size_t device);
+
+#endif /* OC_TEST */
+
 #ifdef __cplusplus
 }
 #endif
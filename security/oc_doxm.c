@@ -226,6 +226,7 @@ oc_sec_doxm_default(size_t device)
   oc_sec_doxm_set_default(&g_doxm[device]);
   oc_device_info_t *d = oc_core_get_device_info(device);
   memcpy(d->di.id, g_doxm[device].deviceuuid.id, sizeof(d->di.id));
+  oc_core_device_info_changed(device);
   oc_sec_dump_doxm(device);
 }
 
@@ -666,6 +667,7 @@ oc_sec_decode_doxm(const oc_rep_t *rep, bool from_storage, bool doc,
     oc_uuid_t *deviceuuid = oc_core_get_device_id(device);
     memcpy(deviceuuid->id, g_doxm[device].deviceuuid.id,
            sizeof(deviceuuid->id));
+    oc_core_device_info_changed(device);
   }
 
   if (devowneruuid_str != NULL) {
@@ -26,8 +26,80 @@
 #include "oc_rep.h"
 #include "oc_store.h"
 #include "port/oc_log_internal.h"
+#include "util/oc_hash.h"
 OC_LIST(contexts);
 OC_MEMB(ctx_s, oc_oscore_context_t, 1);
+static oc_oscore_context_t *g_ctx_by_kid[OC_OSCORE_CONTEXT_HASH_SIZE];
+static oc_oscore_context_t *g_ctx_by_uuid[OC_OSCORE_CONTEXT_HASH_SIZE];
+
+static size_t
+oscore_context_hash(size_t device, const uint8_t *data, size_t data_len)
+{
+  uint32_t hash = oc_hash_fnv1a(OC_HASH_FNV1A_BASIS, data, data_len);
+  hash = oc_hash_fnv1a(hash, &device, sizeof(device));
+  return hash % OC_OSCORE_CONTEXT_HASH_SIZE;
+}
+
+static oc_oscore_context_t **
+oscore_context_kid_bucket(size_t device, const uint8_t *kid, uint8_t kid_len)
+{
+  return &g_ctx_by_kid[oscore_context_hash(device, kid, kid_len)];
+}
+
+static oc_oscore_context_t **
+oscore_context_uuid_bucket(size_t device, const oc_uuid_t *uuid)
+{
+  return &g_ctx_by_uuid[oscore_context_hash(device, uuid->id,
+                                            sizeof(uuid->id))];
+}
+
+static const oc_uuid_t *
+oscore_context_uuid(const oc_oscore_context_t *ctx)
+{
+  return &((const oc_sec_cred_t *)ctx->cred)->subjectuuid;
+}
+
+static void
+oscore_context_index(oc_oscore_context_t *ctx)
+{
+  /* append to keep the lookup order equal to the order of insertion */
+  oc_oscore_context_t **it =
+    oscore_context_kid_bucket(ctx->device, ctx->recvid, ctx->recvid_len);
+  while (*it != NULL) {
+    it = &(*it)->kid_next;
+  }
+  ctx->kid_next = NULL;
+  *it = ctx;
+
+  it = oscore_context_uuid_bucket(ctx->device, oscore_context_uuid(ctx));
+  while (*it != NULL) {
+    it = &(*it)->uuid_next;
+  }
+  ctx->uuid_next = NULL;
+  *it = ctx;
+}
+
+static void
+oscore_context_unindex(oc_oscore_context_t *ctx)
+{
+  oc_oscore_context_t **it =
+    oscore_context_kid_bucket(ctx->device, ctx->recvid, ctx->recvid_len);
+  for (; *it != NULL; it = &(*it)->kid_next) {
+    if (*it == ctx) {
+      *it = ctx->kid_next;
+      break;
+    }
+  }
+  it = oscore_context_uuid_bucket(ctx->device, oscore_context_uuid(ctx));
+  for (; *it != NULL; it = &(*it)->uuid_next) {
+    if (*it == ctx) {
+      *it = ctx->uuid_next;
+      break;
+    }
+  }
+  ctx->kid_next = NULL;
+  ctx->uuid_next = NULL;
+}
 
 oc_oscore_context_t *
 oc_oscore_find_group_context(void)
@@ -51,14 +123,14 @@ oc_oscore_find_context_by_kid(oc_oscore_context_t *ctx, size_t device,
                               const uint8_t *kid, uint8_t kid_len)
 {
   if (!ctx) {
-    ctx = (oc_oscore_context_t *)oc_list_head(contexts);
+    ctx = *oscore_context_kid_bucket(device, kid, kid_len);
   }
   while (ctx != NULL) {
     if (ctx->device == device && kid_len == ctx->recvid_len &&
         memcmp(kid, ctx->recvid, kid_len) == 0) {
       return ctx;
     }
-    ctx = ctx->next;
+    ctx = ctx->kid_next;
   }
   return ctx;
 }
@@ -97,29 +169,19 @@ oc_oscore_find_context_by_token_mid(size_t device, uint8_t *token,
 #ifdef OC_CLIENT
   }
 #endif /* OC_CLIENT */
-  oc_oscore_context_t *ctx = (oc_oscore_context_t *)oc_list_head(contexts);
-  while (ctx != NULL) {
-    oc_sec_cred_t *cred = (oc_sec_cred_t *)ctx->cred;
-    if (memcmp(cred->subjectuuid.id, uuid->id, 16) == 0 &&
-        ctx->device == device) {
-      return ctx;
-    }
-    ctx = ctx->next;
-  }
-  return NULL;
+  return oc_oscore_find_context_by_UUID(device, uuid);
 }
 
 oc_oscore_context_t *
 oc_oscore_find_context_by_UUID(size_t device, oc_uuid_t *uuid)
 {
-  oc_oscore_context_t *ctx = (oc_oscore_context_t *)oc_list_head(contexts);
+  oc_oscore_context_t *ctx = *oscore_context_uuid_bucket(device, uuid);
   while (ctx != NULL) {
-    oc_sec_cred_t *cred = (oc_sec_cred_t *)ctx->cred;
-    if (memcmp(cred->subjectuuid.id, uuid->id, 16) == 0 &&
+    if (memcmp(oscore_context_uuid(ctx)->id, uuid->id, 16) == 0 &&
         ctx->device == device) {
       return ctx;
     }
-    ctx = ctx->next;
+    ctx = ctx->uuid_next;
   }
   return ctx;
 }
@@ -131,6 +193,9 @@ oc_oscore_free_context(oc_oscore_context_t *ctx)
     if (ctx->desc.size > 0) {
       oc_free_string(&ctx->desc);
     }
+    oscore_context_unindex(ctx);
+    mbedtls_ccm_free(&ctx->sendccm);
+    mbedtls_ccm_free(&ctx->recvccm);
     oc_list_remove(contexts, ctx);
     oc_memb_free(&ctx_s, ctx);
   }
@@ -147,6 +212,8 @@ oc_oscore_add_context(size_t device, const char *senderid,
     return NULL;
   }
 
+  mbedtls_ccm_init(&ctx->sendccm);
+  mbedtls_ccm_init(&ctx->recvccm);
   ctx->device = device;
   ctx->ssn = ssn;
   /* To prevent SSN reuse, bump to higher value that could've been previously
@@ -224,15 +291,98 @@ oc_oscore_add_context(size_t device, const char *senderid,
 
   OC_DBG("### derived Common IV ###");
 
+  /* Key the AEAD contexts and build the nonce and AAD templates once, so that
+   * protecting or verifying a message doesn't redo the key schedule */
+  ctx->sendccm_keyed = false;
+  ctx->recvccm_keyed = false;
+  if (senderid) {
+    if (oc_oscore_ccm_setkey(&ctx->sendccm, ctx->sendkey, OSCORE_KEY_LEN) !=
+        0) {
+      goto add_oscore_context_error;
+    }
+    ctx->sendccm_keyed = true;
+  }
+  if (recipientid) {
+    if (oc_oscore_ccm_setkey(&ctx->recvccm, ctx->recvkey, OSCORE_KEY_LEN) !=
+        0) {
+      goto add_oscore_context_error;
+    }
+    ctx->recvccm_keyed = true;
+  }
+  oc_oscore_AEAD_nonce_template(ctx->sendid, ctx->sendid_len, ctx->commoniv,
+                                ctx->send_nonce);
+  oc_oscore_AEAD_nonce_template(ctx->recvid, ctx->recvid_len, ctx->commoniv,
+                                ctx->recv_nonce);
+  if (oc_oscore_AAD_template(ctx->sendid, ctx->sendid_len, ctx->send_aad,
+                             &ctx->send_aad_len) < 0 ||
+      oc_oscore_AAD_template(ctx->recvid, ctx->recvid_len, ctx->recv_aad,
+                             &ctx->recv_aad_len) < 0) {
+    goto add_oscore_context_error;
+  }
+
   oc_list_add(contexts, ctx);
+  oscore_context_index(ctx);
 
   return ctx;
 
 add_oscore_context_error:
+  mbedtls_ccm_free(&ctx->sendccm);
+  mbedtls_ccm_free(&ctx->recvccm);
+  if (ctx->desc.size > 0) {
+    oc_free_string(&ctx->desc);
+  }
   oc_memb_free(&ctx_s, ctx);
   return NULL;
 }
 
+mbedtls_ccm_context *
+oc_oscore_context_sender_ccm(oc_oscore_context_t *ctx)
+{
+  return ctx->sendccm_keyed ? &ctx->sendccm : NULL;
+}
+
+mbedtls_ccm_context *
+oc_oscore_context_recipient_ccm(oc_oscore_context_t *ctx)
+{
+  return ctx->recvccm_keyed ? &ctx->recvccm : NULL;
+}
+
+bool
+oc_oscore_context_is_replay(const oc_oscore_context_t *ctx, uint64_t piv)
+{
+  if (!ctx->rwin_valid || piv > ctx->rwin_max_piv) {
+    return false;
+  }
+  uint64_t diff = ctx->rwin_max_piv - piv;
+  if (diff >= OSCORE_REPLAY_WINDOW_SIZE) {
+    /* too old to be tracked by the window */
+    return true;
+  }
+  return (ctx->rwin & ((uint64_t)1 << diff)) != 0;
+}
+
+void
+oc_oscore_context_update_replay_window(oc_oscore_context_t *ctx, uint64_t piv)
+{
+  if (!ctx->rwin_valid) {
+    ctx->rwin_valid = true;
+    ctx->rwin_max_piv = piv;
+    ctx->rwin = 1;
+    return;
+  }
+  if (piv > ctx->rwin_max_piv) {
+    uint64_t shift = piv - ctx->rwin_max_piv;
+    ctx->rwin = shift >= OSCORE_REPLAY_WINDOW_SIZE ? 0 : ctx->rwin << shift;
+    ctx->rwin |= 1;
+    ctx->rwin_max_piv = piv;
+    return;
+  }
+  uint64_t diff = ctx->rwin_max_piv - piv;
+  if (diff < OSCORE_REPLAY_WINDOW_SIZE) {
+    ctx->rwin |= (uint64_t)1 << diff;
+  }
+}
+
 int
 oc_oscore_context_derive_param(const uint8_t *id, uint8_t id_len,
                                uint8_t *id_ctx, uint8_t id_ctx_len,
@@ -21,7 +21,9 @@
 
 #include "messaging/coap/oscore_constants.h"
 #include "oc_helpers.h"
+#include "oc_oscore_crypto.h"
 #include "oc_uuid.h"
+#include <mbedtls/ccm.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -30,9 +32,20 @@
 extern "C" {
 #endif
 
+#ifndef OC_OSCORE_CONTEXT_HASH_SIZE
+/* Number of buckets of the (device, kid) and (device, uuid) context indexes */
+#define OC_OSCORE_CONTEXT_HASH_SIZE (16)
+#endif /* OC_OSCORE_CONTEXT_HASH_SIZE */
+
+#if OSCORE_REPLAY_WINDOW_SIZE > 64
+#error "OSCORE_REPLAY_WINDOW_SIZE cannot be larger than 64"
+#endif /* OSCORE_REPLAY_WINDOW_SIZE > 64 */
+
 typedef struct oc_oscore_context_t
 {
   struct oc_oscore_context_t *next;
+  struct oc_oscore_context_t *kid_next;  /* next in the (device, kid) bucket */
+  struct oc_oscore_context_t *uuid_next; /* next in the (device, uuid) bucket */
   /* Provisioned parameters */
   void *cred; /* cred entry contains the master secret */
   size_t device;
@@ -50,9 +63,25 @@ typedef struct oc_oscore_context_t
   uint8_t recvkey[OSCORE_KEY_LEN];
   /* Common IV */
   uint8_t commoniv[OSCORE_COMMON_IV_LEN];
-  /* Replay Window */
-  uint64_t rwin[OSCORE_REPLAY_WINDOW_SIZE];
-  uint8_t rwin_idx;
+  /* Precomputed from the derived parameters */
+  /* AES-CCM contexts keyed with sendkey and recvkey, a context is keyed only
+   * if the corresponding ID was provided */
+  mbedtls_ccm_context sendccm;
+  mbedtls_ccm_context recvccm;
+  bool sendccm_keyed;
+  bool recvccm_keyed;
+  /* AEAD nonce templates for sendid and recvid */
+  uint8_t send_nonce[OSCORE_AEAD_NONCE_LEN];
+  uint8_t recv_nonce[OSCORE_AEAD_NONCE_LEN];
+  /* AAD templates with sendid and recvid as request_kid */
+  uint8_t send_aad[OC_OSCORE_AAD_TEMPLATE_MAX_LEN];
+  uint8_t send_aad_len;
+  uint8_t recv_aad[OC_OSCORE_AAD_TEMPLATE_MAX_LEN];
+  uint8_t recv_aad_len;
+  /* Replay Window (RFC 8613, Section 7.4) */
+  uint64_t rwin_max_piv; /* highest Partial IV received so far */
+  uint64_t rwin;    /* bit i set = (rwin_max_piv - i) has been received */
+  bool rwin_valid;  /* set after the first request has been accepted */
 } oc_oscore_context_t;
 
 int oc_oscore_context_derive_param(const uint8_t *id, uint8_t id_len,
@@ -83,6 +112,49 @@ oc_oscore_context_t *oc_oscore_find_context_by_token_mid(
 
 oc_oscore_context_t *oc_oscore_find_group_context(void);
 
+/**
+ * @brief Get the AEAD context keyed with the Sender key.
+ *
+ * @param ctx the OSCORE context (cannot be NULL)
+ * @return mbedtls_ccm_context* the keyed AEAD context
+ * @return NULL if the OSCORE context has no Sender ID
+ */
+mbedtls_ccm_context *oc_oscore_context_sender_ccm(oc_oscore_context_t *ctx);
+
+/**
+ * @brief Get the AEAD context keyed with the Recipient key.
+ *
+ * @param ctx the OSCORE context (cannot be NULL)
+ * @return mbedtls_ccm_context* the keyed AEAD context
+ * @return NULL if the OSCORE context has no Recipient ID
+ */
+mbedtls_ccm_context *oc_oscore_context_recipient_ccm(oc_oscore_context_t *ctx);
+
+/**
+ * @brief Check whether a request with the given Partial IV is a replay.
+ *
+ * A request is a replay if its Partial IV has already been accepted or if it
+ * is older than the replay window.
+ *
+ * @param ctx the OSCORE context (cannot be NULL)
+ * @param piv the Partial IV of the request
+ * @return true the request is a replay and must be rejected
+ * @return false otherwise
+ */
+bool oc_oscore_context_is_replay(const oc_oscore_context_t *ctx, uint64_t piv);
+
+/**
+ * @brief Mark the Partial IV as received and slide the replay window.
+ *
+ * Should be called only after the request has been successfully verified, so
+ * that forged messages cannot move the window.
+ *
+ * @param ctx the OSCORE context (cannot be NULL)
+ * @param piv the Partial IV of the verified request
+ */
+void oc_oscore_context_update_replay_window(oc_oscore_context_t *ctx,
+                                            uint64_t piv);
+
 #ifdef __cplusplus
 }
 #endif
@@ -252,24 +252,163 @@ oc_oscore_compose_AAD(uint8_t *kid, uint8_t kid_len, uint8_t *piv,
   return 0;
 }
 
+void
+oc_oscore_AEAD_nonce_template(const uint8_t *id, uint8_t id_len,
+                              const uint8_t *civ, uint8_t *tmpl)
+{
+  /* Same layout as oc_oscore_AEAD_nonce with an all-zero Partial IV, the
+   * Partial IV is XORed into the last bytes for each message. */
+  memset(tmpl, 0, OSCORE_AEAD_NONCE_LEN);
+  memcpy(tmpl + (OSCORE_AEAD_NONCE_LEN - 5 - id_len), id, id_len);
+  tmpl[0] = id_len;
+  for (int i = 0; i < OSCORE_AEAD_NONCE_LEN; i++) {
+    tmpl[i] = tmpl[i] ^ civ[i];
+  }
+}
+
+void
+oc_oscore_AEAD_nonce_from_template(const uint8_t *tmpl, const uint8_t *piv,
+                                   uint8_t piv_len, uint8_t *nonce)
+{
+  memcpy(nonce, tmpl, OSCORE_AEAD_NONCE_LEN);
+  uint8_t *p = nonce + (OSCORE_AEAD_NONCE_LEN - piv_len);
+  for (uint8_t i = 0; i < piv_len; i++) {
+    p[i] = p[i] ^ piv[i];
+  }
+}
+
+static size_t
+oscore_cbor_bstr_header(size_t len, uint8_t *out)
+{
+  /* Major type 2 (byte string) */
+  if (len < 24) {
+    out[0] = (uint8_t)(0x40 | len);
+    return 1;
+  }
+  out[0] = 0x58;
+  out[1] = (uint8_t)len;
+  return 2;
+}
+
 int
-oc_oscore_encrypt(uint8_t *plaintext, size_t plaintext_len, size_t tag_len,
-                  uint8_t *key, size_t key_len, uint8_t *nonce,
-                  size_t nonce_len, uint8_t *AAD, size_t AAD_len,
-                  uint8_t *output)
+oc_oscore_AAD_template(const uint8_t *kid, uint8_t kid_len, uint8_t *tmpl,
+                       uint8_t *tmpl_len)
 {
-  mbedtls_ccm_context ccm;
-  mbedtls_ccm_init(&ccm);
-  mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, key_len * 8);
+  if (kid_len > OSCORE_CTXID_LEN) {
+    return -1;
+  }
+  /* Leading part of aad_array that does not depend on the message:
+     [ 1, [ 10 ], request_kid, ...
+  */
+  size_t len = 0;
+  tmpl[len++] = 0x85; /* Array of 5 elements */
+  tmpl[len++] = 0x01; /* oscore_version: 1 */
+  tmpl[len++] = 0x81; /* algorithms: array of 1 element */
+  tmpl[len++] = 0x0a; /* alg_aead: 10 */
+  len += oscore_cbor_bstr_header(kid_len, tmpl + len);
+  if (kid_len > 0) {
+    memcpy(tmpl + len, kid, kid_len);
+    len += kid_len;
+  }
+  *tmpl_len = (uint8_t)len;
+  return 0;
+}
+
+int
+oc_oscore_compose_AAD_from_template(const uint8_t *tmpl, uint8_t tmpl_len,
+                                    const uint8_t *piv, uint8_t piv_len,
+                                    uint8_t *AAD, uint8_t *AAD_len)
+{
+  /* request_piv header + request_piv + empty options bstr */
+  size_t aad_array_len = tmpl_len + 1 + piv_len + 1;
+  if (piv_len > OSCORE_PIV_LEN || aad_array_len > 0xff ||
+      aad_array_len + 13 > OSCORE_AAD_MAX_LEN) {
+    return -1;
+  }
+  /* AAD = [ "Encrypt0", h'', bstr .cbor aad_array ], see
+   * oc_oscore_compose_AAD */
+  static const uint8_t enc_structure[] = { 0x83, 0x68, 'E', 'n', 'c', 'r',
+                                           'y',  'p',  't', '0', 0x40 };
+  size_t len = sizeof(enc_structure);
+  memcpy(AAD, enc_structure, len);
+  len += oscore_cbor_bstr_header(aad_array_len, AAD + len);
+  memcpy(AAD + len, tmpl, tmpl_len);
+  len += tmpl_len;
+  len += oscore_cbor_bstr_header(piv_len, AAD + len);
+  if (piv_len > 0) {
+    memcpy(AAD + len, piv, piv_len);
+    len += piv_len;
+  }
+  AAD[len++] = 0x40; /* options: Class I options, none defined */
+  *AAD_len = (uint8_t)len;
+  return 0;
+}
+
+int
+oc_oscore_ccm_setkey(mbedtls_ccm_context *ccm, const uint8_t *key,
+                     size_t key_len)
+{
+  int ret = mbedtls_ccm_setkey(ccm, MBEDTLS_CIPHER_ID_AES, key,
+                               (unsigned int)(key_len * 8));
+  if (ret != 0) {
+    OC_ERR("***error setting OSCORE AEAD key: mbedtls (%d)***", ret);
+  }
+  return ret;
+}
 
-  int ret = mbedtls_ccm_encrypt_and_tag(&ccm, plaintext_len, nonce, nonce_len,
+int
+oc_oscore_encrypt_ccm(mbedtls_ccm_context *ccm, uint8_t *plaintext,
+                      size_t plaintext_len, size_t tag_len,
+                      const uint8_t *nonce, size_t nonce_len,
+                      const uint8_t *AAD, size_t AAD_len, uint8_t *output)
+{
+  if (ccm == NULL) {
+    OC_ERR("***error encrypting OSCORE plaintext: no Sender key***");
+    return MBEDTLS_ERR_CCM_BAD_INPUT;
+  }
+  int ret = mbedtls_ccm_encrypt_and_tag(ccm, plaintext_len, nonce, nonce_len,
                                         AAD, AAD_len, plaintext, output,
                                         plaintext + plaintext_len, tag_len);
 
   if (ret != 0) {
     OC_ERR("***error encrypting OSCORE plaintext: mbedtls (%d)***", ret);
   }
+  return ret;
+}
 
+int
+oc_oscore_decrypt_ccm(mbedtls_ccm_context *ccm, uint8_t *ciphertext,
+                      size_t ciphertext_len, size_t tag_len,
+                      const uint8_t *nonce, size_t nonce_len,
+                      const uint8_t *AAD, size_t AAD_len, uint8_t *output)
+{
+  if (ccm == NULL) {
+    OC_ERR("***error decrypting OSCORE payload: no Recipient key***");
+    return MBEDTLS_ERR_CCM_BAD_INPUT;
+  }
+  int ret = mbedtls_ccm_auth_decrypt(
+    ccm, ciphertext_len - tag_len, nonce, nonce_len, AAD, AAD_len, ciphertext,
+    output, ciphertext + ciphertext_len - tag_len, tag_len);
+
+  if (ret != 0) {
+    OC_ERR("***error decrypting/verifying response: mbedtls (%d)***", ret);
+  }
+  return ret;
+}
+
+int
+oc_oscore_encrypt(uint8_t *plaintext, size_t plaintext_len, size_t tag_len,
+                  uint8_t *key, size_t key_len, uint8_t *nonce,
+                  size_t nonce_len, uint8_t *AAD, size_t AAD_len,
+                  uint8_t *output)
+{
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  int ret = oc_oscore_ccm_setkey(&ccm, key, key_len);
+  if (ret == 0) {
+    ret = oc_oscore_encrypt_ccm(&ccm, plaintext, plaintext_len, tag_len, nonce,
+                                nonce_len, AAD, AAD_len, output);
+  }
   mbedtls_ccm_free(&ccm);
   return ret;
 }
@@ -282,16 +421,11 @@ oc_oscore_decrypt(uint8_t *ciphertext, size_t ciphertext_len, size_t tag_len,
 {
   mbedtls_ccm_context ccm;
   mbedtls_ccm_init(&ccm);
-  mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, key_len * 8);
-
-  int ret = mbedtls_ccm_auth_decrypt(
-    &ccm, ciphertext_len - tag_len, nonce, nonce_len, AAD, AAD_len, ciphertext,
-    output, ciphertext + ciphertext_len - tag_len, tag_len);
-
-  if (ret != 0) {
-    OC_ERR("***error decrypting/verifying response: mbedtls (%d)***", ret);
+  int ret = oc_oscore_ccm_setkey(&ccm, key, key_len);
+  if (ret == 0) {
+    ret = oc_oscore_decrypt_ccm(&ccm, ciphertext, ciphertext_len, tag_len,
+                                nonce, nonce_len, AAD, AAD_len, output);
   }
-
   mbedtls_ccm_free(&ccm);
   return ret;
 }
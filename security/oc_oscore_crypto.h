@@ -19,6 +19,8 @@
 #ifndef OC_OSCORE_CRYPTO_H
 #define OC_OSCORE_CRYPTO_H
 
+#include "messaging/coap/oscore_constants.h"
+#include <mbedtls/ccm.h>
 #include <inttypes.h>
 #include <stddef.h>
 
@@ -26,6 +28,10 @@
 extern "C" {
 #endif
 
+/* Length of the message independent prefix of aad_array: array header,
+ * oscore_version, algorithms and request_kid */
+#define OC_OSCORE_AAD_TEMPLATE_MAX_LEN (4 + 1 + OSCORE_CTXID_LEN)
+
 int HKDF_SHA256(const uint8_t *salt, uint8_t salt_len, const uint8_t *ikm,
                 uint8_t ikm_len, uint8_t *info, uint8_t info_len, uint8_t *okm,
                 uint8_t okm_len);
@@ -37,6 +43,92 @@ void oc_oscore_AEAD_nonce(uint8_t *id, uint8_t id_len, uint8_t *piv,
 int oc_oscore_compose_AAD(uint8_t *kid, uint8_t kid_len, uint8_t *piv,
                           uint8_t piv_len, uint8_t *AAD, uint8_t *AAD_len);
 
+/**
+ * @brief Precompute the part of the AEAD nonce that is fixed for a given
+ * Sender ID and Common IV.
+ *
+ * @param id Sender ID (at most OSCORE_CTXID_LEN bytes)
+ * @param id_len length of the Sender ID
+ * @param civ Common IV (OSCORE_COMMON_IV_LEN bytes)
+ * @param[out] tmpl output template (OSCORE_AEAD_NONCE_LEN bytes)
+ */
+void oc_oscore_AEAD_nonce_template(const uint8_t *id, uint8_t id_len,
+                                   const uint8_t *civ, uint8_t *tmpl);
+
+/**
+ * @brief Compute the AEAD nonce of a message from a template created by
+ * oc_oscore_AEAD_nonce_template. The result is identical to
+ * oc_oscore_AEAD_nonce.
+ *
+ * @param tmpl nonce template
+ * @param piv Partial IV (at most OSCORE_PIV_LEN bytes)
+ * @param piv_len length of the Partial IV
+ * @param[out] nonce output nonce (OSCORE_AEAD_NONCE_LEN bytes)
+ */
+void oc_oscore_AEAD_nonce_from_template(const uint8_t *tmpl,
+                                        const uint8_t *piv, uint8_t piv_len,
+                                        uint8_t *nonce);
+
+/**
+ * @brief Precompute the encoded prefix of aad_array for a given kid.
+ *
+ * @param kid request kid (at most OSCORE_CTXID_LEN bytes)
+ * @param kid_len length of the kid
+ * @param[out] tmpl output buffer (OC_OSCORE_AAD_TEMPLATE_MAX_LEN bytes)
+ * @param[out] tmpl_len length of the template
+ * @return 0 on success
+ * @return -1 on failure
+ */
+int oc_oscore_AAD_template(const uint8_t *kid, uint8_t kid_len, uint8_t *tmpl,
+                           uint8_t *tmpl_len);
+
+/**
+ * @brief Compose the AAD of a message from a template created by
+ * oc_oscore_AAD_template. The result is identical to oc_oscore_compose_AAD.
+ *
+ * @param tmpl AAD template
+ * @param tmpl_len length of the AAD template
+ * @param piv request Partial IV
+ * @param piv_len length of the Partial IV
+ * @param[out] AAD output buffer (OSCORE_AAD_MAX_LEN bytes)
+ * @param[out] AAD_len length of the AAD
+ * @return 0 on success
+ * @return -1 on failure
+ */
+int oc_oscore_compose_AAD_from_template(const uint8_t *tmpl, uint8_t tmpl_len,
+                                        const uint8_t *piv, uint8_t piv_len,
+                                        uint8_t *AAD, uint8_t *AAD_len);
+
+/**
+ * @brief Set the AES key of an initialized CCM context so that it can be
+ * reused for many messages.
+ *
+ * @return 0 on success
+ * @return mbedtls error code on failure
+ */
+int oc_oscore_ccm_setkey(mbedtls_ccm_context *ccm, const uint8_t *key,
+                         size_t key_len);
+
+/**
+ * @brief Same as oc_oscore_decrypt with a CCM context that is already keyed
+ *
+ * @return MBEDTLS_ERR_CCM_BAD_INPUT if ccm is NULL
+ */
+int oc_oscore_decrypt_ccm(mbedtls_ccm_context *ccm, uint8_t *ciphertext,
+                          size_t ciphertext_len, size_t tag_len,
+                          const uint8_t *nonce, size_t nonce_len,
+                          const uint8_t *AAD, size_t AAD_len, uint8_t *output);
+
+/**
+ * @brief Same as oc_oscore_encrypt with a CCM context that is already keyed
+ *
+ * @return MBEDTLS_ERR_CCM_BAD_INPUT if ccm is NULL
+ */
+int oc_oscore_encrypt_ccm(mbedtls_ccm_context *ccm, uint8_t *plaintext,
+                          size_t plaintext_len, size_t tag_len,
+                          const uint8_t *nonce, size_t nonce_len,
+                          const uint8_t *AAD, size_t AAD_len, uint8_t *output);
+
 int oc_oscore_decrypt(uint8_t *ciphertext, size_t ciphertext_len,
                       size_t tag_len, uint8_t *key, size_t key_len,
                       uint8_t *nonce, size_t nonce_len, uint8_t *AAD,
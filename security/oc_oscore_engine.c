@@ -46,25 +46,6 @@ dump_cred(void *data)
   return OC_EVENT_DONE;
 }
 
-static bool
-check_if_replayed_request(oc_oscore_context_t *oscore_ctx, uint64_t piv)
-{
-  uint8_t i;
-  if (piv == 0 && oscore_ctx->rwin[0] == 0 &&
-      oscore_ctx->rwin[OSCORE_REPLAY_WINDOW_SIZE - 1] == 0) {
-    goto fresh_request;
-  }
-  for (i = 0; i < OSCORE_REPLAY_WINDOW_SIZE; i++) {
-    if (oscore_ctx->rwin[i] == piv) {
-      return true;
-    }
-  }
-fresh_request:
-  oscore_ctx->rwin_idx = (oscore_ctx->rwin_idx + 1) % OSCORE_REPLAY_WINDOW_SIZE;
-  oscore_ctx->rwin[oscore_ctx->rwin_idx] = piv;
-  return false;
-}
-
 static bool
 oscore_parse_and_process_inner_message(const oc_message_t *message,
                                        const coap_packet_t *oscore_pkt,
@@ -177,26 +158,28 @@ oscore_parse_message(oc_message_t *message)
   oc_sec_cred_t *oscore_cred = (oc_sec_cred_t *)oscore_ctx->cred;
   memcpy(message->endpoint.di.id, oscore_cred->subjectuuid.id, 16);
 
-  /* Use recipient key for decryption */
-  uint8_t *key = oscore_ctx->recvkey;
   uint8_t AAD[OSCORE_AAD_MAX_LEN];
   uint8_t AAD_len = 0;
   uint8_t nonce[OSCORE_AEAD_NONCE_LEN];
+  bool update_replay_window = false;
+  uint64_t piv = 0;
   /* If received Partial IV in message */
   if (oscore_pkt.piv_len > 0) {
     /* If message is request */
     if (oscore_pkt.code >= OC_GET && oscore_pkt.code <= OC_FETCH) {
       /* Check if this is a repeat request and discard */
-      uint64_t piv = 0;
       oscore_read_piv(oscore_pkt.piv, oscore_pkt.piv_len, &piv);
-      if (check_if_replayed_request(oscore_ctx, piv)) {
+      if (oc_oscore_context_is_replay(oscore_ctx, piv)) {
+        OC_ERR("***replayed request***");
         oscore_send_error(&oscore_pkt, UNAUTHORIZED_4_01, &message->endpoint);
         return false;
       }
+      update_replay_window = true;
 
       /* Compose AAD using received piv and context->recvid */
-      oc_oscore_compose_AAD(oscore_ctx->recvid, oscore_ctx->recvid_len,
-                            oscore_pkt.piv, oscore_pkt.piv_len, AAD, &AAD_len);
+      oc_oscore_compose_AAD_from_template(
+        oscore_ctx->recv_aad, oscore_ctx->recv_aad_len, oscore_pkt.piv,
+        oscore_pkt.piv_len, AAD, &AAD_len);
       OC_DBG("---composed AAD using received Partial IV and Recipient ID");
       OC_LOGbytes(AAD, AAD_len);
     }
@@ -209,9 +192,9 @@ oscore_parse_message(oc_message_t *message)
     OC_LOGbytes(message->endpoint.piv, message->endpoint.piv_len);
 
     /* Compute nonce using received piv and context->recvid */
-    oc_oscore_AEAD_nonce(oscore_ctx->recvid, oscore_ctx->recvid_len,
-                         message->endpoint.piv, message->endpoint.piv_len,
-                         oscore_ctx->commoniv, nonce, OSCORE_AEAD_NONCE_LEN);
+    oc_oscore_AEAD_nonce_from_template(oscore_ctx->recv_nonce,
+                                       message->endpoint.piv,
+                                       message->endpoint.piv_len, nonce);
 
     OC_DBG("---computed AEAD nonce using received Partial IV and Recipient ID");
     OC_LOGbytes(nonce, OSCORE_AEAD_NONCE_LEN);
@@ -232,17 +215,17 @@ oscore_parse_message(oc_message_t *message)
       message->endpoint.piv_len = request_piv_len;
 
       /* Compute nonce using request_piv and context->sendid */
-      oc_oscore_AEAD_nonce(oscore_ctx->sendid, oscore_ctx->sendid_len,
-                           request_piv, request_piv_len, oscore_ctx->commoniv,
-                           nonce, OSCORE_AEAD_NONCE_LEN);
+      oc_oscore_AEAD_nonce_from_template(oscore_ctx->send_nonce, request_piv,
+                                         request_piv_len, nonce);
 
       OC_DBG("---use AEAD nonce from request");
       OC_LOGbytes(nonce, OSCORE_AEAD_NONCE_LEN);
     }
 
     /* Compose AAD using request_piv and context->sendid */
-    oc_oscore_compose_AAD(oscore_ctx->sendid, oscore_ctx->sendid_len,
-                          request_piv, request_piv_len, AAD, &AAD_len);
+    oc_oscore_compose_AAD_from_template(oscore_ctx->send_aad,
+                                        oscore_ctx->send_aad_len, request_piv,
+                                        request_piv_len, AAD, &AAD_len);
 
     OC_DBG("---composed AAD using request_piv and Sender ID");
     OC_LOGbytes(AAD, AAD_len);
@@ -250,12 +233,13 @@ oscore_parse_message(oc_message_t *message)
 
   OC_DBG("### decrypting OSCORE payload ###");
 
-  /* Verify and decrypt OSCORE payload */
+  /* Verify and decrypt OSCORE payload using the recipient key */
 
-  int ret =
-    oc_oscore_decrypt(oscore_pkt.payload, oscore_pkt.payload_len,
-                      OSCORE_AEAD_TAG_LEN, key, OSCORE_KEY_LEN, nonce,
-                      OSCORE_AEAD_NONCE_LEN, AAD, AAD_len, oscore_pkt.payload);
+  int ret = oc_oscore_decrypt_ccm(oc_oscore_context_recipient_ccm(oscore_ctx),
+                                  oscore_pkt.payload, oscore_pkt.payload_len,
+                                  OSCORE_AEAD_TAG_LEN, nonce,
+                                  OSCORE_AEAD_NONCE_LEN, AAD, AAD_len,
+                                  oscore_pkt.payload);
 
   if (ret != 0) {
     OC_ERR("***error decrypting/verifying response : (%d)***", ret);
@@ -265,6 +249,11 @@ oscore_parse_message(oc_message_t *message)
 
   OC_DBG("### successfully decrypted OSCORE payload ###");
 
+  /* The window is moved only by verified requests */
+  if (update_replay_window) {
+    oc_oscore_context_update_replay_window(oscore_ctx, piv);
+  }
+
   /* Adjust payload length to size after decryption (i.e. exclude the tag)
    */
   oscore_pkt.payload_len -= OSCORE_AEAD_TAG_LEN;
@@ -310,7 +299,7 @@ oc_oscore_recv_message(oc_message_t *message)
    *   Set context->recvkey as the decryption key
    *   If received partial IV:
    *     If message is request:
-   *       Check if replayed request and discard
+   *       Check if replayed request against the replay window and discard
    *       Compose AAD using received piv and context->recvid
    *     Copy received piv into oc_message_t->endpoint
    *     Compute nonce using received piv and context->recvid
@@ -321,6 +310,7 @@ oc_oscore_recv_message(oc_message_t *message)
    *       Compute nonce using request_piv and sendid
    *     Compose AAD using request_piv and sendid
    *   Decrypt OSCORE payload
+   *   If message is request, mark received piv in the replay window
    *   Parse inner/protected CoAP options/payload
    *   If non-UPDATE mcast message protected using OSCORE group context,
    silently ignore
@@ -379,9 +369,6 @@ oc_oscore_send_multicast_message(oc_message_t *message)
     OC_DBG("#################################");
     OC_DBG("found group OSCORE context");
 
-    /* Use sender key for encryption */
-    uint8_t *key = oscore_ctx->sendkey;
-
     OC_DBG("### parse CoAP message ###");
     /* Parse CoAP message */
     coap_packet_t coap_pkt[1];
@@ -413,16 +400,16 @@ oc_oscore_send_multicast_message(oc_message_t *message)
     kid_len = oscore_ctx->sendid_len;
 
     /* Compute nonce using partial IV and context->sendid */
-    oc_oscore_AEAD_nonce(oscore_ctx->sendid, oscore_ctx->sendid_len, piv,
-                         piv_len, oscore_ctx->commoniv, nonce,
-                         OSCORE_AEAD_NONCE_LEN);
+    oc_oscore_AEAD_nonce_from_template(oscore_ctx->send_nonce, piv, piv_len,
+                                       nonce);
 
     OC_DBG("---computed AEAD nonce using Partial IV (SSN) and Sender ID");
     OC_LOGbytes(nonce, OSCORE_AEAD_NONCE_LEN);
 
     /* Compose AAD using partial IV and context->sendid */
-    oc_oscore_compose_AAD(oscore_ctx->sendid, oscore_ctx->sendid_len, piv,
-                          piv_len, AAD, &AAD_len);
+    oc_oscore_compose_AAD_from_template(oscore_ctx->send_aad,
+                                        oscore_ctx->send_aad_len, piv, piv_len,
+                                        AAD, &AAD_len);
     OC_DBG("---composed AAD using Partial IV (SSN) and Sender ID");
     OC_LOGbytes(AAD, AAD_len);
 
@@ -452,13 +439,14 @@ oc_oscore_send_multicast_message(oc_message_t *message)
     coap_pkt->payload = message->data + COAP_MAX_HEADER_SIZE;
     coap_pkt->payload_len = plaintext_size;
 
-    /* Encrypt OSCORE plaintext */
+    /* Encrypt OSCORE plaintext using the sender key */
     OC_DBG("### encrypting OSCORE plaintext ###");
 
-    int ret =
-      oc_oscore_encrypt(coap_pkt->payload, coap_pkt->payload_len,
-                        OSCORE_AEAD_TAG_LEN, key, OSCORE_KEY_LEN, nonce,
-                        OSCORE_AEAD_NONCE_LEN, AAD, AAD_len, coap_pkt->payload);
+    int ret = oc_oscore_encrypt_ccm(oc_oscore_context_sender_ccm(oscore_ctx),
+                                    coap_pkt->payload, coap_pkt->payload_len,
+                                    OSCORE_AEAD_TAG_LEN, nonce,
+                                    OSCORE_AEAD_NONCE_LEN, AAD, AAD_len,
+                                    coap_pkt->payload);
 
     if (ret != 0) {
       OC_ERR("***error encrypting OSCORE plaintext***");
@@ -556,9 +544,6 @@ oc_oscore_send_message(oc_message_t *msg)
       return 0;
     }
 
-    /* Use sender key for encryption */
-    uint8_t *key = oscore_ctx->sendkey;
-
     /* Clone incoming oc_message_t (*msg) from CoAP layer */
     message = oc_internal_allocate_outgoing_message();
     message->length = msg->length;
@@ -642,16 +627,16 @@ oc_oscore_send_message(oc_message_t *msg)
       kid_len = oscore_ctx->sendid_len;
 
       /* Compute nonce using partial IV and context->sendid */
-      oc_oscore_AEAD_nonce(oscore_ctx->sendid, oscore_ctx->sendid_len, piv,
-                           piv_len, oscore_ctx->commoniv, nonce,
-                           OSCORE_AEAD_NONCE_LEN);
+      oc_oscore_AEAD_nonce_from_template(oscore_ctx->send_nonce, piv, piv_len,
+                                         nonce);
 
       OC_DBG("---computed AEAD nonce using Partial IV (SSN) and Sender ID");
       OC_LOGbytes(nonce, OSCORE_AEAD_NONCE_LEN);
 
       /* Compose AAD using partial IV and context->sendid */
-      oc_oscore_compose_AAD(oscore_ctx->sendid, oscore_ctx->sendid_len, piv,
-                            piv_len, AAD, &AAD_len);
+      oc_oscore_compose_AAD_from_template(oscore_ctx->send_aad,
+                                          oscore_ctx->send_aad_len, piv,
+                                          piv_len, AAD, &AAD_len);
       OC_DBG("---composed AAD using Partial IV (SSN) and Sender ID");
       OC_LOGbytes(AAD, AAD_len);
 
@@ -678,9 +663,8 @@ oc_oscore_send_message(oc_message_t *msg)
       oscore_ctx->ssn++;
 
       /* Coompute nonce using partial IV and context->sendid */
-      oc_oscore_AEAD_nonce(oscore_ctx->sendid, oscore_ctx->sendid_len, piv,
-                           piv_len, oscore_ctx->commoniv, nonce,
-                           OSCORE_AEAD_NONCE_LEN);
+      oc_oscore_AEAD_nonce_from_template(oscore_ctx->send_nonce, piv, piv_len,
+                                         nonce);
 
       OC_DBG("---computed AEAD nonce using new Partial IV (SSN) and Sender ID");
       OC_LOGbytes(nonce, OSCORE_AEAD_NONCE_LEN);
@@ -689,9 +673,9 @@ oc_oscore_send_message(oc_message_t *msg)
       OC_LOGbytes(message->endpoint.piv, message->endpoint.piv_len);
 
       /* Compose AAD using request_piv and context->recvid */
-      oc_oscore_compose_AAD(oscore_ctx->recvid, oscore_ctx->recvid_len,
-                            message->endpoint.piv, message->endpoint.piv_len,
-                            AAD, &AAD_len);
+      oc_oscore_compose_AAD_from_template(
+        oscore_ctx->recv_aad, oscore_ctx->recv_aad_len, message->endpoint.piv,
+        message->endpoint.piv_len, AAD, &AAD_len);
       OC_DBG("---composed AAD using request_piv and Recipient ID");
       OC_LOGbytes(AAD, AAD_len);
 
@@ -746,13 +730,14 @@ oc_oscore_send_message(oc_message_t *msg)
     coap_pkt->payload = message->data + COAP_MAX_HEADER_SIZE;
     coap_pkt->payload_len = plaintext_size;
 
-    /* Encrypt OSCORE plaintext */
+    /* Encrypt OSCORE plaintext using the sender key */
     OC_DBG("### encrypting OSCORE plaintext ###");
 
-    int ret =
-      oc_oscore_encrypt(coap_pkt->payload, coap_pkt->payload_len,
-                        OSCORE_AEAD_TAG_LEN, key, OSCORE_KEY_LEN, nonce,
-                        OSCORE_AEAD_NONCE_LEN, AAD, AAD_len, coap_pkt->payload);
+    int ret = oc_oscore_encrypt_ccm(oc_oscore_context_sender_ccm(oscore_ctx),
+                                    coap_pkt->payload, coap_pkt->payload_len,
+                                    OSCORE_AEAD_TAG_LEN, nonce,
+                                    OSCORE_AEAD_NONCE_LEN, AAD, AAD_len,
+                                    coap_pkt->payload);
 
     if (ret != 0) {
       OC_ERR("***error encrypting OSCORE plaintext***");
@@ -275,6 +275,7 @@ oc_pstat_handle_state(oc_sec_pstat_t *ps, size_t device, bool from_storage,
 #if OC_WIPE_NAME
       oc_device_info_t *di = oc_core_get_device_info(device);
       oc_free_string(&di->name);
+      oc_core_device_info_changed(device);
 #endif /* OC_WIPE_NAME */
 
       oc_resource_t *oic_d = oc_core_get_resource_by_index(OCF_D, device);
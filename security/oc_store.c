@@ -19,6 +19,7 @@
 #ifdef OC_SECURITY
 
 #include "oc_store.h"
+#include "api/oc_rep_encode_internal.h"
 #include "api/oc_storage_internal.h"
 #include "oc_acl_internal.h"
 #include "oc_ael.h"
@@ -34,6 +35,12 @@
 #include "oc_tls_internal.h"
 #include "port/oc_storage.h"
 
+static void store_dump_doxm(size_t device);
+static void store_dump_pstat(size_t device);
+static void store_dump_cred(size_t device);
+static void store_dump_acl(size_t device);
+static void store_dump_ael(size_t device);
+
 static int
 store_decode_doxm(const oc_rep_t *rep, size_t device, void *data)
 {
@@ -48,6 +55,7 @@ store_decode_doxm(const oc_rep_t *rep, size_t device, void *data)
 void
 oc_sec_load_doxm(size_t device)
 {
+  oc_storage_flush_deferred_dump(store_dump_doxm, device);
   if (oc_storage_load_resource("doxm", device, store_decode_doxm, NULL) <= 0) {
     oc_sec_doxm_default(device);
     OC_ERR("failed to load doxm from storage for device(%zu)", device);
@@ -58,6 +66,7 @@ oc_sec_load_doxm(size_t device)
   oc_uuid_t *deviceuuid = oc_core_get_device_id(device);
   const oc_sec_doxm_t *doxm = oc_sec_get_doxm(device);
   memcpy(deviceuuid, &doxm->deviceuuid, sizeof(oc_uuid_t));
+  oc_core_device_info_changed(device);
 }
 
 static int
@@ -68,8 +77,8 @@ store_encode_doxm(size_t device, void *data)
   return 0;
 }
 
-void
-oc_sec_dump_doxm(size_t device)
+static void
+store_dump_doxm(size_t device)
 {
   long ret = oc_storage_save_resource("doxm", device, store_encode_doxm, NULL);
   if (ret <= 0) {
@@ -77,6 +86,12 @@ oc_sec_dump_doxm(size_t device)
   }
 }
 
+void
+oc_sec_dump_doxm(size_t device)
+{
+  oc_storage_dump(store_dump_doxm, device);
+}
+
 static int
 store_decode_pstat(const oc_rep_t *rep, size_t device, void *data)
 {
@@ -91,6 +106,7 @@ store_decode_pstat(const oc_rep_t *rep, size_t device, void *data)
 void
 oc_sec_load_pstat(size_t device)
 {
+  oc_storage_flush_deferred_dump(store_dump_pstat, device);
   if (oc_storage_load_resource("pstat", device, store_decode_pstat, NULL) <=
       0) {
     oc_sec_pstat_default(device);
@@ -108,8 +124,8 @@ store_encode_pstat(size_t device, void *data)
   return 0;
 }
 
-void
-oc_sec_dump_pstat(size_t device)
+static void
+store_dump_pstat(size_t device)
 {
   long ret =
     oc_storage_save_resource("pstat", device, store_encode_pstat, NULL);
@@ -118,6 +134,12 @@ oc_sec_dump_pstat(size_t device)
   }
 }
 
+void
+oc_sec_dump_pstat(size_t device)
+{
+  oc_storage_dump(store_dump_pstat, device);
+}
+
 void
 oc_sec_load_sp(size_t device)
 {
@@ -157,6 +179,12 @@ oc_sec_dump_sp(size_t device)
     OC_ERR("cannot dump %s to store: cannot allocate buffer", "sp");
     return;
   }
+#endif /* !OC_APP_DATA_STORAGE_BUFFER */
+  // might be called while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+#ifndef OC_APP_DATA_STORAGE_BUFFER
   oc_rep_new_realloc(&sb.buffer, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
 #else  /* !OC_APP_DATA_STORAGE_BUFFER */
   oc_rep_new(sb.buffer, OC_MIN_APP_DATA_SIZE);
@@ -174,6 +202,7 @@ oc_sec_dump_sp(size_t device)
     oc_storage_gen_svr_tag("sp", device, svr_tag, sizeof(svr_tag));
     oc_storage_write(svr_tag, sb.buffer, size);
   }
+  oc_rep_encoder_set_context(prev_encoder_ctx);
   oc_storage_free_buffer(sb);
 }
 
@@ -248,6 +277,7 @@ oc_sec_dump_ecdsa_keypair(size_t device)
 void
 oc_sec_load_cred(size_t device)
 {
+  oc_storage_flush_deferred_dump(store_dump_cred, device);
   oc_storage_buffer_t sb = oc_storage_get_buffer(OC_MAX_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
   if (sb.buffer == NULL) {
@@ -270,8 +300,8 @@ oc_sec_load_cred(size_t device)
   oc_storage_free_buffer(sb);
 }
 
-void
-oc_sec_dump_cred(size_t device)
+static void
+store_dump_cred(size_t device)
 {
   oc_storage_buffer_t sb = oc_storage_get_buffer(OC_MIN_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
@@ -299,9 +329,16 @@ oc_sec_dump_cred(size_t device)
   oc_storage_free_buffer(sb);
 }
 
+void
+oc_sec_dump_cred(size_t device)
+{
+  oc_storage_dump(store_dump_cred, device);
+}
+
 void
 oc_sec_load_acl(size_t device)
 {
+  oc_storage_flush_deferred_dump(store_dump_acl, device);
   oc_storage_buffer_t sb = oc_storage_get_buffer(OC_MAX_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
   if (sb.buffer == NULL) {
@@ -326,8 +363,8 @@ oc_sec_load_acl(size_t device)
   oc_storage_free_buffer(sb);
 }
 
-void
-oc_sec_dump_acl(size_t device)
+static void
+store_dump_acl(size_t device)
 {
   oc_storage_buffer_t sb = oc_storage_get_buffer(OC_MIN_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
@@ -355,6 +392,12 @@ oc_sec_dump_acl(size_t device)
   oc_storage_free_buffer(sb);
 }
 
+void
+oc_sec_dump_acl(size_t device)
+{
+  oc_storage_dump(store_dump_acl, device);
+}
+
 void
 oc_sec_load_unique_ids(size_t device)
 {
@@ -396,6 +439,8 @@ oc_sec_load_unique_ids(size_t device)
       }
     }
     oc_free_rep(p);
+    oc_core_device_info_changed(device);
+    oc_core_platform_info_changed();
   } else {
     oc_sec_dump_unique_ids(device);
   }
@@ -411,6 +456,12 @@ oc_sec_dump_unique_ids(size_t device)
     OC_ERR("cannot dump %s to store: cannot allocate buffer", "unique_ids");
     return;
   }
+#endif /* !OC_APP_DATA_STORAGE_BUFFER */
+  // might be called while a response is being encoded
+  oc_rep_encoder_context_t encoder_ctx;
+  oc_rep_encoder_context_t *prev_encoder_ctx =
+    oc_rep_encoder_set_context(&encoder_ctx);
+#ifndef OC_APP_DATA_STORAGE_BUFFER
   oc_rep_new_realloc(&sb.buffer, OC_MIN_APP_DATA_SIZE, OC_MAX_APP_DATA_SIZE);
 #else  /* !OC_APP_DATA_STORAGE_BUFFER */
   oc_rep_new(sb.buffer, OC_MIN_APP_DATA_SIZE);
@@ -439,6 +490,7 @@ oc_sec_dump_unique_ids(size_t device)
     oc_storage_gen_svr_tag("u_ids", device, svr_tag, sizeof(svr_tag));
     oc_storage_write(svr_tag, sb.buffer, size);
   }
+  oc_rep_encoder_set_context(prev_encoder_ctx);
   oc_storage_free_buffer(sb);
 }
 
@@ -453,6 +505,7 @@ oc_sec_load_ael(size_t device)
   }
 #endif /* !OC_APP_DATA_STORAGE_BUFFER */
 
+  oc_storage_flush_deferred_dump(store_dump_ael, device);
   char svr_tag[OC_STORAGE_SVR_TAG_MAX];
   oc_storage_gen_svr_tag("ael", device, svr_tag, sizeof(svr_tag));
   long ret = oc_storage_read(svr_tag, sb.buffer, sb.size);
@@ -467,8 +520,8 @@ oc_sec_load_ael(size_t device)
   oc_storage_free_buffer(sb);
 }
 
-void
-oc_sec_dump_ael(size_t device)
+static void
+store_dump_ael(size_t device)
 {
   oc_storage_buffer_t sb = oc_storage_get_buffer(OC_MIN_APP_DATA_SIZE);
 #ifndef OC_APP_DATA_STORAGE_BUFFER
@@ -497,6 +550,14 @@ oc_sec_dump_ael(size_t device)
   oc_storage_free_buffer(sb);
 }
 
+void
+oc_sec_dump_ael(size_t device)
+{
+  // every audit event changes the AEL, the writes are coalesced
+  oc_storage_dump_coalesced(store_dump_ael, device,
+                            OC_SEC_AEL_WRITE_BEHIND_WINDOW_MS);
+}
+
 static int
 store_decode_sdi(const oc_rep_t *rep, size_t device, void *data)
 {
@@ -20,6 +20,7 @@
 
 #include "oc_svr_internal.h"
 #include "api/oc_core_res_internal.h"
+#include "api/oc_storage_internal.h"
 #include "oc_acl_internal.h"
 #include "oc_ael.h"
 #include "oc_api.h"
@@ -83,6 +84,10 @@ oc_sec_svr_create(void)
 void
 oc_sec_svr_free(void)
 {
+#ifdef OC_STORAGE
+  // complete the pending writes before the resources are freed
+  oc_storage_flush_deferred_dumps();
+#endif /* OC_STORAGE */
   oc_sec_sdi_free();
   oc_sec_sp_free();
   oc_sec_ael_free();
@@ -555,6 +555,13 @@ ssl_send(void *ctx, const unsigned char *buf, size_t len)
   message->encrypted = 1;
   int ret = oc_send_buffer2(message, false);
   oc_message_unref(message);
+#ifdef OC_TCP
+  if (ret == OC_TCP_SOCKET_ERROR_WOULD_BLOCK) {
+    // mbedTLS keeps the record and writes it again once the send queue of the
+    // TCP session is drained
+    return MBEDTLS_ERR_SSL_WANT_WRITE;
+  }
+#endif /* OC_TCP */
   return ret;
 }
 
@@ -2242,42 +2249,51 @@ oc_sec_derive_owner_psk(const oc_endpoint_t *endpoint, const uint8_t *oxm,
 }
 
 #ifdef OC_TCP
+/* The written part of the message is kept in read_offset, because mbedTLS must
+ * be called again with the rest of the message after
+ * MBEDTLS_ERR_SSL_WANT_WRITE. */
 static int
-ssl_write_tcp(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len)
+ssl_write_tcp(mbedtls_ssl_context *ssl, oc_message_t *message)
 {
-  size_t length = 0;
-  while (length < len) {
-    int ret = mbedtls_ssl_write(ssl, buf + length, len - length);
+  while (message->read_offset < message->length) {
+    int ret = mbedtls_ssl_write(ssl, message->data + message->read_offset,
+                                message->length - message->read_offset);
     if (ret < 0) {
-      if (ret == MBEDTLS_ERR_SSL_WANT_READ &&
-          ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
-        continue;
-      }
       return ret;
     }
-    length += ret;
+    message->read_offset += (size_t)ret;
   }
-  return (int)length;
+  return (int)message->length;
 }
-#endif
+#endif /* OC_TCP */
 
-size_t
-oc_tls_send_message(oc_message_t *message)
+static int
+ssl_write_message(oc_tls_peer_t *peer, oc_message_t *message)
 {
-  size_t length = 0;
-  oc_tls_peer_t *peer = oc_tls_get_peer(&message->endpoint);
-  if (peer) {
-    int ret = 0;
 #ifdef OC_TCP
-    if (peer->endpoint.flags & TCP) {
-      ret = ssl_write_tcp(&peer->ssl_ctx, (unsigned char *)message->data,
-                          message->length);
-    } else
-#endif
-    {
-      ret = mbedtls_ssl_write(&peer->ssl_ctx, (unsigned char *)message->data,
-                              message->length);
+  if (peer->endpoint.flags & TCP) {
+    return ssl_write_tcp(&peer->ssl_ctx, message);
+  }
+#endif /* OC_TCP */
+  return mbedtls_ssl_write(&peer->ssl_ctx, (unsigned char *)message->data,
+                           message->length);
+}
+
+/* Write the messages queued for the peer. A message refused by the full send
+ * queue of the TCP session stays at the head of the queue and it is written
+ * again once the queue is drained. */
+static void
+write_queued_messages(oc_tls_peer_t *peer)
+{
+  oc_message_t *message = (oc_message_t *)oc_list_head(peer->send_q);
+  while (message != NULL) {
+    int ret = ssl_write_message(peer, message);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE && (peer->endpoint.flags & TCP)) {
+      OC_DBG("oc_tls: send queue of TCP session is full");
+      return;
     }
+    oc_list_remove(peer->send_q, message);
+    oc_message_unref(message);
     if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
         ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 #if defined(OC_DEBUG) && OC_ERR_IS_ENABLED
@@ -2286,11 +2302,28 @@ oc_tls_send_message(oc_message_t *message)
       OC_ERR("oc_tls: mbedtls_error: %s", buf);
 #endif /* OC_DEBUG && OC_ERR_IS_ENABLED */
       oc_tls_free_peer(peer, false);
-    } else {
-      length = message->length;
+      return;
     }
+    message = (oc_message_t *)oc_list_head(peer->send_q);
+  }
+}
+
+size_t
+oc_tls_send_message(oc_message_t *message)
+{
+  oc_tls_peer_t *peer = oc_tls_get_peer(&message->endpoint);
+  if (peer == NULL) {
+    oc_message_unref(message);
+    return 0;
+  }
+  size_t length = message->length;
+  // the message is queued behind the messages waiting for the handshake or for
+  // the full send queue of the TCP session
+  bool write = oc_list_head(peer->send_q) == NULL;
+  oc_list_add(peer->send_q, message);
+  if (write) {
+    write_queued_messages(peer);
   }
-  oc_message_unref(message);
   return length;
 }
 
@@ -2318,32 +2351,7 @@ write_application_data(oc_tls_peer_t *peer)
     OC_DBG("oc_tls: write_application_data: Peer not active");
     return;
   }
-  oc_message_t *message = (oc_message_t *)oc_list_pop(peer->send_q);
-  while (message != NULL) {
-    int ret = 0;
-#ifdef OC_TCP
-    if (peer->endpoint.flags & TCP) {
-      ret = ssl_write_tcp(&peer->ssl_ctx, (unsigned char *)message->data,
-                          message->length);
-    } else
-#endif
-    {
-      ret = mbedtls_ssl_write(&peer->ssl_ctx, (unsigned char *)message->data,
-                              message->length);
-    }
-    oc_message_unref(message);
-    if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
-        ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-#if defined(OC_DEBUG) && OC_ERR_IS_ENABLED
-      char buf[256];
-      mbedtls_strerror(ret, buf, sizeof(buf));
-      OC_ERR("oc_tls: mbedtls_error: %s", buf);
-#endif /* OC_ERR_IS_ENABLED */
-      oc_tls_free_peer(peer, false);
-      break;
-    }
-    message = (oc_message_t *)oc_list_pop(peer->send_q);
-  }
+  write_queued_messages(peer);
 }
 
 static void
@@ -2751,6 +2759,26 @@ close_all_tls_sessions(void)
   }
 }
 
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+static void
+write_blocked_tcp_messages(void)
+{
+  oc_tls_peer_t *peer = (oc_tls_peer_t *)oc_list_head(g_tls_peers);
+  while (peer != NULL) {
+    oc_tls_peer_t *next = peer->next;
+    if ((peer->endpoint.flags & TCP) != 0) {
+      if (oc_tls_peer_connected(peer)) {
+        write_queued_messages(peer);
+      } else {
+        // continue the handshake refused by the full send queue
+        read_application_data(peer);
+      }
+    }
+    peer = next;
+  }
+}
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
+
 OC_PROCESS_THREAD(oc_tls_handler, ev, data)
 {
   OC_PROCESS_POLLHANDLER(close_all_tls_sessions());
@@ -2791,6 +2819,12 @@ OC_PROCESS_THREAD(oc_tls_handler, ev, data)
       close_all_tls_sessions_for_device(device);
       continue;
     }
+#ifdef OC_HAS_FEATURE_TCP_SEND_QUEUE
+    if (ev == oc_events[TCP_SEND_QUEUE_DRAINED]) {
+      write_blocked_tcp_messages();
+      continue;
+    }
+#endif /* OC_HAS_FEATURE_TCP_SEND_QUEUE */
   }
 
   OC_PROCESS_END();
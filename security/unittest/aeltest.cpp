@@ -0,0 +1,240 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+#ifdef OC_SECURITY
+
+#include "api/oc_core_res_internal.h"
+#include "api/oc_storage_internal.h"
+#include "oc_api.h"
+#include "oc_ri.h"
+#include "oc_store.h"
+#include "port/oc_connectivity.h"
+#include "port/oc_network_event_handler_internal.h"
+#include "port/oc_storage.h"
+#include "port/oc_storage_internal.h"
+#include "security/oc_ael.h"
+#include "security/oc_svr_internal.h"
+
+#ifdef OC_HAS_FEATURE_PUSH
+#include "api/oc_push_internal.h"
+#endif /* OC_HAS_FEATURE_PUSH */
+
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+static const std::string kDeviceURI{ "/oic/d" };
+static const std::string kDeviceType{ "oic.d.light" };
+static const std::string kDeviceName{ "Table Lamp" };
+static const std::string kOCFSpecVersion{ "ocf.1.0.0" };
+static const std::string kOCFDataModelVersion{ "ocf.res.1.0.0" };
+static const std::string testStorage{ "storage_test" };
+
+struct AelEvent
+{
+  uint8_t category;
+  uint8_t priority;
+  std::string aeid;
+  std::string message;
+  std::vector<std::string> aux;
+};
+
+class TestAel : public testing::Test {
+public:
+  static void SetUpTestCase()
+  {
+    oc_network_event_handler_mutex_init();
+    oc_ri_init();
+    oc_core_init();
+    ASSERT_EQ(0, oc_add_device(kDeviceURI.c_str(), kDeviceType.c_str(),
+                               kDeviceName.c_str(), kOCFSpecVersion.c_str(),
+                               kOCFDataModelVersion.c_str(), nullptr, nullptr));
+    oc_sec_svr_create();
+
+    ASSERT_EQ(0, oc_storage_config(testStorage.c_str()));
+  }
+
+  static void TearDownTestCase()
+  {
+    oc_sec_svr_free();
+#ifdef OC_HAS_FEATURE_PUSH
+    oc_push_free();
+#endif /* OC_HAS_FEATURE_PUSH */
+    oc_connectivity_shutdown(0);
+    oc_core_shutdown();
+    oc_ri_shutdown();
+    oc_network_event_handler_mutex_destroy();
+
+    for (const auto &entry : std::filesystem::directory_iterator(testStorage)) {
+      std::filesystem::remove_all(entry.path());
+    }
+    ASSERT_EQ(0, oc_storage_reset());
+  }
+
+  void SetUp() override { oc_sec_ael_default(0); }
+
+  static std::vector<AelEvent> GetEvents(size_t device)
+  {
+    std::vector<AelEvent> events{};
+    oc_sec_ael_iterate(
+      device,
+      [](const oc_sec_ael_event_t *event, void *data) {
+        AelEvent e{ event->category, event->priority, {}, {}, {} };
+        if (event->aeid != nullptr) {
+          e.aeid = event->aeid;
+        }
+        if (event->message != nullptr) {
+          e.message = event->message;
+        }
+        const char *aux = event->aux;
+        for (size_t i = 0; i < event->aux_len; ++i) {
+          e.aux.emplace_back(aux);
+          aux += e.aux.back().length() + 1;
+        }
+        static_cast<std::vector<AelEvent> *>(data)->push_back(e);
+        return true;
+      },
+      &events);
+    return events;
+  }
+};
+
+TEST_F(TestAel, Add)
+{
+  const char *aux[] = { "aux1", "aux2" };
+  EXPECT_TRUE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_ACCESS_CONTROL,
+                             OC_SEC_AEL_PRIORITYFILTER_WARN, "aeid", "message",
+                             aux, 2));
+  EXPECT_TRUE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                             OC_SEC_AEL_PRIORITYFILTER_ERR, nullptr, "message2",
+                             nullptr, 0));
+
+  auto events = GetEvents(0);
+  ASSERT_EQ(2U, events.size());
+  EXPECT_EQ(OC_SEC_AEL_CATEGORYFILTER_ACCESS_CONTROL, events[0].category);
+  EXPECT_EQ(OC_SEC_AEL_PRIORITYFILTER_WARN, events[0].priority);
+  EXPECT_EQ("aeid", events[0].aeid);
+  EXPECT_EQ("message", events[0].message);
+  ASSERT_EQ(2U, events[0].aux.size());
+  EXPECT_EQ("aux1", events[0].aux[0]);
+  EXPECT_EQ("aux2", events[0].aux[1]);
+  EXPECT_EQ(OC_SEC_AEL_CATEGORYFILTER_DEVICE, events[1].category);
+  EXPECT_TRUE(events[1].aeid.empty());
+  EXPECT_EQ("message2", events[1].message);
+  EXPECT_TRUE(events[1].aux.empty());
+}
+
+TEST_F(TestAel, AddFiltered)
+{
+  const oc_sec_ael_t *ael = oc_sec_get_ael(0);
+  oc_sec_ael_set_limits(0, OC_SEC_AEL_CATEGORYFILTER_DEFAULT,
+                        OC_SEC_AEL_PRIORITYFILTER_ERR, OC_SEC_AEL_MAX_SIZE);
+  EXPECT_FALSE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                              OC_SEC_AEL_PRIORITYFILTER_INFO, "aeid",
+                              "message", nullptr, 0));
+  oc_sec_ael_set_limits(0, OC_SEC_AEL_CATEGORYFILTER_CLOUD,
+                        OC_SEC_AEL_PRIORITYFILTER_ERR, OC_SEC_AEL_MAX_SIZE);
+  EXPECT_FALSE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                              OC_SEC_AEL_PRIORITYFILTER_CRIT, "aeid",
+                              "message", nullptr, 0));
+  EXPECT_EQ(0U, ael->events_count);
+  EXPECT_EQ(0U, ael->events_size);
+}
+
+TEST_F(TestAel, AddTooLarge)
+{
+  std::string message(OC_SEC_AEL_MAX_SIZE, 'a');
+  EXPECT_FALSE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                              OC_SEC_AEL_PRIORITYFILTER_CRIT, "aeid",
+                              message.c_str(), nullptr, 0));
+  EXPECT_EQ(0U, oc_sec_get_ael(0)->events_count);
+}
+
+TEST_F(TestAel, Evict)
+{
+  const oc_sec_ael_t *ael = oc_sec_get_ael(0);
+  // wrap around the ring buffer multiple times, with a smaller limit in the
+  // second half
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    if (i == count / 2) {
+      oc_sec_ael_set_limits(0, OC_SEC_AEL_CATEGORYFILTER_DEFAULT,
+                            OC_SEC_AEL_PRIORITYFILTER_DEFAULT,
+                            OC_SEC_AEL_MAX_SIZE / 3);
+    }
+    std::string message = "event " + std::to_string(i) +
+                          std::string(static_cast<size_t>(i % 37), 'x');
+    const char *aux[] = { "aux1", "aux2", "aux3" };
+    ASSERT_TRUE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                               OC_SEC_AEL_PRIORITYFILTER_CRIT, "aeid",
+                               message.c_str(), aux, i % 4));
+    ASSERT_LE(ael->events_size, ael->maxsize);
+
+    auto events = GetEvents(0);
+    ASSERT_EQ(ael->events_count, events.size());
+    // the newest event is always kept, the others are in order
+    int expected = i - static_cast<int>(events.size()) + 1;
+    for (const auto &e : events) {
+      std::string prefix = "event " + std::to_string(expected);
+      ASSERT_EQ(0, e.message.compare(0, prefix.length(), prefix));
+      ASSERT_EQ(static_cast<size_t>(expected % 4), e.aux.size());
+      ++expected;
+    }
+  }
+  EXPECT_LT(ael->events_count, static_cast<size_t>(count));
+}
+
+TEST_F(TestAel, DumpCoalesced)
+{
+  oc_storage_flush_deferred_dumps();
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                               OC_SEC_AEL_PRIORITYFILTER_CRIT, "aeid",
+                               "message", nullptr, 0));
+  }
+  // the events are written to storage once the window elapses
+  EXPECT_TRUE(oc_storage_has_deferred_dumps());
+  oc_storage_flush_deferred_dumps();
+  EXPECT_FALSE(oc_storage_has_deferred_dumps());
+}
+
+TEST_F(TestAel, DumpAndLoad)
+{
+  for (int i = 0; i < 5; ++i) {
+    std::string message = "event " + std::to_string(i);
+    const char *aux[] = { "aux" };
+    ASSERT_TRUE(oc_sec_ael_add(0, OC_SEC_AEL_CATEGORYFILTER_DEVICE,
+                               OC_SEC_AEL_PRIORITYFILTER_CRIT, "aeid",
+                               message.c_str(), aux, 1));
+  }
+  auto events = GetEvents(0);
+
+  oc_sec_ael_clear(0);
+  oc_sec_load_ael(0);
+
+  auto loaded = GetEvents(0);
+  ASSERT_EQ(events.size(), loaded.size());
+  for (size_t i = 0; i < events.size(); ++i) {
+    EXPECT_EQ(events[i].message, loaded[i].message);
+    EXPECT_EQ(events[i].aeid, loaded[i].aeid);
+    EXPECT_EQ(events[i].aux, loaded[i].aux);
+  }
+}
+
+#endif /* OC_SECURITY */
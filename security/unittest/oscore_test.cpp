@@ -24,10 +24,16 @@
 #include "security/oc_oscore.h"
 #include "security/oc_oscore_context.h"
 #include "security/oc_oscore_crypto.h"
+#include "oc_cred.h"
 #include "oc_helpers.h"
 
 #include "gtest/gtest.h"
+#include <array>
+#include <chrono>
 #include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
 
 class TestOSCORE : public testing::Test {
 protected:
@@ -1149,6 +1155,223 @@ TEST_F(TestOSCORE, ServerResponse2_P)
     testvec,
     "64445d1f00003974920100ff4d4c13669384b67354b2b6175ff4b8658c666a6cf88e");
 }
+TEST_F(TestOSCORE, ReplayWindow)
+{
+  oc_oscore_context_t ctx{};
+
+  // first request is always accepted
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 5));
+  oc_oscore_context_update_replay_window(&ctx, 5);
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 5));
+
+  // out of order requests inside the window are accepted once
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 3));
+  oc_oscore_context_update_replay_window(&ctx, 3);
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 3));
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 4));
+
+  // sliding the window keeps the history
+  oc_oscore_context_update_replay_window(&ctx, 10);
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 10));
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 5));
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 3));
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 4));
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 11));
+
+  // requests older than the window are rejected
+  uint64_t max = 10 + OSCORE_REPLAY_WINDOW_SIZE;
+  oc_oscore_context_update_replay_window(&ctx, max);
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 10));
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, 11));
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, 4));
+
+  // large jump clears the window
+  oc_oscore_context_update_replay_window(&ctx, max + 1000);
+  EXPECT_FALSE(oc_oscore_context_is_replay(&ctx, max + 999));
+  EXPECT_TRUE(oc_oscore_context_is_replay(&ctx, max));
+}
+
+#ifdef OC_DYNAMIC_ALLOCATION
+TEST_F(TestOSCORE, FindContext)
+{
+  std::vector<oc_sec_cred_t> creds(8);
+  std::vector<oc_oscore_context_t *> ctxs{};
+  const char *secret = "0102030405060708090a0b0c0d0e0f10";
+  for (size_t i = 0; i < creds.size(); ++i) {
+    oc_new_string(&creds[i].privatedata.data, secret, strlen(secret));
+    creds[i].credtype = OC_CREDTYPE_OSCORE;
+    creds[i].subjectuuid.id[0] = static_cast<uint8_t>(i);
+    std::string rid = "0" + std::to_string(i);
+    auto *ctx = oc_oscore_add_context(i % 2, "ff", rid.c_str(), 0, nullptr,
+                                      &creds[i], false);
+    ASSERT_NE(nullptr, ctx);
+    ctxs.push_back(ctx);
+  }
+
+  for (size_t i = 0; i < creds.size(); ++i) {
+    uint8_t kid = static_cast<uint8_t>(i);
+    EXPECT_EQ(ctxs[i], oc_oscore_find_context_by_kid(nullptr, i % 2, &kid, 1));
+    EXPECT_EQ(nullptr,
+              oc_oscore_find_context_by_kid(nullptr, (i + 1) % 2, &kid, 1));
+    EXPECT_EQ(ctxs[i],
+              oc_oscore_find_context_by_UUID(i % 2, &creds[i].subjectuuid));
+  }
+
+  for (size_t i = 0; i < creds.size(); ++i) {
+    oc_oscore_free_context(ctxs[i]);
+    uint8_t kid = static_cast<uint8_t>(i);
+    EXPECT_EQ(nullptr, oc_oscore_find_context_by_kid(nullptr, i % 2, &kid, 1));
+    oc_free_string(&creds[i].privatedata.data);
+  }
+}
+
+TEST_F(TestOSCORE, ContextWithoutSenderID)
+{
+  oc_sec_cred_t cred{};
+  const char *secret = "0102030405060708090a0b0c0d0e0f10";
+  oc_new_string(&cred.privatedata.data, secret, strlen(secret));
+  cred.credtype = OC_CREDTYPE_OSCORE;
+  auto *ctx = oc_oscore_add_context(0, nullptr, "01", 0, nullptr, &cred, false);
+  ASSERT_NE(nullptr, ctx);
+  EXPECT_NE(nullptr, oc_oscore_context_recipient_ccm(ctx));
+  // the AEAD context of the missing Sender ID is not keyed and cannot be used
+  EXPECT_EQ(nullptr, oc_oscore_context_sender_ccm(ctx));
+  std::array<uint8_t, 16 + OSCORE_AEAD_TAG_LEN> payload{};
+  std::array<uint8_t, OSCORE_AEAD_NONCE_LEN> nonce{};
+  EXPECT_NE(0, oc_oscore_encrypt_ccm(oc_oscore_context_sender_ccm(ctx),
+                                     payload.data(), 16, OSCORE_AEAD_TAG_LEN,
+                                     nonce.data(), nonce.size(), nullptr, 0,
+                                     payload.data()));
+  oc_oscore_free_context(ctx);
+  oc_free_string(&cred.privatedata.data);
+}
+#endif /* OC_DYNAMIC_ALLOCATION */
+
+TEST_F(TestOSCORE, NonceAndAADTemplates)
+{
+  uint8_t civ[OSCORE_COMMON_IV_LEN];
+  for (size_t i = 0; i < sizeof(civ); ++i) {
+    civ[i] = static_cast<uint8_t>(0x46 + i * 7);
+  }
+  uint8_t id[OSCORE_CTXID_LEN] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+  uint8_t piv[OSCORE_PIV_LEN] = { 0x14, 0x25, 0x36, 0x47, 0x58 };
+
+  for (uint8_t id_len = 0; id_len <= OSCORE_CTXID_LEN; ++id_len) {
+    uint8_t nonce_tmpl[OSCORE_AEAD_NONCE_LEN];
+    oc_oscore_AEAD_nonce_template(id, id_len, civ, nonce_tmpl);
+    uint8_t aad_tmpl[OC_OSCORE_AAD_TEMPLATE_MAX_LEN];
+    uint8_t aad_tmpl_len = 0;
+    ASSERT_EQ(0, oc_oscore_AAD_template(id, id_len, aad_tmpl, &aad_tmpl_len));
+
+    for (uint8_t piv_len = 0; piv_len <= OSCORE_PIV_LEN; ++piv_len) {
+      uint8_t expected[OSCORE_AAD_MAX_LEN];
+      uint8_t actual[OSCORE_AAD_MAX_LEN];
+      oc_oscore_AEAD_nonce(id, id_len, piv, piv_len, civ, expected,
+                           OSCORE_AEAD_NONCE_LEN);
+      oc_oscore_AEAD_nonce_from_template(nonce_tmpl, piv, piv_len, actual);
+      EXPECT_EQ(0, memcmp(expected, actual, OSCORE_AEAD_NONCE_LEN));
+
+      uint8_t expected_len = 0;
+      uint8_t actual_len = 0;
+      ASSERT_EQ(0, oc_oscore_compose_AAD(id, id_len, piv, piv_len, expected,
+                                         &expected_len));
+      ASSERT_EQ(0, oc_oscore_compose_AAD_from_template(
+                     aad_tmpl, aad_tmpl_len, piv, piv_len, actual, &actual_len));
+      ASSERT_EQ(expected_len, actual_len);
+      EXPECT_EQ(0, memcmp(expected, actual, expected_len));
+    }
+  }
+}
+
+/* Compares protecting messages with a key schedule and CBOR encoded AAD per
+ * message against the cached AEAD context and templates. */
+TEST_F(TestOSCORE, ProtectThroughput)
+{
+  constexpr int kIterations = 20000;
+  uint8_t key[OSCORE_KEY_LEN] = { 0xf0, 0x91, 0x0e, 0xd7, 0x29, 0x5e,
+                                  0x6a, 0xd4, 0xb5, 0x4f, 0xc7, 0x93,
+                                  0x15, 0x43, 0x02, 0xff };
+  uint8_t civ[OSCORE_COMMON_IV_LEN] = { 0x46, 0x22, 0xd4, 0xdd, 0x6d,
+                                        0x94, 0x41, 0x68, 0xee, 0xfb,
+                                        0x54, 0x98, 0x7c };
+  uint8_t sid[] = { 0x01 };
+  std::vector<uint8_t> plaintext(64, 0xab);
+  std::vector<uint8_t> buf(plaintext.size() + OSCORE_AEAD_TAG_LEN);
+  std::vector<uint8_t> expected(buf.size());
+
+  auto per_message = [&](uint64_t ssn) {
+    uint8_t piv[OSCORE_PIV_LEN];
+    uint8_t piv_len = 0;
+    oscore_store_piv(ssn, piv, &piv_len);
+    uint8_t nonce[OSCORE_AEAD_NONCE_LEN];
+    oc_oscore_AEAD_nonce(sid, sizeof(sid), piv, piv_len, civ, nonce,
+                         OSCORE_AEAD_NONCE_LEN);
+    uint8_t AAD[OSCORE_AAD_MAX_LEN];
+    uint8_t AAD_len = 0;
+    oc_oscore_compose_AAD(sid, sizeof(sid), piv, piv_len, AAD, &AAD_len);
+    memcpy(buf.data(), plaintext.data(), plaintext.size());
+    return oc_oscore_encrypt(buf.data(), plaintext.size(), OSCORE_AEAD_TAG_LEN,
+                             key, OSCORE_KEY_LEN, nonce, OSCORE_AEAD_NONCE_LEN,
+                             AAD, AAD_len, buf.data());
+  };
+
+  mbedtls_ccm_context ccm;
+  mbedtls_ccm_init(&ccm);
+  ASSERT_EQ(0, oc_oscore_ccm_setkey(&ccm, key, OSCORE_KEY_LEN));
+  uint8_t nonce_tmpl[OSCORE_AEAD_NONCE_LEN];
+  oc_oscore_AEAD_nonce_template(sid, sizeof(sid), civ, nonce_tmpl);
+  uint8_t aad_tmpl[OC_OSCORE_AAD_TEMPLATE_MAX_LEN];
+  uint8_t aad_tmpl_len = 0;
+  ASSERT_EQ(0,
+            oc_oscore_AAD_template(sid, sizeof(sid), aad_tmpl, &aad_tmpl_len));
+
+  auto cached = [&](uint64_t ssn) {
+    uint8_t piv[OSCORE_PIV_LEN];
+    uint8_t piv_len = 0;
+    oscore_store_piv(ssn, piv, &piv_len);
+    uint8_t nonce[OSCORE_AEAD_NONCE_LEN];
+    oc_oscore_AEAD_nonce_from_template(nonce_tmpl, piv, piv_len, nonce);
+    uint8_t AAD[OSCORE_AAD_MAX_LEN];
+    uint8_t AAD_len = 0;
+    oc_oscore_compose_AAD_from_template(aad_tmpl, aad_tmpl_len, piv, piv_len,
+                                        AAD, &AAD_len);
+    memcpy(buf.data(), plaintext.data(), plaintext.size());
+    return oc_oscore_encrypt_ccm(&ccm, buf.data(), plaintext.size(),
+                                 OSCORE_AEAD_TAG_LEN, nonce,
+                                 OSCORE_AEAD_NONCE_LEN, AAD, AAD_len,
+                                 buf.data());
+  };
+
+  // both paths must produce the same ciphertext
+  for (uint64_t ssn : { 0, 1, 255, 256, 65536 }) {
+    ASSERT_EQ(0, per_message(ssn));
+    expected = buf;
+    ASSERT_EQ(0, cached(ssn));
+    EXPECT_EQ(expected, buf);
+  }
+
+  auto measure = [](const auto &protect) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kIterations; ++i) {
+      if (protect(static_cast<uint64_t>(i)) != 0) {
+        return std::chrono::duration<double>::zero();
+      }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start);
+  };
+  auto per_message_time = measure(per_message);
+  auto cached_time = measure(cached);
+  mbedtls_ccm_free(&ccm);
+
+  ASSERT_GT(per_message_time.count(), 0);
+  ASSERT_GT(cached_time.count(), 0);
+  std::cout << "OSCORE protect: per-message key schedule "
+            << kIterations / per_message_time.count()
+            << " msg/s, cached context " << kIterations / cached_time.count()
+            << " msg/s" << std::endl;
+}
+
 #else  /* OC_SECURITY && OC_OSCORE */
 typedef int dummy_declaration;
 #endif /* !OC_SECURITY && !OC_OSCORE */
@@ -1617,6 +1617,18 @@ bool jni_do_post(void) {
 }
 %}
 
+// request builders are not exposed to Java
+%ignore oc_client_request_t;
+%ignore oc_client_request_new;
+%ignore oc_client_request_free;
+%ignore oc_client_request_set_timeout;
+%ignore oc_client_request_begin_payload;
+%ignore oc_client_request_end_payload;
+%ignore oc_client_request_set_payload;
+%ignore oc_client_request_send;
+%ignore oc_client_request_set_accept;
+%ignore oc_client_request_submit;
+
 %ignore oc_do_observe;
 %rename(doObserve) jni_oc_do_observe;
 %inline %{
@@ -50,6 +50,7 @@ struct CborEncoder
 %rename(Double) double_p;
 %rename(Bool) boolean;
 %rename(objectArray) object_array;
+%ignore oc_rep_encoder_context_t;
 %ignore root_map;
 %ignore links_array;
 %ignore g_err;
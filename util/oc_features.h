@@ -34,6 +34,12 @@
 #define OC_HAS_FEATURE_TCP_ASYNC_CONNECT
 #endif /* __linux__ && !__ANDROID_API__ && OC_CLIENT && OC_TCP */
 
+#if defined(__linux__) && !defined(__ANDROID_API__) && defined(OC_TCP)
+/* Messages sent through TCP sessions are queued and written by the network
+ * thread */
+#define OC_HAS_FEATURE_TCP_SEND_QUEUE
+#endif /* __linux__ && !__ANDROID_API__ && OC_TCP */
+
 #if defined(OC_PUSH) && defined(OC_SERVER) && defined(OC_CLIENT) &&            \
   defined(OC_DYNAMIC_ALLOCATION) && defined(OC_COLLECTIONS_IF_CREATE)
 #define OC_HAS_FEATURE_PUSH
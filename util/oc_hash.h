@@ -0,0 +1,65 @@
+/****************************************************************************
+ *
+ * Copyright (c) 2023 plgd.dev s.r.o.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"),
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND,
+ * either express or implied. See the License for the specific
+ * language governing permissions and limitations under the License.
+ *
+ ****************************************************************************/
+
+/**
+ * @file oc_hash.h
+ *
+ * @brief Non-cryptographic hashing of byte sequences.
+ */
+
+#ifndef OC_HASH_H
+#define OC_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Offset basis of the 32-bit FNV-1a hash. */
+#define OC_HASH_FNV1A_BASIS (2166136261U)
+
+/** Offset basis of the 64-bit FNV-1a hash. */
+#define OC_HASH_FNV1A64_BASIS (0xcbf29ce484222325ULL)
+
+/**
+ * @brief Continue the 32-bit FNV-1a hash with the given bytes.
+ *
+ * @param hash hash of the preceding data or OC_HASH_FNV1A_BASIS
+ * @param data data to hash (cannot be NULL if len > 0)
+ * @param len length of the data
+ * @return the updated hash
+ */
+uint32_t oc_hash_fnv1a(uint32_t hash, const void *data, size_t len);
+
+/**
+ * @brief Continue the 64-bit FNV-1a hash with the given bytes.
+ *
+ * @param hash hash of the preceding data or OC_HASH_FNV1A64_BASIS
+ * @param data data to hash (cannot be NULL if len > 0)
+ * @param len length of the data
+ * @return the updated hash
+ */
+uint64_t oc_hash_fnv1a64(uint64_t hash, const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OC_HASH_H */